@@ -10,6 +10,10 @@
 #include <sys/time.h>
 #include <signal.h>
 
+#include "timer_wheel_sim.h"
+#include "timerqueue_sim.h"
+#include "des_sim.h"
+
 // Logging Macros
 #define LOG_LEVEL_DEBUG 0
 #define LOG_LEVEL_INFO  1
@@ -28,11 +32,19 @@
 static int current_log_level = LOG_LEVEL_INFO;
 
 // Alarm Timer Constants
-#define MAX_ALARMS          256
 #define MAX_HANDLERS        64
-#define MIN_ALARM_INTERVAL  1000     // 1ms minimum interval
-#define MAX_ALARM_INTERVAL  86400000 // 24h maximum interval
+#define MIN_ALARM_INTERVAL  1000     // 1s minimum interval (ms)
+#define MAX_ALARM_INTERVAL  86400000 // 24h maximum interval (ms)
 #define TEST_DURATION       30       // seconds
+#define ALARM_TICK_NS       1000000ULL  // 1ms wheel tick
+#define NSEC_PER_MSEC       1000000ULL
+#define NSEC_PER_USEC       1000ULL
+#define SUSPEND_DURATION    1        // seconds
+#define NR_TEST_ALARMS      64
+#define NR_TEST_TIMEOUTS    4096     // one per simulated connection
+#define MIN_TEST_TIMEOUT    100      // ms
+#define MAX_TEST_TIMEOUT    2000     // ms
+#define TEST_REARMS_PER_MS  64       // packets that push a timeout out
 
 // Alarm Types
 typedef enum {
@@ -60,23 +72,38 @@ typedef enum {
 
 // Alarm Structure
 typedef struct alarm {
+    struct wheel_timer timer;       // expires in ALARM_TICK_NS ticks
     unsigned int id;
     alarm_type_t type;
     alarm_state_t state;
     alarm_flags_t flags;
-    uint64_t expires;
+    uint64_t expires;               // ns, CLOCK_MONOTONIC
+    uint64_t timeout;               // ns, as given to create_alarm
     uint64_t period;
     void (*callback)(void *data);
     void *data;
-    struct alarm *next;
 } alarm_t;
 
 // Alarm Queue Structure
+//
+// One timer wheel per alarm type: set and cancel are O(1) however many
+// alarms are armed, and a tick with nothing due costs one comparison.
 typedef struct {
-    alarm_t *head;
-    size_t count;
+    struct timer_wheel wheel;
+    size_t nr_wake;                 // armed ALARM_FLAG_WAKE_SYSTEM alarms
+    uint64_t now;                   // ns, while the wheel runs
     pthread_mutex_t lock;
     pthread_cond_t cond;
+    struct {
+        uint64_t set;
+        uint64_t periodic;
+        uint64_t cancelled;
+        uint64_t fired;
+        uint64_t expired;
+        uint64_t latency_sum;       // ns
+        uint64_t latency_max;
+        uint64_t latency_min;
+    } stats;
 } alarm_queue_t;
 
 // Alarm Statistics Structure
@@ -85,6 +112,7 @@ typedef struct {
     uint64_t active_alarms;
     uint64_t fired_alarms;
     uint64_t expired_alarms;
+    uint64_t cancelled_alarms;
     uint64_t periodic_alarms;
     uint64_t wakeup_events;
     double avg_latency;
@@ -96,13 +124,15 @@ typedef struct {
 // Alarm Manager Structure
 typedef struct {
     alarm_queue_t queues[4];  // One queue per alarm type
-    alarm_t *alarms[MAX_ALARMS];
-    size_t nr_alarms;
+    alarm_t **test_alarms;    // created by run_test, freed on destroy
+    size_t nr_test_alarms;
     bool running;
     bool system_suspended;
     pthread_mutex_t manager_lock;
     pthread_t timer_thread;
     pthread_t suspend_thread;
+    struct des_sim *sim;      // set while running in virtual time
+    bool suspend_wake;        // the current suspend has a wake alarm
     alarm_stats_t stats;
 } alarm_manager_t;
 
@@ -119,7 +149,7 @@ alarm_t* create_alarm(alarm_type_t type, alarm_flags_t flags,
 void destroy_alarm(alarm_t *alarm);
 
 int set_alarm(alarm_manager_t *manager, alarm_t *alarm);
-int cancel_alarm(alarm_manager_t *manager, unsigned int alarm_id);
+int cancel_alarm(alarm_manager_t *manager, alarm_t *alarm);
 
 void* timer_thread(void *arg);
 void* suspend_thread(void *arg);
@@ -127,9 +157,10 @@ void process_alarms(alarm_manager_t *manager);
 void simulate_system_suspend(alarm_manager_t *manager);
 
 void run_test(alarm_manager_t *manager);
+void run_test_virtual(alarm_manager_t *manager, uint64_t seed, uint64_t duration_us);
 void calculate_stats(alarm_manager_t *manager);
 void print_test_stats(alarm_manager_t *manager);
-void demonstrate_alarms(void);
+void demonstrate_alarms(const struct des_options *opts);
 
 // Utility Functions
 const char* get_log_level_string(int level) {
@@ -162,35 +193,101 @@ const char* get_alarm_state_string(alarm_state_t state) {
     }
 }
 
-// Create Alarm Queue
-alarm_queue_t* create_alarm_queue(void) {
-    alarm_queue_t *queue = malloc(sizeof(alarm_queue_t));
-    if (!queue) return NULL;
+// Current Time (ns, CLOCK_MONOTONIC)
+static uint64_t ktime_get(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// CLOCK_MONOTONIC as the manager sees it: virtual while a simulation runs
+static uint64_t alarm_now(alarm_manager_t *manager) {
+    return manager->sim ? manager->sim->now * NSEC_PER_USEC : ktime_get();
+}
+
+// Uniform in [0, n): seeded in virtual time, rand() otherwise
+static uint64_t alarm_rand(alarm_manager_t *manager, uint64_t n) {
+    return manager->sim ? des_rand_range(manager->sim, n) : (uint64_t)rand() % n;
+}
+
+// Wheel tick of an expiry, rounded up so an alarm never fires early
+static inline uint64_t alarm_expires_tick(uint64_t expires) {
+    return (expires + ALARM_TICK_NS - 1) / ALARM_TICK_NS;
+}
 
-    queue->head = NULL;
-    queue->count = 0;
+// Initialize Alarm Queue
+static void init_alarm_queue(alarm_queue_t *queue, uint64_t now) {
+    timer_wheel_init(&queue->wheel, now / ALARM_TICK_NS);
+    queue->nr_wake = 0;
+    queue->now = now;
     pthread_mutex_init(&queue->lock, NULL);
     pthread_cond_init(&queue->cond, NULL);
+    memset(&queue->stats, 0, sizeof(queue->stats));
+    queue->stats.latency_min = UINT64_MAX;
+}
+
+// Alarm Expiry (wheel callback, queue lock held)
+static void alarm_timer_fn(struct wheel_timer *timer, void *arg) {
+    alarm_t *alarm = container_of(timer, alarm_t, timer);
+    alarm_queue_t *queue = (alarm_queue_t*)arg;
+
+    // Beyond WHEEL_TIMEOUT_CUTOFF the wheel clamps the expiry: re-arm for the rest
+    if (queue->now < alarm->expires) {
+        timer_wheel_add(&queue->wheel, &alarm->timer,
+            alarm_expires_tick(alarm->expires), queue->now / ALARM_TICK_NS);
+        return;
+    }
 
-    return queue;
+    uint64_t latency = queue->now - alarm->expires;
+    queue->stats.fired++;
+    queue->stats.latency_sum += latency;
+    if (latency > queue->stats.latency_max) {
+        queue->stats.latency_max = latency;
+    }
+    if (latency < queue->stats.latency_min) {
+        queue->stats.latency_min = latency;
+    }
+
+    alarm->state = ALARM_STATE_FIRED;
+    if (alarm->callback) {
+        alarm->callback(alarm->data);
+    }
+
+    if ((alarm->flags & ALARM_FLAG_PERIODIC) && alarm->period) {
+        // Skip periods missed while suspended
+        alarm->expires += ((queue->now - alarm->expires) / alarm->period + 1) * alarm->period;
+        timer_wheel_add(&queue->wheel, &alarm->timer,
+            alarm_expires_tick(alarm->expires), queue->now / ALARM_TICK_NS);
+        alarm->state = ALARM_STATE_WAITING;
+    } else {
+        alarm->state = ALARM_STATE_EXPIRED;
+        queue->stats.expired++;
+        if (alarm->flags & ALARM_FLAG_WAKE_SYSTEM) {
+            queue->nr_wake--;
+        }
+    }
 }
 
 // Create Alarm
+//
+// expires is in ns: relative to when the alarm is set with
+// ALARM_FLAG_RELATIVE, CLOCK_MONOTONIC time otherwise.
 alarm_t* create_alarm(alarm_type_t type, alarm_flags_t flags,
     uint64_t expires, void (*callback)(void *data), void *data) {
     static unsigned int next_id = 0;
     alarm_t *alarm = malloc(sizeof(alarm_t));
     if (!alarm) return NULL;
 
+    wheel_timer_init(&alarm->timer, alarm_timer_fn);
     alarm->id = next_id++;
     alarm->type = type;
     alarm->state = ALARM_STATE_INACTIVE;
     alarm->flags = flags;
     alarm->expires = expires;
+    alarm->timeout = expires;
     alarm->period = (flags & ALARM_FLAG_PERIODIC) ? expires : 0;
     alarm->callback = callback;
     alarm->data = data;
-    alarm->next = NULL;
 
     return alarm;
 }
@@ -204,25 +301,17 @@ alarm_manager_t* create_alarm_manager(void) {
     }
 
     // Initialize alarm queues
+    manager->sim = NULL;
+    uint64_t now = alarm_now(manager);
     for (size_t i = 0; i < 4; i++) {
-        alarm_queue_t *queue = create_alarm_queue();
-        if (!queue) {
-            // Cleanup and return
-            for (size_t j = 0; j < i; j++) {
-                pthread_mutex_destroy(&manager->queues[j].lock);
-                pthread_cond_destroy(&manager->queues[j].cond);
-                free(&manager->queues[j]);
-            }
-            free(manager);
-            return NULL;
-        }
-        memcpy(&manager->queues[i], queue, sizeof(alarm_queue_t));
-        free(queue);
+        init_alarm_queue(&manager->queues[i], now);
     }
 
-    manager->nr_alarms = 0;
+    manager->test_alarms = NULL;
+    manager->nr_test_alarms = 0;
     manager->running = false;
     manager->system_suspended = false;
+    manager->suspend_wake = false;
     pthread_mutex_init(&manager->manager_lock, NULL);
     memset(&manager->stats, 0, sizeof(alarm_stats_t));
 
@@ -231,41 +320,33 @@ alarm_manager_t* create_alarm_manager(void) {
 }
 
 // Set Alarm
+//
+// Arms the alarm, or re-arms it if it is already waiting: a relative
+// alarm is pushed out to its timeout from now.  O(1) either way.
 int set_alarm(alarm_manager_t *manager, alarm_t *alarm) {
     if (!manager || !alarm || alarm->type >= 4) return -1;
 
-    pthread_mutex_lock(&manager->manager_lock);
-    if (manager->nr_alarms >= MAX_ALARMS) {
-        pthread_mutex_unlock(&manager->manager_lock);
-        return -1;
-    }
-
-    // Add to manager's alarm list
-    manager->alarms[manager->nr_alarms++] = alarm;
-
-    // Add to appropriate queue
     alarm_queue_t *queue = &manager->queues[alarm->type];
+    uint64_t now = alarm_now(manager);
+
     pthread_mutex_lock(&queue->lock);
 
-    // Insert in sorted order by expiry time
-    alarm_t **pp = &queue->head;
-    while (*pp && (*pp)->expires <= alarm->expires) {
-        pp = &(*pp)->next;
+    if (!wheel_timer_pending(&alarm->timer) && (alarm->flags & ALARM_FLAG_WAKE_SYSTEM)) {
+        queue->nr_wake++;
     }
-    alarm->next = *pp;
-    *pp = alarm;
-    queue->count++;
 
-    alarm->state = ALARM_STATE_WAITING;
-    manager->stats.total_alarms++;
-    manager->stats.active_alarms++;
+    alarm->expires = (alarm->flags & ALARM_FLAG_RELATIVE) ?
+        now + alarm->timeout : alarm->timeout;
+    timer_wheel_add(&queue->wheel, &alarm->timer,
+        alarm_expires_tick(alarm->expires), now / ALARM_TICK_NS);
 
+    alarm->state = ALARM_STATE_WAITING;
+    queue->stats.set++;
     if (alarm->flags & ALARM_FLAG_PERIODIC) {
-        manager->stats.periodic_alarms++;
+        queue->stats.periodic++;
     }
 
     pthread_mutex_unlock(&queue->lock);
-    pthread_mutex_unlock(&manager->manager_lock);
 
     LOG(LOG_LEVEL_DEBUG, "Set alarm %u (type: %s, expires: %lu)",
         alarm->id, get_alarm_type_string(alarm->type), alarm->expires);
@@ -273,53 +354,26 @@ int set_alarm(alarm_manager_t *manager, alarm_t *alarm) {
 }
 
 // Cancel Alarm
-int cancel_alarm(alarm_manager_t *manager, unsigned int alarm_id) {
-    if (!manager) return -1;
-
-    pthread_mutex_lock(&manager->manager_lock);
-    alarm_t *alarm = NULL;
-    size_t index;
-
-    // Find alarm in manager's list
-    for (index = 0; index < manager->nr_alarms; index++) {
-        if (manager->alarms[index]->id == alarm_id) {
-            alarm = manager->alarms[index];
-            break;
-        }
-    }
-
-    if (!alarm) {
-        pthread_mutex_unlock(&manager->manager_lock);
-        return -1;
-    }
+int cancel_alarm(alarm_manager_t *manager, alarm_t *alarm) {
+    if (!manager || !alarm || alarm->type >= 4) return -1;
 
-    // Remove from queue
     alarm_queue_t *queue = &manager->queues[alarm->type];
     pthread_mutex_lock(&queue->lock);
 
-    alarm_t **pp = &queue->head;
-    while (*pp && (*pp)->id != alarm_id) {
-        pp = &(*pp)->next;
-    }
-    if (*pp) {
-        *pp = (*pp)->next;
-        queue->count--;
+    bool pending = timer_wheel_del(&queue->wheel, &alarm->timer);
+    if (pending) {
+        alarm->state = ALARM_STATE_INACTIVE;
+        queue->stats.cancelled++;
+        if (alarm->flags & ALARM_FLAG_WAKE_SYSTEM) {
+            queue->nr_wake--;
+        }
     }
 
-    alarm->state = ALARM_STATE_INACTIVE;
-    manager->stats.active_alarms--;
-
     pthread_mutex_unlock(&queue->lock);
 
-    // Remove from manager's list
-    for (size_t i = index; i < manager->nr_alarms - 1; i++) {
-        manager->alarms[i] = manager->alarms[i + 1];
-    }
-    manager->nr_alarms--;
+    if (!pending) return -1;
 
-    pthread_mutex_unlock(&manager->manager_lock);
-
-    LOG(LOG_LEVEL_DEBUG, "Cancelled alarm %u", alarm_id);
+    LOG(LOG_LEVEL_DEBUG, "Cancelled alarm %u", alarm->id);
     return 0;
 }
 
@@ -338,65 +392,19 @@ void* timer_thread(void *arg) {
 }
 
 // Process Alarms
+//
+// A tick with nothing due returns after one comparison per queue; after
+// a suspend the wheel catches up in one pass, firing everything overdue.
 void process_alarms(alarm_manager_t *manager) {
     if (!manager) return;
 
-    struct timespec now;
-    clock_gettime(CLOCK_MONOTONIC, &now);
-    uint64_t current_time = now.tv_sec * 1000000000ULL + now.tv_nsec;
+    uint64_t now = alarm_now(manager);
 
-    // Process each queue
     for (size_t i = 0; i < 4; i++) {
         alarm_queue_t *queue = &manager->queues[i];
         pthread_mutex_lock(&queue->lock);
-
-        alarm_t *alarm = queue->head;
-        alarm_t *prev = NULL;
-
-        while (alarm && alarm->expires <= current_time) {
-            // Fire alarm
-            if (alarm->callback) {
-                alarm->callback(alarm->data);
-            }
-
-            alarm->state = ALARM_STATE_FIRED;
-            manager->stats.fired_alarms++;
-
-            // Calculate latency
-            double latency = (current_time - alarm->expires) / 1000000.0;  // ms
-            if (latency > manager->stats.max_latency) {
-                manager->stats.max_latency = latency;
-            }
-            if (latency < manager->stats.min_latency || 
-                manager->stats.min_latency == 0) {
-                manager->stats.min_latency = latency;
-            }
-
-            // Handle periodic alarms
-            if (alarm->flags & ALARM_FLAG_PERIODIC) {
-                alarm->expires += alarm->period;
-                // Reinsert in sorted order
-                alarm_t **pp = &queue->head;
-                while (*pp && (*pp)->expires <= alarm->expires) {
-                    pp = &(*pp)->next;
-                }
-                if (prev) prev->next = alarm->next;
-                else queue->head = alarm->next;
-                alarm->next = *pp;
-                *pp = alarm;
-            } else {
-                // Remove non-periodic alarm
-                if (prev) prev->next = alarm->next;
-                else queue->head = alarm->next;
-                queue->count--;
-                alarm->state = ALARM_STATE_EXPIRED;
-                manager->stats.expired_alarms++;
-                manager->stats.active_alarms--;
-            }
-
-            alarm = alarm->next;
-        }
-
+        queue->now = now;
+        timer_wheel_run(&queue->wheel, now / ALARM_TICK_NS, queue);
         pthread_mutex_unlock(&queue->lock);
     }
 }
@@ -407,83 +415,132 @@ void* suspend_thread(void *arg) {
 
     while (manager->running) {
         simulate_system_suspend(manager);
-        sleep(rand() % 10 + 5);  // Random interval between suspends
+        sleep(alarm_rand(manager, 10) + 5);  // Random interval between suspends
     }
 
     return NULL;
 }
 
-// Simulate System Suspend
-void simulate_system_suspend(alarm_manager_t *manager) {
-    if (!manager) return;
-
-    pthread_mutex_lock(&manager->manager_lock);
+// Enter suspend; caller holds manager_lock
+static void alarm_suspend_begin(alarm_manager_t *manager) {
     manager->system_suspended = true;
     LOG(LOG_LEVEL_INFO, "System entering suspend state");
 
     // Check for wake alarms
     bool has_wake_alarm = false;
-    for (size_t i = 0; i < 4; i++) {
+    for (size_t i = 0; i < 4 && !has_wake_alarm; i++) {
         alarm_queue_t *queue = &manager->queues[i];
         pthread_mutex_lock(&queue->lock);
-
-        alarm_t *alarm = queue->head;
-        while (alarm) {
-            if (alarm->flags & ALARM_FLAG_WAKE_SYSTEM) {
-                has_wake_alarm = true;
-                manager->stats.wakeup_events++;
-                break;
-            }
-            alarm = alarm->next;
-        }
-
+        has_wake_alarm = queue->nr_wake > 0;
         pthread_mutex_unlock(&queue->lock);
-        if (has_wake_alarm) break;
     }
+    if (has_wake_alarm) {
+        manager->stats.wakeup_events++;
+    }
+    manager->suspend_wake = has_wake_alarm;
+}
 
-    // Simulate suspend
-    sleep(1);
-
-    // Wake up
+// Leave suspend; caller holds manager_lock
+static void alarm_suspend_end(alarm_manager_t *manager) {
     manager->system_suspended = false;
     LOG(LOG_LEVEL_INFO, "System resuming from suspend (wake alarm: %s)",
-        has_wake_alarm ? "yes" : "no");
-
-    pthread_mutex_unlock(&manager->manager_lock);
+        manager->suspend_wake ? "yes" : "no");
 }
 
-// Run Test
-void run_test(alarm_manager_t *manager) {
+// Simulate System Suspend
+void simulate_system_suspend(alarm_manager_t *manager) {
     if (!manager) return;
 
-    LOG(LOG_LEVEL_INFO, "Starting alarm timer test...");
+    pthread_mutex_lock(&manager->manager_lock);
+    alarm_suspend_begin(manager);
+
+    // Simulate suspend
+    sleep(SUSPEND_DURATION);
+
+    // Wake up
+    alarm_suspend_end(manager);
+    pthread_mutex_unlock(&manager->manager_lock);
+}
+
+// Create test alarms and connection timeouts; returns the index of the
+// first timeout in test_alarms, or -1
+static ssize_t create_test_alarms(alarm_manager_t *manager) {
+    manager->test_alarms = calloc(NR_TEST_ALARMS + NR_TEST_TIMEOUTS, sizeof(alarm_t*));
+    if (!manager->test_alarms) {
+        LOG(LOG_LEVEL_ERROR, "Failed to allocate test alarms");
+        return -1;
+    }
 
     // Create test alarms
-    for (size_t i = 0; i < MAX_ALARMS/4; i++) {
+    uint64_t now = alarm_now(manager);
+    for (size_t i = 0; i < NR_TEST_ALARMS; i++) {
         // Create various types of alarms
-        alarm_type_t type = rand() % 4;
+        alarm_type_t type = alarm_rand(manager, 4);
         alarm_flags_t flags = ALARM_FLAG_NONE;
-        if (rand() % 2) flags |= ALARM_FLAG_RELATIVE;
-        if (rand() % 3 == 0) flags |= ALARM_FLAG_PERIODIC;
-        if (rand() % 4 == 0) flags |= ALARM_FLAG_WAKE_SYSTEM;
-
-        uint64_t expires = rand() % 
-            (MAX_ALARM_INTERVAL - MIN_ALARM_INTERVAL) + MIN_ALARM_INTERVAL;
+        if (alarm_rand(manager, 2)) flags |= ALARM_FLAG_RELATIVE;
+        if (alarm_rand(manager, 3) == 0) flags |= ALARM_FLAG_PERIODIC;
+        if (alarm_rand(manager, 4) == 0) flags |= ALARM_FLAG_WAKE_SYSTEM;
+
+        uint64_t expires = (alarm_rand(manager, MAX_ALARM_INTERVAL - MIN_ALARM_INTERVAL) +
+            MIN_ALARM_INTERVAL) * NSEC_PER_MSEC;
+        if (!(flags & ALARM_FLAG_RELATIVE)) {
+            expires += now;
+        }
 
         alarm_t *alarm = create_alarm(type, flags, expires,
             NULL, NULL);  // No callback for test
         if (alarm) {
+            manager->test_alarms[manager->nr_test_alarms++] = alarm;
             set_alarm(manager, alarm);
         }
     }
 
+    // Connection timeouts: pushed out on every packet, so most never fire
+    size_t first_timeout = manager->nr_test_alarms;
+    for (size_t i = 0; i < NR_TEST_TIMEOUTS; i++) {
+        uint64_t timeout = (alarm_rand(manager, MAX_TEST_TIMEOUT - MIN_TEST_TIMEOUT) +
+            MIN_TEST_TIMEOUT) * NSEC_PER_MSEC;
+
+        alarm_t *alarm = create_alarm(ALARM_MONOTONIC, ALARM_FLAG_RELATIVE, timeout,
+            NULL, NULL);
+        if (alarm) {
+            manager->test_alarms[manager->nr_test_alarms++] = alarm;
+            set_alarm(manager, alarm);
+        }
+    }
+    return (ssize_t)first_timeout;
+}
+
+// One ms of traffic: some connections see a packet
+static void rearm_test_timeouts(alarm_manager_t *manager, size_t first_timeout) {
+    size_t nr_timeouts = manager->nr_test_alarms - first_timeout;
+
+    for (size_t i = 0; nr_timeouts && i < TEST_REARMS_PER_MS; i++) {
+        set_alarm(manager, manager->test_alarms[first_timeout +
+            alarm_rand(manager, nr_timeouts)]);
+    }
+}
+
+// Run Test
+void run_test(alarm_manager_t *manager) {
+    if (!manager) return;
+
+    LOG(LOG_LEVEL_INFO, "Starting alarm timer test...");
+
+    ssize_t first_timeout = create_test_alarms(manager);
+    if (first_timeout < 0) return;
+
     // Start threads
     manager->running = true;
     pthread_create(&manager->timer_thread, NULL, timer_thread, manager);
     pthread_create(&manager->suspend_thread, NULL, suspend_thread, manager);
 
-    // Run test
-    sleep(TEST_DURATION);
+    // Run test: every ms some connections see a packet
+    uint64_t end = alarm_now(manager) + TEST_DURATION * 1000000000ULL;
+    while (alarm_now(manager) < end) {
+        rearm_test_timeouts(manager, first_timeout);
+        usleep(1000);
+    }
 
     // Stop threads
     manager->running = false;
@@ -491,6 +548,86 @@ void run_test(alarm_manager_t *manager) {
     pthread_join(manager->suspend_thread, NULL);
 
     // Calculate statistics
+    manager->stats.test_duration = TEST_DURATION;
+    calculate_stats(manager);
+}
+
+// Virtual time: the 1ms tick of timer_thread
+static void virtual_tick_event(struct des_sim *sim, void *arg, uint64_t data) {
+    alarm_manager_t *manager = (alarm_manager_t*)arg;
+
+    if (!manager->system_suspended) {
+        process_alarms(manager);
+    }
+    des_schedule(sim, 1000, virtual_tick_event, manager, data);
+}
+
+// The traffic loop of run_test; data is the first timeout's index
+static void virtual_packet_event(struct des_sim *sim, void *arg, uint64_t data) {
+    alarm_manager_t *manager = (alarm_manager_t*)arg;
+
+    rearm_test_timeouts(manager, data);
+    des_schedule(sim, 1000, virtual_packet_event, manager, data);
+}
+
+// suspend_thread: suspend, resume a second later, sleep 5-14 s
+static void virtual_resume_event(struct des_sim *sim, void *arg, uint64_t data);
+
+static void virtual_suspend_event(struct des_sim *sim, void *arg, uint64_t data) {
+    alarm_manager_t *manager = (alarm_manager_t*)arg;
+
+    alarm_suspend_begin(manager);
+    des_schedule(sim, SUSPEND_DURATION * 1000000ULL, virtual_resume_event, manager, data);
+}
+
+static void virtual_resume_event(struct des_sim *sim, void *arg, uint64_t data) {
+    alarm_manager_t *manager = (alarm_manager_t*)arg;
+
+    alarm_suspend_end(manager);
+    des_schedule(sim, (alarm_rand(manager, 10) + 5) * 1000000ULL,
+        virtual_suspend_event, manager, data);
+}
+
+// Run Test in virtual time: the workload of run_test, driven by the
+// event engine and a seeded RNG, so runs are fast and reproducible
+void run_test_virtual(alarm_manager_t *manager, uint64_t seed, uint64_t duration_us) {
+    if (!manager) return;
+
+    struct des_sim sim;
+    if (!des_init(&sim, seed)) {
+        LOG(LOG_LEVEL_ERROR, "Failed to initialize simulation");
+        return;
+    }
+
+    LOG(LOG_LEVEL_INFO, "Starting alarm timer test (virtual time, seed %lu, %.0f s)...",
+        seed, duration_us / 1e6);
+
+    // The queues are still empty: restart their wheels at virtual zero so
+    // bucket boundaries do not depend on the real clock
+    manager->sim = &sim;
+    for (size_t i = 0; i < 4; i++) {
+        timer_wheel_init(&manager->queues[i].wheel, 0);
+        manager->queues[i].now = 0;
+    }
+
+    ssize_t first_timeout = create_test_alarms(manager);
+    if (first_timeout >= 0) {
+        des_schedule(&sim, 0, virtual_suspend_event, manager, 0);
+        des_schedule(&sim, 1000, virtual_packet_event, manager, first_timeout);
+        des_schedule(&sim, 1000, virtual_tick_event, manager, 0);
+
+        double start = (double)ktime_get();
+        des_run_until(&sim, duration_us);
+        double elapsed = (ktime_get() - start) / 1e9;
+
+        LOG(LOG_LEVEL_INFO, "Simulated %.0f s in %.3f s (%lu events)",
+            duration_us / 1e6, elapsed, sim.nr_fired);
+    }
+    manager->sim = NULL;
+    des_destroy(&sim);
+
+    // Calculate statistics
+    manager->stats.test_duration = duration_us / 1e6;
     calculate_stats(manager);
 }
 
@@ -498,12 +635,40 @@ void run_test(alarm_manager_t *manager) {
 void calculate_stats(alarm_manager_t *manager) {
     if (!manager) return;
 
-    if (manager->stats.fired_alarms > 0) {
-        manager->stats.avg_latency = 
-            (manager->stats.max_latency + manager->stats.min_latency) / 2.0;
+    alarm_stats_t *stats = &manager->stats;
+    uint64_t latency_sum = 0, latency_max = 0, latency_min = UINT64_MAX;
+
+    stats->total_alarms = 0;
+    stats->active_alarms = 0;
+    stats->fired_alarms = 0;
+    stats->expired_alarms = 0;
+    stats->cancelled_alarms = 0;
+    stats->periodic_alarms = 0;
+
+    for (size_t i = 0; i < 4; i++) {
+        alarm_queue_t *queue = &manager->queues[i];
+        pthread_mutex_lock(&queue->lock);
+        stats->total_alarms += queue->stats.set;
+        stats->active_alarms += queue->wheel.nr_timers;
+        stats->fired_alarms += queue->stats.fired;
+        stats->expired_alarms += queue->stats.expired;
+        stats->cancelled_alarms += queue->stats.cancelled;
+        stats->periodic_alarms += queue->stats.periodic;
+        latency_sum += queue->stats.latency_sum;
+        if (queue->stats.latency_max > latency_max) {
+            latency_max = queue->stats.latency_max;
+        }
+        if (queue->stats.latency_min < latency_min) {
+            latency_min = queue->stats.latency_min;
+        }
+        pthread_mutex_unlock(&queue->lock);
     }
 
-    manager->stats.test_duration = TEST_DURATION;
+    if (stats->fired_alarms > 0) {
+        stats->avg_latency = latency_sum / 1000000.0 / stats->fired_alarms;  // ms
+        stats->max_latency = latency_max / 1000000.0;
+        stats->min_latency = latency_min / 1000000.0;
+    }
 }
 
 // Print Test Statistics
@@ -517,6 +682,7 @@ void print_test_stats(alarm_manager_t *manager) {
     printf("Active Alarms:     %lu\n", manager->stats.active_alarms);
     printf("Fired Alarms:      %lu\n", manager->stats.fired_alarms);
     printf("Expired Alarms:    %lu\n", manager->stats.expired_alarms);
+    printf("Cancelled Alarms:  %lu\n", manager->stats.cancelled_alarms);
     printf("Periodic Alarms:   %lu\n", manager->stats.periodic_alarms);
     printf("Wakeup Events:     %lu\n", manager->stats.wakeup_events);
     printf("Avg Latency:       %.2f ms\n", manager->stats.avg_latency);
@@ -527,8 +693,8 @@ void print_test_stats(alarm_manager_t *manager) {
     printf("\nQueue Details:\n");
     for (size_t i = 0; i < 4; i++) {
         alarm_queue_t *queue = &manager->queues[i];
-        printf("  %s Queue: %zu alarms\n",
-            get_alarm_type_string(i), queue->count);
+        printf("  %s Queue: %zu alarms (%zu wake)\n",
+            get_alarm_type_string(i), queue->wheel.nr_timers, queue->nr_wake);
     }
 }
 
@@ -541,13 +707,6 @@ void destroy_alarm(alarm_t *alarm) {
 void destroy_alarm_queue(alarm_queue_t *queue) {
     if (!queue) return;
 
-    alarm_t *current = queue->head;
-    while (current) {
-        alarm_t *next = current->next;
-        destroy_alarm(current);
-        current = next;
-    }
-
     pthread_mutex_destroy(&queue->lock);
     pthread_cond_destroy(&queue->cond);
 }
@@ -557,9 +716,11 @@ void destroy_alarm_manager(alarm_manager_t *manager) {
     if (!manager) return;
 
     // Clean up alarms
-    for (size_t i = 0; i < manager->nr_alarms; i++) {
-        destroy_alarm(manager->alarms[i]);
+    for (size_t i = 0; i < manager->nr_test_alarms; i++) {
+        cancel_alarm(manager, manager->test_alarms[i]);
+        destroy_alarm(manager->test_alarms[i]);
     }
+    free(manager->test_alarms);
 
     // Clean up queues
     for (size_t i = 0; i < 4; i++) {
@@ -572,19 +733,264 @@ void destroy_alarm_manager(alarm_manager_t *manager) {
 }
 
 // Demonstrate Alarms
-void demonstrate_alarms(void) {
+void demonstrate_alarms(const struct des_options *opts) {
     printf("Starting alarm timer demonstration...\n");
 
     // Create and run alarm timer test
     alarm_manager_t *manager = create_alarm_manager();
     if (manager) {
-        run_test(manager);
+        if (opts->threaded)
+            run_test(manager);
+        else
+            run_test_virtual(manager, opts->seed, opts->duration_us);
         print_test_stats(manager);
         destroy_alarm_manager(manager);
     }
 }
 
-int main(void) {
+/*
+ * Benchmark, no threads: a wheel driven directly in virtual 1ms ticks
+ * against a timerqueue, the rbtree hrtimer_sim.c keeps per clock base.
+ *
+ * Re-arm: n connection timeouts of 200ms-30s are armed; every tick n/100
+ * random ones see a packet and are pushed out, then whatever is due
+ * expires and the next expiry is looked up, as an idle NOHZ CPU would.
+ * Few ever fire, which is the case the wheel is built for; the ones
+ * that do fire late by up to a granule of their level.
+ *
+ * Arm/cancel: with n timeouts outstanding, 64 requests in flight each
+ * arm a timeout and cancel it when the reply comes.
+ */
+#define BENCH_OPS           2000000
+#define BENCH_MIN_TIMEOUT   200         // ticks
+#define BENCH_MAX_TIMEOUT   30000
+#define BENCH_REARM_DIV     100
+#define BENCH_IN_FLIGHT     64
+
+static volatile uint64_t bench_sink;
+
+static inline uint64_t bench_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline uint64_t bench_timeout(uint64_t *seed) {
+    return BENCH_MIN_TIMEOUT + bench_rand(seed) % (BENCH_MAX_TIMEOUT - BENCH_MIN_TIMEOUT);
+}
+
+typedef struct {
+    struct wheel_timer timer;
+    uint64_t armed;                 // tick it was last armed at
+} bench_wheel_timer_t;
+
+typedef struct {
+    uint64_t now;
+    uint64_t fired;
+    uint64_t late_sum;              // ticks
+    uint64_t late_max;
+    uint64_t timeout_sum;
+} bench_expiry_t;
+
+static void bench_wheel_fn(struct wheel_timer *timer, void *arg) {
+    bench_wheel_timer_t *t = container_of(timer, bench_wheel_timer_t, timer);
+    bench_expiry_t *expiry = (bench_expiry_t*)arg;
+    uint64_t late = expiry->now - timer->expires;
+
+    expiry->fired++;
+    expiry->late_sum += late;
+    expiry->timeout_sum += timer->expires - t->armed;
+    if (late > expiry->late_max) {
+        expiry->late_max = late;
+    }
+}
+
+static double bench_rearm_tree(size_t n, uint64_t seed, uint64_t *fired) {
+    struct timerqueue_node *timers = calloc(n, sizeof(*timers));
+    if (!timers) return 0;
+
+    struct timerqueue_head head;
+    timerqueue_init_head(&head);
+    for (size_t i = 0; i < n; i++) {
+        timerqueue_init(&timers[i]);
+        timers[i].expires = bench_timeout(&seed);
+        timerqueue_add(&head, &timers[i]);
+    }
+
+    size_t per_tick = n / BENCH_REARM_DIV ? n / BENCH_REARM_DIV : 1;
+    uint64_t now = 0;
+    *fired = 0;
+
+    double start = bench_now();
+    for (size_t op = 0; op < BENCH_OPS; ) {
+        now++;
+        for (size_t j = 0; j < per_tick; j++, op++) {
+            struct timerqueue_node *timer = &timers[bench_rand(&seed) % n];
+            if (timerqueue_node_queued(timer)) {
+                timerqueue_del(&head, timer);
+            }
+            timer->expires = now + bench_timeout(&seed);
+            timerqueue_add(&head, timer);
+        }
+
+        struct timerqueue_node *next;
+        while ((next = timerqueue_getnext(&head)) && next->expires <= now) {
+            timerqueue_del(&head, next);
+            (*fired)++;
+        }
+        bench_sink = next ? next->expires : 0;
+    }
+    double elapsed = bench_now() - start;
+
+    free(timers);
+    return elapsed;
+}
+
+static double bench_rearm_wheel(size_t n, uint64_t seed, bench_expiry_t *expiry) {
+    bench_wheel_timer_t *timers = calloc(n, sizeof(*timers));
+    struct timer_wheel *wheel = malloc(sizeof(*wheel));
+    if (!timers || !wheel) {
+        free(timers);
+        free(wheel);
+        return 0;
+    }
+
+    timer_wheel_init(wheel, 0);
+    for (size_t i = 0; i < n; i++) {
+        wheel_timer_init(&timers[i].timer, bench_wheel_fn);
+        timer_wheel_add(wheel, &timers[i].timer, bench_timeout(&seed), 0);
+    }
+
+    size_t per_tick = n / BENCH_REARM_DIV ? n / BENCH_REARM_DIV : 1;
+    memset(expiry, 0, sizeof(*expiry));
+
+    double start = bench_now();
+    for (size_t op = 0; op < BENCH_OPS; ) {
+        expiry->now++;
+        for (size_t j = 0; j < per_tick; j++, op++) {
+            bench_wheel_timer_t *timer = &timers[bench_rand(&seed) % n];
+            timer->armed = expiry->now;
+            timer_wheel_add(wheel, &timer->timer, expiry->now + bench_timeout(&seed),
+                            expiry->now);
+        }
+
+        timer_wheel_run(wheel, expiry->now, expiry);
+        bench_sink = timer_wheel_next_expiry(wheel);
+    }
+    double elapsed = bench_now() - start;
+
+    free(timers);
+    free(wheel);
+    return elapsed;
+}
+
+static double bench_cancel_tree(size_t n, uint64_t seed) {
+    struct timerqueue_node *timers = calloc(n + BENCH_IN_FLIGHT, sizeof(*timers));
+    if (!timers) return 0;
+
+    struct timerqueue_head head;
+    timerqueue_init_head(&head);
+    for (size_t i = 0; i < n + BENCH_IN_FLIGHT; i++) {
+        timerqueue_init(&timers[i]);
+    }
+    for (size_t i = 0; i < n; i++) {
+        timers[i].expires = bench_timeout(&seed);
+        timerqueue_add(&head, &timers[i]);
+    }
+
+    double start = bench_now();
+    for (size_t op = 0; op < BENCH_OPS; op++) {
+        struct timerqueue_node *timer = &timers[n + op % BENCH_IN_FLIGHT];
+        if (timerqueue_node_queued(timer)) {
+            timerqueue_del(&head, timer);
+        }
+        timer->expires = bench_timeout(&seed);
+        timerqueue_add(&head, timer);
+    }
+    double elapsed = bench_now() - start;
+
+    free(timers);
+    return elapsed;
+}
+
+static double bench_cancel_wheel(size_t n, uint64_t seed) {
+    struct wheel_timer *timers = calloc(n + BENCH_IN_FLIGHT, sizeof(*timers));
+    struct timer_wheel *wheel = malloc(sizeof(*wheel));
+    if (!timers || !wheel) {
+        free(timers);
+        free(wheel);
+        return 0;
+    }
+
+    timer_wheel_init(wheel, 0);
+    for (size_t i = 0; i < n + BENCH_IN_FLIGHT; i++) {
+        wheel_timer_init(&timers[i], NULL);
+    }
+    for (size_t i = 0; i < n; i++) {
+        timer_wheel_add(wheel, &timers[i], bench_timeout(&seed), 0);
+    }
+
+    double start = bench_now();
+    for (size_t op = 0; op < BENCH_OPS; op++) {
+        struct wheel_timer *timer = &timers[n + op % BENCH_IN_FLIGHT];
+        timer_wheel_del(wheel, timer);
+        timer_wheel_add(wheel, timer, bench_timeout(&seed), 0);
+    }
+    double elapsed = bench_now() - start;
+
+    free(timers);
+    free(wheel);
+    return elapsed;
+}
+
+static int run_benchmark(void) {
+    static const size_t sizes[] = { 1000, 10000, 100000, 1000000 };
+
+    printf("Re-arm connection timeouts (%d-%d ms, n/%d per 1 ms tick, %d re-arms)\n",
+           BENCH_MIN_TIMEOUT, BENCH_MAX_TIMEOUT, BENCH_REARM_DIV, BENCH_OPS);
+    printf("  %7s %13s %10s %8s %14s %22s\n",
+           "timers", "timerqueue", "wheel", "speedup", "fired (tq/wh)", "wheel late avg/max");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        uint64_t tree_fired = 0;
+        bench_expiry_t expiry;
+        double tree_ns = bench_rearm_tree(sizes[i], 42, &tree_fired) * 1e9 / BENCH_OPS;
+        double wheel_ns = bench_rearm_wheel(sizes[i], 42, &expiry) * 1e9 / BENCH_OPS;
+        printf("  %7zu %10.0f ns %7.0f ns %7.1fx %7lu/%-6lu %6.1f ms %4lu ms (%.1f%%)\n",
+               sizes[i], tree_ns, wheel_ns, wheel_ns > 0 ? tree_ns / wheel_ns : 0.0,
+               tree_fired, expiry.fired,
+               expiry.fired ? (double)expiry.late_sum / expiry.fired : 0.0, expiry.late_max,
+               expiry.timeout_sum ? 100.0 * expiry.late_sum / expiry.timeout_sum : 0.0);
+    }
+
+    printf("\nArm and cancel with n outstanding (%d in flight, %d pairs)\n",
+           BENCH_IN_FLIGHT, BENCH_OPS);
+    printf("  %7s %13s %10s %8s\n", "timers", "timerqueue", "wheel", "speedup");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        double tree_ns = bench_cancel_tree(sizes[i], 7) * 1e9 / BENCH_OPS;
+        double wheel_ns = bench_cancel_wheel(sizes[i], 7) * 1e9 / BENCH_OPS;
+        printf("  %7zu %10.0f ns %7.0f ns %7.1fx\n",
+               sizes[i], tree_ns, wheel_ns, wheel_ns > 0 ? tree_ns / wheel_ns : 0.0);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        return run_benchmark();
+
+    struct des_options opts;
+    if (!des_parse_options(argc, argv, &opts, TEST_DURATION * 1000000ULL))
+        return 1;
+
     // Set log level
     current_log_level = LOG_LEVEL_INFO;
 
@@ -592,7 +998,7 @@ int main(void) {
     srand(time(NULL));
 
     // Run demonstration
-    demonstrate_alarms();
+    demonstrate_alarms(&opts);
 
     return 0;
 }
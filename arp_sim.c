@@ -8,6 +8,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <stdatomic.h>
 
 // Logging Macros
 #define LOG_LEVEL_DEBUG 0
@@ -27,13 +28,24 @@
 static int current_log_level = LOG_LEVEL_INFO;
 
 // ARP Constants
-#define MAX_ARP_ENTRIES    1024
+#define MAX_ARP_ENTRIES    131072
 #define MAX_PENDING_PKTS   64
 #define ARP_CACHE_TIMEOUT  300    // 5 minutes
 #define ARP_RETRY_TIME     1      // 1 second
 #define MAX_ARP_RETRIES    3
+#define ARP_REACHABLE_TIME 30     // Base, randomized to 0.5x-1.5x
+#define ARP_DELAY_TIME     5      // STALE entry in use, wait before probing
 #define TEST_DURATION      30     // seconds
 
+// Neighbour Table
+#define ARP_HASH_BITS      17     // 128K chains for 100K+ neighbours
+#define ARP_HASH_SIZE      (1U << ARP_HASH_BITS)
+#define ARP_HASH_LOCKS     256
+#define ARP_WHEEL_TICK_MS  100
+#define ARP_WHEEL_BITS     10     // 1024 slots, 102.4s per revolution
+#define ARP_WHEEL_SIZE     (1U << ARP_WHEEL_BITS)
+#define ARP_BENCH_ENTRIES  100000
+
 // Hardware Types
 #define ARPHRD_ETHER      1
 #define ARPHRD_IEEE802    6
@@ -52,14 +64,24 @@ static int current_log_level = LOG_LEVEL_INFO;
 #define ETH_ALEN         6
 #define IPV4_ALEN        4
 
-// ARP Entry States
+// ARP Entry States (neighbour unreachability detection)
 typedef enum {
     ARP_NONE,
-    ARP_INCOMPLETE,
-    ARP_VALID,
+    ARP_INCOMPLETE,     // Request sent, no answer yet
+    ARP_REACHABLE,      // Confirmed within the reachable time
+    ARP_STALE,          // Usable, but not recently confirmed
+    ARP_DELAY,          // Used while stale, waiting before probing
+    ARP_PROBE,          // Unicast probes outstanding
     ARP_FAILED
 } arp_state_t;
 
+// Entry Timer States
+typedef enum {
+    ARP_TIMER_IDLE,
+    ARP_TIMER_PENDING,  // Linked on the wheel or the expired list
+    ARP_TIMER_FIRING    // Taken off the wheel, handler not yet run
+} arp_timer_state_t;
+
 // MAC Address Structure
 typedef struct {
     uint8_t addr[ETH_ALEN];
@@ -85,40 +107,74 @@ typedef struct pending_pkt {
     struct pending_pkt *next;
 } pending_pkt_t;
 
+// Hash chains end in a marker holding the bucket index, so a lockless
+// reader that followed a recycled entry onto another chain notices
+#define ARP_NULLS_MARKER(i)  ((struct arp_entry *)(((uintptr_t)(i) << 1) | 1))
+#define arp_is_nulls(p)      ((uintptr_t)(p) & 1)
+#define arp_nulls_value(p)   ((uint32_t)((uintptr_t)(p) >> 1))
+
 // ARP Entry Structure
 typedef struct arp_entry {
     uint32_t ip;
-    mac_addr_t mac;
-    arp_state_t state;
-    time_t created;
-    time_t updated;
+    uint32_t hash;
+    mac_addr_t mac;                   // Written under lock, read via ha_seq
+    atomic_uint ha_seq;               // Odd while mac is being rewritten
+    _Atomic(arp_state_t) state;       // Written under lock
+    atomic_int refcnt;                // Zero once on the free list
+    uint64_t created;                 // Times in ms, see arp_now_ms()
+    uint64_t updated;
+    _Atomic uint64_t confirmed;       // Last reachability confirmation
+    _Atomic uint64_t used;            // Last packet sent through the entry
     int retry_count;
     pending_pkt_t *pending;
-    struct arp_entry *next;
+    pending_pkt_t *pending_tail;
+    int pending_len;
+    bool dead;                        // Unhashed, must not be re-armed
+    // Timer, under manager->wheel_lock
+    uint64_t timer_tick;
+    arp_timer_state_t timer_state;
+    struct arp_entry *tnext;
+    struct arp_entry **tpprev;
+    _Atomic(struct arp_entry *) next; // Hash chain
+    struct arp_entry *free_next;
     pthread_mutex_t lock;
 } arp_entry_t;
 
 // Statistics Structure
 typedef struct {
-    uint64_t requests_sent;
-    uint64_t requests_received;
-    uint64_t replies_sent;
-    uint64_t replies_received;
-    uint64_t cache_hits;
-    uint64_t cache_misses;
-    uint64_t cache_timeouts;
-    uint64_t retries;
-    uint64_t failed_resolves;
+    _Atomic uint64_t requests_sent;
+    _Atomic uint64_t requests_received;
+    _Atomic uint64_t replies_sent;
+    _Atomic uint64_t replies_received;
+    _Atomic uint64_t cache_hits;
+    _Atomic uint64_t cache_misses;
+    _Atomic uint64_t cache_timeouts;
+    _Atomic uint64_t retries;
+    _Atomic uint64_t failed_resolves;
+    _Atomic uint64_t pkts_sent;
+    _Atomic uint64_t unres_discards;
+    _Atomic uint64_t gc_removed;
 } arp_stats_t;
 
 // ARP Manager Structure
 typedef struct {
-    arp_entry_t *entries[MAX_ARP_ENTRIES];
-    size_t nr_entries;
+    // Neighbour hash: lockless readers, writers take the chain's stripe lock
+    _Atomic(arp_entry_t *) *hash;
+    uint32_t hash_rnd;
+    pthread_mutex_t hash_locks[ARP_HASH_LOCKS];
+    atomic_size_t nr_entries;
+    uint64_t reachable_ms;
+    // Entry memory is recycled, never freed while the manager lives, so a
+    // lockless reader may still dereference an entry it found in a chain
+    arp_entry_t *free_entries;
+    pthread_mutex_t free_lock;
+    // One timer per entry, hashed by expiry tick
+    arp_entry_t *wheel[ARP_WHEEL_SIZE];
+    arp_entry_t *expired;
+    uint64_t wheel_clk;               // Next tick to process
+    pthread_mutex_t wheel_lock;
     bool running;
-    pthread_mutex_t manager_lock;
     pthread_t gc_thread;
-    pthread_t retry_thread;
     arp_stats_t stats;
 } arp_manager_t;
 
@@ -126,16 +182,19 @@ typedef struct {
 const char* get_log_level_string(int level);
 const char* get_arp_state_string(arp_state_t state);
 void mac_addr_to_string(const mac_addr_t *mac, char *str);
+uint64_t arp_now_ms(void);
 
 arp_manager_t* create_arp_manager(void);
 void destroy_arp_manager(arp_manager_t *manager);
 
-arp_entry_t* create_arp_entry(uint32_t ip);
+arp_entry_t* create_arp_entry(arp_manager_t *manager, uint32_t ip);
 void destroy_arp_entry(arp_entry_t *entry);
+void arp_entry_put(arp_manager_t *manager, arp_entry_t *entry);
 
 int arp_add_entry(arp_manager_t *manager, uint32_t ip, const mac_addr_t *mac);
 int arp_remove_entry(arp_manager_t *manager, uint32_t ip);
 arp_entry_t* arp_find_entry(arp_manager_t *manager, uint32_t ip);
+int arp_output(arp_manager_t *manager, uint32_t ip, const void *data, size_t len);
 
 void arp_process_request(arp_manager_t *manager, const arp_packet_t *pkt);
 void arp_process_reply(arp_manager_t *manager, const arp_packet_t *pkt);
@@ -143,14 +202,16 @@ void arp_send_request(arp_manager_t *manager, uint32_t target_ip);
 void arp_send_reply(arp_manager_t *manager, const arp_packet_t *request);
 
 void* gc_thread(void *arg);
-void* retry_thread(void *arg);
-void process_timeouts(arp_manager_t *manager);
-void process_retries(arp_manager_t *manager);
+void arp_run_timers(arp_manager_t *manager, uint64_t now);
 
 void run_test(arp_manager_t *manager);
 void calculate_stats(arp_manager_t *manager);
 void print_test_stats(arp_manager_t *manager);
 void demonstrate_arp(void);
+int run_benchmark(void);
+
+// Added to the monotonic clock; the benchmark uses it to fast-forward
+static _Atomic uint64_t arp_clock_warp_ms;
 
 // Utility Functions
 const char* get_log_level_string(int level) {
@@ -167,7 +228,10 @@ const char* get_arp_state_string(arp_state_t state) {
     switch(state) {
         case ARP_NONE:       return "NONE";
         case ARP_INCOMPLETE: return "INCOMPLETE";
-        case ARP_VALID:      return "VALID";
+        case ARP_REACHABLE:  return "REACHABLE";
+        case ARP_STALE:      return "STALE";
+        case ARP_DELAY:      return "DELAY";
+        case ARP_PROBE:      return "PROBE";
         case ARP_FAILED:     return "FAILED";
         default: return "UNKNOWN";
     }
@@ -179,24 +243,270 @@ void mac_addr_to_string(const mac_addr_t *mac, char *str) {
         mac->addr[3], mac->addr[4], mac->addr[5]);
 }
 
-// Create ARP Entry
-arp_entry_t* create_arp_entry(uint32_t ip) {
-    arp_entry_t *entry = malloc(sizeof(arp_entry_t));
-    if (!entry) return NULL;
+uint64_t arp_now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 +
+           atomic_load_explicit(&arp_clock_warp_ms, memory_order_relaxed);
+}
+
+// Keyed IP hash, so remote hosts cannot aim ARP traffic at one chain
+static uint32_t arp_hash(const arp_manager_t *manager, uint32_t ip) {
+    uint32_t h = ip ^ manager->hash_rnd;
+
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+static inline pthread_mutex_t *arp_hash_lock(arp_manager_t *manager,
+                                             uint32_t hash) {
+    return &manager->hash_locks[hash & (ARP_HASH_LOCKS - 1)];
+}
+
+// Counters are bumped from lockless paths on any thread
+#define arp_stat_inc(manager, field) \
+    atomic_fetch_add_explicit(&(manager)->stats.field, 1, memory_order_relaxed)
+
+static inline void arp_entry_hold(arp_entry_t *entry) {
+    atomic_fetch_add_explicit(&entry->refcnt, 1, memory_order_relaxed);
+}
+
+// Take a reference unless the entry is already on the free list
+static bool arp_entry_hold_not_zero(arp_entry_t *entry) {
+    int ref = atomic_load_explicit(&entry->refcnt, memory_order_relaxed);
+
+    do {
+        if (ref == 0)
+            return false;
+    } while (!atomic_compare_exchange_weak_explicit(&entry->refcnt, &ref,
+                                                    ref + 1,
+                                                    memory_order_acquire,
+                                                    memory_order_relaxed));
+    return true;
+}
+
+// Snapshot the MAC without the entry lock
+static void arp_entry_read_mac(arp_entry_t *entry, mac_addr_t *mac) {
+    unsigned int seq;
+
+    do {
+        while ((seq = atomic_load_explicit(&entry->ha_seq,
+                                           memory_order_acquire)) & 1)
+            ;
+        memcpy(mac, &entry->mac, sizeof(*mac));
+        atomic_thread_fence(memory_order_acquire);
+    } while (atomic_load_explicit(&entry->ha_seq, memory_order_relaxed) != seq);
+}
+
+// Caller holds entry->lock
+static void arp_entry_write_mac(arp_entry_t *entry, const mac_addr_t *mac) {
+    atomic_fetch_add_explicit(&entry->ha_seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&entry->mac, mac, sizeof(*mac));
+    atomic_fetch_add_explicit(&entry->ha_seq, 1, memory_order_release);
+}
+
+// Caller holds entry->lock
+static void arp_entry_set_state(arp_entry_t *entry, arp_state_t state,
+                                uint64_t now) {
+    atomic_store_explicit(&entry->state, state, memory_order_release);
+    entry->updated = now;
+}
+
+// Timer Wheel
+
+static void arp_timer_unlink(arp_entry_t *entry) {
+    if (!entry->tpprev)
+        return;
+    *entry->tpprev = entry->tnext;
+    if (entry->tnext)
+        entry->tnext->tpprev = entry->tpprev;
+    entry->tnext = NULL;
+    entry->tpprev = NULL;
+}
+
+static void arp_timer_link(arp_entry_t **head, arp_entry_t *entry) {
+    entry->tnext = *head;
+    if (*head)
+        (*head)->tpprev = &entry->tnext;
+    entry->tpprev = head;
+    *head = entry;
+}
+
+// (Re)arm the entry's timer; caller holds entry->lock
+static void arp_mod_timer(arp_manager_t *manager, arp_entry_t *entry,
+                          uint64_t expires) {
+    uint64_t tick = (expires + ARP_WHEEL_TICK_MS - 1) / ARP_WHEEL_TICK_MS;
+
+    if (entry->dead)
+        return;
+
+    pthread_mutex_lock(&manager->wheel_lock);
+    arp_timer_unlink(entry);
+    if (tick < manager->wheel_clk)
+        tick = manager->wheel_clk;
+    entry->timer_tick = tick;
+    entry->timer_state = ARP_TIMER_PENDING;
+    arp_timer_link(&manager->wheel[tick & (ARP_WHEEL_SIZE - 1)], entry);
+    pthread_mutex_unlock(&manager->wheel_lock);
+}
+
+// Caller holds entry->lock
+static void arp_del_timer(arp_manager_t *manager, arp_entry_t *entry) {
+    pthread_mutex_lock(&manager->wheel_lock);
+    arp_timer_unlink(entry);
+    entry->timer_state = ARP_TIMER_IDLE;
+    pthread_mutex_unlock(&manager->wheel_lock);
+}
+
+// Move due timers of one slot to the expired list; wheel_lock held
+static void arp_wheel_collect(arp_manager_t *manager, uint32_t slot,
+                              uint64_t tick) {
+    arp_entry_t *entry = manager->wheel[slot], *next;
+
+    for (; entry; entry = next) {
+        next = entry->tnext;
+        if (entry->timer_tick <= tick) {
+            arp_timer_unlink(entry);
+            arp_timer_link(&manager->expired, entry);
+        }
+    }
+}
+
+// Pending Packet Queue
+
+// Caller holds entry->lock; drops the oldest packet when full
+static int arp_queue_pending(arp_manager_t *manager, arp_entry_t *entry,
+                             const void *data, size_t len) {
+    pending_pkt_t *pkt = malloc(sizeof(pending_pkt_t));
+
+    if (!pkt)
+        return -1;
+    pkt->data = malloc(len);
+    if (!pkt->data) {
+        free(pkt);
+        return -1;
+    }
+    memcpy(pkt->data, data, len);
+    pkt->len = len;
+    pkt->next = NULL;
+
+    if (entry->pending_len >= MAX_PENDING_PKTS) {
+        pending_pkt_t *old = entry->pending;
+
+        entry->pending = old->next;
+        if (!entry->pending)
+            entry->pending_tail = NULL;
+        entry->pending_len--;
+        free(old->data);
+        free(old);
+        arp_stat_inc(manager, unres_discards);
+    }
+
+    if (entry->pending_tail)
+        entry->pending_tail->next = pkt;
+    else
+        entry->pending = pkt;
+    entry->pending_tail = pkt;
+    entry->pending_len++;
+    return 0;
+}
+
+// Caller holds entry->lock; the returned list is the caller's to free
+static pending_pkt_t *arp_detach_pending(arp_entry_t *entry) {
+    pending_pkt_t *list = entry->pending;
 
+    entry->pending = NULL;
+    entry->pending_tail = NULL;
+    entry->pending_len = 0;
+    return list;
+}
+
+static void arp_xmit(arp_manager_t *manager, const mac_addr_t *mac,
+                     const void *data, size_t len) {
+    (void)data;
+    (void)len;
+    (void)mac;
+    arp_stat_inc(manager, pkts_sent);
+}
+
+// Send (mac != NULL) or discard a detached pending list
+static void arp_flush_pending(arp_manager_t *manager, pending_pkt_t *pkt,
+                              const mac_addr_t *mac) {
+    while (pkt) {
+        pending_pkt_t *next = pkt->next;
+
+        if (mac)
+            arp_xmit(manager, mac, pkt->data, pkt->len);
+        else
+            arp_stat_inc(manager, unres_discards);
+        free(pkt->data);
+        free(pkt);
+        pkt = next;
+    }
+}
+
+// Create ARP Entry (unhashed, state NONE, one reference)
+arp_entry_t* create_arp_entry(arp_manager_t *manager, uint32_t ip) {
+    arp_entry_t *entry;
+    uint64_t now = arp_now_ms();
+
+    pthread_mutex_lock(&manager->free_lock);
+    entry = manager->free_entries;
+    if (entry)
+        manager->free_entries = entry->free_next;
+    pthread_mutex_unlock(&manager->free_lock);
+
+    if (!entry) {
+        entry = malloc(sizeof(arp_entry_t));
+        if (!entry) return NULL;
+        pthread_mutex_init(&entry->lock, NULL);
+        atomic_init(&entry->ha_seq, 0);
+        atomic_init(&entry->refcnt, 0);
+        atomic_init(&entry->next, ARP_NULLS_MARKER(0));
+    }
+
+    // Lockless readers may still be looking at a recycled entry; they
+    // cannot take a reference until refcnt becomes non-zero below
     entry->ip = ip;
+    entry->hash = arp_hash(manager, ip);
     memset(&entry->mac, 0, sizeof(mac_addr_t));
-    entry->state = ARP_INCOMPLETE;
-    entry->created = time(NULL);
-    entry->updated = entry->created;
+    atomic_store_explicit(&entry->state, ARP_NONE, memory_order_relaxed);
+    entry->created = now;
+    entry->updated = now;
+    atomic_store_explicit(&entry->confirmed, 0, memory_order_relaxed);
+    atomic_store_explicit(&entry->used, now, memory_order_relaxed);
     entry->retry_count = 0;
     entry->pending = NULL;
-    entry->next = NULL;
-    pthread_mutex_init(&entry->lock, NULL);
+    entry->pending_tail = NULL;
+    entry->pending_len = 0;
+    entry->dead = false;
+    entry->timer_tick = 0;
+    entry->timer_state = ARP_TIMER_IDLE;
+    entry->tnext = NULL;
+    entry->tpprev = NULL;
+    entry->free_next = NULL;
+    atomic_store_explicit(&entry->refcnt, 1, memory_order_release);
 
     return entry;
 }
 
+void arp_entry_put(arp_manager_t *manager, arp_entry_t *entry) {
+    if (atomic_fetch_sub_explicit(&entry->refcnt, 1,
+                                  memory_order_acq_rel) != 1)
+        return;
+
+    pthread_mutex_lock(&manager->free_lock);
+    entry->free_next = manager->free_entries;
+    manager->free_entries = entry;
+    pthread_mutex_unlock(&manager->free_lock);
+}
+
 // Create ARP Manager
 arp_manager_t* create_arp_manager(void) {
     arp_manager_t *manager = malloc(sizeof(arp_manager_t));
@@ -205,79 +515,336 @@ arp_manager_t* create_arp_manager(void) {
         return NULL;
     }
 
-    memset(manager->entries, 0, sizeof(manager->entries));
-    manager->nr_entries = 0;
+    manager->hash = malloc(ARP_HASH_SIZE * sizeof(*manager->hash));
+    if (!manager->hash) {
+        LOG(LOG_LEVEL_ERROR, "Failed to allocate ARP hash");
+        free(manager);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < ARP_HASH_SIZE; i++)
+        atomic_init(&manager->hash[i], ARP_NULLS_MARKER(i));
+    for (int i = 0; i < ARP_HASH_LOCKS; i++)
+        pthread_mutex_init(&manager->hash_locks[i], NULL);
+    manager->hash_rnd = (uint32_t)rand() ^ ((uint32_t)rand() << 16);
+    atomic_init(&manager->nr_entries, 0);
+    manager->reachable_ms = ARP_REACHABLE_TIME * 500 +
+                            rand() % (ARP_REACHABLE_TIME * 1000);
+
+    manager->free_entries = NULL;
+    pthread_mutex_init(&manager->free_lock, NULL);
+
+    memset(manager->wheel, 0, sizeof(manager->wheel));
+    manager->expired = NULL;
+    manager->wheel_clk = arp_now_ms() / ARP_WHEEL_TICK_MS;
+    pthread_mutex_init(&manager->wheel_lock, NULL);
+
     manager->running = false;
-    pthread_mutex_init(&manager->manager_lock, NULL);
     memset(&manager->stats, 0, sizeof(arp_stats_t));
 
     LOG(LOG_LEVEL_DEBUG, "Created ARP manager");
     return manager;
 }
 
-// Add ARP Entry
-int arp_add_entry(arp_manager_t *manager, uint32_t ip, const mac_addr_t *mac) {
-    if (!manager || !mac) return -1;
+// Find ARP Entry: lockless, returns a referenced entry or NULL
+arp_entry_t* arp_find_entry(arp_manager_t *manager, uint32_t ip) {
+    if (!manager) return NULL;
+
+    uint32_t hash = arp_hash(manager, ip);
+    uint32_t slot = hash & (ARP_HASH_SIZE - 1);
+    arp_entry_t *entry;
+
+begin:
+    for (entry = atomic_load_explicit(&manager->hash[slot],
+                                      memory_order_acquire);
+         !arp_is_nulls(entry);
+         entry = atomic_load_explicit(&entry->next, memory_order_acquire)) {
+        if (entry->ip != ip)
+            continue;
+        if (!arp_entry_hold_not_zero(entry))
+            goto begin;
+        // The entry may have been recycled for another neighbour
+        if (entry->ip != ip) {
+            arp_entry_put(manager, entry);
+            goto begin;
+        }
+        return entry;
+    }
 
-    pthread_mutex_lock(&manager->manager_lock);
+    // Ended on another chain after following a recycled entry
+    if (arp_nulls_value(entry) != slot)
+        goto begin;
 
-    // Check if entry exists
-    arp_entry_t *entry = arp_find_entry(manager, ip);
-    if (entry) {
-        pthread_mutex_lock(&entry->lock);
-        memcpy(&entry->mac, mac, sizeof(mac_addr_t));
-        entry->state = ARP_VALID;
-        entry->updated = time(NULL);
+    return NULL;
+}
+
+// Mark an entry dead so no path re-arms its timer; hands back its queue
+static bool arp_entry_kill(arp_manager_t *manager, arp_entry_t *entry,
+                           pending_pkt_t **pending) {
+    pthread_mutex_lock(&entry->lock);
+    if (entry->dead) {
         pthread_mutex_unlock(&entry->lock);
-    } else {
-        // Create new entry
-        if (manager->nr_entries >= MAX_ARP_ENTRIES) {
-            pthread_mutex_unlock(&manager->manager_lock);
-            return -1;
+        return false;
+    }
+    entry->dead = true;
+    arp_del_timer(manager, entry);
+    arp_entry_set_state(entry, ARP_NONE, arp_now_ms());
+    *pending = arp_detach_pending(entry);
+    pthread_mutex_unlock(&entry->lock);
+    return true;
+}
+
+// Look up ip, creating an ARP_NONE entry if missing; returns a reference
+static arp_entry_t *arp_neigh_lookup_create(arp_manager_t *manager,
+                                            uint32_t ip) {
+    arp_entry_t *entry, *new_entry;
+    uint32_t hash, slot;
+    pthread_mutex_t *lock;
+
+    entry = arp_find_entry(manager, ip);
+    if (entry)
+        return entry;
+
+    if (atomic_load(&manager->nr_entries) >= MAX_ARP_ENTRIES) {
+        LOG(LOG_LEVEL_WARN, "Neighbour table overflow");
+        return NULL;
+    }
+
+    new_entry = create_arp_entry(manager, ip);
+    if (!new_entry)
+        return NULL;
+
+    hash = new_entry->hash;
+    slot = hash & (ARP_HASH_SIZE - 1);
+    lock = arp_hash_lock(manager, hash);
+
+    pthread_mutex_lock(lock);
+    // Someone may have inserted it since the lockless miss
+    for (entry = atomic_load_explicit(&manager->hash[slot],
+                                      memory_order_relaxed);
+         !arp_is_nulls(entry);
+         entry = atomic_load_explicit(&entry->next, memory_order_relaxed)) {
+        if (entry->ip == ip) {
+            pending_pkt_t *pending = NULL;
+
+            arp_entry_hold(entry);
+            pthread_mutex_unlock(lock);
+            // new_entry is recycled memory: a reader still walking its old
+            // chain may have found and held it, and must see it dead
+            arp_entry_kill(manager, new_entry, &pending);
+            arp_flush_pending(manager, pending, NULL);
+            arp_entry_put(manager, new_entry);
+            return entry;
         }
+    }
 
-        entry = create_arp_entry(ip);
-        if (!entry) {
-            pthread_mutex_unlock(&manager->manager_lock);
-            return -1;
+    arp_entry_hold(new_entry);     // The table's reference
+    atomic_store_explicit(&new_entry->next,
+                          atomic_load_explicit(&manager->hash[slot],
+                                               memory_order_relaxed),
+                          memory_order_relaxed);
+    atomic_store_explicit(&manager->hash[slot], new_entry,
+                          memory_order_release);
+    atomic_fetch_add(&manager->nr_entries, 1);
+    pthread_mutex_unlock(lock);
+
+    return new_entry;
+}
+
+// Unhash an entry the caller holds a reference on
+static bool arp_entry_unhash(arp_manager_t *manager, arp_entry_t *entry) {
+    _Atomic(arp_entry_t *) *pprev;
+    pending_pkt_t *pending;
+    pthread_mutex_t *lock;
+    arp_entry_t *cur;
+
+    if (!arp_entry_kill(manager, entry, &pending))
+        return false;
+
+    lock = arp_hash_lock(manager, entry->hash);
+    pthread_mutex_lock(lock);
+    pprev = &manager->hash[entry->hash & (ARP_HASH_SIZE - 1)];
+    for (cur = atomic_load_explicit(pprev, memory_order_relaxed);
+         !arp_is_nulls(cur);
+         cur = atomic_load_explicit(pprev, memory_order_relaxed)) {
+        if (cur == entry) {
+            // entry->next stays intact for readers still on it
+            atomic_store_explicit(pprev,
+                                  atomic_load_explicit(&entry->next,
+                                                       memory_order_relaxed),
+                                  memory_order_release);
+            break;
         }
+        pprev = &cur->next;
+    }
+    atomic_fetch_sub(&manager->nr_entries, 1);
+    pthread_mutex_unlock(lock);
+
+    arp_flush_pending(manager, pending, NULL);
+    arp_entry_put(manager, entry);
+    return true;
+}
+
+/*
+ * Apply an ARP-learned address. Solicited replies (and manual adds)
+ * confirm the neighbour as REACHABLE; a request from the neighbour only
+ * tells us its address, so new or changed entries become STALE.
+ */
+static int arp_neigh_update(arp_manager_t *manager, uint32_t ip,
+                            const mac_addr_t *mac, arp_state_t new_state) {
+    arp_entry_t *entry;
+    pending_pkt_t *pending = NULL;
+    arp_state_t old;
+    uint64_t now = arp_now_ms();
+    bool changed;
+
+retry:
+    entry = arp_neigh_lookup_create(manager, ip);
+    if (!entry)
+        return -1;
+
+    pthread_mutex_lock(&entry->lock);
+    if (entry->dead) {
+        pthread_mutex_unlock(&entry->lock);
+        arp_entry_put(manager, entry);
+        goto retry;
+    }
 
-        memcpy(&entry->mac, mac, sizeof(mac_addr_t));
-        entry->state = ARP_VALID;
-        manager->entries[manager->nr_entries++] = entry;
+    old = atomic_load_explicit(&entry->state, memory_order_relaxed);
+    changed = old == ARP_NONE || old == ARP_INCOMPLETE || old == ARP_FAILED ||
+              memcmp(&entry->mac, mac, sizeof(mac_addr_t)) != 0;
+    if (changed)
+        arp_entry_write_mac(entry, mac);
+
+    if (new_state == ARP_REACHABLE) {
+        atomic_store_explicit(&entry->confirmed, now, memory_order_relaxed);
+        entry->retry_count = 0;
+        arp_entry_set_state(entry, ARP_REACHABLE, now);
+        arp_mod_timer(manager, entry, now + manager->reachable_ms);
+    } else if (changed) {
+        entry->retry_count = 0;
+        arp_entry_set_state(entry, ARP_STALE, now);
+        arp_mod_timer(manager, entry, now + ARP_CACHE_TIMEOUT * 1000);
     }
 
-    pthread_mutex_unlock(&manager->manager_lock);
+    if (entry->pending)
+        pending = arp_detach_pending(entry);
+    pthread_mutex_unlock(&entry->lock);
+
+    arp_flush_pending(manager, pending, mac);
+    arp_entry_put(manager, entry);
 
     char mac_str[18];
     mac_addr_to_string(mac, mac_str);
-    LOG(LOG_LEVEL_DEBUG, "Added ARP entry: IP %s -> MAC %s",
-        inet_ntoa((struct in_addr){.s_addr = ip}), mac_str);
+    LOG(LOG_LEVEL_DEBUG, "Updated ARP entry: IP %s -> MAC %s (%s)",
+        inet_ntoa((struct in_addr){.s_addr = ip}), mac_str,
+        get_arp_state_string(new_state));
     return 0;
 }
 
-// Find ARP Entry
-arp_entry_t* arp_find_entry(arp_manager_t *manager, uint32_t ip) {
-    if (!manager) return NULL;
+// Add ARP Entry
+int arp_add_entry(arp_manager_t *manager, uint32_t ip, const mac_addr_t *mac) {
+    if (!manager || !mac) return -1;
 
-    for (size_t i = 0; i < manager->nr_entries; i++) {
-        if (manager->entries[i] && manager->entries[i]->ip == ip) {
-            return manager->entries[i];
-        }
+    return arp_neigh_update(manager, ip, mac, ARP_REACHABLE);
+}
+
+// Remove ARP Entry
+int arp_remove_entry(arp_manager_t *manager, uint32_t ip) {
+    if (!manager) return -1;
+
+    arp_entry_t *entry = arp_find_entry(manager, ip);
+    if (!entry)
+        return -1;
+
+    bool removed = arp_entry_unhash(manager, entry);
+    arp_entry_put(manager, entry);
+    return removed ? 0 : -1;
+}
+
+/*
+ * Send a packet to ip. REACHABLE/DELAY/PROBE neighbours are served
+ * without taking any lock; STALE ones start the DELAY timer, unresolved
+ * ones queue the packet (up to MAX_PENDING_PKTS) behind an ARP request.
+ */
+int arp_output(arp_manager_t *manager, uint32_t ip, const void *data,
+               size_t len) {
+    if (!manager) return -1;
+
+    arp_entry_t *entry;
+    arp_state_t state;
+    mac_addr_t mac;
+    uint64_t now;
+    int ret = 0;
+
+retry:
+    entry = arp_find_entry(manager, ip);
+    if (!entry) {
+        arp_stat_inc(manager, cache_misses);
+        entry = arp_neigh_lookup_create(manager, ip);
+        if (!entry)
+            return -1;
     }
-    return NULL;
+
+    now = arp_now_ms();
+    state = atomic_load_explicit(&entry->state, memory_order_acquire);
+    if (state == ARP_REACHABLE || state == ARP_DELAY || state == ARP_PROBE) {
+        arp_entry_read_mac(entry, &mac);
+        if (atomic_load_explicit(&entry->used, memory_order_relaxed) != now)
+            atomic_store_explicit(&entry->used, now, memory_order_relaxed);
+        arp_entry_put(manager, entry);
+        arp_stat_inc(manager, cache_hits);
+        arp_xmit(manager, &mac, data, len);
+        return 0;
+    }
+
+    pthread_mutex_lock(&entry->lock);
+    if (entry->dead) {
+        pthread_mutex_unlock(&entry->lock);
+        arp_entry_put(manager, entry);
+        goto retry;
+    }
+
+    atomic_store_explicit(&entry->used, now, memory_order_relaxed);
+    state = atomic_load_explicit(&entry->state, memory_order_relaxed);
+    switch (state) {
+        case ARP_NONE:
+        case ARP_FAILED:
+            entry->retry_count = 1;
+            arp_entry_set_state(entry, ARP_INCOMPLETE, now);
+            arp_mod_timer(manager, entry, now + ARP_RETRY_TIME * 1000);
+            arp_send_request(manager, ip);
+            // fall through
+        case ARP_INCOMPLETE:
+            ret = arp_queue_pending(manager, entry, data, len);
+            pthread_mutex_unlock(&entry->lock);
+            arp_entry_put(manager, entry);
+            return ret;
+        case ARP_STALE:
+            arp_entry_set_state(entry, ARP_DELAY, now);
+            arp_mod_timer(manager, entry, now + ARP_DELAY_TIME * 1000);
+            break;
+        default:
+            break;
+    }
+
+    memcpy(&mac, &entry->mac, sizeof(mac));
+    pthread_mutex_unlock(&entry->lock);
+    arp_entry_put(manager, entry);
+    arp_stat_inc(manager, cache_hits);
+    arp_xmit(manager, &mac, data, len);
+    return 0;
 }
 
 // Process ARP Request
 void arp_process_request(arp_manager_t *manager, const arp_packet_t *pkt) {
     if (!manager || !pkt) return;
 
-    manager->stats.requests_received++;
+    arp_stat_inc(manager, requests_received);
 
     // Add sender to cache
     mac_addr_t sender_mac;
     memcpy(sender_mac.addr, pkt->sender_mac, ETH_ALEN);
-    arp_add_entry(manager, pkt->sender_ip, &sender_mac);
+    arp_neigh_update(manager, pkt->sender_ip, &sender_mac, ARP_STALE);
 
     // Send reply if we're the target
     if (pkt->target_ip == htonl(INADDR_ANY)) {  // Simulate our IP
@@ -289,12 +856,12 @@ void arp_process_request(arp_manager_t *manager, const arp_packet_t *pkt) {
 void arp_process_reply(arp_manager_t *manager, const arp_packet_t *pkt) {
     if (!manager || !pkt) return;
 
-    manager->stats.replies_received++;
+    arp_stat_inc(manager, replies_received);
 
     // Add sender to cache
     mac_addr_t sender_mac;
     memcpy(sender_mac.addr, pkt->sender_mac, ETH_ALEN);
-    arp_add_entry(manager, pkt->sender_ip, &sender_mac);
+    arp_neigh_update(manager, pkt->sender_ip, &sender_mac, ARP_REACHABLE);
 }
 
 // Send ARP Request
@@ -314,7 +881,7 @@ void arp_send_request(arp_manager_t *manager, uint32_t target_ip) {
     // Simulate broadcast
     memset(request.target_mac, 0xFF, ETH_ALEN);
 
-    manager->stats.requests_sent++;
+    arp_stat_inc(manager, requests_sent);
     LOG(LOG_LEVEL_DEBUG, "Sent ARP request for IP %s",
         inet_ntoa((struct in_addr){.s_addr = target_ip}));
 }
@@ -339,90 +906,139 @@ void arp_send_reply(arp_manager_t *manager, const arp_packet_t *request) {
     uint8_t our_mac[ETH_ALEN] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55};
     memcpy(reply.sender_mac, our_mac, ETH_ALEN);
 
-    manager->stats.replies_sent++;
+    arp_stat_inc(manager, replies_sent);
     LOG(LOG_LEVEL_DEBUG, "Sent ARP reply to IP %s",
         inet_ntoa((struct in_addr){.s_addr = request->sender_ip}));
 }
 
-// GC Thread
-void* gc_thread(void *arg) {
-    arp_manager_t *manager = (arp_manager_t*)arg;
-
-    while (manager->running) {
-        process_timeouts(manager);
-        sleep(1);
+// Run the NUD state machine for an entry whose timer fired
+static void arp_timer_handler(arp_manager_t *manager, arp_entry_t *entry,
+                              uint64_t now) {
+    pending_pkt_t *failed = NULL;
+    bool fire, remove = false;
+    uint64_t confirmed, used;
+
+    pthread_mutex_lock(&entry->lock);
+
+    // Skip if re-armed or deleted after it was taken off the wheel
+    pthread_mutex_lock(&manager->wheel_lock);
+    fire = entry->timer_state == ARP_TIMER_FIRING;
+    if (fire)
+        entry->timer_state = ARP_TIMER_IDLE;
+    pthread_mutex_unlock(&manager->wheel_lock);
+    if (!fire || entry->dead) {
+        pthread_mutex_unlock(&entry->lock);
+        return;
     }
 
-    return NULL;
-}
-
-// Process Timeouts
-void process_timeouts(arp_manager_t *manager) {
-    if (!manager) return;
+    confirmed = atomic_load_explicit(&entry->confirmed, memory_order_relaxed);
+    used = atomic_load_explicit(&entry->used, memory_order_relaxed);
 
-    time_t now = time(NULL);
-    pthread_mutex_lock(&manager->manager_lock);
+    switch (atomic_load_explicit(&entry->state, memory_order_relaxed)) {
+        case ARP_REACHABLE:
+            if (now - confirmed < manager->reachable_ms) {
+                arp_mod_timer(manager, entry, confirmed + manager->reachable_ms);
+            } else {
+                arp_entry_set_state(entry, ARP_STALE, now);
+                arp_mod_timer(manager, entry, now + ARP_CACHE_TIMEOUT * 1000);
+                arp_stat_inc(manager, cache_timeouts);
+            }
+            break;
 
-    for (size_t i = 0; i < manager->nr_entries; i++) {
-        arp_entry_t *entry = manager->entries[i];
-        if (!entry) continue;
+        case ARP_DELAY:
+            if (now - confirmed < ARP_DELAY_TIME * 1000) {
+                arp_entry_set_state(entry, ARP_REACHABLE, now);
+                arp_mod_timer(manager, entry, confirmed + manager->reachable_ms);
+            } else {
+                entry->retry_count = 1;
+                arp_entry_set_state(entry, ARP_PROBE, now);
+                arp_mod_timer(manager, entry, now + ARP_RETRY_TIME * 1000);
+                arp_send_request(manager, entry->ip);
+            }
+            break;
 
-        pthread_mutex_lock(&entry->lock);
-        if (entry->state == ARP_VALID &&
-            (now - entry->updated) > ARP_CACHE_TIMEOUT) {
-            entry->state = ARP_NONE;
-            manager->stats.cache_timeouts++;
-            LOG(LOG_LEVEL_DEBUG, "ARP entry timed out: IP %s",
-                inet_ntoa((struct in_addr){.s_addr = entry->ip}));
-        }
-        pthread_mutex_unlock(&entry->lock);
+        case ARP_INCOMPLETE:
+        case ARP_PROBE:
+            if (entry->retry_count < MAX_ARP_RETRIES) {
+                entry->retry_count++;
+                arp_stat_inc(manager, retries);
+                arp_mod_timer(manager, entry, now + ARP_RETRY_TIME * 1000);
+                arp_send_request(manager, entry->ip);
+            } else {
+                arp_entry_set_state(entry, ARP_FAILED, now);
+                arp_mod_timer(manager, entry, now + ARP_CACHE_TIMEOUT * 1000);
+                failed = arp_detach_pending(entry);
+                arp_stat_inc(manager, failed_resolves);
+                LOG(LOG_LEVEL_DEBUG, "ARP resolution failed: IP %s",
+                    inet_ntoa((struct in_addr){.s_addr = entry->ip}));
+            }
+            break;
+
+        case ARP_STALE:
+            // Garbage collect entries nobody has used for a while
+            if (now - used < ARP_CACHE_TIMEOUT * 1000)
+                arp_mod_timer(manager, entry, used + ARP_CACHE_TIMEOUT * 1000);
+            else
+                remove = true;
+            break;
+
+        case ARP_FAILED:
+            remove = true;
+            break;
+
+        default:
+            break;
     }
+    pthread_mutex_unlock(&entry->lock);
 
-    pthread_mutex_unlock(&manager->manager_lock);
+    arp_flush_pending(manager, failed, NULL);
+    if (remove && arp_entry_unhash(manager, entry))
+        arp_stat_inc(manager, gc_removed);
 }
 
-// Retry Thread
-void* retry_thread(void *arg) {
-    arp_manager_t *manager = (arp_manager_t*)arg;
+// Expire every timer due at or before now
+void arp_run_timers(arp_manager_t *manager, uint64_t now) {
+    if (!manager) return;
 
-    while (manager->running) {
-        process_retries(manager);
-        usleep(100000);  // 100ms interval
+    uint64_t now_tick = now / ARP_WHEEL_TICK_MS;
+    arp_entry_t *entry;
+
+    pthread_mutex_lock(&manager->wheel_lock);
+    if (now_tick >= manager->wheel_clk + ARP_WHEEL_SIZE) {
+        // Fell a whole revolution behind: one pass over every slot
+        for (uint32_t slot = 0; slot < ARP_WHEEL_SIZE; slot++)
+            arp_wheel_collect(manager, slot, now_tick);
+        manager->wheel_clk = now_tick + 1;
     }
+    for (; manager->wheel_clk <= now_tick; manager->wheel_clk++)
+        arp_wheel_collect(manager, manager->wheel_clk & (ARP_WHEEL_SIZE - 1),
+                          manager->wheel_clk);
 
-    return NULL;
-}
+    while ((entry = manager->expired) != NULL) {
+        arp_timer_unlink(entry);
+        entry->timer_state = ARP_TIMER_FIRING;
+        // Pending timers imply the table still holds a reference
+        arp_entry_hold(entry);
+        pthread_mutex_unlock(&manager->wheel_lock);
 
-// Process Retries
-void process_retries(arp_manager_t *manager) {
-    if (!manager) return;
+        arp_timer_handler(manager, entry, now);
+        arp_entry_put(manager, entry);
 
-    time_t now = time(NULL);
-    pthread_mutex_lock(&manager->manager_lock);
+        pthread_mutex_lock(&manager->wheel_lock);
+    }
+    pthread_mutex_unlock(&manager->wheel_lock);
+}
 
-    for (size_t i = 0; i < manager->nr_entries; i++) {
-        arp_entry_t *entry = manager->entries[i];
-        if (!entry) continue;
+// GC Thread: drives the timer wheel
+void* gc_thread(void *arg) {
+    arp_manager_t *manager = (arp_manager_t*)arg;
 
-        pthread_mutex_lock(&entry->lock);
-        if (entry->state == ARP_INCOMPLETE &&
-            (now - entry->updated) > ARP_RETRY_TIME) {
-            if (entry->retry_count < MAX_ARP_RETRIES) {
-                arp_send_request(manager, entry->ip);
-                entry->retry_count++;
-                entry->updated = now;
-                manager->stats.retries++;
-            } else {
-                entry->state = ARP_FAILED;
-                manager->stats.failed_resolves++;
-                LOG(LOG_LEVEL_DEBUG, "ARP resolution failed: IP %s",
-                    inet_ntoa((struct in_addr){.s_addr = entry->ip}));
-            }
-        }
-        pthread_mutex_unlock(&entry->lock);
+    while (manager->running) {
+        arp_run_timers(manager, arp_now_ms());
+        usleep(ARP_WHEEL_TICK_MS * 1000);
     }
 
-    pthread_mutex_unlock(&manager->manager_lock);
+    return NULL;
 }
 
 // Run Test
@@ -434,7 +1050,6 @@ void run_test(arp_manager_t *manager) {
     // Start threads
     manager->running = true;
     pthread_create(&manager->gc_thread, NULL, gc_thread, manager);
-    pthread_create(&manager->retry_thread, NULL, retry_thread, manager);
 
     // Simulate ARP traffic
     for (int i = 0; i < TEST_DURATION; i++) {
@@ -457,9 +1072,27 @@ void run_test(arp_manager_t *manager) {
             arp_process_request(manager, &request);
         }
 
-        // Simulate outgoing requests
+        // Simulate outgoing traffic; half the targets answer
         if (rand() % 100 < 20) {  // 20% chance
-            arp_send_request(manager, htonl(rand()));
+            uint32_t target = htonl(rand());
+            char payload[64] = {0};
+
+            arp_output(manager, target, payload, sizeof(payload));
+            if (rand() % 2) {
+                arp_packet_t reply = {
+                    .hw_type = htons(ARPHRD_ETHER),
+                    .protocol = htons(ETH_P_IP),
+                    .hw_len = ETH_ALEN,
+                    .proto_len = IPV4_ALEN,
+                    .operation = htons(ARPOP_REPLY),
+                    .sender_ip = target,
+                    .target_ip = htonl(INADDR_ANY)
+                };
+                for (int j = 0; j < ETH_ALEN; j++) {
+                    reply.sender_mac[j] = rand() % 256;
+                }
+                arp_process_reply(manager, &reply);
+            }
         }
 
         sleep(1);
@@ -468,7 +1101,6 @@ void run_test(arp_manager_t *manager) {
     // Stop threads
     manager->running = false;
     pthread_join(manager->gc_thread, NULL);
-    pthread_join(manager->retry_thread, NULL);
 
     // Calculate statistics
     calculate_stats(manager);
@@ -480,15 +1112,19 @@ void calculate_stats(arp_manager_t *manager) {
 
     // Count current cache entries by state
     size_t valid = 0, incomplete = 0, failed = 0;
-    for (size_t i = 0; i < manager->nr_entries; i++) {
-        arp_entry_t *entry = manager->entries[i];
-        if (!entry) continue;
-
-        switch (entry->state) {
-            case ARP_VALID: valid++; break;
-            case ARP_INCOMPLETE: incomplete++; break;
-            case ARP_FAILED: failed++; break;
-            default: break;
+    for (uint32_t i = 0; i < ARP_HASH_SIZE; i++) {
+        arp_entry_t *entry = atomic_load(&manager->hash[i]);
+
+        for (; !arp_is_nulls(entry); entry = atomic_load(&entry->next)) {
+            switch (atomic_load(&entry->state)) {
+                case ARP_REACHABLE:
+                case ARP_STALE:
+                case ARP_DELAY:
+                case ARP_PROBE: valid++; break;
+                case ARP_INCOMPLETE: incomplete++; break;
+                case ARP_FAILED: failed++; break;
+                default: break;
+            }
         }
     }
 
@@ -512,18 +1148,22 @@ void print_test_stats(arp_manager_t *manager) {
     printf("Cache Timeouts:    %lu\n", manager->stats.cache_timeouts);
     printf("Retries:          %lu\n", manager->stats.retries);
     printf("Failed Resolves:   %lu\n", manager->stats.failed_resolves);
+    printf("Packets Sent:      %lu\n", manager->stats.pkts_sent);
+    printf("Unres Discards:    %lu\n", manager->stats.unres_discards);
+    printf("GC Removed:        %lu\n", manager->stats.gc_removed);
 
     // Print cache details
-    printf("\nCache Details:\n");
-    for (size_t i = 0; i < manager->nr_entries; i++) {
-        arp_entry_t *entry = manager->entries[i];
-        if (!entry) continue;
-
-        char mac_str[18];
-        mac_addr_to_string(&entry->mac, mac_str);
-        printf("  IP: %-15s  MAC: %-17s  State: %s\n",
-            inet_ntoa((struct in_addr){.s_addr = entry->ip}),
-            mac_str, get_arp_state_string(entry->state));
+    printf("\nCache Details (%zu entries):\n", atomic_load(&manager->nr_entries));
+    for (uint32_t i = 0; i < ARP_HASH_SIZE; i++) {
+        arp_entry_t *entry = atomic_load(&manager->hash[i]);
+
+        for (; !arp_is_nulls(entry); entry = atomic_load(&entry->next)) {
+            char mac_str[18];
+            mac_addr_to_string(&entry->mac, mac_str);
+            printf("  IP: %-15s  MAC: %-17s  State: %s\n",
+                inet_ntoa((struct in_addr){.s_addr = entry->ip}),
+                mac_str, get_arp_state_string(atomic_load(&entry->state)));
+        }
     }
 }
 
@@ -549,13 +1189,26 @@ void destroy_arp_manager(arp_manager_t *manager) {
     if (!manager) return;
 
     // Clean up entries
-    for (size_t i = 0; i < manager->nr_entries; i++) {
-        if (manager->entries[i]) {
-            destroy_arp_entry(manager->entries[i]);
+    for (uint32_t i = 0; i < ARP_HASH_SIZE; i++) {
+        arp_entry_t *entry = atomic_load(&manager->hash[i]);
+
+        while (!arp_is_nulls(entry)) {
+            arp_entry_t *next = atomic_load(&entry->next);
+            destroy_arp_entry(entry);
+            entry = next;
         }
     }
+    while (manager->free_entries) {
+        arp_entry_t *next = manager->free_entries->free_next;
+        destroy_arp_entry(manager->free_entries);
+        manager->free_entries = next;
+    }
 
-    pthread_mutex_destroy(&manager->manager_lock);
+    for (int i = 0; i < ARP_HASH_LOCKS; i++)
+        pthread_mutex_destroy(&manager->hash_locks[i]);
+    pthread_mutex_destroy(&manager->free_lock);
+    pthread_mutex_destroy(&manager->wheel_lock);
+    free(manager->hash);
     free(manager);
     LOG(LOG_LEVEL_DEBUG, "Destroyed ARP manager");
 }
@@ -573,13 +1226,87 @@ void demonstrate_arp(void) {
     }
 }
 
-int main(void) {
+static double bench_elapsed_ns(const struct timespec *start) {
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
+
+// Large L2 segment: resolve, use and age out ARP_BENCH_ENTRIES neighbours
+int run_benchmark(void) {
+    arp_manager_t *manager = create_arp_manager();
+    struct timespec start;
+    char payload[64] = {0};
+    const int lookups = 4 * ARP_BENCH_ENTRIES;
+    double ns;
+
+    if (!manager) return 1;
+
+    printf("ARP neighbour table benchmark: %d neighbours\n", ARP_BENCH_ENTRIES);
+
+    // Unresolved traffic: every neighbour gets an INCOMPLETE entry
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < ARP_BENCH_ENTRIES; i++)
+        arp_output(manager, htonl(0x0a000000 + i), payload, sizeof(payload));
+    ns = bench_elapsed_ns(&start);
+    printf("  resolve miss:   %8.1f ns/op (%zu entries)\n",
+           ns / ARP_BENCH_ENTRIES, atomic_load(&manager->nr_entries));
+
+    // Replies flush each pending queue
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < ARP_BENCH_ENTRIES; i++) {
+        arp_packet_t reply = {
+            .operation = htons(ARPOP_REPLY),
+            .sender_ip = htonl(0x0a000000 + i),
+            .sender_mac = {0x02, 0x00, (uint8_t)(i >> 16), (uint8_t)(i >> 8),
+                           (uint8_t)i, 0x01}
+        };
+        arp_process_reply(manager, &reply);
+    }
+    ns = bench_elapsed_ns(&start);
+    printf("  reply:          %8.1f ns/op\n", ns / ARP_BENCH_ENTRIES);
+
+    // Lockless REACHABLE fast path
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < lookups; i++) {
+        uint32_t n = (uint32_t)i * 2654435761u % ARP_BENCH_ENTRIES;
+        arp_output(manager, htonl(0x0a000000 + n), payload, sizeof(payload));
+    }
+    ns = bench_elapsed_ns(&start);
+    printf("  output hit:     %8.1f ns/op\n", ns / lookups);
+
+    // Age everything to STALE, then collect it; only due slots are touched
+    atomic_fetch_add(&arp_clock_warp_ms, 2 * ARP_REACHABLE_TIME * 1000);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    arp_run_timers(manager, arp_now_ms());
+    ns = bench_elapsed_ns(&start);
+    printf("  reachable->stale: %6.1f ms (%lu timeouts)\n", ns / 1e6,
+           manager->stats.cache_timeouts);
+
+    atomic_fetch_add(&arp_clock_warp_ms, 2 * ARP_CACHE_TIMEOUT * 1000);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    arp_run_timers(manager, arp_now_ms());
+    ns = bench_elapsed_ns(&start);
+    printf("  stale gc:       %8.1f ms (%lu removed, %zu left)\n", ns / 1e6,
+           manager->stats.gc_removed, atomic_load(&manager->nr_entries));
+    printf("  packets sent:   %lu, unresolved discards: %lu\n",
+           manager->stats.pkts_sent, manager->stats.unres_discards);
+
+    destroy_arp_manager(manager);
+    return 0;
+}
+
+int main(int argc, char **argv) {
     // Set log level
     current_log_level = LOG_LEVEL_INFO;
 
     // Seed random number generator
     srand(time(NULL));
 
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        return run_benchmark();
+
     // Run demonstration
     demonstrate_arp();
 
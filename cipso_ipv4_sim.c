@@ -8,6 +8,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <stdatomic.h>
 
 // Logging Macros
 #define LOG_LEVEL_DEBUG 0
@@ -41,6 +42,20 @@ static int current_log_level = LOG_LEVEL_INFO;
 #define CIPSO_V4_MAX_CACHE_SLOTS 256
 #define TEST_DURATION            30
 
+// IP Option Layout
+#define CIPSO_V4_OPT_TYPE        134
+#define CIPSO_V4_HDR_LEN         6      // type, length, 32-bit DOI
+#define CIPSO_V4_OPT_LEN_MAX     40
+#define CIPSO_V4_INV_LVL         0xff
+#define CIPSO_V4_INV_CAT         0xffff
+
+// Label Cache
+#define CIPSO_V4_CACHE_BUCKETSIZE   10  // Entries per chain before eviction
+#define CIPSO_V4_CACHE_REORDERLIMIT 10  // Hit lead needed to pass a neighbour
+#define CIPSO_V4_CACHE_TIMEOUT      300 // Seconds without a hit
+#define CIPSO_V4_DOI_HASH_SIZE      (2 * CIPSO_V4_MAX_DOI_MAPS)
+#define CIPSO_V4_DOI_TOMBSTONE      ((doi_def_t *)1)
+
 // CIPSO Tag Types
 typedef enum {
     TAG_INVALID,
@@ -69,8 +84,15 @@ typedef struct {
     uint8_t *data;
 } cipso_tag_t;
 
-// DOI Definition Structure
+// Local Security Attributes a label translates to
 typedef struct {
+    uint32_t doi;
+    uint8_t level;
+    uint64_t cats[(CIPSO_V4_MAX_CATS + 63) / 64];
+} cipso_secattr_t;
+
+// DOI Definition Structure
+typedef struct doi_def {
     uint32_t doi;
     uint32_t flags;
     sec_level_t *levels;
@@ -79,6 +101,7 @@ typedef struct {
     size_t nr_categories;
     struct doi_mapping *maps;
     size_t nr_maps;
+    struct doi_def *retired_next;
 } doi_def_t;
 
 // DOI Mapping Structure
@@ -89,29 +112,56 @@ typedef struct doi_mapping {
     uint16_t *cat_map;
 } doi_mapping_t;
 
-// Cache Entry Structure
+// Cache Entry Structure, keyed by the raw option bytes
 typedef struct cache_entry {
+    uint32_t hash;
     uint32_t doi;
-    cipso_tag_t tags[CIPSO_V4_MAX_TAGS];
+    uint8_t key[CIPSO_V4_OPT_LEN_MAX];
+    size_t key_len;
+    cipso_secattr_t secattr;
+    atomic_uint activity;                 // Hits, drives promotion
     time_t created;
-    time_t accessed;
-    struct cache_entry *next;
+    _Atomic time_t accessed;
+    _Atomic(struct cache_entry *) next;
+    struct cache_entry *free_next;
 } cache_entry_t;
 
+/*
+ * Cache Bucket: hits are lockless and validated by seq, which writers
+ * make odd while they relink the chain under lock. Entry memory is
+ * recycled rather than freed, so a racing reader only ever sees a stale
+ * entry and retries.
+ */
+typedef struct {
+    _Atomic(cache_entry_t *) list;
+    atomic_uint seq;
+    size_t size;
+    pthread_mutex_t lock;
+} cache_bucket_t;
+
 // Statistics Structure
 typedef struct {
-    uint64_t cache_hits;
-    uint64_t cache_misses;
-    uint64_t cache_invalidations;
-    uint64_t tags_processed;
-    uint64_t tags_generated;
-    uint64_t errors;
+    _Atomic uint64_t cache_hits;
+    _Atomic uint64_t cache_misses;
+    _Atomic uint64_t cache_invalidations;
+    _Atomic uint64_t cache_evictions;
+    _Atomic uint64_t cache_promotions;
+    _Atomic uint64_t tags_processed;
+    _Atomic uint64_t tags_generated;
+    _Atomic uint64_t errors;
 } cipso_stats_t;
 
 // CIPSO Manager Structure
 typedef struct {
     doi_def_t *doi_defs[CIPSO_V4_MAX_DOI_MAPS];
-    cache_entry_t *cache[CIPSO_V4_MAX_CACHE_SLOTS];
+    _Atomic(doi_def_t *) doi_index[CIPSO_V4_DOI_HASH_SIZE];
+    doi_def_t *doi_retired;               // Freed with the manager
+    cache_bucket_t cache[CIPSO_V4_MAX_CACHE_SLOTS];
+    cache_entry_t *cache_free;
+    pthread_mutex_t cache_free_lock;
+    uint32_t cache_rnd;
+    bool cache_enabled;
+    _Atomic time_t now;                   // Coarse clock for cache aging
     size_t nr_dois;
     bool running;
     pthread_mutex_t manager_lock;
@@ -129,7 +179,8 @@ void destroy_cipso_manager(cipso_manager_t *manager);
 doi_def_t* create_doi_def(uint32_t doi);
 void destroy_doi_def(doi_def_t *def);
 
-cache_entry_t* create_cache_entry(uint32_t doi);
+cache_entry_t* create_cache_entry(cipso_manager_t *manager, const uint8_t *key,
+                                  size_t key_len, const cipso_secattr_t *secattr);
 void destroy_cache_entry(cache_entry_t *entry);
 
 int cipso_add_doi_def(cipso_manager_t *manager, doi_def_t *def);
@@ -138,7 +189,11 @@ doi_def_t* cipso_find_doi_def(cipso_manager_t *manager, uint32_t doi);
 
 int cipso_validate_tag(const cipso_tag_t *tag);
 int cipso_cache_add(cipso_manager_t *manager, cache_entry_t *entry);
-cache_entry_t* cipso_cache_find(cipso_manager_t *manager, uint32_t doi);
+int cipso_cache_find(cipso_manager_t *manager, const uint8_t *key,
+                     size_t key_len, cipso_secattr_t *secattr);
+void cipso_cache_invalidate(cipso_manager_t *manager);
+int cipso_getattr(cipso_manager_t *manager, const uint8_t *opt,
+                  cipso_secattr_t *secattr);
 
 void* cache_thread(void *arg);
 void process_cache(cipso_manager_t *manager);
@@ -147,6 +202,7 @@ void run_test(cipso_manager_t *manager);
 void calculate_stats(cipso_manager_t *manager);
 void print_test_stats(cipso_manager_t *manager);
 void demonstrate_cipso(void);
+int run_benchmark(void);
 
 // Utility Functions
 const char* get_log_level_string(int level) {
@@ -170,6 +226,38 @@ const char* get_tag_type_string(cipso_tag_type_t type) {
     }
 }
 
+// Word-at-a-time hash of the option bytes, seeded per manager
+static uint32_t cipso_hash(uint32_t seed, const uint8_t *key, size_t len) {
+    uint64_t h = seed ^ (len * 0x9E3779B97F4A7C15ULL);
+    uint64_t w;
+    size_t i;
+
+    for (i = 0; i + 8 <= len; i += 8) {
+        memcpy(&w, key + i, 8);
+        h = (h ^ w) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 29;
+    }
+    if (i < len) {
+        w = 0;
+        memcpy(&w, key + i, len - i);
+        h = (h ^ w) * 0x9E3779B97F4A7C15ULL;
+    }
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+static inline uint32_t cipso_doi_hash(uint32_t doi) {
+    return (doi * 0x9E3779B1u) >> 23;      // log2(CIPSO_V4_DOI_HASH_SIZE) bits
+}
+
+static inline uint32_t get_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint16_t get_be16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
 // Create DOI Definition
 doi_def_t* create_doi_def(uint32_t doi) {
     doi_def_t *def = malloc(sizeof(doi_def_t));
@@ -183,24 +271,52 @@ doi_def_t* create_doi_def(uint32_t doi) {
     def->nr_categories = 0;
     def->maps = NULL;
     def->nr_maps = 0;
+    def->retired_next = NULL;
 
     return def;
 }
 
-// Create Cache Entry
-cache_entry_t* create_cache_entry(uint32_t doi) {
-    cache_entry_t *entry = malloc(sizeof(cache_entry_t));
-    if (!entry) return NULL;
+// Create Cache Entry, reusing a recycled one when available
+cache_entry_t* create_cache_entry(cipso_manager_t *manager, const uint8_t *key,
+                                  size_t key_len, const cipso_secattr_t *secattr) {
+    cache_entry_t *entry;
 
-    entry->doi = doi;
-    memset(entry->tags, 0, sizeof(entry->tags));
-    entry->created = time(NULL);
-    entry->accessed = entry->created;
-    entry->next = NULL;
+    if (!manager || !key || !secattr || key_len > CIPSO_V4_OPT_LEN_MAX)
+        return NULL;
+
+    pthread_mutex_lock(&manager->cache_free_lock);
+    entry = manager->cache_free;
+    if (entry)
+        manager->cache_free = entry->free_next;
+    pthread_mutex_unlock(&manager->cache_free_lock);
+
+    if (!entry) {
+        entry = malloc(sizeof(cache_entry_t));
+        if (!entry) return NULL;
+        atomic_init(&entry->next, NULL);
+    }
+
+    entry->hash = cipso_hash(manager->cache_rnd, key, key_len);
+    entry->doi = secattr->doi;
+    memcpy(entry->key, key, key_len);
+    entry->key_len = key_len;
+    entry->secattr = *secattr;
+    atomic_store_explicit(&entry->activity, 0, memory_order_relaxed);
+    entry->created = atomic_load_explicit(&manager->now, memory_order_relaxed);
+    atomic_store_explicit(&entry->accessed, entry->created,
+                          memory_order_relaxed);
+    entry->free_next = NULL;
 
     return entry;
 }
 
+static void cipso_cache_recycle(cipso_manager_t *manager, cache_entry_t *entry) {
+    pthread_mutex_lock(&manager->cache_free_lock);
+    entry->free_next = manager->cache_free;
+    manager->cache_free = entry;
+    pthread_mutex_unlock(&manager->cache_free_lock);
+}
+
 // Create CIPSO Manager
 cipso_manager_t* create_cipso_manager(void) {
     cipso_manager_t *manager = malloc(sizeof(cipso_manager_t));
@@ -210,7 +326,20 @@ cipso_manager_t* create_cipso_manager(void) {
     }
 
     memset(manager->doi_defs, 0, sizeof(manager->doi_defs));
-    memset(manager->cache, 0, sizeof(manager->cache));
+    for (size_t i = 0; i < CIPSO_V4_DOI_HASH_SIZE; i++)
+        atomic_init(&manager->doi_index[i], NULL);
+    manager->doi_retired = NULL;
+    for (size_t i = 0; i < CIPSO_V4_MAX_CACHE_SLOTS; i++) {
+        atomic_init(&manager->cache[i].list, NULL);
+        atomic_init(&manager->cache[i].seq, 0);
+        manager->cache[i].size = 0;
+        pthread_mutex_init(&manager->cache[i].lock, NULL);
+    }
+    manager->cache_free = NULL;
+    pthread_mutex_init(&manager->cache_free_lock, NULL);
+    manager->cache_rnd = (uint32_t)rand();
+    manager->cache_enabled = true;
+    atomic_init(&manager->now, time(NULL));
     manager->nr_dois = 0;
     manager->running = false;
     pthread_mutex_init(&manager->manager_lock, NULL);
@@ -237,6 +366,13 @@ int cipso_add_doi_def(cipso_manager_t *manager, doi_def_t *def) {
         return -1;
     }
 
+    // The index is twice the DOI limit, so a free or dead slot exists
+    uint32_t slot = cipso_doi_hash(def->doi);
+    while (atomic_load_explicit(&manager->doi_index[slot],
+                                memory_order_relaxed) > CIPSO_V4_DOI_TOMBSTONE)
+        slot = (slot + 1) & (CIPSO_V4_DOI_HASH_SIZE - 1);
+    atomic_store_explicit(&manager->doi_index[slot], def, memory_order_release);
+
     manager->doi_defs[manager->nr_dois++] = def;
 
     pthread_mutex_unlock(&manager->manager_lock);
@@ -244,14 +380,58 @@ int cipso_add_doi_def(cipso_manager_t *manager, doi_def_t *def) {
     return 0;
 }
 
-// Find DOI Definition
+// Remove DOI Definition; cached labels of any DOI may refer to it
+int cipso_remove_doi_def(cipso_manager_t *manager, uint32_t doi) {
+    if (!manager) return -1;
+
+    pthread_mutex_lock(&manager->manager_lock);
+
+    uint32_t slot = cipso_doi_hash(doi);
+    doi_def_t *def;
+    for (size_t n = 0; n < CIPSO_V4_DOI_HASH_SIZE; n++) {
+        def = atomic_load_explicit(&manager->doi_index[slot],
+                                   memory_order_relaxed);
+        if (!def)
+            break;
+        if (def != CIPSO_V4_DOI_TOMBSTONE && def->doi == doi) {
+            atomic_store_explicit(&manager->doi_index[slot],
+                                  CIPSO_V4_DOI_TOMBSTONE, memory_order_release);
+            for (size_t i = 0; i < manager->nr_dois; i++) {
+                if (manager->doi_defs[i] == def) {
+                    manager->doi_defs[i] = manager->doi_defs[--manager->nr_dois];
+                    manager->doi_defs[manager->nr_dois] = NULL;
+                    break;
+                }
+            }
+            // Lockless readers may still hold it
+            def->retired_next = manager->doi_retired;
+            manager->doi_retired = def;
+            pthread_mutex_unlock(&manager->manager_lock);
+
+            cipso_cache_invalidate(manager);
+            LOG(LOG_LEVEL_DEBUG, "Removed DOI definition %u", doi);
+            return 0;
+        }
+        slot = (slot + 1) & (CIPSO_V4_DOI_HASH_SIZE - 1);
+    }
+
+    pthread_mutex_unlock(&manager->manager_lock);
+    return -1;
+}
+
+// Find DOI Definition: lockless probe of the DOI index
 doi_def_t* cipso_find_doi_def(cipso_manager_t *manager, uint32_t doi) {
     if (!manager) return NULL;
 
-    for (size_t i = 0; i < manager->nr_dois; i++) {
-        if (manager->doi_defs[i] && manager->doi_defs[i]->doi == doi) {
-            return manager->doi_defs[i];
-        }
+    uint32_t slot = cipso_doi_hash(doi);
+    for (size_t n = 0; n < CIPSO_V4_DOI_HASH_SIZE; n++) {
+        doi_def_t *def = atomic_load_explicit(&manager->doi_index[slot],
+                                              memory_order_acquire);
+        if (!def)
+            break;
+        if (def != CIPSO_V4_DOI_TOMBSTONE && def->doi == doi)
+            return def;
+        slot = (slot + 1) & (CIPSO_V4_DOI_HASH_SIZE - 1);
     }
     return NULL;
 }
@@ -279,38 +459,337 @@ int cipso_validate_tag(const cipso_tag_t *tag) {
     return 0;
 }
 
-// Add Cache Entry
+static unsigned int cipso_bucket_read_begin(cache_bucket_t *bucket) {
+    unsigned int seq;
+
+    while ((seq = atomic_load_explicit(&bucket->seq, memory_order_acquire)) & 1)
+        ;
+    return seq;
+}
+
+static bool cipso_bucket_read_retry(cache_bucket_t *bucket, unsigned int seq) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&bucket->seq, memory_order_relaxed) != seq;
+}
+
+static void cipso_bucket_write_begin(cache_bucket_t *bucket) {
+    atomic_fetch_add_explicit(&bucket->seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void cipso_bucket_write_end(cache_bucket_t *bucket) {
+    atomic_fetch_add_explicit(&bucket->seq, 1, memory_order_release);
+}
+
+// Add Cache Entry at the chain head, evicting the coldest (tail) if full
 int cipso_cache_add(cipso_manager_t *manager, cache_entry_t *entry) {
     if (!manager || !entry) return -1;
 
-    pthread_mutex_lock(&manager->manager_lock);
+    cache_bucket_t *bucket = &manager->cache[entry->hash &
+                                             (CIPSO_V4_MAX_CACHE_SLOTS - 1)];
+    cache_entry_t *victim = NULL;
 
-    uint32_t slot = entry->doi % CIPSO_V4_MAX_CACHE_SLOTS;
-    entry->next = manager->cache[slot];
-    manager->cache[slot] = entry;
+    pthread_mutex_lock(&bucket->lock);
+    cipso_bucket_write_begin(bucket);
 
-    pthread_mutex_unlock(&manager->manager_lock);
+    if (bucket->size >= CIPSO_V4_CACHE_BUCKETSIZE) {
+        _Atomic(cache_entry_t *) *pprev = &bucket->list;
+
+        victim = atomic_load_explicit(pprev, memory_order_relaxed);
+        while (atomic_load_explicit(&victim->next, memory_order_relaxed)) {
+            pprev = &victim->next;
+            victim = atomic_load_explicit(pprev, memory_order_relaxed);
+        }
+        atomic_store_explicit(pprev, NULL, memory_order_relaxed);
+        bucket->size--;
+    }
+
+    atomic_store_explicit(&entry->next,
+                          atomic_load_explicit(&bucket->list,
+                                               memory_order_relaxed),
+                          memory_order_relaxed);
+    atomic_store_explicit(&bucket->list, entry, memory_order_release);
+    bucket->size++;
+
+    cipso_bucket_write_end(bucket);
+    pthread_mutex_unlock(&bucket->lock);
+
+    if (victim) {
+        cipso_cache_recycle(manager, victim);
+        manager->stats.cache_evictions++;
+    }
     return 0;
 }
 
-// Find Cache Entry
-cache_entry_t* cipso_cache_find(cipso_manager_t *manager, uint32_t doi) {
-    if (!manager) return NULL;
+// Swap entry with its predecessor if it is still there; bucket lock held
+static void cipso_cache_promote(cipso_manager_t *manager, cache_bucket_t *bucket,
+                                cache_entry_t *prev, cache_entry_t *entry) {
+    _Atomic(cache_entry_t *) *pprev = &bucket->list;
+    cache_entry_t *cur;
+
+    while ((cur = atomic_load_explicit(pprev, memory_order_relaxed)) &&
+           cur != prev)
+        pprev = &cur->next;
+    if (!cur || atomic_load_explicit(&prev->next, memory_order_relaxed) != entry)
+        return;
+
+    cipso_bucket_write_begin(bucket);
+    atomic_store_explicit(&prev->next,
+                          atomic_load_explicit(&entry->next,
+                                               memory_order_relaxed),
+                          memory_order_relaxed);
+    atomic_store_explicit(&entry->next, prev, memory_order_relaxed);
+    atomic_store_explicit(pprev, entry, memory_order_relaxed);
+    cipso_bucket_write_end(bucket);
+    manager->stats.cache_promotions++;
+}
+
+/*
+ * Find Cache Entry: copies the cached attributes out on a hit. An entry
+ * that has collected CIPSO_V4_CACHE_REORDERLIMIT more hits than the one
+ * ahead of it swaps places, so hot labels drift to the chain head.
+ */
+int cipso_cache_find(cipso_manager_t *manager, const uint8_t *key,
+                     size_t key_len, cipso_secattr_t *secattr) {
+    if (!manager || !key) return -1;
+
+    uint32_t hash = cipso_hash(manager->cache_rnd, key, key_len);
+    cache_bucket_t *bucket = &manager->cache[hash &
+                                             (CIPSO_V4_MAX_CACHE_SLOTS - 1)];
+    cache_entry_t *entry, *prev, *found;
+    unsigned int seq, prev_activity = 0;
+    size_t depth;
+
+    do {
+        seq = cipso_bucket_read_begin(bucket);
+        found = NULL;
+        prev = NULL;
+        depth = 0;
+        // A recycled entry can lead anywhere; depth bounds the walk
+        for (entry = atomic_load_explicit(&bucket->list, memory_order_acquire);
+             entry && depth++ <= CIPSO_V4_CACHE_BUCKETSIZE;
+             entry = atomic_load_explicit(&entry->next, memory_order_acquire)) {
+            if (entry->hash == hash && entry->key_len == key_len &&
+                memcmp(entry->key, key, key_len) == 0) {
+                *secattr = entry->secattr;
+                found = entry;
+                break;
+            }
+            prev = entry;
+        }
+        if (found && prev)
+            prev_activity = atomic_load_explicit(&prev->activity,
+                                                 memory_order_relaxed);
+    } while (cipso_bucket_read_retry(bucket, seq));
+
+    if (!found) {
+        manager->stats.cache_misses++;
+        return -ENOENT;
+    }
 
-    uint32_t slot = doi % CIPSO_V4_MAX_CACHE_SLOTS;
-    cache_entry_t *entry = manager->cache[slot];
+    unsigned int activity = atomic_fetch_add_explicit(&found->activity, 1,
+                                                      memory_order_relaxed) + 1;
+    time_t now = atomic_load_explicit(&manager->now, memory_order_relaxed);
+    if (atomic_load_explicit(&found->accessed, memory_order_relaxed) != now)
+        atomic_store_explicit(&found->accessed, now, memory_order_relaxed);
+
+    // Never wait on the hot path; a busy bucket just delays the promotion
+    if (prev && activity > prev_activity + CIPSO_V4_CACHE_REORDERLIMIT &&
+        pthread_mutex_trylock(&bucket->lock) == 0) {
+        cipso_cache_promote(manager, bucket, prev, found);
+        pthread_mutex_unlock(&bucket->lock);
+    }
 
-    while (entry) {
-        if (entry->doi == doi) {
-            entry->accessed = time(NULL);
-            manager->stats.cache_hits++;
-            return entry;
+    manager->stats.cache_hits++;
+    return 0;
+}
+
+// Drop every cached label (DOI configuration changed)
+void cipso_cache_invalidate(cipso_manager_t *manager) {
+    if (!manager) return;
+
+    for (size_t i = 0; i < CIPSO_V4_MAX_CACHE_SLOTS; i++) {
+        cache_bucket_t *bucket = &manager->cache[i];
+        cache_entry_t *entry, *next;
+
+        pthread_mutex_lock(&bucket->lock);
+        cipso_bucket_write_begin(bucket);
+        entry = atomic_load_explicit(&bucket->list, memory_order_relaxed);
+        atomic_store_explicit(&bucket->list, NULL, memory_order_relaxed);
+        bucket->size = 0;
+        cipso_bucket_write_end(bucket);
+        pthread_mutex_unlock(&bucket->lock);
+
+        for (; entry; entry = next) {
+            next = atomic_load_explicit(&entry->next, memory_order_relaxed);
+            cipso_cache_recycle(manager, entry);
+            manager->stats.cache_invalidations++;
         }
-        entry = entry->next;
     }
+}
 
-    manager->stats.cache_misses++;
-    return NULL;
+// Map a remote level/category through the DOI's translation tables
+static int cipso_map_level(const doi_def_t *def, uint8_t remote, uint8_t *local) {
+    if (def->nr_maps && def->maps[0].level_map) {
+        if (def->maps[0].level_map[remote] == CIPSO_V4_INV_LVL)
+            return -EPERM;
+        *local = def->maps[0].level_map[remote];
+    } else {
+        *local = remote;
+    }
+    return 0;
+}
+
+static int cipso_map_cat(const doi_def_t *def, uint16_t remote,
+                         cipso_secattr_t *secattr) {
+    uint16_t local = remote;
+
+    if (remote >= CIPSO_V4_MAX_CATS)
+        return -EPERM;
+    if (def->nr_maps && def->maps[0].cat_map)
+        local = def->maps[0].cat_map[remote];
+    if (local == CIPSO_V4_INV_CAT || local >= CIPSO_V4_MAX_CATS)
+        return -EPERM;
+    secattr->cats[local / 64] |= 1ULL << (local % 64);
+    return 0;
+}
+
+// Translate the first tag of a CIPSO option into local attributes
+static int cipso_parse_tag(const doi_def_t *def, const uint8_t *tag,
+                           size_t avail, cipso_secattr_t *secattr) {
+    cipso_tag_t view = { .type = tag[0], .len = tag[1], .data = (uint8_t *)tag };
+    int ret;
+
+    if (avail < 2 || view.len > avail || cipso_validate_tag(&view) < 0)
+        return -EINVAL;
+
+    ret = cipso_map_level(def, tag[3], &secattr->level);
+    if (ret < 0)
+        return ret;
+
+    switch (view.type) {
+        case CIPSO_V4_TAG_RBITMAP:
+            for (size_t byte = 4; byte < view.len; byte++) {
+                for (int bit = 0; bit < 8; bit++) {
+                    if (!(tag[byte] & (0x80 >> bit)))
+                        continue;
+                    ret = cipso_map_cat(def, (byte - 4) * 8 + bit, secattr);
+                    if (ret < 0)
+                        return ret;
+                }
+            }
+            break;
+        case CIPSO_V4_TAG_ENUM:
+            for (size_t off = 4; off + 1 < view.len; off += 2) {
+                ret = cipso_map_cat(def, get_be16(tag + off), secattr);
+                if (ret < 0)
+                    return ret;
+            }
+            break;
+        case CIPSO_V4_TAG_RANGE:
+            for (size_t off = 4; off + 3 < view.len; off += 4) {
+                uint16_t high = get_be16(tag + off), low = get_be16(tag + off + 2);
+
+                if (low > high)
+                    return -EINVAL;
+                for (uint32_t cat = low; cat <= high; cat++) {
+                    ret = cipso_map_cat(def, cat, secattr);
+                    if (ret < 0)
+                        return ret;
+                }
+            }
+            break;
+        default:
+            return -EINVAL;     // Local tags never arrive off the wire
+    }
+    return 0;
+}
+
+/*
+ * Translate a received CIPSO option. Every labelled packet comes through
+ * here, so a cache hit costs one hash and a lockless chain walk; only
+ * misses look up the DOI and parse the tag.
+ */
+int cipso_getattr(cipso_manager_t *manager, const uint8_t *opt,
+                  cipso_secattr_t *secattr) {
+    if (!manager || !opt || !secattr) return -EINVAL;
+
+    size_t len = opt[1];
+    doi_def_t *def;
+    int ret;
+
+    if (opt[0] != CIPSO_V4_OPT_TYPE || len < CIPSO_V4_HDR_LEN + 4 ||
+        len > CIPSO_V4_OPT_LEN_MAX) {
+        manager->stats.errors++;
+        return -EINVAL;
+    }
+
+    if (manager->cache_enabled && cipso_cache_find(manager, opt, len, secattr) == 0)
+        return 0;
+
+    def = cipso_find_doi_def(manager, get_be32(opt + 2));
+    if (!def) {
+        manager->stats.errors++;
+        return -ENOENT;
+    }
+
+    memset(secattr, 0, sizeof(*secattr));
+    secattr->doi = def->doi;
+    ret = cipso_parse_tag(def, opt + CIPSO_V4_HDR_LEN,
+                          len - CIPSO_V4_HDR_LEN, secattr);
+    if (ret < 0) {
+        manager->stats.errors++;
+        return ret;
+    }
+    manager->stats.tags_processed++;
+
+    if (manager->cache_enabled) {
+        cache_entry_t *entry = create_cache_entry(manager, opt, len, secattr);
+        if (entry)
+            cipso_cache_add(manager, entry);
+    }
+    return 0;
+}
+
+// Build an enumerated-category CIPSO option; returns its length
+static size_t cipso_build_enum_opt(uint8_t *opt, uint32_t doi, uint8_t level,
+                                   const uint16_t *cats, size_t nr_cats) {
+    size_t tag_len = 4 + 2 * nr_cats;
+
+    opt[0] = CIPSO_V4_OPT_TYPE;
+    opt[1] = CIPSO_V4_HDR_LEN + tag_len;
+    opt[2] = doi >> 24;
+    opt[3] = doi >> 16;
+    opt[4] = doi >> 8;
+    opt[5] = doi;
+    opt[6] = CIPSO_V4_TAG_ENUM;
+    opt[7] = tag_len;
+    opt[8] = 0;
+    opt[9] = level;
+    for (size_t i = 0; i < nr_cats; i++) {
+        opt[10 + 2 * i] = cats[i] >> 8;
+        opt[11 + 2 * i] = cats[i];
+    }
+    return opt[1];
+}
+
+// Build a bitmap-category CIPSO option; returns its length
+static size_t cipso_build_rbitmap_opt(uint8_t *opt, uint32_t doi, uint8_t level,
+                                      const uint8_t *bitmap, size_t bitmap_len) {
+    size_t tag_len = 4 + bitmap_len;
+
+    opt[0] = CIPSO_V4_OPT_TYPE;
+    opt[1] = CIPSO_V4_HDR_LEN + tag_len;
+    opt[2] = doi >> 24;
+    opt[3] = doi >> 16;
+    opt[4] = doi >> 8;
+    opt[5] = doi;
+    opt[6] = CIPSO_V4_TAG_RBITMAP;
+    opt[7] = tag_len;
+    opt[8] = 0;
+    opt[9] = level;
+    memcpy(opt + 10, bitmap, bitmap_len);
+    return opt[1];
 }
 
 // Cache Thread
@@ -325,30 +804,47 @@ void* cache_thread(void *arg) {
     return NULL;
 }
 
-// Process Cache
+// Process Cache: tick the coarse clock and age out idle labels
 void process_cache(cipso_manager_t *manager) {
     if (!manager) return;
 
     time_t now = time(NULL);
-    pthread_mutex_lock(&manager->manager_lock);
+    atomic_store_explicit(&manager->now, now, memory_order_relaxed);
 
     // Process each cache slot
     for (size_t i = 0; i < CIPSO_V4_MAX_CACHE_SLOTS; i++) {
-        cache_entry_t **pp = &manager->cache[i];
-        while (*pp) {
-            cache_entry_t *entry = *pp;
+        cache_bucket_t *bucket = &manager->cache[i];
+        cache_entry_t *expired = NULL, *entry;
+        _Atomic(cache_entry_t *) *pp;
+
+        if (!atomic_load_explicit(&bucket->list, memory_order_relaxed))
+            continue;
+
+        pthread_mutex_lock(&bucket->lock);
+        cipso_bucket_write_begin(bucket);
+        pp = &bucket->list;
+        while ((entry = atomic_load_explicit(pp, memory_order_relaxed))) {
             // Remove entries older than 5 minutes
-            if (now - entry->accessed > 300) {
-                *pp = entry->next;
-                destroy_cache_entry(entry);
-                manager->stats.cache_invalidations++;
+            if (now - atomic_load(&entry->accessed) > CIPSO_V4_CACHE_TIMEOUT) {
+                atomic_store_explicit(pp, atomic_load(&entry->next),
+                                      memory_order_relaxed);
+                entry->free_next = expired;
+                expired = entry;
+                bucket->size--;
             } else {
                 pp = &entry->next;
             }
         }
+        cipso_bucket_write_end(bucket);
+        pthread_mutex_unlock(&bucket->lock);
+
+        while (expired) {
+            entry = expired;
+            expired = entry->free_next;
+            cipso_cache_recycle(manager, entry);
+            manager->stats.cache_invalidations++;
+        }
     }
-
-    pthread_mutex_unlock(&manager->manager_lock);
 }
 
 // Run Test
@@ -386,38 +882,19 @@ void run_test(cipso_manager_t *manager) {
 
     // Simulate CIPSO operations
     for (int i = 0; i < TEST_DURATION; i++) {
-        // Simulate tag processing
+        // Simulate labelled packets
         for (uint32_t doi = 1; doi <= 5; doi++) {
             if (rand() % 100 < 30) {  // 30% chance
-                cache_entry_t *entry = cipso_cache_find(manager, doi);
-                if (!entry) {
-                    entry = create_cache_entry(doi);
-                    if (entry) {
-                        // Add some test tags
-                        for (int j = 0; j < CIPSO_V4_MAX_TAGS; j++) {
-                            entry->tags[j].type = rand() % 4 + 1;
-                            entry->tags[j].len = 4;
-                            entry->tags[j].data = malloc(4);
-                            if (entry->tags[j].data) {
-                                for (int k = 0; k < 4; k++) {
-                                    entry->tags[j].data[k] = rand() % 256;
-                                }
-                            }
-                        }
-                        cipso_cache_add(manager, entry);
-                        manager->stats.tags_generated += CIPSO_V4_MAX_TAGS;
-                    }
-                }
-                if (entry) {
-                    // Validate tags
-                    for (int j = 0; j < CIPSO_V4_MAX_TAGS; j++) {
-                        if (cipso_validate_tag(&entry->tags[j]) == 0) {
-                            manager->stats.tags_processed++;
-                        } else {
-                            manager->stats.errors++;
-                        }
-                    }
-                }
+                uint8_t opt[CIPSO_V4_OPT_LEN_MAX];
+                uint16_t cats[CIPSO_V4_MAX_TAGS];
+                cipso_secattr_t secattr;
+
+                for (int j = 0; j < CIPSO_V4_MAX_TAGS; j++)
+                    cats[j] = rand() % 4;
+                cipso_build_enum_opt(opt, doi, rand() % 3 + 1, cats,
+                                     CIPSO_V4_MAX_TAGS);
+                manager->stats.tags_generated++;
+                cipso_getattr(manager, opt, &secattr);
             }
         }
         sleep(1);
@@ -438,11 +915,7 @@ void calculate_stats(cipso_manager_t *manager) {
     // Count current cache entries
     size_t total_entries = 0;
     for (size_t i = 0; i < CIPSO_V4_MAX_CACHE_SLOTS; i++) {
-        cache_entry_t *entry = manager->cache[i];
-        while (entry) {
-            total_entries++;
-            entry = entry->next;
-        }
+        total_entries += manager->cache[i].size;
     }
 
     LOG(LOG_LEVEL_INFO, "Cache entries: %zu", total_entries);
@@ -458,6 +931,8 @@ void print_test_stats(cipso_manager_t *manager) {
     printf("Cache Hits:        %lu\n", manager->stats.cache_hits);
     printf("Cache Misses:      %lu\n", manager->stats.cache_misses);
     printf("Cache Invalids:    %lu\n", manager->stats.cache_invalidations);
+    printf("Cache Evictions:   %lu\n", manager->stats.cache_evictions);
+    printf("Cache Promotions:  %lu\n", manager->stats.cache_promotions);
     printf("Tags Processed:    %lu\n", manager->stats.tags_processed);
     printf("Tags Generated:    %lu\n", manager->stats.tags_generated);
     printf("Errors:           %lu\n", manager->stats.errors);
@@ -476,12 +951,13 @@ void print_test_stats(cipso_manager_t *manager) {
     // Print cache details
     printf("\nCache Details:\n");
     for (size_t i = 0; i < CIPSO_V4_MAX_CACHE_SLOTS; i++) {
-        cache_entry_t *entry = manager->cache[i];
+        cache_entry_t *entry = atomic_load(&manager->cache[i].list);
         if (entry) {
             printf("  Slot %zu:\n", i);
             while (entry) {
-                printf("    DOI %u: %d tags\n", entry->doi, CIPSO_V4_MAX_TAGS);
-                entry = entry->next;
+                printf("    DOI %u: level %u, %u hits\n", entry->doi,
+                       entry->secattr.level, atomic_load(&entry->activity));
+                entry = atomic_load(&entry->next);
             }
         }
     }
@@ -489,11 +965,6 @@ void print_test_stats(cipso_manager_t *manager) {
 
 // Destroy Cache Entry
 void destroy_cache_entry(cache_entry_t *entry) {
-    if (!entry) return;
-
-    for (int i = 0; i < CIPSO_V4_MAX_TAGS; i++) {
-        free(entry->tags[i].data);
-    }
     free(entry);
 }
 
@@ -511,6 +982,10 @@ void destroy_doi_def(doi_def_t *def) {
     }
     free(def->categories);
 
+    for (size_t i = 0; i < def->nr_maps; i++) {
+        free(def->maps[i].level_map);
+        free(def->maps[i].cat_map);
+    }
     free(def->maps);
     free(def);
 }
@@ -525,16 +1000,23 @@ void destroy_cipso_manager(cipso_manager_t *manager) {
             destroy_doi_def(manager->doi_defs[i]);
         }
     }
+    while (manager->doi_retired) {
+        doi_def_t *next = manager->doi_retired->retired_next;
+        destroy_doi_def(manager->doi_retired);
+        manager->doi_retired = next;
+    }
 
     // Clean up cache
+    cipso_cache_invalidate(manager);
+    while (manager->cache_free) {
+        cache_entry_t *next = manager->cache_free->free_next;
+        destroy_cache_entry(manager->cache_free);
+        manager->cache_free = next;
+    }
     for (size_t i = 0; i < CIPSO_V4_MAX_CACHE_SLOTS; i++) {
-        cache_entry_t *entry = manager->cache[i];
-        while (entry) {
-            cache_entry_t *next = entry->next;
-            destroy_cache_entry(entry);
-            entry = next;
-        }
+        pthread_mutex_destroy(&manager->cache[i].lock);
     }
+    pthread_mutex_destroy(&manager->cache_free_lock);
 
     pthread_mutex_destroy(&manager->manager_lock);
     free(manager);
@@ -554,13 +1036,120 @@ void demonstrate_cipso(void) {
     }
 }
 
-int main(void) {
+// Benchmark Parameters
+#define BENCH_DOIS      64
+#define BENCH_HOT       1024        // Fits in the cache
+#define BENCH_COLD      (1 << 16)   // Labels seen once in a long while
+#define BENCH_PACKETS   (1 << 21)
+
+static double bench_elapsed_ns(const struct timespec *start) {
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
+
+// Labelled packets per second through cipso_getattr() at several hit ratios
+int run_benchmark(void) {
+    static const int hit_pct[] = { 0, 50, 90, 99, 100 };
+    cipso_manager_t *manager = create_cipso_manager();
+    uint8_t (*labels)[CIPSO_V4_OPT_LEN_MAX];
+    uint32_t *trace;
+    cipso_secattr_t secattr;
+    struct timespec start;
+
+    if (!manager) return 1;
+
+    labels = malloc((size_t)(BENCH_HOT + BENCH_COLD) * sizeof(*labels));
+    trace = malloc(BENCH_PACKETS * sizeof(*trace));
+    if (!labels || !trace) return 1;
+
+    // DOIs with real level and category translation tables
+    for (uint32_t d = 0; d < BENCH_DOIS; d++) {
+        doi_def_t *def = create_doi_def(3000 + d * 7919);
+        def->maps = calloc(1, sizeof(doi_mapping_t));
+        def->nr_maps = 1;
+        def->maps[0].level_map = malloc(256);
+        def->maps[0].cat_map = malloc(CIPSO_V4_MAX_CATS * sizeof(uint16_t));
+        for (int l = 0; l < 256; l++)
+            def->maps[0].level_map[l] = l < 16 ? 15 - l : CIPSO_V4_INV_LVL;
+        for (int c = 0; c < CIPSO_V4_MAX_CATS; c++)
+            def->maps[0].cat_map[c] = CIPSO_V4_MAX_CATS - 1 - c;
+        cipso_add_doi_def(manager, def);
+    }
+
+    // Bitmap tags (the common default) over the full category space
+    for (uint32_t i = 0; i < BENCH_HOT + BENCH_COLD; i++) {
+        uint8_t bitmap[(CIPSO_V4_MAX_CATS + 7) / 8];
+
+        for (size_t b = 0; b < sizeof(bitmap); b++)
+            bitmap[b] = (uint8_t)((i * 2654435761u) >> (b % 24)) | 0x11;
+        bitmap[sizeof(bitmap) - 1] &= 0xfe;     // Only 239 categories
+        cipso_build_rbitmap_opt(labels[i], 3000 + (i % BENCH_DOIS) * 7919,
+                                i % 16, bitmap, sizeof(bitmap));
+    }
+
+    printf("CIPSO label translation, %d packets per run\n", BENCH_PACKETS);
+    printf("%8s %14s %14s %10s\n", "hit %", "cached pps", "uncached pps",
+           "measured");
+    for (size_t r = 0; r < sizeof(hit_pct) / sizeof(hit_pct[0]); r++) {
+        double ns_cached, ns_uncached;
+        uint64_t hits, lookups;
+        uint32_t cold = 0;
+
+        for (uint32_t i = 0; i < BENCH_PACKETS; i++) {
+            if ((uint32_t)rand() % 100 < (uint32_t)hit_pct[r])
+                trace[i] = rand() % BENCH_HOT;
+            else
+                trace[i] = BENCH_HOT + cold++ % BENCH_COLD;
+        }
+
+        // Warm the hot set, then measure
+        cipso_cache_invalidate(manager);
+        manager->cache_enabled = true;
+        for (uint32_t i = 0; i < BENCH_HOT; i++)
+            cipso_getattr(manager, labels[i], &secattr);
+        hits = manager->stats.cache_hits;
+        lookups = hits + manager->stats.cache_misses;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (uint32_t i = 0; i < BENCH_PACKETS; i++)
+            cipso_getattr(manager, labels[trace[i]], &secattr);
+        ns_cached = bench_elapsed_ns(&start);
+        hits = manager->stats.cache_hits - hits;
+        lookups = manager->stats.cache_hits + manager->stats.cache_misses - lookups;
+
+        manager->cache_enabled = false;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (uint32_t i = 0; i < BENCH_PACKETS; i++)
+            cipso_getattr(manager, labels[trace[i]], &secattr);
+        ns_uncached = bench_elapsed_ns(&start);
+
+        printf("%8d %14.0f %14.0f %9.1f%%\n", hit_pct[r],
+               BENCH_PACKETS / (ns_cached / 1e9),
+               BENCH_PACKETS / (ns_uncached / 1e9),
+               100.0 * hits / lookups);
+    }
+    printf("evictions %lu, promotions %lu, errors %lu\n",
+           manager->stats.cache_evictions, manager->stats.cache_promotions,
+           manager->stats.errors);
+
+    free(labels);
+    free(trace);
+    destroy_cipso_manager(manager);
+    return 0;
+}
+
+int main(int argc, char **argv) {
     // Set log level
     current_log_level = LOG_LEVEL_INFO;
 
     // Seed random number generator
     srand(time(NULL));
 
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        return run_benchmark();
+
     // Run demonstration
     demonstrate_cipso();
 
@@ -9,6 +9,7 @@
 #include <unistd.h>
 #include <sys/time.h>
 #include <signal.h>
+#include "des_sim.h"
 
 // Logging Macros
 #define LOG_LEVEL_DEBUG 0
@@ -114,6 +115,7 @@ typedef struct {
     bool running;
     pthread_mutex_t manager_lock;
     pthread_t tick_thread;
+    struct des_sim *sim;      // set while running in virtual time
     clock_stats_t stats;
 } clock_manager_t;
 
@@ -126,10 +128,12 @@ const char* get_event_type_string(event_type_t type);
 clock_manager_t* create_clock_manager(size_t nr_cpus);
 void destroy_clock_manager(clock_manager_t *manager);
 
+void clock_tick(clock_manager_t *manager);
 void* tick_thread(void *arg);
 void handle_clock_event(clock_manager_t *manager, clock_event_t *event);
 void simulate_clock_activity(clock_manager_t *manager);
 void run_test(clock_manager_t *manager);
+void run_test_virtual(clock_manager_t *manager, uint64_t seed, uint64_t duration_us);
 
 uint64_t get_cpu_clock(clock_manager_t *manager, unsigned int cpu_id);
 void calibrate_cpu_clock(clock_manager_t *manager, unsigned int cpu_id);
@@ -137,7 +141,7 @@ void switch_clock_source(clock_manager_t *manager, unsigned int cpu_id, clock_so
 
 void calculate_stats(clock_manager_t *manager);
 void print_test_stats(clock_manager_t *manager);
-void demonstrate_clock(void);
+void demonstrate_clock(const struct des_options *opts);
 
 // Utility Functions
 const char* get_log_level_string(int level) {
@@ -180,6 +184,11 @@ const char* get_event_type_string(event_type_t type) {
     }
 }
 
+// Random draw from the simulation's RNG in virtual time, rand() otherwise
+static uint64_t clock_rand(clock_manager_t *manager, uint64_t n) {
+    return manager->sim ? des_rand_range(manager->sim, n) : (uint64_t)rand() % n;
+}
+
 // Create Clock Manager
 clock_manager_t* create_clock_manager(size_t nr_cpus) {
     if (nr_cpus > MAX_CPUS) {
@@ -246,6 +255,7 @@ clock_manager_t* create_clock_manager(size_t nr_cpus) {
     manager->nr_sources = MAX_CLOCK_SOURCES;
     manager->nr_events = 0;
     manager->running = false;
+    manager->sim = NULL;
     pthread_mutex_init(&manager->manager_lock, NULL);
     memset(&manager->stats, 0, sizeof(clock_stats_t));
 
@@ -253,6 +263,30 @@ clock_manager_t* create_clock_manager(size_t nr_cpus) {
     return manager;
 }
 
+// Process one tick on every CPU
+void clock_tick(clock_manager_t *manager) {
+    for (size_t i = 0; i < manager->nr_cpus; i++) {
+        pthread_mutex_lock(&manager->cpus[i].lock);
+        
+        if (manager->cpus[i].state == CLOCK_RUNNING) {
+            // Update local clock
+            uint64_t increment = TICK_PERIOD_NS;
+            
+            // Apply drift
+            increment += (increment * manager->cpus[i].drift_ns) / 1000000000ULL;
+            
+            manager->cpus[i].local_clock += increment;
+            manager->cpus[i].ticks++;
+            manager->stats.total_ticks++;
+        } else if (manager->cpus[i].state == CLOCK_SUSPENDED) {
+            manager->cpus[i].missed_ticks++;
+            manager->stats.missed_ticks++;
+        }
+
+        pthread_mutex_unlock(&manager->cpus[i].lock);
+    }
+}
+
 // Tick Thread
 void* tick_thread(void *arg) {
     clock_manager_t *manager = (clock_manager_t*)arg;
@@ -263,26 +297,7 @@ void* tick_thread(void *arg) {
         clock_gettime(CLOCK_MONOTONIC, &start);
 
         // Process tick for each CPU
-        for (size_t i = 0; i < manager->nr_cpus; i++) {
-            pthread_mutex_lock(&manager->cpus[i].lock);
-            
-            if (manager->cpus[i].state == CLOCK_RUNNING) {
-                // Update local clock
-                uint64_t increment = TICK_PERIOD_NS;
-                
-                // Apply drift
-                increment += (increment * manager->cpus[i].drift_ns) / 1000000000ULL;
-                
-                manager->cpus[i].local_clock += increment;
-                manager->cpus[i].ticks++;
-                manager->stats.total_ticks++;
-            } else if (manager->cpus[i].state == CLOCK_SUSPENDED) {
-                manager->cpus[i].missed_ticks++;
-                manager->stats.missed_ticks++;
-            }
-
-            pthread_mutex_unlock(&manager->cpus[i].lock);
-        }
+        clock_tick(manager);
 
         // Simulate clock events
         if (tick_count % 1000 == 0) {  // Every second
@@ -357,14 +372,13 @@ void switch_clock_source(clock_manager_t *manager, unsigned int cpu_id,
     
     clock_source_t old_source = manager->cpus[cpu_id].current_source;
     manager->cpus[cpu_id].current_source = new_source;
-    
-    // Recalibrate after switch
-    calibrate_cpu_clock(manager, cpu_id);
-    
     manager->stats.clock_switches++;
     
     pthread_mutex_unlock(&manager->cpus[cpu_id].lock);
 
+    // Recalibrate after switch; calibrate_cpu_clock takes the CPU lock itself
+    calibrate_cpu_clock(manager, cpu_id);
+
     LOG(LOG_LEVEL_INFO, "CPU %u switched clock source: %s -> %s",
         cpu_id, get_clock_source_string(old_source),
         get_clock_source_string(new_source));
@@ -376,7 +390,7 @@ void simulate_clock_activity(clock_manager_t *manager) {
 
     for (size_t i = 0; i < manager->nr_cpus; i++) {
         // Randomly introduce events
-        int event_type = rand() % 100;
+        int event_type = clock_rand(manager, 100);
         
         if (event_type < 5) {  // 5% chance of suspend/resume
             pthread_mutex_lock(&manager->cpus[i].lock);
@@ -391,7 +405,7 @@ void simulate_clock_activity(clock_manager_t *manager) {
             }
             pthread_mutex_unlock(&manager->cpus[i].lock);
         } else if (event_type < 10) {  // 5% chance of clock switch
-            clock_source_t new_source = rand() % manager->nr_sources;
+            clock_source_t new_source = clock_rand(manager, manager->nr_sources);
             switch_clock_source(manager, i, new_source);
         } else if (event_type < 15) {  // 5% chance of calibration
             calibrate_cpu_clock(manager, i);
@@ -417,6 +431,53 @@ void run_test(clock_manager_t *manager) {
     pthread_join(manager->tick_thread, NULL);
 
     // Calculate statistics
+    manager->stats.test_duration = TEST_DURATION;
+    calculate_stats(manager);
+}
+
+// Virtual Tick: the body of one tick_thread iteration; data is the tick count
+static void virtual_tick_event(struct des_sim *sim, void *arg, uint64_t data) {
+    clock_manager_t *manager = arg;
+
+    clock_tick(manager);
+    if (data % 1000 == 0)  // Every second
+        simulate_clock_activity(manager);
+
+    des_schedule(sim, TICK_PERIOD_NS / 1000, virtual_tick_event, manager, data + 1);
+}
+
+// Run Test in virtual time: the workload of run_test, driven by the
+// event engine and a seeded RNG, so runs are fast and reproducible
+void run_test_virtual(clock_manager_t *manager, uint64_t seed, uint64_t duration_us) {
+    if (!manager) return;
+
+    struct des_sim sim;
+    if (!des_init(&sim, seed)) {
+        LOG(LOG_LEVEL_ERROR, "Failed to initialize simulation");
+        return;
+    }
+
+    LOG(LOG_LEVEL_INFO, "Starting clock test (virtual time, seed %lu, %.0f s)...",
+        seed, duration_us / 1e6);
+
+    manager->sim = &sim;
+    des_schedule(&sim, 0, virtual_tick_event, manager, 0);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    des_run_until(&sim, duration_us);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    LOG(LOG_LEVEL_INFO, "Simulated %.0f s in %.3f s (%lu events)",
+        duration_us / 1e6,
+        (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9,
+        sim.nr_fired);
+
+    manager->sim = NULL;
+    des_destroy(&sim);
+
+    // Calculate statistics
+    manager->stats.test_duration = duration_us / 1e6;
     calculate_stats(manager);
 }
 
@@ -435,7 +496,6 @@ void calculate_stats(clock_manager_t *manager) {
 
     manager->stats.avg_drift = total_drift / manager->nr_cpus;
     manager->stats.max_drift = max_drift;
-    manager->stats.test_duration = TEST_DURATION;
 }
 
 // Print Test Statistics
@@ -483,19 +543,26 @@ void destroy_clock_manager(clock_manager_t *manager) {
 }
 
 // Demonstrate Clock
-void demonstrate_clock(void) {
+void demonstrate_clock(const struct des_options *opts) {
     printf("Starting clock demonstration...\n");
 
     // Create and run clock test
     clock_manager_t *manager = create_clock_manager(8);
     if (manager) {
-        run_test(manager);
+        if (opts->threaded)
+            run_test(manager);
+        else
+            run_test_virtual(manager, opts->seed, opts->duration_us);
         print_test_stats(manager);
         destroy_clock_manager(manager);
     }
 }
 
-int main(void) {
+int main(int argc, char **argv) {
+    struct des_options opts;
+    if (!des_parse_options(argc, argv, &opts, TEST_DURATION * 1000000ULL))
+        return 1;
+
     // Set log level
     current_log_level = LOG_LEVEL_INFO;
 
@@ -503,7 +570,7 @@ int main(void) {
     srand(time(NULL));
 
     // Run demonstration
-    demonstrate_clock();
+    demonstrate_clock(&opts);
 
     return 0;
 }
@@ -10,6 +10,8 @@
 #include <sys/time.h>
 #include <signal.h>
 
+#include "timer_wheel_sim.h"
+
 // Logging Macros
 #define LOG_LEVEL_DEBUG 0
 #define LOG_LEVEL_INFO  1
@@ -30,11 +32,15 @@ static int current_log_level = LOG_LEVEL_INFO;
 // Clock Event Constants
 #define MAX_CPUS           16
 #define MAX_DEVICES        32
-#define MAX_EVENTS         1024
 #define MAX_HANDLERS       64
-#define MIN_DELTA         1000     // 1us minimum delta
-#define MAX_DELTA         1000000  // 1s maximum delta
+#define MIN_DELTA         1000        // 1us minimum delta
+#define MAX_DELTA         1000000000  // 1s maximum delta
 #define TEST_DURATION     30       // seconds
+#define TICK_NS           1000000ULL  // 1ms tick (HZ=1000)
+#define NR_TEST_TIMERS    32
+#define MIN_TEST_PERIOD   50       // ms
+#define MAX_TEST_PERIOD   2000     // ms
+#define TEST_CHURN_US     10000    // a timer is pushed out this often
 
 // Clock Event States
 typedef enum {
@@ -84,9 +90,27 @@ typedef struct {
     pthread_mutex_t lock;
 } clock_event_device_t;
 
+// Timer List Structure
+//
+// Low-resolution timer run from the tick: on the tick wheel it costs
+// O(1) to arm, re-arm or delete, and fires up to a tick late, plus up
+// to a granule of its wheel level for long timeouts.
+typedef struct {
+    struct wheel_timer entry;       // expires in ticks
+    uint64_t expires;               // ns, CLOCK_MONOTONIC
+    uint64_t period;                // ns, re-armed on expiry if nonzero
+    void (*func)(void *data);
+    void *data;
+} timer_list_t;
+
 // Clock Event Statistics Structure
 typedef struct {
     uint64_t total_events;
+    uint64_t timer_events;
+    uint64_t periodic_ticks;        // wakeups with the tick running
+    uint64_t nohz_ticks;            // wakeups with the tick stopped
+    uint64_t skipped_ticks;         // ticks slept through in NOHZ
+    uint64_t latency_sum;           // ns, timer expiry to run
     uint64_t oneshot_events;
     uint64_t periodic_events;
     uint64_t missed_events;
@@ -108,6 +132,15 @@ typedef struct {
     pthread_mutex_t manager_lock;
     pthread_t timer_thread;
     clock_event_stats_t stats;
+
+    // Tick, under manager_lock
+    clock_event_device_t *tick_device;
+    struct timer_wheel wheel;       // timer_list_t entries
+    bool nohz;                      // stop the tick while no timer is due
+    uint64_t now;                   // ns, while timers run
+    uint64_t last_tick;
+    uint64_t next_event;            // ns the tick device is programmed for
+    pthread_cond_t tick_cond;       // an earlier timer reprograms the tick
 } clock_event_manager_t;
 
 // Function Prototypes
@@ -127,6 +160,10 @@ int register_clock_event_handler(clock_event_manager_t *manager,
 void unregister_clock_event_handler(clock_event_manager_t *manager,
     unsigned int handler_id);
 
+void init_timer(timer_list_t *timer, void (*func)(void *data), void *data);
+int mod_timer(clock_event_manager_t *manager, timer_list_t *timer, uint64_t expires);
+int del_timer(clock_event_manager_t *manager, timer_list_t *timer);
+
 void* timer_thread(void *arg);
 void process_clock_events(clock_event_manager_t *manager);
 void simulate_clock_events(clock_event_manager_t *manager);
@@ -167,6 +204,13 @@ const char* get_clock_event_rating_string(clock_event_rating_t rating) {
     }
 }
 
+// Current Time (ns, CLOCK_MONOTONIC)
+static uint64_t clock_event_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
 // Create Clock Event Device
 clock_event_device_t* create_clock_event_device(const char *name,
     clock_event_features_t features, clock_event_rating_t rating) {
@@ -204,6 +248,21 @@ clock_event_manager_t* create_clock_event_manager(void) {
     pthread_mutex_init(&manager->manager_lock, NULL);
     memset(&manager->stats, 0, sizeof(clock_event_stats_t));
 
+    // The tick thread sleeps on CLOCK_MONOTONIC deadlines
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&manager->tick_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    uint64_t now = clock_event_now();
+    timer_wheel_init(&manager->wheel, now / TICK_NS);
+    manager->tick_device = NULL;
+    manager->nohz = false;
+    manager->now = now;
+    manager->last_tick = now / TICK_NS;
+    manager->next_event = now;
+
     // Create default devices
     const char *device_names[] = {
         "Local APIC Timer",
@@ -234,6 +293,16 @@ clock_event_manager_t* create_clock_event_manager(void) {
         }
     }
 
+    // Tick device: the best rated one that can be programmed one-shot,
+    // which is what stopping the tick needs
+    for (size_t i = 0; i < manager->nr_devices; i++) {
+        clock_event_device_t *device = &manager->devices[i];
+        if ((device->features & CLOCK_EVT_FEAT_ONESHOT) &&
+            (!manager->tick_device || device->rating > manager->tick_device->rating)) {
+            manager->tick_device = device;
+        }
+    }
+
     LOG(LOG_LEVEL_DEBUG, "Created clock event manager with %zu devices",
         manager->nr_devices);
     return manager;
@@ -268,15 +337,149 @@ void unregister_clock_event_handler(clock_event_manager_t *manager,
     LOG(LOG_LEVEL_DEBUG, "Unregistered clock event handler %u", handler_id);
 }
 
+// Program the tick device: the next tick, or with the tick stopped the
+// next timer, no further out than the device can count
+static void tick_program_next(clock_event_manager_t *manager, uint64_t now_tick) {
+    uint64_t next_tick = now_tick + 1;
+
+    if (manager->nohz && manager->tick_device) {
+        uint64_t max_ticks = manager->tick_device->max_delta_ns / TICK_NS;
+        uint64_t expiry = timer_wheel_next_expiry(&manager->wheel);
+
+        if (max_ticks < 1) max_ticks = 1;
+        if (expiry > now_tick) {
+            next_tick = expiry - now_tick < max_ticks ? expiry : now_tick + max_ticks;
+        }
+    }
+    manager->next_event = next_tick * TICK_NS;
+}
+
+// Modify Timer
+//
+// Arms the timer for expires (ns), or moves it there if it is already
+// pending.  Returns 1 if it was pending.  A timer due before the tick
+// device fires next reprograms it.
+int mod_timer(clock_event_manager_t *manager, timer_list_t *timer, uint64_t expires) {
+    if (!manager || !timer) return -1;
+
+    pthread_mutex_lock(&manager->manager_lock);
+    bool pending = wheel_timer_pending(&timer->entry);
+    uint64_t now_tick = clock_event_now() / TICK_NS;
+
+    timer->expires = expires;
+    timer_wheel_add(&manager->wheel, &timer->entry,
+        (expires + TICK_NS - 1) / TICK_NS, now_tick);
+
+    uint64_t next = timer_wheel_next_expiry(&manager->wheel) * TICK_NS;
+    if (next < manager->next_event) {
+        manager->next_event = next;
+        pthread_cond_signal(&manager->tick_cond);
+    }
+    pthread_mutex_unlock(&manager->manager_lock);
+
+    return pending;
+}
+
+// Delete Timer
+//
+// Returns 1 if the timer was pending.  The tick is not reprogrammed: it
+// fires early at worst, finds nothing due and sleeps again.
+int del_timer(clock_event_manager_t *manager, timer_list_t *timer) {
+    if (!manager || !timer) return -1;
+
+    pthread_mutex_lock(&manager->manager_lock);
+    bool pending = timer_wheel_del(&manager->wheel, &timer->entry);
+    pthread_mutex_unlock(&manager->manager_lock);
+
+    return pending;
+}
+
+// Timer Expiry (wheel callback, manager lock held)
+static void timer_list_fn(struct wheel_timer *entry, void *arg) {
+    timer_list_t *timer = container_of(entry, timer_list_t, entry);
+    clock_event_manager_t *manager = (clock_event_manager_t*)arg;
+    clock_event_stats_t *stats = &manager->stats;
+
+    double latency = (double)(manager->now - timer->expires);
+    stats->timer_events++;
+    stats->latency_sum += manager->now - timer->expires;
+    if (latency > stats->max_latency) {
+        stats->max_latency = latency;
+    }
+    if (latency < stats->min_latency || stats->timer_events == 1) {
+        stats->min_latency = latency;
+    }
+
+    if (timer->func) {
+        timer->func(timer->data);
+    }
+
+    if (timer->period) {
+        timer->expires += timer->period;
+        if (timer->expires <= manager->now) {
+            timer->expires = manager->now + timer->period;
+        }
+        timer_wheel_add(&manager->wheel, &timer->entry,
+            (timer->expires + TICK_NS - 1) / TICK_NS, manager->now / TICK_NS);
+    }
+}
+
+// Initialize Timer
+void init_timer(timer_list_t *timer, void (*func)(void *data), void *data) {
+    wheel_timer_init(&timer->entry, timer_list_fn);
+    timer->expires = 0;
+    timer->period = 0;
+    timer->func = func;
+    timer->data = data;
+}
+
+// Run Timers (manager lock held)
+static void run_timers(clock_event_manager_t *manager, uint64_t now) {
+    manager->now = now;
+    timer_wheel_run(&manager->wheel, now / TICK_NS, manager);
+}
+
 // Timer Thread
+//
+// The tick: each wakeup runs the due timers and the tick handlers, then
+// sleeps until the programmed next event.  In NOHZ mode that is the
+// next timer rather than the next tick, found from the wheel's pending
+// bitmaps; an earlier mod_timer() signals it to sleep less.
 void* timer_thread(void *arg) {
     clock_event_manager_t *manager = (clock_event_manager_t*)arg;
 
+    pthread_mutex_lock(&manager->manager_lock);
     while (manager->running) {
+        uint64_t now = clock_event_now();
+        uint64_t now_tick = now / TICK_NS;
+
+        if (manager->nohz) {
+            manager->stats.nohz_ticks++;
+            if (now_tick > manager->last_tick + 1) {
+                manager->stats.skipped_ticks += now_tick - manager->last_tick - 1;
+            }
+        } else {
+            manager->stats.periodic_ticks++;
+        }
+        manager->last_tick = now_tick;
+
+        run_timers(manager, now);
+
+        pthread_mutex_unlock(&manager->manager_lock);
         process_clock_events(manager);
         simulate_clock_events(manager);
-        usleep(1000);  // 1ms tick
+        pthread_mutex_lock(&manager->manager_lock);
+
+        tick_program_next(manager, now_tick);
+        while (manager->running && clock_event_now() < manager->next_event) {
+            struct timespec deadline = {
+                .tv_sec = manager->next_event / 1000000000ULL,
+                .tv_nsec = manager->next_event % 1000000000ULL,
+            };
+            pthread_cond_timedwait(&manager->tick_cond, &manager->manager_lock, &deadline);
+        }
     }
+    pthread_mutex_unlock(&manager->manager_lock);
 
     return NULL;
 }
@@ -285,10 +488,6 @@ void* timer_thread(void *arg) {
 void process_clock_events(clock_event_manager_t *manager) {
     if (!manager) return;
 
-    struct timespec now;
-    clock_gettime(CLOCK_MONOTONIC, &now);
-    uint64_t current_ns = now.tv_sec * 1000000000ULL + now.tv_nsec;
-
     for (size_t i = 0; i < manager->nr_devices; i++) {
         clock_event_device_t *device = &manager->devices[i];
         pthread_mutex_lock(&device->lock);
@@ -352,6 +551,11 @@ void simulate_clock_events(clock_event_manager_t *manager) {
     }
 }
 
+// Test handler: data is the message to print
+static void print_handler(void *data) {
+    fputs(data, stdout);
+}
+
 // Run Test
 void run_test(clock_event_manager_t *manager) {
     if (!manager) return;
@@ -360,21 +564,56 @@ void run_test(clock_event_manager_t *manager) {
 
     // Register test handlers
     register_clock_event_handler(manager, 
-        (void(*)(void*))printf, "Handler 1 triggered\n");
+        print_handler, "Handler 1 triggered\n");
     register_clock_event_handler(manager,
-        (void(*)(void*))printf, "Handler 2 triggered\n");
+        print_handler, "Handler 2 triggered\n");
+
+    // Test timers: periodic housekeeping, 50ms-2s apart
+    timer_list_t *timers = calloc(NR_TEST_TIMERS, sizeof(timer_list_t));
+    if (!timers) {
+        LOG(LOG_LEVEL_ERROR, "Failed to allocate test timers");
+        return;
+    }
+    uint64_t now = clock_event_now();
+    for (size_t i = 0; i < NR_TEST_TIMERS; i++) {
+        init_timer(&timers[i], NULL, NULL);
+        timers[i].period = (uint64_t)(rand() %
+            (MAX_TEST_PERIOD - MIN_TEST_PERIOD) + MIN_TEST_PERIOD) * 1000000ULL;
+        mod_timer(manager, &timers[i], now + timers[i].period);
+    }
 
     // Start timer thread
     manager->running = true;
     pthread_create(&manager->timer_thread, NULL, timer_thread, manager);
 
-    // Run test
-    sleep(TEST_DURATION);
+    // Run test: half with a periodic tick, half with the tick stopped
+    // while idle.  Meanwhile timers are pushed out, as traffic would.
+    for (int phase = 0; phase < 2; phase++) {
+        pthread_mutex_lock(&manager->manager_lock);
+        manager->nohz = phase == 1;
+        pthread_mutex_unlock(&manager->manager_lock);
+        LOG(LOG_LEVEL_INFO, "Tick mode: %s", phase ? "NOHZ" : "periodic");
+
+        uint64_t end = clock_event_now() + TEST_DURATION * 1000000000ULL / 2;
+        while (clock_event_now() < end) {
+            timer_list_t *timer = &timers[rand() % NR_TEST_TIMERS];
+            mod_timer(manager, timer, clock_event_now() + timer->period);
+            usleep(TEST_CHURN_US);
+        }
+    }
 
     // Stop timer thread
+    pthread_mutex_lock(&manager->manager_lock);
     manager->running = false;
+    pthread_cond_signal(&manager->tick_cond);
+    pthread_mutex_unlock(&manager->manager_lock);
     pthread_join(manager->timer_thread, NULL);
 
+    for (size_t i = 0; i < NR_TEST_TIMERS; i++) {
+        del_timer(manager, &timers[i]);
+    }
+    free(timers);
+
     // Calculate statistics
     calculate_stats(manager);
 }
@@ -383,11 +622,11 @@ void run_test(clock_event_manager_t *manager) {
 void calculate_stats(clock_event_manager_t *manager) {
     if (!manager) return;
 
-    if (manager->stats.total_events > 0) {
-        // Calculate latency statistics (simulated values)
-        manager->stats.avg_latency = 500.0;  // 500ns average latency
-        manager->stats.max_latency = 2000.0; // 2us maximum latency
-        manager->stats.min_latency = 100.0;  // 100ns minimum latency
+    // Latency from timer expiry to its callback; max/min are kept as
+    // timers run
+    if (manager->stats.timer_events > 0) {
+        manager->stats.avg_latency =
+            (double)manager->stats.latency_sum / manager->stats.timer_events;
     }
 
     manager->stats.test_duration = TEST_DURATION;
@@ -406,6 +645,12 @@ void print_test_stats(clock_event_manager_t *manager) {
     printf("Missed Events:     %lu\n", manager->stats.missed_events);
     printf("Early Events:      %lu\n", manager->stats.early_events);
     printf("Late Events:       %lu\n", manager->stats.late_events);
+    printf("Timer Events:      %lu\n", manager->stats.timer_events);
+    printf("Periodic Ticks:    %lu\n", manager->stats.periodic_ticks);
+    printf("NOHZ Wakeups:      %lu\n", manager->stats.nohz_ticks);
+    printf("Skipped Ticks:     %lu\n", manager->stats.skipped_ticks);
+    printf("Tick Device:       %s\n",
+        manager->tick_device ? manager->tick_device->name : "none");
     printf("Avg Latency:       %.2f ns\n", manager->stats.avg_latency);
     printf("Max Latency:       %.2f ns\n", manager->stats.max_latency);
     printf("Min Latency:       %.2f ns\n", manager->stats.min_latency);
@@ -441,6 +686,7 @@ void destroy_clock_event_manager(clock_event_manager_t *manager) {
         destroy_clock_event_device(&manager->devices[i]);
     }
 
+    pthread_cond_destroy(&manager->tick_cond);
     pthread_mutex_destroy(&manager->manager_lock);
     free(manager);
     LOG(LOG_LEVEL_DEBUG, "Destroyed clock event manager");
@@ -4,6 +4,10 @@
 #include <stdbool.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 
 // Logging Macros
 #define LOG_LEVEL_DEBUG 0
@@ -22,6 +26,12 @@
 // Global Log Level
 static int current_log_level = LOG_LEVEL_INFO;
 
+// Event Engine Constants
+#define CM_DEFAULT_QUEUE_DEPTH  256
+#define CM_EVENT_BATCH_MAX      64     // Events handed to one batch callback
+#define CM_POLL_BUDGET          256    // Connections reaped per poll
+#define CM_POLL_SPIN            64     // Empty polls before yielding the CPU
+
 // Connection States
 typedef enum {
     CM_STATE_IDLE,
@@ -86,13 +96,23 @@ typedef void (*cm_event_callback_fn)(
     struct cm_event *event
 );
 
-// Connection Event Structure
+// Batched Event Callback: events are only valid for the duration of the call
+typedef void (*cm_event_batch_callback_fn)(
+    struct cm_connection *conn,
+    struct cm_event *events,
+    size_t count
+);
+
+// Payloads up to this size are carried inside the event
+#define CM_EVENT_INLINE_DATA sizeof(cm_endpoint_t)
+
+// Connection Event Structure (a slot in the connection's event ring)
 typedef struct cm_event {
     cm_event_type_t type;
-    void *data;
+    void *data;                 // inline_data, or heap for large payloads
     size_t data_length;
     cm_event_callback_fn callback;
-    struct cm_event *next;
+    uint8_t inline_data[CM_EVENT_INLINE_DATA];
 } cm_event_t;
 
 // Connection Statistics
@@ -103,8 +123,12 @@ typedef struct {
     unsigned long bytes_received;
     unsigned long retransmissions;
     unsigned long timeouts;
+    unsigned long events_delivered;
+    unsigned long events_dropped;    // Event ring was full
 } cm_connection_stats_t;
 
+struct cm_completion_queue;
+
 // Connection Management Structure
 typedef struct cm_connection {
     uint64_t connection_id;
@@ -113,13 +137,20 @@ typedef struct cm_connection {
     cm_endpoint_t remote_endpoint;
     cm_connection_params_t params;
     
-    // Event Management
-    cm_event_t *event_queue;
-    size_t event_queue_depth;
+    // Event Management: single-producer/single-consumer ring sized by
+    // params.receive_queue_depth, consumed by the completion queue poller
+    cm_event_t *event_ring;
+    size_t event_ring_mask;
+    _Atomic size_t event_head;           // Next slot to deliver
+    _Atomic size_t event_tail;           // Next slot to fill
+    atomic_bool event_armed;             // Queued on the completion queue
+    struct cm_completion_queue *cq;
     
     // Callbacks
     cm_event_callback_fn state_change_callback;
     cm_event_callback_fn error_callback;
+    cm_event_batch_callback_fn batch_callback;
+    void *context;
     
     // Statistics
     cm_connection_stats_t stats;
@@ -130,14 +161,43 @@ typedef struct cm_connection {
     
     // Linked List Management
     struct cm_connection *next;
+    struct cm_connection **pprev;
 } cm_connection_t;
 
+// Completion Queue Slot
+typedef struct {
+    _Atomic size_t sequence;
+    cm_connection_t *connection;
+} cm_cq_slot_t;
+
+// Completion Queue: connections with pending events, shared by many
+// connections. Each connection is queued at most once (event_armed), so
+// a queue sized to max_connections never overflows.
+typedef struct cm_completion_queue {
+    cm_cq_slot_t *slots;
+    size_t mask;
+    _Atomic size_t enqueue_pos __attribute__((aligned(64)));
+    _Atomic size_t dequeue_pos __attribute__((aligned(64)));
+    
+    // Poller Statistics
+    unsigned long polls;
+    unsigned long empty_polls;
+    unsigned long completions;
+    unsigned long batches;
+    unsigned long events;
+} cm_completion_queue_t;
+
 // Connection Management System
 typedef struct {
     cm_connection_t *connections;
     size_t max_connections;
     size_t current_connections;
     
+    // Completion Queues, connections are spread across them
+    cm_completion_queue_t *cqs;
+    size_t num_cqs;
+    size_t next_cq;
+    
     // Global Statistics
     unsigned long total_connections_established;
     unsigned long total_connection_failures;
@@ -150,6 +210,7 @@ const char* get_connection_type_string(cm_connection_type_t type);
 const char* get_qos_level_string(cm_qos_level_t level);
 
 cm_system_t* create_cm_system(size_t max_connections);
+cm_system_t* create_cm_system_with_cqs(size_t max_connections, size_t num_cqs);
 void destroy_cm_system(cm_system_t *system);
 
 cm_connection_t* create_connection(
@@ -176,17 +237,27 @@ bool disconnect_connection(
     cm_connection_t *connection
 );
 
-void enqueue_event(
+bool enqueue_event(
     cm_connection_t *connection, 
     cm_event_type_t type, 
     void *data, 
     size_t data_length
 );
 
-void process_connection_events(
+size_t process_connection_events(
     cm_connection_t *connection
 );
 
+size_t poll_completion_queue(
+    cm_completion_queue_t *cq,
+    size_t budget
+);
+
+void run_event_loop(
+    cm_completion_queue_t *cq,
+    atomic_bool *stop
+);
+
 void print_connection_stats(
     cm_connection_t *connection
 );
@@ -241,8 +312,82 @@ const char* get_qos_level_string(cm_qos_level_t level) {
     }
 }
 
-// Create Connection Management System
-cm_system_t* create_cm_system(size_t max_connections) {
+// Round up to a power of two, at least 2
+static size_t cm_roundup_pow2(size_t n) {
+    size_t size = 2;
+
+    while (size < n) {
+        size <<= 1;
+    }
+    return size;
+}
+
+// Initialize Completion Queue
+static bool init_completion_queue(cm_completion_queue_t *cq, size_t entries) {
+    size_t size = cm_roundup_pow2(entries);
+
+    memset(cq, 0, sizeof(*cq));
+    cq->slots = malloc(size * sizeof(cm_cq_slot_t));
+    if (!cq->slots) {
+        return false;
+    }
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&cq->slots[i].sequence, i);
+        cq->slots[i].connection = NULL;
+    }
+    cq->mask = size - 1;
+    atomic_init(&cq->enqueue_pos, 0);
+    atomic_init(&cq->dequeue_pos, 0);
+    return true;
+}
+
+// Queue a connection with pending events; safe from any producer thread
+static bool cq_push(cm_completion_queue_t *cq, cm_connection_t *connection) {
+    size_t pos = atomic_load_explicit(&cq->enqueue_pos, memory_order_relaxed);
+
+    for (;;) {
+        cm_cq_slot_t *slot = &cq->slots[pos & cq->mask];
+        size_t seq = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&cq->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                slot->connection = connection;
+                atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;  // Full: cannot happen while sized to max_connections
+        } else {
+            pos = atomic_load_explicit(&cq->enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+// Reap up to max ready connections; only the queue's poller calls this
+static size_t cq_pop_batch(cm_completion_queue_t *cq, cm_connection_t **out, size_t max) {
+    size_t pos = atomic_load_explicit(&cq->dequeue_pos, memory_order_relaxed);
+    size_t n = 0;
+
+    while (n < max) {
+        cm_cq_slot_t *slot = &cq->slots[pos & cq->mask];
+        size_t seq = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+
+        if (seq != pos + 1) {
+            break;  // Empty, or a producer has claimed the slot but not filled it
+        }
+        out[n++] = slot->connection;
+        atomic_store_explicit(&slot->sequence, pos + cq->mask + 1, memory_order_release);
+        pos++;
+    }
+    atomic_store_explicit(&cq->dequeue_pos, pos, memory_order_relaxed);
+    return n;
+}
+
+// Create Connection Management System with Completion Queues
+cm_system_t* create_cm_system_with_cqs(size_t max_connections, size_t num_cqs) {
     cm_system_t *system = malloc(sizeof(cm_system_t));
     if (!system) {
         LOG(LOG_LEVEL_ERROR, "Failed to allocate CM system");
@@ -255,9 +400,35 @@ cm_system_t* create_cm_system(size_t max_connections) {
     system->total_connections_established = 0;
     system->total_connection_failures = 0;
 
+    // Every connection may sit on one queue at once
+    system->num_cqs = num_cqs ? num_cqs : 1;
+    system->next_cq = 0;
+    system->cqs = calloc(system->num_cqs, sizeof(cm_completion_queue_t));
+    if (!system->cqs) {
+        LOG(LOG_LEVEL_ERROR, "Failed to allocate completion queues");
+        free(system);
+        return NULL;
+    }
+    for (size_t i = 0; i < system->num_cqs; i++) {
+        if (!init_completion_queue(&system->cqs[i], max_connections)) {
+            LOG(LOG_LEVEL_ERROR, "Failed to allocate completion queue");
+            while (i--) {
+                free(system->cqs[i].slots);
+            }
+            free(system->cqs);
+            free(system);
+            return NULL;
+        }
+    }
+
     return system;
 }
 
+// Create Connection Management System
+cm_system_t* create_cm_system(size_t max_connections) {
+    return create_cm_system_with_cqs(max_connections, 1);
+}
+
 // Create Connection
 cm_connection_t* create_connection(
     cm_system_t *system,
@@ -294,17 +465,32 @@ cm_connection_t* create_connection(
         connection->params.type = CM_CONN_TYPE_RELIABLE;
         connection->params.qos_level = QOS_BEST_EFFORT;
         connection->params.max_message_size = 65536;
-        connection->params.receive_queue_depth = 256;
-        connection->params.send_queue_depth = 256;
+        connection->params.receive_queue_depth = CM_DEFAULT_QUEUE_DEPTH;
+        connection->params.send_queue_depth = CM_DEFAULT_QUEUE_DEPTH;
     }
 
-    // Initialize event queue
-    connection->event_queue = NULL;
-    connection->event_queue_depth = 0;
+    // Preallocate the event ring
+    size_t ring_size = cm_roundup_pow2(connection->params.receive_queue_depth ?
+                                       connection->params.receive_queue_depth :
+                                       CM_DEFAULT_QUEUE_DEPTH);
+    connection->event_ring = malloc(ring_size * sizeof(cm_event_t));
+    if (!connection->event_ring) {
+        LOG(LOG_LEVEL_ERROR, "Failed to allocate event ring");
+        free(connection);
+        return NULL;
+    }
+    connection->event_ring_mask = ring_size - 1;
+    atomic_init(&connection->event_head, 0);
+    atomic_init(&connection->event_tail, 0);
+    atomic_init(&connection->event_armed, false);
+    connection->cq = &system->cqs[system->next_cq];
+    system->next_cq = (system->next_cq + 1) % system->num_cqs;
 
     // Reset callbacks
     connection->state_change_callback = NULL;
     connection->error_callback = NULL;
+    connection->batch_callback = NULL;
+    connection->context = NULL;
 
     // Reset statistics
     memset(&connection->stats, 0, sizeof(cm_connection_stats_t));
@@ -315,6 +501,10 @@ cm_connection_t* create_connection(
 
     // Link to system
     connection->next = system->connections;
+    if (connection->next) {
+        connection->next->pprev = &connection->next;
+    }
+    connection->pprev = &system->connections;
     system->connections = connection;
     system->current_connections++;
 
@@ -448,59 +638,179 @@ bool disconnect_connection(cm_connection_t *connection) {
 }
 
 // Enqueue Connection Event
-void enqueue_event(
+// Single producer per connection. Returns false if the ring is full.
+bool enqueue_event(
     cm_connection_t *connection, 
     cm_event_type_t type, 
     void *data, 
     size_t data_length
 ) {
-    if (!connection) return;
+    if (!connection) return false;
 
-    cm_event_t *event = malloc(sizeof(cm_event_t));
-    if (!event) {
-        LOG(LOG_LEVEL_ERROR, "Failed to allocate event");
-        return;
+    size_t tail = atomic_load_explicit(&connection->event_tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&connection->event_head, memory_order_acquire);
+    if (tail - head > connection->event_ring_mask) {
+        connection->stats.events_dropped++;
+        return false;
     }
 
+    cm_event_t *event = &connection->event_ring[tail & connection->event_ring_mask];
     event->type = type;
-    event->data = data ? malloc(data_length) : NULL;
-    if (data && event->data) {
+    event->data = NULL;
+    if (data && data_length <= CM_EVENT_INLINE_DATA) {
+        event->data = event->inline_data;
+    } else if (data) {
+        event->data = malloc(data_length);
+        if (!event->data) {
+            LOG(LOG_LEVEL_ERROR, "Failed to allocate event data");
+            connection->stats.events_dropped++;
+            return false;
+        }
+    }
+    if (data) {
         memcpy(event->data, data, data_length);
     }
     event->data_length = data_length;
     event->callback = NULL;
-    event->next = connection->event_queue;
-    connection->event_queue = event;
-    connection->event_queue_depth++;
+    atomic_store_explicit(&connection->event_tail, tail + 1, memory_order_release);
+
+    // Queue the connection unless it is already waiting to be polled
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!atomic_load_explicit(&connection->event_armed, memory_order_relaxed) &&
+        !atomic_exchange(&connection->event_armed, true)) {
+        cq_push(connection->cq, connection);
+    }
+    return true;
+}
+
+// Hand a contiguous run of events to the connection's callbacks
+static void dispatch_events(cm_connection_t *connection, cm_event_t *events, size_t count) {
+    if (connection->batch_callback) {
+        connection->batch_callback(connection, events, count);
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            cm_event_t *event = &events[i];
+
+            // Log event details
+            LOG(LOG_LEVEL_DEBUG, "Processing event: %d", event->type);
+
+            if (event->callback) {
+                event->callback(connection, event);
+            } else if (event->type == CM_EVENT_ERROR) {
+                if (connection->error_callback) {
+                    connection->error_callback(connection, event);
+                }
+            } else if (connection->state_change_callback) {
+                connection->state_change_callback(connection, event);
+            }
+        }
+    }
+
+    // Free out-of-line event data
+    for (size_t i = 0; i < count; i++) {
+        if (events[i].data && events[i].data != events[i].inline_data) {
+            free(events[i].data);
+        }
+    }
 }
 
 // Process Connection Events
-void process_connection_events(cm_connection_t *connection) {
-    if (!connection) return;
+// Delivers everything pending in ring order, in batches of up to
+// CM_EVENT_BATCH_MAX contiguous slots. Must not race with the poller of
+// the connection's completion queue.
+size_t process_connection_events(cm_connection_t *connection) {
+    if (!connection) return 0;
+
+    size_t head = atomic_load_explicit(&connection->event_head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&connection->event_tail, memory_order_acquire);
+    size_t delivered = 0;
+
+    while (head != tail) {
+        size_t index = head & connection->event_ring_mask;
+        size_t count = tail - head;
+
+        // Stop at the ring's end so the batch stays contiguous
+        if (count > connection->event_ring_mask + 1 - index) {
+            count = connection->event_ring_mask + 1 - index;
+        }
+        if (count > CM_EVENT_BATCH_MAX) {
+            count = CM_EVENT_BATCH_MAX;
+        }
 
-    cm_event_t *event = connection->event_queue;
-    while (event) {
-        // Log event details
-        LOG(LOG_LEVEL_DEBUG, "Processing event: %d", event->type);
+        dispatch_events(connection, &connection->event_ring[index], count);
+        head += count;
+        delivered += count;
+        if (connection->cq) {
+            connection->cq->batches++;
+        }
 
-        // Call event callback if set
-        if (event->callback) {
-            event->callback(connection, event);
+        // Free the slots before looking for more
+        atomic_store_explicit(&connection->event_head, head, memory_order_release);
+        if (head == tail) {
+            tail = atomic_load_explicit(&connection->event_tail, memory_order_acquire);
         }
+    }
 
-        // Move to next event
-        cm_event_t *next = event->next;
-        
-        // Free event data
-        free(event->data);
-        free(event);
-        
-        event = next;
+    connection->stats.events_delivered += delivered;
+    return delivered;
+}
+
+// Poll a Completion Queue
+// Reaps up to budget ready connections and drains each one's ring.
+// Returns the number of events delivered.
+size_t poll_completion_queue(cm_completion_queue_t *cq, size_t budget) {
+    cm_connection_t *ready[CM_POLL_BUDGET];
+    size_t events = 0;
+
+    if (!cq) return 0;
+    if (budget == 0 || budget > CM_POLL_BUDGET) {
+        budget = CM_POLL_BUDGET;
+    }
+
+    size_t n = cq_pop_batch(cq, ready, budget);
+    cq->polls++;
+    if (n == 0) {
+        cq->empty_polls++;
+        return 0;
     }
 
-    // Reset event queue
-    connection->event_queue = NULL;
-    connection->event_queue_depth = 0;
+    for (size_t i = 0; i < n; i++) {
+        cm_connection_t *connection = ready[i];
+
+        // Disarm before draining: an event enqueued from here on re-queues
+        // the connection, so none can be stranded in the ring
+        atomic_store(&connection->event_armed, false);
+        atomic_thread_fence(memory_order_seq_cst);
+        events += process_connection_events(connection);
+    }
+
+    cq->completions += n;
+    cq->events += events;
+    return events;
+}
+
+// Poll-Mode Event Loop
+// Busy-polls the queue, yielding the CPU after CM_POLL_SPIN empty polls,
+// until *stop is set and the queue is drained.
+void run_event_loop(cm_completion_queue_t *cq, atomic_bool *stop) {
+    unsigned int idle = 0;
+
+    for (;;) {
+        if (poll_completion_queue(cq, CM_POLL_BUDGET)) {
+            idle = 0;
+            continue;
+        }
+        if (atomic_load_explicit(stop, memory_order_acquire)) {
+            // A last pass picks up anything queued before stop was set
+            while (poll_completion_queue(cq, CM_POLL_BUDGET)) {
+            }
+            break;
+        }
+        if (++idle >= CM_POLL_SPIN) {
+            idle = 0;
+            sched_yield();
+        }
+    }
 }
 
 // Print Connection Statistics
@@ -519,6 +829,8 @@ void print_connection_stats(cm_connection_t *connection) {
     printf("Bytes Received:     %lu\n", connection->stats.bytes_received);
     printf("Retransmissions:    %lu\n", connection->stats.retransmissions);
     printf("Timeouts:           %lu\n", connection->stats.timeouts);
+    printf("Events Delivered:   %lu\n", connection->stats.events_delivered);
+    printf("Events Dropped:     %lu\n", connection->stats.events_dropped);
 }
 
 // Destroy Connection
@@ -526,19 +838,21 @@ void destroy_connection(cm_connection_t *connection, cm_system_t *system) {
     if (!connection || !system) return;
 
     // Remove from system's connection list
-    cm_connection_t **current = &system->connections;
-    while (*current) {
-        if (*current == connection) {
-            *current = connection->next;
-            break;
-        }
-        current = &(*current)->next;
+    *connection->pprev = connection->next;
+    if (connection->next) {
+        connection->next->pprev = connection->pprev;
     }
 
-    // Process any remaining events
+    // Deliver remaining events. While the connection is still queued on its
+    // completion queue, poll that queue (from its poller's context) so no
+    // completion is left pointing at freed memory.
+    while (atomic_load(&connection->event_armed)) {
+        poll_completion_queue(connection->cq, CM_POLL_BUDGET);
+    }
     process_connection_events(connection);
 
     // Free connection
+    free(connection->event_ring);
     free(connection);
 
     // Update system statistics
@@ -554,9 +868,25 @@ void destroy_cm_system(cm_system_t *system) {
         destroy_connection(system->connections, system);
     }
 
+    for (size_t i = 0; i < system->num_cqs; i++) {
+        free(system->cqs[i].slots);
+    }
+    free(system->cqs);
     free(system);
 }
 
+// Demonstration Event Callback
+static void demo_event_callback(cm_connection_t *conn, cm_event_t *event) {
+    static const char *names[] = {
+        "CONNECT_REQUEST", "CONNECT_RESPONSE", "CONNECT_ESTABLISHED",
+        "DISCONNECT_REQUEST", "DISCONNECT_RESPONSE", "ERROR"
+    };
+
+    LOG(LOG_LEVEL_INFO, "Connection %lu event %s (%zu bytes), state %s",
+        conn->connection_id, names[event->type], event->data_length,
+        get_connection_state_string(conn->state));
+}
+
 // Demonstration Function
 void demonstrate_connection_management() {
     // Create Connection Management System
@@ -602,6 +932,8 @@ void demonstrate_connection_management() {
         &params
     );
 
+    client->state_change_callback = demo_event_callback;
+
     // Connect to Remote Endpoint
     connect_to_endpoint(client, &remote_endpoint);
 
@@ -609,17 +941,276 @@ void demonstrate_connection_management() {
     client->state = CM_STATE_REQ_RCVD;
     accept_connection(listener, client);
 
+    // Deliver both events from the shared completion queue
+    poll_completion_queue(client->cq, CM_POLL_BUDGET);
+
     // Print Connection Statistics
     print_connection_stats(client);
 
     // Disconnect
     disconnect_connection(client);
+    poll_completion_queue(client->cq, CM_POLL_BUDGET);
 
     // Cleanup
     destroy_cm_system(cm_system);
 }
 
-int main(void) {
+// Benchmark
+#define BENCH_QUEUE_DEPTH     16
+#define BENCH_EVENTS_PER_CONN 4
+#define BENCH_PRODUCERS       2
+#define BENCH_THREAD_SECONDS  1
+
+static unsigned long bench_events;
+static unsigned long bench_calls;
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline uint64_t bench_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+// Batch callback: account the events as a fabric handler would
+static void bench_batch_callback(cm_connection_t *conn, cm_event_t *events, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        conn->stats.packets_received++;
+        conn->stats.bytes_received += events[i].data_length;
+    }
+    bench_events += count;
+    bench_calls++;
+}
+
+static cm_system_t *bench_create(size_t n, size_t num_cqs, cm_connection_t ***conns) {
+    cm_connection_params_t params = {
+        .type = CM_CONN_TYPE_RELIABLE,
+        .qos_level = QOS_LOW_LATENCY,
+        .max_message_size = 4096,
+        .receive_queue_depth = BENCH_QUEUE_DEPTH,
+        .send_queue_depth = BENCH_QUEUE_DEPTH
+    };
+    cm_system_t *system = create_cm_system_with_cqs(n, num_cqs);
+
+    *conns = malloc(n * sizeof(cm_connection_t *));
+    for (size_t i = 0; i < n; i++) {
+        (*conns)[i] = create_connection(system, NULL, &params);
+        (*conns)[i]->batch_callback = bench_batch_callback;
+    }
+    return system;
+}
+
+// Sparse activity: 1% of connections get events each round. The sweep
+// visits every connection the way the single-connection loop did; the
+// completion queue visits only the ones with events.
+static void bench_sparse(size_t n) {
+    cm_connection_t **conns;
+    cm_system_t *system = bench_create(n, 1, &conns);
+    cm_completion_queue_t *cq = &system->cqs[0];
+    size_t active = n / 100 > 64 ? n / 100 : 64;
+    size_t rounds = 2000000 / (active * BENCH_EVENTS_PER_CONN);
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    cm_event_type_t type = CM_EVENT_CONNECT_RESPONSE;
+    double t0, elapsed;
+
+    if (rounds < 10) {
+        rounds = 10;
+    }
+
+    for (int mode = 0; mode < 2; mode++) {
+        bench_events = bench_calls = 0;
+        elapsed = 0;
+        for (size_t r = 0; r < rounds; r++) {
+            t0 = bench_now();
+            for (size_t a = 0; a < active; a++) {
+                cm_connection_t *conn = conns[bench_rand(&seed) % n];
+
+                for (int e = 0; e < BENCH_EVENTS_PER_CONN; e++) {
+                    enqueue_event(conn, type, NULL, 0);
+                }
+            }
+            if (mode == 0) {
+                for (size_t i = 0; i < n; i++) {
+                    process_connection_events(conns[i]);
+                }
+            } else {
+                while (poll_completion_queue(cq, CM_POLL_BUDGET)) {
+                }
+            }
+            elapsed += bench_now() - t0;
+
+            // The sweep leaves completions queued; reap them untimed
+            while (mode == 0 &&
+                   atomic_load(&cq->dequeue_pos) != atomic_load(&cq->enqueue_pos)) {
+                poll_completion_queue(cq, CM_POLL_BUDGET);
+            }
+        }
+        printf("  %6zu conns  %s  %8.1f ns/event  %6.2f M events/s  (%.1f events/callback)\n",
+               n, mode == 0 ? "sweep:" : "cq:   ", elapsed * 1e9 / bench_events,
+               bench_events / elapsed / 1e6, (double)bench_events / bench_calls);
+    }
+
+    destroy_cm_system(system);
+    free(conns);
+}
+
+// Connection churn through the public API: create, connect, accept,
+// disconnect and destroy every connection, polling as a fabric would
+static void bench_churn(size_t n) {
+    cm_endpoint_t remote = { .ip_address = "10.0.0.2", .port = 4791, .node_id = 2 };
+    cm_endpoint_t local = { .ip_address = "10.0.0.1", .port = 4791, .node_id = 1 };
+    cm_connection_params_t params = {
+        .type = CM_CONN_TYPE_RELIABLE,
+        .qos_level = QOS_LOW_LATENCY,
+        .max_message_size = 4096,
+        .receive_queue_depth = BENCH_QUEUE_DEPTH,
+        .send_queue_depth = BENCH_QUEUE_DEPTH
+    };
+    cm_system_t *system = create_cm_system(n + 1);
+    cm_connection_t **conns = malloc(n * sizeof(cm_connection_t *));
+    cm_connection_t *listener = create_connection(system, &local, &params);
+    double t0, dt;
+
+    listen_for_connections(listener);
+    bench_events = bench_calls = 0;
+    t0 = bench_now();
+    for (size_t i = 0; i < n; i++) {
+        conns[i] = create_connection(system, NULL, &params);
+        conns[i]->batch_callback = bench_batch_callback;
+        connect_to_endpoint(conns[i], &remote);
+        conns[i]->state = CM_STATE_REQ_RCVD;
+        accept_connection(listener, conns[i]);
+        if ((i & 255) == 255) {
+            poll_completion_queue(&system->cqs[0], CM_POLL_BUDGET);
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        disconnect_connection(conns[i]);
+        if ((i & 255) == 255) {
+            poll_completion_queue(&system->cqs[0], CM_POLL_BUDGET);
+        }
+    }
+    while (poll_completion_queue(&system->cqs[0], CM_POLL_BUDGET)) {
+    }
+    for (size_t i = 0; i < n; i++) {
+        destroy_connection(conns[i], system);
+    }
+    dt = bench_now() - t0;
+    printf("  %6zu conns  churn:  %8.1f ns/lifecycle  %6.2f M lifecycles/s  (%lu events, %.1f events/callback)\n",
+           n, dt * 1e9 / n, n / dt / 1e6, bench_events, (double)bench_events / bench_calls);
+
+    destroy_cm_system(system);
+    free(conns);
+}
+
+struct bench_producer {
+    cm_connection_t **conns;
+    size_t first, count;
+    atomic_bool *stop;
+    uint64_t seed;
+    unsigned long produced;
+    unsigned long full;
+};
+
+static void *bench_producer_thread(void *arg) {
+    struct bench_producer *p = arg;
+
+    while (!atomic_load_explicit(p->stop, memory_order_relaxed)) {
+        cm_connection_t *conn = p->conns[p->first + bench_rand(&p->seed) % p->count];
+
+        for (int e = 0; e < BENCH_EVENTS_PER_CONN; e++) {
+            if (enqueue_event(conn, CM_EVENT_CONNECT_RESPONSE, NULL, 0)) {
+                p->produced++;
+            } else {
+                p->full++;
+                sched_yield();
+            }
+        }
+    }
+    return NULL;
+}
+
+static void *bench_poller_thread(void *arg) {
+    void **args = arg;
+
+    run_event_loop(args[0], args[1]);
+    return NULL;
+}
+
+// Producers own disjoint connections; one poller drains the shared queue
+static void bench_threaded(size_t n) {
+    struct bench_producer producers[BENCH_PRODUCERS];
+    pthread_t threads[BENCH_PRODUCERS], poller;
+    atomic_bool stop_producers = false, stop_poller = false;
+    cm_connection_t **conns;
+    cm_system_t *system = bench_create(n, 1, &conns);
+    void *poller_args[2] = { &system->cqs[0], &stop_poller };
+    unsigned long produced = 0, full = 0, delivered = 0, dropped = 0;
+    double t0, dt;
+
+    bench_events = bench_calls = 0;
+    t0 = bench_now();
+    pthread_create(&poller, NULL, bench_poller_thread, poller_args);
+    for (int i = 0; i < BENCH_PRODUCERS; i++) {
+        producers[i] = (struct bench_producer){
+            .conns = conns, .first = i * (n / BENCH_PRODUCERS), .count = n / BENCH_PRODUCERS,
+            .stop = &stop_producers, .seed = 0x9e3779b97f4a7c15ULL + i
+        };
+        pthread_create(&threads[i], NULL, bench_producer_thread, &producers[i]);
+    }
+    sleep(BENCH_THREAD_SECONDS);
+    atomic_store(&stop_producers, true);
+    for (int i = 0; i < BENCH_PRODUCERS; i++) {
+        pthread_join(threads[i], NULL);
+        produced += producers[i].produced;
+        full += producers[i].full;
+    }
+    atomic_store(&stop_poller, true);
+    pthread_join(poller, NULL);
+    dt = bench_now() - t0;
+
+    for (size_t i = 0; i < n; i++) {
+        delivered += conns[i]->stats.events_delivered;
+        dropped += conns[i]->stats.events_dropped;
+    }
+    printf("  %6zu conns  %d producers + poller: %6.2f M events/s  (%lu produced, %lu delivered, %lu ring-full retries, %lu empty polls)\n",
+           n, BENCH_PRODUCERS, delivered / dt / 1e6, produced, delivered, full,
+           system->cqs[0].empty_polls);
+    if (produced != delivered || dropped != full) {
+        printf("  MISMATCH: produced %lu delivered %lu\n", produced, delivered);
+    }
+
+    destroy_cm_system(system);
+    free(conns);
+}
+
+static int run_benchmark(void) {
+    static const size_t sizes[] = { 1000, 10000, 100000 };
+
+    current_log_level = LOG_LEVEL_ERROR;
+    printf("CM event engine benchmark (ring depth %d, %d events per active connection)\n",
+           BENCH_QUEUE_DEPTH, BENCH_EVENTS_PER_CONN);
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        bench_sparse(sizes[i]);
+    }
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        bench_churn(sizes[i]);
+    }
+    bench_threaded(100000);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        return run_benchmark();
+
     // Set log level
     current_log_level = LOG_LEVEL_INFO;
 
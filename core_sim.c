@@ -9,6 +9,7 @@
 #include <unistd.h>
 #include <sys/time.h>
 #include <signal.h>
+#include <stdatomic.h>
 
 // Logging Macros
 #define LOG_LEVEL_DEBUG 0
@@ -28,14 +29,28 @@
 static int current_log_level = LOG_LEVEL_INFO;
 
 // Scheduler Constants
-#define MAX_CPUS           16
+#define MAX_CPUS           64
 #define MAX_TASKS          1024
 #define MAX_PRIORITY       100
 #define MIN_PRIORITY       0
 #define DEFAULT_TIMESLICE  100000  // 100ms
-#define LOAD_BALANCE_INTERVAL 1000000  // 1s
+#define LOAD_BALANCE_INTERVAL 1000000  // 1s, fallback behind stealing
+#define IDLE_POLL_US       1000    // 1ms
 #define TEST_DURATION      30     // seconds
 
+// Per-CPU Run Queue Ring (power of two)
+#define RUNQ_SIZE          256
+#define STEAL_BATCH        (RUNQ_SIZE / 2)
+
+// Uniform Machine Layout for Steal Distances
+#define THREADS_PER_CORE   2
+#define CORES_PER_LLC      4
+#define LLCS_PER_NODE      2
+
+#define NR_CPUS MAX_CPUS
+#include "sched_topology_sim.h"
+#include "des_sim.h"
+
 // Task States
 typedef enum {
     TASK_RUNNING,
@@ -69,25 +84,49 @@ typedef struct task {
     uint64_t timeslice;
     uint64_t deadline;
     int cpu;
+    uint64_t wakeup_time;
+    uint64_t start_time;
+    uint64_t completion_time;
+    bool woken;
     struct task *next;
 } task_t;
 
 // Run Queue Structure
+//
+// The ring has a single producer, the owning CPU, which publishes at
+// tail.  Every consumer, owner and thieves alike, claims entries by a
+// CAS on head, so a thief takes half the queue with one CAS and the
+// owner never needs a lock.  Queueing stays FIFO, which keeps round
+// robin (and therefore tail latency) intact where a LIFO work-stealing
+// deque would keep re-running the newest task.  Other CPUs hand work
+// over through wake_list, a lock-free stack the owner drains.
 typedef struct {
-    task_t *head;
-    size_t count;
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    _Atomic(task_t *) slots[RUNQ_SIZE];
+    _Atomic(task_t *) wake_list;
+    task_t *overflow_head;      // owner only: did not fit the ring
+    task_t *overflow_tail;
     uint64_t total_weight;
-    pthread_mutex_t lock;
 } run_queue_t;
 
 // CPU Structure
-typedef struct {
+typedef struct cpu {
     unsigned int id;
     cpu_state_t state;
     run_queue_t *queue;
     task_t *current;
+    _Atomic size_t nr_running;  // current plus everything queued
+    _Atomic bool need_resched;
+    uint64_t idle_start;
     uint64_t idle_time;
     uint64_t busy_time;
+    int steal_order[MAX_CPUS];  // other CPUs, nearest first
+    int steal_dist[MAX_CPUS];
+    uint64_t slice_start;       // virtual time mode
+    uint64_t slice_end;
+    uint64_t slice_gen;
+    struct sched_manager *manager;
     pthread_t thread;
     pthread_mutex_t lock;
 } cpu_t;
@@ -99,6 +138,10 @@ typedef struct {
     uint64_t migrations;
     uint64_t context_switches;
     uint64_t load_balances;
+    uint64_t steals;
+    uint64_t wakeups;
+    uint64_t total_wait;
+    uint64_t max_wait;
     double avg_latency;
     double cpu_utilization;
     double load_imbalance;
@@ -106,12 +149,14 @@ typedef struct {
 } sched_stats_t;
 
 // Scheduler Manager Structure
-typedef struct {
+typedef struct sched_manager {
     cpu_t cpus[MAX_CPUS];
     task_t *tasks[MAX_TASKS];
     size_t nr_cpus;
     size_t nr_tasks;
     bool running;
+    bool work_stealing;
+    struct cpu_topology topo;
     pthread_mutex_t manager_lock;
     pthread_t load_balancer;
     sched_stats_t stats;
@@ -135,9 +180,10 @@ void schedule_task(sched_manager_t *manager, task_t *task);
 void balance_load(sched_manager_t *manager);
 
 void run_test(sched_manager_t *manager);
+void run_test_virtual(sched_manager_t *manager, uint64_t seed, uint64_t duration_us);
 void calculate_stats(sched_manager_t *manager);
 void print_test_stats(sched_manager_t *manager);
-void demonstrate_scheduler(void);
+void demonstrate_scheduler(const struct des_options *opts);
 
 // Utility Functions
 const char* get_log_level_string(int level) {
@@ -184,14 +230,159 @@ run_queue_t* create_run_queue(void) {
     run_queue_t *queue = malloc(sizeof(run_queue_t));
     if (!queue) return NULL;
 
-    queue->head = NULL;
-    queue->count = 0;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    for (size_t i = 0; i < RUNQ_SIZE; i++)
+        atomic_init(&queue->slots[i], NULL);
+    atomic_init(&queue->wake_list, NULL);
+    queue->overflow_head = NULL;
+    queue->overflow_tail = NULL;
     queue->total_weight = 0;
-    pthread_mutex_init(&queue->lock, NULL);
 
     return queue;
 }
 
+static uint64_t core_clock_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Tasks in the ring; a snapshot, exact only for the owner
+static inline uint32_t runq_size(run_queue_t *q) {
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    return tail - head;
+}
+
+// Owner: append at tail, false when the ring is full
+static bool runq_put(run_queue_t *q, task_t *task) {
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+    if (tail - head >= RUNQ_SIZE)
+        return false;
+    atomic_store_explicit(&q->slots[tail % RUNQ_SIZE], task, memory_order_relaxed);
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+// Owner: append, spilling to the private overflow list
+static void runq_push(run_queue_t *q, task_t *task) {
+    if (runq_put(q, task))
+        return;
+    task->next = NULL;
+    if (q->overflow_tail)
+        q->overflow_tail->next = task;
+    else
+        q->overflow_head = task;
+    q->overflow_tail = task;
+}
+
+// Owner: take the oldest entry
+static task_t *runq_get(run_queue_t *q) {
+    for (;;) {
+        uint32_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+        uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        if (head == tail)
+            return NULL;
+        task_t *task = atomic_load_explicit(&q->slots[head % RUNQ_SIZE], memory_order_relaxed);
+        if (atomic_compare_exchange_weak_explicit(&q->head, &head, head + 1,
+                                                  memory_order_release, memory_order_relaxed))
+            return task;
+    }
+}
+
+// Any CPU: claim the older half (rounded up) of the ring, at most max
+static uint32_t runq_grab(run_queue_t *q, task_t **batch, uint32_t max) {
+    for (;;) {
+        uint32_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+        uint32_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+        uint32_t n = tail - head;
+
+        n -= n / 2;
+        if (n > max)
+            n = max;
+        if (!n)
+            return 0;
+        // Read head and tail across an update by the owner
+        if (n > RUNQ_SIZE / 2)
+            continue;
+        for (uint32_t i = 0; i < n; i++)
+            batch[i] = atomic_load_explicit(&q->slots[(head + i) % RUNQ_SIZE],
+                                            memory_order_relaxed);
+        if (atomic_compare_exchange_weak_explicit(&q->head, &head, head + n,
+                                                  memory_order_release, memory_order_relaxed))
+            return n;
+    }
+}
+
+// Any CPU: hand a task to the owner
+static void runq_wake_list_add(run_queue_t *q, task_t *task) {
+    task_t *first = atomic_load_explicit(&q->wake_list, memory_order_relaxed);
+    do {
+        task->next = first;
+    } while (!atomic_compare_exchange_weak_explicit(&q->wake_list, &first, task,
+                                                    memory_order_release,
+                                                    memory_order_relaxed));
+}
+
+// Detach the whole wake list, oldest first
+static task_t *runq_wake_list_take(run_queue_t *q) {
+    task_t *list = atomic_exchange_explicit(&q->wake_list, NULL, memory_order_acquire);
+    task_t *fifo = NULL;
+
+    while (list) {
+        task_t *next = list->next;
+        list->next = fifo;
+        fifo = list;
+        list = next;
+    }
+    return fifo;
+}
+
+// Owner: move overflow, then handed-over tasks, into the ring
+static void runq_refill(run_queue_t *q) {
+    while (q->overflow_head) {
+        // Once in the ring the task may be stolen: unlink it first
+        task_t *task = q->overflow_head;
+        task_t *next = task->next;
+        if (!runq_put(q, task))
+            return;
+        q->overflow_head = next;
+        if (!next)
+            q->overflow_tail = NULL;
+    }
+
+    task_t *task = runq_wake_list_take(q);
+    while (task) {
+        task_t *next = task->next;
+        runq_push(q, task);
+        task = next;
+    }
+}
+
+// Any CPU: claim the older half of a wake list the owner has not
+// drained yet; the rest goes back
+static uint32_t runq_wake_list_grab(run_queue_t *q, task_t **batch, uint32_t max) {
+    task_t *list = runq_wake_list_take(q);
+    uint32_t n = 0, total = 0;
+
+    for (task_t *task = list; task; task = task->next)
+        total++;
+    total -= total / 2;
+    while (list && n < total && n < max) {
+        batch[n++] = list;
+        list = list->next;
+    }
+    while (list) {
+        task_t *next = list->next;
+        runq_wake_list_add(q, list);
+        list = next;
+    }
+    return n;
+}
+
 // Create Task
 task_t* create_task(task_type_t type, int priority) {
     task_t *task = malloc(sizeof(task_t));
@@ -206,14 +397,47 @@ task_t* create_task(task_type_t type, int priority) {
     task->timeslice = DEFAULT_TIMESLICE;
     task->deadline = 0;
     task->cpu = -1;
+    task->wakeup_time = 0;
+    task->start_time = 0;
+    task->completion_time = 0;
+    task->woken = false;
     task->next = NULL;
 
     return task;
 }
 
+// How far work travels between two CPUs
+static int cpu_distance(const struct cpu_topology *topo, unsigned int a, unsigned int b) {
+    if (topo->cpu[a].core == topo->cpu[b].core) return 1;
+    if (topo->cpu[a].llc == topo->cpu[b].llc)   return 2;
+    if (topo->cpu[a].node == topo->cpu[b].node) return 3;
+    return 4;
+}
+
+// Victims nearest first; ties start after the thief so that
+// neighbours do not all raid the same CPU
+static void build_steal_order(sched_manager_t *manager, cpu_t *cpu) {
+    size_t n = 0;
+
+    for (int dist = 1; dist <= 4; dist++) {
+        for (size_t i = 1; i < manager->nr_cpus; i++) {
+            unsigned int other = (cpu->id + i) % manager->nr_cpus;
+            if (cpu_distance(&manager->topo, cpu->id, other) != dist)
+                continue;
+            cpu->steal_order[n] = (int)other;
+            cpu->steal_dist[n] = dist;
+            n++;
+        }
+    }
+    for (; n < MAX_CPUS; n++) {
+        cpu->steal_order[n] = -1;
+        cpu->steal_dist[n] = 0;
+    }
+}
+
 // Create Scheduler Manager
 sched_manager_t* create_sched_manager(size_t nr_cpus) {
-    if (nr_cpus > MAX_CPUS) {
+    if (nr_cpus == 0 || nr_cpus > MAX_CPUS) {
         LOG(LOG_LEVEL_ERROR, "Number of CPUs exceeds maximum");
         return NULL;
     }
@@ -224,10 +448,14 @@ sched_manager_t* create_sched_manager(size_t nr_cpus) {
         return NULL;
     }
 
+    manager->nr_cpus = nr_cpus;
+    cpu_topology_init_uniform(&manager->topo, (unsigned int)nr_cpus, THREADS_PER_CORE,
+                              CORES_PER_LLC, LLCS_PER_NODE);
+
     // Initialize CPUs
     for (size_t i = 0; i < nr_cpus; i++) {
         manager->cpus[i].id = i;
-        manager->cpus[i].state = CPU_ACTIVE;
+        manager->cpus[i].state = CPU_IDLE;
         manager->cpus[i].queue = create_run_queue();
         if (!manager->cpus[i].queue) {
             // Cleanup and return
@@ -239,14 +467,22 @@ sched_manager_t* create_sched_manager(size_t nr_cpus) {
             return NULL;
         }
         manager->cpus[i].current = NULL;
+        atomic_init(&manager->cpus[i].nr_running, 0);
+        atomic_init(&manager->cpus[i].need_resched, false);
+        manager->cpus[i].idle_start = 0;
         manager->cpus[i].idle_time = 0;
         manager->cpus[i].busy_time = 0;
+        manager->cpus[i].slice_start = 0;
+        manager->cpus[i].slice_end = UINT64_MAX;
+        manager->cpus[i].slice_gen = 0;
+        manager->cpus[i].manager = manager;
+        build_steal_order(manager, &manager->cpus[i]);
         pthread_mutex_init(&manager->cpus[i].lock, NULL);
     }
 
-    manager->nr_cpus = nr_cpus;
     manager->nr_tasks = 0;
     manager->running = false;
+    manager->work_stealing = true;
     pthread_mutex_init(&manager->manager_lock, NULL);
     memset(&manager->stats, 0, sizeof(sched_stats_t));
 
@@ -254,59 +490,142 @@ sched_manager_t* create_sched_manager(size_t nr_cpus) {
     return manager;
 }
 
-// CPU Thread
-void* cpu_thread(void *arg) {
-    cpu_t *cpu = (cpu_t*)arg;
-    sched_manager_t *manager = (sched_manager_t*)((void**)arg)[1];
-
-    while (manager->running) {
-        pthread_mutex_lock(&cpu->lock);
+// Move a claimed batch: the first task runs, the rest queue on dst
+static void migrate_batch(sched_manager_t *manager, cpu_t *src, cpu_t *dst,
+                          task_t **batch, uint32_t n) {
+    atomic_fetch_sub(&src->nr_running, n);
+    atomic_fetch_add(&dst->nr_running, n);
+    for (uint32_t i = 0; i < n; i++)
+        batch[i]->cpu = (int)dst->id;
+    manager->stats.migrations += n;
+}
 
-        if (cpu->current) {
-            // Process current task
-            task_t *task = cpu->current;
-            
-            // Simulate task execution
-            usleep(task->timeslice);
-            task->runtime += task->timeslice;
-            cpu->busy_time += task->timeslice;
-
-            // Check if task is complete
-            if (task->runtime >= task->deadline) {
-                task->state = TASK_DEAD;
-                cpu->current = NULL;
-                manager->stats.completed_tasks++;
-            } else {
-                // Put task back in queue
-                task->state = TASK_READY;
-                pthread_mutex_lock(&cpu->queue->lock);
-                task->next = cpu->queue->head;
-                cpu->queue->head = task;
-                cpu->queue->count++;
-                pthread_mutex_unlock(&cpu->queue->lock);
-                cpu->current = NULL;
+// Idle Steal: walk victims nearest first and take half the queue of the
+// busiest CPU at the closest distance that has anything waiting
+static task_t *steal_work(sched_manager_t *manager, cpu_t *cpu) {
+    task_t *batch[STEAL_BATCH];
+
+    for (size_t i = 0; i < MAX_CPUS && cpu->steal_order[i] >= 0; ) {
+        int dist = cpu->steal_dist[i];
+        cpu_t *victim = NULL;
+        size_t max_running = 1;
+
+        for (; i < MAX_CPUS && cpu->steal_order[i] >= 0 && cpu->steal_dist[i] == dist; i++) {
+            cpu_t *other = &manager->cpus[cpu->steal_order[i]];
+            size_t nr = atomic_load_explicit(&other->nr_running, memory_order_relaxed);
+            if (nr > max_running) {
+                max_running = nr;
+                victim = other;
             }
+        }
+        if (!victim)
+            continue;
+
+        uint32_t n = runq_grab(victim->queue, batch, STEAL_BATCH);
+        if (!n)
+            n = runq_wake_list_grab(victim->queue, batch, STEAL_BATCH);
+        if (!n)
+            continue;
+
+        migrate_batch(manager, victim, cpu, batch, n);
+        for (uint32_t j = 1; j < n; j++)
+            runq_push(cpu->queue, batch[j]);
+        manager->stats.steals++;
+
+        LOG(LOG_LEVEL_DEBUG, "CPU %u stole %u tasks from CPU %u (distance %d)",
+            cpu->id, n, victim->id, dist);
+        return batch[0];
+    }
+    return NULL;
+}
 
+// Run Slice: charge delta us to the current task, then decide what
+// runs next.  Returns the next slice in us, 0 when the CPU goes idle.
+// Only the owning CPU calls this.
+static uint64_t cpu_tick(sched_manager_t *manager, cpu_t *cpu, uint64_t delta, uint64_t now) {
+    run_queue_t *q = cpu->queue;
+    task_t *task = cpu->current;
+
+    atomic_store_explicit(&cpu->need_resched, false, memory_order_relaxed);
+    runq_refill(q);
+
+    if (task) {
+        task->runtime += delta;
+        cpu->busy_time += delta;
+
+        // Check if task is complete
+        if (task->runtime >= task->deadline) {
+            task->state = TASK_DEAD;
+            task->completion_time = now;
+            cpu->current = NULL;
+            atomic_fetch_sub(&cpu->nr_running, 1);
+            manager->stats.completed_tasks++;
+            manager->stats.context_switches++;
+        } else if (runq_size(q) || q->overflow_head) {
+            // Slice used up with others waiting: round robin
+            task->state = TASK_READY;
+            runq_push(q, task);
+            cpu->current = NULL;
             manager->stats.context_switches++;
         }
+    }
 
+    if (!cpu->current) {
         // Get next task
-        pthread_mutex_lock(&cpu->queue->lock);
-        if (cpu->queue->head) {
-            cpu->current = cpu->queue->head;
-            cpu->queue->head = cpu->queue->head->next;
-            cpu->queue->count--;
-            cpu->current->state = TASK_RUNNING;
-            cpu->current->next = NULL;
+        task = runq_get(q);
+        if (!task && manager->work_stealing)
+            task = steal_work(manager, cpu);
+
+        if (task) {
+            task->state = TASK_RUNNING;
+            task->next = NULL;
+            cpu->current = task;
+            if (task->woken) {
+                uint64_t wait = now - task->wakeup_time;
+                task->woken = false;
+                task->start_time = now;
+                manager->stats.wakeups++;
+                manager->stats.total_wait += wait;
+                if (wait > manager->stats.max_wait)
+                    manager->stats.max_wait = wait;
+            }
+            if (cpu->state == CPU_IDLE)
+                cpu->idle_time += now - cpu->idle_start;
             cpu->state = CPU_ACTIVE;
-        } else {
+        } else if (cpu->state != CPU_IDLE) {
             cpu->state = CPU_IDLE;
-            cpu->idle_time += DEFAULT_TIMESLICE;
-            usleep(DEFAULT_TIMESLICE);
+            cpu->idle_start = now;
         }
-        pthread_mutex_unlock(&cpu->queue->lock);
+    }
+
+    if (!cpu->current)
+        return 0;
+    uint64_t left = cpu->current->deadline - cpu->current->runtime;
+    return left < cpu->current->timeslice ? left : cpu->current->timeslice;
+}
+
+// CPU Thread
+void* cpu_thread(void *arg) {
+    cpu_t *cpu = (cpu_t*)arg;
+    sched_manager_t *manager = cpu->manager;
+    uint64_t slice = 0;
+
+    pthread_mutex_lock(&cpu->lock);
+    cpu->idle_start = core_clock_us();
+    pthread_mutex_unlock(&cpu->lock);
+
+    while (manager->running) {
+        pthread_mutex_lock(&cpu->lock);
+
+        // Simulate task execution
+        if (slice)
+            usleep(slice);
+        slice = cpu_tick(manager, cpu, slice, core_clock_us());
 
         pthread_mutex_unlock(&cpu->lock);
+
+        if (!slice)
+            usleep(IDLE_POLL_US);  // Idle
     }
 
     return NULL;
@@ -324,47 +643,51 @@ void* load_balancer_thread(void *arg) {
     return NULL;
 }
 
-// Schedule Task
-void schedule_task(sched_manager_t *manager, task_t *task) {
-    if (!manager || !task) return;
-
+// Queue a woken task on the CPU with the fewest runnable tasks
+static void __schedule_task(sched_manager_t *manager, task_t *task, uint64_t now) {
     // Find least loaded CPU
     size_t target_cpu = 0;
-    size_t min_tasks = UINT64_MAX;
+    size_t min_tasks = SIZE_MAX;
 
     for (size_t i = 0; i < manager->nr_cpus; i++) {
-        pthread_mutex_lock(&manager->cpus[i].queue->lock);
-        if (manager->cpus[i].queue->count < min_tasks) {
-            min_tasks = manager->cpus[i].queue->count;
+        size_t nr = atomic_load_explicit(&manager->cpus[i].nr_running, memory_order_relaxed);
+        if (nr < min_tasks) {
+            min_tasks = nr;
             target_cpu = i;
         }
-        pthread_mutex_unlock(&manager->cpus[i].queue->lock);
     }
 
     // Assign task to CPU
     cpu_t *cpu = &manager->cpus[target_cpu];
-    pthread_mutex_lock(&cpu->queue->lock);
     task->cpu = target_cpu;
-    task->next = cpu->queue->head;
-    cpu->queue->head = task;
-    cpu->queue->count++;
-    pthread_mutex_unlock(&cpu->queue->lock);
+    task->state = TASK_READY;
+    task->wakeup_time = now;
+    task->woken = true;
+    atomic_fetch_add(&cpu->nr_running, 1);
+    runq_wake_list_add(cpu->queue, task);
+    atomic_store_explicit(&cpu->need_resched, true, memory_order_relaxed);
 
     LOG(LOG_LEVEL_DEBUG, "Scheduled task %u (type: %s) to CPU %zu",
         task->id, get_task_type_string(task->type), target_cpu);
 }
 
-// Balance Load
+// Schedule Task
+void schedule_task(sched_manager_t *manager, task_t *task) {
+    if (!manager || !task) return;
+
+    __schedule_task(manager, task, core_clock_us());
+}
+
+// Balance Load: periodic fallback for imbalance idle stealing missed
 void balance_load(sched_manager_t *manager) {
     if (!manager) return;
 
     // Find most and least loaded CPUs
     size_t max_cpu = 0, min_cpu = 0;
-    size_t max_tasks = 0, min_tasks = UINT64_MAX;
+    size_t max_tasks = 0, min_tasks = SIZE_MAX;
 
     for (size_t i = 0; i < manager->nr_cpus; i++) {
-        pthread_mutex_lock(&manager->cpus[i].queue->lock);
-        size_t count = manager->cpus[i].queue->count;
+        size_t count = atomic_load_explicit(&manager->cpus[i].nr_running, memory_order_relaxed);
         if (count > max_tasks) {
             max_tasks = count;
             max_cpu = i;
@@ -373,34 +696,22 @@ void balance_load(sched_manager_t *manager) {
             min_tasks = count;
             min_cpu = i;
         }
-        pthread_mutex_unlock(&manager->cpus[i].queue->lock);
     }
 
     // Balance if necessary
     if (max_tasks - min_tasks > 1) {
         cpu_t *src_cpu = &manager->cpus[max_cpu];
         cpu_t *dst_cpu = &manager->cpus[min_cpu];
-
-        pthread_mutex_lock(&src_cpu->queue->lock);
-        pthread_mutex_lock(&dst_cpu->queue->lock);
+        task_t *task;
 
         // Move task from most loaded to least loaded CPU
-        if (src_cpu->queue->head) {
-            task_t *task = src_cpu->queue->head;
-            src_cpu->queue->head = task->next;
-            src_cpu->queue->count--;
-
-            task->next = dst_cpu->queue->head;
-            dst_cpu->queue->head = task;
-            dst_cpu->queue->count++;
-            task->cpu = min_cpu;
-
-            manager->stats.migrations++;
+        if (runq_grab(src_cpu->queue, &task, 1) ||
+            runq_wake_list_grab(src_cpu->queue, &task, 1)) {
+            migrate_batch(manager, src_cpu, dst_cpu, &task, 1);
+            runq_wake_list_add(dst_cpu->queue, task);
+            atomic_store_explicit(&dst_cpu->need_resched, true, memory_order_relaxed);
         }
 
-        pthread_mutex_unlock(&dst_cpu->queue->lock);
-        pthread_mutex_unlock(&src_cpu->queue->lock);
-
         manager->stats.load_balances++;
     }
 }
@@ -424,12 +735,9 @@ void run_test(sched_manager_t *manager) {
 
     // Start CPU threads
     manager->running = true;
-    void *thread_args[2];
-    thread_args[1] = manager;
 
     for (size_t i = 0; i < manager->nr_cpus; i++) {
-        thread_args[0] = &manager->cpus[i];
-        pthread_create(&manager->cpus[i].thread, NULL, cpu_thread, thread_args);
+        pthread_create(&manager->cpus[i].thread, NULL, cpu_thread, &manager->cpus[i]);
     }
 
     // Start load balancer
@@ -464,46 +772,156 @@ void run_test(sched_manager_t *manager) {
     pthread_join(manager->load_balancer, NULL);
 
     // Calculate statistics
+    manager->stats.test_duration = TEST_DURATION;
     calculate_stats(manager);
 }
 
-// Calculate Statistics
-void calculate_stats(sched_manager_t *manager) {
-    if (!manager) return;
+// Virtual time: run a CPU again at time, superseding its pending slice end
+static void virtual_arm_cpu(struct des_sim *sim, cpu_t *cpu, uint64_t time);
 
-    uint64_t total_runtime = 0;
-    uint64_t total_latency = 0;
-    uint64_t total_busy_time = 0;
+static void virtual_cpu_event(struct des_sim *sim, void *arg, uint64_t gen) {
+    cpu_t *cpu = (cpu_t*)arg;
+
+    if (gen != cpu->slice_gen)
+        return;
+
+    uint64_t delta = cpu->current ? sim->now - cpu->slice_start : 0;
+    uint64_t slice = cpu_tick(cpu->manager, cpu, delta, sim->now);
+    cpu->slice_start = sim->now;
+    cpu->slice_end = UINT64_MAX;
+    if (slice)
+        virtual_arm_cpu(sim, cpu, sim->now + slice);
+}
+
+static void virtual_arm_cpu(struct des_sim *sim, cpu_t *cpu, uint64_t time) {
+    cpu->slice_end = time;
+    if (!des_schedule_at(sim, time, virtual_cpu_event, cpu, ++cpu->slice_gen))
+        LOG(LOG_LEVEL_ERROR, "Failed to schedule CPU %u", cpu->id);
+}
+
+// Idle CPUs handed work run now; busy ones take it at their next tick,
+// as a woken CPU thread would
+static void virtual_kick_idle(struct des_sim *sim, sched_manager_t *manager) {
+    for (size_t i = 0; i < manager->nr_cpus; i++) {
+        cpu_t *cpu = &manager->cpus[i];
+        if (!cpu->current && cpu->slice_end == UINT64_MAX &&
+            atomic_load_explicit(&cpu->need_resched, memory_order_relaxed))
+            virtual_arm_cpu(sim, cpu, sim->now);
+    }
+}
+
+static void virtual_balance_event(struct des_sim *sim, void *arg, uint64_t data) {
+    sched_manager_t *manager = (sched_manager_t*)arg;
+
+    balance_load(manager);
+    virtual_kick_idle(sim, manager);
+    des_schedule(sim, LOAD_BALANCE_INTERVAL, virtual_balance_event, manager, data);
+}
+
+// Slot for a new task; long runs recycle those of finished tasks
+static task_t **virtual_task_slot(sched_manager_t *manager) {
+    if (manager->nr_tasks < MAX_TASKS)
+        return &manager->tasks[manager->nr_tasks++];
 
     for (size_t i = 0; i < manager->nr_tasks; i++) {
-        if (manager->tasks[i]) {
-            total_runtime += manager->tasks[i]->runtime;
-            total_latency += manager->tasks[i]->runtime - manager->tasks[i]->deadline;
+        if (manager->tasks[i]->state == TASK_DEAD) {
+            destroy_task(manager->tasks[i]);
+            return &manager->tasks[i];
         }
     }
+    return NULL;
+}
+
+static void virtual_add_task(struct des_sim *sim, sched_manager_t *manager, task_type_t type) {
+    task_t *task = create_task(type, (int)des_rand_range(sim, MAX_PRIORITY));
+    if (!task)
+        return;
+
+    task_t **slot = virtual_task_slot(manager);
+    if (!slot) {
+        destroy_task(task);
+        return;
+    }
+    task->deadline = (des_rand_range(sim, 10) + 1) * DEFAULT_TIMESLICE;
+    __schedule_task(manager, task, sim->now);
+    *slot = task;
+    manager->stats.total_tasks++;
+}
+
+// Same arrival process as run_test: a 10% chance every 100ms
+static void virtual_arrival_event(struct des_sim *sim, void *arg, uint64_t data) {
+    sched_manager_t *manager = (sched_manager_t*)arg;
+
+    if (des_rand_range(sim, 100) < 10) {
+        virtual_add_task(sim, manager, des_rand_range(sim, 10) == 0 ? TASK_RT : TASK_NORMAL);
+        virtual_kick_idle(sim, manager);
+    }
+    des_schedule(sim, 100000, virtual_arrival_event, manager, data);
+}
+
+// Run Test in virtual time: the workload of run_test, driven by the
+// event engine and a seeded RNG, so runs are fast and reproducible
+void run_test_virtual(sched_manager_t *manager, uint64_t seed, uint64_t duration_us) {
+    if (!manager) return;
+
+    struct des_sim sim;
+    if (!des_init(&sim, seed)) {
+        LOG(LOG_LEVEL_ERROR, "Failed to initialize simulation");
+        return;
+    }
+
+    LOG(LOG_LEVEL_INFO, "Starting scheduler test (virtual time, seed %lu, %.0f s)...",
+        seed, duration_us / 1e6);
+
+    // Create initial tasks
+    for (size_t i = 0; i < MAX_TASKS/2; i++) {
+        virtual_add_task(&sim, manager, TASK_NORMAL);
+    }
+
+    des_schedule(&sim, 100000, virtual_arrival_event, manager, 0);
+    des_schedule(&sim, LOAD_BALANCE_INTERVAL, virtual_balance_event, manager, 0);
+    virtual_kick_idle(&sim, manager);
+
+    double start = (double)core_clock_us();
+    des_run_until(&sim, duration_us);
+    double elapsed = (core_clock_us() - start) / 1e6;
+
+    LOG(LOG_LEVEL_INFO, "Simulated %.0f s in %.3f s (%lu events)",
+        duration_us / 1e6, elapsed, sim.nr_fired);
+    des_destroy(&sim);
+
+    // Calculate statistics
+    manager->stats.test_duration = duration_us / 1e6;
+    calculate_stats(manager);
+}
+
+// Calculate Statistics
+void calculate_stats(sched_manager_t *manager) {
+    if (!manager) return;
+
+    uint64_t total_busy_time = 0;
 
     for (size_t i = 0; i < manager->nr_cpus; i++) {
         total_busy_time += manager->cpus[i].busy_time;
     }
 
-    if (manager->stats.completed_tasks > 0) {
-        manager->stats.avg_latency = 
-            (double)total_latency / manager->stats.completed_tasks;
+    // Latency: wakeup until first run
+    if (manager->stats.wakeups > 0) {
+        manager->stats.avg_latency =
+            (double)manager->stats.total_wait / manager->stats.wakeups;
     }
 
     manager->stats.cpu_utilization = 
-        (double)total_busy_time / (TEST_DURATION * 1000000 * manager->nr_cpus);
+        (double)total_busy_time / (manager->stats.test_duration * 1000000 * manager->nr_cpus);
 
     // Calculate load imbalance
-    size_t max_queue = 0, min_queue = UINT64_MAX;
+    size_t max_queue = 0, min_queue = SIZE_MAX;
     for (size_t i = 0; i < manager->nr_cpus; i++) {
-        size_t count = manager->cpus[i].queue->count;
+        size_t count = atomic_load(&manager->cpus[i].nr_running);
         if (count > max_queue) max_queue = count;
         if (count < min_queue) min_queue = count;
     }
     manager->stats.load_imbalance = max_queue - min_queue;
-
-    manager->stats.test_duration = TEST_DURATION;
 }
 
 // Print Test Statistics
@@ -518,7 +936,9 @@ void print_test_stats(sched_manager_t *manager) {
     printf("Context Switches:   %lu\n", manager->stats.context_switches);
     printf("Task Migrations:    %lu\n", manager->stats.migrations);
     printf("Load Balances:      %lu\n", manager->stats.load_balances);
+    printf("Idle Steals:        %lu\n", manager->stats.steals);
     printf("Avg Task Latency:   %.2f us\n", manager->stats.avg_latency);
+    printf("Max Task Latency:   %lu us\n", manager->stats.max_wait);
     printf("CPU Utilization:    %.2f%%\n", manager->stats.cpu_utilization * 100);
     printf("Load Imbalance:     %.2f\n", manager->stats.load_imbalance);
 
@@ -528,7 +948,7 @@ void print_test_stats(sched_manager_t *manager) {
         cpu_t *cpu = &manager->cpus[i];
         printf("  CPU %zu:\n", i);
         printf("    State:     %s\n", get_cpu_state_string(cpu->state));
-        printf("    Queue Size: %zu\n", cpu->queue->count);
+        printf("    Queue Size: %zu\n", atomic_load(&cpu->nr_running));
         printf("    Busy Time:  %lu us\n", cpu->busy_time);
         printf("    Idle Time:  %lu us\n", cpu->idle_time);
     }
@@ -539,18 +959,8 @@ void destroy_task(task_t *task) {
     free(task);
 }
 
-// Destroy Run Queue
+// Destroy Run Queue: tasks are owned by the manager
 void destroy_run_queue(run_queue_t *queue) {
-    if (!queue) return;
-
-    task_t *current = queue->head;
-    while (current) {
-        task_t *next = current->next;
-        destroy_task(current);
-        current = next;
-    }
-
-    pthread_mutex_destroy(&queue->lock);
     free(queue);
 }
 
@@ -575,19 +985,185 @@ void destroy_sched_manager(sched_manager_t *manager) {
 }
 
 // Demonstrate Scheduler
-void demonstrate_scheduler(void) {
+void demonstrate_scheduler(const struct des_options *opts) {
     printf("Starting scheduler demonstration...\n");
 
     // Create and run scheduler test
     sched_manager_t *manager = create_sched_manager(8);
     if (manager) {
-        run_test(manager);
+        if (opts->threaded)
+            run_test(manager);
+        else
+            run_test_virtual(manager, opts->seed, opts->duration_us);
         print_test_stats(manager);
         destroy_sched_manager(manager);
     }
 }
 
-int main(void) {
+#define BENCH_ARRIVALS     100000
+#define BENCH_LOAD_PCT     70
+#define BENCH_BURST_PER_CPU 2       // tasks per CPU arriving together
+#define BENCH_LONG_PCT     10       // share of long tasks
+#define BENCH_SHORT_MIN    1000     // us
+#define BENCH_SHORT_MAX    10000
+#define BENCH_LONG_MIN     50000
+#define BENCH_LONG_MAX     200000
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline uint64_t bench_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static int bench_cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void bench_print_latency(const char *label, uint64_t *lat, size_t n) {
+    if (!n) return;
+    qsort(lat, n, sizeof(*lat), bench_cmp_u64);
+    printf("  %s p50 %6lu p99 %7lu max %7lu us", label, lat[n / 2], lat[n * 99 / 100],
+           lat[n - 1]);
+}
+
+// Virtual time: bursts of 2 tasks per CPU, 90% short and 10% long, so
+// short tasks regularly queue behind a long one while other CPUs idle
+static void bench_run(size_t nr_cpus, bool work_stealing) {
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    uint64_t slice_start[MAX_CPUS], slice_end[MAX_CPUS];
+    uint64_t mean_runtime = ((100 - BENCH_LONG_PCT) * (BENCH_SHORT_MIN + BENCH_SHORT_MAX) +
+                             BENCH_LONG_PCT * (BENCH_LONG_MIN + BENCH_LONG_MAX)) / 200;
+    size_t burst = BENCH_BURST_PER_CPU * nr_cpus;
+    uint64_t mean_gap = burst * mean_runtime * 100 / (BENCH_LOAD_PCT * nr_cpus);
+    uint64_t now = 0, next_arrival = 0, next_balance = LOAD_BALANCE_INTERVAL;
+    size_t arrived = 0, events = 0;
+
+    sched_manager_t *manager = create_sched_manager(nr_cpus);
+    task_t **tasks = calloc(BENCH_ARRIVALS, sizeof(*tasks));
+    uint64_t *wait = calloc(BENCH_ARRIVALS, sizeof(*wait));
+    uint64_t *response = calloc(BENCH_ARRIVALS, sizeof(*response));
+    if (!manager || !tasks || !wait || !response) {
+        free(tasks);
+        free(wait);
+        free(response);
+        destroy_sched_manager(manager);
+        return;
+    }
+    manager->work_stealing = work_stealing;
+    for (size_t i = 0; i < nr_cpus; i++)
+        slice_end[i] = UINT64_MAX;
+
+    double start = bench_now();
+    for (;;) {
+        // Next event: a burst, a balancer run or the end of a slice
+        uint64_t t = arrived < BENCH_ARRIVALS ? next_arrival : UINT64_MAX;
+        for (size_t i = 0; i < nr_cpus; i++)
+            t = slice_end[i] < t ? slice_end[i] : t;
+        if (t == UINT64_MAX)
+            break;
+        now = t < next_balance ? t : next_balance;
+
+        if (now == next_balance) {
+            balance_load(manager);
+            next_balance += LOAD_BALANCE_INTERVAL;
+        }
+
+        if (arrived < BENCH_ARRIVALS && next_arrival == now) {
+            for (size_t i = 0; i < burst && arrived < BENCH_ARRIVALS; i++) {
+                task_t *task = create_task(TASK_NORMAL, (int)(bench_rand(&seed) % MAX_PRIORITY));
+                if (!task)
+                    break;
+                if (bench_rand(&seed) % 100 < BENCH_LONG_PCT)
+                    task->deadline = BENCH_LONG_MIN +
+                        bench_rand(&seed) % (BENCH_LONG_MAX - BENCH_LONG_MIN);
+                else
+                    task->deadline = BENCH_SHORT_MIN +
+                        bench_rand(&seed) % (BENCH_SHORT_MAX - BENCH_SHORT_MIN);
+                tasks[arrived++] = task;
+                __schedule_task(manager, task, now);
+            }
+            next_arrival = now + 1 + bench_rand(&seed) % (2 * mean_gap);
+        }
+
+        // Run every CPU whose slice ended or that was handed work
+        bool again = true;
+        while (again) {
+            again = false;
+            for (size_t i = 0; i < nr_cpus; i++) {
+                cpu_t *cpu = &manager->cpus[i];
+                if (slice_end[i] != now && !atomic_load(&cpu->need_resched))
+                    continue;
+                // A busy CPU picks up handed-over work at its next tick
+                if (slice_end[i] != now && cpu->current)
+                    continue;
+                uint64_t delta = cpu->current ? now - slice_start[i] : 0;
+                uint64_t slice = cpu_tick(manager, cpu, delta, now);
+                slice_start[i] = now;
+                slice_end[i] = slice ? now + slice : UINT64_MAX;
+                again = true;
+                events++;
+            }
+        }
+    }
+    double elapsed = bench_now() - start;
+
+    size_t n = 0;
+    for (size_t i = 0; i < arrived; i++) {
+        if (tasks[i]->state == TASK_DEAD) {
+            wait[n] = tasks[i]->start_time - tasks[i]->wakeup_time;
+            response[n] = tasks[i]->completion_time - tasks[i]->wakeup_time - tasks[i]->deadline;
+            n++;
+        }
+        destroy_task(tasks[i]);
+    }
+
+    printf("  %2zu CPUs %-9s", nr_cpus, work_stealing ? "stealing" : "balancer");
+    bench_print_latency("wait", wait, n);
+    bench_print_latency("delay", response, n);
+    printf("  steals %6lu migr %6lu  %4.0f ns/event", manager->stats.steals,
+           manager->stats.migrations, elapsed * 1e9 / (events ? events : 1));
+    if (n != arrived)
+        printf("  LOST %zu", arrived - n);
+    printf("\n");
+
+    free(tasks);
+    free(wait);
+    free(response);
+    destroy_sched_manager(manager);
+}
+
+static int run_benchmark(void) {
+    static const size_t cpus[] = { 8, 16, 32, 64 };
+
+    current_log_level = LOG_LEVEL_ERROR;
+    printf("Bursty arrivals (%d tasks, %d%% load, bursts of %d per CPU, %d%% long tasks,\n"
+           "wait = wakeup to first run, delay = completion time beyond own runtime)\n",
+           BENCH_ARRIVALS, BENCH_LOAD_PCT, BENCH_BURST_PER_CPU, BENCH_LONG_PCT);
+    for (size_t i = 0; i < sizeof(cpus) / sizeof(cpus[0]); i++) {
+        bench_run(cpus[i], false);
+        bench_run(cpus[i], true);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        return run_benchmark();
+
+    struct des_options opts;
+    if (!des_parse_options(argc, argv, &opts, TEST_DURATION * 1000000ULL))
+        return 1;
+
     // Set log level
     current_log_level = LOG_LEVEL_INFO;
 
@@ -595,7 +1171,7 @@ int main(void) {
     srand(time(NULL));
 
     // Run demonstration
-    demonstrate_scheduler();
+    demonstrate_scheduler(&opts);
 
     return 0;
 }
@@ -9,6 +9,8 @@
 #include <unistd.h>
 #include <math.h>
 
+#include "pelt_sim.h"
+
 // Logging Macros
 #define LOG_LEVEL_DEBUG 0
 #define LOG_LEVEL_INFO  1
@@ -34,6 +36,12 @@ static int current_log_level = LOG_LEVEL_INFO;
 #define DEFAULT_RATE_LIMIT     5    // 5ms
 #define MAX_LOAD            100     // 100%
 #define UTIL_THRESHOLD       80     // 80%
+#define NICE_0_LOAD        1024
+
+// Simulated length of each demo scenario.  util_avg follows demand with
+// a 32ms half-life, but each frequency step it earns also shortens the
+// busy time it sees, so util and frequency need ~1-2s to settle together.
+#define SCENARIO_MS        2000
 
 // Power States
 typedef enum {
@@ -67,10 +75,14 @@ typedef struct {
     unsigned int target_freq;
     unsigned int max_freq;
     unsigned int min_freq;
-    unsigned int util;
+    unsigned int util;           // util_avg as a percentage, for reporting
     cpu_state_t state;
     freq_stats_t stats;
-    uint64_t last_update;
+    uint64_t last_update;        // ns, last frequency evaluation
+    // Runqueue state reported by the scheduler and its PELT signal
+    unsigned int nr_running;
+    unsigned long load_weight;
+    struct sched_avg avg;
     pthread_mutex_t lock;
 } cpu_t;
 
@@ -89,6 +101,7 @@ typedef struct {
     cpu_t cpus[MAX_CPUS];
     policy_t policy;
     unsigned int nr_cpus;
+    uint64_t clock;              // ns, simulated scheduler clock
     pthread_t monitor_thread;
     bool running;
     pthread_mutex_t manager_lock;
@@ -103,7 +116,10 @@ schedutil_t* create_schedutil(unsigned int nr_cpus);
 void destroy_schedutil(schedutil_t *util);
 
 void set_power_state(schedutil_t *util, power_state_t state);
-void update_cpu_util(schedutil_t *util, unsigned int cpu_id, unsigned int util);
+uint64_t schedutil_clock(schedutil_t *util);
+void advance_clock(schedutil_t *util, uint64_t delta_ns);
+void update_cpu_util(schedutil_t *util, unsigned int cpu_id, uint64_t now,
+                     unsigned int nr_running, unsigned long load_weight);
 void update_cpu_freq(schedutil_t *util, unsigned int cpu_id);
 void* monitor_thread(void *arg);
 
@@ -170,6 +186,9 @@ schedutil_t* create_schedutil(unsigned int nr_cpus) {
         cpu->state = CPU_ACTIVE;
         memset(&cpu->stats, 0, sizeof(freq_stats_t));
         cpu->last_update = 0;
+        cpu->nr_running = 0;
+        cpu->load_weight = 0;
+        memset(&cpu->avg, 0, sizeof(cpu->avg));
         pthread_mutex_init(&cpu->lock, NULL);
     }
 
@@ -182,6 +201,7 @@ schedutil_t* create_schedutil(unsigned int nr_cpus) {
     util->policy.util_threshold = UTIL_THRESHOLD;
 
     util->nr_cpus = nr_cpus;
+    util->clock = 0;
     pthread_mutex_init(&util->manager_lock, NULL);
     util->running = true;
 
@@ -234,46 +254,83 @@ void set_power_state(schedutil_t *util, power_state_t state) {
         get_power_state_string(state));
 }
 
+// Scheduler Clock
+uint64_t schedutil_clock(schedutil_t *util) {
+    pthread_mutex_lock(&util->manager_lock);
+    uint64_t now = util->clock;
+    pthread_mutex_unlock(&util->manager_lock);
+    return now;
+}
+
+void advance_clock(schedutil_t *util, uint64_t delta_ns) {
+    pthread_mutex_lock(&util->manager_lock);
+    util->clock += delta_ns;
+    pthread_mutex_unlock(&util->manager_lock);
+}
+
+// Capacity the CPU currently runs at, in SCHED_CAPACITY_SCALE units
+static inline unsigned long cpu_freq_capacity(cpu_t *cpu) {
+    return (unsigned long)(((uint64_t)cpu->curr_freq << SCHED_CAPACITY_SHIFT) / cpu->max_freq);
+}
+
+// Bring the PELT signal up to now with the state that held until now.
+// Running time is scaled by the current frequency, so util_avg is the
+// share of the CPU's full capacity actually used.  Caller holds cpu->lock.
+static void update_cpu_pelt(cpu_t *cpu, uint64_t now) {
+    unsigned long running = cpu->nr_running ? cpu_freq_capacity(cpu) : 0;
+
+    if (pelt_update_rq(now, &cpu->avg, cpu->load_weight, cpu->nr_running, running))
+        cpu->util = (unsigned int)((cpu->avg.util_avg * MAX_LOAD) >> SCHED_CAPACITY_SHIFT);
+}
+
 // Update CPU Utilization
-void update_cpu_util(schedutil_t *util, unsigned int cpu_id, unsigned int util) {
+//
+// Scheduler hook, called whenever the runqueue changes: account the time
+// since the last call, record the new runqueue state, then re-evaluate
+// the frequency if the rate limit allows.
+void update_cpu_util(schedutil_t *util, unsigned int cpu_id, uint64_t now,
+                     unsigned int nr_running, unsigned long load_weight) {
     if (!util || cpu_id >= util->nr_cpus) return;
 
     cpu_t *cpu = &util->cpus[cpu_id];
     pthread_mutex_lock(&cpu->lock);
-    
-    cpu->util = util > MAX_LOAD ? MAX_LOAD : util;
-    
+
+    update_cpu_pelt(cpu, now);
+    cpu->nr_running = nr_running;
+    cpu->load_weight = load_weight;
+
     // Update frequency if needed
-    uint64_t now = time(NULL) * 1000000;  // Convert to microseconds
-    uint64_t delta = now - cpu->last_update;
-    
+    uint64_t delta = (now - cpu->last_update) / 1000;  // us
+
     if (delta >= util->policy.up_rate_limit_us) {
         update_cpu_freq(util, cpu_id);
         cpu->last_update = now;
     }
-    
+
     pthread_mutex_unlock(&cpu->lock);
 }
 
 // Calculate Target Frequency
+//
+// util_avg is frequency invariant, so the frequency that would run it
+// at 80% busy is 1.25 * max_freq * util / capacity.  Pick the lowest
+// step at or above that.
 unsigned int calc_target_freq(schedutil_t *util, cpu_t *cpu) {
-    unsigned int target_freq;
-    
-    // Calculate target frequency based on utilization
-    if (cpu->util >= util->policy.util_threshold) {
-        // High utilization: scale up frequency
-        target_freq = (cpu->util * MAX_FREQ) / MAX_LOAD;
-        if (util->policy.boost_enabled)
-            target_freq += FREQ_STEP;  // Add boost
-    } else {
-        // Low utilization: scale down frequency
-        target_freq = ((cpu->util + 10) * MAX_FREQ) / MAX_LOAD;
-    }
-    
-    // Round to nearest frequency step
-    target_freq = (target_freq / FREQ_STEP) * FREQ_STEP;
-    
-    return target_freq;
+    uint64_t target_freq;
+
+    target_freq = ((uint64_t)(cpu->max_freq + (cpu->max_freq >> 2)) * cpu->avg.util_avg)
+                  >> SCHED_CAPACITY_SHIFT;
+
+    // High utilization: add boost on top of the headroom
+    if (cpu->util >= util->policy.util_threshold && util->policy.boost_enabled)
+        target_freq += FREQ_STEP;
+
+    // Round up to the next frequency step
+    target_freq = ((target_freq + FREQ_STEP - 1) / FREQ_STEP) * FREQ_STEP;
+    if (target_freq > UINT32_MAX)
+        target_freq = UINT32_MAX;
+
+    return (unsigned int)target_freq;
 }
 
 // Apply Frequency Constraints
@@ -366,11 +423,14 @@ void* monitor_thread(void *arg) {
             if (cpu->state != CPU_ACTIVE)
                 continue;
                 
+            uint64_t now = schedutil_clock(util);
             pthread_mutex_lock(&cpu->lock);
             
+            // Decay the signal of CPUs the scheduler has not reported
+            update_cpu_pelt(cpu, now);
+
             // Update frequency if needed
-            uint64_t now = time(NULL) * 1000000;
-            uint64_t delta = now - cpu->last_update;
+            uint64_t delta = (now - cpu->last_update) / 1000;  // us
             
             if (delta >= util->policy.down_rate_limit_us) {
                 update_cpu_freq(util, i);
@@ -403,7 +463,8 @@ void print_schedutil_stats(schedutil_t *util) {
         printf("\nCPU %u Statistics:\n", i);
         printf("  State: %s\n", get_cpu_state_string(cpu->state));
         printf("  Current Frequency: %u MHz\n", cpu->curr_freq / 1000);
-        printf("  Current Utilization: %u%%\n", cpu->util);
+        printf("  Current Utilization: %u%% (util_avg %lu, load_avg %lu)\n",
+            cpu->util, cpu->avg.util_avg, cpu->avg.load_avg);
         printf("  Frequency Switches: %lu\n", cpu->stats.switches);
         printf("  Up Transitions: %lu\n", cpu->stats.up_transitions);
         printf("  Down Transitions: %lu\n", cpu->stats.down_transitions);
@@ -441,6 +502,43 @@ void destroy_schedutil(schedutil_t *util) {
     LOG(LOG_LEVEL_DEBUG, "Destroyed schedutil");
 }
 
+// Give each CPU a random demand in [demand_min, demand_min + demand_range)
+// percent of its full capacity for duration_ms of simulated time, one
+// scheduler event per ms.  At lower frequencies the same work keeps the
+// CPU busy for longer, which is what drives the frequency up.
+static void run_workload(schedutil_t *util, unsigned int demand_min,
+                         unsigned int demand_range, int duration_ms) {
+    unsigned int demand[MAX_CPUS];
+
+    for (unsigned int cpu = 0; cpu < util->nr_cpus; cpu++)
+        demand[cpu] = demand_min + rand() % demand_range;
+
+    for (int ms = 0; ms < duration_ms; ms++) {
+        advance_clock(util, 1000000);
+        uint64_t now = schedutil_clock(util);
+
+        for (unsigned int cpu = 0; cpu < util->nr_cpus; cpu++) {
+            cpu_t *c = &util->cpus[cpu];
+            pthread_mutex_lock(&c->lock);
+            unsigned int busy_pct = demand[cpu] * c->max_freq / c->curr_freq;
+            pthread_mutex_unlock(&c->lock);
+
+            bool busy = (unsigned int)(rand() % 100) < busy_pct;
+            update_cpu_util(util, cpu, now, busy ? 1 : 0, busy ? NICE_0_LOAD : 0);
+        }
+        if (ms % 10 == 9)
+            usleep(1000);  // let the monitor thread run
+    }
+
+    for (unsigned int cpu = 0; cpu < util->nr_cpus; cpu++) {
+        cpu_t *c = &util->cpus[cpu];
+        pthread_mutex_lock(&c->lock);
+        printf("  CPU %u: demand %2u%% -> util_avg %4lu, %4u MHz\n",
+            cpu, demand[cpu], c->avg.util_avg, c->curr_freq / 1000);
+        pthread_mutex_unlock(&c->lock);
+    }
+}
+
 // Demonstrate Scheduler Utility
 void demonstrate_schedutil(void) {
     // Create schedutil with 4 CPUs
@@ -453,32 +551,17 @@ void demonstrate_schedutil(void) {
     // Scenario 1: Normal workload
     printf("\nScenario 1: Normal workload\n");
     set_power_state(util, POWER_NORMAL);
-    for (int i = 0; i < 10; i++) {
-        for (unsigned int cpu = 0; cpu < util->nr_cpus; cpu++) {
-            update_cpu_util(util, cpu, 30 + rand() % 40);  // 30-70% util
-        }
-        usleep(10000);  // 10ms
-    }
+    run_workload(util, 30, 40, SCENARIO_MS);  // 30-70% busy
 
     // Scenario 2: High performance workload
     printf("\nScenario 2: High performance workload\n");
     set_power_state(util, POWER_PERFORMANCE);
-    for (int i = 0; i < 10; i++) {
-        for (unsigned int cpu = 0; cpu < util->nr_cpus; cpu++) {
-            update_cpu_util(util, cpu, 70 + rand() % 30);  // 70-100% util
-        }
-        usleep(10000);
-    }
+    run_workload(util, 70, 30, SCENARIO_MS);  // 70-100% busy
 
     // Scenario 3: Power saving mode
     printf("\nScenario 3: Power saving mode\n");
     set_power_state(util, POWER_POWERSAVE);
-    for (int i = 0; i < 10; i++) {
-        for (unsigned int cpu = 0; cpu < util->nr_cpus; cpu++) {
-            update_cpu_util(util, cpu, rand() % 30);  // 0-30% util
-        }
-        usleep(10000);
-    }
+    run_workload(util, 0, 30, SCENARIO_MS);  // 0-30% busy
 
     // Print final statistics
     print_schedutil_stats(util);
@@ -0,0 +1,393 @@
+/*
+ * Internet Checksum Simulation (RFC 1071)
+ * Shared by tcp_ipv4_sim.c and udp_sim.c
+ *
+ * This module provides:
+ * - Word-at-a-time scalar, SSE2 and AVX2 partial-sum kernels
+ * - Runtime CPU dispatch (first call picks the widest supported kernel)
+ * - One-pass copy-and-checksum for send paths
+ * - Incremental update for header rewrites (RFC 1624)
+ * - TCP/UDP pseudo-header sums
+ *
+ * Partial sums are 32-bit one's-complement accumulators in native byte
+ * order, like the kernel's __wsum; csum_sim_fold() produces the final
+ * 16-bit field value. Kernel builds (__KERNEL__) get the scalar kernel
+ * only, since vector registers would need kernel_fpu_begin().
+ */
+
+#ifndef _CSUM_SIM_H
+#define _CSUM_SIM_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/string.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CSUM_SIM_X86 1
+#endif
+#endif
+
+typedef uint32_t csum_sim_t;
+
+typedef csum_sim_t (*csum_sim_fn)(const void *buf, size_t len, csum_sim_t sum);
+typedef csum_sim_t (*csum_sim_copy_fn)(void *dst, const void *src, size_t len,
+                                       csum_sim_t sum);
+
+struct csum_sim_kernel {
+    const char *name;
+    csum_sim_fn partial;
+    csum_sim_copy_fn partial_copy;
+    int (*supported)(void);
+};
+
+/* One's-complement helpers */
+
+static inline csum_sim_t csum_sim_add(csum_sim_t a, csum_sim_t b)
+{
+    a += b;
+    return a + (a < b);
+}
+
+static inline csum_sim_t csum_sim_fold64(uint64_t sum)
+{
+    sum = (sum & 0xffffffffULL) + (sum >> 32);
+    sum = (sum & 0xffffffffULL) + (sum >> 32);
+    return (csum_sim_t)sum;
+}
+
+static inline uint16_t csum_sim_fold(csum_sim_t sum)
+{
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+/* Rotate a sum computed at an odd byte offset into place */
+static inline csum_sim_t csum_sim_block_add(csum_sim_t sum, csum_sim_t sum2,
+                                            size_t offset)
+{
+    if (offset & 1)
+        sum2 = (sum2 << 8) | (sum2 >> 24);
+    return csum_sim_add(sum, sum2);
+}
+
+/* Trailing 0-7 bytes, zero padded, in native order */
+static inline uint64_t csum_sim_tail(const unsigned char *p, size_t len)
+{
+    uint64_t w = 0;
+
+    memcpy(&w, p, len);
+    return (w & 0xffffffffULL) + (w >> 32);
+}
+
+/* Scalar kernel: 64-bit loads, 32-bit halves into a 64-bit accumulator */
+
+static csum_sim_t csum_sim_partial_scalar(const void *buf, size_t len,
+                                          csum_sim_t sum)
+{
+    const unsigned char *p = buf;
+    uint64_t acc = sum, a0 = 0, a1 = 0, w0, w1;
+
+    while (len >= 16) {
+        memcpy(&w0, p, 8);
+        memcpy(&w1, p + 8, 8);
+        a0 += (w0 & 0xffffffffULL) + (w0 >> 32);
+        a1 += (w1 & 0xffffffffULL) + (w1 >> 32);
+        p += 16;
+        len -= 16;
+    }
+    if (len >= 8) {
+        memcpy(&w0, p, 8);
+        a0 += (w0 & 0xffffffffULL) + (w0 >> 32);
+        p += 8;
+        len -= 8;
+    }
+    if (len)
+        a1 += csum_sim_tail(p, len);
+
+    /* Each accumulator gains < 2^33 per 16 bytes: no overflow below 32GB */
+    acc += csum_sim_fold64(a0);
+    acc += csum_sim_fold64(a1);
+    return csum_sim_fold64(acc);
+}
+
+static csum_sim_t csum_sim_partial_copy_scalar(void *dst, const void *src,
+                                               size_t len, csum_sim_t sum)
+{
+    const unsigned char *s = src;
+    unsigned char *d = dst;
+    uint64_t acc = sum, a0 = 0, w0;
+
+    while (len >= 8) {
+        memcpy(&w0, s, 8);
+        memcpy(d, &w0, 8);
+        a0 += (w0 & 0xffffffffULL) + (w0 >> 32);
+        s += 8;
+        d += 8;
+        len -= 8;
+    }
+    if (len) {
+        memcpy(d, s, len);
+        a0 += csum_sim_tail(s, len);
+    }
+
+    acc += csum_sim_fold64(a0);
+    return csum_sim_fold64(acc);
+}
+
+static int csum_sim_always(void)
+{
+    return 1;
+}
+
+#ifdef CSUM_SIM_X86
+
+/* Horizontal sum of 64-bit lanes, each < 2^63 */
+static inline uint64_t csum_sim_hsum128(__m128i v)
+{
+    return (uint64_t)_mm_cvtsi128_si64(v) +
+           (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(v, v));
+}
+
+/*
+ * SSE2 kernel: widen 32-bit lanes to 64 bits by interleaving with zero and
+ * add into two accumulators. SSE2 is baseline on x86-64, so this needs no
+ * CPU check there.
+ */
+static csum_sim_t csum_sim_partial_sse2(const void *buf, size_t len,
+                                        csum_sim_t sum)
+{
+    const unsigned char *p = buf;
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc0 = zero, acc1 = zero, v0, v1;
+    uint64_t acc;
+
+    while (len >= 32) {
+        v0 = _mm_loadu_si128((const __m128i *)p);
+        v1 = _mm_loadu_si128((const __m128i *)(p + 16));
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v0, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v0, zero));
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v1, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v1, zero));
+        p += 32;
+        len -= 32;
+    }
+
+    acc = csum_sim_fold64(csum_sim_hsum128(acc0));
+    acc += csum_sim_fold64(csum_sim_hsum128(acc1));
+    return csum_sim_partial_scalar(p, len, csum_sim_add(sum, csum_sim_fold64(acc)));
+}
+
+static csum_sim_t csum_sim_partial_copy_sse2(void *dst, const void *src,
+                                             size_t len, csum_sim_t sum)
+{
+    const unsigned char *s = src;
+    unsigned char *d = dst;
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc0 = zero, acc1 = zero, v0, v1;
+    uint64_t acc;
+
+    while (len >= 32) {
+        v0 = _mm_loadu_si128((const __m128i *)s);
+        v1 = _mm_loadu_si128((const __m128i *)(s + 16));
+        _mm_storeu_si128((__m128i *)d, v0);
+        _mm_storeu_si128((__m128i *)(d + 16), v1);
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v0, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v0, zero));
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v1, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v1, zero));
+        s += 32;
+        d += 32;
+        len -= 32;
+    }
+
+    acc = csum_sim_fold64(csum_sim_hsum128(acc0));
+    acc += csum_sim_fold64(csum_sim_hsum128(acc1));
+    return csum_sim_partial_copy_scalar(d, s, len,
+                                        csum_sim_add(sum, csum_sim_fold64(acc)));
+}
+
+static int csum_sim_has_sse2(void)
+{
+    return __builtin_cpu_supports("sse2");
+}
+
+__attribute__((target("avx2")))
+static inline uint64_t csum_sim_hsum256(__m256i v)
+{
+    return csum_sim_hsum128(_mm_add_epi64(_mm256_castsi256_si128(v),
+                                          _mm256_extracti128_si256(v, 1)));
+}
+
+/* AVX2 kernel: as SSE2, 64 bytes per iteration with four accumulators */
+__attribute__((target("avx2")))
+static csum_sim_t csum_sim_partial_avx2(const void *buf, size_t len,
+                                        csum_sim_t sum)
+{
+    const unsigned char *p = buf;
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc0 = zero, acc1 = zero, acc2 = zero, acc3 = zero, v0, v1;
+    uint64_t acc;
+
+    while (len >= 64) {
+        v0 = _mm256_loadu_si256((const __m256i *)p);
+        v1 = _mm256_loadu_si256((const __m256i *)(p + 32));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+        acc2 = _mm256_add_epi64(acc2, _mm256_unpacklo_epi32(v1, zero));
+        acc3 = _mm256_add_epi64(acc3, _mm256_unpackhi_epi32(v1, zero));
+        p += 64;
+        len -= 64;
+    }
+
+    acc = csum_sim_fold64(csum_sim_hsum256(_mm256_add_epi64(acc0, acc1)));
+    acc += csum_sim_fold64(csum_sim_hsum256(_mm256_add_epi64(acc2, acc3)));
+    /* The tail runs legacy-SSE code: avoid the AVX->SSE transition stall */
+    _mm256_zeroupper();
+    return csum_sim_partial_sse2(p, len, csum_sim_add(sum, csum_sim_fold64(acc)));
+}
+
+__attribute__((target("avx2")))
+static csum_sim_t csum_sim_partial_copy_avx2(void *dst, const void *src,
+                                             size_t len, csum_sim_t sum)
+{
+    const unsigned char *s = src;
+    unsigned char *d = dst;
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc0 = zero, acc1 = zero, acc2 = zero, acc3 = zero, v0, v1;
+    uint64_t acc;
+
+    while (len >= 64) {
+        v0 = _mm256_loadu_si256((const __m256i *)s);
+        v1 = _mm256_loadu_si256((const __m256i *)(s + 32));
+        _mm256_storeu_si256((__m256i *)d, v0);
+        _mm256_storeu_si256((__m256i *)(d + 32), v1);
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+        acc2 = _mm256_add_epi64(acc2, _mm256_unpacklo_epi32(v1, zero));
+        acc3 = _mm256_add_epi64(acc3, _mm256_unpackhi_epi32(v1, zero));
+        s += 64;
+        d += 64;
+        len -= 64;
+    }
+
+    acc = csum_sim_fold64(csum_sim_hsum256(_mm256_add_epi64(acc0, acc1)));
+    acc += csum_sim_fold64(csum_sim_hsum256(_mm256_add_epi64(acc2, acc3)));
+    _mm256_zeroupper();
+    return csum_sim_partial_copy_sse2(d, s, len,
+                                      csum_sim_add(sum, csum_sim_fold64(acc)));
+}
+
+static int csum_sim_has_avx2(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif /* CSUM_SIM_X86 */
+
+/* Kernels, widest first */
+static const struct csum_sim_kernel csum_sim_kernels[] = {
+#ifdef CSUM_SIM_X86
+    { "avx2", csum_sim_partial_avx2, csum_sim_partial_copy_avx2, csum_sim_has_avx2 },
+    { "sse2", csum_sim_partial_sse2, csum_sim_partial_copy_sse2, csum_sim_has_sse2 },
+#endif
+    { "scalar", csum_sim_partial_scalar, csum_sim_partial_copy_scalar, csum_sim_always },
+};
+
+#define CSUM_SIM_NR_KERNELS (sizeof(csum_sim_kernels) / sizeof(csum_sim_kernels[0]))
+
+/* Buffers shorter than this stay on the scalar kernel: no vector setup */
+#define CSUM_SIM_VECTOR_MIN 128
+
+/* Resolved on first use; racing resolvers store the same value */
+static const struct csum_sim_kernel *csum_sim_active;
+
+static const struct csum_sim_kernel *csum_sim_resolve(void)
+{
+    const struct csum_sim_kernel *k = __atomic_load_n(&csum_sim_active,
+                                                      __ATOMIC_ACQUIRE);
+    size_t i;
+
+    if (k)
+        return k;
+    for (i = 0; i < CSUM_SIM_NR_KERNELS; i++) {
+        if (csum_sim_kernels[i].supported()) {
+            k = &csum_sim_kernels[i];
+            break;
+        }
+    }
+    __atomic_store_n(&csum_sim_active, k, __ATOMIC_RELEASE);
+    return k;
+}
+
+/* Public API */
+
+static inline csum_sim_t csum_sim_partial(const void *buf, size_t len,
+                                          csum_sim_t sum)
+{
+    if (len < CSUM_SIM_VECTOR_MIN)
+        return csum_sim_partial_scalar(buf, len, sum);
+    return csum_sim_resolve()->partial(buf, len, sum);
+}
+
+/* Copy len bytes and return their partial sum, touching the data once */
+static inline csum_sim_t csum_sim_partial_copy(void *dst, const void *src,
+                                               size_t len, csum_sim_t sum)
+{
+    if (len < CSUM_SIM_VECTOR_MIN)
+        return csum_sim_partial_copy_scalar(dst, src, len, sum);
+    return csum_sim_resolve()->partial_copy(dst, src, len, sum);
+}
+
+/* Folded checksum of a buffer, ready to store in a header */
+static inline uint16_t csum_sim_compute(const void *buf, size_t len)
+{
+    return csum_sim_fold(csum_sim_partial(buf, len, 0));
+}
+
+/* Pseudo-header sum; addresses in network order, len and proto in host */
+static inline csum_sim_t csum_sim_tcpudp_nofold(uint32_t saddr, uint32_t daddr,
+                                                uint32_t len, uint8_t proto,
+                                                csum_sim_t sum)
+{
+    unsigned char ph[4] = { 0, proto, (len >> 8) & 0xff, len & 0xff };
+    uint64_t s = sum;
+    uint32_t w;
+
+    /* zero, protocol and length exactly as they appear on the wire */
+    memcpy(&w, ph, sizeof(w));
+    s += saddr;
+    s += daddr;
+    s += w;
+    return csum_sim_fold64(s);
+}
+
+/*
+ * Incremental update (RFC 1624, eqn. 3): HC' = ~(~HC + ~m + m').
+ * old/new are the field values exactly as stored in the packet.
+ */
+static inline void csum_sim_replace2(uint16_t *check, uint16_t old, uint16_t new)
+{
+    csum_sim_t sum = (uint16_t)~*check;
+
+    sum += (uint16_t)~old;
+    sum += new;
+    *check = csum_sim_fold(sum);
+}
+
+static inline void csum_sim_replace4(uint16_t *check, uint32_t old, uint32_t new)
+{
+    csum_sim_t sum = (uint16_t)~*check;
+
+    sum += (uint16_t)~(old & 0xffff);
+    sum += (uint16_t)~(old >> 16);
+    sum += new & 0xffff;
+    sum += new >> 16;
+    *check = csum_sim_fold(sum);
+}
+
+#endif /* _CSUM_SIM_H */
@@ -0,0 +1,1318 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stddef.h>
+
+// Logging Macros
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_ERROR 3
+
+#define LOG(level, ...) do { \
+    if (level >= current_log_level) { \
+        printf("[%s] ", get_log_level_string(level)); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+    } \
+} while(0)
+
+#define container_of(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+// Global Log Level
+static int current_log_level = LOG_LEVEL_INFO;
+
+// Deadline Scheduler Constants (times in us)
+#define MAX_CPUS           64       // CPU masks are one 64-bit word
+#define MAX_DL_TASKS       256
+#define BW_SHIFT           20
+#define BW_UNIT            (1ULL << BW_SHIFT)
+#define DL_GLOBAL_PERIOD   1000000  // admission window, as rt_sim's rt_period
+#define DL_GLOBAL_RUNTIME  950000   // 95% of every CPU, as rt_sim's BANDWIDTH_CAP
+#define DL_MIN_RUNTIME     10
+#define SIM_DURATION       2000000  // 2s of virtual time
+
+// Deadline Task States
+typedef enum {
+    DL_RUNNING,
+    DL_READY,
+    DL_THROTTLED,           // budget used up, waiting for replenishment
+    DL_SLEEPING,            // job done, waiting for the next release
+    DL_DEAD
+} dl_state_t;
+
+// Red-Black Tree Colors
+typedef enum {
+    RB_RED,
+    RB_BLACK
+} rb_color_t;
+
+// Red-Black Tree Node, ordered by key
+typedef struct rb_node {
+    struct rb_node *parent;
+    struct rb_node *left;
+    struct rb_node *right;
+    rb_color_t color;
+    uint64_t key;
+} rb_node_t;
+
+// Tree Root with cached leftmost (smallest key)
+typedef struct {
+    rb_node_t *rb_node;
+    rb_node_t *rb_leftmost;
+} rb_root_cached_t;
+
+// Deadline Task Structure
+typedef struct dl_task {
+    unsigned int id;
+    char name[32];
+    dl_state_t state;
+
+    // Reservation: runtime <= deadline <= period
+    uint64_t dl_runtime;
+    uint64_t dl_deadline;
+    uint64_t dl_period;
+    uint64_t dl_bw;                 // runtime / period, BW_UNIT scale
+
+    // Constant Bandwidth Server: budget and absolute deadline
+    int64_t runtime;
+    uint64_t deadline;
+
+    // Periodic job model
+    uint64_t job_exec;              // work per job
+    uint64_t job_left;
+    uint64_t job_release;
+    uint64_t job_deadline;
+
+    // Statistics
+    uint64_t jobs_done;
+    uint64_t jobs_missed;
+    uint64_t max_tardiness;
+    uint64_t nr_throttled;
+    uint64_t sum_exec;
+
+    int cpu;
+    int bw_cpu;                     // CPU whose this_bw holds dl_bw
+    bool admitted;
+    rb_node_t node;                 // EDF tree while queued
+    rb_node_t timer;                // timer tree while throttled or sleeping
+    struct dl_task *wake_next;
+} dl_task_t;
+
+// Deadline Run Queue
+typedef struct {
+    rb_root_cached_t root;          // queued tasks by absolute deadline
+    rb_root_cached_t timers;        // throttled and sleeping tasks by expiry
+    dl_task_t *curr;
+    unsigned int nr_running;        // queued, not counting curr
+    uint64_t exec_start;
+    uint64_t this_bw;               // bandwidth of the tasks homed here
+    bool overloaded;                // tasks queued behind a running one
+    pthread_mutex_t lock;
+} dl_rq_t;
+
+// CPU Deadline Heap: busy CPUs by the deadline they run, latest on top,
+// so a waking task finds the CPU it should preempt in O(1)
+typedef struct {
+    pthread_mutex_t lock;
+    int size;
+    struct {
+        uint64_t dl;
+        int cpu;
+    } elements[MAX_CPUS];
+    int idx[MAX_CPUS];              // heap position, -1 if free
+    uint64_t free_cpus;             // no deadline task at all
+} cpudl_t;
+
+// Root Domain: bandwidth admission and global EDF state
+typedef struct {
+    pthread_mutex_t lock;
+    uint64_t bw;                    // admissible per CPU, BW_UNIT scale
+    uint64_t total_bw;              // admitted so far
+    cpudl_t cpudl;
+    _Atomic uint64_t dlo_mask;      // overloaded CPUs
+} root_domain_t;
+
+// CPU Structure
+typedef struct {
+    unsigned int id;
+    dl_rq_t dl_rq;
+    uint64_t next_event;
+} dl_cpu_t;
+
+// Deadline Statistics Structure
+typedef struct {
+    uint64_t jobs;
+    uint64_t missed;
+    uint64_t throttles;
+    uint64_t replenishments;
+    uint64_t migrations;
+    uint64_t preemptions;
+    uint64_t rejected;
+    uint64_t max_tardiness;
+} dl_stats_t;
+
+// Deadline Scheduler Manager Structure
+typedef struct {
+    dl_cpu_t cpus[MAX_CPUS];
+    dl_task_t *tasks[MAX_DL_TASKS];
+    size_t nr_cpus;
+    size_t nr_tasks;
+    root_domain_t rd;
+    bool global;                    // cpudl placement and push/pull
+    uint64_t clock;
+    dl_stats_t stats;
+    pthread_mutex_t manager_lock;
+} dl_manager_t;
+
+// Function Prototypes
+const char* get_log_level_string(int level);
+const char* get_dl_state_string(dl_state_t state);
+
+dl_manager_t* create_dl_manager(size_t nr_cpus, bool global);
+void destroy_dl_manager(dl_manager_t *manager);
+
+dl_task_t* create_dl_task(const char *name, uint64_t job_exec);
+void destroy_dl_task(dl_task_t *task);
+int sched_setattr_dl(dl_manager_t *manager, dl_task_t *task,
+                     uint64_t runtime, uint64_t deadline, uint64_t period);
+int start_dl_task(dl_manager_t *manager, dl_task_t *task, uint64_t release);
+
+void run_simulation(dl_manager_t *manager, uint64_t duration);
+void print_dl_stats(dl_manager_t *manager);
+void demonstrate_dl_scheduler(void);
+
+// Utility Functions
+const char* get_log_level_string(int level) {
+    switch(level) {
+        case LOG_LEVEL_DEBUG: return "DEBUG";
+        case LOG_LEVEL_INFO:  return "INFO";
+        case LOG_LEVEL_WARN:  return "WARN";
+        case LOG_LEVEL_ERROR: return "ERROR";
+        default: return "UNKNOWN";
+    }
+}
+
+const char* get_dl_state_string(dl_state_t state) {
+    switch(state) {
+        case DL_RUNNING:   return "RUNNING";
+        case DL_READY:     return "READY";
+        case DL_THROTTLED: return "THROTTLED";
+        case DL_SLEEPING:  return "SLEEPING";
+        case DL_DEAD:      return "DEAD";
+        default: return "UNKNOWN";
+    }
+}
+
+static inline bool dl_time_before(uint64_t a, uint64_t b) {
+    return (int64_t)(a - b) < 0;
+}
+
+static inline uint64_t to_ratio(uint64_t period, uint64_t runtime) {
+    return period ? (runtime << BW_SHIFT) / period : 0;
+}
+
+// Red-Black Tree
+//
+// Two trees per runqueue share this code: queued tasks keyed by
+// absolute deadline (the EDF order) and waiting tasks keyed by timer
+// expiry.  Equal keys insert to the right, so ties stay FIFO.
+static void rb_rotate_left(rb_root_cached_t *root, rb_node_t *x) {
+    rb_node_t *y = x->right;
+
+    x->right = y->left;
+    if (y->left)
+        y->left->parent = x;
+    y->parent = x->parent;
+    if (!x->parent)
+        root->rb_node = y;
+    else if (x == x->parent->left)
+        x->parent->left = y;
+    else
+        x->parent->right = y;
+    y->left = x;
+    x->parent = y;
+}
+
+static void rb_rotate_right(rb_root_cached_t *root, rb_node_t *x) {
+    rb_node_t *y = x->left;
+
+    x->left = y->right;
+    if (y->right)
+        y->right->parent = x;
+    y->parent = x->parent;
+    if (!x->parent)
+        root->rb_node = y;
+    else if (x == x->parent->right)
+        x->parent->right = y;
+    else
+        x->parent->left = y;
+    y->right = x;
+    x->parent = y;
+}
+
+static rb_node_t *rb_next(rb_node_t *node) {
+    if (node->right) {
+        node = node->right;
+        while (node->left)
+            node = node->left;
+        return node;
+    }
+    while (node->parent && node == node->parent->right)
+        node = node->parent;
+    return node->parent;
+}
+
+static void rb_insert_cached(rb_root_cached_t *root, rb_node_t *node) {
+    rb_node_t **new = &root->rb_node;
+    rb_node_t *parent = NULL;
+    bool leftmost = true;
+
+    while (*new) {
+        parent = *new;
+        if (dl_time_before(node->key, parent->key)) {
+            new = &parent->left;
+        } else {
+            new = &parent->right;
+            leftmost = false;
+        }
+    }
+
+    node->parent = parent;
+    node->left = NULL;
+    node->right = NULL;
+    node->color = RB_RED;
+    *new = node;
+
+    if (leftmost)
+        root->rb_leftmost = node;
+
+    // Rebalance tree
+    while (node != root->rb_node && node->parent->color == RB_RED) {
+        rb_node_t *gparent = node->parent->parent;
+
+        if (node->parent == gparent->left) {
+            rb_node_t *uncle = gparent->right;
+            if (uncle && uncle->color == RB_RED) {
+                node->parent->color = RB_BLACK;
+                uncle->color = RB_BLACK;
+                gparent->color = RB_RED;
+                node = gparent;
+            } else {
+                if (node == node->parent->right) {
+                    node = node->parent;
+                    rb_rotate_left(root, node);
+                }
+                node->parent->color = RB_BLACK;
+                gparent->color = RB_RED;
+                rb_rotate_right(root, gparent);
+            }
+        } else {
+            rb_node_t *uncle = gparent->left;
+            if (uncle && uncle->color == RB_RED) {
+                node->parent->color = RB_BLACK;
+                uncle->color = RB_BLACK;
+                gparent->color = RB_RED;
+                node = gparent;
+            } else {
+                if (node == node->parent->left) {
+                    node = node->parent;
+                    rb_rotate_right(root, node);
+                }
+                node->parent->color = RB_BLACK;
+                gparent->color = RB_RED;
+                rb_rotate_left(root, gparent);
+            }
+        }
+    }
+    root->rb_node->color = RB_BLACK;
+}
+
+static void rb_transplant(rb_root_cached_t *root, rb_node_t *u, rb_node_t *v) {
+    if (!u->parent)
+        root->rb_node = v;
+    else if (u == u->parent->left)
+        u->parent->left = v;
+    else
+        u->parent->right = v;
+    if (v)
+        v->parent = u->parent;
+}
+
+static void rb_erase_fixup(rb_root_cached_t *root, rb_node_t *node, rb_node_t *parent) {
+    while (node != root->rb_node && (!node || node->color == RB_BLACK)) {
+        if (node == parent->left) {
+            rb_node_t *sibling = parent->right;
+            if (sibling->color == RB_RED) {
+                sibling->color = RB_BLACK;
+                parent->color = RB_RED;
+                rb_rotate_left(root, parent);
+                sibling = parent->right;
+            }
+            if ((!sibling->left || sibling->left->color == RB_BLACK) &&
+                (!sibling->right || sibling->right->color == RB_BLACK)) {
+                sibling->color = RB_RED;
+                node = parent;
+                parent = node->parent;
+            } else {
+                if (!sibling->right || sibling->right->color == RB_BLACK) {
+                    sibling->left->color = RB_BLACK;
+                    sibling->color = RB_RED;
+                    rb_rotate_right(root, sibling);
+                    sibling = parent->right;
+                }
+                sibling->color = parent->color;
+                parent->color = RB_BLACK;
+                if (sibling->right)
+                    sibling->right->color = RB_BLACK;
+                rb_rotate_left(root, parent);
+                node = root->rb_node;
+            }
+        } else {
+            rb_node_t *sibling = parent->left;
+            if (sibling->color == RB_RED) {
+                sibling->color = RB_BLACK;
+                parent->color = RB_RED;
+                rb_rotate_right(root, parent);
+                sibling = parent->left;
+            }
+            if ((!sibling->left || sibling->left->color == RB_BLACK) &&
+                (!sibling->right || sibling->right->color == RB_BLACK)) {
+                sibling->color = RB_RED;
+                node = parent;
+                parent = node->parent;
+            } else {
+                if (!sibling->left || sibling->left->color == RB_BLACK) {
+                    sibling->right->color = RB_BLACK;
+                    sibling->color = RB_RED;
+                    rb_rotate_left(root, sibling);
+                    sibling = parent->left;
+                }
+                sibling->color = parent->color;
+                parent->color = RB_BLACK;
+                if (sibling->left)
+                    sibling->left->color = RB_BLACK;
+                rb_rotate_right(root, parent);
+                node = root->rb_node;
+            }
+        }
+    }
+    if (node)
+        node->color = RB_BLACK;
+}
+
+static void rb_erase_cached(rb_root_cached_t *root, rb_node_t *z) {
+    rb_node_t *child, *parent;
+    rb_color_t color = z->color;
+
+    if (root->rb_leftmost == z)
+        root->rb_leftmost = rb_next(z);
+
+    if (!z->left) {
+        child = z->right;
+        parent = z->parent;
+        rb_transplant(root, z, child);
+    } else if (!z->right) {
+        child = z->left;
+        parent = z->parent;
+        rb_transplant(root, z, child);
+    } else {
+        rb_node_t *successor = z->right;
+        while (successor->left)
+            successor = successor->left;
+        color = successor->color;
+        child = successor->right;
+        if (successor->parent == z) {
+            parent = successor;
+        } else {
+            parent = successor->parent;
+            rb_transplant(root, successor, child);
+            successor->right = z->right;
+            successor->right->parent = successor;
+        }
+        rb_transplant(root, z, successor);
+        successor->left = z->left;
+        successor->left->parent = successor;
+        successor->color = z->color;
+    }
+
+    if (color == RB_BLACK && root->rb_node)
+        rb_erase_fixup(root, child, parent);
+
+    z->parent = z->left = z->right = NULL;
+}
+
+static inline dl_task_t *dl_first(const dl_rq_t *rq) {
+    return rq->root.rb_leftmost ? container_of(rq->root.rb_leftmost, dl_task_t, node) : NULL;
+}
+
+static inline dl_task_t *dl_first_timer(const dl_rq_t *rq) {
+    return rq->timers.rb_leftmost ? container_of(rq->timers.rb_leftmost, dl_task_t, timer) : NULL;
+}
+
+// CPU Deadline Heap
+static void cpudl_init(cpudl_t *cp) {
+    pthread_mutex_init(&cp->lock, NULL);
+    cp->size = 0;
+    cp->free_cpus = 0;
+    for (int i = 0; i < MAX_CPUS; i++)
+        cp->idx[i] = -1;
+}
+
+static void cpudl_swap(cpudl_t *cp, int a, int b) {
+    int cpu_a = cp->elements[a].cpu, cpu_b = cp->elements[b].cpu;
+    uint64_t dl_a = cp->elements[a].dl;
+
+    cp->elements[a].cpu = cpu_b;
+    cp->elements[a].dl = cp->elements[b].dl;
+    cp->elements[b].cpu = cpu_a;
+    cp->elements[b].dl = dl_a;
+    cp->idx[cpu_b] = a;
+    cp->idx[cpu_a] = b;
+}
+
+static void cpudl_heapify_down(cpudl_t *cp, int idx) {
+    for (;;) {
+        int l = 2 * idx + 1, r = l + 1, latest = idx;
+
+        if (l < cp->size && dl_time_before(cp->elements[latest].dl, cp->elements[l].dl))
+            latest = l;
+        if (r < cp->size && dl_time_before(cp->elements[latest].dl, cp->elements[r].dl))
+            latest = r;
+        if (latest == idx)
+            break;
+        cpudl_swap(cp, idx, latest);
+        idx = latest;
+    }
+}
+
+static void cpudl_heapify_up(cpudl_t *cp, int idx) {
+    while (idx > 0) {
+        int p = (idx - 1) / 2;
+        if (!dl_time_before(cp->elements[p].dl, cp->elements[idx].dl))
+            break;
+        cpudl_swap(cp, idx, p);
+        idx = p;
+    }
+}
+
+static void cpudl_heapify(cpudl_t *cp, int idx) {
+    if (idx > 0 && dl_time_before(cp->elements[(idx - 1) / 2].dl, cp->elements[idx].dl))
+        cpudl_heapify_up(cp, idx);
+    else
+        cpudl_heapify_down(cp, idx);
+}
+
+// Record the earliest deadline a CPU is running
+static void cpudl_set(cpudl_t *cp, int cpu, uint64_t dl) {
+    pthread_mutex_lock(&cp->lock);
+    int idx = cp->idx[cpu];
+    if (idx < 0) {
+        idx = cp->size++;
+        cp->elements[idx].dl = dl;
+        cp->elements[idx].cpu = cpu;
+        cp->idx[cpu] = idx;
+        cp->free_cpus &= ~(1ULL << cpu);
+        cpudl_heapify_up(cp, idx);
+    } else if (cp->elements[idx].dl != dl) {
+        cp->elements[idx].dl = dl;
+        cpudl_heapify(cp, idx);
+    }
+    pthread_mutex_unlock(&cp->lock);
+}
+
+// The CPU has no deadline work left
+static void cpudl_clear(cpudl_t *cp, int cpu) {
+    pthread_mutex_lock(&cp->lock);
+    int idx = cp->idx[cpu];
+    if (idx >= 0) {
+        int last = --cp->size;
+        cp->idx[cpu] = -1;
+        if (idx != last) {
+            cp->elements[idx] = cp->elements[last];
+            cp->idx[cp->elements[idx].cpu] = idx;
+            cpudl_heapify(cp, idx);
+        }
+    }
+    cp->free_cpus |= 1ULL << cpu;
+    pthread_mutex_unlock(&cp->lock);
+}
+
+// Free CPUs, else the CPU with the latest deadline if it is later than dl
+static bool cpudl_find(cpudl_t *cp, uint64_t dl, uint64_t *later_mask) {
+    bool found = false;
+
+    pthread_mutex_lock(&cp->lock);
+    if (cp->free_cpus) {
+        *later_mask = cp->free_cpus;
+        found = true;
+    } else if (cp->size && dl_time_before(dl, cp->elements[0].dl)) {
+        *later_mask = 1ULL << cp->elements[0].cpu;
+        found = true;
+    }
+    pthread_mutex_unlock(&cp->lock);
+    return found;
+}
+
+// Create Deadline Task: parameters come from sched_setattr_dl()
+dl_task_t* create_dl_task(const char *name, uint64_t job_exec) {
+    dl_task_t *task = calloc(1, sizeof(dl_task_t));
+    if (!task) return NULL;
+
+    static unsigned int next_id = 0;
+    task->id = next_id++;
+    snprintf(task->name, sizeof(task->name), "%s", name);
+    task->state = DL_DEAD;
+    task->job_exec = job_exec;
+    task->cpu = -1;
+
+    return task;
+}
+
+// Create Deadline Manager
+dl_manager_t* create_dl_manager(size_t nr_cpus, bool global) {
+    if (nr_cpus == 0 || nr_cpus > MAX_CPUS) {
+        LOG(LOG_LEVEL_ERROR, "Number of CPUs exceeds maximum");
+        return NULL;
+    }
+
+    dl_manager_t *manager = calloc(1, sizeof(dl_manager_t));
+    if (!manager) {
+        LOG(LOG_LEVEL_ERROR, "Failed to allocate deadline manager");
+        return NULL;
+    }
+
+    pthread_mutex_init(&manager->rd.lock, NULL);
+    manager->rd.bw = to_ratio(DL_GLOBAL_PERIOD, DL_GLOBAL_RUNTIME);
+    cpudl_init(&manager->rd.cpudl);
+    atomic_init(&manager->rd.dlo_mask, 0);
+
+    // Initialize CPUs
+    for (size_t i = 0; i < nr_cpus; i++) {
+        manager->cpus[i].id = i;
+        manager->cpus[i].next_event = 0;
+        pthread_mutex_init(&manager->cpus[i].dl_rq.lock, NULL);
+        cpudl_clear(&manager->rd.cpudl, (int)i);
+    }
+
+    manager->nr_cpus = nr_cpus;
+    manager->global = global;
+    pthread_mutex_init(&manager->manager_lock, NULL);
+
+    LOG(LOG_LEVEL_DEBUG, "Created %s EDF manager with %zu CPUs",
+        global ? "global" : "partitioned", nr_cpus);
+    return manager;
+}
+
+// Admission Control
+//
+// The root domain may hand out DL_GLOBAL_RUNTIME / DL_GLOBAL_PERIOD of
+// every CPU.  A reservation is accepted only if the admitted bandwidth
+// still fits, which is what lets global EDF bound every task's
+// tardiness.  The task is homed on the CPU with the least bandwidth.
+// Partitioned mode never moves it from there, so that CPU alone must
+// also fit it (worst-fit): uniprocessor EDF then meets every deadline.
+// Global mode may migrate it, so the bandwidth stays charged to bw_cpu
+// and a later change is applied there, not wherever the task now runs.
+int sched_setattr_dl(dl_manager_t *manager, dl_task_t *task,
+                     uint64_t runtime, uint64_t deadline, uint64_t period) {
+    if (!manager || !task) return -EINVAL;
+    if (!period)
+        period = deadline;
+    if (runtime < DL_MIN_RUNTIME || runtime > deadline || deadline > period)
+        return -EINVAL;
+
+    uint64_t new_bw = to_ratio(period, runtime);
+    uint64_t old_bw = task->admitted ? task->dl_bw : 0;
+
+    // rd.lock serialises all this_bw updates, so the per-CPU fit
+    // checked here still holds when it is applied
+    pthread_mutex_lock(&manager->rd.lock);
+    if (manager->rd.total_bw - old_bw + new_bw > manager->rd.bw * manager->nr_cpus) {
+        pthread_mutex_unlock(&manager->rd.lock);
+        manager->stats.rejected++;
+        LOG(LOG_LEVEL_WARN, "Rejected %s: %lu/%lu/%lu us would exceed %.0f%% of %zu CPUs",
+            task->name, runtime, deadline, period,
+            100.0 * DL_GLOBAL_RUNTIME / DL_GLOBAL_PERIOD, manager->nr_cpus);
+        return -EBUSY;
+    }
+
+    int home = task->bw_cpu;
+    if (!task->admitted) {
+        home = 0;
+        for (size_t i = 1; i < manager->nr_cpus; i++) {
+            if (manager->cpus[i].dl_rq.this_bw < manager->cpus[home].dl_rq.this_bw)
+                home = (int)i;
+        }
+    }
+    if (!manager->global &&
+        manager->cpus[home].dl_rq.this_bw - old_bw + new_bw > manager->rd.bw) {
+        pthread_mutex_unlock(&manager->rd.lock);
+        manager->stats.rejected++;
+        LOG(LOG_LEVEL_WARN, "Rejected %s: %lu/%lu/%lu us fits on no single CPU",
+            task->name, runtime, deadline, period);
+        return -EBUSY;
+    }
+    manager->rd.total_bw += new_bw - old_bw;
+    if (!task->admitted)
+        task->cpu = home;
+    task->bw_cpu = home;
+
+    dl_rq_t *rq = &manager->cpus[home].dl_rq;
+    pthread_mutex_lock(&rq->lock);
+    rq->this_bw += new_bw - old_bw;
+    task->dl_runtime = runtime;
+    task->dl_deadline = deadline;
+    task->dl_period = period;
+    task->dl_bw = new_bw;
+    task->admitted = true;
+    pthread_mutex_unlock(&rq->lock);
+    pthread_mutex_unlock(&manager->rd.lock);
+
+    LOG(LOG_LEVEL_DEBUG, "Admitted %s: runtime %lu, deadline %lu, period %lu us on CPU %d",
+        task->name, runtime, deadline, period, home);
+    return 0;
+}
+
+// Give back an admitted task's bandwidth to the CPU it was charged to
+static void dl_release_bw(dl_manager_t *manager, dl_task_t *task) {
+    pthread_mutex_lock(&manager->rd.lock);
+    dl_rq_t *rq = &manager->cpus[task->bw_cpu].dl_rq;
+    pthread_mutex_lock(&rq->lock);
+    rq->this_bw -= task->dl_bw;
+    pthread_mutex_unlock(&rq->lock);
+    manager->rd.total_bw -= task->dl_bw;
+    task->admitted = false;
+    pthread_mutex_unlock(&manager->rd.lock);
+}
+
+// Constant Bandwidth Server
+//
+// A task may use dl_runtime every dl_period.  On wakeup it keeps its
+// current (runtime, deadline) only if running the remaining budget
+// before the deadline would not exceed its reserved bandwidth; otherwise
+// it gets a fresh budget and deadline.  When the budget runs out the
+// task is throttled until the start of its next period, so an overrun
+// costs its own deadlines and nobody else's.
+static bool dl_entity_overflow(const dl_task_t *task, uint64_t now) {
+    unsigned __int128 left = (unsigned __int128)task->dl_deadline * (uint64_t)task->runtime;
+    unsigned __int128 right = (unsigned __int128)(task->deadline - now) * task->dl_runtime;
+    return right < left;
+}
+
+static void update_dl_entity(dl_task_t *task, uint64_t now) {
+    if (task->runtime <= 0 || dl_time_before(task->deadline, now) ||
+        dl_entity_overflow(task, now)) {
+        task->deadline = now + task->dl_deadline;
+        task->runtime = (int64_t)task->dl_runtime;
+    }
+}
+
+static void replenish_dl_entity(dl_task_t *task, uint64_t now) {
+    while (task->runtime <= 0) {
+        task->deadline += task->dl_period;
+        task->runtime += (int64_t)task->dl_runtime;
+    }
+    // Lagging too far behind: restart from now
+    if (dl_time_before(task->deadline, now)) {
+        task->deadline = now + task->dl_deadline;
+        task->runtime = (int64_t)task->dl_runtime;
+    }
+}
+
+// Runqueue Operations (rq lock held)
+static void __enqueue_dl_task(dl_rq_t *rq, dl_task_t *task) {
+    task->node.key = task->deadline;
+    rb_insert_cached(&rq->root, &task->node);
+    rq->nr_running++;
+    task->state = DL_READY;
+}
+
+static void __dequeue_dl_task(dl_rq_t *rq, dl_task_t *task) {
+    rb_erase_cached(&rq->root, &task->node);
+    rq->nr_running--;
+}
+
+static void __arm_dl_timer(dl_rq_t *rq, dl_task_t *task, uint64_t expires) {
+    task->timer.key = expires;
+    rb_insert_cached(&rq->timers, &task->timer);
+}
+
+// Earliest deadline on the CPU, running or queued; false if none
+static bool dl_rq_earliest(const dl_rq_t *rq, uint64_t *dl) {
+    dl_task_t *first = dl_first(rq);
+
+    if (rq->curr && (!first || !dl_time_before(first->deadline, rq->curr->deadline)))
+        *dl = rq->curr->deadline;
+    else if (first)
+        *dl = first->deadline;
+    else
+        return false;
+    return true;
+}
+
+// Would a task with deadline dl be the earliest here?
+static bool dl_rq_later_than(const dl_rq_t *rq, uint64_t dl) {
+    uint64_t earliest;
+    return !dl_rq_earliest(rq, &earliest) || dl_time_before(dl, earliest);
+}
+
+// Publish the CPU's earliest deadline and overload state
+static void update_dl_rq(dl_manager_t *manager, dl_cpu_t *cpu) {
+    dl_rq_t *rq = &cpu->dl_rq;
+    bool overloaded = rq->nr_running && rq->curr;
+    uint64_t earliest;
+
+    if (dl_rq_earliest(rq, &earliest))
+        cpudl_set(&manager->rd.cpudl, (int)cpu->id, earliest);
+    else
+        cpudl_clear(&manager->rd.cpudl, (int)cpu->id);
+
+    if (overloaded != rq->overloaded) {
+        rq->overloaded = overloaded;
+        if (overloaded)
+            atomic_fetch_or(&manager->rd.dlo_mask, 1ULL << cpu->id);
+        else
+            atomic_fetch_and(&manager->rd.dlo_mask, ~(1ULL << cpu->id));
+    }
+}
+
+static void double_dl_rq_lock(dl_cpu_t *a, dl_cpu_t *b) {
+    if (a->id > b->id) {
+        dl_cpu_t *tmp = a;
+        a = b;
+        b = tmp;
+    }
+    pthread_mutex_lock(&a->dl_rq.lock);
+    pthread_mutex_lock(&b->dl_rq.lock);
+}
+
+static void double_dl_rq_unlock(dl_cpu_t *a, dl_cpu_t *b) {
+    pthread_mutex_unlock(&a->dl_rq.lock);
+    pthread_mutex_unlock(&b->dl_rq.lock);
+}
+
+// Find Later CPU: a free CPU, or the one running the latest deadline,
+// preferring the task's previous CPU; -1 if every CPU runs earlier work
+static int find_later_cpu(dl_manager_t *manager, uint64_t dl, int prev_cpu) {
+    uint64_t later;
+
+    if (!cpudl_find(&manager->rd.cpudl, dl, &later))
+        return -1;
+    if (prev_cpu >= 0 && (later >> prev_cpu) & 1)
+        return prev_cpu;
+    return __builtin_ctzll(later);
+}
+
+// Move a queued task between CPUs (both rq locks held)
+static void move_dl_task(dl_manager_t *manager, dl_cpu_t *src, dl_cpu_t *dst, dl_task_t *task) {
+    __dequeue_dl_task(&src->dl_rq, task);
+    task->cpu = (int)dst->id;
+    __enqueue_dl_task(&dst->dl_rq, task);
+    update_dl_rq(manager, src);
+    update_dl_rq(manager, dst);
+    manager->stats.migrations++;
+
+    LOG(LOG_LEVEL_DEBUG, "Migrated %s (deadline %lu) from CPU %u to CPU %u",
+        task->name, task->deadline, src->id, dst->id);
+}
+
+// Push: send the earliest task waiting behind current to a CPU whose
+// deadlines are all later.  Returns true if a task moved.
+static bool push_dl_task(dl_manager_t *manager, dl_cpu_t *cpu) {
+    dl_rq_t *rq = &cpu->dl_rq;
+
+    pthread_mutex_lock(&rq->lock);
+    dl_task_t *task = rq->overloaded ? dl_first(rq) : NULL;
+    uint64_t dl = task ? task->deadline : 0;
+    int prev_cpu = task ? task->cpu : -1;
+    pthread_mutex_unlock(&rq->lock);
+
+    if (!task)
+        return false;
+
+    int target = find_later_cpu(manager, dl, prev_cpu);
+    if (target < 0 || target == (int)cpu->id)
+        return false;
+
+    // Recheck under both locks
+    dl_cpu_t *dst = &manager->cpus[target];
+    bool moved = false;
+    double_dl_rq_lock(cpu, dst);
+    task = rq->overloaded ? dl_first(rq) : NULL;
+    if (task && dl_rq_later_than(&dst->dl_rq, task->deadline)) {
+        move_dl_task(manager, cpu, dst, task);
+        moved = true;
+    }
+    double_dl_rq_unlock(cpu, dst);
+    return moved;
+}
+
+// Pull: this CPU's earliest deadline moved later; take waiting tasks
+// that are now earlier than anything here
+static bool pull_dl_task(dl_manager_t *manager, dl_cpu_t *cpu) {
+    uint64_t dlo = atomic_load(&manager->rd.dlo_mask) & ~(1ULL << cpu->id);
+    bool pulled = false;
+
+    while (dlo) {
+        dl_cpu_t *src = &manager->cpus[__builtin_ctzll(dlo)];
+        dlo &= dlo - 1;
+
+        double_dl_rq_lock(cpu, src);
+        dl_task_t *task = src->dl_rq.overloaded ? dl_first(&src->dl_rq) : NULL;
+
+        // Leave tasks that beat src's current: src will switch to them
+        if (task && dl_rq_later_than(&cpu->dl_rq, task->deadline) &&
+            !dl_time_before(task->deadline, src->dl_rq.curr->deadline)) {
+            move_dl_task(manager, src, cpu, task);
+            pulled = true;
+        }
+        double_dl_rq_unlock(cpu, src);
+    }
+    return pulled;
+}
+
+// Job Release: a new job arrives, the CBS wakeup rule applies and the
+// task is queued where it can run soonest
+static void dl_task_wakeup(dl_manager_t *manager, dl_task_t *task, uint64_t now) {
+    task->job_left = task->job_exec;
+    task->job_deadline = task->job_release + task->dl_deadline;
+    update_dl_entity(task, now);
+
+    int target = task->cpu;
+    if (manager->global) {
+        int later = find_later_cpu(manager, task->deadline, task->cpu);
+        if (later >= 0)
+            target = later;
+    }
+
+    dl_cpu_t *cpu = &manager->cpus[target];
+    pthread_mutex_lock(&cpu->dl_rq.lock);
+    task->cpu = target;
+    __enqueue_dl_task(&cpu->dl_rq, task);
+    update_dl_rq(manager, cpu);
+    pthread_mutex_unlock(&cpu->dl_rq.lock);
+}
+
+// Charge the running task up to now: finish its job or throttle it
+static void update_curr_dl(dl_manager_t *manager, dl_rq_t *rq, uint64_t now) {
+    dl_task_t *curr = rq->curr;
+    if (!curr)
+        return;
+
+    uint64_t delta = now - rq->exec_start;
+    rq->exec_start = now;
+    curr->runtime -= (int64_t)delta;
+    curr->sum_exec += delta;
+    curr->job_left = curr->job_left > delta ? curr->job_left - delta : 0;
+
+    if (!curr->job_left) {
+        uint64_t tardiness = dl_time_before(curr->job_deadline, now) ? now - curr->job_deadline : 0;
+
+        curr->jobs_done++;
+        manager->stats.jobs++;
+        if (tardiness) {
+            curr->jobs_missed++;
+            manager->stats.missed++;
+            if (tardiness > curr->max_tardiness)
+                curr->max_tardiness = tardiness;
+            if (tardiness > manager->stats.max_tardiness)
+                manager->stats.max_tardiness = tardiness;
+        }
+
+        curr->job_release += curr->dl_period;
+        if (dl_time_before(now, curr->job_release)) {
+            // Sleep until the next release
+            curr->state = DL_SLEEPING;
+            __arm_dl_timer(rq, curr, curr->job_release);
+            rq->curr = NULL;
+            return;
+        }
+
+        // Already released: keep going on the current budget
+        curr->job_left = curr->job_exec;
+        curr->job_deadline = curr->job_release + curr->dl_deadline;
+    }
+
+    if (curr->runtime <= 0) {
+        uint64_t next_period = curr->deadline - curr->dl_deadline + curr->dl_period;
+
+        curr->nr_throttled++;
+        manager->stats.throttles++;
+        rq->curr = NULL;
+        if (dl_time_before(now, next_period)) {
+            curr->state = DL_THROTTLED;
+            __arm_dl_timer(rq, curr, next_period);
+        } else {
+            replenish_dl_entity(curr, now);
+            __enqueue_dl_task(rq, curr);
+        }
+    }
+}
+
+// Run Slice: account the running task, fire due timers, and pick the
+// earliest deadline.  Returns when this CPU next needs attention.
+static uint64_t dl_cpu_tick(dl_manager_t *manager, dl_cpu_t *cpu, uint64_t now) {
+    dl_rq_t *rq = &cpu->dl_rq;
+    dl_task_t *wake = NULL, *task;
+
+    pthread_mutex_lock(&rq->lock);
+    update_curr_dl(manager, rq, now);
+
+    // Replenish throttled tasks in place; releases may go anywhere
+    while ((task = dl_first_timer(rq)) && !dl_time_before(now, task->timer.key)) {
+        rb_erase_cached(&rq->timers, &task->timer);
+        if (task->state == DL_THROTTLED) {
+            replenish_dl_entity(task, now);
+            __enqueue_dl_task(rq, task);
+            manager->stats.replenishments++;
+        } else {
+            task->wake_next = wake;
+            wake = task;
+        }
+    }
+    update_dl_rq(manager, cpu);
+    pthread_mutex_unlock(&rq->lock);
+
+    for (; wake; wake = task) {
+        task = wake->wake_next;
+        dl_task_wakeup(manager, wake, now);
+    }
+
+    // Preempt for an earlier deadline
+    pthread_mutex_lock(&rq->lock);
+    task = dl_first(rq);
+    if (rq->curr && task && dl_time_before(task->deadline, rq->curr->deadline)) {
+        __enqueue_dl_task(rq, rq->curr);
+        rq->curr = NULL;
+        manager->stats.preemptions++;
+    }
+    update_dl_rq(manager, cpu);
+    pthread_mutex_unlock(&rq->lock);
+
+    if (!rq->curr) {
+        if (manager->global)
+            pull_dl_task(manager, cpu);
+
+        pthread_mutex_lock(&rq->lock);
+        task = dl_first(rq);
+        if (task) {
+            __dequeue_dl_task(rq, task);
+            task->state = DL_RUNNING;
+            rq->curr = task;
+            rq->exec_start = now;
+            update_dl_rq(manager, cpu);
+        }
+        pthread_mutex_unlock(&rq->lock);
+    }
+
+    // Whatever still waits behind current may run elsewhere
+    if (rq->curr && manager->global) {
+        while (push_dl_task(manager, cpu))
+            ;
+    }
+
+    // Next event: budget or job exhausted, or a timer
+    uint64_t next = UINT64_MAX;
+    pthread_mutex_lock(&rq->lock);
+    if (rq->curr) {
+        uint64_t left = (uint64_t)(rq->curr->runtime > 0 ? rq->curr->runtime : 0);
+        next = now + (left < rq->curr->job_left ? left : rq->curr->job_left);
+    }
+    if ((task = dl_first_timer(rq)) && task->timer.key < next)
+        next = task->timer.key;
+    pthread_mutex_unlock(&rq->lock);
+    return next;
+}
+
+// Idle with work queued, or a queued task beats current: the
+// reschedule IPI a wakeup or migration would send
+static bool dl_need_resched(dl_cpu_t *cpu) {
+    dl_rq_t *rq = &cpu->dl_rq;
+
+    pthread_mutex_lock(&rq->lock);
+    dl_task_t *first = dl_first(rq);
+    bool resched = first && (!rq->curr || dl_time_before(first->deadline, rq->curr->deadline));
+    pthread_mutex_unlock(&rq->lock);
+    return resched;
+}
+
+// Start Task: first job released at the given time.  The manager owns
+// the task from here on.  With MAX_DL_TASKS already started it is
+// rejected with -ENOSPC instead: its bandwidth is released and the
+// caller keeps it.
+int start_dl_task(dl_manager_t *manager, dl_task_t *task, uint64_t release) {
+    if (!manager || !task || !task->admitted) return -EINVAL;
+
+    pthread_mutex_lock(&manager->manager_lock);
+    if (manager->nr_tasks == MAX_DL_TASKS) {
+        pthread_mutex_unlock(&manager->manager_lock);
+        dl_release_bw(manager, task);
+        manager->stats.rejected++;
+        LOG(LOG_LEVEL_WARN, "Rejected %s: %d tasks already started",
+            task->name, MAX_DL_TASKS);
+        return -ENOSPC;
+    }
+    manager->tasks[manager->nr_tasks++] = task;
+    pthread_mutex_unlock(&manager->manager_lock);
+
+    dl_rq_t *rq = &manager->cpus[task->cpu].dl_rq;
+    pthread_mutex_lock(&rq->lock);
+    task->state = DL_SLEEPING;
+    task->job_release = release;
+    task->runtime = 0;
+    __arm_dl_timer(rq, task, release);
+    pthread_mutex_unlock(&rq->lock);
+
+    manager->cpus[task->cpu].next_event = manager->clock;
+    return 0;
+}
+
+// Run Simulation: event-driven virtual time across all CPUs
+void run_simulation(dl_manager_t *manager, uint64_t duration) {
+    if (!manager) return;
+
+    uint64_t end = manager->clock + duration;
+    for (;;) {
+        uint64_t now = UINT64_MAX;
+        for (size_t i = 0; i < manager->nr_cpus; i++) {
+            if (manager->cpus[i].next_event < now)
+                now = manager->cpus[i].next_event;
+        }
+        if (now > end)
+            break;
+        manager->clock = now;
+
+        // Run every CPU that is due or was handed earlier work
+        bool again = true;
+        while (again) {
+            again = false;
+            for (size_t i = 0; i < manager->nr_cpus; i++) {
+                dl_cpu_t *cpu = &manager->cpus[i];
+                if (cpu->next_event > now && !dl_need_resched(cpu))
+                    continue;
+                cpu->next_event = dl_cpu_tick(manager, cpu, now);
+                again = true;
+            }
+        }
+    }
+
+    // Account the partial slices up to the end
+    manager->clock = end;
+    for (size_t i = 0; i < manager->nr_cpus; i++) {
+        dl_rq_t *rq = &manager->cpus[i].dl_rq;
+        pthread_mutex_lock(&rq->lock);
+        update_curr_dl(manager, rq, end);
+        pthread_mutex_unlock(&rq->lock);
+    }
+}
+
+// Print Deadline Statistics
+void print_dl_stats(dl_manager_t *manager) {
+    if (!manager) return;
+
+    printf("\nDeadline Scheduler Results (%s EDF, %zu CPUs, %.2f s):\n",
+           manager->global ? "global" : "partitioned", manager->nr_cpus,
+           manager->clock / 1e6);
+    printf("-------------------------\n");
+    printf("Admitted Bandwidth: %.1f%% of %.0f%%\n",
+           100.0 * manager->rd.total_bw / BW_UNIT,
+           100.0 * manager->rd.bw * manager->nr_cpus / BW_UNIT);
+    printf("Rejected Tasks:     %lu\n", manager->stats.rejected);
+    printf("Jobs Completed:     %lu\n", manager->stats.jobs);
+    printf("Missed Deadlines:   %lu\n", manager->stats.missed);
+    printf("Max Tardiness:      %lu us\n", manager->stats.max_tardiness);
+    printf("Throttle Events:    %lu\n", manager->stats.throttles);
+    printf("Replenishments:     %lu\n", manager->stats.replenishments);
+    printf("Migrations:         %lu\n", manager->stats.migrations);
+    printf("Preemptions:        %lu\n", manager->stats.preemptions);
+
+    printf("\n  %-16s %20s %6s %6s %6s %9s %6s %4s\n",
+           "Task", "runtime/dl/period", "bw", "jobs", "missed", "tardy us", "thrtl", "cpu");
+    for (size_t i = 0; i < manager->nr_tasks; i++) {
+        dl_task_t *task = manager->tasks[i];
+        char params[32];
+        snprintf(params, sizeof(params), "%lu/%lu/%lu",
+                 task->dl_runtime, task->dl_deadline, task->dl_period);
+        printf("  %-16s %20s %5.1f%% %6lu %6lu %9lu %6lu %4d\n",
+               task->name, params, 100.0 * task->dl_bw / BW_UNIT, task->jobs_done,
+               task->jobs_missed, task->max_tardiness, task->nr_throttled, task->cpu);
+    }
+}
+
+// Destroy Deadline Task
+void destroy_dl_task(dl_task_t *task) {
+    free(task);
+}
+
+// Destroy Deadline Manager (started tasks belong to the manager)
+void destroy_dl_manager(dl_manager_t *manager) {
+    if (!manager) return;
+
+    for (size_t i = 0; i < manager->nr_tasks; i++) {
+        destroy_dl_task(manager->tasks[i]);
+    }
+
+    for (size_t i = 0; i < manager->nr_cpus; i++) {
+        pthread_mutex_destroy(&manager->cpus[i].dl_rq.lock);
+    }
+
+    pthread_mutex_destroy(&manager->rd.cpudl.lock);
+    pthread_mutex_destroy(&manager->rd.lock);
+    pthread_mutex_destroy(&manager->manager_lock);
+    free(manager);
+    LOG(LOG_LEVEL_DEBUG, "Destroyed deadline manager");
+}
+
+// Demonstrate Deadline Scheduler
+void demonstrate_dl_scheduler(void) {
+    printf("Starting deadline scheduler demonstration...\n");
+
+    dl_manager_t *manager = create_dl_manager(4, true);
+    if (!manager) return;
+
+    // A media pipeline: 60 fps video, 5 ms audio, a compositor that must
+    // finish well inside its frame, and a filter that overruns its budget
+    struct {
+        const char *name;
+        uint64_t runtime, deadline, period, exec;
+    } pipeline[] = {
+        { "video_decode",   5000, 16666, 16666,  4500 },
+        { "audio_mix",       500,  5000,  5000,   400 },
+        { "compositor",     3000,  8333, 16666,  2800 },
+        { "camera_isp",     8000, 33333, 33333,  7000 },
+        { "runaway_filter", 2000, 10000, 10000,  9000 },
+    };
+
+    for (size_t i = 0; i < sizeof(pipeline) / sizeof(pipeline[0]); i++) {
+        dl_task_t *task = create_dl_task(pipeline[i].name, pipeline[i].exec);
+        if (!task) continue;
+        if (sched_setattr_dl(manager, task, pipeline[i].runtime,
+                             pipeline[i].deadline, pipeline[i].period) != 0 ||
+            start_dl_task(manager, task, 0) != 0) {
+            destroy_dl_task(task);
+        }
+    }
+
+    // Fill the rest with encoders until admission control says no
+    for (int i = 0; ; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "encoder_%d", i);
+        dl_task_t *task = create_dl_task(name, 5500);
+        if (!task) break;
+        if (sched_setattr_dl(manager, task, 6000, 20000, 20000) != 0 ||
+            start_dl_task(manager, task, (uint64_t)i * 1000) != 0) {
+            destroy_dl_task(task);
+            break;
+        }
+    }
+
+    run_simulation(manager, SIM_DURATION);
+    print_dl_stats(manager);
+    destroy_dl_manager(manager);
+}
+
+// Benchmark: global vs partitioned EDF on random task sets
+
+#define BENCH_DURATION     5000000  // us of virtual time
+#define BENCH_MIN_PERIOD   1000
+#define BENCH_MAX_PERIOD   100000
+#define BENCH_MAX_UTIL_PCT 60       // largest single reservation
+#define BENCH_MAX_REJECTS  64       // partitioned: give up filling after this
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline uint64_t bench_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+// Admit implicit-deadline tasks until load_pct of the machine is
+// reserved; every job uses exactly its runtime.  Partitioned admission
+// can turn away a task no single CPU fits, so that mode keeps drawing
+// until BENCH_MAX_REJECTS in a row fail and may stop short of load_pct.
+static void bench_run(size_t nr_cpus, unsigned int load_pct, bool global) {
+    uint64_t seed = 0x2545f4914f6cdd1dULL ^ (nr_cpus * 131 + load_pct);
+    dl_manager_t *manager = create_dl_manager(nr_cpus, global);
+    if (!manager) return;
+
+    uint64_t target_bw = BW_UNIT * nr_cpus * load_pct / 100;
+    unsigned int misfits = 0;
+    while (manager->rd.total_bw < target_bw && manager->nr_tasks < MAX_DL_TASKS) {
+        uint64_t period = BENCH_MIN_PERIOD + bench_rand(&seed) % (BENCH_MAX_PERIOD - BENCH_MIN_PERIOD);
+        uint64_t util = 5 + bench_rand(&seed) % (BENCH_MAX_UTIL_PCT - 5);
+        uint64_t runtime = period * util / 100;
+        dl_task_t *task = create_dl_task("bench", runtime);
+        if (!task)
+            break;
+        if (sched_setattr_dl(manager, task, runtime, period, period) != 0) {
+            destroy_dl_task(task);
+            if (global || ++misfits >= BENCH_MAX_REJECTS)
+                break;
+            continue;
+        }
+        misfits = 0;
+        if (start_dl_task(manager, task, bench_rand(&seed) % period) != 0) {
+            destroy_dl_task(task);
+            break;
+        }
+    }
+
+    double start = bench_now();
+    run_simulation(manager, BENCH_DURATION);
+    double elapsed = bench_now() - start;
+
+    printf("  %2zu CPUs %3u%% %-11s %3zu tasks (%3.0f%% admitted)  jobs %7lu  missed %5.2f%%"
+           "  max tardy %6lu us  migr %6lu  %4.0f ns/job\n",
+           nr_cpus, load_pct, global ? "global" : "partitioned", manager->nr_tasks,
+           100.0 * manager->rd.total_bw / (BW_UNIT * nr_cpus),
+           manager->stats.jobs, manager->stats.jobs ? 100.0 * manager->stats.missed / manager->stats.jobs : 0.0,
+           manager->stats.max_tardiness, manager->stats.migrations,
+           elapsed * 1e9 / (manager->stats.jobs ? manager->stats.jobs : 1));
+    destroy_dl_manager(manager);
+}
+
+static int run_benchmark(void) {
+    static const size_t cpus[] = { 16, 32 };
+    static const unsigned int loads[] = { 70, 90 };
+
+    current_log_level = LOG_LEVEL_ERROR;
+    printf("EDF benchmark (%.0f s virtual, periods %d-%d us, per-task util <= %d%%)\n",
+           BENCH_DURATION / 1e6, BENCH_MIN_PERIOD, BENCH_MAX_PERIOD, BENCH_MAX_UTIL_PCT);
+    for (size_t i = 0; i < sizeof(cpus) / sizeof(cpus[0]); i++) {
+        for (size_t j = 0; j < sizeof(loads) / sizeof(loads[0]); j++) {
+            bench_run(cpus[i], loads[j], false);
+            bench_run(cpus[i], loads[j], true);
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        return run_benchmark();
+
+    // Set log level
+    current_log_level = LOG_LEVEL_INFO;
+
+    // Run demonstration
+    demonstrate_dl_scheduler();
+
+    return 0;
+}
@@ -0,0 +1,235 @@
+/*
+ * Discrete-Event Simulation Core
+ * Shared by core_sim.c, rt_sim.c, alarmtimer_sim.c, hrtimer_sim.c and
+ * clock_sim.c
+ *
+ * The threaded simulators model time with usleep() and time(NULL), so a
+ * run takes as long as what it simulates and no two runs agree.  Here
+ * time is a virtual clock in microseconds that jumps straight to the
+ * next pending event.  Events live in a binary min-heap keyed by
+ * (time, seq): seq is a per-simulation counter, so events due at the
+ * same instant fire in the order they were scheduled rather than in
+ * whatever order the heap happens to hold them.  Together with the
+ * seeded RNG below, a run is a pure function of its seed.
+ *
+ * There is no cancel.  A handler that re-arms (a CPU whose slice is cut
+ * short) bumps a generation number kept by the caller and passes it as
+ * the event's data; stale events compare it and return.
+ */
+
+#ifndef _DES_SIM_H
+#define _DES_SIM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DES_INITIAL_EVENTS  64
+#define DES_DEFAULT_SEED    1
+
+struct des_sim;
+
+typedef void (*des_event_fn)(struct des_sim *sim, void *arg, uint64_t data);
+
+struct des_event {
+    uint64_t time;                  /* us */
+    uint64_t seq;
+    des_event_fn fn;
+    void *arg;
+    uint64_t data;
+};
+
+struct des_sim {
+    uint64_t now;                   /* us */
+    uint64_t seq;
+    uint64_t rng;
+    struct des_event *heap;
+    size_t nr_events;
+    size_t capacity;
+    uint64_t nr_fired;
+    bool stopped;
+};
+
+/* Options of a simulator that runs either mode */
+struct des_options {
+    bool threaded;
+    uint64_t seed;
+    uint64_t duration_us;
+};
+
+/* splitmix64: spreads small seeds over the whole state */
+static inline uint64_t des_mix_seed(uint64_t seed)
+{
+    uint64_t z = seed + 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    return z ? z : 0x9e3779b97f4a7c15ULL;
+}
+
+static inline bool des_init(struct des_sim *sim, uint64_t seed)
+{
+    memset(sim, 0, sizeof(*sim));
+    sim->heap = malloc(DES_INITIAL_EVENTS * sizeof(*sim->heap));
+    if (!sim->heap)
+        return false;
+    sim->capacity = DES_INITIAL_EVENTS;
+    sim->rng = des_mix_seed(seed);
+    return true;
+}
+
+static inline void des_destroy(struct des_sim *sim)
+{
+    free(sim->heap);
+    sim->heap = NULL;
+    sim->nr_events = sim->capacity = 0;
+}
+
+/* xorshift64* */
+static inline uint64_t des_rand(struct des_sim *sim)
+{
+    uint64_t x = sim->rng;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    sim->rng = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+/* Uniform in [0, n), n > 0 */
+static inline uint64_t des_rand_range(struct des_sim *sim, uint64_t n)
+{
+    return (uint64_t)(((unsigned __int128)des_rand(sim) * n) >> 64);
+}
+
+static inline bool des_event_before(const struct des_event *a, const struct des_event *b)
+{
+    return a->time < b->time || (a->time == b->time && a->seq < b->seq);
+}
+
+/* Schedule fn at an absolute time; the past means now */
+static inline bool des_schedule_at(struct des_sim *sim, uint64_t time, des_event_fn fn,
+                                   void *arg, uint64_t data)
+{
+    if (sim->nr_events == sim->capacity) {
+        size_t capacity = sim->capacity * 2;
+        struct des_event *heap = realloc(sim->heap, capacity * sizeof(*heap));
+        if (!heap)
+            return false;
+        sim->heap = heap;
+        sim->capacity = capacity;
+    }
+
+    struct des_event ev = {
+        .time = time > sim->now ? time : sim->now,
+        .seq = sim->seq++,
+        .fn = fn,
+        .arg = arg,
+        .data = data,
+    };
+
+    /* Sift up */
+    size_t i = sim->nr_events++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!des_event_before(&ev, &sim->heap[parent]))
+            break;
+        sim->heap[i] = sim->heap[parent];
+        i = parent;
+    }
+    sim->heap[i] = ev;
+    return true;
+}
+
+static inline bool des_schedule(struct des_sim *sim, uint64_t delay, des_event_fn fn,
+                                void *arg, uint64_t data)
+{
+    return des_schedule_at(sim, sim->now + delay, fn, arg, data);
+}
+
+static inline struct des_event des_pop(struct des_sim *sim)
+{
+    struct des_event top = sim->heap[0];
+    struct des_event last = sim->heap[--sim->nr_events];
+    size_t i = 0;
+
+    /* Sift the last event down from the root */
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= sim->nr_events)
+            break;
+        if (child + 1 < sim->nr_events &&
+            des_event_before(&sim->heap[child + 1], &sim->heap[child]))
+            child++;
+        if (!des_event_before(&sim->heap[child], &last))
+            break;
+        sim->heap[i] = sim->heap[child];
+        i = child;
+    }
+    if (sim->nr_events)
+        sim->heap[i] = last;
+    return top;
+}
+
+static inline void des_stop(struct des_sim *sim)
+{
+    sim->stopped = true;
+}
+
+/*
+ * Fire events due at or before end, then leave the clock at end.
+ * Returns false when a handler stopped the simulation first.
+ */
+static inline bool des_run_until(struct des_sim *sim, uint64_t end)
+{
+    sim->stopped = false;
+    while (sim->nr_events && sim->heap[0].time <= end && !sim->stopped) {
+        struct des_event ev = des_pop(sim);
+        sim->now = ev.time;
+        sim->nr_fired++;
+        ev.fn(sim, ev.arg, ev.data);
+    }
+    if (sim->stopped)
+        return false;
+    sim->now = end;
+    return true;
+}
+
+/*
+ * Parse the options shared by simulators with both modes:
+ *
+ *   --threaded        real pthreads and wall-clock time
+ *   --seed N          RNG seed for virtual time
+ *   --duration S      simulated seconds
+ */
+static inline bool des_parse_options(int argc, char **argv, struct des_options *opts,
+                                     uint64_t default_duration_us)
+{
+    opts->threaded = false;
+    opts->seed = DES_DEFAULT_SEED;
+    opts->duration_us = default_duration_us;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threaded") == 0) {
+            opts->threaded = true;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            opts->seed = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+            double seconds = strtod(argv[++i], NULL);
+            if (seconds <= 0) {
+                fprintf(stderr, "invalid duration: %s\n", argv[i]);
+                return false;
+            }
+            opts->duration_us = (uint64_t)(seconds * 1e6);
+        } else {
+            fprintf(stderr, "usage: %s [--bench] [--threaded] [--seed N] [--duration S]\n",
+                    argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif /* _DES_SIM_H */
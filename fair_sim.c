@@ -7,7 +7,13 @@
 #include <time.h>
 #include <errno.h>
 #include <unistd.h>
+#include <limits.h>
+#include <stddef.h>
 #include <math.h>
+#include <stdatomic.h>
+
+#include "pelt_sim.h"
+#include "sched_topology_sim.h"
 
 // Logging Macros
 #define LOG_LEVEL_DEBUG 0
@@ -23,6 +29,9 @@
     } \
 } while(0)
 
+#define container_of(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
 // Global Log Level
 static int current_log_level = LOG_LEVEL_INFO;
 
@@ -33,6 +42,13 @@ static int current_log_level = LOG_LEVEL_INFO;
 #define DEFAULT_WEIGHT    1024
 #define NICE_0_LOAD      1024
 
+// EEVDF Constants
+#define BASE_SLICE        3000000    // 3ms in ns, request size r_i
+#define TICK_NSEC         1000000    // 1ms in ns
+
+// Load Balancing Constants
+#define NR_MIGRATE        32         // tasks scanned per balance attempt
+
 // Process States
 typedef enum {
     TASK_RUNNING,
@@ -68,6 +84,13 @@ typedef struct task_struct {
     uint64_t exec_start;
     uint64_t sum_exec_runtime;
     uint64_t prev_sum_exec_runtime;
+    // EEVDF: virtual deadline, lag at dequeue and requested slice
+    uint64_t deadline;
+    uint64_t min_deadline;       // augmented: min deadline in this subtree
+    int64_t vlag;
+    uint64_t slice;
+    bool on_rq;
+    struct sched_avg avg;        // PELT load/utilisation of this task
     rb_node_t node;
     struct task_struct *next;
 } task_t;
@@ -75,9 +98,20 @@ typedef struct task_struct {
 // CFS Run Queue
 typedef struct {
     rb_node_t *rb_root;
+    rb_node_t *rb_leftmost;      // cached leftmost, smallest vruntime
     task_t *curr;
     unsigned int nr_running;
     uint64_t min_vruntime;
+    // Weighted sum of (vruntime - min_vruntime) and sum of weights over
+    // the queued entities; curr is folded in by avg_vruntime()
+    int64_t avg_vruntime;
+    int64_t avg_load;
+    bool eevdf;
+    struct sched_avg avg;        // PELT aggregate of the runqueue
+    // Published under lock for the load balancer to read without it
+    _Atomic unsigned int snap_nr_running;
+    _Atomic unsigned long snap_load;
+    _Atomic uint64_t snap_clock;
     uint64_t clock;
     pthread_mutex_t lock;
 } cfs_rq_t;
@@ -88,6 +122,7 @@ typedef struct {
     cfs_rq_t *cfs;
     uint64_t clock;
     bool online;
+    struct sched_domain *sd;     // lowest sched domain of this CPU
 } cpu_t;
 
 // CFS Statistics
@@ -107,6 +142,11 @@ typedef struct {
     bool load_balance;
     unsigned int balance_interval;
     bool track_stats;
+    bool eevdf;                  // pick by eligible earliest deadline
+    // Machine shape for the sched domains (0 = 1 / all CPUs)
+    unsigned int threads_per_core;
+    unsigned int cores_per_llc;
+    unsigned int llcs_per_node;
 } cfs_config_t;
 
 // CFS Manager
@@ -115,6 +155,8 @@ typedef struct {
     size_t nr_cpus;
     cfs_config_t config;
     cfs_stats_t stats;
+    struct cpu_topology topo;
+    struct sched_domain *sd[NR_CPUS];
     pthread_mutex_t manager_lock;
     pthread_t balance_thread;
     bool running;
@@ -136,14 +178,19 @@ task_t* rb_leftmost(rb_node_t *node);
 void rb_replace_node(cfs_rq_t *cfs, rb_node_t *old, rb_node_t *new);
 
 void update_curr(cfs_rq_t *cfs, uint64_t now);
+void update_load_avg(cfs_rq_t *cfs, task_t *se, uint64_t now);
 void update_min_vruntime(cfs_rq_t *cfs);
 uint64_t calc_delta_fair(uint64_t delta, unsigned int weight);
+uint64_t avg_vruntime(cfs_rq_t *cfs);
+bool entity_eligible(cfs_rq_t *cfs, task_t *se);
+task_t* pick_eevdf(cfs_rq_t *cfs);
 task_t* pick_next_task(cfs_rq_t *cfs);
 
 void enqueue_task(cpu_t *cpu, task_t *task);
 void dequeue_task(cpu_t *cpu, task_t *task);
 void schedule(cpu_t *cpu);
 
+void rebalance_domains(cfs_manager_t *manager, cpu_t *cpu);
 void load_balance(cfs_manager_t *manager);
 void* load_balancer(void *arg);
 void print_cfs_stats(cfs_manager_t *manager);
@@ -174,6 +221,11 @@ const char* get_task_state_string(task_state_t state) {
 
 // Create CFS Manager
 cfs_manager_t* create_cfs_manager(cfs_config_t config) {
+    if (config.nr_cpus == 0 || config.nr_cpus > NR_CPUS) {
+        LOG(LOG_LEVEL_ERROR, "Number of CPUs must be 1-%d", NR_CPUS);
+        return NULL;
+    }
+
     cfs_manager_t *manager = malloc(sizeof(cfs_manager_t));
     if (!manager) {
         LOG(LOG_LEVEL_ERROR, "Failed to allocate CFS manager");
@@ -186,6 +238,16 @@ cfs_manager_t* create_cfs_manager(cfs_config_t config) {
         return NULL;
     }
 
+    // Build the sched domain hierarchy from the machine shape
+    cpu_topology_init_uniform(&manager->topo, config.nr_cpus, config.threads_per_core,
+                              config.cores_per_llc, config.llcs_per_node);
+    if (!build_sched_domains(&manager->topo, manager->sd)) {
+        LOG(LOG_LEVEL_ERROR, "Failed to build sched domains");
+        free(manager->cpus);
+        free(manager);
+        return NULL;
+    }
+
     // Initialize CPUs
     for (unsigned int i = 0; i < config.nr_cpus; i++) {
         manager->cpus[i].id = i;
@@ -194,13 +256,16 @@ cfs_manager_t* create_cfs_manager(cfs_config_t config) {
             for (unsigned int j = 0; j < i; j++) {
                 free(manager->cpus[j].cfs);
             }
+            free_sched_domains(manager->sd, config.nr_cpus);
             free(manager->cpus);
             free(manager);
             return NULL;
         }
         pthread_mutex_init(&manager->cpus[i].cfs->lock, NULL);
+        manager->cpus[i].cfs->eevdf = config.eevdf;
         manager->cpus[i].clock = 0;
         manager->cpus[i].online = true;
+        manager->cpus[i].sd = manager->sd[i];
     }
 
     manager->nr_cpus = config.nr_cpus;
@@ -235,6 +300,12 @@ task_t* create_task(pid_t pid, const char *name, int nice) {
     task->exec_start = 0;
     task->sum_exec_runtime = 0;
     task->prev_sum_exec_runtime = 0;
+    task->deadline = 0;
+    task->min_deadline = 0;
+    task->vlag = 0;
+    task->slice = BASE_SLICE;
+    task->on_rq = false;
+    pelt_init_entity(&task->avg, task->weight);
     task->next = NULL;
 
     memset(&task->node, 0, sizeof(rb_node_t));
@@ -246,52 +317,399 @@ task_t* create_task(pid_t pid, const char *name, int nice) {
 }
 
 // Red-Black Tree Operations
+//
+// The timeline is ordered by vruntime.  Every node also carries the
+// minimum deadline found in its subtree (task->min_deadline) so that
+// pick_eevdf() can skip whole subtrees that cannot hold the earliest
+// eligible deadline.  Rotations and erase keep the augmented value in
+// step with the tree shape.
+static inline task_t *rb_task(rb_node_t *node) {
+    return container_of(node, task_t, node);
+}
+
+static inline bool deadline_before(uint64_t a, uint64_t b) {
+    return (int64_t)(a - b) < 0;
+}
+
+// Recompute the subtree minimum of one node; returns true if it changed
+static bool rb_augment_compute(rb_node_t *node) {
+    task_t *task = rb_task(node);
+    uint64_t min_deadline = task->deadline;
+
+    if (node->left && deadline_before(rb_task(node->left)->min_deadline, min_deadline))
+        min_deadline = rb_task(node->left)->min_deadline;
+    if (node->right && deadline_before(rb_task(node->right)->min_deadline, min_deadline))
+        min_deadline = rb_task(node->right)->min_deadline;
+
+    if (task->min_deadline == min_deadline)
+        return false;
+    task->min_deadline = min_deadline;
+    return true;
+}
+
+static void rb_rotate_left(cfs_rq_t *cfs, rb_node_t *x) {
+    rb_node_t *y = x->right;
+
+    x->right = y->left;
+    if (y->left)
+        y->left->parent = x;
+    y->parent = x->parent;
+    if (!x->parent)
+        cfs->rb_root = y;
+    else if (x == x->parent->left)
+        x->parent->left = y;
+    else
+        x->parent->right = y;
+    y->left = x;
+    x->parent = y;
+
+    // y now spans x's old subtree
+    rb_task(y)->min_deadline = rb_task(x)->min_deadline;
+    rb_augment_compute(x);
+}
+
+static void rb_rotate_right(cfs_rq_t *cfs, rb_node_t *x) {
+    rb_node_t *y = x->left;
+
+    x->left = y->right;
+    if (y->right)
+        y->right->parent = x;
+    y->parent = x->parent;
+    if (!x->parent)
+        cfs->rb_root = y;
+    else if (x == x->parent->right)
+        x->parent->right = y;
+    else
+        x->parent->left = y;
+    y->right = x;
+    x->parent = y;
+
+    rb_task(y)->min_deadline = rb_task(x)->min_deadline;
+    rb_augment_compute(x);
+}
+
+static rb_node_t *rb_next(rb_node_t *node) {
+    if (node->right) {
+        node = node->right;
+        while (node->left)
+            node = node->left;
+        return node;
+    }
+    while (node->parent && node == node->parent->right)
+        node = node->parent;
+    return node->parent;
+}
+
 void rb_insert(cfs_rq_t *cfs, task_t *task) {
     rb_node_t **new = &cfs->rb_root;
     rb_node_t *parent = NULL;
+    bool leftmost = true;
 
     while (*new) {
         parent = *new;
-        task_t *entry = container_of(parent, task_t, node);
+        task_t *entry = rb_task(parent);
 
-        if (task->vruntime < entry->vruntime)
+        if ((int64_t)(task->vruntime - entry->vruntime) < 0) {
             new = &parent->left;
-        else
+        } else {
             new = &parent->right;
+            leftmost = false;
+        }
     }
 
     task->node.parent = parent;
     task->node.left = NULL;
     task->node.right = NULL;
     task->node.color = RB_RED;
+    task->min_deadline = task->deadline;
     *new = &task->node;
 
+    if (leftmost)
+        cfs->rb_leftmost = &task->node;
+
+    // Propagate the new deadline towards the root
+    for (rb_node_t *n = parent; n && rb_augment_compute(n); n = n->parent)
+        ;
+
     // Rebalance tree
     rb_node_t *node = &task->node;
     while (node != cfs->rb_root && node->parent->color == RB_RED) {
-        if (node->parent == node->parent->parent->left) {
-            rb_node_t *uncle = node->parent->parent->right;
+        rb_node_t *gparent = node->parent->parent;
+
+        if (node->parent == gparent->left) {
+            rb_node_t *uncle = gparent->right;
             if (uncle && uncle->color == RB_RED) {
                 node->parent->color = RB_BLACK;
                 uncle->color = RB_BLACK;
-                node->parent->parent->color = RB_RED;
-                node = node->parent->parent;
+                gparent->color = RB_RED;
+                node = gparent;
             } else {
                 if (node == node->parent->right) {
                     node = node->parent;
-                    // Left rotate
+                    rb_rotate_left(cfs, node);
                 }
                 node->parent->color = RB_BLACK;
-                node->parent->parent->color = RB_RED;
-                // Right rotate
+                gparent->color = RB_RED;
+                rb_rotate_right(cfs, gparent);
             }
         } else {
-            // Mirror case
+            rb_node_t *uncle = gparent->left;
+            if (uncle && uncle->color == RB_RED) {
+                node->parent->color = RB_BLACK;
+                uncle->color = RB_BLACK;
+                gparent->color = RB_RED;
+                node = gparent;
+            } else {
+                if (node == node->parent->left) {
+                    node = node->parent;
+                    rb_rotate_right(cfs, node);
+                }
+                node->parent->color = RB_BLACK;
+                gparent->color = RB_RED;
+                rb_rotate_left(cfs, gparent);
+            }
         }
     }
     cfs->rb_root->color = RB_BLACK;
 }
 
+static void rb_transplant(cfs_rq_t *cfs, rb_node_t *u, rb_node_t *v) {
+    if (!u->parent)
+        cfs->rb_root = v;
+    else if (u == u->parent->left)
+        u->parent->left = v;
+    else
+        u->parent->right = v;
+    if (v)
+        v->parent = u->parent;
+}
+
+static void rb_erase_fixup(cfs_rq_t *cfs, rb_node_t *node, rb_node_t *parent) {
+    while (node != cfs->rb_root && (!node || node->color == RB_BLACK)) {
+        if (node == parent->left) {
+            rb_node_t *sibling = parent->right;
+            if (sibling->color == RB_RED) {
+                sibling->color = RB_BLACK;
+                parent->color = RB_RED;
+                rb_rotate_left(cfs, parent);
+                sibling = parent->right;
+            }
+            if ((!sibling->left || sibling->left->color == RB_BLACK) &&
+                (!sibling->right || sibling->right->color == RB_BLACK)) {
+                sibling->color = RB_RED;
+                node = parent;
+                parent = node->parent;
+            } else {
+                if (!sibling->right || sibling->right->color == RB_BLACK) {
+                    sibling->left->color = RB_BLACK;
+                    sibling->color = RB_RED;
+                    rb_rotate_right(cfs, sibling);
+                    sibling = parent->right;
+                }
+                sibling->color = parent->color;
+                parent->color = RB_BLACK;
+                if (sibling->right)
+                    sibling->right->color = RB_BLACK;
+                rb_rotate_left(cfs, parent);
+                node = cfs->rb_root;
+            }
+        } else {
+            rb_node_t *sibling = parent->left;
+            if (sibling->color == RB_RED) {
+                sibling->color = RB_BLACK;
+                parent->color = RB_RED;
+                rb_rotate_right(cfs, parent);
+                sibling = parent->left;
+            }
+            if ((!sibling->left || sibling->left->color == RB_BLACK) &&
+                (!sibling->right || sibling->right->color == RB_BLACK)) {
+                sibling->color = RB_RED;
+                node = parent;
+                parent = node->parent;
+            } else {
+                if (!sibling->left || sibling->left->color == RB_BLACK) {
+                    sibling->right->color = RB_BLACK;
+                    sibling->color = RB_RED;
+                    rb_rotate_left(cfs, sibling);
+                    sibling = parent->left;
+                }
+                sibling->color = parent->color;
+                parent->color = RB_BLACK;
+                if (sibling->left)
+                    sibling->left->color = RB_BLACK;
+                rb_rotate_right(cfs, parent);
+                node = cfs->rb_root;
+            }
+        }
+    }
+    if (node)
+        node->color = RB_BLACK;
+}
+
+void rb_erase(cfs_rq_t *cfs, task_t *task) {
+    rb_node_t *z = &task->node;
+    rb_node_t *child, *parent;
+    rb_color_t color = z->color;
+
+    if (cfs->rb_leftmost == z)
+        cfs->rb_leftmost = rb_next(z);
+
+    if (!z->left) {
+        child = z->right;
+        parent = z->parent;
+        rb_transplant(cfs, z, child);
+    } else if (!z->right) {
+        child = z->left;
+        parent = z->parent;
+        rb_transplant(cfs, z, child);
+    } else {
+        rb_node_t *successor = z->right;
+        while (successor->left)
+            successor = successor->left;
+        color = successor->color;
+        child = successor->right;
+        if (successor->parent == z) {
+            parent = successor;
+        } else {
+            parent = successor->parent;
+            rb_transplant(cfs, successor, child);
+            successor->right = z->right;
+            successor->right->parent = successor;
+        }
+        rb_transplant(cfs, z, successor);
+        successor->left = z->left;
+        successor->left->parent = successor;
+        successor->color = z->color;
+    }
+
+    // The successor moved onto this path, so recompute all the way up
+    for (rb_node_t *n = parent; n; n = n->parent)
+        rb_augment_compute(n);
+
+    if (color == RB_BLACK && cfs->rb_root)
+        rb_erase_fixup(cfs, child, parent);
+
+    z->parent = z->left = z->right = NULL;
+}
+
+task_t* rb_leftmost(rb_node_t *node) {
+    if (!node)
+        return NULL;
+    while (node->left)
+        node = node->left;
+    return rb_task(node);
+}
+
+// EEVDF Bookkeeping
+//
+// Virtual lag is measured against the load-weighted average vruntime V.
+// Keys are kept relative to min_vruntime so the weighted sum stays small.
+static inline int64_t entity_key(cfs_rq_t *cfs, task_t *se) {
+    return (int64_t)(se->vruntime - cfs->min_vruntime);
+}
+
+static void avg_vruntime_add(cfs_rq_t *cfs, task_t *se) {
+    cfs->avg_vruntime += entity_key(cfs, se) * (int64_t)se->weight;
+    cfs->avg_load += se->weight;
+}
+
+static void avg_vruntime_sub(cfs_rq_t *cfs, task_t *se) {
+    cfs->avg_vruntime -= entity_key(cfs, se) * (int64_t)se->weight;
+    cfs->avg_load -= se->weight;
+}
+
+// Rebase the weighted sum when min_vruntime moves forward by delta
+static inline void avg_vruntime_update(cfs_rq_t *cfs, int64_t delta) {
+    cfs->avg_vruntime -= cfs->avg_load * delta;
+}
+
+uint64_t avg_vruntime(cfs_rq_t *cfs) {
+    task_t *curr = cfs->curr;
+    int64_t avg = cfs->avg_vruntime;
+    int64_t load = cfs->avg_load;
+
+    if (curr && curr->on_rq) {
+        avg += entity_key(cfs, curr) * (int64_t)curr->weight;
+        load += curr->weight;
+    }
+
+    if (load) {
+        // Round towards negative infinity so V never overshoots
+        if (avg < 0)
+            avg -= load - 1;
+        avg /= load;
+    }
+    return cfs->min_vruntime + avg;
+}
+
+// An entity is eligible when its lag is non-negative: vruntime <= V.
+// Compared without the division: key * load <= sum(key_i * w_i).
+bool entity_eligible(cfs_rq_t *cfs, task_t *se) {
+    task_t *curr = cfs->curr;
+    int64_t avg = cfs->avg_vruntime;
+    int64_t load = cfs->avg_load;
+
+    if (curr && curr->on_rq) {
+        avg += entity_key(cfs, curr) * (int64_t)curr->weight;
+        load += curr->weight;
+    }
+    return avg >= entity_key(cfs, se) * load;
+}
+
+static void update_entity_lag(cfs_rq_t *cfs, task_t *se) {
+    int64_t limit = (int64_t)calc_delta_fair(
+        2 * se->slice > TICK_NSEC ? 2 * se->slice : TICK_NSEC, se->weight);
+    int64_t lag = (int64_t)(avg_vruntime(cfs) - se->vruntime);
+
+    if (lag > limit)
+        lag = limit;
+    else if (lag < -limit)
+        lag = -limit;
+    se->vlag = lag;
+}
+
+// Place a waking entity so that it keeps the lag it left with.  Adding
+// the entity shifts V, so the stored lag is inflated by (W + w) / W to
+// come out unchanged once the entity is part of the average.
+static void place_entity(cfs_rq_t *cfs, task_t *se, bool initial) {
+    uint64_t vruntime = avg_vruntime(cfs);
+    int64_t lag = 0;
+
+    if (cfs->nr_running) {
+        int64_t load = cfs->avg_load;
+
+        if (cfs->curr && cfs->curr->on_rq)
+            load += cfs->curr->weight;
+        lag = se->vlag * (load + (int64_t)se->weight);
+        if (!load)
+            load = 1;
+        lag /= load;
+    }
+    se->vruntime = vruntime - lag;
+
+    // Start new tasks with half a slice so they do not jump the queue
+    uint64_t vslice = calc_delta_fair(se->slice, se->weight);
+    if (initial)
+        vslice /= 2;
+    se->deadline = se->vruntime + vslice;
+}
+
+static void update_deadline(task_t *se) {
+    if ((int64_t)(se->vruntime - se->deadline) < 0)
+        return;
+    se->deadline = se->vruntime + calc_delta_fair(se->slice, se->weight);
+}
+
+static void __enqueue_entity(cfs_rq_t *cfs, task_t *se) {
+    avg_vruntime_add(cfs, se);
+    rb_insert(cfs, se);
+}
+
+static void __dequeue_entity(cfs_rq_t *cfs, task_t *se) {
+    rb_erase(cfs, se);
+    avg_vruntime_sub(cfs, se);
+}
+
 // Update Current Task
 void update_curr(cfs_rq_t *cfs, uint64_t now) {
     task_t *curr = cfs->curr;
@@ -303,7 +721,32 @@ void update_curr(cfs_rq_t *cfs, uint64_t now) {
     curr->vruntime += calc_delta_fair(delta_exec, curr->weight);
     curr->exec_start = now;
 
+    if (cfs->eevdf)
+        update_deadline(curr);
+
     update_min_vruntime(cfs);
+    update_load_avg(cfs, curr, now);
+}
+
+// Weight of everything runnable here, including curr
+static inline unsigned long cfs_rq_load_weight(cfs_rq_t *cfs) {
+    unsigned long load = (unsigned long)cfs->avg_load;
+    if (cfs->curr && cfs->curr->on_rq)
+        load += cfs->curr->weight;
+    return load;
+}
+
+// Update Load Average
+//
+// Bring the entity (if any) and the runqueue PELT signals up to now.
+// Must run before any state change so the elapsed time is accounted
+// with the state that actually held.
+void update_load_avg(cfs_rq_t *cfs, task_t *se, uint64_t now) {
+    if (se && se->avg.last_update_time)
+        pelt_update_entity(now, &se->avg, se->weight, se->on_rq,
+                           se == cfs->curr ? SCHED_CAPACITY_SCALE : 0);
+    pelt_update_rq(now, &cfs->avg, cfs_rq_load_weight(cfs), cfs->nr_running,
+                   cfs->curr ? SCHED_CAPACITY_SCALE : 0);
 }
 
 // Calculate Fair Delta
@@ -315,9 +758,87 @@ uint64_t calc_delta_fair(uint64_t delta, unsigned int weight) {
 
 // Update Minimum Virtual Runtime
 void update_min_vruntime(cfs_rq_t *cfs) {
-    task_t *leftmost = rb_leftmost(cfs->rb_root);
-    if (leftmost)
-        cfs->min_vruntime = leftmost->vruntime;
+    task_t *curr = cfs->curr;
+    uint64_t vruntime = cfs->min_vruntime;
+
+    if (curr) {
+        if (curr->on_rq)
+            vruntime = curr->vruntime;
+        else
+            curr = NULL;
+    }
+
+    if (cfs->rb_leftmost) {
+        task_t *leftmost = rb_task(cfs->rb_leftmost);
+        if (!curr || (int64_t)(leftmost->vruntime - vruntime) < 0)
+            vruntime = leftmost->vruntime;
+    }
+
+    // min_vruntime only moves forward
+    int64_t delta = (int64_t)(vruntime - cfs->min_vruntime);
+    if (delta > 0) {
+        avg_vruntime_update(cfs, delta);
+        cfs->min_vruntime = vruntime;
+    }
+}
+
+// Pick the eligible entity with the earliest virtual deadline.
+//
+// Walk down from the root: ineligible nodes send us left (everything to
+// their right has an even larger vruntime).  For an eligible node the
+// whole left subtree is eligible too, so its min_deadline tells us
+// whether the answer lives there without visiting it.  Finally descend
+// into the best left subtree following min_deadline.  O(log n).
+task_t* pick_eevdf(cfs_rq_t *cfs) {
+    rb_node_t *node = cfs->rb_root;
+    task_t *best = NULL;
+    task_t *best_left = NULL;
+
+    while (node) {
+        task_t *se = rb_task(node);
+
+        if (!entity_eligible(cfs, se)) {
+            node = node->left;
+            continue;
+        }
+
+        if (!best || deadline_before(se->deadline, best->deadline))
+            best = se;
+
+        if (node->left) {
+            task_t *left = rb_task(node->left);
+
+            if (!best_left || deadline_before(left->min_deadline, best_left->min_deadline))
+                best_left = left;
+
+            // The earliest deadline below this node is on the left
+            if (left->min_deadline == se->min_deadline)
+                break;
+        }
+
+        // This node holds the earliest deadline of its subtree
+        if (se->deadline == se->min_deadline)
+            break;
+
+        node = node->right;
+    }
+
+    if (!best_left || !deadline_before(best_left->min_deadline, best->deadline))
+        return best;
+
+    node = &best_left->node;
+    while (node) {
+        task_t *se = rb_task(node);
+
+        if (se->deadline == se->min_deadline)
+            return se;
+
+        if (node->left && rb_task(node->left)->min_deadline == se->min_deadline)
+            node = node->left;
+        else
+            node = node->right;
+    }
+    return best;
 }
 
 // Pick Next Task
@@ -325,27 +846,55 @@ task_t* pick_next_task(cfs_rq_t *cfs) {
     if (!cfs->rb_root)
         return NULL;
 
-    task_t *next = rb_leftmost(cfs->rb_root);
+    task_t *next = NULL;
+    if (cfs->eevdf)
+        next = pick_eevdf(cfs);
+    // CFS fallback: smallest vruntime from the cached leftmost
     if (!next)
-        return NULL;
+        next = rb_task(cfs->rb_leftmost);
 
-    rb_erase(cfs, next);
+    __dequeue_entity(cfs, next);
     return next;
 }
 
-// Enqueue Task
-void enqueue_task(cpu_t *cpu, task_t *task) {
-    if (!cpu || !task) return;
+// Publish the load balancer's view of this runqueue; caller holds lock
+static inline void cfs_rq_publish(cpu_t *cpu) {
+    cfs_rq_t *cfs = cpu->cfs;
 
-    pthread_mutex_lock(&cpu->cfs->lock);
+    atomic_store_explicit(&cfs->snap_nr_running, cfs->nr_running, memory_order_relaxed);
+    atomic_store_explicit(&cfs->snap_load, cfs->avg.load_avg, memory_order_relaxed);
+    atomic_store_explicit(&cfs->snap_clock, cpu->clock, memory_order_relaxed);
+}
+
+// Enqueue Task (caller holds cpu->cfs->lock)
+static void __enqueue_task(cpu_t *cpu, task_t *task) {
+    update_curr(cpu->cfs, cpu->clock);
+    update_load_avg(cpu->cfs, task, cpu->clock);
+
+    // New or migrated tasks bring their history with them
+    if (!task->avg.last_update_time)
+        pelt_attach_entity(&cpu->cfs->avg, &task->avg, task->weight);
 
     task->exec_start = cpu->clock;
-    if (task->vruntime < cpu->cfs->min_vruntime)
+    if (cpu->cfs->eevdf) {
+        place_entity(cpu->cfs, task, task->sum_exec_runtime == 0);
+    } else if ((int64_t)(task->vruntime - cpu->cfs->min_vruntime) < 0) {
         task->vruntime = cpu->cfs->min_vruntime;
+    }
 
-    rb_insert(cpu->cfs, task);
+    __enqueue_entity(cpu->cfs, task);
+    task->on_rq = true;
     cpu->cfs->nr_running++;
+    update_min_vruntime(cpu->cfs);
+}
 
+// Enqueue Task
+void enqueue_task(cpu_t *cpu, task_t *task) {
+    if (!cpu || !task) return;
+
+    pthread_mutex_lock(&cpu->cfs->lock);
+    __enqueue_task(cpu, task);
+    cfs_rq_publish(cpu);
     pthread_mutex_unlock(&cpu->cfs->lock);
 
     LOG(LOG_LEVEL_DEBUG, "Enqueued task %s on CPU %u", task->name, cpu->id);
@@ -357,8 +906,19 @@ void dequeue_task(cpu_t *cpu, task_t *task) {
 
     pthread_mutex_lock(&cpu->cfs->lock);
 
-    rb_erase(cpu->cfs, task);
+    update_curr(cpu->cfs, cpu->clock);
+    update_load_avg(cpu->cfs, task, cpu->clock);
+    if (cpu->cfs->eevdf)
+        update_entity_lag(cpu->cfs, task);
+
+    if (task == cpu->cfs->curr)
+        cpu->cfs->curr = NULL;
+    else
+        __dequeue_entity(cpu->cfs, task);
+    task->on_rq = false;
     cpu->cfs->nr_running--;
+    update_min_vruntime(cpu->cfs);
+    cfs_rq_publish(cpu);
 
     pthread_mutex_unlock(&cpu->cfs->lock);
 
@@ -373,23 +933,36 @@ void schedule(cpu_t *cpu) {
 
     // Update current task
     update_curr(cpu->cfs, cpu->clock);
+    update_load_avg(cpu->cfs, NULL, cpu->clock);
 
-    // Get next task
+    // Put the previous task back so it competes for the pick
     task_t *prev = cpu->cfs->curr;
-    task_t *next = pick_next_task(cpu->cfs);
-
     if (prev) {
-        // Re-enqueue previous task if still runnable
-        if (prev->state == TASK_RUNNING)
-            rb_insert(cpu->cfs, prev);
+        if (prev->state == TASK_RUNNING) {
+            __enqueue_entity(cpu->cfs, prev);
+        } else {
+            if (cpu->cfs->eevdf)
+                update_entity_lag(cpu->cfs, prev);
+            prev->on_rq = false;
+            cpu->cfs->nr_running--;
+        }
+        cpu->cfs->curr = NULL;
     }
 
-    // Switch to next task
-    cpu->cfs->curr = next;
+    // Get next task
+    task_t *next = pick_next_task(cpu->cfs);
+
+    // Switch to next task; its wait so far counts as runnable
     if (next)
+        update_load_avg(cpu->cfs, next, cpu->clock);
+    cpu->cfs->curr = next;
+    if (next) {
         next->exec_start = cpu->clock;
+        next->prev_sum_exec_runtime = next->sum_exec_runtime;
+    }
 
     cpu->clock += MINIMUM_TIMESLICE;
+    cfs_rq_publish(cpu);
 
     pthread_mutex_unlock(&cpu->cfs->lock);
 
@@ -399,58 +972,317 @@ void schedule(cpu_t *cpu) {
         next ? next->name : "idle");
 }
 
-// Load Balance
-void load_balance(cfs_manager_t *manager) {
-    if (!manager) return;
+// Detach Task (caller holds cpu->cfs->lock)
+//
+// Take a queued (not running) task off cpu for migration.  Its lag is
+// recorded and its PELT history detached so the destination can place
+// and attach it.  Under plain CFS the vruntime is made relative to this
+// runqueue and rebased onto the destination's in __attach_task().
+static void __detach_task(cpu_t *cpu, task_t *task) {
+    cfs_rq_t *cfs = cpu->cfs;
+
+    update_load_avg(cfs, task, cpu->clock);
+    if (cfs->eevdf)
+        update_entity_lag(cfs, task);
+
+    __dequeue_entity(cfs, task);
+    task->on_rq = false;
+    cfs->nr_running--;
+    pelt_detach_entity(&cfs->avg, &task->avg, task->weight);
+    if (!cfs->eevdf)
+        task->vruntime -= cfs->min_vruntime;
+    update_min_vruntime(cfs);
+}
 
-    pthread_mutex_lock(&manager->manager_lock);
+// Attach Task (caller holds cpu->cfs->lock)
+static void __attach_task(cpu_t *cpu, task_t *task) {
+    if (!cpu->cfs->eevdf)
+        task->vruntime += cpu->cfs->min_vruntime;
+    __enqueue_task(cpu, task);
+}
 
-    if (manager->config.track_stats)
-        manager->stats.load_balance_calls++;
+// Lock two runqueues in CPU order so concurrent balancers cannot deadlock
+static void double_rq_lock(cpu_t *a, cpu_t *b) {
+    if (a->id > b->id) {
+        cpu_t *tmp = a;
+        a = b;
+        b = tmp;
+    }
+    pthread_mutex_lock(&a->cfs->lock);
+    pthread_mutex_lock(&b->cfs->lock);
+}
 
-    // Simple load balancing: move tasks from busy to idle CPUs
-    for (size_t i = 0; i < manager->nr_cpus; i++) {
-        cpu_t *src_cpu = &manager->cpus[i];
-        if (!src_cpu->online) continue;
+static void double_rq_unlock(cpu_t *a, cpu_t *b) {
+    pthread_mutex_unlock(&a->cfs->lock);
+    pthread_mutex_unlock(&b->cfs->lock);
+}
 
-        pthread_mutex_lock(&src_cpu->cfs->lock);
-        unsigned int src_load = src_cpu->cfs->nr_running;
-        pthread_mutex_unlock(&src_cpu->cfs->lock);
+// Load Balancing
+//
+// Every CPU balances its own sched domains bottom-up and pulls work
+// towards itself.  Group and runqueue loads come from the snapshots each
+// runqueue publishes, so finding the busiest runqueue takes no locks;
+// only the source and destination are locked while tasks move.
 
-        if (src_load <= 1) continue;
+typedef enum {
+    MIGRATE_LOAD,                // move PELT load until the groups even out
+    MIGRATE_TASK                 // spare CPUs here: move a number of tasks
+} migration_type_t;
 
-        // Find least loaded CPU
-        cpu_t *dst_cpu = NULL;
-        unsigned int min_load = UINT_MAX;
+typedef struct {
+    unsigned long load;          // sum of PELT load_avg
+    unsigned long avg_load;      // load per SCHED_CAPACITY_SCALE of capacity
+    unsigned long capacity;
+    unsigned int nr_running;
+    unsigned int idle_cpus;
+    unsigned int weight;
+} sg_lb_stats_t;
 
-        for (size_t j = 0; j < manager->nr_cpus; j++) {
-            if (i == j) continue;
+typedef struct {
+    cpu_t *dst;
+    cpu_t *src;
+    struct sched_domain *sd;
+    migration_type_t type;
+    unsigned long imbalance;     // load or tasks, depending on type
+} lb_env_t;
+
+static inline unsigned int cpu_nr_running(cpu_t *cpu) {
+    return atomic_load_explicit(&cpu->cfs->snap_nr_running, memory_order_relaxed);
+}
 
-            cpu_t *cpu = &manager->cpus[j];
-            if (!cpu->online) continue;
+static inline unsigned long cpu_load(cpu_t *cpu) {
+    return atomic_load_explicit(&cpu->cfs->snap_load, memory_order_relaxed);
+}
 
-            pthread_mutex_lock(&cpu->cfs->lock);
-            unsigned int load = cpu->cfs->nr_running;
-            pthread_mutex_unlock(&cpu->cfs->lock);
+static void update_sg_lb_stats(cfs_manager_t *manager, struct sched_group *sg,
+                               sg_lb_stats_t *sgs) {
+    unsigned int i;
 
-            if (load < min_load) {
-                min_load = load;
-                dst_cpu = cpu;
-            }
+    memset(sgs, 0, sizeof(*sgs));
+    for_each_cpu(i, &sg->cpus) {
+        cpu_t *cpu = &manager->cpus[i];
+        if (!cpu->online)
+            continue;
+
+        unsigned int nr = cpu_nr_running(cpu);
+        sgs->load += cpu_load(cpu);
+        sgs->nr_running += nr;
+        if (!nr)
+            sgs->idle_cpus++;
+        sgs->capacity += SCHED_CAPACITY_SCALE;
+        sgs->weight++;
+    }
+    if (sgs->capacity)
+        sgs->avg_load = sgs->load * SCHED_CAPACITY_SCALE / sgs->capacity;
+}
+
+// Only one CPU per local group balances a domain: the first idle one,
+// or the group's first CPU if none is idle
+static bool should_we_balance(cfs_manager_t *manager, cpu_t *this_cpu,
+                              struct sched_domain *sd) {
+    struct sched_group *local = &sd->groups[sd->local_group];
+    unsigned int i;
+
+    for_each_cpu(i, &local->cpus) {
+        cpu_t *cpu = &manager->cpus[i];
+        if (cpu->online && !cpu_nr_running(cpu))
+            return cpu == this_cpu;
+    }
+    return local->first_cpu == this_cpu->id;
+}
+
+// Pick the group to pull from and size the imbalance; NULL if balanced
+static struct sched_group *find_busiest_group(cfs_manager_t *manager, lb_env_t *env) {
+    struct sched_domain *sd = env->sd;
+    struct sched_group *busiest = NULL;
+    sg_lb_stats_t local = {0}, busiest_stats = {0}, sgs;
+    unsigned long total_load = 0, total_capacity = 0;
+
+    for (unsigned int g = 0; g < sd->nr_groups; g++) {
+        update_sg_lb_stats(manager, &sd->groups[g], &sgs);
+        total_load += sgs.load;
+        total_capacity += sgs.capacity;
+
+        if (g == sd->local_group) {
+            local = sgs;
+            continue;
+        }
+        // Only queued (not running) tasks can move
+        if (sgs.nr_running <= sgs.weight)
+            continue;
+        if (!busiest || sgs.avg_load > busiest_stats.avg_load) {
+            busiest = &sd->groups[g];
+            busiest_stats = sgs;
         }
+    }
 
-        // Migrate task if beneficial
-        if (dst_cpu && min_load + 1 < src_load) {
-            task_t *task = pick_next_task(src_cpu->cfs);
-            if (task) {
-                enqueue_task(dst_cpu, task);
-                if (manager->config.track_stats)
-                    manager->stats.migrations++;
-            }
+    if (!busiest || !local.weight)
+        return NULL;
+
+    // Idle CPUs here: even out tasks per CPU between the two groups
+    if (local.idle_cpus) {
+        long nr = ((long)busiest_stats.nr_running * local.weight -
+                   (long)local.nr_running * busiest_stats.weight) /
+                  (long)(busiest_stats.weight + local.weight);
+        if (nr <= 0)
+            return NULL;
+        env->type = MIGRATE_TASK;
+        env->imbalance = (unsigned long)nr;
+        return busiest;
+    }
+
+    if (local.avg_load >= busiest_stats.avg_load)
+        return NULL;
+    if (100 * busiest_stats.avg_load <= env->sd->imbalance_pct * local.avg_load)
+        return NULL;
+
+    // Move enough to bring neither side past the domain average
+    unsigned long domain_avg = total_load * SCHED_CAPACITY_SCALE / total_capacity;
+    if (local.avg_load >= domain_avg || busiest_stats.avg_load <= domain_avg)
+        return NULL;
+
+    unsigned long pull = (busiest_stats.avg_load - domain_avg) * busiest_stats.capacity;
+    unsigned long room = (domain_avg - local.avg_load) * local.capacity;
+    env->type = MIGRATE_LOAD;
+    env->imbalance = (pull < room ? pull : room) / SCHED_CAPACITY_SCALE;
+    return env->imbalance ? busiest : NULL;
+}
+
+static cpu_t *find_busiest_queue(cfs_manager_t *manager, lb_env_t *env,
+                                 struct sched_group *group) {
+    cpu_t *busiest = NULL;
+    unsigned long busiest_val = 0;
+    unsigned int i;
+
+    for_each_cpu(i, &group->cpus) {
+        cpu_t *cpu = &manager->cpus[i];
+        unsigned int nr = cpu_nr_running(cpu);
+
+        if (!cpu->online || nr <= 1)
+            continue;
+
+        unsigned long val = env->type == MIGRATE_TASK ? nr : cpu_load(cpu);
+        if (val > busiest_val) {
+            busiest_val = val;
+            busiest = cpu;
         }
     }
+    return busiest;
+}
 
-    pthread_mutex_unlock(&manager->manager_lock);
+// Move queued tasks from src to dst; both runqueues locked
+static unsigned int detach_attach_tasks(lb_env_t *env) {
+    cfs_rq_t *src = env->src->cfs;
+    unsigned int moved = 0, loops = 0;
+
+    update_curr(src, env->src->clock);
+    update_load_avg(src, NULL, env->src->clock);
+    update_curr(env->dst->cfs, env->dst->clock);
+
+    rb_node_t *node = src->rb_leftmost;
+    while (node && env->imbalance && src->nr_running > 1 && loops++ < NR_MIGRATE) {
+        task_t *task = rb_task(node);
+        node = rb_next(node);
+
+        if (env->type == MIGRATE_LOAD) {
+            update_load_avg(src, task, env->src->clock);
+            unsigned long load = task->avg.load_avg;
+
+            // Too big to move unless we keep failing
+            if ((load >> env->sd->nr_balance_failed) > env->imbalance)
+                continue;
+            env->imbalance -= load < env->imbalance ? load : env->imbalance;
+        } else {
+            env->imbalance--;
+        }
+
+        __detach_task(env->src, task);
+        __attach_task(env->dst, task);
+        moved++;
+    }
+    return moved;
+}
+
+// Balance one domain for this_cpu; returns tasks moved, or -1 when
+// another CPU is responsible for this domain (and those above it)
+static int balance_domain(cfs_manager_t *manager, cpu_t *this_cpu,
+                          struct sched_domain *sd) {
+    lb_env_t env = { .dst = this_cpu, .sd = sd };
+
+    if (!should_we_balance(manager, this_cpu, sd))
+        return -1;
+
+    if (manager->config.track_stats)
+        manager->stats.load_balance_calls++;
+
+    struct sched_group *group = find_busiest_group(manager, &env);
+    if (!group)
+        goto out_balanced;
+
+    env.src = find_busiest_queue(manager, &env, group);
+    if (!env.src || env.src == this_cpu)
+        goto out_balanced;
+
+    double_rq_lock(env.dst, env.src);
+    unsigned int moved = env.src->cfs->nr_running > 1 ? detach_attach_tasks(&env) : 0;
+    cfs_rq_publish(env.src);
+    cfs_rq_publish(env.dst);
+    double_rq_unlock(env.dst, env.src);
+
+    if (!moved) {
+        sd->nr_balance_failed++;
+        return 0;
+    }
+
+    if (manager->config.track_stats)
+        manager->stats.migrations += moved;
+    sd->nr_balance_failed = 0;
+    sd->balance_interval = sd->min_interval;
+    return (int)moved;
+
+out_balanced:
+    sd->nr_balance_failed = 0;
+    // Back off while the domain stays balanced
+    if (sd->balance_interval < sd->max_interval)
+        sd->balance_interval *= 2;
+    if (sd->balance_interval > sd->max_interval)
+        sd->balance_interval = sd->max_interval;
+    return 0;
+}
+
+// Rebalance Domains
+//
+// Walk this CPU's domains bottom-up, balancing each one whose interval
+// has elapsed on this CPU's clock.  Busy CPUs stretch the interval by
+// busy_factor, since they have less to gain from pulling work.
+void rebalance_domains(cfs_manager_t *manager, cpu_t *cpu) {
+    uint64_t now = atomic_load_explicit(&cpu->cfs->snap_clock, memory_order_relaxed);
+    bool idle = cpu_nr_running(cpu) == 0;
+
+    for (struct sched_domain *sd = cpu->sd; sd; sd = sd->parent) {
+        uint64_t interval = (uint64_t)sd->balance_interval * (idle ? 1 : sd->busy_factor);
+
+        if (now - sd->last_balance < interval * 1000000ULL)
+            continue;
+
+        int moved = balance_domain(manager, cpu, sd);
+        sd->last_balance = now;
+        if (moved < 0)
+            break;
+        if (moved)
+            idle = false;
+    }
+}
+
+// Load Balance
+void load_balance(cfs_manager_t *manager) {
+    if (!manager) return;
+
+    for (size_t i = 0; i < manager->nr_cpus; i++) {
+        cpu_t *cpu = &manager->cpus[i];
+        if (cpu->online)
+            rebalance_domains(manager, cpu);
+    }
 }
 
 // Load Balancer Thread
@@ -473,6 +1305,7 @@ void print_cfs_stats(cfs_manager_t *manager) {
 
     printf("\nCFS Statistics:\n");
     printf("--------------\n");
+    printf("Pick Policy:         %s\n", manager->config.eevdf ? "EEVDF" : "CFS");
     printf("Context Switches:    %lu\n", manager->stats.context_switches);
     printf("Task Migrations:     %lu\n", manager->stats.migrations);
     printf("Load Balance Calls:  %lu\n", manager->stats.load_balance_calls);
@@ -492,6 +1325,10 @@ void print_cfs_stats(cfs_manager_t *manager) {
         printf("  Tasks:     %u\n", cpu->cfs->nr_running);
         printf("  Current:   %s\n", 
             cpu->cfs->curr ? cpu->cfs->curr->name : "idle");
+        printf("  Min Vrt:   %lu ns\n", cpu->cfs->min_vruntime);
+        printf("  Load Avg:  %lu\n", cpu->cfs->avg.load_avg);
+        printf("  Util Avg:  %lu / %lu\n", cpu->cfs->avg.util_avg, SCHED_CAPACITY_SCALE);
+        printf("  Avg Vrt:   %lu ns\n", avg_vruntime(cpu->cfs));
         pthread_mutex_unlock(&cpu->cfs->lock);
     }
 
@@ -526,12 +1363,15 @@ void destroy_cfs_manager(cfs_manager_t *manager) {
             task_t *task = pick_next_task(cpu->cfs);
             if (task) destroy_task(task);
         }
+        destroy_task(cpu->cfs->curr);
+        cpu->cfs->curr = NULL;
         pthread_mutex_unlock(&cpu->cfs->lock);
         
         pthread_mutex_destroy(&cpu->cfs->lock);
         free(cpu->cfs);
     }
 
+    free_sched_domains(manager->sd, manager->nr_cpus);
     free(manager->cpus);
 
     pthread_mutex_unlock(&manager->manager_lock);
@@ -548,13 +1388,19 @@ void demonstrate_cfs(void) {
         .nr_cpus = 4,
         .load_balance = true,
         .balance_interval = 100,
-        .track_stats = true
+        .track_stats = true,
+        .eevdf = true,
+        .threads_per_core = 2,
+        .cores_per_llc = 2,
+        .llcs_per_node = 1
     };
 
     // Create CFS manager
     cfs_manager_t *manager = create_cfs_manager(config);
     if (!manager) return;
 
+    print_sched_domains(manager->cpus[0].sd, 0);
+
     // Create sample tasks
     const char *task_names[] = {
         "system_daemon",
@@ -593,7 +1439,232 @@ void demonstrate_cfs(void) {
     destroy_cfs_manager(manager);
 }
 
-int main(void) {
+// Benchmark: cost of schedule() with thousands of runnable tasks
+
+#define BENCH_PICKS        2000000
+#define BENCH_VERIFY_PICKS 20000
+#define BENCH_WAKE_PERIOD  16
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline uint64_t bench_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static cpu_t *bench_create_cpu(size_t n, bool eevdf, task_t ***tasks_out, uint64_t *seed) {
+    cpu_t *cpu = calloc(1, sizeof(cpu_t));
+    task_t **tasks = calloc(n, sizeof(task_t *));
+    if (!cpu || !tasks || !(cpu->cfs = calloc(1, sizeof(cfs_rq_t)))) {
+        free(tasks);
+        if (cpu) free(cpu->cfs);
+        free(cpu);
+        return NULL;
+    }
+    pthread_mutex_init(&cpu->cfs->lock, NULL);
+    cpu->cfs->eevdf = eevdf;
+    cpu->online = true;
+
+    for (size_t i = 0; i < n; i++) {
+        tasks[i] = create_task((pid_t)i + 1, "bench", (int)(bench_rand(seed) % 21) - 10);
+        if (tasks[i]) {
+            tasks[i]->slice = BASE_SLICE / 2 + bench_rand(seed) % (2 * BASE_SLICE);
+            enqueue_task(cpu, tasks[i]);
+        }
+    }
+    *tasks_out = tasks;
+    return cpu;
+}
+
+static void bench_destroy_cpu(cpu_t *cpu, task_t **tasks, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        destroy_task(tasks[i]);
+    pthread_mutex_destroy(&cpu->cfs->lock);
+    free(cpu->cfs);
+    free(cpu);
+    free(tasks);
+}
+
+// Sleep and wake a random task so lag and placement are exercised
+static void bench_wake_one(cpu_t *cpu, task_t **tasks, size_t n, uint64_t *seed) {
+    task_t *task = tasks[bench_rand(seed) % n];
+    if (!task || !task->on_rq)
+        return;
+    dequeue_task(cpu, task);
+    enqueue_task(cpu, task);
+}
+
+// Reference pick: scan every queued entity
+static task_t *bench_pick_linear(cfs_rq_t *cfs) {
+    task_t *best = NULL;
+    for (rb_node_t *node = cfs->rb_leftmost; node; node = rb_next(node)) {
+        task_t *se = rb_task(node);
+        if (entity_eligible(cfs, se) &&
+            (!best || deadline_before(se->deadline, best->deadline)))
+            best = se;
+    }
+    return best;
+}
+
+static void bench_verify(size_t n) {
+    uint64_t seed = 0x9e3779b97f4a7c15ULL ^ n;
+    task_t **tasks;
+    cpu_t *cpu = bench_create_cpu(n, true, &tasks, &seed);
+    if (!cpu) return;
+    cfs_rq_t *cfs = cpu->cfs;
+    unsigned long mismatches = 0;
+    double fast = 0, slow = 0;
+
+    for (int i = 0; i < BENCH_VERIFY_PICKS; i++) {
+        if (i % BENCH_WAKE_PERIOD == 0)
+            bench_wake_one(cpu, tasks, n, &seed);
+
+        // schedule() with the pick done twice
+        update_curr(cfs, cpu->clock);
+        if (cfs->curr) {
+            __enqueue_entity(cfs, cfs->curr);
+            cfs->curr = NULL;
+        }
+
+        double t0 = bench_now();
+        task_t *expect = bench_pick_linear(cfs);
+        double t1 = bench_now();
+        task_t *next = pick_eevdf(cfs);
+        double t2 = bench_now();
+        slow += t1 - t0;
+        fast += t2 - t1;
+
+        if (!next || !expect || next->deadline != expect->deadline ||
+            !entity_eligible(cfs, next))
+            mismatches++;
+
+        if (next) {
+            __dequeue_entity(cfs, next);
+            next->exec_start = cpu->clock;
+        }
+        cfs->curr = next;
+        cpu->clock += MINIMUM_TIMESLICE;
+    }
+
+    printf("  %6zu tasks  verify: linear %8.0f ns  augmented %6.0f ns  mismatches %lu\n",
+           n, slow * 1e9 / BENCH_VERIFY_PICKS, fast * 1e9 / BENCH_VERIFY_PICKS, mismatches);
+    bench_destroy_cpu(cpu, tasks, n);
+}
+
+static void bench_schedule(size_t n, bool eevdf) {
+    uint64_t seed = 0x2545f4914f6cdd1dULL ^ n;
+    task_t **tasks;
+    cpu_t *cpu = bench_create_cpu(n, eevdf, &tasks, &seed);
+    if (!cpu) return;
+
+    double start = bench_now();
+    for (int i = 0; i < BENCH_PICKS; i++) {
+        if (i % BENCH_WAKE_PERIOD == 0)
+            bench_wake_one(cpu, tasks, n, &seed);
+        schedule(cpu);
+    }
+    double elapsed = bench_now() - start;
+
+    printf("  %6zu tasks  %-5s  %6.0f ns/schedule  (min_vruntime %lu, avg %lu)\n",
+           n, eevdf ? "EEVDF" : "CFS", elapsed * 1e9 / BENCH_PICKS,
+           cpu->cfs->min_vruntime, avg_vruntime(cpu->cfs));
+    bench_destroy_cpu(cpu, tasks, n);
+}
+
+// Balance a 256-CPU, 2-node machine after piling every task onto the
+// first LLC, advancing each CPU clock by one tick per pass
+#define BENCH_LB_CPUS          256
+#define BENCH_LB_TASKS_PER_CPU 4
+#define BENCH_LB_PASSES        2000
+
+static void bench_spread(cfs_manager_t *manager, unsigned int *min, unsigned int *max) {
+    *min = UINT_MAX;
+    *max = 0;
+    for (size_t i = 0; i < manager->nr_cpus; i++) {
+        unsigned int nr = cpu_nr_running(&manager->cpus[i]);
+        if (nr < *min) *min = nr;
+        if (nr > *max) *max = nr;
+    }
+}
+
+static void bench_balance(void) {
+    cfs_config_t config = {
+        .nr_cpus = BENCH_LB_CPUS,
+        .load_balance = false,
+        .track_stats = true,
+        .eevdf = true,
+        .threads_per_core = 2,
+        .cores_per_llc = 16,
+        .llcs_per_node = 4
+    };
+    cfs_manager_t *manager = create_cfs_manager(config);
+    if (!manager) return;
+
+    size_t nr_tasks = (size_t)BENCH_LB_CPUS * BENCH_LB_TASKS_PER_CPU;
+    uint64_t seed = 0x5851f42d4c957f2dULL;
+    for (size_t i = 0; i < nr_tasks; i++) {
+        task_t *task = create_task((pid_t)i + 1, "lb", (int)(bench_rand(&seed) % 11) - 5);
+        if (task)
+            enqueue_task(&manager->cpus[i % 32], task);
+    }
+
+    printf("Load balance: %d CPUs (%d nodes, %d LLCs, SMT2), %zu tasks on CPUs 0-31\n",
+           BENCH_LB_CPUS, BENCH_LB_CPUS / (config.threads_per_core * config.cores_per_llc *
+                                           config.llcs_per_node),
+           BENCH_LB_CPUS / (config.threads_per_core * config.cores_per_llc), nr_tasks);
+    print_sched_domains(manager->cpus[0].sd, 0);
+
+    double balance_time = 0;
+    for (int pass = 1; pass <= BENCH_LB_PASSES; pass++) {
+        for (size_t i = 0; i < manager->nr_cpus; i++)
+            schedule(&manager->cpus[i]);
+
+        double start = bench_now();
+        load_balance(manager);
+        balance_time += bench_now() - start;
+
+        if (pass == 10 || pass == 100 || pass == 500 || pass == BENCH_LB_PASSES) {
+            unsigned int min, max;
+            bench_spread(manager, &min, &max);
+            printf("  after %4d ms: nr_running %u-%u, migrations %6lu, domain balances %7lu, "
+                   "%6.1f us/pass\n",
+                   pass, min, max, manager->stats.migrations,
+                   manager->stats.load_balance_calls, balance_time * 1e6 / pass);
+        }
+    }
+
+    destroy_cfs_manager(manager);
+}
+
+static int run_benchmark(void) {
+    static const size_t sizes[] = { 1000, 5000, 50000 };
+
+    current_log_level = LOG_LEVEL_ERROR;
+    printf("Fair pick benchmark (%d schedules, sleep/wake every %d)\n",
+           BENCH_PICKS, BENCH_WAKE_PERIOD);
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        bench_schedule(sizes[i], false);
+        bench_schedule(sizes[i], true);
+    }
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        bench_verify(sizes[i]);
+    }
+    bench_balance();
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        return run_benchmark();
+
     // Set log level
     current_log_level = LOG_LEVEL_INFO;
 
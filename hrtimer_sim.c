@@ -10,6 +10,9 @@
 #include <sys/time.h>
 #include <signal.h>
 
+#include "timerqueue_sim.h"
+#include "des_sim.h"
+
 // Logging Macros
 #define LOG_LEVEL_DEBUG 0
 #define LOG_LEVEL_INFO  1
@@ -29,11 +32,16 @@ static int current_log_level = LOG_LEVEL_INFO;
 
 // HRTimer Constants
 #define MAX_CPUS           16
-#define MAX_TIMERS         1024
 #define MAX_BASES          4
 #define MIN_HRTIMER_DELTA  100     // 100ns minimum delta
 #define MAX_HRTIMER_DELTA  1000000 // 1ms maximum delta
 #define TEST_DURATION      30      // seconds
+#define NR_TEST_TIMERS     1024
+#define MAX_TEST_SLACK     50000   // 50us
+#define KTIME_MAX          UINT64_MAX
+#define NSEC_PER_SEC       1000000000ULL
+#define NSEC_PER_USEC      1000ULL
+#define TAI_OFFSET         (37 * NSEC_PER_SEC)  // TAI - UTC
 
 // Clock Bases
 typedef enum {
@@ -60,26 +68,58 @@ typedef enum {
 } hrtimer_mode_t;
 
 // Timer Structure
+//
+// A timer may fire anywhere in [softexpires, expires]: expires (the
+// hard expiry) orders the timerqueue and programs the CPU's next event,
+// and whenever the CPU wakes for one timer it also runs every timer
+// whose soft expiry has passed.  The slack between the two lets timers
+// armed close together share a single wakeup.
 typedef struct hrtimer {
+    struct timerqueue_node node;    // node.expires: hard expiry
     unsigned int id;
     hrtimer_base_type_t base;
     hrtimer_state_t state;
     hrtimer_mode_t mode;
-    uint64_t expires;
     uint64_t softexpires;
-    int (*function)(void *data);
+    uint64_t period;                // restart interval, 0 = one shot
+    int (*function)(void *data);    // returns nonzero to restart
     void *data;
     int cpu;
-    struct hrtimer *next;
 } hrtimer_t;
 
+// Clock Base: one timerqueue per clock on every CPU
+typedef struct {
+    struct timerqueue_head active;
+    uint64_t offset;                // this clock minus CLOCK_MONOTONIC
+    size_t nr_timers;
+} clock_base_t;
+
+struct hrtimer_manager;
+
 // CPU Base Structure
 typedef struct {
-    hrtimer_t *timers[MAX_BASES];
+    clock_base_t clock_bases[MAX_BASES];
     uint64_t resolution;
-    uint64_t offset;
+    uint64_t expires_next;          // CLOCK_MONOTONIC, earliest hard expiry
     size_t nr_timers;
+    unsigned int cpu;
+    bool running;
     pthread_mutex_t lock;
+    pthread_cond_t wakeup;          // expiry thread sleeps here
+    pthread_t thread;
+    uint64_t event_time;            // virtual time: pending expiry event, us
+    uint64_t event_gen;
+    struct hrtimer_manager *manager;
+    struct {
+        uint64_t started;
+        uint64_t fired;             // callbacks run
+        uint64_t expired;
+        uint64_t overruns;
+        uint64_t events;            // expiry passes (wakeups with work)
+        uint64_t lateness_sum;      // ns past soft expiry
+        uint64_t lateness_max;
+        uint64_t lateness_min;
+    } stats;
 } cpu_base_t;
 
 // Statistics Structure
@@ -89,6 +129,7 @@ typedef struct {
     uint64_t expired_timers;
     uint64_t migrations;
     uint64_t overruns;
+    uint64_t wakeups;
     double avg_precision;
     double max_precision;
     double min_precision;
@@ -96,15 +137,15 @@ typedef struct {
 } hrtimer_stats_t;
 
 // HRTimer Manager Structure
-typedef struct {
+typedef struct hrtimer_manager {
     cpu_base_t cpu_bases[MAX_CPUS];
-    hrtimer_t *timers[MAX_TIMERS];
     size_t nr_cpus;
-    size_t nr_timers;
     bool running;
     pthread_mutex_t manager_lock;
-    pthread_t timer_thread;
     pthread_t migration_thread;
+    hrtimer_t **test_timers;        // created by run_test, freed on destroy
+    size_t nr_test_timers;
+    struct des_sim *sim;            // set while running in virtual time
     hrtimer_stats_t stats;
 } hrtimer_manager_t;
 
@@ -122,17 +163,22 @@ hrtimer_t* create_hrtimer(hrtimer_base_type_t base, hrtimer_mode_t mode,
 void destroy_hrtimer(hrtimer_t *timer);
 
 int start_hrtimer(hrtimer_manager_t *manager, hrtimer_t *timer, uint64_t expires);
+int start_hrtimer_range(hrtimer_manager_t *manager, hrtimer_t *timer, uint64_t expires,
+    uint64_t delta);
 int cancel_hrtimer(hrtimer_manager_t *manager, hrtimer_t *timer);
+uint64_t hrtimer_forward(hrtimer_t *timer, uint64_t now, uint64_t interval);
+uint64_t hrtimer_cb_get_time(hrtimer_manager_t *manager, hrtimer_base_type_t base);
 
 void* timer_thread(void *arg);
 void* migration_thread(void *arg);
-void process_timers(hrtimer_manager_t *manager);
+uint64_t process_timers(cpu_base_t *cpu_base, uint64_t now);
 void migrate_timers(hrtimer_manager_t *manager);
 
 void run_test(hrtimer_manager_t *manager);
+void run_test_virtual(hrtimer_manager_t *manager, uint64_t seed, uint64_t duration_us);
 void calculate_stats(hrtimer_manager_t *manager);
 void print_test_stats(hrtimer_manager_t *manager);
-void demonstrate_hrtimers(void);
+void demonstrate_hrtimers(const struct des_options *opts);
 
 // Utility Functions
 const char* get_log_level_string(int level) {
@@ -175,6 +221,38 @@ const char* get_timer_mode_string(hrtimer_mode_t mode) {
     }
 }
 
+// Time Helpers
+static uint64_t ktime_get(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+static uint64_t ktime_get_real(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+static uint64_t ktime_add_safe(uint64_t a, uint64_t b) {
+    return a > KTIME_MAX - b ? KTIME_MAX : a + b;
+}
+
+// CLOCK_MONOTONIC as the manager sees it: virtual while a simulation runs
+static uint64_t hrtimer_clock_mono(hrtimer_manager_t *manager) {
+    return manager->sim ? manager->sim->now * NSEC_PER_USEC : ktime_get();
+}
+
+// Uniform in [0, n): seeded in virtual time, rand() otherwise
+static uint64_t hrtimer_rand(hrtimer_manager_t *manager, uint64_t n) {
+    return manager->sim ? des_rand_range(manager->sim, n) : (uint64_t)rand() % n;
+}
+
+// Current time of a clock base
+uint64_t hrtimer_cb_get_time(hrtimer_manager_t *manager, hrtimer_base_type_t base) {
+    return hrtimer_clock_mono(manager) + manager->cpu_bases[0].clock_bases[base].offset;
+}
+
 // Create HRTimer
 hrtimer_t* create_hrtimer(hrtimer_base_type_t base, hrtimer_mode_t mode,
     int (*function)(void *data), void *data) {
@@ -182,24 +260,25 @@ hrtimer_t* create_hrtimer(hrtimer_base_type_t base, hrtimer_mode_t mode,
     hrtimer_t *timer = malloc(sizeof(hrtimer_t));
     if (!timer) return NULL;
 
+    timerqueue_init(&timer->node);
+    timer->node.expires = 0;
     timer->id = next_id++;
     timer->base = base;
     timer->state = HRTIMER_STATE_INACTIVE;
     timer->mode = mode;
-    timer->expires = 0;
     timer->softexpires = 0;
+    timer->period = 0;
     timer->function = function;
     timer->data = data;
     timer->cpu = -1;
-    timer->next = NULL;
 
     return timer;
 }
 
 // Create HRTimer Manager
 hrtimer_manager_t* create_hrtimer_manager(size_t nr_cpus) {
-    if (nr_cpus > MAX_CPUS) {
-        LOG(LOG_LEVEL_ERROR, "Number of CPUs exceeds maximum");
+    if (nr_cpus == 0 || nr_cpus > MAX_CPUS) {
+        LOG(LOG_LEVEL_ERROR, "Number of CPUs must be 1-%d", MAX_CPUS);
         return NULL;
     }
 
@@ -209,19 +288,45 @@ hrtimer_manager_t* create_hrtimer_manager(size_t nr_cpus) {
         return NULL;
     }
 
+    // Clock offsets from CLOCK_MONOTONIC, shared by every CPU
+    uint64_t mono = ktime_get();
+    uint64_t real = ktime_get_real();
+    uint64_t offsets[MAX_BASES] = {
+        [HRTIMER_BASE_MONOTONIC] = 0,
+        [HRTIMER_BASE_REALTIME]  = real - mono,
+        [HRTIMER_BASE_BOOTTIME]  = 0,              // never suspended
+        [HRTIMER_BASE_TAI]       = real - mono + TAI_OFFSET,
+    };
+
+    // Expiry threads sleep on CLOCK_MONOTONIC deadlines
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
     // Initialize CPU bases
     for (size_t i = 0; i < nr_cpus; i++) {
-        cpu_base_t *base = &manager->cpu_bases[i];
-        memset(base->timers, 0, sizeof(base->timers));
-        base->resolution = 1;  // 1ns resolution
-        base->offset = 0;
-        base->nr_timers = 0;
-        pthread_mutex_init(&base->lock, NULL);
+        cpu_base_t *cpu_base = &manager->cpu_bases[i];
+        memset(cpu_base, 0, sizeof(*cpu_base));
+        for (size_t j = 0; j < MAX_BASES; j++) {
+            timerqueue_init_head(&cpu_base->clock_bases[j].active);
+            cpu_base->clock_bases[j].offset = offsets[j];
+        }
+        cpu_base->resolution = 1;  // 1ns resolution
+        cpu_base->expires_next = KTIME_MAX;
+        cpu_base->event_time = KTIME_MAX;
+        cpu_base->cpu = i;
+        cpu_base->manager = manager;
+        cpu_base->stats.lateness_min = UINT64_MAX;
+        pthread_mutex_init(&cpu_base->lock, NULL);
+        pthread_cond_init(&cpu_base->wakeup, &attr);
     }
+    pthread_condattr_destroy(&attr);
 
     manager->nr_cpus = nr_cpus;
-    manager->nr_timers = 0;
     manager->running = false;
+    manager->test_timers = NULL;
+    manager->nr_test_timers = 0;
+    manager->sim = NULL;
     pthread_mutex_init(&manager->manager_lock, NULL);
     memset(&manager->stats, 0, sizeof(hrtimer_stats_t));
 
@@ -229,46 +334,164 @@ hrtimer_manager_t* create_hrtimer_manager(size_t nr_cpus) {
     return manager;
 }
 
-// Start HRTimer
-int start_hrtimer(hrtimer_manager_t *manager, hrtimer_t *timer, uint64_t expires) {
-    if (!manager || !timer) return -1;
+// Hard expiry of a timer on CLOCK_MONOTONIC
+static uint64_t hrtimer_expires_mono(cpu_base_t *cpu_base, hrtimer_t *timer) {
+    uint64_t offset = cpu_base->clock_bases[timer->base].offset;
+    return timer->node.expires > offset ? timer->node.expires - offset : 0;
+}
 
-    pthread_mutex_lock(&manager->manager_lock);
-    if (manager->nr_timers >= MAX_TIMERS) {
-        pthread_mutex_unlock(&manager->manager_lock);
-        return -1;
+// Recompute the CPU's next event from the earliest timer of each base
+static void hrtimer_update_next_event(cpu_base_t *cpu_base) {
+    uint64_t expires_next = KTIME_MAX;
+
+    for (size_t base = 0; base < MAX_BASES; base++) {
+        struct timerqueue_node *next =
+            timerqueue_getnext(&cpu_base->clock_bases[base].active);
+        if (next) {
+            uint64_t expires = hrtimer_expires_mono(cpu_base,
+                container_of(next, hrtimer_t, node));
+            if (expires < expires_next)
+                expires_next = expires;
+        }
     }
+    cpu_base->expires_next = expires_next;
+}
 
-    // Assign to CPU
-    int target_cpu = (timer->mode == HRTIMER_MODE_PINNED && timer->cpu >= 0) ?
-        timer->cpu : rand() % manager->nr_cpus;
-    timer->cpu = target_cpu;
+static void virtual_expiry_event(struct des_sim *sim, void *arg, uint64_t gen);
 
-    // Add to manager's timer list
-    manager->timers[manager->nr_timers++] = timer;
+// The next event moved earlier: wake the expiry thread, or in virtual
+// time supersede the pending expiry event.  Caller holds cpu_base->lock.
+static void hrtimer_reprogram(cpu_base_t *cpu_base) {
+    struct des_sim *sim = cpu_base->manager->sim;
 
-    // Add to CPU base
-    cpu_base_t *cpu_base = &manager->cpu_bases[target_cpu];
-    pthread_mutex_lock(&cpu_base->lock);
+    if (!sim) {
+        pthread_cond_signal(&cpu_base->wakeup);
+        return;
+    }
+    if (cpu_base->expires_next == KTIME_MAX)
+        return;
+
+    // The engine ticks in us; never wake before the hard expiry
+    uint64_t time = (cpu_base->expires_next + NSEC_PER_USEC - 1) / NSEC_PER_USEC;
+    if (time >= cpu_base->event_time)
+        return;
+    cpu_base->event_time = time;
+    if (!des_schedule_at(sim, time, virtual_expiry_event, cpu_base, ++cpu_base->event_gen))
+        LOG(LOG_LEVEL_ERROR, "Failed to schedule CPU %u", cpu_base->cpu);
+}
 
-    timer->expires = expires;
-    timer->softexpires = expires;
+// Queue a timer; caller holds cpu_base->lock
+static void enqueue_hrtimer(cpu_base_t *cpu_base, hrtimer_t *timer) {
+    clock_base_t *base = &cpu_base->clock_bases[timer->base];
+
+    timer->cpu = cpu_base->cpu;
     timer->state = HRTIMER_STATE_ENQUEUED;
+    base->nr_timers++;
+    cpu_base->nr_timers++;
 
-    // Insert in sorted order
-    hrtimer_t **pp = &cpu_base->timers[timer->base];
-    while (*pp && (*pp)->expires <= timer->expires) {
-        pp = &(*pp)->next;
+    // Only a new earliest timer can move the next event forward
+    if (timerqueue_add(&base->active, &timer->node)) {
+        uint64_t expires = hrtimer_expires_mono(cpu_base, timer);
+        if (expires < cpu_base->expires_next) {
+            cpu_base->expires_next = expires;
+            hrtimer_reprogram(cpu_base);
+        }
     }
-    timer->next = *pp;
-    *pp = timer;
-    cpu_base->nr_timers++;
+}
 
-    manager->stats.total_timers++;
-    manager->stats.active_timers++;
+// Unqueue a timer; caller holds cpu_base->lock
+//
+// The next event is left alone: if this was the earliest timer the
+// expiry thread wakes for nothing and reprograms from what is queued.
+static void remove_hrtimer(cpu_base_t *cpu_base, hrtimer_t *timer, hrtimer_state_t state) {
+    clock_base_t *base = &cpu_base->clock_bases[timer->base];
+
+    timerqueue_del(&base->active, &timer->node);
+    base->nr_timers--;
+    cpu_base->nr_timers--;
+    timer->state = state;
+}
 
+// Lock the base the timer is queued on, following it across migrations
+static cpu_base_t *lock_hrtimer_base(hrtimer_manager_t *manager, hrtimer_t *timer) {
+    for (;;) {
+        int cpu = timer->cpu;
+        if (cpu < 0)
+            return NULL;
+        cpu_base_t *cpu_base = &manager->cpu_bases[cpu];
+        pthread_mutex_lock(&cpu_base->lock);
+        if (timer->cpu == cpu)
+            return cpu_base;
+        pthread_mutex_unlock(&cpu_base->lock);
+    }
+}
+
+// Lock the timer's current base and new_base, in CPU order as
+// migrate_timers does, so the timer cannot be queued by anyone else
+// while it moves.  A timer never queued anywhere is covered by CPU 0's
+// lock, which serializes its first starts.  Returns the current base.
+static cpu_base_t *lock_hrtimer_bases(hrtimer_manager_t *manager, hrtimer_t *timer,
+    cpu_base_t *new_base) {
+    for (;;) {
+        int cpu = timer->cpu;
+        cpu_base_t *old_base = &manager->cpu_bases[cpu < 0 ? 0 : cpu];
+        cpu_base_t *first = old_base->cpu < new_base->cpu ? old_base : new_base;
+        cpu_base_t *second = first == old_base ? new_base : old_base;
+
+        pthread_mutex_lock(&first->lock);
+        if (second != first)
+            pthread_mutex_lock(&second->lock);
+        if (timer->cpu == cpu)
+            return old_base;
+        if (second != first)
+            pthread_mutex_unlock(&second->lock);
+        pthread_mutex_unlock(&first->lock);
+    }
+}
+
+// Start HRTimer in [expires, expires + delta]
+//
+// A queued timer is moved rather than queued twice.  REL timers count
+// from the current time of their clock base.
+int start_hrtimer_range(hrtimer_manager_t *manager, hrtimer_t *timer, uint64_t expires,
+    uint64_t delta) {
+    if (!manager || !timer || timer->base >= MAX_BASES) return -1;
+    if (timer->mode == HRTIMER_MODE_PINNED && timer->cpu >= (int)manager->nr_cpus)
+        return -1;
+
+    if (timer->mode == HRTIMER_MODE_REL)
+        expires = ktime_add_safe(expires, hrtimer_cb_get_time(manager, timer->base));
+
+    // Assign to CPU.  A pinned timer stays where it is; the pick is
+    // checked again under the locks, as the timer may migrate meanwhile.
+    int target_cpu;
+    cpu_base_t *old_base, *cpu_base;
+    for (;;) {
+        int cpu = timer->cpu;
+        target_cpu = (timer->mode == HRTIMER_MODE_PINNED && cpu >= 0) ?
+            cpu : (int)hrtimer_rand(manager, manager->nr_cpus);
+        cpu_base = &manager->cpu_bases[target_cpu];
+
+        old_base = lock_hrtimer_bases(manager, timer, cpu_base);
+        if (timer->mode != HRTIMER_MODE_PINNED || timer->cpu == cpu)
+            break;
+        if (old_base != cpu_base)
+            pthread_mutex_unlock(&old_base->lock);
+        pthread_mutex_unlock(&cpu_base->lock);
+    }
+
+    // Move it from its current base with both locks held
+    if (timerqueue_node_queued(&timer->node))
+        remove_hrtimer(old_base, timer, HRTIMER_STATE_INACTIVE);
+
+    timer->softexpires = expires;
+    timer->node.expires = ktime_add_safe(expires, delta);
+    enqueue_hrtimer(cpu_base, timer);
+    cpu_base->stats.started++;
+
+    if (old_base != cpu_base)
+        pthread_mutex_unlock(&old_base->lock);
     pthread_mutex_unlock(&cpu_base->lock);
-    pthread_mutex_unlock(&manager->manager_lock);
 
     LOG(LOG_LEVEL_DEBUG, "Started timer %u (base: %s, mode: %s) on CPU %d",
         timer->id, get_base_type_string(timer->base),
@@ -276,110 +499,125 @@ int start_hrtimer(hrtimer_manager_t *manager, hrtimer_t *timer, uint64_t expires
     return 0;
 }
 
+// Start HRTimer
+int start_hrtimer(hrtimer_manager_t *manager, hrtimer_t *timer, uint64_t expires) {
+    return start_hrtimer_range(manager, timer, expires, 0);
+}
+
 // Cancel HRTimer
 int cancel_hrtimer(hrtimer_manager_t *manager, hrtimer_t *timer) {
     if (!manager || !timer || timer->cpu < 0) return -1;
 
-    pthread_mutex_lock(&manager->manager_lock);
-    cpu_base_t *cpu_base = &manager->cpu_bases[timer->cpu];
-    pthread_mutex_lock(&cpu_base->lock);
+    cpu_base_t *cpu_base = lock_hrtimer_base(manager, timer);
+    if (!cpu_base) return -1;
 
-    // Remove from CPU base
-    hrtimer_t **pp = &cpu_base->timers[timer->base];
-    while (*pp && *pp != timer) {
-        pp = &(*pp)->next;
-    }
-    if (*pp) {
-        *pp = timer->next;
-        timer->next = NULL;
-        timer->state = HRTIMER_STATE_INACTIVE;
-        cpu_base->nr_timers--;
-        manager->stats.active_timers--;
-    }
+    if (timerqueue_node_queued(&timer->node))
+        remove_hrtimer(cpu_base, timer, HRTIMER_STATE_INACTIVE);
 
     pthread_mutex_unlock(&cpu_base->lock);
-    pthread_mutex_unlock(&manager->manager_lock);
 
     LOG(LOG_LEVEL_DEBUG, "Cancelled timer %u", timer->id);
     return 0;
 }
 
-// Timer Thread
-void* timer_thread(void *arg) {
-    hrtimer_manager_t *manager = (hrtimer_manager_t*)arg;
+// Forward a timer past now by whole intervals; returns the number of
+// intervals skipped, so anything above 1 is an overrun.  Counted from
+// the soft expiry: a timer run early in its range must still move on.
+uint64_t hrtimer_forward(hrtimer_t *timer, uint64_t now, uint64_t interval) {
+    if (interval == 0 || now < timer->softexpires)
+        return 0;
 
-    while (manager->running) {
-        process_timers(manager);
-        usleep(100);  // 100us tick
-    }
+    uint64_t delta = now - timer->softexpires;
+    uint64_t orun = delta / interval + 1;
+    uint64_t step = orun * interval;
 
-    return NULL;
+    timer->softexpires = ktime_add_safe(timer->softexpires, step);
+    timer->node.expires = ktime_add_safe(timer->node.expires, step);
+    return orun;
 }
 
-// Process Timers
-void process_timers(hrtimer_manager_t *manager) {
-    if (!manager) return;
+// Run one expired timer; caller holds cpu_base->lock, as the callback
+// does, so callbacks must not start or cancel timers themselves
+static void run_hrtimer(cpu_base_t *cpu_base, hrtimer_t *timer, uint64_t basenow) {
+    uint64_t lateness = basenow - timer->softexpires;
+
+    cpu_base->stats.fired++;
+    cpu_base->stats.lateness_sum += lateness;
+    if (lateness > cpu_base->stats.lateness_max)
+        cpu_base->stats.lateness_max = lateness;
+    if (lateness < cpu_base->stats.lateness_min)
+        cpu_base->stats.lateness_min = lateness;
+
+    remove_hrtimer(cpu_base, timer, HRTIMER_STATE_CALLBACK);
+    int restart = timer->function ? timer->function(timer->data) : 0;
+
+    if (restart && timer->period) {
+        uint64_t orun = hrtimer_forward(timer, basenow, timer->period);
+        if (orun > 1)
+            cpu_base->stats.overruns += orun - 1;
+        enqueue_hrtimer(cpu_base, timer);
+    } else {
+        timer->state = HRTIMER_STATE_EXPIRED;
+        cpu_base->stats.expired++;
+    }
+}
 
-    struct timespec now;
-    clock_gettime(CLOCK_MONOTONIC, &now);
-    uint64_t current_time = now.tv_sec * 1000000000ULL + now.tv_nsec;
+// Process Timers
+//
+// Run every timer on this CPU whose soft expiry is at or before now
+// (CLOCK_MONOTONIC).  Each queue is in hard-expiry order, so the walk
+// stops at the first timer still inside its soft window.  Caller holds
+// cpu_base->lock; returns the next event.
+uint64_t process_timers(cpu_base_t *cpu_base, uint64_t now) {
+    cpu_base->stats.events++;
+
+    for (size_t base = 0; base < MAX_BASES; base++) {
+        clock_base_t *clock_base = &cpu_base->clock_bases[base];
+        uint64_t basenow = now + clock_base->offset;
+        struct timerqueue_node *node;
+
+        while ((node = timerqueue_getnext(&clock_base->active))) {
+            hrtimer_t *timer = container_of(node, hrtimer_t, node);
+            if (basenow < timer->softexpires)
+                break;
+            run_hrtimer(cpu_base, timer, basenow);
+        }
+    }
 
-    // Process each CPU base
-    for (size_t cpu = 0; cpu < manager->nr_cpus; cpu++) {
-        cpu_base_t *cpu_base = &manager->cpu_bases[cpu];
-        pthread_mutex_lock(&cpu_base->lock);
+    hrtimer_update_next_event(cpu_base);
+    return cpu_base->expires_next;
+}
 
-        // Process each base type
-        for (size_t base = 0; base < MAX_BASES; base++) {
-            hrtimer_t *timer = cpu_base->timers[base];
-            hrtimer_t *prev = NULL;
-
-            while (timer && timer->expires <= current_time) {
-                // Execute timer callback
-                if (timer->function) {
-                    timer->state = HRTIMER_STATE_CALLBACK;
-                    int restart = timer->function(timer->data);
-                    
-                    // Handle restart
-                    if (restart) {
-                        timer->expires += timer->softexpires;
-                        // Reinsert in sorted order
-                        hrtimer_t **pp = &cpu_base->timers[base];
-                        while (*pp && (*pp)->expires <= timer->expires) {
-                            pp = &(*pp)->next;
-                        }
-                        if (prev) prev->next = timer->next;
-                        else cpu_base->timers[base] = timer->next;
-                        timer->next = *pp;
-                        *pp = timer;
-                        timer->state = HRTIMER_STATE_ENQUEUED;
-                    } else {
-                        // Remove expired timer
-                        if (prev) prev->next = timer->next;
-                        else cpu_base->timers[base] = timer->next;
-                        timer->state = HRTIMER_STATE_EXPIRED;
-                        cpu_base->nr_timers--;
-                        manager->stats.active_timers--;
-                        manager->stats.expired_timers++;
-                    }
-                }
+// Timer Thread
+//
+// One per CPU.  It sleeps until the earliest hard expiry across the
+// CPU's clock bases; a timer queued ahead of that signals it to sleep
+// less, and an idle CPU sleeps until signalled.
+void* timer_thread(void *arg) {
+    cpu_base_t *cpu_base = (cpu_base_t*)arg;
 
-                // Calculate precision
-                double precision = (current_time - timer->expires) / 1000.0;  // us
-                if (precision > manager->stats.max_precision) {
-                    manager->stats.max_precision = precision;
-                }
-                if (precision < manager->stats.min_precision || 
-                    manager->stats.min_precision == 0) {
-                    manager->stats.min_precision = precision;
-                }
+    pthread_mutex_lock(&cpu_base->lock);
+    while (cpu_base->running) {
+        uint64_t now = ktime_get();
 
-                timer = timer->next;
-            }
+        if (cpu_base->expires_next <= now) {
+            process_timers(cpu_base, now);
+            continue;
         }
 
-        pthread_mutex_unlock(&cpu_base->lock);
+        if (cpu_base->expires_next == KTIME_MAX) {
+            pthread_cond_wait(&cpu_base->wakeup, &cpu_base->lock);
+        } else {
+            struct timespec deadline = {
+                .tv_sec = cpu_base->expires_next / NSEC_PER_SEC,
+                .tv_nsec = cpu_base->expires_next % NSEC_PER_SEC,
+            };
+            pthread_cond_timedwait(&cpu_base->wakeup, &cpu_base->lock, &deadline);
+        }
     }
+    pthread_mutex_unlock(&cpu_base->lock);
+
+    return NULL;
 }
 
 // Migration Thread
@@ -388,7 +626,7 @@ void* migration_thread(void *arg) {
 
     while (manager->running) {
         migrate_timers(manager);
-        usleep(1000000);  // 1ms interval
+        usleep(1000);  // 1ms interval
     }
 
     return NULL;
@@ -404,12 +642,16 @@ void migrate_timers(hrtimer_manager_t *manager) {
 
     for (size_t i = 0; i < manager->nr_cpus; i++) {
         cpu_base_t *base = &manager->cpu_bases[i];
-        if (base->nr_timers > max_timers) {
-            max_timers = base->nr_timers;
+        pthread_mutex_lock(&base->lock);
+        size_t nr_timers = base->nr_timers;
+        pthread_mutex_unlock(&base->lock);
+
+        if (nr_timers > max_timers) {
+            max_timers = nr_timers;
             max_cpu = i;
         }
-        if (base->nr_timers < min_timers) {
-            min_timers = base->nr_timers;
+        if (nr_timers < min_timers) {
+            min_timers = nr_timers;
             min_cpu = i;
         }
     }
@@ -419,29 +661,25 @@ void migrate_timers(hrtimer_manager_t *manager) {
         cpu_base_t *src_base = &manager->cpu_bases[max_cpu];
         cpu_base_t *dst_base = &manager->cpu_bases[min_cpu];
 
-        pthread_mutex_lock(&src_base->lock);
-        pthread_mutex_lock(&dst_base->lock);
+        // Lock in CPU order so two migrations cannot deadlock
+        pthread_mutex_lock(&manager->cpu_bases[max_cpu < min_cpu ? max_cpu : min_cpu].lock);
+        pthread_mutex_lock(&manager->cpu_bases[max_cpu < min_cpu ? min_cpu : max_cpu].lock);
 
-        // Find a timer to migrate
+        // Move the earliest timer that is not pinned
         for (size_t base = 0; base < MAX_BASES; base++) {
-            hrtimer_t **pp = &src_base->timers[base];
-            while (*pp) {
-                hrtimer_t *timer = *pp;
+            struct timerqueue_node *node =
+                timerqueue_getnext(&src_base->clock_bases[base].active);
+            for (; node; node = timerqueue_iterate_next(node)) {
+                hrtimer_t *timer = container_of(node, hrtimer_t, node);
                 if (timer->mode != HRTIMER_MODE_PINNED) {
-                    // Remove from source
-                    *pp = timer->next;
-                    src_base->nr_timers--;
-
-                    // Add to destination
-                    timer->cpu = min_cpu;
-                    timer->next = dst_base->timers[base];
-                    dst_base->timers[base] = timer;
-                    dst_base->nr_timers++;
+                    remove_hrtimer(src_base, timer, HRTIMER_STATE_INACTIVE);
+                    enqueue_hrtimer(dst_base, timer);
 
+                    pthread_mutex_lock(&manager->manager_lock);
                     manager->stats.migrations++;
+                    pthread_mutex_unlock(&manager->manager_lock);
                     goto done_migration;
                 }
-                pp = &(*pp)->next;
             }
         }
 
@@ -451,38 +689,128 @@ done_migration:
     }
 }
 
+// Periodic test timers keep restarting
+static int test_timer_fn(void *data) {
+    (void)data;
+    return 1;
+}
+
+// Create test timers: half one-shot, half periodic (10-100ms)
+static void create_test_timers(hrtimer_manager_t *manager) {
+    hrtimer_t **timers = calloc(NR_TEST_TIMERS, sizeof(hrtimer_t*));
+    size_t nr_timers = 0;
+    manager->test_timers = timers;
+    for (size_t i = 0; timers && i < NR_TEST_TIMERS; i++) {
+        hrtimer_base_type_t base = hrtimer_rand(manager, MAX_BASES);
+        hrtimer_mode_t mode = hrtimer_rand(manager, 4);
+        bool periodic = i % 2;
+        hrtimer_t *timer = create_hrtimer(base, mode, periodic ? test_timer_fn : NULL, NULL);
+        if (!timer) continue;
+
+        timers[nr_timers] = timer;
+        manager->nr_test_timers = ++nr_timers;
+        if (mode == HRTIMER_MODE_PINNED)
+            timer->cpu = i % manager->nr_cpus;
+        if (periodic)
+            timer->period = (10 + hrtimer_rand(manager, 91)) * 1000000ULL;
+
+        uint64_t delta = hrtimer_rand(manager, MAX_HRTIMER_DELTA - MIN_HRTIMER_DELTA) +
+            MIN_HRTIMER_DELTA;
+        uint64_t expires = mode == HRTIMER_MODE_REL ? delta :
+            hrtimer_cb_get_time(manager, base) + delta;
+        start_hrtimer_range(manager, timer, expires, hrtimer_rand(manager, MAX_TEST_SLACK));
+    }
+}
+
 // Run Test
 void run_test(hrtimer_manager_t *manager) {
     if (!manager) return;
 
     LOG(LOG_LEVEL_INFO, "Starting hrtimer test...");
 
-    // Create test timers
-    for (size_t i = 0; i < MAX_TIMERS/4; i++) {
-        hrtimer_base_type_t base = rand() % MAX_BASES;
-        hrtimer_mode_t mode = rand() % 4;
-        hrtimer_t *timer = create_hrtimer(base, mode, NULL, NULL);
-        if (timer) {
-            uint64_t expires = rand() % 
-                (MAX_HRTIMER_DELTA - MIN_HRTIMER_DELTA) + MIN_HRTIMER_DELTA;
-            start_hrtimer(manager, timer, expires);
-        }
-    }
-
     // Start threads
     manager->running = true;
-    pthread_create(&manager->timer_thread, NULL, timer_thread, manager);
+    for (size_t i = 0; i < manager->nr_cpus; i++) {
+        cpu_base_t *cpu_base = &manager->cpu_bases[i];
+        cpu_base->running = true;
+        pthread_create(&cpu_base->thread, NULL, timer_thread, cpu_base);
+    }
     pthread_create(&manager->migration_thread, NULL, migration_thread, manager);
 
+    create_test_timers(manager);
+
     // Run test
     sleep(TEST_DURATION);
 
     // Stop threads
     manager->running = false;
-    pthread_join(manager->timer_thread, NULL);
     pthread_join(manager->migration_thread, NULL);
+    for (size_t i = 0; i < manager->nr_cpus; i++) {
+        cpu_base_t *cpu_base = &manager->cpu_bases[i];
+        pthread_mutex_lock(&cpu_base->lock);
+        cpu_base->running = false;
+        pthread_cond_signal(&cpu_base->wakeup);
+        pthread_mutex_unlock(&cpu_base->lock);
+        pthread_join(cpu_base->thread, NULL);
+    }
 
     // Calculate statistics
+    manager->stats.test_duration = TEST_DURATION;
+    calculate_stats(manager);
+}
+
+// Virtual time: a CPU's expiry event, what timer_thread does on waking
+static void virtual_expiry_event(struct des_sim *sim, void *arg, uint64_t gen) {
+    cpu_base_t *cpu_base = (cpu_base_t*)arg;
+
+    if (gen != cpu_base->event_gen)
+        return;
+
+    pthread_mutex_lock(&cpu_base->lock);
+    cpu_base->event_time = KTIME_MAX;
+    process_timers(cpu_base, sim->now * NSEC_PER_USEC);
+    hrtimer_reprogram(cpu_base);
+    pthread_mutex_unlock(&cpu_base->lock);
+}
+
+// Same cadence as migration_thread
+static void virtual_migration_event(struct des_sim *sim, void *arg, uint64_t data) {
+    hrtimer_manager_t *manager = (hrtimer_manager_t*)arg;
+
+    migrate_timers(manager);
+    des_schedule(sim, 1000, virtual_migration_event, manager, data);
+}
+
+// Run Test in virtual time: the workload of run_test, driven by the
+// event engine and a seeded RNG, so runs are fast and reproducible
+void run_test_virtual(hrtimer_manager_t *manager, uint64_t seed, uint64_t duration_us) {
+    if (!manager) return;
+
+    struct des_sim sim;
+    if (!des_init(&sim, seed)) {
+        LOG(LOG_LEVEL_ERROR, "Failed to initialize simulation");
+        return;
+    }
+
+    LOG(LOG_LEVEL_INFO, "Starting hrtimer test (virtual time, seed %lu, %.0f s)...",
+        seed, duration_us / 1e6);
+
+    // Clock offsets came from the real clocks; only differences matter
+    manager->sim = &sim;
+    create_test_timers(manager);
+    des_schedule(&sim, 1000, virtual_migration_event, manager, 0);
+
+    double start = (double)ktime_get();
+    des_run_until(&sim, duration_us);
+    double elapsed = (ktime_get() - start) / 1e9;
+
+    LOG(LOG_LEVEL_INFO, "Simulated %.0f s in %.3f s (%lu events)",
+        duration_us / 1e6, elapsed, sim.nr_fired);
+    manager->sim = NULL;
+    des_destroy(&sim);
+
+    // Calculate statistics
+    manager->stats.test_duration = duration_us / 1e6;
     calculate_stats(manager);
 }
 
@@ -490,12 +818,37 @@ void run_test(hrtimer_manager_t *manager) {
 void calculate_stats(hrtimer_manager_t *manager) {
     if (!manager) return;
 
-    if (manager->stats.expired_timers > 0) {
-        manager->stats.avg_precision = 
-            (manager->stats.max_precision + manager->stats.min_precision) / 2.0;
+    uint64_t lateness_sum = 0, lateness_max = 0, lateness_min = UINT64_MAX;
+    uint64_t fired = 0;
+
+    manager->stats.total_timers = 0;
+    manager->stats.active_timers = 0;
+    manager->stats.expired_timers = 0;
+    manager->stats.overruns = 0;
+    manager->stats.wakeups = 0;
+
+    for (size_t i = 0; i < manager->nr_cpus; i++) {
+        cpu_base_t *cpu_base = &manager->cpu_bases[i];
+        pthread_mutex_lock(&cpu_base->lock);
+        manager->stats.total_timers += cpu_base->stats.started;
+        manager->stats.active_timers += cpu_base->nr_timers;
+        manager->stats.expired_timers += cpu_base->stats.expired;
+        manager->stats.overruns += cpu_base->stats.overruns;
+        manager->stats.wakeups += cpu_base->stats.events;
+        fired += cpu_base->stats.fired;
+        lateness_sum += cpu_base->stats.lateness_sum;
+        if (cpu_base->stats.lateness_max > lateness_max)
+            lateness_max = cpu_base->stats.lateness_max;
+        if (cpu_base->stats.lateness_min < lateness_min)
+            lateness_min = cpu_base->stats.lateness_min;
+        pthread_mutex_unlock(&cpu_base->lock);
     }
 
-    manager->stats.test_duration = TEST_DURATION;
+    if (fired > 0) {
+        manager->stats.avg_precision = lateness_sum / 1000.0 / fired;
+        manager->stats.max_precision = lateness_max / 1000.0;
+        manager->stats.min_precision = lateness_min / 1000.0;
+    }
 }
 
 // Print Test Statistics
@@ -510,6 +863,7 @@ void print_test_stats(hrtimer_manager_t *manager) {
     printf("Expired Timers:    %lu\n", manager->stats.expired_timers);
     printf("Timer Migrations:  %lu\n", manager->stats.migrations);
     printf("Timer Overruns:    %lu\n", manager->stats.overruns);
+    printf("Expiry Wakeups:    %lu\n", manager->stats.wakeups);
     printf("Avg Precision:     %.2f us\n", manager->stats.avg_precision);
     printf("Max Precision:     %.2f us\n", manager->stats.max_precision);
     printf("Min Precision:     %.2f us\n", manager->stats.min_precision);
@@ -518,14 +872,10 @@ void print_test_stats(hrtimer_manager_t *manager) {
     printf("\nCPU Base Details:\n");
     for (size_t i = 0; i < manager->nr_cpus; i++) {
         cpu_base_t *base = &manager->cpu_bases[i];
-        printf("  CPU %zu: %zu timers\n", i, base->nr_timers);
+        printf("  CPU %zu: %zu timers, %lu callbacks in %lu wakeups\n", i,
+            base->nr_timers, base->stats.fired, base->stats.events);
         for (size_t j = 0; j < MAX_BASES; j++) {
-            size_t count = 0;
-            hrtimer_t *timer = base->timers[j];
-            while (timer) {
-                count++;
-                timer = timer->next;
-            }
+            size_t count = base->clock_bases[j].nr_timers;
             if (count > 0) {
                 printf("    %s: %zu timers\n",
                     get_base_type_string(j), count);
@@ -540,16 +890,25 @@ void destroy_hrtimer(hrtimer_t *timer) {
 }
 
 // Destroy HRTimer Manager
+//
+// Only the test timers are the manager's; any other timer belongs to
+// whoever created it and must be cancelled first.
 void destroy_hrtimer_manager(hrtimer_manager_t *manager) {
     if (!manager) return;
 
     // Clean up timers
-    for (size_t i = 0; i < manager->nr_timers; i++) {
-        destroy_hrtimer(manager->timers[i]);
+    for (size_t i = 0; i < manager->nr_test_timers; i++) {
+        cancel_hrtimer(manager, manager->test_timers[i]);
+        destroy_hrtimer(manager->test_timers[i]);
     }
+    free(manager->test_timers);
 
     // Clean up CPU bases
     for (size_t i = 0; i < manager->nr_cpus; i++) {
+        if (manager->cpu_bases[i].nr_timers)
+            LOG(LOG_LEVEL_WARN, "CPU %zu still has %zu timers queued",
+                i, manager->cpu_bases[i].nr_timers);
+        pthread_cond_destroy(&manager->cpu_bases[i].wakeup);
         pthread_mutex_destroy(&manager->cpu_bases[i].lock);
     }
 
@@ -559,19 +918,202 @@ void destroy_hrtimer_manager(hrtimer_manager_t *manager) {
 }
 
 // Demonstrate HRTimers
-void demonstrate_hrtimers(void) {
+void demonstrate_hrtimers(const struct des_options *opts) {
     printf("Starting hrtimer demonstration...\n");
 
     // Create and run hrtimer test
     hrtimer_manager_t *manager = create_hrtimer_manager(8);
     if (manager) {
-        run_test(manager);
+        if (opts->threaded)
+            run_test(manager);
+        else
+            run_test_virtual(manager, opts->seed, opts->duration_us);
         print_test_stats(manager);
         destroy_hrtimer_manager(manager);
     }
 }
 
-int main(void) {
+/*
+ * Benchmark, no threads: one CPU base driven directly.
+ *
+ * Re-arm: n timers are armed (one per connection) and random ones are
+ * re-armed to a new expiry, as every packet on a connection would.  The
+ * timerqueue is compared with the sorted list it replaced, whose
+ * re-arm walks the list once to unlink and once to insert.
+ *
+ * Coalescing: 100k one-shot timers spread over one second are expired
+ * by an idle CPU in virtual time that jumps to each next event, for a
+ * range of soft/hard slack.  Fewer wakeups is what the slack buys.
+ */
+#define BENCH_TIMERS        100000
+#define BENCH_REARMS        200000
+#define BENCH_LIST_WORK     20000000    // list nodes visited, bounds the list runs
+#define BENCH_WINDOW        NSEC_PER_SEC
+
+static inline uint64_t bench_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The old per-base queue: singly linked, sorted by expiry
+typedef struct bench_list_timer {
+    uint64_t expires;
+    struct bench_list_timer *next;
+} bench_list_timer_t;
+
+static int bench_cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double bench_rearm_list(size_t n, uint64_t seed, size_t *rearms) {
+    bench_list_timer_t *timers = calloc(n, sizeof(*timers));
+    uint64_t *expiries = malloc(n * sizeof(uint64_t));
+    if (!timers || !expiries) {
+        free(timers);
+        free(expiries);
+        return 0;
+    }
+
+    // Preload sorted in O(n log n) rather than by n list inserts
+    for (size_t i = 0; i < n; i++)
+        expiries[i] = bench_rand(&seed) % BENCH_WINDOW;
+    qsort(expiries, n, sizeof(uint64_t), bench_cmp_u64);
+    bench_list_timer_t *head = NULL;
+    for (size_t i = n; i-- > 0; ) {
+        timers[i].expires = expiries[i];
+        timers[i].next = head;
+        head = &timers[i];
+    }
+
+    size_t ops = BENCH_LIST_WORK / n;
+    ops = ops < BENCH_REARMS ? ops : BENCH_REARMS;
+    double start = bench_now();
+    for (size_t op = 0; op < ops; op++) {
+        bench_list_timer_t *timer = &timers[bench_rand(&seed) % n];
+        bench_list_timer_t **pp = &head;
+        while (*pp != timer)
+            pp = &(*pp)->next;
+        *pp = timer->next;
+
+        timer->expires = bench_rand(&seed) % BENCH_WINDOW;
+        pp = &head;
+        while (*pp && (*pp)->expires <= timer->expires)
+            pp = &(*pp)->next;
+        timer->next = *pp;
+        *pp = timer;
+    }
+    double elapsed = bench_now() - start;
+
+    free(timers);
+    free(expiries);
+    *rearms = ops;
+    return elapsed;
+}
+
+static double bench_rearm_tree(hrtimer_manager_t *manager, size_t n, uint64_t seed) {
+    hrtimer_t *timers = calloc(n, sizeof(*timers));
+    if (!timers) return 0;
+
+    for (size_t i = 0; i < n; i++) {
+        timerqueue_init(&timers[i].node);
+        timers[i].base = HRTIMER_BASE_MONOTONIC;
+        timers[i].mode = HRTIMER_MODE_ABS;
+        timers[i].cpu = -1;
+        start_hrtimer(manager, &timers[i], bench_rand(&seed) % BENCH_WINDOW);
+    }
+
+    double start = bench_now();
+    for (size_t op = 0; op < BENCH_REARMS; op++) {
+        hrtimer_t *timer = &timers[bench_rand(&seed) % n];
+        start_hrtimer(manager, timer, bench_rand(&seed) % BENCH_WINDOW);
+    }
+    double elapsed = bench_now() - start;
+
+    for (size_t i = 0; i < n; i++)
+        cancel_hrtimer(manager, &timers[i]);
+    free(timers);
+    return elapsed;
+}
+
+static void bench_coalesce(hrtimer_manager_t *manager, uint64_t slack, uint64_t seed) {
+    hrtimer_t *timers = calloc(BENCH_TIMERS, sizeof(*timers));
+    if (!timers) return;
+
+    cpu_base_t *cpu_base = &manager->cpu_bases[0];
+    memset(&cpu_base->stats, 0, sizeof(cpu_base->stats));
+    cpu_base->stats.lateness_min = UINT64_MAX;
+
+    for (size_t i = 0; i < BENCH_TIMERS; i++) {
+        timerqueue_init(&timers[i].node);
+        timers[i].base = HRTIMER_BASE_MONOTONIC;
+        timers[i].mode = HRTIMER_MODE_ABS;
+        timers[i].cpu = -1;
+        start_hrtimer_range(manager, &timers[i], bench_rand(&seed) % BENCH_WINDOW, slack);
+    }
+
+    double start = bench_now();
+    pthread_mutex_lock(&cpu_base->lock);
+    uint64_t next = cpu_base->expires_next;
+    while (next != KTIME_MAX)
+        next = process_timers(cpu_base, next);
+    pthread_mutex_unlock(&cpu_base->lock);
+    double elapsed = bench_now() - start;
+
+    printf("  slack %6lu us  %7lu wakeups  %6.1f timers/wakeup  avg early %6.1f us"
+           "  %5.0f ns/expiry\n",
+           slack / 1000, cpu_base->stats.events,
+           (double)cpu_base->stats.fired / cpu_base->stats.events,
+           slack / 1000.0 - cpu_base->stats.lateness_sum / 1000.0 / cpu_base->stats.fired,
+           elapsed * 1e9 / cpu_base->stats.fired);
+    free(timers);
+}
+
+static int run_benchmark(void) {
+    static const size_t sizes[] = { 1000, 10000, BENCH_TIMERS };
+    static const uint64_t slacks[] = { 0, 10000, 50000, 1000000, 10000000 };
+
+    hrtimer_manager_t *manager = create_hrtimer_manager(1);
+    if (!manager) return 1;
+
+    printf("Re-arm one of n armed timers (%d re-arms per tree run)\n", BENCH_REARMS);
+    printf("  %7s %14s %14s %9s\n", "timers", "list", "timerqueue", "speedup");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        size_t list_ops = 0;
+        double list = bench_rearm_list(sizes[i], 42, &list_ops);
+        double tree = bench_rearm_tree(manager, sizes[i], 42);
+        double list_ns = list * 1e9 / (list_ops ? list_ops : 1);
+        double tree_ns = tree * 1e9 / BENCH_REARMS;
+        printf("  %7zu %11.0f ns %11.0f ns %8.1fx\n",
+               sizes[i], list_ns, tree_ns, tree_ns > 0 ? list_ns / tree_ns : 0.0);
+    }
+
+    printf("\nExpire %d one-shot timers over 1s (soft expiry uniform)\n", BENCH_TIMERS);
+    for (size_t i = 0; i < sizeof(slacks) / sizeof(slacks[0]); i++)
+        bench_coalesce(manager, slacks[i], 7);
+
+    destroy_hrtimer_manager(manager);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        return run_benchmark();
+
+    struct des_options opts;
+    if (!des_parse_options(argc, argv, &opts, TEST_DURATION * 1000000ULL))
+        return 1;
+
     // Set log level
     current_log_level = LOG_LEVEL_INFO;
 
@@ -579,7 +1121,7 @@ int main(void) {
     srand(time(NULL));
 
     // Run demonstration
-    demonstrate_hrtimers();
+    demonstrate_hrtimers(&opts);
 
     return 0;
 }
@@ -0,0 +1,2306 @@
+/*
+ * Connection Tracking Core Simulation
+ * Based on Linux kernel's nf_conntrack_core.c
+ *
+ * This is the table that nf_conntrack_standalone.c dumps through
+ * /proc/net/nf_conntrack. It implements:
+ * - A resizable hash of tuples. Chains are hlist_nulls lists ending in a
+ *   marker that holds the bucket index. Lookups take no locks.
+ * - Type-stable nf_conn memory. Objects are recycled through per-CPU
+ *   caches and never returned to malloc, standing in for
+ *   SLAB_TYPESAFE_BY_RCU. Readers take a reference and recheck the key.
+ * - Per-CPU unconfirmed lists for entries that are not yet hashed
+ * - Timeout expiry by a GC worker that scans the table in time-bounded
+ *   batches and adapts its interval to the timeouts it sees
+ * - Early drop of unassured entries when the table is full
+ * - The seq_file dumper from nf_conntrack_standalone.c. It resumes at
+ *   (bucket, skip) and holds no lock across buckets.
+ *
+ * Run with --bench [entries] to measure insert, lookup, dump, resize,
+ * early-drop and expiry rates at tens of millions of entries.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/* Tunables */
+#define HZ                      1000    // nfct_time_stamp() ticks are ms
+#define NR_CPUS                 64      // Threads that may touch the table
+#define CONNTRACK_LOCKS         1024
+#define MAX_CHAINLEN            64u
+#define NF_CT_EVICTION_RANGE    8
+#define NF_CT_HASH_MAX          (1U << 28)
+#define NF_CT_REFRESH_SLACK     HZ      // Leave ->timeout alone if this close
+#define CT_SLAB_CHUNK           8192    // Objects carved per allocation
+#define CT_PCPU_CACHE           256
+
+/* GC Parameters */
+#define GC_SCAN_INTERVAL_MAX    (60ul * HZ)
+#define GC_SCAN_INTERVAL_MIN    (1ul * HZ)
+#define GC_SCAN_INTERVAL_CLAMP  (300ul * HZ)    // Clamp timeouts to this
+#define GC_SCAN_INITIAL_COUNT   100
+#define GC_SCAN_INTERVAL_INIT   GC_SCAN_INTERVAL_MAX
+#define GC_SCAN_MAX_DURATION    (10 * HZ / 1000)
+#define GC_SCAN_EXPIRED_MAX     (64000u / HZ)
+
+
+/* Verdicts */
+#define NF_DROP   0
+#define NF_ACCEPT 1
+
+/* Connection Directions */
+enum ip_conntrack_dir {
+    IP_CT_DIR_ORIGINAL,
+    IP_CT_DIR_REPLY,
+    IP_CT_DIR_MAX
+};
+
+/* Connection Status Bits */
+enum ip_conntrack_status {
+    IPS_EXPECTED_BIT = 0,
+    IPS_SEEN_REPLY_BIT = 1,
+    IPS_ASSURED_BIT = 2,
+    IPS_CONFIRMED_BIT = 3,
+    IPS_DYING_BIT = 9,
+    IPS_OFFLOAD_BIT = 14,
+    IPS_HW_OFFLOAD_BIT = 15,
+};
+
+#define IPS_SEEN_REPLY  (1UL << IPS_SEEN_REPLY_BIT)
+#define IPS_ASSURED     (1UL << IPS_ASSURED_BIT)
+#define IPS_CONFIRMED   (1UL << IPS_CONFIRMED_BIT)
+#define IPS_DYING       (1UL << IPS_DYING_BIT)
+#define IPS_OFFLOAD     (1UL << IPS_OFFLOAD_BIT)
+#define IPS_HW_OFFLOAD  (1UL << IPS_HW_OFFLOAD_BIT)
+
+/*
+ * Nulls lists: a chain ends in a marker carrying a value instead of NULL.
+ * Hash chains carry their bucket index, so a lockless reader that followed
+ * a recycled entry onto another chain notices and restarts.
+ */
+struct hlist_nulls_node {
+    _Atomic(struct hlist_nulls_node *) next;
+    _Atomic(struct hlist_nulls_node *) *pprev;  // Writers only, NULL if unhashed
+};
+
+struct hlist_nulls_head {
+    _Atomic(struct hlist_nulls_node *) first;
+};
+
+#define NULLS_MARKER(v)        ((struct hlist_nulls_node *)(((uintptr_t)(v) << 1) | 1))
+#define is_a_nulls(p)          ((uintptr_t)(p) & 1)
+#define get_nulls_value(p)     ((unsigned int)((uintptr_t)(p) >> 1))
+
+#define UNCONFIRMED_NULLS_VAL  (1U << 30)       // Plus the owning cpu
+#define CT_FREE_NULLS_VAL      ((1U << 31) - 1)
+
+/* Address Union */
+union nf_inet_addr {
+    uint32_t all[4];
+    uint32_t ip;
+    uint32_t ip6[4];
+};
+
+/* Connection Tuple: everything before dst.dir is the key */
+struct nf_conntrack_tuple {
+    struct {
+        union nf_inet_addr u3;
+        uint16_t port;              // Network order; ICMP id
+        uint16_t l3num;
+    } src;
+    struct {
+        union nf_inet_addr u3;
+        union {
+            uint16_t port;          // Network order
+            struct {
+                uint8_t type, code;
+            } icmp;
+        } u;
+        uint8_t protonum;
+        uint8_t dir;
+    } dst;
+};
+
+#define NF_CT_TUPLE_KEY_LEN offsetof(struct nf_conntrack_tuple, dst.dir)
+
+struct nf_conntrack_tuple_hash {
+    struct hlist_nulls_node hnnode;
+    struct nf_conntrack_tuple tuple;
+};
+
+/* Accounting Extension */
+struct nf_conn_counter {
+    _Atomic uint64_t packets;
+    _Atomic uint64_t bytes;
+};
+
+/* Connection */
+struct nf_conn {
+    atomic_uint use;                // Zero while on a free list
+    _Atomic uint32_t timeout;       // Relative until confirmed, then absolute
+    atomic_ulong status;
+    uint16_t cpu;                   // Owner of the unconfirmed list
+    uint16_t zone;
+    uint32_t mark;
+    uint64_t start;                 // Creation time in ns, for delta-time
+    struct nf_conn_counter *acct;   // NULL unless nf_ct_acct
+    struct nf_conntrack_tuple_hash tuplehash[IP_CT_DIR_MAX];
+};
+
+/* Per-CPU Statistics, in /proc/net/stat/nf_conntrack order */
+struct ip_conntrack_stat {
+    unsigned int found;
+    unsigned int invalid;
+    unsigned int insert;
+    unsigned int insert_failed;
+    unsigned int clash_resolve;
+    unsigned int drop;
+    unsigned int early_drop;
+    unsigned int error;
+    unsigned int expect_new;
+    unsigned int expect_create;
+    unsigned int expect_delete;
+    unsigned int search_restart;
+    unsigned int chaintoolong;
+};
+
+/* Per-CPU State: only the owning thread touches cache and stat */
+struct ct_pcpu {
+    pthread_mutex_t lock;           // Protects unconfirmed
+    struct hlist_nulls_head unconfirmed;
+    struct ip_conntrack_stat stat;
+    unsigned int ncache;
+    struct nf_conn *cache[CT_PCPU_CACHE];
+} __attribute__((aligned(64)));
+
+/* GC Work */
+struct conntrack_gc_work {
+    uint32_t next_bucket;
+    unsigned long avg_timeout;
+    long count;
+    uint32_t start_time;
+    bool exiting;
+    atomic_bool early_drop;         // Set by a failed allocation
+    unsigned long batches;
+    unsigned long reaped;
+};
+
+/* Retired Hash Tables */
+struct ct_retired_table {
+    struct hlist_nulls_head *hash;
+    struct ct_retired_table *next;
+};
+
+/* Global State */
+static struct hlist_nulls_head *_Atomic nf_conntrack_hash;
+static atomic_uint nf_conntrack_htable_size;
+static atomic_uint nf_conntrack_generation;     // Seqcount, odd while resizing
+static pthread_mutex_t nf_conntrack_locks[CONNTRACK_LOCKS];
+static pthread_mutex_t nf_conntrack_resize_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct ct_retired_table *nf_conntrack_retired;
+static unsigned int nf_conntrack_max;
+static atomic_uint nf_ct_count;
+static bool nf_ct_acct;
+static bool nf_ct_tstamp;
+static uint64_t nf_conntrack_hash_rnd[2];
+static struct ct_pcpu ct_pcpu[NR_CPUS];
+static atomic_int ct_nr_cpus;
+static __thread int ct_cpu = -1;
+static _Atomic uint32_t nfct_time_warp;         // Lets --bench age the table
+static struct conntrack_gc_work conntrack_gc_work;
+
+/* Protocol Timeouts in ticks, the net.netfilter.nf_conntrack_*_timeout sysctls */
+static unsigned int nf_ct_generic_timeout = 600 * HZ;
+static unsigned int nf_ct_tcp_timeout_syn_sent = 120 * HZ;
+static unsigned int nf_ct_tcp_timeout_syn_recv = 60 * HZ;
+static unsigned int nf_ct_tcp_timeout_established = 5 * 24 * 3600 * HZ;
+static unsigned int nf_ct_udp_timeout = 30 * HZ;
+static unsigned int nf_ct_udp_timeout_stream = 120 * HZ;
+static unsigned int nf_ct_icmp_timeout = 30 * HZ;
+
+/* Object Depot, behind the per-CPU caches */
+static struct {
+    pthread_mutex_t lock;
+    struct nf_conn **objs;
+    size_t nr, cap;
+    struct nf_conn **chunks;
+    size_t nr_chunks, cap_chunks;
+} ct_depot = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/* Clock */
+static inline uint32_t nfct_time_stamp(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint32_t)(ts.tv_sec * HZ + ts.tv_nsec / (1000000000 / HZ)) +
+           atomic_load_explicit(&nfct_time_warp, memory_order_relaxed);
+}
+
+static inline uint64_t ktime_get_real_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Per-CPU Access */
+static inline struct ct_pcpu *this_cpu_ct(void)
+{
+    if (ct_cpu < 0) {
+        ct_cpu = atomic_fetch_add(&ct_nr_cpus, 1);
+        if (ct_cpu >= NR_CPUS) {
+            fprintf(stderr, "nf_conntrack: more than %d threads\n", NR_CPUS);
+            abort();
+        }
+    }
+    return &ct_pcpu[ct_cpu];
+}
+
+#define NF_CT_STAT_INC(count) (this_cpu_ct()->stat.count++)
+#define NF_CT_STAT_ADD(count, v) (this_cpu_ct()->stat.count += (v))
+
+/* Seqcount */
+static inline unsigned int read_seqcount_begin(atomic_uint *s)
+{
+    unsigned int seq;
+
+    while ((seq = atomic_load_explicit(s, memory_order_acquire)) & 1)
+        sched_yield();
+    return seq;
+}
+
+static inline bool read_seqcount_retry(atomic_uint *s, unsigned int seq)
+{
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(s, memory_order_relaxed) != seq;
+}
+
+/* Refcount and Status Helpers */
+static inline bool atomic_inc_not_zero(atomic_uint *v)
+{
+    unsigned int old = atomic_load_explicit(v, memory_order_relaxed);
+
+    do {
+        if (!old)
+            return false;
+    } while (!atomic_compare_exchange_weak_explicit(v, &old, old + 1,
+                                                    memory_order_acquire,
+                                                    memory_order_relaxed));
+    return true;
+}
+
+static inline bool test_bit_ct(const struct nf_conn *ct, unsigned long mask)
+{
+    return atomic_load_explicit(&((struct nf_conn *)ct)->status,
+                                memory_order_acquire) & mask;
+}
+
+static inline void set_bit_ct(struct nf_conn *ct, unsigned long mask)
+{
+    atomic_fetch_or_explicit(&ct->status, mask, memory_order_release);
+}
+
+static inline bool test_and_set_bit_ct(struct nf_conn *ct, unsigned long mask)
+{
+    return atomic_fetch_or_explicit(&ct->status, mask, memory_order_acq_rel) & mask;
+}
+
+static inline bool nf_ct_is_confirmed(const struct nf_conn *ct)
+{
+    return test_bit_ct(ct, IPS_CONFIRMED);
+}
+
+static inline bool nf_ct_is_dying(const struct nf_conn *ct)
+{
+    return test_bit_ct(ct, IPS_DYING);
+}
+
+static inline bool nf_ct_is_expired(const struct nf_conn *ct)
+{
+    return (int32_t)(atomic_load_explicit(&((struct nf_conn *)ct)->timeout,
+                                          memory_order_relaxed) -
+                     nfct_time_stamp()) <= 0;
+}
+
+/* Confirmed, expired and not already being killed */
+static inline bool nf_ct_should_gc(const struct nf_conn *ct)
+{
+    return nf_ct_is_expired(ct) && nf_ct_is_confirmed(ct) &&
+           !nf_ct_is_dying(ct);
+}
+
+static inline long nf_ct_expires(const struct nf_conn *ct)
+{
+    int32_t left = (int32_t)(atomic_load_explicit(&((struct nf_conn *)ct)->timeout,
+                                                  memory_order_relaxed) -
+                             nfct_time_stamp());
+
+    return left > 0 ? left : 0;
+}
+
+static inline struct nf_conn *
+nf_ct_tuplehash_to_ctrack(const struct nf_conntrack_tuple_hash *h)
+{
+    return (struct nf_conn *)((char *)(h - h->tuple.dst.dir) -
+                              offsetof(struct nf_conn, tuplehash));
+}
+
+#define NF_CT_DIRECTION(h) ((h)->tuple.dst.dir)
+
+static inline uint8_t nf_ct_protonum(const struct nf_conn *ct)
+{
+    return ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple.dst.protonum;
+}
+
+static inline uint16_t nf_ct_l3num(const struct nf_conn *ct)
+{
+    return ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple.src.l3num;
+}
+
+static inline bool nf_ct_tuple_equal(const struct nf_conntrack_tuple *t1,
+                                     const struct nf_conntrack_tuple *t2)
+{
+    return memcmp(t1, t2, NF_CT_TUPLE_KEY_LEN) == 0;
+}
+
+static inline bool nf_ct_key_equal(struct nf_conntrack_tuple_hash *h,
+                                   const struct nf_conntrack_tuple *tuple,
+                                   uint16_t zone)
+{
+    struct nf_conn *ct = nf_ct_tuplehash_to_ctrack(h);
+
+    /* A recycled entry may carry the key before it is confirmed */
+    return nf_ct_tuple_equal(tuple, &h->tuple) && ct->zone == zone &&
+           nf_ct_is_confirmed(ct);
+}
+
+/* Nulls List Operations */
+static inline struct nf_conntrack_tuple_hash *
+hlist_nulls_entry(struct hlist_nulls_node *n)
+{
+    return (struct nf_conntrack_tuple_hash *)n;
+}
+
+static inline struct hlist_nulls_node *
+hlist_nulls_first_rcu(struct hlist_nulls_head *h)
+{
+    return atomic_load_explicit(&h->first, memory_order_acquire);
+}
+
+static inline struct hlist_nulls_node *
+hlist_nulls_next_rcu(struct hlist_nulls_node *n)
+{
+    return atomic_load_explicit(&n->next, memory_order_acquire);
+}
+
+static inline void INIT_HLIST_NULLS_HEAD(struct hlist_nulls_head *h,
+                                         unsigned int nulls)
+{
+    atomic_init(&h->first, NULLS_MARKER(nulls));
+}
+
+static void hlist_nulls_add_head_rcu(struct hlist_nulls_node *n,
+                                     struct hlist_nulls_head *h)
+{
+    struct hlist_nulls_node *first;
+
+    first = atomic_load_explicit(&h->first, memory_order_relaxed);
+    atomic_store_explicit(&n->next, first, memory_order_relaxed);
+    n->pprev = &h->first;
+    if (!is_a_nulls(first))
+        first->pprev = &n->next;
+    atomic_store_explicit(&h->first, n, memory_order_release);
+}
+
+/* Leaves n->next alone so a reader standing on n can walk on */
+static void hlist_nulls_del_rcu(struct hlist_nulls_node *n)
+{
+    struct hlist_nulls_node *next;
+
+    next = atomic_load_explicit(&n->next, memory_order_relaxed);
+    atomic_store_explicit(n->pprev, next, memory_order_release);
+    if (!is_a_nulls(next))
+        next->pprev = n->pprev;
+    n->pprev = NULL;
+}
+
+/* SipHash-2-4 over the 39-byte tuple key */
+#define SIPROUND(v0, v1, v2, v3) do { \
+    v0 += v1; v1 = (v1 << 13) | (v1 >> 51); v1 ^= v0; v0 = (v0 << 32) | (v0 >> 32); \
+    v2 += v3; v3 = (v3 << 16) | (v3 >> 48); v3 ^= v2; \
+    v0 += v3; v3 = (v3 << 21) | (v3 >> 43); v3 ^= v0; \
+    v2 += v1; v1 = (v1 << 17) | (v1 >> 47); v1 ^= v2; v2 = (v2 << 32) | (v2 >> 32); \
+} while (0)
+
+static uint32_t hash_conntrack_raw(const struct nf_conntrack_tuple *tuple,
+                                   uint16_t zone)
+{
+    uint64_t k0 = nf_conntrack_hash_rnd[0] ^ zone;
+    uint64_t k1 = nf_conntrack_hash_rnd[1];
+    uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+    uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+    uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+    uint64_t v3 = 0x7465646279746573ULL ^ k1;
+    uint64_t w[5] = { 0 };
+    int i;
+
+    memcpy(w, tuple, NF_CT_TUPLE_KEY_LEN);
+    w[4] |= (uint64_t)NF_CT_TUPLE_KEY_LEN << 56;
+    for (i = 0; i < 5; i++) {
+        v3 ^= w[i];
+        SIPROUND(v0, v1, v2, v3);
+        SIPROUND(v0, v1, v2, v3);
+        v0 ^= w[i];
+    }
+    v2 ^= 0xff;
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    return (uint32_t)(v0 ^ v1 ^ v2 ^ v3);
+}
+
+/* Map a raw hash onto [0, size) without a division */
+static inline unsigned int reciprocal_scale(uint32_t val, uint32_t ep_ro)
+{
+    return (unsigned int)(((uint64_t)val * ep_ro) >> 32);
+}
+
+/* Table Snapshot */
+void nf_conntrack_get_ht(struct hlist_nulls_head **hash, unsigned int *hsize)
+{
+    struct hlist_nulls_head *hptr;
+    unsigned int sequence, hsz;
+
+    do {
+        sequence = read_seqcount_begin(&nf_conntrack_generation);
+        hsz = atomic_load_explicit(&nf_conntrack_htable_size, memory_order_relaxed);
+        hptr = atomic_load_explicit(&nf_conntrack_hash, memory_order_acquire);
+    } while (read_seqcount_retry(&nf_conntrack_generation, sequence));
+
+    *hash = hptr;
+    *hsize = hsz;
+}
+
+uint32_t nf_conntrack_count(void)
+{
+    return atomic_load_explicit(&nf_ct_count, memory_order_relaxed);
+}
+
+/* Bucket Locks */
+static inline void nf_conntrack_lock(unsigned int h)
+{
+    pthread_mutex_lock(&nf_conntrack_locks[h % CONNTRACK_LOCKS]);
+}
+
+static inline void nf_conntrack_unlock(unsigned int h)
+{
+    pthread_mutex_unlock(&nf_conntrack_locks[h % CONNTRACK_LOCKS]);
+}
+
+static void nf_conntrack_double_unlock(unsigned int h1, unsigned int h2)
+{
+    h1 %= CONNTRACK_LOCKS;
+    h2 %= CONNTRACK_LOCKS;
+    pthread_mutex_unlock(&nf_conntrack_locks[h1]);
+    if (h1 != h2)
+        pthread_mutex_unlock(&nf_conntrack_locks[h2]);
+}
+
+/* Returns true if a resize happened meanwhile and the caller must retry */
+static bool nf_conntrack_double_lock(unsigned int h1, unsigned int h2,
+                                     unsigned int sequence)
+{
+    h1 %= CONNTRACK_LOCKS;
+    h2 %= CONNTRACK_LOCKS;
+    if (h1 <= h2) {
+        pthread_mutex_lock(&nf_conntrack_locks[h1]);
+        if (h1 != h2)
+            pthread_mutex_lock(&nf_conntrack_locks[h2]);
+    } else {
+        pthread_mutex_lock(&nf_conntrack_locks[h2]);
+        pthread_mutex_lock(&nf_conntrack_locks[h1]);
+    }
+    if (read_seqcount_retry(&nf_conntrack_generation, sequence)) {
+        nf_conntrack_double_unlock(h1, h2);
+        return true;
+    }
+    return false;
+}
+
+static void nf_conntrack_all_lock(void)
+{
+    int i;
+
+    for (i = 0; i < CONNTRACK_LOCKS; i++)
+        pthread_mutex_lock(&nf_conntrack_locks[i]);
+}
+
+static void nf_conntrack_all_unlock(void)
+{
+    int i;
+
+    for (i = CONNTRACK_LOCKS - 1; i >= 0; i--)
+        pthread_mutex_unlock(&nf_conntrack_locks[i]);
+}
+
+/* Object Allocation */
+static bool ct_depot_reserve(size_t extra)
+{
+    struct nf_conn **objs;
+    size_t cap;
+
+    if (ct_depot.nr + extra <= ct_depot.cap)
+        return true;
+    cap = ct_depot.cap ? ct_depot.cap * 2 : CT_SLAB_CHUNK;
+    while (cap < ct_depot.nr + extra)
+        cap *= 2;
+    objs = realloc(ct_depot.objs, cap * sizeof(*objs));
+    if (!objs)
+        return false;
+    ct_depot.objs = objs;
+    ct_depot.cap = cap;
+    return true;
+}
+
+/* Carve a fresh chunk into the depot; called with ct_depot.lock held */
+static bool ct_slab_grow(void)
+{
+    struct nf_conn *chunk, **chunks;
+    size_t i;
+
+    if (ct_depot.nr_chunks == ct_depot.cap_chunks) {
+        size_t cap = ct_depot.cap_chunks ? ct_depot.cap_chunks * 2 : 64;
+
+        chunks = realloc(ct_depot.chunks, cap * sizeof(*chunks));
+        if (!chunks)
+            return false;
+        ct_depot.chunks = chunks;
+        ct_depot.cap_chunks = cap;
+    }
+    if (!ct_depot_reserve(CT_SLAB_CHUNK))
+        return false;
+    chunk = calloc(CT_SLAB_CHUNK, sizeof(*chunk));
+    if (!chunk)
+        return false;
+    ct_depot.chunks[ct_depot.nr_chunks++] = chunk;
+
+    for (i = 0; i < CT_SLAB_CHUNK; i++) {
+        struct nf_conn *ct = &chunk[i];
+
+        /* Direction is fixed per slot for the object's whole life */
+        ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple.dst.dir = IP_CT_DIR_ORIGINAL;
+        ct->tuplehash[IP_CT_DIR_REPLY].tuple.dst.dir = IP_CT_DIR_REPLY;
+        atomic_init(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode.next,
+                    NULLS_MARKER(CT_FREE_NULLS_VAL));
+        atomic_init(&ct->tuplehash[IP_CT_DIR_REPLY].hnnode.next,
+                    NULLS_MARKER(CT_FREE_NULLS_VAL));
+        ct_depot.objs[ct_depot.nr++] = ct;
+    }
+    return true;
+}
+
+static void ct_slab_refill(struct ct_pcpu *pcpu)
+{
+    size_t n;
+
+    pthread_mutex_lock(&ct_depot.lock);
+    if (!ct_depot.nr && !ct_slab_grow()) {
+        pthread_mutex_unlock(&ct_depot.lock);
+        return;
+    }
+    n = ct_depot.nr < CT_PCPU_CACHE / 2 ? ct_depot.nr : CT_PCPU_CACHE / 2;
+    ct_depot.nr -= n;
+    memcpy(pcpu->cache, &ct_depot.objs[ct_depot.nr], n * sizeof(pcpu->cache[0]));
+    pcpu->ncache = n;
+    pthread_mutex_unlock(&ct_depot.lock);
+}
+
+static struct nf_conn *ct_slab_alloc(struct ct_pcpu *pcpu)
+{
+    if (!pcpu->ncache)
+        ct_slab_refill(pcpu);
+    if (!pcpu->ncache)
+        return NULL;
+    return pcpu->cache[--pcpu->ncache];
+}
+
+static void ct_slab_free(struct ct_pcpu *pcpu, struct nf_conn *ct)
+{
+    if (pcpu->ncache == CT_PCPU_CACHE) {
+        unsigned int n = CT_PCPU_CACHE / 2;
+
+        pthread_mutex_lock(&ct_depot.lock);
+        if (ct_depot_reserve(n)) {
+            pcpu->ncache -= n;
+            memcpy(&ct_depot.objs[ct_depot.nr], &pcpu->cache[pcpu->ncache],
+                   n * sizeof(pcpu->cache[0]));
+            ct_depot.nr += n;
+        }
+        pthread_mutex_unlock(&ct_depot.lock);
+        if (pcpu->ncache == CT_PCPU_CACHE)
+            return;     // Leak rather than lose type stability
+    }
+    pcpu->cache[pcpu->ncache++] = ct;
+}
+
+/* Unconfirmed Lists */
+static void nf_ct_add_to_unconfirmed_list(struct nf_conn *ct)
+{
+    struct ct_pcpu *pcpu = this_cpu_ct();
+
+    ct->cpu = (uint16_t)(pcpu - ct_pcpu);
+    pthread_mutex_lock(&pcpu->lock);
+    hlist_nulls_add_head_rcu(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode,
+                             &pcpu->unconfirmed);
+    pthread_mutex_unlock(&pcpu->lock);
+}
+
+static void nf_ct_del_from_unconfirmed_list(struct nf_conn *ct)
+{
+    struct ct_pcpu *pcpu = &ct_pcpu[ct->cpu];
+
+    pthread_mutex_lock(&pcpu->lock);
+    if (ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode.pprev)
+        hlist_nulls_del_rcu(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode);
+    pthread_mutex_unlock(&pcpu->lock);
+}
+
+/* Release */
+static void nf_conntrack_free(struct nf_conn *ct)
+{
+    /* Never confirmed: still on, or already off, its unconfirmed list */
+    if (ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode.pprev)
+        nf_ct_del_from_unconfirmed_list(ct);
+
+    free(ct->acct);
+    ct->acct = NULL;
+    atomic_fetch_sub_explicit(&nf_ct_count, 1, memory_order_relaxed);
+    ct_slab_free(this_cpu_ct(), ct);
+}
+
+static inline void nf_ct_put(struct nf_conn *ct)
+{
+    if (atomic_fetch_sub_explicit(&ct->use, 1, memory_order_acq_rel) == 1)
+        nf_conntrack_free(ct);
+}
+
+static void clean_from_lists(struct nf_conn *ct)
+{
+    struct hlist_nulls_head *ct_hash;
+    unsigned int hash, reply_hash, sequence, hsize;
+
+    do {
+        sequence = read_seqcount_begin(&nf_conntrack_generation);
+        nf_conntrack_get_ht(&ct_hash, &hsize);
+        hash = reciprocal_scale(
+            hash_conntrack_raw(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple, ct->zone),
+            hsize);
+        reply_hash = reciprocal_scale(
+            hash_conntrack_raw(&ct->tuplehash[IP_CT_DIR_REPLY].tuple, ct->zone),
+            hsize);
+    } while (nf_conntrack_double_lock(hash, reply_hash, sequence));
+
+    hlist_nulls_del_rcu(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode);
+    hlist_nulls_del_rcu(&ct->tuplehash[IP_CT_DIR_REPLY].hnnode);
+
+    nf_conntrack_double_unlock(hash, reply_hash);
+}
+
+/* Unhash and drop the table's reference; false if someone else did */
+bool nf_ct_delete(struct nf_conn *ct)
+{
+    if (test_and_set_bit_ct(ct, IPS_DYING))
+        return false;
+
+    clean_from_lists(ct);
+    nf_ct_put(ct);
+    return true;
+}
+
+static inline bool nf_ct_kill(struct nf_conn *ct)
+{
+    return nf_ct_delete(ct);
+}
+
+static void nf_ct_gc_expired(struct nf_conn *ct)
+{
+    if (!atomic_inc_not_zero(&ct->use))
+        return;
+
+    if (nf_ct_should_gc(ct))
+        nf_ct_kill(ct);
+
+    nf_ct_put(ct);
+}
+
+/* Lookup */
+static struct nf_conntrack_tuple_hash *
+____nf_conntrack_find(uint16_t zone, const struct nf_conntrack_tuple *tuple,
+                      uint32_t hash)
+{
+    struct nf_conntrack_tuple_hash *h;
+    struct hlist_nulls_head *ct_hash;
+    struct hlist_nulls_node *n;
+    unsigned int bucket, hsize, sequence;
+
+begin:
+    sequence = read_seqcount_begin(&nf_conntrack_generation);
+    nf_conntrack_get_ht(&ct_hash, &hsize);
+    bucket = reciprocal_scale(hash, hsize);
+
+    for (n = hlist_nulls_first_rcu(&ct_hash[bucket]); !is_a_nulls(n);
+         n = hlist_nulls_next_rcu(n)) {
+        struct nf_conn *ct;
+
+        h = hlist_nulls_entry(n);
+        if (!nf_ct_key_equal(h, tuple, zone))
+            continue;
+
+        /*
+         * Only a match has its timeout read: for a reply-direction node
+         * that is another cache line. Expired entries that do not match
+         * are left to the GC worker.
+         */
+        ct = nf_ct_tuplehash_to_ctrack(h);
+        if (nf_ct_is_expired(ct)) {
+            nf_ct_gc_expired(ct);
+            continue;
+        }
+        return h;
+    }
+    /*
+     * if the nulls value we got at the end of this lookup is
+     * not the expected one, we must restart lookup.
+     * We probably met an item that was moved to another chain.
+     */
+    if (get_nulls_value(n) != bucket) {
+        NF_CT_STAT_INC(search_restart);
+        goto begin;
+    }
+
+    /* A resize may have moved the entry behind us with a matching marker */
+    if (read_seqcount_retry(&nf_conntrack_generation, sequence))
+        goto begin;
+
+    return NULL;
+}
+
+/* Find a connection corresponding to a tuple, taking a reference */
+static struct nf_conntrack_tuple_hash *
+__nf_conntrack_find_get(uint16_t zone, const struct nf_conntrack_tuple *tuple,
+                        uint32_t hash)
+{
+    struct nf_conntrack_tuple_hash *h;
+    struct nf_conn *ct;
+
+    for (;;) {
+        h = ____nf_conntrack_find(zone, tuple, hash);
+        if (!h)
+            return NULL;
+
+        ct = nf_ct_tuplehash_to_ctrack(h);
+        if (atomic_inc_not_zero(&ct->use)) {
+            if (nf_ct_key_equal(h, tuple, zone))
+                return h;
+            /* Recycled between the walk and the reference: look again */
+            nf_ct_put(ct);
+        }
+    }
+}
+
+struct nf_conntrack_tuple_hash *
+nf_conntrack_find_get(uint16_t zone, const struct nf_conntrack_tuple *tuple)
+{
+    return __nf_conntrack_find_get(zone, tuple, hash_conntrack_raw(tuple, zone));
+}
+
+/* Early Drop */
+static unsigned int early_drop_list(struct hlist_nulls_head *head)
+{
+    struct nf_conntrack_tuple_hash *h;
+    struct hlist_nulls_node *n;
+    unsigned int drops = 0;
+    struct nf_conn *tmp;
+
+    for (n = hlist_nulls_first_rcu(head); !is_a_nulls(n);
+         n = hlist_nulls_next_rcu(n)) {
+        h = hlist_nulls_entry(n);
+        tmp = nf_ct_tuplehash_to_ctrack(h);
+
+        if (nf_ct_is_expired(tmp)) {
+            nf_ct_gc_expired(tmp);
+            continue;
+        }
+
+        if (test_bit_ct(tmp, IPS_ASSURED) || nf_ct_is_dying(tmp))
+            continue;
+
+        if (!atomic_inc_not_zero(&tmp->use))
+            continue;
+
+        /* Recheck after the reference: tmp may have been recycled */
+        if (nf_ct_is_confirmed(tmp) && !test_bit_ct(tmp, IPS_ASSURED) &&
+            nf_ct_delete(tmp))
+            drops++;
+
+        nf_ct_put(tmp);
+    }
+
+    return drops;
+}
+
+static bool early_drop(uint32_t hash)
+{
+    unsigned int i, bucket = 0;
+
+    for (i = 0; i < NF_CT_EVICTION_RANGE; i++) {
+        struct hlist_nulls_head *ct_hash;
+        unsigned int hsize, drops;
+
+        nf_conntrack_get_ht(&ct_hash, &hsize);
+        if (!i)
+            bucket = reciprocal_scale(hash, hsize);
+        else
+            bucket = (bucket + 1) % hsize;
+
+        drops = early_drop_list(&ct_hash[bucket]);
+        if (drops) {
+            NF_CT_STAT_ADD(early_drop, drops);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Allocation */
+static struct nf_conn *
+__nf_conntrack_alloc(uint16_t zone, const struct nf_conntrack_tuple *orig,
+                     const struct nf_conntrack_tuple *repl, uint32_t hash)
+{
+    unsigned int ct_count;
+    struct nf_conn *ct;
+
+    /* We don't want any race condition at early drop stage */
+    ct_count = atomic_fetch_add_explicit(&nf_ct_count, 1, memory_order_relaxed) + 1;
+
+    if (nf_conntrack_max && ct_count > nf_conntrack_max) {
+        if (!early_drop(hash)) {
+            if (!atomic_load_explicit(&conntrack_gc_work.early_drop,
+                                      memory_order_relaxed))
+                atomic_store(&conntrack_gc_work.early_drop, true);
+            atomic_fetch_sub_explicit(&nf_ct_count, 1, memory_order_relaxed);
+            NF_CT_STAT_INC(drop);
+            return NULL;
+        }
+    }
+
+    ct = ct_slab_alloc(this_cpu_ct());
+    if (!ct) {
+        atomic_fetch_sub_explicit(&nf_ct_count, 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    /*
+     * Readers may still be looking at this object's old incarnation, so
+     * the hash nodes' next pointers are left alone. Everything else is
+     * rewritten while use is zero and published by the release below.
+     */
+    atomic_store_explicit(&ct->status, 0, memory_order_relaxed);
+    atomic_store_explicit(&ct->timeout, 0, memory_order_relaxed);
+    ct->zone = zone;
+    ct->mark = 0;
+    ct->start = nf_ct_tstamp ? ktime_get_real_ns() : 0;
+    ct->acct = nf_ct_acct ? calloc(IP_CT_DIR_MAX, sizeof(*ct->acct)) : NULL;
+    memcpy(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple, orig, NF_CT_TUPLE_KEY_LEN);
+    memcpy(&ct->tuplehash[IP_CT_DIR_REPLY].tuple, repl, NF_CT_TUPLE_KEY_LEN);
+    ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode.pprev = NULL;
+    ct->tuplehash[IP_CT_DIR_REPLY].hnnode.pprev = NULL;
+
+    /* Because we use type-stable memory, this must be last */
+    atomic_store_explicit(&ct->use, 1, memory_order_release);
+    return ct;
+}
+
+struct nf_conn *nf_conntrack_alloc(uint16_t zone,
+                                   const struct nf_conntrack_tuple *orig,
+                                   const struct nf_conntrack_tuple *repl)
+{
+    return __nf_conntrack_alloc(zone, orig, repl, 0);
+}
+
+static void nf_ct_invert_tuple(struct nf_conntrack_tuple *inverse,
+                               const struct nf_conntrack_tuple *orig)
+{
+    memset(inverse, 0, sizeof(*inverse));
+    inverse->src.l3num = orig->src.l3num;
+    inverse->src.u3 = orig->dst.u3;
+    inverse->dst.u3 = orig->src.u3;
+    inverse->dst.protonum = orig->dst.protonum;
+    inverse->dst.dir = !orig->dst.dir;
+
+    switch (orig->dst.protonum) {
+    case IPPROTO_ICMP:
+    case IPPROTO_ICMPV6:
+        /* Echo request <-> echo reply, id stays */
+        inverse->src.port = orig->src.port;
+        inverse->dst.u.icmp.code = orig->dst.u.icmp.code;
+        if (orig->dst.u.icmp.type == 8)
+            inverse->dst.u.icmp.type = 0;
+        else if (orig->dst.u.icmp.type == 128)
+            inverse->dst.u.icmp.type = 129;
+        else
+            inverse->dst.u.icmp.type = orig->dst.u.icmp.type;
+        break;
+    default:
+        inverse->src.port = orig->dst.u.port;
+        inverse->dst.u.port = orig->src.port;
+        break;
+    }
+}
+
+/* Allocate a new conntrack and park it on this cpu's unconfirmed list */
+static struct nf_conntrack_tuple_hash *
+init_conntrack(uint16_t zone, const struct nf_conntrack_tuple *tuple,
+               uint32_t hash)
+{
+    struct nf_conntrack_tuple repl_tuple;
+    struct nf_conn *ct;
+
+    nf_ct_invert_tuple(&repl_tuple, tuple);
+
+    ct = __nf_conntrack_alloc(zone, tuple, &repl_tuple, hash);
+    if (!ct)
+        return NULL;
+
+    nf_ct_add_to_unconfirmed_list(ct);
+    return &ct->tuplehash[IP_CT_DIR_ORIGINAL];
+}
+
+/* Confirm a connection given skb; places it in hash table */
+int __nf_conntrack_confirm(struct nf_conn **ctp)
+{
+    struct nf_conn *ct = *ctp, *existing;
+    struct nf_conntrack_tuple_hash *h;
+    struct hlist_nulls_head *ct_hash;
+    struct hlist_nulls_node *n;
+    unsigned int hash, reply_hash, sequence, hsize, chainlen;
+    uint32_t orig_raw, repl_raw;
+
+    orig_raw = hash_conntrack_raw(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple, ct->zone);
+    repl_raw = hash_conntrack_raw(&ct->tuplehash[IP_CT_DIR_REPLY].tuple, ct->zone);
+
+    do {
+        sequence = read_seqcount_begin(&nf_conntrack_generation);
+        nf_conntrack_get_ht(&ct_hash, &hsize);
+        hash = reciprocal_scale(orig_raw, hsize);
+        reply_hash = reciprocal_scale(repl_raw, hsize);
+    } while (nf_conntrack_double_lock(hash, reply_hash, sequence));
+
+    /* Off the unconfirmed list before the dying check; see unconfirmed_destroy */
+    nf_ct_del_from_unconfirmed_list(ct);
+
+    if (nf_ct_is_dying(ct))
+        goto out_drop;
+
+    /*
+     * See if there's one in the list already, including reverse:
+     * NAT could have grabbed it without realizing, since we're
+     * not in the hash. If there is, we lost race.
+     */
+    chainlen = 0;
+    for (n = hlist_nulls_first_rcu(&ct_hash[hash]); !is_a_nulls(n);
+         n = hlist_nulls_next_rcu(n)) {
+        h = hlist_nulls_entry(n);
+        if (nf_ct_key_equal(h, &ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple, ct->zone))
+            goto out_clash;
+        if (chainlen++ > MAX_CHAINLEN)
+            goto chaintoolong;
+    }
+
+    chainlen = 0;
+    for (n = hlist_nulls_first_rcu(&ct_hash[reply_hash]); !is_a_nulls(n);
+         n = hlist_nulls_next_rcu(n)) {
+        h = hlist_nulls_entry(n);
+        if (nf_ct_key_equal(h, &ct->tuplehash[IP_CT_DIR_REPLY].tuple, ct->zone))
+            goto out_clash;
+        if (chainlen++ > MAX_CHAINLEN)
+            goto chaintoolong;
+    }
+
+    /* Timeout is relative to confirmation time, not original setting time */
+    atomic_store_explicit(&ct->timeout,
+                          atomic_load_explicit(&ct->timeout, memory_order_relaxed) +
+                          nfct_time_stamp(),
+                          memory_order_relaxed);
+
+    set_bit_ct(ct, IPS_CONFIRMED);
+
+    /* The table holds its own reference from here on */
+    atomic_fetch_add_explicit(&ct->use, 1, memory_order_relaxed);
+    hlist_nulls_add_head_rcu(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode,
+                             &ct_hash[hash]);
+    hlist_nulls_add_head_rcu(&ct->tuplehash[IP_CT_DIR_REPLY].hnnode,
+                             &ct_hash[reply_hash]);
+    nf_conntrack_double_unlock(hash, reply_hash);
+    NF_CT_STAT_INC(insert);
+    return NF_ACCEPT;
+
+out_clash:
+    /* Another cpu confirmed the same flow first: continue with its entry */
+    existing = nf_ct_tuplehash_to_ctrack(h);
+    if (!nf_ct_is_dying(existing) && !nf_ct_is_expired(existing) &&
+        atomic_inc_not_zero(&existing->use)) {
+        nf_conntrack_double_unlock(hash, reply_hash);
+        NF_CT_STAT_INC(clash_resolve);
+        nf_ct_put(ct);
+        *ctp = existing;
+        return NF_ACCEPT;
+    }
+    goto out_drop;
+chaintoolong:
+    NF_CT_STAT_INC(chaintoolong);
+out_drop:
+    nf_conntrack_double_unlock(hash, reply_hash);
+    NF_CT_STAT_INC(insert_failed);
+    return NF_DROP;
+}
+
+static inline int nf_conntrack_confirm(struct nf_conn **ctp)
+{
+    if (nf_ct_is_confirmed(*ctp))
+        return NF_ACCEPT;
+    return __nf_conntrack_confirm(ctp);
+}
+
+/* Packet Path */
+static uint32_t nf_ct_l4_timeout(const struct nf_conn *ct)
+{
+    unsigned long status = atomic_load_explicit(&((struct nf_conn *)ct)->status,
+                                                memory_order_relaxed);
+
+    switch (nf_ct_protonum(ct)) {
+    case IPPROTO_TCP:
+        if (status & IPS_ASSURED)
+            return nf_ct_tcp_timeout_established;
+        if (status & IPS_SEEN_REPLY)
+            return nf_ct_tcp_timeout_syn_recv;
+        return nf_ct_tcp_timeout_syn_sent;
+    case IPPROTO_UDP:
+    case IPPROTO_UDPLITE:
+        return (status & IPS_ASSURED) ? nf_ct_udp_timeout_stream : nf_ct_udp_timeout;
+    case IPPROTO_ICMP:
+    case IPPROTO_ICMPV6:
+        return nf_ct_icmp_timeout;
+    default:
+        return nf_ct_generic_timeout;
+    }
+}
+
+/*
+ * Refresh the timeout and count the packet. A busy flow would otherwise
+ * rewrite ->timeout on every packet and bounce its cache line between
+ * cpus, so the store is skipped while the deadline moves by less than
+ * NF_CT_REFRESH_SLACK.
+ */
+static void nf_ct_refresh_acct(struct nf_conn *ct, enum ip_conntrack_dir dir,
+                               uint32_t extra_jiffies, unsigned int bytes)
+{
+    uint32_t cur = atomic_load_explicit(&ct->timeout, memory_order_relaxed);
+
+    if (nf_ct_is_confirmed(ct))
+        extra_jiffies += nfct_time_stamp();
+
+    if ((uint32_t)(extra_jiffies - cur + NF_CT_REFRESH_SLACK) >= 2 * NF_CT_REFRESH_SLACK)
+        atomic_store_explicit(&ct->timeout, extra_jiffies, memory_order_relaxed);
+
+    if (ct->acct) {
+        atomic_fetch_add_explicit(&ct->acct[dir].packets, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&ct->acct[dir].bytes, bytes, memory_order_relaxed);
+    }
+}
+
+static void nf_conntrack_handle_packet(struct nf_conn *ct,
+                                       enum ip_conntrack_dir dir,
+                                       unsigned int len)
+{
+    unsigned long status = atomic_load_explicit(&ct->status, memory_order_relaxed);
+
+    /* Assured once traffic follows the first reply */
+    if (dir == IP_CT_DIR_REPLY && !(status & IPS_SEEN_REPLY))
+        set_bit_ct(ct, IPS_SEEN_REPLY);
+    else if ((status & IPS_SEEN_REPLY) && !(status & IPS_ASSURED))
+        set_bit_ct(ct, IPS_ASSURED);
+
+    nf_ct_refresh_acct(ct, dir, nf_ct_l4_timeout(ct), len);
+}
+
+/* Track one packet: look up or create its conntrack, then confirm it */
+int nf_conntrack_in(const struct nf_conntrack_tuple *tuple, uint16_t zone,
+                    unsigned int len)
+{
+    struct nf_conntrack_tuple_hash *h;
+    struct nf_conn *ct;
+    uint32_t hash;
+    int ret;
+
+    hash = hash_conntrack_raw(tuple, zone);
+    h = __nf_conntrack_find_get(zone, tuple, hash);
+    if (!h) {
+        h = init_conntrack(zone, tuple, hash);
+        if (!h)
+            return NF_DROP;
+    } else {
+        NF_CT_STAT_INC(found);
+    }
+
+    ct = nf_ct_tuplehash_to_ctrack(h);
+    nf_conntrack_handle_packet(ct, NF_CT_DIRECTION(h), len);
+
+    ret = nf_conntrack_confirm(&ct);
+    nf_ct_put(ct);
+    return ret;
+}
+
+/* Resize */
+static struct hlist_nulls_head *nf_ct_alloc_hashtable(unsigned int *sizep)
+{
+    struct hlist_nulls_head *hash;
+    unsigned int i, size = *sizep;
+
+    if (!size || size > NF_CT_HASH_MAX)
+        return NULL;
+    hash = malloc((size_t)size * sizeof(*hash));
+    if (!hash)
+        return NULL;
+    for (i = 0; i < size; i++)
+        INIT_HLIST_NULLS_HEAD(&hash[i], i);
+    return hash;
+}
+
+/*
+ * Rehash everything into a table of hashsize buckets. Writers are held off
+ * by the bucket locks and lockless readers by the generation seqcount; the
+ * old table is retired rather than freed since readers may still be
+ * walking it (there is no grace period to wait for here).
+ */
+int nf_conntrack_hash_resize(unsigned int hashsize)
+{
+    struct hlist_nulls_head *hash, *old_hash;
+    struct ct_retired_table *retired;
+    unsigned int old_size, i;
+
+    hash = nf_ct_alloc_hashtable(&hashsize);
+    if (!hash)
+        return -1;
+    retired = malloc(sizeof(*retired));
+    if (!retired) {
+        free(hash);
+        return -1;
+    }
+
+    pthread_mutex_lock(&nf_conntrack_resize_mutex);
+    old_size = atomic_load(&nf_conntrack_htable_size);
+    if (old_size == hashsize) {
+        pthread_mutex_unlock(&nf_conntrack_resize_mutex);
+        free(hash);
+        free(retired);
+        return 0;
+    }
+
+    nf_conntrack_all_lock();
+    atomic_fetch_add_explicit(&nf_conntrack_generation, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    /*
+     * Lookups in the old hash might happen in parallel, which means
+     * that readers might see the entries in the new hash too.
+     */
+    old_hash = atomic_load(&nf_conntrack_hash);
+    for (i = 0; i < old_size; i++) {
+        struct hlist_nulls_node *n;
+
+        while (!is_a_nulls(n = hlist_nulls_first_rcu(&old_hash[i]))) {
+            struct nf_conntrack_tuple_hash *h = hlist_nulls_entry(n);
+            struct nf_conn *ct = nf_ct_tuplehash_to_ctrack(h);
+            unsigned int bucket;
+
+            hlist_nulls_del_rcu(n);
+            bucket = reciprocal_scale(hash_conntrack_raw(&h->tuple, ct->zone),
+                                      hashsize);
+            hlist_nulls_add_head_rcu(n, &hash[bucket]);
+        }
+    }
+    atomic_store_explicit(&nf_conntrack_htable_size, hashsize, memory_order_relaxed);
+    atomic_store_explicit(&nf_conntrack_hash, hash, memory_order_release);
+
+    atomic_fetch_add_explicit(&nf_conntrack_generation, 1, memory_order_release);
+    nf_conntrack_all_unlock();
+
+    retired->hash = old_hash;
+    retired->next = nf_conntrack_retired;
+    nf_conntrack_retired = retired;
+    pthread_mutex_unlock(&nf_conntrack_resize_mutex);
+    return 0;
+}
+
+/* Garbage Collection */
+static bool gc_worker_skip_ct(const struct nf_conn *ct)
+{
+    return !nf_ct_is_confirmed(ct) || nf_ct_is_dying(ct);
+}
+
+static bool gc_worker_can_early_drop(const struct nf_conn *ct)
+{
+    if (test_bit_ct(ct, IPS_OFFLOAD))
+        return false;
+    return !test_bit_ct(ct, IPS_ASSURED);
+}
+
+/*
+ * One GC batch. Scans from next_bucket until the table is done, the batch
+ * has run GC_SCAN_MAX_DURATION, or more than GC_SCAN_EXPIRED_MAX entries
+ * were reaped. While scanning it keeps a running average of the remaining
+ * timeouts, which sets the delay before the next full pass. Returns the
+ * delay in ticks; 0 means continue at once.
+ */
+static unsigned long gc_worker(struct conntrack_gc_work *gc_work)
+{
+    unsigned int i, hashsz, nf_conntrack_max95 = 0;
+    uint32_t end_time, start_time = nfct_time_stamp();
+    unsigned int expired_count = 0;
+    unsigned long next_run;
+    int32_t delta_time;
+    long count;
+
+    gc_work->batches++;
+    i = gc_work->next_bucket;
+    if (atomic_load_explicit(&gc_work->early_drop, memory_order_relaxed))
+        nf_conntrack_max95 = nf_conntrack_max / 100u * 95u;
+
+    if (i == 0) {
+        gc_work->avg_timeout = GC_SCAN_INTERVAL_INIT;
+        gc_work->count = GC_SCAN_INITIAL_COUNT;
+        gc_work->start_time = start_time;
+    }
+
+    next_run = gc_work->avg_timeout;
+    count = gc_work->count;
+
+    end_time = start_time + GC_SCAN_MAX_DURATION;
+
+    do {
+        struct hlist_nulls_head *ct_hash;
+        struct hlist_nulls_node *n;
+        struct nf_conn *tmp;
+
+        nf_conntrack_get_ht(&ct_hash, &hashsz);
+        if (i >= hashsz)
+            break;
+
+        for (n = hlist_nulls_first_rcu(&ct_hash[i]); !is_a_nulls(n);
+             n = hlist_nulls_next_rcu(n)) {
+            long expires;
+
+            tmp = nf_ct_tuplehash_to_ctrack(hlist_nulls_entry(n));
+
+            if (expired_count > GC_SCAN_EXPIRED_MAX) {
+                gc_work->next_bucket = i;
+                gc_work->avg_timeout = next_run;
+                gc_work->count = count;
+
+                delta_time = (int32_t)(nfct_time_stamp() - gc_work->start_time);
+
+                /* re-sched immediately if total cycle time is exceeded */
+                next_run = delta_time < (int32_t)GC_SCAN_INTERVAL_MAX;
+                goto early_exit;
+            }
+
+            if (nf_ct_is_expired(tmp)) {
+                nf_ct_gc_expired(tmp);
+                expired_count++;
+                gc_work->reaped++;
+                continue;
+            }
+
+            expires = nf_ct_expires(tmp);
+            if (expires < (long)GC_SCAN_INTERVAL_MIN)
+                expires = GC_SCAN_INTERVAL_MIN;
+            else if (expires > (long)GC_SCAN_INTERVAL_CLAMP)
+                expires = GC_SCAN_INTERVAL_CLAMP;
+            expires = (expires - (long)next_run) / ++count;
+            next_run += expires;
+
+            if (nf_conntrack_max95 == 0 || gc_worker_skip_ct(tmp))
+                continue;
+
+            if (nf_conntrack_count() < nf_conntrack_max95)
+                continue;
+
+            /* need to take reference to avoid possible races */
+            if (!atomic_inc_not_zero(&tmp->use))
+                continue;
+
+            if (gc_worker_skip_ct(tmp)) {
+                nf_ct_put(tmp);
+                continue;
+            }
+
+            if (gc_worker_can_early_drop(tmp)) {
+                nf_ct_kill(tmp);
+                expired_count++;
+            }
+
+            nf_ct_put(tmp);
+        }
+
+        /*
+         * could check get_nulls_value() here and restart if ct
+         * was moved to another chain.  But given gc is best-effort
+         * we will just continue with next hash slot.
+         */
+        i++;
+
+        delta_time = (int32_t)(nfct_time_stamp() - end_time);
+        if (delta_time > 0 && i < hashsz) {
+            gc_work->avg_timeout = next_run;
+            gc_work->count = count;
+            gc_work->next_bucket = i;
+            next_run = 0;
+            goto early_exit;
+        }
+    } while (i < hashsz);
+
+    gc_work->next_bucket = 0;
+
+    if (next_run < GC_SCAN_INTERVAL_MIN)
+        next_run = GC_SCAN_INTERVAL_MIN;
+    else if (next_run > GC_SCAN_INTERVAL_MAX)
+        next_run = GC_SCAN_INTERVAL_MAX;
+
+    delta_time = (int32_t)(nfct_time_stamp() - gc_work->start_time);
+    if (delta_time < 1)
+        delta_time = 1;
+    if (next_run > (unsigned long)delta_time)
+        next_run -= delta_time;
+    else
+        next_run = 1;
+
+early_exit:
+    if (next_run)
+        atomic_store_explicit(&gc_work->early_drop, false, memory_order_relaxed);
+
+    return next_run;
+}
+
+static void *gc_thread(void *arg)
+{
+    struct conntrack_gc_work *gc_work = arg;
+
+    while (!__atomic_load_n(&gc_work->exiting, __ATOMIC_RELAXED)) {
+        unsigned long next_run = gc_worker(gc_work);
+
+        /* Sleep in slices so exiting is noticed promptly */
+        while (next_run && !__atomic_load_n(&gc_work->exiting, __ATOMIC_RELAXED)) {
+            unsigned long slice = next_run < 50 ? next_run : 50;
+            struct timespec ts = {
+                .tv_sec = 0,
+                .tv_nsec = (long)slice * (1000000000L / HZ)
+            };
+
+            nanosleep(&ts, NULL);
+            next_run -= slice;
+        }
+        if (!next_run)
+            sched_yield();
+    }
+    return NULL;
+}
+
+/* Teardown Helpers */
+
+/* Mark unconfirmed entries dying so they are dropped instead of confirmed */
+static void nf_ct_unconfirmed_destroy(void)
+{
+    int cpu, nr = atomic_load(&ct_nr_cpus);
+
+    for (cpu = 0; cpu < nr && cpu < NR_CPUS; cpu++) {
+        struct ct_pcpu *pcpu = &ct_pcpu[cpu];
+        struct hlist_nulls_node *n;
+
+        pthread_mutex_lock(&pcpu->lock);
+        for (n = hlist_nulls_first_rcu(&pcpu->unconfirmed); !is_a_nulls(n);
+             n = hlist_nulls_next_rcu(n))
+            set_bit_ct(nf_ct_tuplehash_to_ctrack(hlist_nulls_entry(n)), IPS_DYING);
+        pthread_mutex_unlock(&pcpu->lock);
+    }
+}
+
+/* Grab a reference to some entry of bucket; NULL once it is empty */
+static struct nf_conn *get_next_corpse(unsigned int bucket)
+{
+    struct hlist_nulls_head *ct_hash;
+    struct hlist_nulls_node *n;
+    unsigned int sequence, hsize;
+    struct nf_conn *ct = NULL;
+
+    do {
+        sequence = read_seqcount_begin(&nf_conntrack_generation);
+        nf_conntrack_get_ht(&ct_hash, &hsize);
+        if (bucket >= hsize)
+            return NULL;
+        nf_conntrack_lock(bucket);
+        if (!read_seqcount_retry(&nf_conntrack_generation, sequence))
+            break;
+        nf_conntrack_unlock(bucket);
+    } while (1);
+
+    for (n = hlist_nulls_first_rcu(&ct_hash[bucket]); !is_a_nulls(n);
+         n = hlist_nulls_next_rcu(n)) {
+        struct nf_conn *tmp = nf_ct_tuplehash_to_ctrack(hlist_nulls_entry(n));
+
+        if (!nf_ct_is_dying(tmp) && atomic_inc_not_zero(&tmp->use)) {
+            ct = tmp;
+            break;
+        }
+    }
+    nf_conntrack_unlock(bucket);
+    return ct;
+}
+
+void nf_conntrack_flush(void)
+{
+    struct hlist_nulls_head *ct_hash;
+    unsigned int bucket, hsize;
+    struct nf_conn *ct;
+
+    nf_ct_unconfirmed_destroy();
+
+    nf_conntrack_get_ht(&ct_hash, &hsize);
+    for (bucket = 0; bucket < hsize; bucket++) {
+        while ((ct = get_next_corpse(bucket)) != NULL) {
+            nf_ct_kill(ct);
+            nf_ct_put(ct);
+        }
+    }
+}
+
+/* Init and Cleanup */
+int nf_conntrack_init(unsigned int hashsize, unsigned int max)
+{
+    struct hlist_nulls_head *hash;
+    int i;
+
+    nf_conntrack_hash_rnd[0] = ((uint64_t)rand() << 32) ^ (uint64_t)rand() ^
+                               (uint64_t)ktime_get_real_ns();
+    nf_conntrack_hash_rnd[1] = ((uint64_t)rand() << 32) ^ (uint64_t)rand();
+
+    for (i = 0; i < CONNTRACK_LOCKS; i++)
+        pthread_mutex_init(&nf_conntrack_locks[i], NULL);
+    for (i = 0; i < NR_CPUS; i++) {
+        pthread_mutex_init(&ct_pcpu[i].lock, NULL);
+        INIT_HLIST_NULLS_HEAD(&ct_pcpu[i].unconfirmed, UNCONFIRMED_NULLS_VAL + i);
+        memset(&ct_pcpu[i].stat, 0, sizeof(ct_pcpu[i].stat));
+        ct_pcpu[i].ncache = 0;
+    }
+
+    hash = nf_ct_alloc_hashtable(&hashsize);
+    if (!hash)
+        return -1;
+    atomic_store(&nf_conntrack_htable_size, hashsize);
+    atomic_store(&nf_conntrack_hash, hash);
+    atomic_store(&nf_conntrack_generation, 0);
+    atomic_store(&nf_ct_count, 0);
+    nf_conntrack_max = max;
+    nf_conntrack_retired = NULL;
+    memset(&conntrack_gc_work, 0, sizeof(conntrack_gc_work));
+    return 0;
+}
+
+void nf_conntrack_cleanup(void)
+{
+    struct ct_retired_table *retired;
+    size_t i;
+    int cpu;
+
+    nf_conntrack_flush();
+
+    while ((retired = nf_conntrack_retired) != NULL) {
+        nf_conntrack_retired = retired->next;
+        free(retired->hash);
+        free(retired);
+    }
+    free(atomic_load(&nf_conntrack_hash));
+    atomic_store(&nf_conntrack_hash, NULL);
+    atomic_store(&nf_conntrack_htable_size, 0);
+
+    for (i = 0; i < ct_depot.nr_chunks; i++)
+        free(ct_depot.chunks[i]);
+    free(ct_depot.chunks);
+    free(ct_depot.objs);
+    ct_depot.chunks = NULL;
+    ct_depot.objs = NULL;
+    ct_depot.nr = ct_depot.cap = 0;
+    ct_depot.nr_chunks = ct_depot.cap_chunks = 0;
+    for (cpu = 0; cpu < NR_CPUS; cpu++) {
+        ct_pcpu[cpu].ncache = 0;
+        pthread_mutex_destroy(&ct_pcpu[cpu].lock);
+    }
+    for (i = 0; i < CONNTRACK_LOCKS; i++)
+        pthread_mutex_destroy(&nf_conntrack_locks[i]);
+}
+
+/*
+ * Minimal seq_file, enough to run the /proc/net/nf_conntrack dumper from
+ * nf_conntrack_standalone.c: each read fills one buffer between start and
+ * stop, and an entry that does not fit is shown again by the next read.
+ */
+struct seq_file {
+    char *buf;
+    size_t size;
+    size_t count;
+    loff_t index;
+    void *private;
+};
+
+struct seq_operations {
+    void *(*start)(struct seq_file *m, loff_t *pos);
+    void (*stop)(struct seq_file *m, void *v);
+    void *(*next)(struct seq_file *m, void *v, loff_t *pos);
+    int (*show)(struct seq_file *m, void *v);
+};
+
+#define SEQ_START_TOKEN ((void *)1)
+
+static inline bool seq_has_overflowed(struct seq_file *m)
+{
+    return m->count == m->size;
+}
+
+static void seq_printf(struct seq_file *m, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void seq_printf(struct seq_file *m, const char *fmt, ...)
+{
+    va_list args;
+    int len;
+
+    if (m->count >= m->size)
+        return;
+    va_start(args, fmt);
+    len = vsnprintf(m->buf + m->count, m->size - m->count, fmt, args);
+    va_end(args);
+    if (len < 0 || (size_t)len >= m->size - m->count)
+        m->count = m->size;
+    else
+        m->count += len;
+}
+
+static inline void seq_puts(struct seq_file *m, const char *s)
+{
+    seq_printf(m, "%s", s);
+}
+
+/* Read the whole file, handing each filled buffer to sink; returns bytes */
+static size_t seq_read_all(struct seq_file *m, const struct seq_operations *op,
+                           void (*sink)(const char *buf, size_t len, void *arg),
+                           void *arg)
+{
+    size_t total = 0;
+    void *p;
+
+    m->index = 0;
+    for (;;) {
+        m->count = 0;
+        p = op->start(m, &m->index);
+        while (p) {
+            size_t old = m->count;
+
+            op->show(m, p);
+            if (seq_has_overflowed(m)) {
+                m->count = old;
+                break;
+            }
+            p = op->next(m, p, &m->index);
+        }
+        op->stop(m, p);
+        if (sink)
+            sink(m->buf, m->count, arg);
+        total += m->count;
+        if (!p)
+            break;
+    }
+    return total;
+}
+
+/* /proc/net/nf_conntrack, as in nf_conntrack_standalone.c */
+static void print_tuple(struct seq_file *s, const struct nf_conntrack_tuple *tuple)
+{
+    char src[INET6_ADDRSTRLEN], dst[INET6_ADDRSTRLEN];
+
+    switch (tuple->src.l3num) {
+    case AF_INET:
+        inet_ntop(AF_INET, &tuple->src.u3.ip, src, sizeof(src));
+        inet_ntop(AF_INET, &tuple->dst.u3.ip, dst, sizeof(dst));
+        seq_printf(s, "src=%s dst=%s ", src, dst);
+        break;
+    case AF_INET6:
+        inet_ntop(AF_INET6, tuple->src.u3.ip6, src, sizeof(src));
+        inet_ntop(AF_INET6, tuple->dst.u3.ip6, dst, sizeof(dst));
+        seq_printf(s, "src=%s dst=%s ", src, dst);
+        break;
+    default:
+        break;
+    }
+
+    switch (tuple->dst.protonum) {
+    case IPPROTO_ICMP:
+    case IPPROTO_ICMPV6:
+        seq_printf(s, "type=%u code=%u id=%u ",
+                   tuple->dst.u.icmp.type,
+                   tuple->dst.u.icmp.code,
+                   ntohs(tuple->src.port));
+        break;
+    case IPPROTO_TCP:
+    case IPPROTO_UDP:
+    case IPPROTO_UDPLITE:
+    case IPPROTO_SCTP:
+        seq_printf(s, "sport=%hu dport=%hu ",
+                   ntohs(tuple->src.port),
+                   ntohs(tuple->dst.u.port));
+        break;
+    default:
+        break;
+    }
+}
+
+struct ct_iter_state {
+    struct hlist_nulls_head *hash;
+    unsigned int htable_size;
+    unsigned int skip_elems;
+    unsigned int bucket;
+    uint64_t time_now;
+};
+
+/*
+ * Return the next entry after (bucket, skip_elems). Each read resumes
+ * where the last one stopped instead of walking from bucket 0, and no
+ * lock is held across buckets.
+ */
+static struct nf_conntrack_tuple_hash *ct_get_next(struct ct_iter_state *st)
+{
+    struct nf_conntrack_tuple_hash *h;
+    struct hlist_nulls_node *n;
+    unsigned int i;
+
+    for (i = st->bucket; i < st->htable_size; i++) {
+        unsigned int skip = 0;
+
+restart:
+        for (n = hlist_nulls_first_rcu(&st->hash[i]); !is_a_nulls(n);
+             n = hlist_nulls_next_rcu(n)) {
+            struct hlist_nulls_node *tmp = n;
+
+            h = hlist_nulls_entry(n);
+            if (NF_CT_DIRECTION(h) != IP_CT_DIR_ORIGINAL)
+                continue;
+
+            if (++skip <= st->skip_elems)
+                continue;
+
+            /* h should be returned, skip to nulls marker. */
+            while (!is_a_nulls(tmp))
+                tmp = hlist_nulls_next_rcu(tmp);
+
+            /* check if h is still linked to hash[i] */
+            if (get_nulls_value(tmp) != i) {
+                skip = 0;
+                goto restart;
+            }
+
+            st->skip_elems = skip;
+            st->bucket = i;
+            return h;
+        }
+
+        skip = 0;
+        st->skip_elems = 0;
+    }
+
+    st->bucket = i;
+    return NULL;
+}
+
+static void *ct_seq_start(struct seq_file *seq, loff_t *pos)
+{
+    struct ct_iter_state *st = seq->private;
+
+    st->time_now = ktime_get_real_ns();
+    nf_conntrack_get_ht(&st->hash, &st->htable_size);
+
+    if (*pos == 0) {
+        st->skip_elems = 0;
+        st->bucket = 0;
+    } else if (st->skip_elems) {
+        /* resume from last dumped entry */
+        st->skip_elems--;
+    }
+
+    return ct_get_next(st);
+}
+
+static void *ct_seq_next(struct seq_file *s, void *v, loff_t *pos)
+{
+    (void)v;
+    (*pos)++;
+    return ct_get_next(s->private);
+}
+
+static void ct_seq_stop(struct seq_file *s, void *v)
+{
+    (void)s;
+    (void)v;
+}
+
+static const char *l3proto_name(uint16_t proto)
+{
+    switch (proto) {
+    case AF_INET: return "ipv4";
+    case AF_INET6: return "ipv6";
+    }
+
+    return "unknown";
+}
+
+static const char *l4proto_name(uint16_t proto)
+{
+    switch (proto) {
+    case IPPROTO_ICMP: return "icmp";
+    case IPPROTO_TCP: return "tcp";
+    case IPPROTO_UDP: return "udp";
+    case IPPROTO_SCTP: return "sctp";
+    case IPPROTO_UDPLITE: return "udplite";
+    case IPPROTO_ICMPV6: return "icmpv6";
+    }
+
+    return "unknown";
+}
+
+static void seq_print_acct(struct seq_file *s, const struct nf_conn *ct, int dir)
+{
+    if (!ct->acct)
+        return;
+
+    seq_printf(s, "packets=%llu bytes=%llu ",
+               (unsigned long long)atomic_load(&ct->acct[dir].packets),
+               (unsigned long long)atomic_load(&ct->acct[dir].bytes));
+}
+
+/* return 0 on success, 1 in case of error */
+static int ct_seq_show(struct seq_file *s, void *v)
+{
+    struct nf_conntrack_tuple_hash *hash = v;
+    struct nf_conn *ct = nf_ct_tuplehash_to_ctrack(hash);
+    struct ct_iter_state *st = s->private;
+    int ret = 0;
+
+    if (!atomic_inc_not_zero(&ct->use))
+        return 0;
+
+    if (nf_ct_should_gc(ct)) {
+        nf_ct_kill(ct);
+        goto release;
+    }
+
+    /* we only want to print DIR_ORIGINAL */
+    if (NF_CT_DIRECTION(hash))
+        goto release;
+
+    ret = -1;
+    seq_printf(s, "%-8s %u %-8s %u ",
+               l3proto_name(nf_ct_l3num(ct)), nf_ct_l3num(ct),
+               l4proto_name(nf_ct_protonum(ct)), nf_ct_protonum(ct));
+
+    if (!test_bit_ct(ct, IPS_OFFLOAD))
+        seq_printf(s, "%ld ", nf_ct_expires(ct) / HZ);
+
+    print_tuple(s, &ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple);
+
+    if (seq_has_overflowed(s))
+        goto release;
+
+    seq_print_acct(s, ct, IP_CT_DIR_ORIGINAL);
+
+    if (!test_bit_ct(ct, IPS_SEEN_REPLY))
+        seq_puts(s, "[UNREPLIED] ");
+
+    print_tuple(s, &ct->tuplehash[IP_CT_DIR_REPLY].tuple);
+
+    seq_print_acct(s, ct, IP_CT_DIR_REPLY);
+
+    if (test_bit_ct(ct, IPS_HW_OFFLOAD))
+        seq_puts(s, "[HW_OFFLOAD] ");
+    else if (test_bit_ct(ct, IPS_OFFLOAD))
+        seq_puts(s, "[OFFLOAD] ");
+    else if (test_bit_ct(ct, IPS_ASSURED))
+        seq_puts(s, "[ASSURED] ");
+
+    if (seq_has_overflowed(s))
+        goto release;
+
+    seq_printf(s, "mark=%u ", ct->mark);
+
+    if (ct->zone)
+        seq_printf(s, "zone=%u ", ct->zone);
+
+    if (ct->start && st->time_now > ct->start)
+        seq_printf(s, "delta-time=%llu ",
+                   (unsigned long long)((st->time_now - ct->start) / 1000000000ULL));
+
+    seq_printf(s, "use=%u\n", atomic_load(&ct->use));
+
+    if (seq_has_overflowed(s))
+        goto release;
+
+    ret = 0;
+release:
+    nf_ct_put(ct);
+    return ret;
+}
+
+static const struct seq_operations ct_seq_ops = {
+    .start = ct_seq_start,
+    .next  = ct_seq_next,
+    .stop  = ct_seq_stop,
+    .show  = ct_seq_show
+};
+
+/* /proc/net/stat/nf_conntrack */
+static void *ct_cpu_seq_start(struct seq_file *seq, loff_t *pos)
+{
+    int cpu, nr = atomic_load(&ct_nr_cpus);
+
+    (void)seq;
+    if (*pos == 0)
+        return SEQ_START_TOKEN;
+
+    for (cpu = *pos - 1; cpu < nr && cpu < NR_CPUS; ++cpu) {
+        *pos = cpu + 1;
+        return &ct_pcpu[cpu].stat;
+    }
+
+    return NULL;
+}
+
+static void *ct_cpu_seq_next(struct seq_file *seq, void *v, loff_t *pos)
+{
+    int cpu, nr = atomic_load(&ct_nr_cpus);
+
+    (void)seq;
+    (void)v;
+    for (cpu = *pos; cpu < nr && cpu < NR_CPUS; ++cpu) {
+        *pos = cpu + 1;
+        return &ct_pcpu[cpu].stat;
+    }
+    (*pos)++;
+    return NULL;
+}
+
+static int ct_cpu_seq_show(struct seq_file *seq, void *v)
+{
+    const struct ip_conntrack_stat *st = v;
+
+    if (v == SEQ_START_TOKEN) {
+        seq_puts(seq, "entries  clashres found new invalid ignore delete chainlength insert insert_failed drop early_drop icmp_error  expect_new expect_create expect_delete search_restart\n");
+        return 0;
+    }
+
+    seq_printf(seq, "%08x  %08x %08x %08x %08x %08x %08x %08x "
+                    "%08x %08x %08x %08x %08x  %08x %08x %08x %08x\n",
+               nf_conntrack_count(),
+               st->clash_resolve,
+               st->found,
+               0,
+               st->invalid,
+               0,
+               0,
+               st->chaintoolong,
+               st->insert,
+               st->insert_failed,
+               st->drop,
+               st->early_drop,
+               st->error,
+
+               st->expect_new,
+               st->expect_create,
+               st->expect_delete,
+               st->search_restart
+        );
+    return 0;
+}
+
+static const struct seq_operations ct_cpu_seq_ops = {
+    .start = ct_cpu_seq_start,
+    .next  = ct_cpu_seq_next,
+    .stop  = ct_seq_stop,
+    .show  = ct_cpu_seq_show,
+};
+
+static void seq_sink_stdout(const char *buf, size_t len, void *arg)
+{
+    (void)arg;
+    fwrite(buf, 1, len, stdout);
+}
+
+static void seq_sink_count(const char *buf, size_t len, void *arg)
+{
+    size_t *lines = arg;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        if (buf[i] == '\n')
+            (*lines)++;
+}
+
+/* Dump a seq file through a page-sized buffer */
+static size_t ct_seq_dump(const struct seq_operations *op,
+                          void (*sink)(const char *, size_t, void *), void *arg)
+{
+    struct ct_iter_state st = { 0 };
+    char page[4096];
+    struct seq_file m = {
+        .buf = page,
+        .size = sizeof(page),
+        .private = &st,
+    };
+
+    return seq_read_all(&m, op, sink, arg);
+}
+
+static unsigned int ct_stat_sum(size_t offset)
+{
+    int cpu, nr = atomic_load(&ct_nr_cpus);
+    unsigned int sum = 0;
+
+    for (cpu = 0; cpu < nr && cpu < NR_CPUS; cpu++)
+        sum += *(unsigned int *)((char *)&ct_pcpu[cpu].stat + offset);
+    return sum;
+}
+
+#define CT_STAT_SUM(field) ct_stat_sum(offsetof(struct ip_conntrack_stat, field))
+
+/* Benchmark */
+#define BENCH_DEFAULT_ENTRIES 20000000u
+#define BENCH_STRESS_FLOWS    262144u
+#define BENCH_STRESS_WORKERS  3
+#define BENCH_STRESS_SECONDS  2
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline uint64_t bench_rand(uint64_t *state)
+{
+    uint64_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+/* Flow i: 10.0.0.0/8 clients, 64 source ports each, to 4093 servers */
+static void bench_tuple(struct nf_conntrack_tuple *t, uint32_t i, int dir)
+{
+    struct nf_conntrack_tuple orig;
+
+    memset(&orig, 0, sizeof(orig));
+    orig.src.l3num = AF_INET;
+    orig.src.u3.ip = htonl(0x0a000000u | ((i >> 6) & 0xffffff));
+    orig.src.port = htons(1024 + (i & 63));
+    orig.dst.u3.ip = htonl(0xac100000u | (i % 4093));
+    orig.dst.u.port = htons(443);
+    orig.dst.protonum = IPPROTO_UDP;
+
+    if (dir == IP_CT_DIR_REPLY)
+        nf_ct_invert_tuple(t, &orig);
+    else
+        *t = orig;
+}
+
+struct bench_stress_arg {
+    atomic_bool *stop;
+    uint64_t seed;
+    unsigned long packets;
+    unsigned long dumps;
+};
+
+static void *bench_stress_worker(void *p)
+{
+    struct bench_stress_arg *arg = p;
+    struct nf_conntrack_tuple t;
+    uint64_t seed = arg->seed;
+
+    while (!atomic_load_explicit(arg->stop, memory_order_relaxed)) {
+        uint64_t r = bench_rand(&seed);
+
+        bench_tuple(&t, (uint32_t)(r % BENCH_STRESS_FLOWS), (int)((r >> 40) & 1));
+        nf_conntrack_in(&t, 0, 100);
+        arg->packets++;
+
+        /* Now and then kill a flow to exercise delete vs lookup */
+        if ((r & 1023) == 0) {
+            struct nf_conntrack_tuple_hash *h = nf_conntrack_find_get(0, &t);
+
+            if (h) {
+                struct nf_conn *ct = nf_ct_tuplehash_to_ctrack(h);
+
+                nf_ct_kill(ct);
+                nf_ct_put(ct);
+            }
+        }
+    }
+    return NULL;
+}
+
+static void *bench_stress_dumper(void *p)
+{
+    struct bench_stress_arg *arg = p;
+
+    while (!atomic_load_explicit(arg->stop, memory_order_relaxed)) {
+        size_t lines = 0;
+
+        ct_seq_dump(&ct_seq_ops, seq_sink_count, &lines);
+        arg->dumps++;
+    }
+    return NULL;
+}
+
+static int run_benchmark(unsigned int entries)
+{
+    struct bench_stress_arg args[BENCH_STRESS_WORKERS + 1];
+    pthread_t threads[BENCH_STRESS_WORKERS + 1], gc;
+    struct nf_conntrack_tuple t;
+    atomic_bool stop = false;
+    unsigned int i, extra, lookups, hits, hsize, drops_before;
+    unsigned long packets = 0, dumps = 0, batches;
+    struct hlist_nulls_head *ct_hash;
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    size_t lines = 0, bytes;
+    double t0, dt;
+
+    if (nf_conntrack_init(entries, entries) < 0) {
+        fprintf(stderr, "Failed to allocate %u buckets\n", entries);
+        return 1;
+    }
+
+    /* Nothing may time out before the GC phase, however slow the box */
+    nf_ct_udp_timeout = nf_ct_udp_timeout_stream = 3600 * HZ;
+
+    printf("nf_conntrack benchmark: %u entries, %u buckets, %zu bytes/entry\n",
+           entries, entries, sizeof(struct nf_conn));
+
+    /* New connections: miss, allocate, confirm */
+    t0 = bench_now();
+    for (i = 0; i < entries; i++) {
+        bench_tuple(&t, i, IP_CT_DIR_ORIGINAL);
+        if (nf_conntrack_in(&t, 0, 100) != NF_ACCEPT)
+            break;
+    }
+    dt = bench_now() - t0;
+    printf("  insert:       %10u conns  %8.1f ns/conn  %6.2f M/s  (count %u)\n",
+           i, dt * 1e9 / i, i / dt / 1e6, nf_conntrack_count());
+
+    /* Established packets, both directions, random order */
+    lookups = entries < 10000000u ? entries : 10000000u;
+    t0 = bench_now();
+    for (i = 0; i < lookups; i++) {
+        uint64_t r = bench_rand(&seed);
+
+        bench_tuple(&t, (uint32_t)(r % entries), (int)((r >> 40) & 1));
+        nf_conntrack_in(&t, 0, 100);
+    }
+    dt = bench_now() - t0;
+    printf("  lookup:       %10u pkts   %8.1f ns/pkt   %6.2f M/s  (count %u)\n",
+           lookups, dt * 1e9 / lookups, lookups / dt / 1e6, nf_conntrack_count());
+
+    /* Stream the whole table the way cat /proc/net/nf_conntrack would */
+    t0 = bench_now();
+    bytes = ct_seq_dump(&ct_seq_ops, seq_sink_count, &lines);
+    dt = bench_now() - t0;
+    printf("  dump:         %10zu lines  %8.1f ns/line  %6.2f M/s  (%.1f MB, count %u)\n",
+           lines, dt * 1e9 / (lines ? lines : 1), lines / dt / 1e6, bytes / 1e6,
+           nf_conntrack_count());
+
+    /* Double the table, then check every sampled flow is still found */
+    t0 = bench_now();
+    nf_conntrack_hash_resize(entries * 2 > NF_CT_HASH_MAX ? NF_CT_HASH_MAX : entries * 2);
+    dt = bench_now() - t0;
+    nf_conntrack_get_ht(&ct_hash, &hsize);
+    for (i = 0, hits = 0; i < 1000000u; i++) {
+        struct nf_conntrack_tuple_hash *h;
+
+        bench_tuple(&t, (uint32_t)(bench_rand(&seed) % entries), IP_CT_DIR_ORIGINAL);
+        h = nf_conntrack_find_get(0, &t);
+        if (h) {
+            hits++;
+            nf_ct_put(nf_ct_tuplehash_to_ctrack(h));
+        }
+    }
+    printf("  resize:       %10u buckets %7.1f ms  (%u/1000000 sampled flows found)\n",
+           hsize, dt * 1e3, hits);
+
+    /* Table full: every new flow has to evict an unassured one */
+    extra = entries / 4;
+    drops_before = CT_STAT_SUM(drop);
+    t0 = bench_now();
+    for (i = 0; i < extra; i++) {
+        bench_tuple(&t, entries + i, IP_CT_DIR_ORIGINAL);
+        nf_conntrack_in(&t, 0, 100);
+    }
+    dt = bench_now() - t0;
+    printf("  early drop:   %10u conns  %8.1f ns/conn  %6.2f M/s  (%u evicted, %u dropped, count %u/%u)\n",
+           extra, dt * 1e9 / extra, extra / dt / 1e6, CT_STAT_SUM(early_drop),
+           CT_STAT_SUM(drop) - drops_before, nf_conntrack_count(), nf_conntrack_max);
+
+    /* Age everything past its timeout and let GC batches reap it */
+    atomic_store(&nfct_time_warp, 10u * 24 * 3600 * HZ);
+    batches = conntrack_gc_work.batches;
+    extra = nf_conntrack_count();
+    t0 = bench_now();
+    while (nf_conntrack_count())
+        gc_worker(&conntrack_gc_work);
+    dt = bench_now() - t0;
+    printf("  gc expiry:    %10u conns  %8.1f ns/conn  %6.2f M/s  (%lu batches)\n",
+           extra, dt * 1e9 / (extra ? extra : 1), extra / dt / 1e6,
+           conntrack_gc_work.batches - batches);
+
+    /* Packet path, GC and dumper all running at once */
+    t0 = bench_now();
+    conntrack_gc_work.exiting = false;
+    pthread_create(&gc, NULL, gc_thread, &conntrack_gc_work);
+    for (i = 0; i <= BENCH_STRESS_WORKERS; i++) {
+        args[i] = (struct bench_stress_arg){ .stop = &stop, .seed = seed + i * 7919 };
+        pthread_create(&threads[i], NULL,
+                       i < BENCH_STRESS_WORKERS ? bench_stress_worker : bench_stress_dumper,
+                       &args[i]);
+    }
+    sleep(BENCH_STRESS_SECONDS);
+    atomic_store(&stop, true);
+    for (i = 0; i <= BENCH_STRESS_WORKERS; i++) {
+        pthread_join(threads[i], NULL);
+        packets += args[i].packets;
+        dumps += args[i].dumps;
+    }
+    __atomic_store_n(&conntrack_gc_work.exiting, true, __ATOMIC_RELAXED);
+    pthread_join(gc, NULL);
+    dt = bench_now() - t0;
+    extra = nf_conntrack_count();
+    nf_conntrack_flush();
+    printf("  stress:       %10lu pkts   %6.2f M/s  %lu dumps  (count %u, %u after flush)\n",
+           packets, packets / dt / 1e6, dumps, extra, nf_conntrack_count());
+
+    printf("\n/proc/net/stat/nf_conntrack:\n");
+    ct_seq_dump(&ct_cpu_seq_ops, seq_sink_stdout, NULL);
+
+    nf_conntrack_cleanup();
+    return 0;
+}
+
+static void demo_tuple(struct nf_conntrack_tuple *t, int family, const char *src,
+                       const char *dst, uint8_t proto, uint16_t sport, uint16_t dport)
+{
+    memset(t, 0, sizeof(*t));
+    t->src.l3num = family;
+    inet_pton(family, src, &t->src.u3);
+    inet_pton(family, dst, &t->dst.u3);
+    t->dst.protonum = proto;
+    if (proto == IPPROTO_ICMP || proto == IPPROTO_ICMPV6) {
+        t->src.port = htons(sport);
+        t->dst.u.icmp.type = (uint8_t)dport;
+    } else {
+        t->src.port = htons(sport);
+        t->dst.u.port = htons(dport);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct nf_conntrack_tuple tcp, tcp_r, udp, icmp, tcp6, tcp6_r;
+
+    srand(time(NULL));
+
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        return run_benchmark(argc > 2 ? (unsigned int)strtoul(argv[2], NULL, 0)
+                                      : BENCH_DEFAULT_ENTRIES);
+
+    if (nf_conntrack_init(1024, 4096) < 0) {
+        fprintf(stderr, "Failed to initialize conntrack table\n");
+        return 1;
+    }
+    nf_ct_acct = true;
+    nf_ct_tstamp = true;
+
+    /* TCP handshake: SYN, SYN-ACK, ACK */
+    demo_tuple(&tcp, AF_INET, "192.168.1.10", "93.184.216.34", IPPROTO_TCP, 40000, 443);
+    nf_ct_invert_tuple(&tcp_r, &tcp);
+    nf_conntrack_in(&tcp, 0, 60);
+    nf_conntrack_in(&tcp_r, 0, 60);
+    nf_conntrack_in(&tcp, 0, 52);
+
+    /* DNS query without an answer */
+    demo_tuple(&udp, AF_INET, "192.168.1.10", "8.8.8.8", IPPROTO_UDP, 53124, 53);
+    nf_conntrack_in(&udp, 0, 72);
+
+    /* Ping */
+    demo_tuple(&icmp, AF_INET, "192.168.1.10", "1.1.1.1", IPPROTO_ICMP, 4242, 8);
+    nf_conntrack_in(&icmp, 0, 84);
+
+    /* IPv6 TCP in zone 7, answered once */
+    demo_tuple(&tcp6, AF_INET6, "2001:db8::10", "2001:db8::80", IPPROTO_TCP, 50000, 80);
+    nf_ct_invert_tuple(&tcp6_r, &tcp6);
+    nf_conntrack_in(&tcp6, 7, 80);
+    nf_conntrack_in(&tcp6_r, 7, 80);
+
+    printf("/proc/net/nf_conntrack (%u entries):\n", nf_conntrack_count());
+    ct_seq_dump(&ct_seq_ops, seq_sink_stdout, NULL);
+
+    /* Resize under the entries; the dump must not change */
+    nf_conntrack_hash_resize(4096);
+    printf("\nAfter resize to %u buckets:\n", atomic_load(&nf_conntrack_htable_size));
+    ct_seq_dump(&ct_seq_ops, seq_sink_stdout, NULL);
+
+    /* Three minutes later only the established TCP flow is left */
+    atomic_store(&nfct_time_warp, 180u * HZ);
+    while (gc_worker(&conntrack_gc_work) == 0)
+        ;
+    printf("\nAfter 180s and a GC pass (%lu reaped):\n", conntrack_gc_work.reaped);
+    ct_seq_dump(&ct_seq_ops, seq_sink_stdout, NULL);
+
+    printf("\n/proc/net/stat/nf_conntrack:\n");
+    ct_seq_dump(&ct_cpu_seq_ops, seq_sink_stdout, NULL);
+
+    nf_conntrack_cleanup();
+    return 0;
+}
@@ -0,0 +1,246 @@
+/*
+ * Per-Entity Load Tracking Simulation (PELT)
+ * Shared by fair_sim.c and cpufreq_schedutil_sim.c
+ *
+ * Time is split into 1024us periods.  A period that ended n periods ago
+ * contributes y^n of its value, with y^32 = 1/2 (32ms half-life), so
+ *
+ *     sum = u_0 + u_1*y + u_2*y^2 + ...
+ *
+ * is maintained incrementally: on each update the old sum is decayed by
+ * y^p for the p periods that passed and the new segments are added.
+ * Decay uses a precomputed table of y^n * 2^32 for n < 32 plus a shift
+ * for every full half-life, so no floating point is involved.  The sums
+ * saturate at LOAD_AVG_MAX; dividing by it yields averages in the range
+ * of the input (load weight, or SCHED_CAPACITY_SCALE for utilisation).
+ *
+ * Entities track their own signal; a runqueue tracks its aggregate from
+ * its total weight and nr_running.  attach/detach move an entity's
+ * history when it migrates, so blocked utilisation follows the task.
+ */
+
+#ifndef _PELT_SIM_H
+#define _PELT_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SCHED_CAPACITY_SHIFT  10
+#define SCHED_CAPACITY_SCALE  (1UL << SCHED_CAPACITY_SHIFT)
+
+#define PELT_PERIOD_SHIFT     10          /* ns >> 10 ~= us */
+#define PELT_PERIOD           1024        /* us per period */
+#define LOAD_AVG_PERIOD       32          /* periods per half-life */
+#define LOAD_AVG_MAX          47742       /* sum of 1024 * y^n, n >= 0 */
+#define PELT_MIN_DIVIDER      (LOAD_AVG_MAX - PELT_PERIOD)
+
+struct sched_avg {
+    uint64_t last_update_time;            /* ns, 0 = not attached */
+    uint64_t load_sum;
+    uint64_t runnable_sum;
+    uint32_t util_sum;
+    uint32_t period_contrib;              /* us into the current period */
+    unsigned long load_avg;
+    unsigned long runnable_avg;
+    unsigned long util_avg;
+};
+
+/* y^n * 2^32 for n in [0, LOAD_AVG_PERIOD) */
+static const uint32_t pelt_yN_inv[LOAD_AVG_PERIOD] = {
+    0xffffffff, 0xfa83b2db, 0xf5257d15, 0xefe4b99b, 0xeac0c6e7, 0xe5b906e7,
+    0xe0ccdeec, 0xdbfbb797, 0xd744fcca, 0xd2a81d91, 0xce248c15, 0xc9b9bd86,
+    0xc5672a11, 0xc12c4cca, 0xbd08a39f, 0xb8fbaf47, 0xb504f333, 0xb123f581,
+    0xad583eea, 0xa9a15ab4, 0xa5fed6a9, 0xa2704303, 0x9ef53260, 0x9b8d39b9,
+    0x9837f051, 0x94f4efa8, 0x91c3d373, 0x8ea4398b, 0x8b95c1e3, 0x88980e80,
+    0x85aac367, 0x82cd8698,
+};
+
+/* val * y^n */
+static inline uint64_t pelt_decay_load(uint64_t val, uint64_t n)
+{
+    if (n > LOAD_AVG_PERIOD * 63)
+        return 0;
+
+    if (n >= LOAD_AVG_PERIOD) {
+        val >>= n / LOAD_AVG_PERIOD;
+        n %= LOAD_AVG_PERIOD;
+    }
+    return (uint64_t)(((unsigned __int128)val * pelt_yN_inv[n]) >> 32);
+}
+
+/*
+ * Contribution of an update that spans p periods:
+ *
+ *            d1          d2           d3
+ *            ^           ^            ^
+ *       |<->|<->|<----------->|<--->|
+ *   ... |---x---|------| ... |------|-----x (now)
+ *
+ *   d1 * y^p                      (rest of the period we were in)
+ * + 1024 * (y^1 + ... + y^(p-1))  (full periods)
+ * + d3                            (part of the current period)
+ */
+static inline uint32_t pelt_accumulate_segments(uint64_t periods, uint32_t d1, uint32_t d3)
+{
+    uint32_t c1 = (uint32_t)pelt_decay_load(d1, periods);
+    uint32_t c2 = LOAD_AVG_MAX - (uint32_t)pelt_decay_load(LOAD_AVG_MAX, periods) - PELT_PERIOD;
+
+    return c1 + c2 + d3;
+}
+
+/*
+ * Fold delta us into the sums.  running is the capacity the entity ran
+ * at (SCHED_CAPACITY_SCALE at full speed), which makes util_sum
+ * frequency invariant.  Returns the number of period boundaries crossed.
+ */
+static inline uint64_t pelt_accumulate_sum(uint64_t delta, struct sched_avg *sa,
+                                           unsigned long load, unsigned long runnable,
+                                           unsigned long running)
+{
+    uint32_t contrib = (uint32_t)delta;
+    uint64_t periods;
+
+    delta += sa->period_contrib;
+    periods = delta / PELT_PERIOD;
+
+    if (periods) {
+        sa->load_sum = pelt_decay_load(sa->load_sum, periods);
+        sa->runnable_sum = pelt_decay_load(sa->runnable_sum, periods);
+        sa->util_sum = (uint32_t)pelt_decay_load(sa->util_sum, periods);
+
+        delta %= PELT_PERIOD;
+        if (load)
+            contrib = pelt_accumulate_segments(periods,
+                                               PELT_PERIOD - sa->period_contrib,
+                                               (uint32_t)delta);
+    }
+    sa->period_contrib = (uint32_t)delta;
+
+    if (load)
+        sa->load_sum += load * contrib;
+    if (runnable)
+        sa->runnable_sum += (uint64_t)(runnable * contrib) << SCHED_CAPACITY_SHIFT;
+    if (running)
+        sa->util_sum += (uint32_t)(running * contrib);
+
+    return periods;
+}
+
+/* Sums cover LOAD_AVG_MAX minus whatever of the current period is left */
+static inline uint32_t pelt_divider(const struct sched_avg *sa)
+{
+    return PELT_MIN_DIVIDER + sa->period_contrib;
+}
+
+/*
+ * Advance the sums to now (ns).  The state passed in is the state that
+ * held since the last update.  Returns true when a period boundary was
+ * crossed and the averages need recomputing.
+ */
+static inline bool pelt_update_load_sum(uint64_t now, struct sched_avg *sa,
+                                        unsigned long load, unsigned long runnable,
+                                        unsigned long running)
+{
+    uint64_t delta = now - sa->last_update_time;
+
+    /* Clock went backwards: resync and account nothing */
+    if ((int64_t)delta < 0) {
+        sa->last_update_time = now;
+        return false;
+    }
+
+    delta >>= PELT_PERIOD_SHIFT;
+    if (!delta)
+        return false;
+    sa->last_update_time += delta << PELT_PERIOD_SHIFT;
+
+    /* A blocked entity neither runs nor waits */
+    if (!load)
+        runnable = running = 0;
+
+    return pelt_accumulate_sum(delta, sa, load, runnable, running) != 0;
+}
+
+static inline void pelt_update_load_avg(struct sched_avg *sa, unsigned long load)
+{
+    uint32_t divider = pelt_divider(sa);
+
+    sa->load_avg = (unsigned long)(load * sa->load_sum / divider);
+    sa->runnable_avg = (unsigned long)(sa->runnable_sum / divider);
+    sa->util_avg = sa->util_sum / divider;
+}
+
+/* Entity: load_sum counts runnable time, scaled by weight on output */
+static inline bool pelt_update_entity(uint64_t now, struct sched_avg *sa, unsigned long weight,
+                                      bool on_rq, unsigned long running)
+{
+    if (!pelt_update_load_sum(now, sa, on_rq, on_rq, running))
+        return false;
+    pelt_update_load_avg(sa, weight);
+    return true;
+}
+
+/* Runqueue: load_sum already carries the total weight */
+static inline bool pelt_update_rq(uint64_t now, struct sched_avg *sa, unsigned long load_weight,
+                                  unsigned int nr_running, unsigned long running)
+{
+    if (!pelt_update_load_sum(now, sa, load_weight, nr_running, running))
+        return false;
+    pelt_update_load_avg(sa, 1);
+    return true;
+}
+
+/* New entities start fully loaded so balancing sees them immediately */
+static inline void pelt_init_entity(struct sched_avg *sa, unsigned long weight)
+{
+    sa->last_update_time = 0;
+    sa->period_contrib = PELT_PERIOD - 1;
+    sa->load_sum = pelt_divider(sa);
+    sa->load_avg = weight;
+    sa->runnable_sum = 0;
+    sa->runnable_avg = 0;
+    sa->util_sum = 0;
+    sa->util_avg = 0;
+}
+
+/* Move an entity's history onto a runqueue, aligned to its period */
+static inline void pelt_attach_entity(struct sched_avg *rq, struct sched_avg *se,
+                                      unsigned long weight)
+{
+    uint32_t divider = pelt_divider(rq);
+
+    se->last_update_time = rq->last_update_time;
+    se->period_contrib = rq->period_contrib;
+    se->util_sum = (uint32_t)(se->util_avg * divider);
+    se->runnable_sum = (uint64_t)se->runnable_avg * divider;
+    se->load_sum = weight ? (uint64_t)se->load_avg * divider / weight : 0;
+
+    rq->util_avg += se->util_avg;
+    rq->util_sum += se->util_sum;
+    rq->runnable_avg += se->runnable_avg;
+    rq->runnable_sum += se->runnable_sum;
+    rq->load_avg += se->load_avg;
+    rq->load_sum += (uint64_t)weight * se->load_sum;
+}
+
+/* Remove an entity's contribution; clamp against rounding drift */
+static inline void pelt_detach_entity(struct sched_avg *rq, struct sched_avg *se,
+                                      unsigned long weight)
+{
+#define PELT_SUB_POSITIVE(var, val) ((var) = (var) > (val) ? (var) - (val) : 0)
+    PELT_SUB_POSITIVE(rq->util_avg, se->util_avg);
+    PELT_SUB_POSITIVE(rq->util_sum, se->util_sum);
+    PELT_SUB_POSITIVE(rq->runnable_avg, se->runnable_avg);
+    PELT_SUB_POSITIVE(rq->runnable_sum, se->runnable_sum);
+    PELT_SUB_POSITIVE(rq->load_avg, se->load_avg);
+    PELT_SUB_POSITIVE(rq->load_sum, (uint64_t)weight * se->load_sum);
+#undef PELT_SUB_POSITIVE
+
+    /* Keep the sum consistent with the average after clamping */
+    if (rq->util_sum < rq->util_avg * PELT_MIN_DIVIDER)
+        rq->util_sum = (uint32_t)(rq->util_avg * PELT_MIN_DIVIDER);
+
+    se->last_update_time = 0;
+}
+
+#endif /* _PELT_SIM_H */
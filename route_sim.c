@@ -2,6 +2,9 @@
 /*
  * IP Routing Table Simulation
  * Based on Linux kernel routing implementation
+ *
+ * Longest-prefix match is done by an LC-trie (fib_trie style), with an
+ * optional DIR-24-8 table in front of it. The route cache is optional.
  */
 
 #include <linux/types.h>
@@ -18,6 +21,14 @@
 #include <linux/string.h>
 #include <linux/jhash.h>
 #include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/sort.h>
+#include <linux/mutex.h>
+#include <linux/bitops.h>
+#include <linux/bitmap.h>
+#include <linux/refcount.h>
+#include <linux/rcupdate.h>
+#include <linux/moduleparam.h>
 #include <net/ip.h>
 #include <net/protocol.h>
 #include <net/route.h>
@@ -38,6 +49,18 @@
 #define RT_CACHE_MIN_DST 256
 #define RT_CACHE_MAX_SIZE (256*1024)
 
+/* FIB Parameters */
+#define FIB_LC_ROOT_BRANCH 16       /* Fixed root fan-out for large tables */
+#define FIB_LC_FILL_NUM 1           /* Node fill factor 1/2 */
+#define FIB_LC_FILL_DEN 2
+#define FIB_SLOT_BITS 16            /* Longer prefixes are grouped per /16 */
+#define FIB_DIR_CHUNK_ENTRIES (1 << 16) /* tbl24 entries per /8 chunk */
+#define FIB_DIR_TBL8_FLAG 0x8000
+#define FIB_DIR_MAX_TBL8 0x8000     /* tbl8 groups per chunk */
+#define FIB_MAX_NH 0x7fff           /* Next-hop index must fit a DIR-24-8 entry */
+#define FIB_NH_NONE 0
+#define FIB_NH_HASH_BITS 12
+
 /* Route Flags */
 #define RTF_UP          0x0001  /* Route usable */
 #define RTF_GATEWAY     0x0002  /* Destination is a gateway */
@@ -53,6 +76,7 @@
 
 /* Route Cache Entry */
 struct rt_cache_entry {
+    struct dst_entry dst;       /* Must be first: dst_alloc() hands out the entry */
     struct rt_cache_entry *next;
     struct rt_key {
         __be32 dst;
@@ -70,7 +94,6 @@ struct rt_cache_entry {
         unsigned window;
         unsigned rtt;
         struct neighbour *neigh;
-        atomic_t refcnt;
         unsigned long expires;
     } info;
     unsigned long lastuse;
@@ -108,25 +131,41 @@ static inline unsigned int rt_hash(__be32 dst, __be32 src, int iif, __u8 tos)
     return h & RT_HASH_MASK;
 }
 
+static struct kmem_cache *rt_cache_cachep __read_mostly;
+
+/* Called by dst_destroy() before it frees the entry to rt_cache_cachep */
+static void rt_dst_destroy(struct dst_entry *dst)
+{
+    struct rt_cache_entry *rce = container_of(dst, struct rt_cache_entry, dst);
+    
+    if (rce->info.neigh)
+        neigh_release(rce->info.neigh);
+}
+
+static struct dst_ops rt_dst_ops = {
+    .family = AF_INET,
+    .destroy = rt_dst_destroy,
+};
+
+/*
+ * Route entries are dsts: the dst refcount is the only reference count,
+ * and the entry goes back to rt_cache_cachep (after an RCU grace period)
+ * when the last holder - cache, caller or skb - drops it.
+ */
 static struct rt_cache_entry *rt_cache_alloc(void)
 {
     struct rt_cache_entry *rce;
     
-    rce = kmalloc(sizeof(*rce), GFP_ATOMIC);
-    if (rce) {
-        memset(rce, 0, sizeof(*rce));
-        atomic_set(&rce->info.refcnt, 1);
-    }
+    rce = dst_alloc(&rt_dst_ops, NULL, DST_OBSOLETE_NONE, DST_NOCOUNT);
+    if (rce)
+        memset((char *)rce + sizeof(rce->dst), 0,
+               sizeof(*rce) - sizeof(rce->dst));
     return rce;
 }
 
 static void rt_cache_free(struct rt_cache_entry *rce)
 {
-    if (atomic_dec_and_test(&rce->info.refcnt)) {
-        if (rce->info.neigh)
-            neigh_release(rce->info.neigh);
-        kfree(rce);
-    }
+    dst_release(&rce->dst);
 }
 
 static int rt_cache_valid(const struct rt_cache_entry *rce)
@@ -150,8 +189,8 @@ static struct rt_cache_entry *rt_cache_lookup(__be32 dst, __be32 src,
             rce->key.src == src &&
             rce->key.iif == iif &&
             rce->key.tos == tos) {
-            if (rt_cache_valid(rce)) {
-                atomic_inc(&rce->info.refcnt);
+            /* A zero refcount means it is already on its way out */
+            if (rt_cache_valid(rce) && dst_hold_safe(&rce->dst)) {
                 rce->lastuse = jiffies;
                 rt_cache_stat.hits++;
                 rcu_read_unlock();
@@ -208,8 +247,11 @@ static void rt_cache_gc(unsigned long dummy)
     
     rt_cache_stat.gc_total++;
     
-    spin_lock_bh(&rt_hash_lock);
+    /* Drop the lock between buckets so inserts are not stalled by a sweep */
     for (i = 0; i < RT_CACHE_CAPACITY; i++) {
+        if (!rcu_access_pointer(rt_hash_table[i]))
+            continue;
+        spin_lock_bh(&rt_hash_lock);
         rp = &rt_hash_table[i];
         while ((rce = *rp) != NULL) {
             if (!rt_cache_valid(rce) ||
@@ -223,56 +265,1021 @@ static void rt_cache_gc(unsigned long dummy)
                     next_gc = rce->info.expires;
             }
         }
+        spin_unlock_bh(&rt_hash_lock);
     }
-    spin_unlock_bh(&rt_hash_lock);
 }
 
-/* Route Input Processing */
-int ip_route_input_slow(struct sk_buff *skb, __be32 daddr, __be32 saddr,
-                       __u8 tos, struct net_device *dev)
+/*
+ * FIB: longest-prefix-match engine
+ *
+ * Prefixes of length FIB_SLOT_BITS and longer are grouped into slots, one
+ * per /16, each a sorted array with an LC-trie (Nilsson/Karlsson
+ * level-compressed trie) over it; the few shorter prefixes form one extra
+ * slot of their own. An optional DIR-24-8 table sits in front, split into
+ * one chunk per /8.
+ *
+ * Updates are applied in batches. A commit rebuilds only the slots the
+ * batch touches and repaints only their /16s of DIR-24-8, in copies of the
+ * affected chunks; everything else is shared with the previous snapshot
+ * through reference counts. The new snapshot is published with
+ * rcu_assign_pointer(), so lookups take no locks and never observe a
+ * half-applied batch. What only the old snapshot held is freed after a
+ * grace period.
+ */
+
+struct fib_nh_res {
+    __be32 gw;
+    int oif;
+    unsigned flags;
+    unsigned mtu;
+    unsigned window;
+    unsigned rtt;
+    __u8 scope;
+};
+
+struct fib_route {
+    u32 key;                /* Host order, masked to plen */
+    u8 plen;
+    u16 nh;                 /* Index into fib_nh_table, 1-based */
+};
+
+struct lc_entry {
+    u32 key;
+    u8 plen;
+    u16 nh;
+    s32 pre;                /* Next shorter covering prefix, -1 if none */
+};
+
+struct lc_node {
+    u8 branch;              /* log2(children), 0 for a leaf */
+    u8 skip;                /* Bits skipped before branching */
+    u32 adr;                /* First child, or base vector index for a leaf */
+};
+
+struct lc_trie {
+    struct lc_node *trie;
+    struct lc_entry *base;  /* Prefixes that contain no other prefix */
+    struct lc_entry *pre;   /* Prefixes that contain others */
+    u32 ntrie;
+    u32 nbase;
+    u32 npre;
+};
+
+/* Immutable once published; shared by every snapshot that holds a ref */
+struct fib_slot {
+    struct fib_route *routes;   /* Sorted by (key, plen) */
+    u32 nroutes;
+    struct lc_trie lc;
+    refcount_t ref;
+};
+
+/* The 256 /16 slots of one /8 */
+struct fib_slot_dir {
+    struct fib_slot *slot[256];
+    refcount_t ref;
+};
+
+/*
+ * DIR-24-8 for one /8: a tbl24 entry per /24, and 256-entry tbl8 groups
+ * for /24s that contain longer prefixes. Copied on write.
+ */
+struct dir_chunk {
+    u16 *tbl8;
+    u32 ntbl8;
+    u32 cap8;
+    refcount_t ref;
+    u16 tbl24[FIB_DIR_CHUNK_ENTRIES];
+};
+
+struct fib_snapshot {
+    struct fib_slot_dir *slots[256];
+    struct fib_slot *shorts;        /* Prefixes shorter than FIB_SLOT_BITS */
+    struct dir_chunk *dir[256];     /* NULL: this /8 is looked up in the tries */
+    u32 nroutes;
+    struct rcu_head rcu;
+};
+
+enum {
+    FIB_OP_ADD,
+    FIB_OP_DEL,
+};
+
+struct fib_update {
+    u32 key;
+    u32 seq;                /* Later updates to one prefix win */
+    u8 plen;
+    u8 op;
+    u16 nh;
+};
+
+struct fib_batch {
+    struct fib_update *ops;
+    u32 n;
+    u32 cap;
+};
+
+static struct fib_snapshot __rcu *fib_current;
+static DEFINE_MUTEX(fib_mutex);
+static DEFINE_SPINLOCK(fib_nh_lock);
+
+/* Next hops are interned and never change once published */
+static struct fib_nh_res fib_nh_table[FIB_MAX_NH + 1];
+static u32 fib_nh_count;
+
+/* Intern index: chains of fib_nh_table slots, linked through fib_nh_next */
+static u16 fib_nh_hash[1 << FIB_NH_HASH_BITS];
+static u16 fib_nh_next[FIB_MAX_NH + 1];
+
+static bool fib_dir24_enabled = true;
+module_param(fib_dir24_enabled, bool, 0444);
+MODULE_PARM_DESC(fib_dir24_enabled, "Build a DIR-24-8 table in front of the LC-trie");
+
+static bool rt_cache_enabled;
+module_param(rt_cache_enabled, bool, 0644);
+MODULE_PARM_DESC(rt_cache_enabled, "Cache FIB results in the route cache");
+
+static inline u32 fib_mask(u8 plen)
 {
-    struct rt_cache_entry *rce;
-    struct fib_result res;
+    return plen ? ~0U << (32 - plen) : 0;
+}
+
+/* Bits [pos, pos + n) of key counting from the MSB; n >= 1 */
+static inline u32 lc_extract(u32 pos, u32 n, u32 key)
+{
+    return (key << pos) >> (32 - n);
+}
+
+/* Field by field: the struct has padding, so memcmp() would see garbage */
+static u32 fib_nh_hashfn(const struct fib_nh_res *res)
+{
+    u32 h;
+
+    h = jhash_3words((__force u32)res->gw, res->oif, res->flags, 0);
+    h = jhash_3words(res->mtu, res->window, res->rtt, h);
+    return jhash_1word(res->scope, h) >> (32 - FIB_NH_HASH_BITS);
+}
+
+static bool fib_nh_equal(const struct fib_nh_res *a, const struct fib_nh_res *b)
+{
+    return a->gw == b->gw && a->oif == b->oif && a->flags == b->flags &&
+           a->mtu == b->mtu && a->window == b->window && a->rtt == b->rtt &&
+           a->scope == b->scope;
+}
+
+static int fib_nh_intern(const struct fib_nh_res *res)
+{
+    u32 h = fib_nh_hashfn(res);
+    u32 i;
+
+    spin_lock_bh(&fib_nh_lock);
+    for (i = fib_nh_hash[h]; i != FIB_NH_NONE; i = fib_nh_next[i]) {
+        if (fib_nh_equal(&fib_nh_table[i], res)) {
+            spin_unlock_bh(&fib_nh_lock);
+            return i;
+        }
+    }
+    if (fib_nh_count >= FIB_MAX_NH) {
+        spin_unlock_bh(&fib_nh_lock);
+        return -ENOSPC;
+    }
+    i = ++fib_nh_count;
+    fib_nh_table[i] = *res;
+    fib_nh_next[i] = fib_nh_hash[h];
+    fib_nh_hash[h] = i;
+    spin_unlock_bh(&fib_nh_lock);
+    return i;
+}
+
+/* Number of leading bits a and b share, starting at pos */
+static inline u32 lc_common_bits(u32 a, u32 b, u32 pos)
+{
+    u32 x = (a ^ b) << pos;
+
+    return x ? 32 - fls(x) : 32 - pos;
+}
+
+/*
+ * Largest branching factor for which at least FILL of the 2^branch
+ * children would be non-empty (entries are sorted, so distinct bit
+ * patterns are contiguous).
+ */
+static u32 lc_compute_branch(const struct lc_entry *base, u32 first, u32 n,
+                             u32 pos)
+{
+    u32 branch = 1, count, pat, prev, i;
+
+    if (n == 2)
+        return 1;
+
+    do {
+        branch++;
+        if (pos + branch > 32)
+            break;
+        count = 0;
+        prev = 0;
+        for (i = first; i < first + n; i++) {
+            pat = lc_extract(pos, branch, base[i].key);
+            if (i == first || pat != prev)
+                count++;
+            prev = pat;
+        }
+    } while (count * FIB_LC_FILL_DEN >= (1U << branch) * FIB_LC_FILL_NUM);
+
+    return branch - 1;
+}
+
+/*
+ * Longest prefix longer than pos covering slot bitpat, among e itself (a
+ * base prefix may end inside the branch bits) and its prefix chain.
+ */
+static u32 lc_chain_match(const struct lc_trie *t, const struct lc_entry *e,
+                          u32 pos, u32 branch, u32 bitpat)
+{
+    const struct lc_entry *pe = e;
+    u32 len;
+
+    for (;;) {
+        if (pe->plen <= pos)
+            break;
+        len = min_t(u32, pe->plen - pos, branch);
+        if (lc_extract(pos, len, pe->key) == bitpat >> (branch - len))
+            return pe->plen;
+        if (pe->pre == -1)
+            break;
+        pe = &t->pre[pe->pre];
+    }
+    return 0;
+}
+
+/*
+ * Build the subtrie for base[first, first + n) at trie slot node. With
+ * t->trie == NULL only *nextfree is advanced, which sizes the trie.
+ */
+static void lc_build(struct lc_trie *t, u32 first, u32 n, u32 pos, u32 node,
+                     u32 *nextfree)
+{
+    const struct lc_entry *base = t->base;
+    u32 skip, branch, adr, bitpat, p, k, leaf, m1, m2;
+
+    if (n == 1) {
+        if (t->trie) {
+            t->trie[node].branch = 0;
+            t->trie[node].skip = 0;
+            t->trie[node].adr = first;
+        }
+        return;
+    }
+
+    skip = lc_common_bits(base[first].key, base[first + n - 1].key, pos);
+    pos += skip;
+
+    if (node == 0 && n >= (1U << (FIB_LC_ROOT_BRANCH - 1)) &&
+        pos + FIB_LC_ROOT_BRANCH <= 32)
+        branch = FIB_LC_ROOT_BRANCH;
+    else
+        branch = lc_compute_branch(base, first, n, pos);
+
+    adr = *nextfree;
+    *nextfree += 1U << branch;
+    if (t->trie) {
+        t->trie[node].branch = branch;
+        t->trie[node].skip = skip;
+        t->trie[node].adr = adr;
+    }
+
+    p = first;
+    for (bitpat = 0; bitpat < (1U << branch); bitpat++) {
+        k = 0;
+        while (p + k < first + n &&
+               lc_extract(pos, branch, base[p + k].key) == bitpat)
+            k++;
+
+        if (k) {
+            lc_build(t, p, k, pos + branch, adr + bitpat, nextfree);
+            p += k;
+            continue;
+        }
+
+        /*
+         * Empty slot: point at the neighbouring leaf whose prefix or chain
+         * covers this slot; shorter covering prefixes are in every chain.
+         */
+        m1 = p > first ? lc_chain_match(t, &base[p - 1], pos, branch, bitpat) : 0;
+        m2 = p < first + n ? lc_chain_match(t, &base[p], pos, branch, bitpat) : 0;
+        leaf = ((m1 > m2 && m1) || p == first + n) ? p - 1 : p;
+        lc_build(t, leaf, 1, pos + branch, adr + bitpat, nextfree);
+    }
+}
+
+static void lc_trie_free(struct lc_trie *t)
+{
+    kvfree(t->trie);
+    kvfree(t->base);
+    kvfree(t->pre);
+    memset(t, 0, sizeof(*t));
+}
+
+/* routes must be sorted by (key, plen) and free of duplicates */
+static int lc_trie_build(struct lc_trie *t, const struct fib_route *routes, u32 n)
+{
+    s32 stack[33];
+    u32 i, sp = 0, nextfree;
+
+    memset(t, 0, sizeof(*t));
+    if (!n)
+        return 0;
+
+    t->base = kvmalloc_array(n, sizeof(*t->base), GFP_KERNEL);
+    t->pre = kvmalloc_array(n, sizeof(*t->pre), GFP_KERNEL);
+    if (!t->base || !t->pre)
+        goto nomem;
+
+    /*
+     * A prefix is internal if the next prefix in sort order lies inside it.
+     * The stack holds the internal prefixes enclosing the current one.
+     */
+    for (i = 0; i < n; i++) {
+        const struct fib_route *r = &routes[i];
+        struct lc_entry e = { .key = r->key, .plen = r->plen, .nh = r->nh };
+
+        while (sp && ((t->pre[stack[sp - 1]].key ^ r->key) &
+                      fib_mask(t->pre[stack[sp - 1]].plen)))
+            sp--;
+        e.pre = sp ? stack[sp - 1] : -1;
+
+        if (i + 1 < n && !((routes[i + 1].key ^ r->key) & fib_mask(r->plen))) {
+            t->pre[t->npre] = e;
+            stack[sp++] = t->npre++;
+        } else {
+            t->base[t->nbase++] = e;
+        }
+    }
+
+    nextfree = 1;
+    lc_build(t, 0, t->nbase, 0, 0, &nextfree);
+    t->trie = kvmalloc_array(nextfree, sizeof(*t->trie), GFP_KERNEL);
+    if (!t->trie)
+        goto nomem;
+    t->ntrie = nextfree;
+    nextfree = 1;
+    lc_build(t, 0, t->nbase, 0, 0, &nextfree);
+    return 0;
+
+nomem:
+    lc_trie_free(t);
+    return -ENOMEM;
+}
+
+static u16 lc_trie_lookup(const struct lc_trie *t, u32 addr)
+{
+    const struct lc_entry *e;
+    struct lc_node node;
+    u32 pos, branch;
+    s32 pre;
+
+    if (!t->ntrie)
+        return FIB_NH_NONE;
+
+    node = t->trie[0];
+    pos = node.skip;
+    while (node.branch) {
+        branch = node.branch;
+        node = t->trie[node.adr + lc_extract(pos, branch, addr)];
+        pos += branch + node.skip;
+    }
+
+    e = &t->base[node.adr];
+    if (!((e->key ^ addr) & fib_mask(e->plen)))
+        return e->nh;
+
+    for (pre = e->pre; pre != -1; pre = e->pre) {
+        e = &t->pre[pre];
+        if (!((e->key ^ addr) & fib_mask(e->plen)))
+            return e->nh;
+    }
+    return FIB_NH_NONE;
+}
+
+static void fib_slot_put(struct fib_slot *s)
+{
+    if (s && refcount_dec_and_test(&s->ref)) {
+        lc_trie_free(&s->lc);
+        kvfree(s->routes);
+        kfree(s);
+    }
+}
+
+static void fib_slot_dir_put(struct fib_slot_dir *sd)
+{
+    int i;
+
+    if (!sd || !refcount_dec_and_test(&sd->ref))
+        return;
+    for (i = 0; i < 256; i++)
+        fib_slot_put(sd->slot[i]);
+    kfree(sd);
+}
+
+static void dir_chunk_put(struct dir_chunk *d)
+{
+    if (d && refcount_dec_and_test(&d->ref)) {
+        kvfree(d->tbl8);
+        kvfree(d);
+    }
+}
+
+/*
+ * Copy src for writing, or start an empty chunk. Entries of the /16s set
+ * in skip are about to be repainted, so they and their tbl8 groups are not
+ * copied; groups earlier repaints left unreferenced are dropped too.
+ */
+static struct dir_chunk *dir_chunk_clone(const struct dir_chunk *src,
+                                         const unsigned long *skip)
+{
+    struct dir_chunk *d;
+    u32 i, live = 0;
+    u16 e;
+
+    d = kvzalloc(sizeof(*d), GFP_KERNEL);
+    if (!d)
+        return NULL;
+    refcount_set(&d->ref, 1);
+    if (!src)
+        return d;
+
+    for (i = 0; i < FIB_DIR_CHUNK_ENTRIES; i++)
+        live += (src->tbl24[i] & FIB_DIR_TBL8_FLAG) && !test_bit(i >> 8, skip);
+    if (live) {
+        d->tbl8 = kvmalloc_array(live * 256, sizeof(*d->tbl8), GFP_KERNEL);
+        if (!d->tbl8) {
+            dir_chunk_put(d);
+            return NULL;
+        }
+        d->cap8 = live;
+    }
+
+    for (i = 0; i < FIB_DIR_CHUNK_ENTRIES; i++) {
+        if (test_bit(i >> 8, skip))
+            continue;
+        e = src->tbl24[i];
+        if (e & FIB_DIR_TBL8_FLAG) {
+            memcpy(&d->tbl8[d->ntbl8 << 8],
+                   &src->tbl8[(u32)(e & ~FIB_DIR_TBL8_FLAG) << 8],
+                   256 * sizeof(*d->tbl8));
+            e = FIB_DIR_TBL8_FLAG | d->ntbl8++;
+        }
+        d->tbl24[i] = e;
+    }
+    return d;
+}
+
+/* Append a tbl8 group filled with e; returns its index */
+static int dir_chunk_new_group(struct dir_chunk *d, u16 e)
+{
+    u32 i, g;
+
+    if (d->ntbl8 == FIB_DIR_MAX_TBL8)
+        return -ENOSPC;
+    if (d->ntbl8 == d->cap8) {
+        u32 cap = min_t(u32, d->cap8 ? d->cap8 * 2 : 16, FIB_DIR_MAX_TBL8);
+        u16 *tbl8 = kvmalloc_array(cap * 256, sizeof(*tbl8), GFP_KERNEL);
+
+        if (!tbl8)
+            return -ENOMEM;
+        if (d->tbl8)
+            memcpy(tbl8, d->tbl8, d->ntbl8 * 256 * sizeof(*tbl8));
+        kvfree(d->tbl8);
+        d->tbl8 = tbl8;
+        d->cap8 = cap;
+    }
+
+    g = d->ntbl8++;
+    for (i = 0; i < 256; i++)
+        d->tbl8[(g << 8) | i] = e;
+    return g;
+}
+
+/*
+ * Recompute the 256 tbl24 entries of /16 slot: the longest short prefix
+ * covering all of it, then the slot's own prefixes in increasing length so
+ * longer ones overwrite shorter ones.
+ */
+static int dir_chunk_paint(struct dir_chunk *d, const struct fib_snapshot *snap,
+                           u32 slot)
+{
+    const struct fib_slot_dir *sd = snap->slots[slot >> 8];
+    const struct fib_slot *s = sd ? sd->slot[slot & 0xff] : NULL;
+    u16 *tbl24 = &d->tbl24[(slot & 0xff) << 8];
+    u16 nh = FIB_NH_NONE;
+    u32 plen, i, k, idx, cnt;
+    int g;
+
+    if (snap->shorts)
+        nh = lc_trie_lookup(&snap->shorts->lc, slot << FIB_SLOT_BITS);
+    for (i = 0; i < 256; i++)
+        tbl24[i] = nh;
+    if (!s)
+        return 0;
+
+    /* A pass per length; slots are small and this needs no allocation */
+    for (plen = FIB_SLOT_BITS; plen <= 32; plen++) {
+        for (k = 0; k < s->nroutes; k++) {
+            const struct fib_route *r = &s->routes[k];
+
+            if (r->plen != plen)
+                continue;
+
+            idx = (r->key >> 8) & 0xff;
+            if (plen <= 24) {
+                cnt = 1U << (24 - plen);
+                for (i = 0; i < cnt; i++)
+                    tbl24[idx + i] = r->nh;
+                continue;
+            }
+
+            if (tbl24[idx] & FIB_DIR_TBL8_FLAG) {
+                g = tbl24[idx] & ~FIB_DIR_TBL8_FLAG;
+            } else {
+                g = dir_chunk_new_group(d, tbl24[idx]);
+                if (g < 0)
+                    return g;
+                tbl24[idx] = FIB_DIR_TBL8_FLAG | g;
+            }
+            idx = ((u32)g << 8) | (r->key & 0xff);
+            cnt = 1U << (32 - plen);
+            for (i = 0; i < cnt; i++)
+                d->tbl8[idx + i] = r->nh;
+        }
+    }
+    return 0;
+}
+
+/* One read for most destinations, two for /24s holding longer prefixes */
+static inline u16 dir_chunk_lookup(const struct dir_chunk *d, u32 addr)
+{
+    u16 e = d->tbl24[(addr >> 8) & (FIB_DIR_CHUNK_ENTRIES - 1)];
+
+    if (unlikely(e & FIB_DIR_TBL8_FLAG))
+        e = d->tbl8[((u32)(e & ~FIB_DIR_TBL8_FLAG) << 8) | (addr & 0xff)];
+    return e;
+}
+
+static u16 fib_trie_lookup(const struct fib_snapshot *snap, u32 addr)
+{
+    const struct fib_slot_dir *sd = snap->slots[addr >> 24];
+    const struct fib_slot *s = sd ? sd->slot[(addr >> 16) & 0xff] : NULL;
+    u16 nh = FIB_NH_NONE;
+
+    if (s)
+        nh = lc_trie_lookup(&s->lc, addr);
+    if (nh == FIB_NH_NONE && snap->shorts)
+        nh = lc_trie_lookup(&snap->shorts->lc, addr);
+    return nh;
+}
+
+static void fib_snapshot_free(struct fib_snapshot *snap)
+{
+    int c;
+
+    if (!snap)
+        return;
+    for (c = 0; c < 256; c++) {
+        fib_slot_dir_put(snap->slots[c]);
+        dir_chunk_put(snap->dir[c]);
+    }
+    fib_slot_put(snap->shorts);
+    kfree(snap);
+}
+
+static void fib_snapshot_free_rcu(struct rcu_head *head)
+{
+    fib_snapshot_free(container_of(head, struct fib_snapshot, rcu));
+}
+
+static int fib_update_cmp(const void *a, const void *b)
+{
+    const struct fib_update *x = a, *y = b;
+
+    if (x->key != y->key)
+        return x->key < y->key ? -1 : 1;
+    if (x->plen != y->plen)
+        return x->plen < y->plen ? -1 : 1;
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static int fib_batch_push(struct fib_batch *b, __be32 prefix, u8 plen,
+                          u8 op, u16 nh)
+{
+    struct fib_update *u;
+
+    if (plen > 32)
+        return -EINVAL;
+
+    if (b->n == b->cap) {
+        u32 cap = b->cap ? b->cap * 2 : 1024;
+        struct fib_update *ops = kvmalloc_array(cap, sizeof(*ops), GFP_KERNEL);
+
+        if (!ops)
+            return -ENOMEM;
+        if (b->ops)
+            memcpy(ops, b->ops, b->n * sizeof(*ops));
+        kvfree(b->ops);
+        b->ops = ops;
+        b->cap = cap;
+    }
+
+    u = &b->ops[b->n];
+    u->key = ntohl(prefix) & fib_mask(plen);
+    u->plen = plen;
+    u->op = op;
+    u->nh = nh;
+    u->seq = b->n++;
+    return 0;
+}
+
+/* Queue a route add/replace; nothing is visible until fib_batch_commit() */
+int fib_batch_add(struct fib_batch *b, __be32 prefix, u8 plen,
+                  const struct fib_nh_res *res)
+{
+    int nh = fib_nh_intern(res);
+
+    if (nh < 0)
+        return nh;
+    return fib_batch_push(b, prefix, plen, FIB_OP_ADD, nh);
+}
+
+/* Queue a route delete */
+int fib_batch_del(struct fib_batch *b, __be32 prefix, u8 plen)
+{
+    return fib_batch_push(b, prefix, plen, FIB_OP_DEL, FIB_NH_NONE);
+}
+
+void fib_batch_release(struct fib_batch *b)
+{
+    kvfree(b->ops);
+    memset(b, 0, sizeof(*b));
+}
+
+/* Merge the sorted batch into the sorted route array */
+static u32 fib_merge_routes(struct fib_route *out, const struct fib_route *old,
+                            u32 nold, const struct fib_update *ops, u32 nops)
+{
+    u32 i = 0, j = 0, n = 0;
+
+    while (i < nold || j < nops) {
+        const struct fib_update *u;
+
+        if (j == nops || (i < nold &&
+            (old[i].key < ops[j].key ||
+             (old[i].key == ops[j].key && old[i].plen < ops[j].plen)))) {
+            out[n++] = old[i++];
+            continue;
+        }
+
+        /* Collapse all updates to one prefix; the last one wins */
+        u = &ops[j];
+        while (j + 1 < nops && ops[j + 1].key == u->key &&
+               ops[j + 1].plen == u->plen)
+            u = &ops[++j];
+        j++;
+
+        if (i < nold && old[i].key == u->key && old[i].plen == u->plen)
+            i++;
+        if (u->op == FIB_OP_ADD) {
+            out[n].key = u->key;
+            out[n].plen = u->plen;
+            out[n].nh = u->nh;
+            n++;
+        }
+    }
+    return n;
+}
+
+/*
+ * Merge ops into old's prefixes and build a new slot from the result;
+ * *out is NULL if no prefixes are left.
+ */
+static int fib_slot_build(struct fib_slot **out, const struct fib_slot *old,
+                          const struct fib_update *ops, u32 nops)
+{
+    struct fib_slot *s;
     int err;
-    
-    /* Check for martian addresses */
-    if (ipv4_is_multicast(saddr) || ipv4_is_lbcast(saddr) ||
-        ipv4_is_loopback(saddr)) {
-        goto martian_source;
+
+    *out = NULL;
+    s = kzalloc(sizeof(*s), GFP_KERNEL);
+    if (!s)
+        return -ENOMEM;
+    refcount_set(&s->ref, 1);
+
+    s->routes = kvmalloc_array((old ? old->nroutes : 0) + nops,
+                               sizeof(*s->routes), GFP_KERNEL);
+    if (!s->routes) {
+        fib_slot_put(s);
+        return -ENOMEM;
     }
-    
-    /* Route lookup in FIB */
-    err = fib_lookup(dev_net(dev), &res);
+    s->nroutes = fib_merge_routes(s->routes, old ? old->routes : NULL,
+                                  old ? old->nroutes : 0, ops, nops);
+    if (!s->nroutes) {
+        fib_slot_put(s);
+        return 0;
+    }
+
+    err = lc_trie_build(&s->lc, s->routes, s->nroutes);
     if (err) {
-        if (err == -EINVAL)
-            goto martian_destination;
-        goto no_route;
+        fib_slot_put(s);
+        return err;
+    }
+    *out = s;
+    return 0;
+}
+
+/* Give snap its own copy of the slot directory for /8 c */
+static struct fib_slot_dir *fib_slot_dir_cow(struct fib_snapshot *snap,
+                                             const struct fib_snapshot *old,
+                                             u32 c)
+{
+    struct fib_slot_dir *sd = snap->slots[c], *nsd;
+    int i;
+
+    if (sd && (!old || sd != old->slots[c]))
+        return sd;
+
+    nsd = kzalloc(sizeof(*nsd), GFP_KERNEL);
+    if (!nsd)
+        return NULL;
+    refcount_set(&nsd->ref, 1);
+    if (sd) {
+        for (i = 0; i < 256; i++) {
+            nsd->slot[i] = sd->slot[i];
+            if (nsd->slot[i])
+                refcount_inc(&nsd->slot[i]->ref);
+        }
+        fib_slot_dir_put(sd);
+    }
+    snap->slots[c] = nsd;
+    return nsd;
+}
+
+/*
+ * Repaint DIR-24-8 for the /16s set in dirty. A chunk this /8 never had,
+ * or had to give up, is painted whole. A chunk that runs out of tbl8
+ * groups is dropped and its /8 looked up in the tries instead.
+ */
+static int fib_dir_update(struct fib_snapshot *snap, const unsigned long *dirty)
+{
+    struct dir_chunk *d;
+    u32 c, i;
+    int err;
+
+    for (c = 0; c < 256; c++) {
+        const unsigned long *map = dirty + c * BITS_TO_LONGS(256);
+
+        if (bitmap_empty(map, 256))
+            continue;
+
+        d = dir_chunk_clone(snap->dir[c], map);
+        if (!d)
+            return -ENOMEM;
+        err = 0;
+        for (i = 0; i < 256 && !err; i++)
+            if (!snap->dir[c] || test_bit(i, map))
+                err = dir_chunk_paint(d, snap, (c << 8) | i);
+
+        dir_chunk_put(snap->dir[c]);
+        snap->dir[c] = NULL;
+        if (err) {
+            dir_chunk_put(d);
+            if (err != -ENOSPC)
+                return err;
+            pr_warn_ratelimited("route_sim: too many tbl8 groups in %u.0.0.0/8, using LC-trie only\n",
+                                c);
+            continue;
+        }
+        snap->dir[c] = d;
+    }
+    return 0;
+}
+
+/* Drop all but the last queued update to each prefix; ops must be sorted */
+static u32 fib_batch_collapse(struct fib_update *ops, u32 n)
+{
+    u32 i, k = 0;
+
+    for (i = 0; i < n; i++) {
+        if (i + 1 < n && ops[i + 1].key == ops[i].key &&
+            ops[i + 1].plen == ops[i].plen)
+            continue;
+        ops[k++] = ops[i];
     }
+    return k;
+}
+
+/*
+ * Apply a batch atomically. The new snapshot starts out sharing everything
+ * with the current one; only the slots the batch touches are rebuilt and
+ * only their /16s of DIR-24-8 repainted before it is published.
+ */
+int fib_batch_commit(struct fib_batch *b)
+{
+    struct fib_snapshot *old, *snap;
+    struct fib_update *ops = NULL;
+    struct fib_slot_dir *sd;
+    struct fib_slot *s, **sp;
+    unsigned long *dirty;
+    u32 n, nshort = 0, i, j, c, slot;
+    int err = -ENOMEM;
+
+    snap = kzalloc(sizeof(*snap), GFP_KERNEL);
+    dirty = bitmap_zalloc(1U << FIB_SLOT_BITS, GFP_KERNEL);
+    if (!snap || !dirty)
+        goto out;
+
+    sort(b->ops, b->n, sizeof(*b->ops), fib_update_cmp, NULL);
+    n = b->n = fib_batch_collapse(b->ops, b->n);
+
+    /* Short prefixes first, then the rest in runs of one slot each */
+    for (i = 0; i < n; i++)
+        nshort += b->ops[i].plen < FIB_SLOT_BITS;
+    ops = kvmalloc_array(n ? n : 1, sizeof(*ops), GFP_KERNEL);
+    if (!ops)
+        goto out;
+    for (i = 0, j = 0, c = nshort; i < n; i++) {
+        if (b->ops[i].plen < FIB_SLOT_BITS)
+            ops[j++] = b->ops[i];
+        else
+            ops[c++] = b->ops[i];
+    }
+
+    mutex_lock(&fib_mutex);
+    old = rcu_dereference_protected(fib_current, lockdep_is_held(&fib_mutex));
+
+    if (old) {
+        for (c = 0; c < 256; c++) {
+            snap->slots[c] = old->slots[c];
+            if (snap->slots[c])
+                refcount_inc(&snap->slots[c]->ref);
+            snap->dir[c] = old->dir[c];
+            if (snap->dir[c])
+                refcount_inc(&snap->dir[c]->ref);
+        }
+        snap->shorts = old->shorts;
+        if (snap->shorts)
+            refcount_inc(&snap->shorts->ref);
+        snap->nroutes = old->nroutes;
+    }
+
+    for (i = 0; i < n; i = j) {
+        if (i < nshort) {
+            j = nshort;
+            sp = &snap->shorts;
+            for (c = i; c < j; c++)
+                bitmap_set(dirty, ops[c].key >> FIB_SLOT_BITS,
+                           1U << (FIB_SLOT_BITS - ops[c].plen));
+        } else {
+            slot = ops[i].key >> FIB_SLOT_BITS;
+            for (j = i + 1; j < n && ops[j].key >> FIB_SLOT_BITS == slot; j++)
+                ;
+            sd = fib_slot_dir_cow(snap, old, slot >> 8);
+            if (!sd) {
+                err = -ENOMEM;
+                goto fail;
+            }
+            sp = &sd->slot[slot & 0xff];
+            __set_bit(slot, dirty);
+        }
+
+        err = fib_slot_build(&s, *sp, &ops[i], j - i);
+        if (err)
+            goto fail;
+        snap->nroutes -= *sp ? (*sp)->nroutes : 0;
+        snap->nroutes += s ? s->nroutes : 0;
+        fib_slot_put(*sp);
+        *sp = s;
+    }
+
+    if (fib_dir24_enabled) {
+        err = fib_dir_update(snap, dirty);
+        if (err)
+            goto fail;
+    }
+
+    rcu_assign_pointer(fib_current, snap);
+    mutex_unlock(&fib_mutex);
+
+    if (old)
+        call_rcu(&old->rcu, fib_snapshot_free_rcu);
+    b->n = 0;
+    snap = NULL;
+    err = 0;
+    goto out;
+
+fail:
+    mutex_unlock(&fib_mutex);
+out:
+    fib_snapshot_free(snap);
+    kvfree(ops);
+    bitmap_free(dirty);
+    return err;
+}
+
+/* Longest-prefix match; lockless, safe from any context */
+int fib_lookup_lpm(__be32 daddr, struct fib_nh_res *res)
+{
+    const struct fib_snapshot *snap;
+    const struct dir_chunk *d;
+    u32 addr = ntohl(daddr);
+    u16 nh = FIB_NH_NONE;
+
+    rcu_read_lock();
+    snap = rcu_dereference(fib_current);
+    if (snap) {
+        d = snap->dir[addr >> 24];
+        nh = d ? dir_chunk_lookup(d, addr) : fib_trie_lookup(snap, addr);
+    }
+    rcu_read_unlock();
+
+    if (nh == FIB_NH_NONE)
+        return -ENETUNREACH;
+    *res = fib_nh_table[nh];
+    return 0;
+}
+
+/*
+ * Build a route entry from a FIB result. The entry comes back holding one
+ * reference for the caller; with the route cache on, the cache takes a
+ * second one of its own.
+ */
+static struct rt_cache_entry *rt_entry_create(__be32 daddr, __be32 saddr,
+                                              int iif, int oif, __u8 tos,
+                                              const struct fib_nh_res *res)
+{
+    struct rt_cache_entry *rce;
     
-    /* Create route cache entry */
     rce = rt_cache_alloc();
     if (!rce)
-        goto no_route;
+        return NULL;
     
     /* Fill route cache entry */
     rce->key.dst = daddr;
     rce->key.src = saddr;
-    rce->key.iif = dev->ifindex;
+    rce->key.iif = iif;
+    rce->key.oif = oif;
     rce->key.tos = tos;
-    rce->key.scope = res.scope;
+    rce->key.scope = res->scope;
     
-    rce->info.gw = res.gw;
-    rce->info.oif = res.oif;
-    rce->info.flags = res.flags;
-    rce->info.mtu = res.mtu;
-    rce->info.window = res.window;
-    rce->info.rtt = res.rtt;
+    rce->info.gw = res->gw;
+    rce->info.oif = res->oif;
+    rce->info.flags = res->flags;
+    rce->info.mtu = res->mtu;
+    rce->info.window = res->window;
+    rce->info.rtt = res->rtt;
     
     rce->lastuse = jiffies;
     rce->info.expires = jiffies + RT_GC_TIMEOUT;
     
-    /* Insert into route cache */
-    rt_cache_insert(rce);
+    /* Input routes are delivered locally or forwarded; output ones sent */
+    if (iif)
+        rce->dst.input = res->scope == RT_SCOPE_HOST ? ip_local_deliver
+                                                     : ip_forward;
+    rce->dst.output = ip_output;
+    
+    /* The FIB answers in one or two reads; caching is optional */
+    if (rt_cache_enabled) {
+        dst_hold(&rce->dst);
+        rt_cache_insert(rce);
+    }
+    
+    return rce;
+}
+
+/* Route Input Processing: attaches the route to skb on success */
+int ip_route_input_slow(struct sk_buff *skb, __be32 daddr, __be32 saddr,
+                       __u8 tos, struct net_device *dev)
+{
+    struct rt_cache_entry *rce;
+    struct fib_nh_res res = {};
+    int err;
+    
+    /* Check for martian addresses */
+    if (ipv4_is_multicast(saddr) || ipv4_is_lbcast(saddr) ||
+        ipv4_is_loopback(saddr)) {
+        goto martian_source;
+    }
+    
+    if (ipv4_is_zeronet(daddr) || ipv4_is_loopback(daddr))
+        goto martian_destination;
+    
+    /* Route lookup in FIB */
+    err = fib_lookup_lpm(daddr, &res);
+    if (err)
+        goto no_route;
+    
+    rce = rt_entry_create(daddr, saddr, dev->ifindex, 0, tos, &res);
+    if (!rce)
+        goto no_route;
+    
+    /* The skb takes over the caller's reference */
+    skb_dst_set(skb, &rce->dst);
     
     return 0;
 
@@ -289,45 +1296,27 @@ no_route:
     return -EHOSTUNREACH;
 }
 
-/* Route Output Processing */
+/*
+ * Route Output Processing. Like rt_cache_lookup(), returns a referenced
+ * entry whether or not the route cache is on; callers drop it with
+ * rt_cache_free().
+ */
 struct rt_cache_entry *ip_route_output_slow(__be32 daddr, __be32 saddr,
                                           __u8 tos, int oif)
 {
     struct rt_cache_entry *rce;
-    struct fib_result res;
+    struct fib_nh_res res = {};
     int err;
     
     /* Route lookup in FIB */
-    err = fib_lookup(dev_net(init_net.loopback_dev), &res);
+    err = fib_lookup_lpm(daddr, &res);
     if (err)
         goto no_route;
     
-    /* Create route cache entry */
-    rce = rt_cache_alloc();
+    rce = rt_entry_create(daddr, saddr, 0, oif, tos, &res);
     if (!rce)
         goto no_route;
     
-    /* Fill route cache entry */
-    rce->key.dst = daddr;
-    rce->key.src = saddr;
-    rce->key.iif = 0;
-    rce->key.oif = oif;
-    rce->key.tos = tos;
-    rce->key.scope = res.scope;
-    
-    rce->info.gw = res.gw;
-    rce->info.oif = res.oif;
-    rce->info.flags = res.flags;
-    rce->info.mtu = res.mtu;
-    rce->info.window = res.window;
-    rce->info.rtt = res.rtt;
-    
-    rce->lastuse = jiffies;
-    rce->info.expires = jiffies + RT_GC_TIMEOUT;
-    
-    /* Insert into route cache */
-    rt_cache_insert(rce);
-    
     return rce;
 
 no_route:
@@ -340,6 +1329,11 @@ void __init ip_rt_init(void)
 {
     int i;
     
+    rt_cache_cachep = kmem_cache_create("rt_cache_entry",
+                                        sizeof(struct rt_cache_entry), 0,
+                                        SLAB_HWCACHE_ALIGN | SLAB_PANIC, NULL);
+    rt_dst_ops.kmem_cachep = rt_cache_cachep;
+    
     /* Initialize hash table */
     for (i = 0; i < RT_CACHE_CAPACITY; i++)
         rt_hash_table[i] = NULL;
@@ -363,6 +1357,11 @@ void __exit ip_rt_cleanup(void)
     /* Delete timer */
     del_timer(&rt_gc_timer);
     
+    /* Free the FIB */
+    rcu_barrier();
+    fib_snapshot_free(rcu_dereference_protected(fib_current, 1));
+    RCU_INIT_POINTER(fib_current, NULL);
+    
     /* Free all route cache entries */
     for (i = 0; i < RT_CACHE_CAPACITY; i++) {
         for (rce = rt_hash_table[i]; rce; rce = next) {
@@ -371,6 +1370,10 @@ void __exit ip_rt_cleanup(void)
         }
         rt_hash_table[i] = NULL;
     }
+    
+    /* dst_release() frees after a grace period */
+    rcu_barrier();
+    kmem_cache_destroy(rt_cache_cachep);
 }
 
 /* ICMP Redirect Processing */
@@ -378,14 +1381,21 @@ void ip_rt_send_redirect(struct sk_buff *skb)
 {
     struct iphdr *iph = ip_hdr(skb);
     struct rt_cache_entry *rce;
+    struct fib_nh_res res = {};
     
     rce = rt_cache_lookup(iph->daddr, iph->saddr,
                          skb->dev->ifindex, iph->tos);
-    if (!rce)
+    if (!rce) {
+        if (fib_lookup_lpm(iph->daddr, &res) || !(res.flags & RTF_GATEWAY))
+            return;
+        icmp_send(skb, ICMP_REDIRECT, ICMP_REDIR_HOST, res.gw);
         return;
+    }
     
-    if (!(rce->info.flags & RTF_GATEWAY))
+    if (!(rce->info.flags & RTF_GATEWAY)) {
+        rt_cache_free(rce);
         return;
+    }
     
     icmp_send(skb, ICMP_REDIRECT, ICMP_REDIR_HOST, rce->info.gw);
     rt_cache_free(rce);
@@ -448,6 +1458,31 @@ void rt_cache_debug(void)
     printk(KERN_INFO "  Expired: %lu\n", rt_cache_stat.expired);
     printk(KERN_INFO "  GC Total: %lu\n", rt_cache_stat.gc_total);
     
+    rcu_read_lock();
+    {
+        const struct fib_snapshot *snap = rcu_dereference(fib_current);
+        u32 c, nslots = 0, nchunks = 0, ntbl8 = 0;
+        
+        if (snap) {
+            for (c = 0; c < 256; c++) {
+                if (snap->slots[c])
+                    for (i = 0; i < 256; i++)
+                        nslots += !!snap->slots[c]->slot[i];
+                if (snap->dir[c]) {
+                    nchunks++;
+                    ntbl8 += snap->dir[c]->ntbl8;
+                }
+            }
+            printk(KERN_INFO "FIB: %u prefixes, %u next hops\n",
+                   snap->nroutes, fib_nh_count);
+            printk(KERN_INFO "  LC-trie: %u slots, %u short prefixes\n",
+                   nslots, snap->shorts ? snap->shorts->nroutes : 0);
+            printk(KERN_INFO "  DIR-24-8: %u of 256 chunks, %u tbl8 groups\n",
+                   nchunks, ntbl8);
+        }
+    }
+    rcu_read_unlock();
+    
     printk(KERN_INFO "\nCache Entries:\n");
     for (i = 0; i < RT_CACHE_CAPACITY; i++) {
         for (rce = rt_hash_table[i]; rce; rce = rce->next) {
@@ -4,12 +4,15 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <time.h>
 #include <errno.h>
 #include <unistd.h>
 #include <sys/time.h>
 #include <signal.h>
 
+#include "des_sim.h"
+
 // Logging Macros
 #define LOG_LEVEL_DEBUG 0
 #define LOG_LEVEL_INFO  1
@@ -28,13 +31,24 @@
 static int current_log_level = LOG_LEVEL_INFO;
 
 // RT Scheduler Constants
-#define MAX_CPUS           16
+#define MAX_CPUS           64       // CPU masks are one 64-bit word
 #define MAX_RT_TASKS       256
-#define RT_PRIO_LEVELS     100
+#define RT_PRIO_LEVELS     100      // 0 is the most important
 #define MAX_RUNTIME        1000000  // 1s
 #define MIN_RUNTIME        1000     // 1ms
 #define BANDWIDTH_CAP      950000   // 95% bandwidth cap
 #define TEST_DURATION      30       // seconds
+#define RT_TIMESLICE_US    1000     // preemption check granularity
+#define RR_TIMESLICE_US    100000   // round robin quantum
+
+// One bit per priority plus a delimiter bit at RT_PRIO_LEVELS, so the
+// first-bit search always terminates
+#define RT_BITMAP_WORDS    ((RT_PRIO_LEVELS + 1 + 63) / 64)
+
+// cpupri levels: 0 = no RT task, RT priority p at RT_PRIO_LEVELS - p
+#define CPUPRI_NR_PRIORITIES (RT_PRIO_LEVELS + 1)
+#define CPUPRI_INVALID       -1
+#define CPUPRI_IDLE          0
 
 // RT Task States
 typedef enum {
@@ -64,27 +78,51 @@ typedef struct rt_task {
     uint64_t actual_runtime;
     uint64_t start_time;
     uint64_t completion_time;
+    uint64_t wakeup_time;
+    uint64_t rr_slice;
     int cpu;
     bool throttled;
+    bool woken;             // waiting for its first run since wakeup
     struct rt_task *next;
 } rt_task_t;
 
-// RT Run Queue Structure
+// RT Run Queue Structure: a FIFO per priority, bit set while non-empty
 typedef struct {
     rt_task_t *tasks[RT_PRIO_LEVELS];
-    size_t nr_tasks;
+    rt_task_t *tail[RT_PRIO_LEVELS];
+    uint64_t bitmap[RT_BITMAP_WORDS];
+    size_t nr_tasks;        // queued, not counting current
+    int curr_prio;          // RT_PRIO_LEVELS while nothing runs
+    bool overloaded;        // tasks queued behind a running one
     uint64_t total_runtime;
     pthread_mutex_t lock;
 } rt_rq_t;
 
+// CPU Priority Map: which CPUs run at each cpupri level, so the least
+// important CPU is found without visiting every runqueue
+typedef struct {
+    struct {
+        atomic_uint count;
+        _Atomic uint64_t mask;
+    } pri_to_cpu[CPUPRI_NR_PRIORITIES];
+    int cpu_to_pri[MAX_CPUS];   // written under that CPU's rq lock
+} cpupri_t;
+
+struct rt_manager;
+
 // CPU Structure
 typedef struct {
     unsigned int id;
+    struct rt_manager *manager;
     rt_rq_t *rt_rq;
     rt_task_t *current;
     uint64_t rt_runtime;
     uint64_t rt_period;
     bool rt_throttled;
+    uint64_t slice_start;       // virtual time mode
+    uint64_t slice_end;
+    uint64_t slice_gen;
+    uint64_t stalled_runtime;   // ran before a throttle, not yet charged
     pthread_t thread;
     pthread_mutex_t lock;
 } rt_cpu_t;
@@ -97,6 +135,9 @@ typedef struct {
     uint64_t migrations;
     uint64_t preemptions;
     uint64_t throttles;
+    uint64_t wakeups;
+    uint64_t total_wakeup_latency;
+    uint64_t max_wakeup_latency;
     double avg_response_time;
     double cpu_utilization;
     double bandwidth_usage;
@@ -104,11 +145,14 @@ typedef struct {
 } rt_stats_t;
 
 // RT Scheduler Manager Structure
-typedef struct {
+typedef struct rt_manager {
     rt_cpu_t cpus[MAX_CPUS];
     rt_task_t *tasks[MAX_RT_TASKS];
     size_t nr_cpus;
     size_t nr_tasks;
+    cpupri_t cpupri;
+    _Atomic uint64_t rto_mask;  // overloaded CPUs
+    bool push_pull;             // cpupri placement and RT migration
     bool running;
     pthread_mutex_t manager_lock;
     pthread_t bandwidth_thread;
@@ -132,9 +176,10 @@ void schedule_rt_task(rt_manager_t *manager, rt_task_t *task);
 void check_bandwidth(rt_manager_t *manager);
 
 void run_test(rt_manager_t *manager);
+void run_test_virtual(rt_manager_t *manager, uint64_t seed, uint64_t duration_us);
 void calculate_stats(rt_manager_t *manager);
 void print_test_stats(rt_manager_t *manager);
-void demonstrate_rt_scheduler(void);
+void demonstrate_rt_scheduler(const struct des_options *opts);
 
 // Utility Functions
 const char* get_log_level_string(int level) {
@@ -173,13 +218,148 @@ rt_rq_t* create_rt_rq(void) {
     if (!rq) return NULL;
 
     memset(rq->tasks, 0, sizeof(rq->tasks));
+    memset(rq->tail, 0, sizeof(rq->tail));
+    memset(rq->bitmap, 0, sizeof(rq->bitmap));
+    rq->bitmap[RT_PRIO_LEVELS / 64] |= 1ULL << (RT_PRIO_LEVELS % 64);
     rq->nr_tasks = 0;
+    rq->curr_prio = RT_PRIO_LEVELS;
+    rq->overloaded = false;
     rq->total_runtime = 0;
     pthread_mutex_init(&rq->lock, NULL);
 
     return rq;
 }
 
+static uint64_t rt_clock_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static inline int rt_prio_to_cpupri(int prio) {
+    return prio >= RT_PRIO_LEVELS ? CPUPRI_IDLE : RT_PRIO_LEVELS - prio;
+}
+
+static void cpupri_init(cpupri_t *cp) {
+    for (int i = 0; i < CPUPRI_NR_PRIORITIES; i++) {
+        atomic_init(&cp->pri_to_cpu[i].count, 0);
+        atomic_init(&cp->pri_to_cpu[i].mask, 0);
+    }
+    for (int i = 0; i < MAX_CPUS; i++)
+        cp->cpu_to_pri[i] = CPUPRI_INVALID;
+}
+
+// Move a CPU to a new level; set the new bit before clearing the old so
+// a concurrent search never misses the CPU altogether
+static void cpupri_set(cpupri_t *cp, int cpu, int newpri) {
+    int oldpri = cp->cpu_to_pri[cpu];
+    uint64_t bit = 1ULL << cpu;
+
+    if (newpri == oldpri)
+        return;
+
+    atomic_fetch_or(&cp->pri_to_cpu[newpri].mask, bit);
+    atomic_fetch_add(&cp->pri_to_cpu[newpri].count, 1);
+    if (oldpri != CPUPRI_INVALID) {
+        atomic_fetch_sub(&cp->pri_to_cpu[oldpri].count, 1);
+        atomic_fetch_and(&cp->pri_to_cpu[oldpri].mask, ~bit);
+    }
+    cp->cpu_to_pri[cpu] = newpri;
+}
+
+// CPUs in the least important non-empty level below prio; the loop ends
+// at the first populated level, bounded by the number of levels
+static bool cpupri_find(cpupri_t *cp, int prio, uint64_t cpus, uint64_t *lowest_mask) {
+    int task_pri = rt_prio_to_cpupri(prio);
+
+    for (int idx = 0; idx < task_pri; idx++) {
+        if (!atomic_load(&cp->pri_to_cpu[idx].count))
+            continue;
+        uint64_t mask = atomic_load(&cp->pri_to_cpu[idx].mask) & cpus;
+        if (mask) {
+            *lowest_mask = mask;
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline int rt_find_first_bit(const uint64_t *bitmap) {
+    int i = 0;
+    while (!bitmap[i])
+        i++;
+    return i * 64 + __builtin_ctzll(bitmap[i]);
+}
+
+// Queue at the tail, or at the head for a preempted task (rq lock held)
+static void __enqueue_rt_task(rt_rq_t *rq, rt_task_t *task, bool head) {
+    int prio = task->priority;
+
+    if (!rq->tasks[prio]) {
+        task->next = NULL;
+        rq->tasks[prio] = rq->tail[prio] = task;
+        rq->bitmap[prio / 64] |= 1ULL << (prio % 64);
+    } else if (head) {
+        task->next = rq->tasks[prio];
+        rq->tasks[prio] = task;
+    } else {
+        task->next = NULL;
+        rq->tail[prio]->next = task;
+        rq->tail[prio] = task;
+    }
+    rq->nr_tasks++;
+}
+
+// Remove the head of a non-empty priority list (rq lock held)
+static rt_task_t *__dequeue_rt_task(rt_rq_t *rq, int prio) {
+    rt_task_t *task = rq->tasks[prio];
+
+    rq->tasks[prio] = task->next;
+    if (!task->next) {
+        rq->tail[prio] = NULL;
+        rq->bitmap[prio / 64] &= ~(1ULL << (prio % 64));
+    }
+    rq->nr_tasks--;
+    task->next = NULL;
+    return task;
+}
+
+// Most important task on the CPU, running or queued
+static inline int rt_rq_prio(const rt_rq_t *rq) {
+    int prio = rt_find_first_bit(rq->bitmap);
+    return prio < rq->curr_prio ? prio : rq->curr_prio;
+}
+
+// Publish the CPU's priority and overload state (rq lock held)
+static void update_rt_rq(rt_manager_t *manager, rt_cpu_t *cpu) {
+    rt_rq_t *rq = cpu->rt_rq;
+    bool overloaded = rq->nr_tasks && rq->curr_prio < RT_PRIO_LEVELS;
+
+    cpupri_set(&manager->cpupri, (int)cpu->id, rt_prio_to_cpupri(rt_rq_prio(rq)));
+    if (overloaded != rq->overloaded) {
+        rq->overloaded = overloaded;
+        if (overloaded)
+            atomic_fetch_or(&manager->rto_mask, 1ULL << cpu->id);
+        else
+            atomic_fetch_and(&manager->rto_mask, ~(1ULL << cpu->id));
+    }
+}
+
+static void double_rt_rq_lock(rt_cpu_t *a, rt_cpu_t *b) {
+    if (a->id > b->id) {
+        rt_cpu_t *tmp = a;
+        a = b;
+        b = tmp;
+    }
+    pthread_mutex_lock(&a->rt_rq->lock);
+    pthread_mutex_lock(&b->rt_rq->lock);
+}
+
+static void double_rt_rq_unlock(rt_cpu_t *a, rt_cpu_t *b) {
+    pthread_mutex_unlock(&a->rt_rq->lock);
+    pthread_mutex_unlock(&b->rt_rq->lock);
+}
+
 // Create RT Task
 rt_task_t* create_rt_task(rt_type_t type, int priority) {
     if (priority >= RT_PRIO_LEVELS) return NULL;
@@ -200,8 +380,11 @@ rt_task_t* create_rt_task(rt_type_t type, int priority) {
     task->actual_runtime = 0;
     task->start_time = 0;
     task->completion_time = 0;
+    task->wakeup_time = 0;
+    task->rr_slice = RR_TIMESLICE_US;
     task->cpu = -1;
     task->throttled = false;
+    task->woken = false;
     task->next = NULL;
 
     return task;
@@ -220,9 +403,13 @@ rt_manager_t* create_rt_manager(size_t nr_cpus) {
         return NULL;
     }
 
+    cpupri_init(&manager->cpupri);
+    atomic_init(&manager->rto_mask, 0);
+
     // Initialize CPUs
     for (size_t i = 0; i < nr_cpus; i++) {
         manager->cpus[i].id = i;
+        manager->cpus[i].manager = manager;
         manager->cpus[i].rt_rq = create_rt_rq();
         if (!manager->cpus[i].rt_rq) {
             // Cleanup and return
@@ -237,11 +424,17 @@ rt_manager_t* create_rt_manager(size_t nr_cpus) {
         manager->cpus[i].rt_runtime = 0;
         manager->cpus[i].rt_period = MAX_RUNTIME;
         manager->cpus[i].rt_throttled = false;
+        manager->cpus[i].slice_start = 0;
+        manager->cpus[i].slice_end = UINT64_MAX;
+        manager->cpus[i].slice_gen = 0;
+        manager->cpus[i].stalled_runtime = 0;
         pthread_mutex_init(&manager->cpus[i].lock, NULL);
+        cpupri_set(&manager->cpupri, (int)i, CPUPRI_IDLE);
     }
 
     manager->nr_cpus = nr_cpus;
     manager->nr_tasks = 0;
+    manager->push_pull = true;
     manager->running = false;
     pthread_mutex_init(&manager->manager_lock, NULL);
     memset(&manager->stats, 0, sizeof(rt_stats_t));
@@ -250,74 +443,201 @@ rt_manager_t* create_rt_manager(size_t nr_cpus) {
     return manager;
 }
 
-// CPU Thread
-void* cpu_thread(void *arg) {
-    rt_cpu_t *cpu = (rt_cpu_t*)arg;
-    rt_manager_t *manager = (rt_manager_t*)((void**)arg)[1];
+// Find Lowest CPU: one running less important work than prio, the
+// task's previous CPU if it qualifies; -1 if every CPU is busier
+static int find_lowest_cpu(rt_manager_t *manager, int prio, int prev_cpu) {
+    uint64_t cpus = manager->nr_cpus == 64 ? ~0ULL : (1ULL << manager->nr_cpus) - 1;
+    uint64_t lowest;
+
+    if (!cpupri_find(&manager->cpupri, prio, cpus, &lowest))
+        return -1;
+    if (prev_cpu >= 0 && (lowest >> prev_cpu) & 1)
+        return prev_cpu;
+    return __builtin_ctzll(lowest);
+}
 
-    while (manager->running) {
-        pthread_mutex_lock(&cpu->lock);
+// Move the head of src's prio list to dst (both rq locks held)
+static void move_rt_task(rt_manager_t *manager, rt_cpu_t *src, rt_cpu_t *dst, int prio) {
+    rt_task_t *task = __dequeue_rt_task(src->rt_rq, prio);
 
-        if (cpu->rt_throttled) {
-            pthread_mutex_unlock(&cpu->lock);
-            usleep(1000);  // Wait if throttled
-            continue;
+    task->cpu = (int)dst->id;
+    __enqueue_rt_task(dst->rt_rq, task, false);
+    update_rt_rq(manager, src);
+    update_rt_rq(manager, dst);
+    manager->stats.migrations++;
+
+    LOG(LOG_LEVEL_DEBUG, "Migrated RT task %u (prio %d) from CPU %u to CPU %u",
+        task->id, prio, src->id, dst->id);
+}
+
+// Push: hand the best task waiting behind current to a CPU running
+// something less important.  Returns true if a task moved.
+static bool push_rt_task(rt_manager_t *manager, rt_cpu_t *cpu) {
+    rt_rq_t *rq = cpu->rt_rq;
+
+    pthread_mutex_lock(&rq->lock);
+    int prio = rq->overloaded ? rt_find_first_bit(rq->bitmap) : RT_PRIO_LEVELS;
+    int prev_cpu = prio < RT_PRIO_LEVELS ? rq->tasks[prio]->cpu : -1;
+    pthread_mutex_unlock(&rq->lock);
+
+    if (prio >= RT_PRIO_LEVELS)
+        return false;
+
+    int target = find_lowest_cpu(manager, prio, prev_cpu);
+    if (target < 0 || target == (int)cpu->id)
+        return false;
+
+    // Recheck under both locks: the task may have run, the target may
+    // have picked up more important work
+    rt_cpu_t *dst = &manager->cpus[target];
+    bool moved = false;
+    double_rt_rq_lock(cpu, dst);
+    prio = rq->overloaded ? rt_find_first_bit(rq->bitmap) : RT_PRIO_LEVELS;
+    if (prio < RT_PRIO_LEVELS && prio < rt_rq_prio(dst->rt_rq)) {
+        move_rt_task(manager, cpu, dst, prio);
+        moved = true;
+    }
+    double_rt_rq_unlock(cpu, dst);
+    return moved;
+}
+
+// Pull: this CPU is dropping priority; take waiting tasks from
+// overloaded CPUs that are more important than what is left here
+static bool pull_rt_task(rt_manager_t *manager, rt_cpu_t *cpu) {
+    uint64_t rto = atomic_load(&manager->rto_mask) & ~(1ULL << cpu->id);
+    bool pulled = false;
+
+    while (rto) {
+        rt_cpu_t *src = &manager->cpus[__builtin_ctzll(rto)];
+        rto &= rto - 1;
+
+        double_rt_rq_lock(cpu, src);
+        int prio = rt_find_first_bit(src->rt_rq->bitmap);
+
+        // Leave tasks that outrank src's current: src will switch to them
+        if (src->rt_rq->overloaded && prio < rt_rq_prio(cpu->rt_rq) &&
+            prio >= src->rt_rq->curr_prio) {
+            move_rt_task(manager, src, cpu, prio);
+            pulled = true;
         }
+        double_rt_rq_unlock(cpu, src);
+    }
+    return pulled;
+}
 
-        if (cpu->current) {
-            // Process current task
-            rt_task_t *task = cpu->current;
-            
-            // Simulate task execution
-            usleep(task->runtime);
-            task->actual_runtime += task->runtime;
-            cpu->rt_runtime += task->runtime;
-
-            // Check if task is complete
-            if (task->actual_runtime >= task->runtime) {
-                task->completion_time = time(NULL);
-                if (task->completion_time - task->start_time > task->deadline) {
-                    manager->stats.missed_deadlines++;
-                }
-                task->state = RT_DEAD;
-                cpu->current = NULL;
-                manager->stats.completed_tasks++;
-            } else if (task->type == RT_RR) {
-                // Round Robin time slice expired
+// Idle with work queued, or a queued task outranks current: the
+// reschedule IPI a wakeup or migration would send
+static bool rt_need_resched(rt_cpu_t *cpu) {
+    if (!cpu->current)
+        return cpu->rt_rq->nr_tasks != 0;
+    return rt_find_first_bit(cpu->rt_rq->bitmap) < cpu->current->priority;
+}
+
+// Run Slice: charge delta us to the current task, then decide what
+// runs next.  Returns the next slice in us, 0 when the CPU goes idle.
+static uint64_t rt_cpu_tick(rt_manager_t *manager, rt_cpu_t *cpu, uint64_t delta, uint64_t now) {
+    rt_rq_t *rq = cpu->rt_rq;
+    rt_task_t *task = cpu->current;
+
+    if (task) {
+        task->actual_runtime += delta;
+        task->rr_slice = task->rr_slice > delta ? task->rr_slice - delta : 0;
+        cpu->rt_runtime += delta;
+
+        pthread_mutex_lock(&rq->lock);
+        if (task->actual_runtime >= task->runtime) {
+            task->completion_time = now;
+            if (task->completion_time - task->wakeup_time > task->deadline) {
+                manager->stats.missed_deadlines++;
+            }
+            task->state = RT_DEAD;
+            cpu->current = NULL;
+            manager->stats.completed_tasks++;
+        } else if (rt_find_first_bit(rq->bitmap) < task->priority) {
+            // Preempted: back to the head of its list
+            task->state = RT_READY;
+            __enqueue_rt_task(rq, task, true);
+            cpu->current = NULL;
+            manager->stats.preemptions++;
+        } else if (task->type == RT_RR && !task->rr_slice) {
+            // Round Robin time slice expired
+            task->rr_slice = RR_TIMESLICE_US;
+            if (rq->tasks[task->priority]) {
                 task->state = RT_READY;
-                pthread_mutex_lock(&cpu->rt_rq->lock);
-                task->next = cpu->rt_rq->tasks[task->priority];
-                cpu->rt_rq->tasks[task->priority] = task;
-                cpu->rt_rq->nr_tasks++;
-                pthread_mutex_unlock(&cpu->rt_rq->lock);
+                __enqueue_rt_task(rq, task, false);
                 cpu->current = NULL;
                 manager->stats.preemptions++;
             }
         }
+        if (!cpu->current) {
+            rq->curr_prio = RT_PRIO_LEVELS;
+            update_rt_rq(manager, cpu);
+        }
+        pthread_mutex_unlock(&rq->lock);
+    }
+
+    if (!cpu->current) {
+        if (manager->push_pull)
+            pull_rt_task(manager, cpu);
 
         // Get next task
-        pthread_mutex_lock(&cpu->rt_rq->lock);
-        rt_task_t *next_task = NULL;
-        for (int prio = 0; prio < RT_PRIO_LEVELS; prio++) {
-            if (cpu->rt_rq->tasks[prio]) {
-                next_task = cpu->rt_rq->tasks[prio];
-                cpu->rt_rq->tasks[prio] = next_task->next;
-                cpu->rt_rq->nr_tasks--;
-                next_task->next = NULL;
-                break;
+        pthread_mutex_lock(&rq->lock);
+        int prio = rt_find_first_bit(rq->bitmap);
+        if (prio < RT_PRIO_LEVELS) {
+            task = __dequeue_rt_task(rq, prio);
+            task->state = RT_RUNNING;
+            cpu->current = task;
+            rq->curr_prio = prio;
+            if (task->woken) {
+                uint64_t latency = now - task->wakeup_time;
+                task->woken = false;
+                task->start_time = now;
+                manager->stats.wakeups++;
+                manager->stats.total_wakeup_latency += latency;
+                if (latency > manager->stats.max_wakeup_latency)
+                    manager->stats.max_wakeup_latency = latency;
             }
+            update_rt_rq(manager, cpu);
         }
-        pthread_mutex_unlock(&cpu->rt_rq->lock);
+        pthread_mutex_unlock(&rq->lock);
+    }
 
-        if (next_task) {
-            cpu->current = next_task;
-            next_task->state = RT_RUNNING;
-            next_task->start_time = time(NULL);
-        } else {
-            usleep(1000);  // Idle
+    // Whatever still waits behind current may run elsewhere
+    if (cpu->current && manager->push_pull) {
+        while (push_rt_task(manager, cpu))
+            ;
+    }
+
+    if (!cpu->current)
+        return 0;
+    uint64_t left = cpu->current->runtime - cpu->current->actual_runtime;
+    return left < RT_TIMESLICE_US ? left : RT_TIMESLICE_US;
+}
+
+// CPU Thread
+void* cpu_thread(void *arg) {
+    rt_cpu_t *cpu = (rt_cpu_t*)arg;
+    rt_manager_t *manager = cpu->manager;
+    uint64_t slice = 0;
+
+    while (manager->running) {
+        pthread_mutex_lock(&cpu->lock);
+
+        if (cpu->rt_throttled) {
+            pthread_mutex_unlock(&cpu->lock);
+            usleep(1000);  // Wait if throttled
+            continue;
         }
 
+        // Simulate task execution
+        if (slice)
+            usleep(slice);
+        slice = rt_cpu_tick(manager, cpu, slice, rt_clock_us());
+
         pthread_mutex_unlock(&cpu->lock);
+
+        if (!slice)
+            usleep(1000);  // Idle
     }
 
     return NULL;
@@ -365,34 +685,48 @@ void check_bandwidth(rt_manager_t *manager) {
     }
 }
 
-// Schedule RT Task
-void schedule_rt_task(rt_manager_t *manager, rt_task_t *task) {
-    if (!manager || !task) return;
-
-    // Find least loaded CPU
-    size_t target_cpu = 0;
-    size_t min_tasks = UINT64_MAX;
-
-    for (size_t i = 0; i < manager->nr_cpus; i++) {
-        pthread_mutex_lock(&manager->cpus[i].rt_rq->lock);
-        if (manager->cpus[i].rt_rq->nr_tasks < min_tasks) {
-            min_tasks = manager->cpus[i].rt_rq->nr_tasks;
-            target_cpu = i;
+// Queue a woken task: on the least important CPU when cpupri finds
+// one, otherwise where it last ran until a CPU pulls it
+static void __schedule_rt_task(rt_manager_t *manager, rt_task_t *task, uint64_t now) {
+    int target = -1;
+
+    if (manager->push_pull) {
+        target = find_lowest_cpu(manager, task->priority, task->cpu);
+        if (target < 0)
+            target = task->cpu >= 0 ? task->cpu : (int)(task->id % manager->nr_cpus);
+    } else {
+        // Find least loaded CPU
+        size_t min_tasks = SIZE_MAX;
+        for (size_t i = 0; i < manager->nr_cpus; i++) {
+            pthread_mutex_lock(&manager->cpus[i].rt_rq->lock);
+            if (manager->cpus[i].rt_rq->nr_tasks < min_tasks) {
+                min_tasks = manager->cpus[i].rt_rq->nr_tasks;
+                target = (int)i;
+            }
+            pthread_mutex_unlock(&manager->cpus[i].rt_rq->lock);
         }
-        pthread_mutex_unlock(&manager->cpus[i].rt_rq->lock);
     }
 
     // Assign task to CPU
-    rt_cpu_t *cpu = &manager->cpus[target_cpu];
+    rt_cpu_t *cpu = &manager->cpus[target];
     pthread_mutex_lock(&cpu->rt_rq->lock);
-    task->cpu = target_cpu;
-    task->next = cpu->rt_rq->tasks[task->priority];
-    cpu->rt_rq->tasks[task->priority] = task;
-    cpu->rt_rq->nr_tasks++;
+    task->cpu = target;
+    task->state = RT_READY;
+    task->wakeup_time = now;
+    task->woken = true;
+    __enqueue_rt_task(cpu->rt_rq, task, false);
+    update_rt_rq(manager, cpu);
     pthread_mutex_unlock(&cpu->rt_rq->lock);
 
-    LOG(LOG_LEVEL_DEBUG, "Scheduled RT task %u (type: %s, prio: %d) to CPU %zu",
-        task->id, get_rt_type_string(task->type), task->priority, target_cpu);
+    LOG(LOG_LEVEL_DEBUG, "Scheduled RT task %u (type: %s, prio: %d) to CPU %d",
+        task->id, get_rt_type_string(task->type), task->priority, target);
+}
+
+// Schedule RT Task
+void schedule_rt_task(rt_manager_t *manager, rt_task_t *task) {
+    if (!manager || !task) return;
+
+    __schedule_rt_task(manager, task, rt_clock_us());
 }
 
 // Run Test
@@ -416,12 +750,8 @@ void run_test(rt_manager_t *manager) {
 
     // Start CPU threads
     manager->running = true;
-    void *thread_args[2];
-    thread_args[1] = manager;
-
     for (size_t i = 0; i < manager->nr_cpus; i++) {
-        thread_args[0] = &manager->cpus[i];
-        pthread_create(&manager->cpus[i].thread, NULL, cpu_thread, thread_args);
+        pthread_create(&manager->cpus[i].thread, NULL, cpu_thread, &manager->cpus[i]);
     }
 
     // Start bandwidth monitor
@@ -455,6 +785,145 @@ void run_test(rt_manager_t *manager) {
     pthread_join(manager->bandwidth_thread, NULL);
 
     // Calculate statistics
+    manager->stats.test_duration = TEST_DURATION;
+    calculate_stats(manager);
+}
+
+// Virtual time: run a CPU at time, superseding its pending slice end
+static void virtual_arm_cpu(struct des_sim *sim, rt_cpu_t *cpu, uint64_t time);
+static void virtual_kick_cpus(struct des_sim *sim, rt_manager_t *manager);
+
+static void virtual_cpu_event(struct des_sim *sim, void *arg, uint64_t gen) {
+    rt_cpu_t *cpu = (rt_cpu_t*)arg;
+
+    if (gen != cpu->slice_gen)
+        return;
+
+    uint64_t ran = cpu->current ? sim->now - cpu->slice_start : 0;
+    cpu->slice_start = sim->now;
+    cpu->slice_end = UINT64_MAX;
+
+    // Throttled: the slice that ran is charged once the CPU may go on
+    if (cpu->rt_throttled) {
+        cpu->stalled_runtime += ran;
+        return;
+    }
+
+    uint64_t slice = rt_cpu_tick(cpu->manager, cpu, cpu->stalled_runtime + ran, sim->now);
+    cpu->stalled_runtime = 0;
+    if (slice)
+        virtual_arm_cpu(sim, cpu, sim->now + slice);
+
+    // Push and pull may have handed work to other CPUs
+    virtual_kick_cpus(sim, cpu->manager);
+}
+
+static void virtual_arm_cpu(struct des_sim *sim, rt_cpu_t *cpu, uint64_t time) {
+    cpu->slice_end = time;
+    if (!des_schedule_at(sim, time, virtual_cpu_event, cpu, ++cpu->slice_gen))
+        LOG(LOG_LEVEL_ERROR, "Failed to schedule CPU %u", cpu->id);
+}
+
+// Run every CPU that was handed work, is outranked, or was stalled by
+// throttling and may go on
+static void virtual_kick_cpus(struct des_sim *sim, rt_manager_t *manager) {
+    for (size_t i = 0; i < manager->nr_cpus; i++) {
+        rt_cpu_t *cpu = &manager->cpus[i];
+        if (cpu->rt_throttled || cpu->slice_end == sim->now)
+            continue;
+        if (rt_need_resched(cpu) || (cpu->current && cpu->slice_end == UINT64_MAX))
+            virtual_arm_cpu(sim, cpu, sim->now);
+    }
+}
+
+static void virtual_bandwidth_event(struct des_sim *sim, void *arg, uint64_t data) {
+    rt_manager_t *manager = (rt_manager_t*)arg;
+
+    check_bandwidth(manager);
+    virtual_kick_cpus(sim, manager);
+    des_schedule(sim, 10000, virtual_bandwidth_event, manager, data);
+}
+
+// Slot for a new task; long runs recycle those of finished tasks
+static rt_task_t **virtual_task_slot(rt_manager_t *manager) {
+    if (manager->nr_tasks < MAX_RT_TASKS)
+        return &manager->tasks[manager->nr_tasks++];
+
+    for (size_t i = 0; i < manager->nr_tasks; i++) {
+        if (manager->tasks[i]->state == RT_DEAD) {
+            destroy_rt_task(manager->tasks[i]);
+            return &manager->tasks[i];
+        }
+    }
+    return NULL;
+}
+
+// create_rt_task with its random parameters drawn from the simulation
+static void virtual_add_task(struct des_sim *sim, rt_manager_t *manager) {
+    rt_type_t type = (rt_type_t)des_rand_range(sim, 3);
+    rt_task_t *task = create_rt_task(type, (int)des_rand_range(sim, RT_PRIO_LEVELS));
+    if (!task)
+        return;
+
+    rt_task_t **slot = virtual_task_slot(manager);
+    if (!slot) {
+        destroy_rt_task(task);
+        return;
+    }
+    if (type == RT_DEADLINE) {
+        task->period = des_rand_range(sim, MAX_RUNTIME - MIN_RUNTIME) + MIN_RUNTIME;
+        task->deadline = task->period;
+    }
+    task->runtime = des_rand_range(sim, MAX_RUNTIME / 10) + MIN_RUNTIME;
+    __schedule_rt_task(manager, task, sim->now);
+    *slot = task;
+    manager->stats.total_tasks++;
+}
+
+// Same arrival process as run_test: a 10% chance every 100ms
+static void virtual_arrival_event(struct des_sim *sim, void *arg, uint64_t data) {
+    rt_manager_t *manager = (rt_manager_t*)arg;
+
+    if (des_rand_range(sim, 100) < 10) {
+        virtual_add_task(sim, manager);
+        virtual_kick_cpus(sim, manager);
+    }
+    des_schedule(sim, 100000, virtual_arrival_event, manager, data);
+}
+
+// Run Test in virtual time: the workload of run_test, driven by the
+// event engine and a seeded RNG, so runs are fast and reproducible
+void run_test_virtual(rt_manager_t *manager, uint64_t seed, uint64_t duration_us) {
+    if (!manager) return;
+
+    struct des_sim sim;
+    if (!des_init(&sim, seed)) {
+        LOG(LOG_LEVEL_ERROR, "Failed to initialize simulation");
+        return;
+    }
+
+    LOG(LOG_LEVEL_INFO, "Starting RT scheduler test (virtual time, seed %lu, %.0f s)...",
+        seed, duration_us / 1e6);
+
+    // Create initial tasks
+    for (size_t i = 0; i < MAX_RT_TASKS/2; i++) {
+        virtual_add_task(&sim, manager);
+    }
+
+    des_schedule(&sim, 100000, virtual_arrival_event, manager, 0);
+    des_schedule(&sim, 10000, virtual_bandwidth_event, manager, 0);
+    virtual_kick_cpus(&sim, manager);
+
+    double start = (double)rt_clock_us();
+    des_run_until(&sim, duration_us);
+    double elapsed = (rt_clock_us() - start) / 1e6;
+
+    LOG(LOG_LEVEL_INFO, "Simulated %.0f s in %.3f s (%lu events)",
+        duration_us / 1e6, elapsed, sim.nr_fired);
+    des_destroy(&sim);
+
+    // Calculate statistics
+    manager->stats.test_duration = duration_us / 1e6;
     calculate_stats(manager);
 }
 
@@ -475,11 +944,11 @@ void calculate_stats(rt_manager_t *manager) {
 
     if (manager->stats.completed_tasks > 0) {
         manager->stats.avg_response_time = 
-            (double)total_response_time / manager->stats.completed_tasks;
+            (double)total_response_time / manager->stats.completed_tasks / 1000.0;
     }
 
     manager->stats.cpu_utilization = 
-        (double)total_runtime / (TEST_DURATION * 1000000 * manager->nr_cpus);
+        (double)total_runtime / (manager->stats.test_duration * 1000000 * manager->nr_cpus);
 
     // Calculate bandwidth usage
     uint64_t total_bandwidth = 0;
@@ -487,9 +956,7 @@ void calculate_stats(rt_manager_t *manager) {
         total_bandwidth += manager->cpus[i].rt_runtime;
     }
     manager->stats.bandwidth_usage = 
-        (double)total_bandwidth / (TEST_DURATION * 1000000 * manager->nr_cpus);
-
-    manager->stats.test_duration = TEST_DURATION;
+        (double)total_bandwidth / (manager->stats.test_duration * 1000000 * manager->nr_cpus);
 }
 
 // Print Test Statistics
@@ -506,6 +973,9 @@ void print_test_stats(rt_manager_t *manager) {
     printf("Preemptions:        %lu\n", manager->stats.preemptions);
     printf("Throttle Events:    %lu\n", manager->stats.throttles);
     printf("Avg Response Time:  %.2f ms\n", manager->stats.avg_response_time);
+    printf("Avg Wakeup Latency: %.2f us\n", manager->stats.wakeups ?
+           (double)manager->stats.total_wakeup_latency / manager->stats.wakeups : 0.0);
+    printf("Max Wakeup Latency: %lu us\n", manager->stats.max_wakeup_latency);
     printf("CPU Utilization:    %.2f%%\n", manager->stats.cpu_utilization * 100);
     printf("Bandwidth Usage:    %.2f%%\n", manager->stats.bandwidth_usage * 100);
 
@@ -520,19 +990,10 @@ void print_test_stats(rt_manager_t *manager) {
     }
 }
 
-// Destroy RT Run Queue
+// Destroy RT Run Queue (queued tasks belong to the manager's task table)
 void destroy_rt_rq(rt_rq_t *rq) {
     if (!rq) return;
 
-    for (int i = 0; i < RT_PRIO_LEVELS; i++) {
-        rt_task_t *current = rq->tasks[i];
-        while (current) {
-            rt_task_t *next = current->next;
-            free(current);
-            current = next;
-        }
-    }
-
     pthread_mutex_destroy(&rq->lock);
     free(rq);
 }
@@ -563,19 +1024,162 @@ void destroy_rt_manager(rt_manager_t *manager) {
 }
 
 // Demonstrate RT Scheduler
-void demonstrate_rt_scheduler(void) {
+void demonstrate_rt_scheduler(const struct des_options *opts) {
     printf("Starting RT scheduler demonstration...\n");
 
     // Create and run RT scheduler test
-    rt_manager_t *manager = create_rt_manager(8);
+    rt_manager_t *manager = create_rt_manager(16);
     if (manager) {
-        run_test(manager);
+        if (opts->threaded)
+            run_test(manager);
+        else
+            run_test_virtual(manager, opts->seed, opts->duration_us);
         print_test_stats(manager);
         destroy_rt_manager(manager);
     }
 }
 
-int main(void) {
+// Benchmark: wakeup latency under RT load, in virtual time
+
+#define BENCH_ARRIVALS     200000
+#define BENCH_LOAD_PCT     85
+#define BENCH_MIN_RUNTIME  100      // us
+#define BENCH_MAX_RUNTIME  4000     // us
+#define BENCH_HIGH_PRIO    10       // priorities below this are "high"
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline uint64_t bench_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static int bench_cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void bench_print_latency(const char *label, uint64_t *lat, size_t n) {
+    if (!n) return;
+    qsort(lat, n, sizeof(*lat), bench_cmp_u64);
+    printf("  %s p99 %5lu max %6lu us", label, lat[n * 99 / 100], lat[n - 1]);
+}
+
+static void bench_run(size_t nr_cpus, bool push_pull) {
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    uint64_t slice_start[MAX_CPUS], slice_end[MAX_CPUS];
+    uint64_t mean_gap = (BENCH_MIN_RUNTIME + BENCH_MAX_RUNTIME) / 2 * 100 /
+                        (BENCH_LOAD_PCT * nr_cpus);
+    uint64_t now = 0, next_arrival = 0;
+    size_t arrived = 0, events = 0;
+
+    rt_manager_t *manager = create_rt_manager(nr_cpus);
+    rt_task_t **tasks = calloc(BENCH_ARRIVALS, sizeof(*tasks));
+    uint64_t *all = calloc(BENCH_ARRIVALS, sizeof(*all));
+    uint64_t *high = calloc(BENCH_ARRIVALS, sizeof(*high));
+    if (!manager || !tasks || !all || !high) {
+        free(tasks);
+        free(all);
+        free(high);
+        destroy_rt_manager(manager);
+        return;
+    }
+    manager->push_pull = push_pull;
+    for (size_t i = 0; i < nr_cpus; i++)
+        slice_end[i] = UINT64_MAX;
+
+    double start = bench_now();
+    for (;;) {
+        // Next event: an arrival or the end of a running slice
+        uint64_t t = arrived < BENCH_ARRIVALS ? next_arrival : UINT64_MAX;
+        for (size_t i = 0; i < nr_cpus; i++)
+            t = slice_end[i] < t ? slice_end[i] : t;
+        if (t == UINT64_MAX)
+            break;
+        now = t;
+
+        if (arrived < BENCH_ARRIVALS && next_arrival == now) {
+            rt_task_t *task = create_rt_task(bench_rand(&seed) % 2 ? RT_RR : RT_FIFO,
+                                             (int)(bench_rand(&seed) % RT_PRIO_LEVELS));
+            if (!task)
+                break;
+            task->runtime = BENCH_MIN_RUNTIME +
+                bench_rand(&seed) % (BENCH_MAX_RUNTIME - BENCH_MIN_RUNTIME);
+            tasks[arrived++] = task;
+            __schedule_rt_task(manager, task, now);
+            next_arrival = now + 1 + bench_rand(&seed) % (2 * mean_gap);
+        }
+
+        // Run every CPU whose slice ended or that was handed work
+        bool again = true;
+        while (again) {
+            again = false;
+            for (size_t i = 0; i < nr_cpus; i++) {
+                rt_cpu_t *cpu = &manager->cpus[i];
+                if (slice_end[i] != now && !rt_need_resched(cpu))
+                    continue;
+                uint64_t delta = cpu->current ? now - slice_start[i] : 0;
+                uint64_t slice = rt_cpu_tick(manager, cpu, delta, now);
+                slice_start[i] = now;
+                slice_end[i] = slice ? now + slice : UINT64_MAX;
+                again = true;
+                events++;
+            }
+        }
+    }
+    double elapsed = bench_now() - start;
+
+    size_t nr_all = 0, nr_high = 0;
+    for (size_t i = 0; i < arrived; i++) {
+        uint64_t latency = tasks[i]->start_time - tasks[i]->wakeup_time;
+        all[nr_all++] = latency;
+        if (tasks[i]->priority < BENCH_HIGH_PRIO)
+            high[nr_high++] = latency;
+        destroy_rt_task(tasks[i]);
+    }
+
+    printf("  %2zu CPUs %-9s", nr_cpus, push_pull ? "cpupri" : "least-q");
+    bench_print_latency("all", all, nr_all);
+    bench_print_latency("high", high, nr_high);
+    printf("  migr %6lu  %4.0f ns/event\n", manager->stats.migrations,
+           elapsed * 1e9 / (events ? events : 1));
+
+    free(tasks);
+    free(all);
+    free(high);
+    destroy_rt_manager(manager);
+}
+
+static int run_benchmark(void) {
+    static const size_t cpus[] = { 4, 16, 32, 64 };
+
+    current_log_level = LOG_LEVEL_ERROR;
+    printf("RT wakeup latency (%d wakeups, %d%% load, %d-%d us runtimes, high = prio < %d)\n",
+           BENCH_ARRIVALS, BENCH_LOAD_PCT, BENCH_MIN_RUNTIME, BENCH_MAX_RUNTIME,
+           BENCH_HIGH_PRIO);
+    for (size_t i = 0; i < sizeof(cpus) / sizeof(cpus[0]); i++) {
+        bench_run(cpus[i], false);
+        bench_run(cpus[i], true);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        return run_benchmark();
+
+    struct des_options opts;
+    if (!des_parse_options(argc, argv, &opts, TEST_DURATION * 1000000ULL))
+        return 1;
+
     // Set log level
     current_log_level = LOG_LEVEL_INFO;
 
@@ -583,7 +1187,7 @@ int main(void) {
     srand(time(NULL));
 
     // Run demonstration
-    demonstrate_rt_scheduler();
+    demonstrate_rt_scheduler(&opts);
 
     return 0;
 }
@@ -34,6 +34,13 @@ typedef enum {
     TASK_ZOMBIE
 } task_state_t;
 
+// <pthread.h> pulls in <sched.h>, whose SCHED_* macros would
+// otherwise replace the enumerators below
+#undef SCHED_FIFO
+#undef SCHED_RR
+#undef SCHED_BATCH
+#undef SCHED_IDLE
+
 // Scheduling Policies
 typedef enum {
     SCHED_FIFO,
@@ -52,6 +59,21 @@ typedef enum {
 #define DEFAULT_TIMESLICE_MS 100
 #define MIN_TIMESLICE_MS     10
 #define MAX_TIMESLICE_MS     200
+#define TICK_MS              1      // time charged per schedule() call
+
+// Interactivity: sleep_avg moves dynamic priority +/- MAX_BONUS/2
+#define MAX_USER_PRIO        (MAX_PRIO - MIN_PRIO)
+#define PRIO_BONUS_RATIO     25
+#define MAX_BONUS            (MAX_USER_PRIO * PRIO_BONUS_RATIO / 100)
+#define INTERACTIVE_DELTA    2
+#define MAX_SLEEP_AVG        (DEFAULT_TIMESLICE_MS * MAX_BONUS)
+#define STARVATION_LIMIT     MAX_SLEEP_AVG
+
+// One bit per priority plus a delimiter bit at MAX_PRIO, so the
+// first-bit search always terminates
+#define BITMAP_WORDS ((MAX_PRIO + 1 + 31) / 32)
+
+struct prio_array;
 
 // Process Structure
 typedef struct task_struct {
@@ -65,15 +87,32 @@ typedef struct task_struct {
     unsigned long runtime;
     unsigned long deadline;
     unsigned long timeslice;
-    time_t last_run;
+    unsigned long last_run;         // CPU clock of the last pick
+    unsigned long sleep_avg;        // ms, 0..MAX_SLEEP_AVG
+    unsigned long sleep_start;      // CPU clock when it blocked
+    struct prio_array *array;       // NULL while running or asleep
     struct task_struct *next;
 } task_t;
 
+// Priority Array: a FIFO per priority, bit set while it is non-empty
+typedef struct prio_array {
+    unsigned int nr_active;
+    unsigned int bitmap[BITMAP_WORDS];
+    task_t *tasks[MAX_PRIO];
+    task_t *tail[MAX_PRIO];
+} prio_array_t;
+
 // Run Queue Structure
 typedef struct {
-    task_t *tasks[MAX_PRIO];
-    unsigned int bitmap[MAX_PRIO / 32 + 1];
-    size_t nr_running;
+    prio_array_t *active;
+    prio_array_t *expired;
+    prio_array_t arrays[2];
+    size_t nr_running;              // queued tasks, not counting curr
+    unsigned long expired_timestamp; // clock of the first expiry, 0 = none
+    int best_expired_prio;
+    unsigned long nr_array_swaps;
+    unsigned long nr_expired;       // slices that ended on the expired array
+    bool o1_mode;
     pthread_mutex_t lock;
 } runqueue_t;
 
@@ -102,6 +141,7 @@ typedef struct {
     bool load_balance;
     unsigned int balance_interval;
     bool track_stats;
+    bool o1_mode;       // expire timeslices into a second array, interactivity bonuses
 } sched_config_t;
 
 // Scheduler Manager
@@ -134,6 +174,7 @@ void destroy_task(task_t *task);
 bool enqueue_task(cpu_t *cpu, task_t *task);
 task_t* dequeue_task(cpu_t *cpu);
 task_t* pick_next_task(cpu_t *cpu);
+bool wake_up_task(cpu_t *cpu, task_t *task);
 
 void schedule(cpu_t *cpu);
 void load_balance(sched_manager_t *manager);
@@ -176,6 +217,191 @@ const char* get_sched_policy_string(sched_policy_t policy) {
     }
 }
 
+// Find First Set Bit: a handful of word tests whatever the task count
+static inline int sched_find_first_bit(const unsigned int *bitmap) {
+    int i = 0;
+    while (!bitmap[i])
+        i++;
+    return i * 32 + __builtin_ctz(bitmap[i]);
+}
+
+static void prio_array_init(prio_array_t *array) {
+    memset(array, 0, sizeof(*array));
+    array->bitmap[MAX_PRIO / 32] |= 1U << (MAX_PRIO % 32);
+}
+
+static void runqueue_init(runqueue_t *rq, bool o1_mode) {
+    prio_array_init(&rq->arrays[0]);
+    prio_array_init(&rq->arrays[1]);
+    rq->active = &rq->arrays[0];
+    rq->expired = &rq->arrays[1];
+    rq->nr_running = 0;
+    rq->expired_timestamp = 0;
+    rq->best_expired_prio = MAX_PRIO;
+    rq->nr_array_swaps = 0;
+    rq->nr_expired = 0;
+    rq->o1_mode = o1_mode;
+    pthread_mutex_init(&rq->lock, NULL);
+}
+
+// Append to the tail of the task's priority list (rq lock held)
+static void __enqueue_task(runqueue_t *rq, prio_array_t *array, task_t *task) {
+    int prio = task->dynamic_priority;
+
+    task->next = NULL;
+    if (array->tail[prio]) {
+        array->tail[prio]->next = task;
+    } else {
+        array->tasks[prio] = task;
+        array->bitmap[prio / 32] |= 1U << (prio % 32);
+    }
+    array->tail[prio] = task;
+    array->nr_active++;
+    task->array = array;
+    rq->nr_running++;
+}
+
+// Push to the head: a preempted task keeps its place in line
+static void __enqueue_task_head(runqueue_t *rq, prio_array_t *array, task_t *task) {
+    int prio = task->dynamic_priority;
+
+    task->next = array->tasks[prio];
+    if (!task->next) {
+        array->tail[prio] = task;
+        array->bitmap[prio / 32] |= 1U << (prio % 32);
+    }
+    array->tasks[prio] = task;
+    array->nr_active++;
+    task->array = array;
+    rq->nr_running++;
+}
+
+// Remove the head of a non-empty priority list (rq lock held)
+static task_t *__dequeue_task(runqueue_t *rq, prio_array_t *array, int prio) {
+    task_t *task = array->tasks[prio];
+
+    array->tasks[prio] = task->next;
+    if (!task->next) {
+        array->tail[prio] = NULL;
+        array->bitmap[prio / 32] &= ~(1U << (prio % 32));
+    }
+    array->nr_active--;
+    rq->nr_running--;
+    task->next = NULL;
+    task->array = NULL;
+    return task;
+}
+
+static inline bool rt_task(const task_t *task) {
+    return task->policy == SCHED_FIFO || task->policy == SCHED_RR;
+}
+
+// Effective Priority: static priority adjusted by up to +/-5 for sleep_avg
+static int effective_prio(const task_t *task) {
+    if (task->policy != SCHED_NORMAL)
+        return task->static_priority;
+
+    int bonus = (int)(task->sleep_avg * MAX_BONUS / MAX_SLEEP_AVG) - MAX_BONUS / 2;
+    int prio = task->static_priority - bonus;
+    if (prio < MIN_PRIO)
+        prio = MIN_PRIO;
+    if (prio > MAX_PRIO - 1)
+        prio = MAX_PRIO - 1;
+    return prio;
+}
+
+// Interactive tasks go back on the active array when their slice runs out
+static bool task_interactive(const task_t *task) {
+    int nice = task->static_priority - DEFAULT_PRIO;
+    int delta = (nice + 20) * MAX_BONUS / 40 - 20 * MAX_BONUS / 40 + INTERACTIVE_DELTA;
+
+    return task->policy == SCHED_NORMAL &&
+           task->dynamic_priority <= task->static_priority - delta;
+}
+
+// Time Slice: by policy, scaled by static priority for normal tasks
+static unsigned long task_timeslice(const task_t *task) {
+    switch (task->policy) {
+        case SCHED_FIFO:
+        case SCHED_BATCH:
+            return MAX_TIMESLICE_MS;
+        case SCHED_RR:
+            return DEFAULT_TIMESLICE_MS;
+        case SCHED_IDLE:
+            return MIN_TIMESLICE_MS;
+        default: {
+            unsigned long slice = (unsigned long)DEFAULT_TIMESLICE_MS *
+                (unsigned long)(MAX_PRIO - task->static_priority) / MAX_USER_PRIO;
+            return slice < MIN_TIMESLICE_MS ? MIN_TIMESLICE_MS : slice;
+        }
+    }
+}
+
+// Expired tasks have waited too long, or one of them outranks curr
+static bool expired_starving(cpu_t *cpu, const task_t *curr) {
+    runqueue_t *rq = cpu->rq;
+
+    if (rq->expired_timestamp &&
+        (cpu->clock - rq->expired_timestamp) * TICK_MS >=
+            STARVATION_LIMIT * (rq->nr_running + 1) + 1)
+        return true;
+    return curr->static_priority > rq->best_expired_prio;
+}
+
+// Charge a tick to the running task; returns false if it keeps the CPU
+static bool task_tick(cpu_t *cpu, task_t *task) {
+    runqueue_t *rq = cpu->rq;
+    int best = sched_find_first_bit(rq->active->bitmap);
+
+    task->sleep_avg = task->sleep_avg > TICK_MS ? task->sleep_avg - TICK_MS : 0;
+
+    if (task->policy == SCHED_FIFO || task->timeslice > TICK_MS) {
+        if (task->policy != SCHED_FIFO)
+            task->timeslice -= TICK_MS;
+        if (best >= task->dynamic_priority)
+            return false;
+        __enqueue_task_head(rq, rq->active, task);
+        return true;
+    }
+
+    // Slice used up: requeue behind its peers, or wait for the array swap
+    task->dynamic_priority = effective_prio(task);
+    task->timeslice = task_timeslice(task);
+    if (rt_task(task) || (task_interactive(task) && !expired_starving(cpu, task))) {
+        __enqueue_task(rq, rq->active, task);
+    } else {
+        if (!rq->expired_timestamp)
+            rq->expired_timestamp = cpu->clock;
+        if (task->static_priority < rq->best_expired_prio)
+            rq->best_expired_prio = task->static_priority;
+        __enqueue_task(rq, rq->expired, task);
+        rq->nr_expired++;
+    }
+    return true;
+}
+
+// Pick the head of the highest priority list (rq lock held)
+static task_t *__pick_next_task(cpu_t *cpu) {
+    runqueue_t *rq = cpu->rq;
+
+    if (!rq->nr_running)
+        return NULL;
+
+    // Every queued task used its slice: the expired array takes over
+    if (!rq->active->nr_active) {
+        prio_array_t *array = rq->active;
+        rq->active = rq->expired;
+        rq->expired = array;
+        rq->expired_timestamp = 0;
+        rq->best_expired_prio = MAX_PRIO;
+        rq->nr_array_swaps++;
+    }
+
+    task_t *next = __dequeue_task(rq, rq->active, sched_find_first_bit(rq->active->bitmap));
+    next->last_run = cpu->clock;
+    return next;
+}
+
 // Create Scheduler Manager
 sched_manager_t* create_sched_manager(sched_config_t config) {
     sched_manager_t *manager = malloc(sizeof(sched_manager_t));
@@ -202,7 +428,7 @@ sched_manager_t* create_sched_manager(sched_config_t config) {
             free(manager);
             return NULL;
         }
-        pthread_mutex_init(&manager->cpus[i].rq->lock, NULL);
+        runqueue_init(manager->cpus[i].rq, config.o1_mode);
         manager->cpus[i].curr = NULL;
         manager->cpus[i].clock = 0;
         manager->cpus[i].online = true;
@@ -236,6 +462,12 @@ task_t* create_task(
         return NULL;
     }
 
+    // Clamp into the priority arrays
+    if (priority < 0)
+        priority = 0;
+    if (priority > MAX_PRIO - 1)
+        priority = MAX_PRIO - 1;
+
     task->pid = pid;
     strncpy(task->name, name, sizeof(task->name) - 1);
     task->state = TASK_RUNNING;
@@ -245,8 +477,11 @@ task_t* create_task(
     task->dynamic_priority = priority;
     task->runtime = 0;
     task->deadline = 0;
-    task->timeslice = DEFAULT_TIMESLICE_MS;
-    task->last_run = time(NULL);
+    task->timeslice = task_timeslice(task);
+    task->last_run = 0;
+    task->sleep_avg = 0;
+    task->sleep_start = 0;
+    task->array = NULL;
     task->next = NULL;
 
     LOG(LOG_LEVEL_DEBUG, "Created task %s (PID: %d, Policy: %s, Priority: %d)",
@@ -259,13 +494,7 @@ bool enqueue_task(cpu_t *cpu, task_t *task) {
     if (!cpu || !task) return false;
 
     pthread_mutex_lock(&cpu->rq->lock);
-
-    // Add task to appropriate priority queue
-    task->next = cpu->rq->tasks[task->priority];
-    cpu->rq->tasks[task->priority] = task;
-    cpu->rq->bitmap[task->priority / 32] |= (1 << (task->priority % 32));
-    cpu->rq->nr_running++;
-
+    __enqueue_task(cpu->rq, cpu->rq->active, task);
     pthread_mutex_unlock(&cpu->rq->lock);
 
     LOG(LOG_LEVEL_DEBUG, "Enqueued task %s on CPU %u", task->name, cpu->id);
@@ -278,24 +507,16 @@ task_t* dequeue_task(cpu_t *cpu) {
 
     pthread_mutex_lock(&cpu->rq->lock);
 
-    // Find highest priority task
+    // Highest priority task, from the expired array once active is empty
+    runqueue_t *rq = cpu->rq;
     task_t *task = NULL;
-    for (int prio = 0; prio < MAX_PRIO; prio++) {
-        if (cpu->rq->bitmap[prio / 32] & (1 << (prio % 32))) {
-            task = cpu->rq->tasks[prio];
-            cpu->rq->tasks[prio] = task->next;
-            if (!cpu->rq->tasks[prio]) {
-                cpu->rq->bitmap[prio / 32] &= ~(1 << (prio % 32));
-            }
-            cpu->rq->nr_running--;
-            break;
-        }
-    }
+    prio_array_t *array = rq->active->nr_active ? rq->active : rq->expired;
+    if (array->nr_active)
+        task = __dequeue_task(rq, array, sched_find_first_bit(array->bitmap));
 
     pthread_mutex_unlock(&cpu->rq->lock);
 
     if (task) {
-        task->next = NULL;
         LOG(LOG_LEVEL_DEBUG, "Dequeued task %s from CPU %u", 
             task->name, cpu->id);
     }
@@ -307,56 +528,66 @@ task_t* dequeue_task(cpu_t *cpu) {
 task_t* pick_next_task(cpu_t *cpu) {
     if (!cpu) return NULL;
 
-    task_t *next = dequeue_task(cpu);
-    if (next) {
-        // Update task timings
-        next->last_run = time(NULL);
-        
-        // Reset timeslice based on policy
-        switch (next->policy) {
-            case SCHED_FIFO:
-                next->timeslice = MAX_TIMESLICE_MS;
-                break;
-            case SCHED_RR:
-                next->timeslice = DEFAULT_TIMESLICE_MS;
-                break;
-            case SCHED_NORMAL:
-                next->timeslice = DEFAULT_TIMESLICE_MS * 
-                    (140 - next->priority) / 40;
-                break;
-            case SCHED_BATCH:
-                next->timeslice = MAX_TIMESLICE_MS;
-                break;
-            case SCHED_IDLE:
-                next->timeslice = MIN_TIMESLICE_MS;
-                break;
-        }
-    }
+    pthread_mutex_lock(&cpu->rq->lock);
+    task_t *next = __pick_next_task(cpu);
+    pthread_mutex_unlock(&cpu->rq->lock);
 
     return next;
 }
 
-// Schedule
+// Wake Up Task: credit the time slept, then queue on the active array
+bool wake_up_task(cpu_t *cpu, task_t *task) {
+    if (!cpu || !task || task->array || task->state == TASK_RUNNING) return false;
+
+    pthread_mutex_lock(&cpu->rq->lock);
+
+    if (cpu->rq->o1_mode) {
+        unsigned long slept = (cpu->clock - task->sleep_start) * TICK_MS;
+        task->sleep_avg = task->sleep_avg + slept > MAX_SLEEP_AVG
+            ? MAX_SLEEP_AVG : task->sleep_avg + slept;
+        task->dynamic_priority = effective_prio(task);
+    }
+    task->state = TASK_RUNNING;
+    __enqueue_task(cpu->rq, cpu->rq->active, task);
+
+    pthread_mutex_unlock(&cpu->rq->lock);
+
+    LOG(LOG_LEVEL_DEBUG, "Woke task %s on CPU %u (sleep_avg %lu ms, prio %d)",
+        task->name, cpu->id, task->sleep_avg, task->dynamic_priority);
+    return true;
+}
+
+// Schedule: one tick on this CPU
 void schedule(cpu_t *cpu) {
     if (!cpu) return;
 
-    // Get next task
+    runqueue_t *rq = cpu->rq;
+    pthread_mutex_lock(&rq->lock);
+
     task_t *prev = cpu->curr;
-    task_t *next = pick_next_task(cpu);
+    cpu->clock++;
 
     if (prev) {
-        // Update runtime statistics
-        prev->runtime += time(NULL) - prev->last_run;
-        
-        // Handle task based on state
-        if (prev->state == TASK_RUNNING) {
-            enqueue_task(cpu, prev);
+        prev->runtime += TICK_MS;
+
+        if (prev->state != TASK_RUNNING) {
+            // Blocked: off the runqueue until wake_up_task()
+            prev->sleep_start = cpu->clock;
+        } else if (!rq->o1_mode) {
+            // Plain round robin by priority
+            prev->timeslice = task_timeslice(prev);
+            __enqueue_task(rq, rq->active, prev);
+        } else if (!task_tick(cpu, prev)) {
+            pthread_mutex_unlock(&rq->lock);
+            return;
         }
     }
 
     // Switch to next task
+    task_t *next = __pick_next_task(cpu);
     cpu->curr = next;
-    cpu->clock++;
+
+    pthread_mutex_unlock(&rq->lock);
 
     LOG(LOG_LEVEL_DEBUG, "CPU %u switched from %s to %s",
         cpu->id,
@@ -454,7 +685,10 @@ void print_sched_stats(sched_manager_t *manager) {
         printf("  Clock:     %lu\n", cpu->clock);
         
         pthread_mutex_lock(&cpu->rq->lock);
-        printf("  Run Queue: %zu tasks\n", cpu->rq->nr_running);
+        printf("  Run Queue: %zu tasks (%u active, %u expired)\n", cpu->rq->nr_running,
+               cpu->rq->active->nr_active, cpu->rq->expired->nr_active);
+        printf("  Swaps:     %lu (%lu expired slices)\n", cpu->rq->nr_array_swaps,
+               cpu->rq->nr_expired);
         pthread_mutex_unlock(&cpu->rq->lock);
     }
 
@@ -485,14 +719,17 @@ void destroy_sched_manager(sched_manager_t *manager) {
         
         // Clean up runqueue
         pthread_mutex_lock(&cpu->rq->lock);
-        for (int prio = 0; prio < MAX_PRIO; prio++) {
-            task_t *task = cpu->rq->tasks[prio];
-            while (task) {
-                task_t *next = task->next;
-                destroy_task(task);
-                task = next;
+        for (int i = 0; i < 2; i++) {
+            for (int prio = 0; prio < MAX_PRIO; prio++) {
+                task_t *task = cpu->rq->arrays[i].tasks[prio];
+                while (task) {
+                    task_t *next = task->next;
+                    destroy_task(task);
+                    task = next;
+                }
             }
         }
+        destroy_task(cpu->curr);
         pthread_mutex_unlock(&cpu->rq->lock);
         pthread_mutex_destroy(&cpu->rq->lock);
         free(cpu->rq);
@@ -514,7 +751,8 @@ void demonstrate_scheduler(void) {
         .nr_cpus = 4,
         .load_balance = true,
         .balance_interval = 100,
-        .track_stats = true
+        .track_stats = true,
+        .o1_mode = true
     };
 
     // Create scheduler manager
@@ -563,7 +801,156 @@ void demonstrate_scheduler(void) {
     destroy_sched_manager(manager);
 }
 
-int main(void) {
+// Benchmark: schedule() cost as the runqueue grows
+
+#define BENCH_TICKS        20000000 // enough for several passes over 100k hogs
+#define BENCH_VERIFY_TICKS 200000
+#define BENCH_WAKE_PERIOD  16
+#define BENCH_SLEEPERS     4        // wakeups start once this many sleep
+#define BENCH_INTERACTIVE  16       // one task in 16 sleeps, the rest are hogs
+#define BENCH_BURST        2        // ticks an interactive task runs per wakeup
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline uint64_t bench_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+// Normal tasks across the nice range on one CPU
+static sched_manager_t *bench_create(size_t n, bool o1_mode, uint64_t *seed) {
+    sched_config_t config = {
+        .nr_cpus = 1,
+        .load_balance = false,
+        .o1_mode = o1_mode
+    };
+    sched_manager_t *manager = create_sched_manager(config);
+    if (!manager) return NULL;
+
+    for (size_t i = 0; i < n; i++) {
+        int prio = MIN_PRIO + (int)(bench_rand(seed) % MAX_USER_PRIO);
+        task_t *task = create_task((pid_t)i + 1, "bench", SCHED_NORMAL, prio);
+        if (!task) break;
+        enqueue_task(&manager->cpus[0], task);
+    }
+    return manager;
+}
+
+// Every BENCH_WAKE_PERIOD ticks a random sleeper wakes. Interactive tasks
+// block after BENCH_BURST ticks on the CPU, so hogs get most of the time,
+// run out their slices and drive the expired array and the swaps
+static void bench_tick(cpu_t *cpu, unsigned long tick, task_t **sleepers,
+                       size_t *nr_sleepers, uint64_t *seed) {
+    if (tick % BENCH_WAKE_PERIOD == 0 && *nr_sleepers >= BENCH_SLEEPERS) {
+        size_t i = bench_rand(seed) % *nr_sleepers;
+        wake_up_task(cpu, sleepers[i]);
+        sleepers[i] = sleepers[--*nr_sleepers];
+    }
+    if (cpu->curr && cpu->curr->pid % BENCH_INTERACTIVE == 0 &&
+        cpu->clock - cpu->curr->last_run >= BENCH_BURST) {
+        cpu->curr->state = TASK_INTERRUPTIBLE;
+        sleepers[(*nr_sleepers)++] = cpu->curr;
+    }
+    schedule(cpu);
+}
+
+static void bench_destroy(sched_manager_t *manager, task_t **sleepers, size_t nr_sleepers) {
+    for (size_t i = 0; i < nr_sleepers; i++)
+        destroy_task(sleepers[i]);
+    free(sleepers);
+    destroy_sched_manager(manager);
+}
+
+static void bench_schedule(size_t n, bool o1_mode) {
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    size_t nr_sleepers = 0;
+    unsigned long interactive = 0;
+
+    sched_manager_t *manager = bench_create(n, o1_mode, &seed);
+    if (!manager) return;
+    task_t **sleepers = calloc(n / BENCH_INTERACTIVE + 1, sizeof(*sleepers));
+    cpu_t *cpu = &manager->cpus[0];
+
+    double start = bench_now();
+    for (unsigned long tick = 1; tick <= BENCH_TICKS; tick++) {
+        bench_tick(cpu, tick, sleepers, &nr_sleepers, &seed);
+        if (o1_mode && cpu->curr && task_interactive(cpu->curr))
+            interactive++;
+    }
+    double elapsed = bench_now() - start;
+
+    printf("  %7zu tasks  %-6s  %6.1f ns/schedule", n, o1_mode ? "O(1)" : "legacy",
+           elapsed * 1e9 / BENCH_TICKS);
+    if (o1_mode)
+        printf("  expired %7lu  swaps %4lu  interactive %5.1f%%",
+               cpu->rq->nr_expired, cpu->rq->nr_array_swaps,
+               100.0 * interactive / BENCH_TICKS);
+    printf("\n");
+
+    bench_destroy(manager, sleepers, nr_sleepers);
+}
+
+// Check each pick against a priority-by-priority scan of both arrays
+static void bench_verify(size_t n) {
+    uint64_t seed = 0x2545f4914f6cdd1dULL;
+    size_t nr_sleepers = 0;
+    unsigned long mismatches = 0;
+
+    sched_manager_t *manager = bench_create(n, true, &seed);
+    if (!manager) return;
+    task_t **sleepers = calloc(n / BENCH_INTERACTIVE + 1, sizeof(*sleepers));
+    cpu_t *cpu = &manager->cpus[0];
+
+    for (unsigned long tick = 1; tick <= BENCH_VERIFY_TICKS; tick++) {
+        runqueue_t *rq = cpu->rq;
+        prio_array_t *array = rq->active->nr_active ? rq->active : rq->expired;
+        task_t *prev = cpu->curr;
+        task_t *expect = NULL;
+
+        for (int prio = 0; prio < MAX_PRIO && !expect; prio++)
+            expect = array->tasks[prio];
+
+        bench_tick(cpu, tick, sleepers, &nr_sleepers, &seed);
+
+        // Only a switch that did not requeue or wake anything is predictable
+        if (cpu->curr != prev && (!prev || !prev->array) &&
+            tick % BENCH_WAKE_PERIOD != 0 && cpu->curr != expect)
+            mismatches++;
+    }
+
+    printf("  %7zu tasks  verify  %lu ticks, %lu mismatches\n",
+           n, (unsigned long)BENCH_VERIFY_TICKS, mismatches);
+
+    bench_destroy(manager, sleepers, nr_sleepers);
+}
+
+static int run_benchmark(void) {
+    static const size_t sizes[] = { 100, 1000, 10000, 100000 };
+
+    current_log_level = LOG_LEVEL_ERROR;
+    printf("Priority array benchmark (%d ticks, sleep/wake every %d, "
+           "1 in %d tasks interactive)\n",
+           BENCH_TICKS, BENCH_WAKE_PERIOD, BENCH_INTERACTIVE);
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        bench_schedule(sizes[i], false);
+        bench_schedule(sizes[i], true);
+    }
+    bench_verify(10000);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        return run_benchmark();
+
     // Set log level
     current_log_level = LOG_LEVEL_INFO;
 
@@ -0,0 +1,317 @@
+/*
+ * Scheduler Domain Topology Simulation
+ * Shared by topology_sim.c, fair_sim.c and core_sim.c
+ *
+ * Logical CPUs are described by where they sit in the machine: the core
+ * they are a hardware thread of, the last-level cache (socket) that core
+ * shares, and the NUMA node.  topology_sim.c produces this description
+ * from its node/socket/core tree; fair_sim.c can also generate a uniform
+ * one, and core_sim.c uses a uniform one to rank work-stealing victims.
+ * build_sched_domains() turns it into the per-CPU hierarchy the
+ * load balancer walks bottom-up:
+ *
+ *   SMT   threads of one core           groups: single CPUs
+ *   MC    cores sharing an LLC          groups: cores
+ *   NODE  LLCs of one NUMA node         groups: LLCs
+ *   NUMA  the whole machine             groups: NUMA nodes
+ *
+ * A level is dropped when it would hold a single group (no SMT, one LLC
+ * per node, one node).  Every CPU owns private copies of its domains, so
+ * balance state (last_balance, balance_interval) is only ever written by
+ * the CPU balancing it and needs no lock.
+ */
+
+#ifndef _SCHED_TOPOLOGY_SIM_H
+#define _SCHED_TOPOLOGY_SIM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef NR_CPUS
+#define NR_CPUS 256
+#endif
+
+#define CPUMASK_WORDS ((NR_CPUS + 63) / 64)
+
+typedef struct {
+    uint64_t bits[CPUMASK_WORDS];
+} cpumask_t;
+
+static inline void cpumask_clear(cpumask_t *mask)
+{
+    memset(mask, 0, sizeof(*mask));
+}
+
+static inline void cpumask_set_cpu(unsigned int cpu, cpumask_t *mask)
+{
+    mask->bits[cpu / 64] |= 1ULL << (cpu % 64);
+}
+
+static inline bool cpumask_test_cpu(unsigned int cpu, const cpumask_t *mask)
+{
+    return (mask->bits[cpu / 64] >> (cpu % 64)) & 1;
+}
+
+static inline unsigned int cpumask_weight(const cpumask_t *mask)
+{
+    unsigned int weight = 0;
+    for (int i = 0; i < CPUMASK_WORDS; i++)
+        weight += (unsigned int)__builtin_popcountll(mask->bits[i]);
+    return weight;
+}
+
+static inline bool cpumask_equal(const cpumask_t *a, const cpumask_t *b)
+{
+    return memcmp(a, b, sizeof(*a)) == 0;
+}
+
+/* First set bit at or after cpu, NR_CPUS if none */
+static inline unsigned int cpumask_next_from(unsigned int cpu, const cpumask_t *mask)
+{
+    while (cpu < NR_CPUS) {
+        uint64_t word = mask->bits[cpu / 64] >> (cpu % 64);
+        if (word)
+            return cpu + (unsigned int)__builtin_ctzll(word);
+        cpu = (cpu | 63) + 1;
+    }
+    return NR_CPUS;
+}
+
+static inline unsigned int cpumask_first(const cpumask_t *mask)
+{
+    return cpumask_next_from(0, mask);
+}
+
+#define for_each_cpu(cpu, mask) \
+    for ((cpu) = cpumask_first(mask); (cpu) < NR_CPUS; \
+         (cpu) = cpumask_next_from((cpu) + 1, mask))
+
+/* Render as a range list ("0-3,8,10-11") */
+static inline char *cpumask_print_list(const cpumask_t *mask, char *buf, size_t len)
+{
+    size_t off = 0;
+    unsigned int cpu = cpumask_first(mask);
+
+    buf[0] = '\0';
+    while (cpu < NR_CPUS && off < len) {
+        unsigned int end = cpu;
+        while (end + 1 < NR_CPUS && cpumask_test_cpu(end + 1, mask))
+            end++;
+        int n = end > cpu
+            ? snprintf(buf + off, len - off, "%s%u-%u", off ? "," : "", cpu, end)
+            : snprintf(buf + off, len - off, "%s%u", off ? "," : "", cpu);
+        if (n < 0)
+            break;
+        off += (size_t)n;
+        cpu = cpumask_next_from(end + 1, mask);
+    }
+    return buf;
+}
+
+/* Machine description: global ids, one entry per logical CPU */
+struct cpu_topology {
+    unsigned int nr_cpus;
+    struct {
+        unsigned int core;
+        unsigned int llc;
+        unsigned int node;
+    } cpu[NR_CPUS];
+};
+
+/* Number CPUs thread-first, then core, LLC and node */
+static inline bool cpu_topology_init_uniform(struct cpu_topology *topo, unsigned int nr_cpus,
+                                             unsigned int threads_per_core,
+                                             unsigned int cores_per_llc,
+                                             unsigned int llcs_per_node)
+{
+    if (nr_cpus == 0 || nr_cpus > NR_CPUS)
+        return false;
+
+    threads_per_core = threads_per_core ? threads_per_core : 1;
+    cores_per_llc = cores_per_llc ? cores_per_llc : nr_cpus;
+    llcs_per_node = llcs_per_node ? llcs_per_node : 1;
+
+    topo->nr_cpus = nr_cpus;
+    for (unsigned int i = 0; i < nr_cpus; i++) {
+        topo->cpu[i].core = i / threads_per_core;
+        topo->cpu[i].llc = topo->cpu[i].core / cores_per_llc;
+        topo->cpu[i].node = topo->cpu[i].llc / llcs_per_node;
+    }
+    return true;
+}
+
+enum sd_level {
+    SD_SMT,
+    SD_MC,
+    SD_NODE,
+    SD_NUMA,
+    SD_NR_LEVELS
+};
+
+static const char *const sd_level_names[SD_NR_LEVELS] = { "SMT", "MC", "NODE", "NUMA" };
+
+/* Load balancing is less eager the further tasks would travel */
+static const unsigned int sd_imbalance_pct[SD_NR_LEVELS] = { 110, 117, 117, 125 };
+
+#define SD_BUSY_FACTOR 16
+
+struct sched_group {
+    cpumask_t cpus;
+    unsigned int weight;
+    unsigned int first_cpu;
+};
+
+struct sched_domain {
+    struct sched_domain *parent;
+    struct sched_domain *child;
+    enum sd_level level;
+    cpumask_t span;
+    unsigned int span_weight;
+    struct sched_group *groups;
+    unsigned int nr_groups;
+    unsigned int local_group;       /* index of the group holding this CPU */
+
+    /* Balance state, private to the owning CPU */
+    unsigned int min_interval;      /* ms */
+    unsigned int max_interval;      /* ms */
+    unsigned int balance_interval;  /* ms, backs off while balanced */
+    unsigned int busy_factor;
+    unsigned int imbalance_pct;
+    unsigned int nr_balance_failed;
+    uint64_t last_balance;          /* ns */
+};
+
+/* Id of the unit that a level spans; level -1 is the CPU itself */
+static inline unsigned int sd_level_key(const struct cpu_topology *topo, int level,
+                                        unsigned int cpu)
+{
+    switch (level) {
+        case SD_SMT:  return topo->cpu[cpu].core;
+        case SD_MC:   return topo->cpu[cpu].llc;
+        case SD_NODE: return topo->cpu[cpu].node;
+        case SD_NUMA: return 0;
+        default:      return cpu;
+    }
+}
+
+static inline void free_sched_domains(struct sched_domain **sd, unsigned int nr_cpus)
+{
+    for (unsigned int cpu = 0; cpu < nr_cpus; cpu++) {
+        struct sched_domain *next;
+        for (struct sched_domain *d = sd[cpu]; d; d = next) {
+            next = d->parent;
+            free(d->groups);
+            free(d);
+        }
+        sd[cpu] = NULL;
+    }
+}
+
+static inline struct sched_domain *build_sched_domain(const struct cpu_topology *topo,
+                                                      unsigned int cpu, int level)
+{
+    struct sched_domain *sd = calloc(1, sizeof(*sd));
+    if (!sd)
+        return NULL;
+
+    unsigned int key = sd_level_key(topo, level, cpu);
+    for (unsigned int j = 0; j < topo->nr_cpus; j++) {
+        if (sd_level_key(topo, level, j) == key)
+            cpumask_set_cpu(j, &sd->span);
+    }
+    sd->span_weight = cpumask_weight(&sd->span);
+
+    /* Groups: the span split by the next level down */
+    sd->groups = calloc(sd->span_weight, sizeof(*sd->groups));
+    if (!sd->groups) {
+        free(sd);
+        return NULL;
+    }
+
+    cpumask_t covered;
+    unsigned int j;
+    cpumask_clear(&covered);
+    for_each_cpu(j, &sd->span) {
+        if (cpumask_test_cpu(j, &covered))
+            continue;
+
+        struct sched_group *sg = &sd->groups[sd->nr_groups];
+        unsigned int gkey = sd_level_key(topo, level - 1, j);
+        unsigned int k;
+
+        sg->first_cpu = j;
+        for_each_cpu(k, &sd->span) {
+            if (sd_level_key(topo, level - 1, k) == gkey) {
+                cpumask_set_cpu(k, &sg->cpus);
+                cpumask_set_cpu(k, &covered);
+            }
+        }
+        sg->weight = cpumask_weight(&sg->cpus);
+        if (cpumask_test_cpu(cpu, &sg->cpus))
+            sd->local_group = sd->nr_groups;
+        sd->nr_groups++;
+    }
+
+    sd->level = (enum sd_level)level;
+    sd->min_interval = sd->span_weight;
+    sd->max_interval = 2 * sd->span_weight;
+    sd->balance_interval = sd->min_interval;
+    sd->busy_factor = SD_BUSY_FACTOR;
+    sd->imbalance_pct = sd_imbalance_pct[level];
+    return sd;
+}
+
+/*
+ * Build the domain chain of every CPU; sd[cpu] receives the lowest
+ * level.  Returns false (and frees everything) on allocation failure.
+ */
+static inline bool build_sched_domains(const struct cpu_topology *topo, struct sched_domain **sd)
+{
+    for (unsigned int cpu = 0; cpu < topo->nr_cpus; cpu++) {
+        struct sched_domain *child = NULL;
+
+        sd[cpu] = NULL;
+        for (int level = 0; level < SD_NR_LEVELS; level++) {
+            struct sched_domain *d = build_sched_domain(topo, cpu, level);
+            if (!d) {
+                free_sched_domains(sd, cpu + 1);
+                return false;
+            }
+
+            /* Nothing to balance between: a single group */
+            if (d->nr_groups < 2) {
+                free(d->groups);
+                free(d);
+                continue;
+            }
+
+            d->child = child;
+            if (child)
+                child->parent = d;
+            else
+                sd[cpu] = d;
+            child = d;
+        }
+    }
+    return true;
+}
+
+static inline void print_sched_domains(struct sched_domain *sd, unsigned int cpu)
+{
+    char span[256], group[256];
+
+    printf("CPU %u sched domains:\n", cpu);
+    for (; sd; sd = sd->parent) {
+        printf("  %-4s span %s, interval %u-%u ms, imbalance %u%%, groups:",
+            sd_level_names[sd->level], cpumask_print_list(&sd->span, span, sizeof(span)),
+            sd->min_interval, sd->max_interval, sd->imbalance_pct);
+        for (unsigned int i = 0; i < sd->nr_groups; i++)
+            printf(" {%s}", cpumask_print_list(&sd->groups[i].cpus, group, sizeof(group)));
+        printf("\n");
+    }
+}
+
+#endif /* _SCHED_TOPOLOGY_SIM_H */
@@ -4,6 +4,11 @@
  * This is a simplified simulation of the Linux kernel's TCP BPF functionality
  * for educational purposes. It demonstrates the core concepts of TCP packet
  * processing with BPF hooks.
+ *
+ * Sockets can be placed in a sockmap or sockhash whose SK_MSG verdict
+ * program may redirect a sender's data to a peer socket. Redirected data
+ * moves as refcounted sk_msg scatterlists onto the peer's lockless ingress
+ * queue, so it is copied only on the way in and on the way out.
  */
 
 #include <stdio.h>
@@ -20,6 +25,8 @@
 #include <time.h>
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
 
 #define MAX_PACKET_SIZE 65535
 #define MAX_QUEUE_SIZE 1024
@@ -27,23 +34,61 @@
 #define MAX_MSG_SIZE 8192
 #define DEFAULT_PORT 8888
 #define BACKLOG 5
+#define MAX_MSG_FRAGS 17             // Scatterlist entries per sk_msg
+#define SK_MSG_PAGE_SIZE 32768       // Data page size for sk_msg copies
+#define SOCKHASH_BUCKETS 256
+#define BPF_F_INGRESS (1U << 0)      // Redirect to the peer's receive side
+#define SK_PSOCK_INGRESS_MAX (4U << 20) // Unread redirected bytes per socket
 
 // Simulated BPF program types
 enum bpf_prog_type {
     BPF_PROG_TYPE_SOCKET_FILTER,
     BPF_PROG_TYPE_TCP_LISTEN,
     BPF_PROG_TYPE_TCP_DATA,
+    BPF_PROG_TYPE_SK_MSG,
     BPF_PROG_TYPE_MAX
 };
 
+// Verdicts returned by SK_MSG programs
+enum sk_action {
+    SK_DROP = 0,
+    SK_PASS = 1,
+};
+
+enum bpf_map_type {
+    BPF_MAP_TYPE_SOCKMAP,
+    BPF_MAP_TYPE_SOCKHASH,
+};
+
+// Refcounted data page; frags of several sk_msgs may share one
+struct sk_page {
+    atomic_int refcount;
+    size_t size;
+    unsigned char data[];
+};
+
+struct sk_msg_frag {
+    struct sk_page *page;
+    uint32_t offset;
+    uint32_t len;
+};
+
+struct sock;
+
 // Simulated socket message structure
 struct sk_msg {
-    void *data;
-    size_t len;
-    size_t offset;
+    void *data;                  // First fragment, as seen by verdict programs
+    size_t len;                  // Bytes not yet consumed
+    size_t offset;               // Bytes consumed so far
     struct sk_msg *next;
     atomic_int refcount;
     bool in_use;
+    struct sock *sk;             // Sending socket
+    struct sock *sk_redir;       // Set by bpf_msg_redirect_*()
+    uint32_t redir_flags;
+    int sg_start;                // First frag with unconsumed data
+    int nr_frags;
+    struct sk_msg_frag frags[MAX_MSG_FRAGS];
 };
 
 // Simulated socket buffer structure
@@ -66,6 +111,14 @@ struct bpf_prog {
     atomic_int refcount;
 };
 
+// Socket buffer queue
+struct sk_buff_head {
+    struct sk_buff *first;
+    struct sk_buff *last;
+    int qlen;
+    pthread_mutex_t lock;
+};
+
 // Simulated socket structure
 struct sock {
     int fd;
@@ -75,15 +128,50 @@ struct sock {
     struct bpf_prog *progs[BPF_PROG_TYPE_MAX];
     pthread_mutex_t lock;
     atomic_bool closed;
-    void *sk_user_data;
+    pthread_mutex_t psock_lock;  // Leaf lock: publishes/detaches sk_user_data
+    void *sk_user_data;          // struct sk_psock once in a sockmap
 };
 
-// Socket buffer queue
-struct sk_buff_head {
-    struct sk_buff *first;
-    struct sk_buff *last;
-    int qlen;
+/*
+ * Per-socket sockmap state. Redirecting senders push onto ingress_head
+ * with a CAS and never block; the reader splices that LIFO stack into
+ * its private FIFO under ingress_lock, which no producer touches.
+ */
+struct sk_psock {
+    struct sock *sk;
+    struct bpf_map *map;
+    atomic_int refcnt;           // One for sk_user_data, one per redirect in flight
+    _Atomic(struct sk_msg *) ingress_head;
+    struct sk_msg *ingress_first;
+    struct sk_msg *ingress_last;
+    pthread_mutex_t ingress_lock;
+    atomic_size_t ingress_bytes;
+    struct sk_msg *cork;         // Open message being filled, under sk->lock
+    struct sk_page *tx_page;     // Page new send data is copied into
+    size_t tx_off;
+    uint32_t cork_bytes;         // Run the verdict once this much is queued
+    atomic_ulong redir_msgs;
+    atomic_ulong redir_bytes;
+    atomic_ulong redir_drops;    // Peer's ingress queue was full
+};
+
+struct sock_hash_elem {
+    uint32_t key;
+    struct sock *sk;
+    _Atomic(struct sock_hash_elem *) next;
+    struct sock_hash_elem *retired_next;
+};
+
+// Sockmap (array) or sockhash; lookups are lockless, updates take lock
+struct bpf_map {
+    enum bpf_map_type map_type;
+    uint32_t max_entries;
+    _Atomic(struct bpf_prog *) msg_verdict;
     pthread_mutex_t lock;
+    _Atomic(struct sock *) *socks;                 // SOCKMAP
+    _Atomic(struct sock_hash_elem *) *buckets;     // SOCKHASH
+    struct sock_hash_elem *retired;                // Freed with the map
+    uint32_t count;
 };
 
 // Global variables
@@ -241,12 +329,17 @@ static struct sock *create_socket(void) {
     sk_buff_head_init(&sk->rx_queue);
     sk_buff_head_init(&sk->tx_queue);
     pthread_mutex_init(&sk->lock, NULL);
+    pthread_mutex_init(&sk->psock_lock, NULL);
     atomic_init(&sk->closed, false);
     
     return sk;
 }
 
+static void sk_psock_put(struct sk_psock *psock);
+
 static void destroy_socket(struct sock *sk) {
+    struct sk_psock *psock;
+    
     if (!sk)
         return;
     
@@ -254,6 +347,15 @@ static void destroy_socket(struct sock *sk) {
     
     pthread_mutex_lock(&sk->lock);
     
+    // Callers remove the socket from its sockmap first; a redirect still
+    // in flight keeps the psock until it drops its reference
+    pthread_mutex_lock(&sk->psock_lock);
+    psock = sk->sk_user_data;
+    sk->sk_user_data = NULL;
+    pthread_mutex_unlock(&sk->psock_lock);
+    if (psock)
+        sk_psock_put(psock);
+    
     close(sk->fd);
     sk_buff_head_destroy(&sk->rx_queue);
     sk_buff_head_destroy(&sk->tx_queue);
@@ -265,6 +367,7 @@ static void destroy_socket(struct sock *sk) {
     
     pthread_mutex_unlock(&sk->lock);
     pthread_mutex_destroy(&sk->lock);
+    pthread_mutex_destroy(&sk->psock_lock);
     
     free(sk);
 }
@@ -372,6 +475,712 @@ static int tcp_recvmsg_locked(struct sock *sk, void *buf, size_t len) {
     return ret;
 }
 
+// Sockmap and sk_msg redirect
+
+static struct sk_page *sk_page_alloc(size_t size) {
+    struct sk_page *page = safe_malloc(sizeof(*page) + size);
+    
+    atomic_init(&page->refcount, 1);
+    page->size = size;
+    return page;
+}
+
+static void sk_page_put(struct sk_page *page) {
+    if (atomic_fetch_sub(&page->refcount, 1) == 1)
+        free(page);
+}
+
+static struct sk_msg *sk_msg_alloc(struct sock *sk) {
+    struct sk_msg *msg = safe_malloc(sizeof(*msg));
+    
+    // frags[] beyond nr_frags is never read, so leave it uninitialised
+    memset(msg, 0, offsetof(struct sk_msg, frags));
+    atomic_init(&msg->refcount, 1);
+    msg->sk = sk;
+    msg->in_use = true;
+    return msg;
+}
+
+static void sk_msg_free(struct sk_msg *msg) {
+    for (int i = msg->sg_start; i < msg->nr_frags; i++)
+        sk_page_put(msg->frags[i].page);
+    free(msg);
+}
+
+static inline bool sk_msg_full(const struct sk_msg *msg) {
+    return msg->nr_frags == MAX_MSG_FRAGS;
+}
+
+static inline struct sk_psock *sk_psock(const struct sock *sk) {
+    return sk->sk_user_data;
+}
+
+// Referenced psock of another socket, or NULL; drop with sk_psock_put()
+static struct sk_psock *sk_psock_get(struct sock *sk) {
+    struct sk_psock *psock;
+    
+    pthread_mutex_lock(&sk->psock_lock);
+    psock = sk->sk_user_data;
+    if (psock)
+        atomic_fetch_add_explicit(&psock->refcnt, 1, memory_order_relaxed);
+    pthread_mutex_unlock(&sk->psock_lock);
+    return psock;
+}
+
+/*
+ * Copy user data into msg; returns bytes taken (0 if msg is full). Data
+ * is carved from the socket's current tx page, so small messages share
+ * pages instead of each allocating one. Caller holds sk->lock.
+ */
+static size_t sk_msg_copy_in(struct sk_psock *psock, struct sk_msg *msg,
+                             const void *buf, size_t len) {
+    size_t copied = 0;
+    
+    while (copied < len) {
+        struct sk_msg_frag *frag = msg->nr_frags ?
+                                   &msg->frags[msg->nr_frags - 1] : NULL;
+        size_t room, n;
+        
+        if (!psock->tx_page || psock->tx_off == psock->tx_page->size) {
+            if (psock->tx_page)
+                sk_page_put(psock->tx_page);
+            psock->tx_page = sk_page_alloc(SK_MSG_PAGE_SIZE);
+            psock->tx_off = 0;
+        }
+        room = psock->tx_page->size - psock->tx_off;
+        
+        // Extend the last frag if it ends where the tx page is free
+        if (!frag || frag->page != psock->tx_page ||
+            frag->offset + frag->len != psock->tx_off) {
+            if (msg->nr_frags == MAX_MSG_FRAGS)
+                break;
+            frag = &msg->frags[msg->nr_frags++];
+            frag->page = psock->tx_page;
+            frag->offset = psock->tx_off;
+            frag->len = 0;
+            atomic_fetch_add_explicit(&frag->page->refcount, 1,
+                                      memory_order_relaxed);
+        }
+        
+        n = len - copied < room ? len - copied : room;
+        memcpy(frag->page->data + psock->tx_off, (const char *)buf + copied, n);
+        frag->len += n;
+        psock->tx_off += n;
+        copied += n;
+    }
+    
+    msg->len += copied;
+    return copied;
+}
+
+static struct sk_psock *sk_psock_init(struct sock *sk, struct bpf_map *map) {
+    struct sk_psock *psock = safe_malloc(sizeof(*psock));
+    
+    memset(psock, 0, sizeof(*psock));
+    psock->sk = sk;
+    psock->map = map;
+    atomic_init(&psock->refcnt, 1);
+    atomic_init(&psock->ingress_head, NULL);
+    pthread_mutex_init(&psock->ingress_lock, NULL);
+    atomic_init(&psock->ingress_bytes, 0);
+    atomic_init(&psock->redir_msgs, 0);
+    atomic_init(&psock->redir_bytes, 0);
+    atomic_init(&psock->redir_drops, 0);
+    return psock;
+}
+
+/*
+ * Producer side: lock-free push, any number of redirecting senders.
+ * Returns false, queueing nothing, once SK_PSOCK_INGRESS_MAX unread bytes
+ * are waiting; an empty queue always takes one message.
+ */
+static bool sk_psock_queue_msg(struct sk_psock *psock, struct sk_msg *msg) {
+    struct sk_msg *head = atomic_load_explicit(&psock->ingress_head,
+                                               memory_order_relaxed);
+    size_t queued = atomic_fetch_add(&psock->ingress_bytes, msg->len);
+    
+    if (queued && queued + msg->len > SK_PSOCK_INGRESS_MAX) {
+        atomic_fetch_sub(&psock->ingress_bytes, msg->len);
+        return false;
+    }
+    do {
+        msg->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&psock->ingress_head,
+                                                    &head, msg,
+                                                    memory_order_release,
+                                                    memory_order_relaxed));
+    return true;
+}
+
+// Consumer side, under ingress_lock: oldest unread message or NULL
+static struct sk_msg *sk_psock_peek_msg(struct sk_psock *psock) {
+    struct sk_msg *stack, *msg, *first = NULL, *last = NULL;
+    
+    if (psock->ingress_first)
+        return psock->ingress_first;
+    
+    stack = atomic_exchange_explicit(&psock->ingress_head, NULL,
+                                     memory_order_acquire);
+    // Reverse the LIFO stack into arrival order
+    while (stack) {
+        msg = stack;
+        stack = msg->next;
+        msg->next = first;
+        first = msg;
+        if (!last)
+            last = msg;
+    }
+    psock->ingress_first = first;
+    psock->ingress_last = last;
+    return first;
+}
+
+static void sk_psock_pop_msg(struct sk_psock *psock) {
+    struct sk_msg *msg = psock->ingress_first;
+    
+    psock->ingress_first = msg->next;
+    if (!psock->ingress_first)
+        psock->ingress_last = NULL;
+}
+
+static void sk_psock_free(struct sk_psock *psock) {
+    struct sk_msg *msg;
+    
+    pthread_mutex_lock(&psock->ingress_lock);
+    while ((msg = sk_psock_peek_msg(psock)) != NULL) {
+        sk_psock_pop_msg(psock);
+        sk_msg_free(msg);
+    }
+    pthread_mutex_unlock(&psock->ingress_lock);
+    
+    if (psock->cork)
+        sk_msg_free(psock->cork);
+    if (psock->tx_page)
+        sk_page_put(psock->tx_page);
+    pthread_mutex_destroy(&psock->ingress_lock);
+    free(psock);
+}
+
+static void sk_psock_put(struct sk_psock *psock) {
+    if (atomic_fetch_sub_explicit(&psock->refcnt, 1, memory_order_acq_rel) == 1)
+        sk_psock_free(psock);
+}
+
+static struct bpf_map *sock_map_create(enum bpf_map_type type,
+                                       uint32_t max_entries) {
+    struct bpf_map *map = safe_malloc(sizeof(*map));
+    
+    memset(map, 0, sizeof(*map));
+    map->map_type = type;
+    map->max_entries = max_entries;
+    atomic_init(&map->msg_verdict, NULL);
+    pthread_mutex_init(&map->lock, NULL);
+    
+    if (type == BPF_MAP_TYPE_SOCKMAP) {
+        map->socks = safe_malloc(max_entries * sizeof(*map->socks));
+        for (uint32_t i = 0; i < max_entries; i++)
+            atomic_init(&map->socks[i], NULL);
+    } else {
+        map->buckets = safe_malloc(SOCKHASH_BUCKETS * sizeof(*map->buckets));
+        for (uint32_t i = 0; i < SOCKHASH_BUCKETS; i++)
+            atomic_init(&map->buckets[i], NULL);
+    }
+    return map;
+}
+
+static void sock_map_free(struct bpf_map *map) {
+    struct bpf_prog *prog = atomic_load(&map->msg_verdict);
+    struct sock_hash_elem *elem, *next;
+    
+    if (prog)
+        unregister_bpf_prog(prog);
+    if (map->buckets) {
+        for (uint32_t i = 0; i < SOCKHASH_BUCKETS; i++) {
+            for (elem = atomic_load(&map->buckets[i]); elem; elem = next) {
+                next = atomic_load(&elem->next);
+                free(elem);
+            }
+        }
+        free(map->buckets);
+    }
+    for (elem = map->retired; elem; elem = next) {
+        next = elem->retired_next;
+        free(elem);
+    }
+    free(map->socks);
+    pthread_mutex_destroy(&map->lock);
+    free(map);
+}
+
+// The map takes over the caller's reference on prog
+static int sock_map_attach_prog(struct bpf_map *map, struct bpf_prog *prog) {
+    if (prog->type != BPF_PROG_TYPE_SK_MSG)
+        return -EINVAL;
+    prog = atomic_exchange(&map->msg_verdict, prog);
+    if (prog)
+        unregister_bpf_prog(prog);
+    return 0;
+}
+
+static inline uint32_t sock_hash_bucket(uint32_t key) {
+    return (key * 0x9E3779B1u) >> 24;       // log2(SOCKHASH_BUCKETS) bits
+}
+
+static struct sock *__sock_map_lookup_elem(struct bpf_map *map, uint32_t key) {
+    if (key >= map->max_entries)
+        return NULL;
+    return atomic_load_explicit(&map->socks[key], memory_order_acquire);
+}
+
+static struct sock *__sock_hash_lookup_elem(struct bpf_map *map, uint32_t key) {
+    struct sock_hash_elem *elem;
+    
+    elem = atomic_load_explicit(&map->buckets[sock_hash_bucket(key)],
+                                memory_order_acquire);
+    for (; elem; elem = atomic_load_explicit(&elem->next, memory_order_acquire))
+        if (elem->key == key)
+            return elem->sk;
+    return NULL;
+}
+
+// Add sk at key; the socket gets a psock and the map's verdict program
+static int sock_map_update_elem(struct bpf_map *map, uint32_t key,
+                                struct sock *sk) {
+    struct sock_hash_elem *elem;
+    _Atomic(struct sock_hash_elem *) *bucket;
+    int ret = 0;
+    
+    pthread_mutex_lock(&sk->lock);
+    if (sk->sk_user_data && sk_psock(sk)->map != map) {
+        pthread_mutex_unlock(&sk->lock);
+        return -EBUSY;
+    }
+    if (!sk->sk_user_data) {
+        struct sk_psock *psock = sk_psock_init(sk, map);
+        
+        pthread_mutex_lock(&sk->psock_lock);
+        sk->sk_user_data = psock;
+        pthread_mutex_unlock(&sk->psock_lock);
+    }
+    pthread_mutex_unlock(&sk->lock);
+    
+    pthread_mutex_lock(&map->lock);
+    if (map->map_type == BPF_MAP_TYPE_SOCKMAP) {
+        if (key >= map->max_entries) {
+            ret = -E2BIG;
+            goto out;
+        }
+        atomic_store_explicit(&map->socks[key], sk, memory_order_release);
+        goto out;
+    }
+    
+    if (__sock_hash_lookup_elem(map, key)) {
+        ret = -EEXIST;
+        goto out;
+    }
+    if (map->count >= map->max_entries) {
+        ret = -E2BIG;
+        goto out;
+    }
+    elem = safe_malloc(sizeof(*elem));
+    elem->key = key;
+    elem->sk = sk;
+    elem->retired_next = NULL;
+    bucket = &map->buckets[sock_hash_bucket(key)];
+    atomic_init(&elem->next, atomic_load(bucket));
+    atomic_store_explicit(bucket, elem, memory_order_release);
+    map->count++;
+out:
+    pthread_mutex_unlock(&map->lock);
+    return ret;
+}
+
+static int sock_map_delete_elem(struct bpf_map *map, uint32_t key) {
+    _Atomic(struct sock_hash_elem *) *pprev;
+    struct sock_hash_elem *elem;
+    int ret = -ENOENT;
+    
+    pthread_mutex_lock(&map->lock);
+    if (map->map_type == BPF_MAP_TYPE_SOCKMAP) {
+        if (key < map->max_entries &&
+            atomic_exchange(&map->socks[key], NULL))
+            ret = 0;
+        goto out;
+    }
+    
+    pprev = &map->buckets[sock_hash_bucket(key)];
+    for (elem = atomic_load(pprev); elem; elem = atomic_load(pprev)) {
+        if (elem->key == key) {
+            atomic_store_explicit(pprev, atomic_load(&elem->next),
+                                  memory_order_release);
+            // Lockless readers may still hold it
+            elem->retired_next = map->retired;
+            map->retired = elem;
+            map->count--;
+            ret = 0;
+            break;
+        }
+        pprev = &elem->next;
+    }
+out:
+    pthread_mutex_unlock(&map->lock);
+    return ret;
+}
+
+// Helpers callable from SK_MSG programs
+
+static int bpf_msg_redirect_map(struct sk_msg *msg, struct bpf_map *map,
+                                uint32_t key, uint64_t flags) {
+    msg->sk_redir = __sock_map_lookup_elem(map, key);
+    msg->redir_flags = flags & BPF_F_INGRESS;
+    return msg->sk_redir ? SK_PASS : SK_DROP;
+}
+
+static int bpf_msg_redirect_hash(struct sk_msg *msg, struct bpf_map *map,
+                                 uint32_t key, uint64_t flags) {
+    msg->sk_redir = __sock_hash_lookup_elem(map, key);
+    msg->redir_flags = flags & BPF_F_INGRESS;
+    return msg->sk_redir ? SK_PASS : SK_DROP;
+}
+
+// Defer the verdict until bytes have been queued on this socket
+static int bpf_msg_cork_bytes(struct sk_msg *msg, uint32_t bytes) {
+    sk_psock(msg->sk)->cork_bytes = bytes;
+    return 0;
+}
+
+// Transmit msg on sk's own connection and free it
+static int tcp_bpf_push(struct sock *sk, struct sk_msg *msg) {
+    int ret = 0;
+    
+    for (int i = msg->sg_start; i < msg->nr_frags && ret >= 0; i++) {
+        struct sk_msg_frag *frag = &msg->frags[i];
+        
+        ret = send(sk->fd, frag->page->data + frag->offset, frag->len,
+                   MSG_NOSIGNAL);
+    }
+    sk_msg_free(msg);
+    return ret < 0 ? -errno : 0;
+}
+
+// Run the verdict on a complete message and act on it
+static int tcp_bpf_verdict_apply(struct sk_psock *psock, struct sk_msg *msg) {
+    struct bpf_prog *prog = atomic_load(&psock->map->msg_verdict);
+    struct sk_psock *peer;
+    size_t len = msg->len;
+    int verdict = SK_PASS;
+    
+    msg->sk_redir = NULL;
+    msg->data = msg->frags[msg->sg_start].page->data +
+                msg->frags[msg->sg_start].offset;
+    if (prog)
+        verdict = prog->filter(msg, msg->data, msg->frags[msg->sg_start].len);
+    
+    if (verdict != SK_PASS) {
+        sk_msg_free(msg);
+        return -EACCES;
+    }
+    if (!msg->sk_redir)
+        return tcp_bpf_push(psock->sk, msg);
+    
+    if (!(msg->redir_flags & BPF_F_INGRESS))
+        return tcp_bpf_push(msg->sk_redir, msg);
+    
+    // Ingress redirect: hand the scatterlist over as is
+    peer = sk_psock_get(msg->sk_redir);
+    if (!peer || atomic_load(&msg->sk_redir->closed)) {
+        if (peer)
+            sk_psock_put(peer);
+        sk_msg_free(msg);
+        return -EPIPE;
+    }
+    if (!sk_psock_queue_msg(peer, msg)) {
+        // The reader is not keeping up: drop rather than grow without bound
+        sk_psock_put(peer);
+        sk_msg_free(msg);
+        atomic_fetch_add(&psock->redir_drops, 1);
+        return -ENOBUFS;
+    }
+    sk_psock_put(peer);
+    atomic_fetch_add(&psock->redir_msgs, 1);
+    atomic_fetch_add(&psock->redir_bytes, len);
+    return 0;
+}
+
+// Send through the socket's sockmap, if any
+static int tcp_bpf_sendmsg(struct sock *sk, const void *buf, size_t len) {
+    struct sk_psock *psock = sk_psock(sk);
+    struct sk_msg *msg;
+    size_t copied = 0;
+    int ret = 0;
+    
+    if (!psock || !atomic_load(&psock->map->msg_verdict))
+        return tcp_sendmsg_locked(sk, buf, len);
+    
+    pthread_mutex_lock(&sk->lock);
+    while (copied < len) {
+        if (!psock->cork)
+            psock->cork = sk_msg_alloc(sk);
+        msg = psock->cork;
+        copied += sk_msg_copy_in(psock, msg, (const char *)buf + copied,
+                                 len - copied);
+        
+        if (msg->len >= psock->cork_bytes || sk_msg_full(msg)) {
+            psock->cork = NULL;
+            ret = tcp_bpf_verdict_apply(psock, msg);
+            if (ret < 0)
+                break;
+        }
+    }
+    pthread_mutex_unlock(&sk->lock);
+    
+    return copied ? (int)copied : ret;
+}
+
+// Apply the verdict to a partially corked message (end of a burst)
+static int tcp_bpf_flush(struct sock *sk) {
+    struct sk_psock *psock = sk_psock(sk);
+    struct sk_msg *msg;
+    int ret = 0;
+    
+    if (!psock)
+        return 0;
+    pthread_mutex_lock(&sk->lock);
+    msg = psock->cork;
+    psock->cork = NULL;
+    if (msg && msg->len)
+        ret = tcp_bpf_verdict_apply(psock, msg);
+    else if (msg)
+        sk_msg_free(msg);
+    pthread_mutex_unlock(&sk->lock);
+    return ret;
+}
+
+// Read redirected data first, then fall back to the TCP stream
+static int tcp_bpf_recvmsg(struct sock *sk, void *buf, size_t len) {
+    struct sk_psock *psock = sk_psock(sk);
+    struct sk_msg *msg;
+    size_t copied = 0;
+    
+    if (!psock)
+        return tcp_recvmsg_locked(sk, buf, len);
+    
+    pthread_mutex_lock(&psock->ingress_lock);
+    while (copied < len && (msg = sk_psock_peek_msg(psock)) != NULL) {
+        while (copied < len && msg->sg_start < msg->nr_frags) {
+            struct sk_msg_frag *frag = &msg->frags[msg->sg_start];
+            size_t n = len - copied < frag->len ? len - copied : frag->len;
+            
+            memcpy((char *)buf + copied, frag->page->data + frag->offset, n);
+            frag->offset += n;
+            frag->len -= n;
+            msg->len -= n;
+            msg->offset += n;
+            copied += n;
+            if (!frag->len)
+                sk_page_put(msg->frags[msg->sg_start++].page);
+        }
+        if (msg->sg_start == msg->nr_frags) {
+            sk_psock_pop_msg(psock);
+            free(msg);
+        }
+    }
+    pthread_mutex_unlock(&psock->ingress_lock);
+    
+    if (copied) {
+        atomic_fetch_sub(&psock->ingress_bytes, copied);
+        return copied;
+    }
+    return tcp_recvmsg_locked(sk, buf, len);
+}
+
+// Local proxy benchmark
+
+#define PROXY_BENCH_BYTES (256UL << 20)
+#define PROXY_BENCH_WINDOW 65536     // Bytes in flight before the reader drains
+#define PROXY_BENCH_HASH_KEY_A 8080  // Sockhash keys, port-like as in a proxy
+#define PROXY_BENCH_HASH_KEY_B 9090
+
+static struct bpf_map *proxy_bench_map;
+static struct bpf_map *proxy_bench_hash;
+static uint32_t proxy_bench_cork;
+
+// SK_MSG verdict: everything sent on A goes to B's receive side
+static int proxy_redirect_verdict(void *ctx, void *data, size_t len) {
+    (void)data;
+    (void)len;
+    bpf_msg_cork_bytes(ctx, proxy_bench_cork);
+    return bpf_msg_redirect_map(ctx, proxy_bench_map, 1, BPF_F_INGRESS);
+}
+
+// Same verdict for a sockhash keyed pair
+static int proxy_redirect_hash_verdict(void *ctx, void *data, size_t len) {
+    (void)data;
+    (void)len;
+    bpf_msg_cork_bytes(ctx, proxy_bench_cork);
+    return bpf_msg_redirect_hash(ctx, proxy_bench_hash, PROXY_BENCH_HASH_KEY_B,
+                                 BPF_F_INGRESS);
+}
+
+static struct bpf_prog *proxy_bench_prog(const char *name,
+                                         int (*filter)(void *, void *, size_t)) {
+    struct bpf_prog *prog = safe_malloc(sizeof(*prog));
+    
+    memset(prog, 0, sizeof(*prog));
+    prog->type = BPF_PROG_TYPE_SK_MSG;
+    prog->filter = filter;
+    strncpy(prog->name, name, sizeof(prog->name) - 1);
+    atomic_init(&prog->refcount, 1);
+    register_bpf_prog(prog);
+    return prog;
+}
+
+static double proxy_bench_elapsed(const struct timespec *t0) {
+    struct timespec t1;
+    
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) + (t1.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+/*
+ * Userspace proxy: the client's write lands in A's queue, the proxy reads
+ * it out and writes it into B's queue, and the server reads it: every hop
+ * allocates and copies.
+ */
+static double proxy_bench_copy(struct sock *a, struct sock *b, size_t msg_size,
+                               char *src, char *dst) {
+    size_t iters = PROXY_BENCH_BYTES / msg_size, done = 0;
+    size_t window = PROXY_BENCH_WINDOW / msg_size;
+    struct timespec t0;
+    struct sk_buff *skb, *fwd;
+    
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while (done < iters) {
+        size_t burst = iters - done < window ? iters - done : window;
+        
+        for (size_t i = 0; i < burst; i++) {
+            skb = alloc_skb(msg_size);
+            memcpy(skb->data, src, msg_size);
+            skb->len = msg_size;
+            sk_buff_queue_tail(&a->rx_queue, skb);
+        }
+        while ((skb = sk_buff_dequeue(&a->rx_queue)) != NULL) {
+            memcpy(dst, skb->data, skb->len);       // proxy recv()
+            fwd = alloc_skb(skb->len);              // proxy send()
+            memcpy(fwd->data, dst, skb->len);
+            fwd->len = skb->len;
+            sk_buff_queue_tail(&b->rx_queue, fwd);
+            free(skb->head);
+            free(skb);
+        }
+        while ((skb = sk_buff_dequeue(&b->rx_queue)) != NULL) {
+            memcpy(dst, skb->data, skb->len);       // server recv()
+            free(skb->head);
+            free(skb);
+        }
+        done += burst;
+    }
+    return (double)iters * msg_size / proxy_bench_elapsed(&t0) / 1e9;
+}
+
+// Sockmap redirect: one copy into sk_msg pages, one copy out at B
+static double proxy_bench_redirect(struct sock *a, struct sock *b,
+                                   size_t msg_size, char *src, char *dst) {
+    size_t iters = PROXY_BENCH_BYTES / msg_size, done = 0, got = 0;
+    size_t window = PROXY_BENCH_WINDOW / msg_size;
+    struct timespec t0;
+    int ret;
+    
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while (done < iters) {
+        size_t burst = iters - done < window ? iters - done : window;
+        
+        for (size_t i = 0; i < burst; i++)
+            tcp_bpf_sendmsg(a, src, msg_size);
+        tcp_bpf_flush(a);
+        while (got < (done + burst) * msg_size &&
+               (ret = tcp_bpf_recvmsg(b, dst, MAX_PACKET_SIZE)) > 0)
+            got += ret;
+        done += burst;
+    }
+    if (got != iters * msg_size) {
+        fprintf(stderr, "redirect lost data: %zu of %zu bytes\n",
+                got, iters * msg_size);
+        return 0;
+    }
+    return (double)iters * msg_size / proxy_bench_elapsed(&t0) / 1e9;
+}
+
+static int tcp_bpf_run_proxy_benchmark(void) {
+    static const size_t sizes[] = { 64, 512, 4096, 16384, 32768 };
+    struct bpf_prog *prog, *hash_prog;
+    struct sock *a, *b, *c, *d;
+    char *src, *dst;
+    
+    a = create_socket();
+    b = create_socket();
+    c = create_socket();
+    d = create_socket();
+    if (!a || !b || !c || !d)
+        return 1;
+    src = safe_malloc(MAX_PACKET_SIZE);
+    dst = safe_malloc(MAX_PACKET_SIZE);
+    memset(src, 'A', MAX_PACKET_SIZE);
+    
+    // A -> B through a sockmap, C -> D through a sockhash
+    proxy_bench_map = sock_map_create(BPF_MAP_TYPE_SOCKMAP, 2);
+    prog = proxy_bench_prog("proxy_redirect", proxy_redirect_verdict);
+    sock_map_attach_prog(proxy_bench_map, prog);
+    sock_map_update_elem(proxy_bench_map, 0, a);
+    sock_map_update_elem(proxy_bench_map, 1, b);
+    
+    proxy_bench_hash = sock_map_create(BPF_MAP_TYPE_SOCKHASH, 2);
+    hash_prog = proxy_bench_prog("proxy_redirect_hash", proxy_redirect_hash_verdict);
+    sock_map_attach_prog(proxy_bench_hash, hash_prog);
+    sock_map_update_elem(proxy_bench_hash, PROXY_BENCH_HASH_KEY_A, c);
+    sock_map_update_elem(proxy_bench_hash, PROXY_BENCH_HASH_KEY_B, d);
+    
+    printf("local proxy A -> B, GB/s, %lu MB per run\n", PROXY_BENCH_BYTES >> 20);
+    printf("%8s %10s %10s %10s %10s\n", "msg", "copy", "redirect", "cork=64K",
+           "sockhash");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        double copy, redir, cork, hash;
+        
+        copy = proxy_bench_copy(a, b, sizes[i], src, dst);
+        proxy_bench_cork = 0;
+        sk_psock(a)->cork_bytes = 0;
+        redir = proxy_bench_redirect(a, b, sizes[i], src, dst);
+        proxy_bench_cork = 65536;
+        cork = proxy_bench_redirect(a, b, sizes[i], src, dst);
+        proxy_bench_cork = 0;
+        sk_psock(c)->cork_bytes = 0;
+        hash = proxy_bench_redirect(c, d, sizes[i], src, dst);
+        printf("%8zu %10.2f %10.2f %10.2f %10.2f\n", sizes[i], copy, redir,
+               cork, hash);
+    }
+    printf("redirected: %lu msgs via sockmap, %lu via sockhash, %lu dropped\n",
+           atomic_load(&sk_psock(a)->redir_msgs),
+           atomic_load(&sk_psock(c)->redir_msgs),
+           atomic_load(&sk_psock(a)->redir_drops) +
+           atomic_load(&sk_psock(c)->redir_drops));
+    
+    sock_map_delete_elem(proxy_bench_map, 0);
+    sock_map_delete_elem(proxy_bench_map, 1);
+    sock_map_delete_elem(proxy_bench_hash, PROXY_BENCH_HASH_KEY_A);
+    sock_map_delete_elem(proxy_bench_hash, PROXY_BENCH_HASH_KEY_B);
+    destroy_socket(a);
+    destroy_socket(b);
+    destroy_socket(c);
+    destroy_socket(d);
+    unregister_bpf_prog(prog);
+    unregister_bpf_prog(hash_prog);
+    sock_map_free(proxy_bench_map);
+    sock_map_free(proxy_bench_hash);
+    free(src);
+    free(dst);
+    return 0;
+}
+
 // Example BPF program
 static int example_filter(void *ctx, void *data, size_t len) {
     // Simple packet inspection
@@ -388,7 +1197,7 @@ static int example_filter(void *ctx, void *data, size_t len) {
 // Server implementation
 static void *server_worker(void *arg) {
     struct sock *listen_sk = (struct sock *)arg;
-    struct sock *client_sk;
+    struct sock *client_sk = NULL;
     char buf[MAX_MSG_SIZE];
     int ret;
     
@@ -431,6 +1240,9 @@ int main(int argc, char **argv) {
     pthread_t worker_thread;
     int ret;
     
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        return tcp_bpf_run_proxy_benchmark();
+    
     // Create listening socket
     listen_sk = create_socket();
     if (!listen_sk) {
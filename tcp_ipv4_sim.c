@@ -6,8 +6,11 @@
  * - Connection establishment (3-way handshake)
  * - Connection state management
  * - Socket operations
+ * - Resizable established hash with lockless (hlist_nulls) lookup
+ * - Listening hash with SO_REUSEPORT groups
  * - Packet handling and routing
  * - MD5 signature support
+ * - Vectorized checksums via the shared csum_sim.h module
  * - Error handling (ICMP)
  */
 
@@ -26,8 +29,14 @@
 #include <time.h>
 #include <signal.h>
 #include <fcntl.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <openssl/md5.h>
 
+#include "csum_sim.h"
+
 /* Constants */
 #define TCP_HEADER_LEN 20
 #define IP_HEADER_LEN 20
@@ -36,24 +45,15 @@
 #define TCP_INIT_WINDOW 65535
 #define TCP_MAX_RETRIES 5
 #define TCP_TIMEOUT_MS 1000
-#define TCP_MAX_SOCKETS 1024
-#define TCP_HASH_SIZE 1024
-#define TCP_TIME_WAIT 60
-
-/* TCP States */
-enum tcp_state {
-    TCP_CLOSED = 0,
-    TCP_LISTEN,
-    TCP_SYN_SENT,
-    TCP_SYN_RECV,
-    TCP_ESTABLISHED,
-    TCP_FIN_WAIT1,
-    TCP_FIN_WAIT2,
-    TCP_CLOSING,
-    TCP_TIME_WAIT,
-    TCP_CLOSE_WAIT,
-    TCP_LAST_ACK
-};
+#define TCP_MAX_SOCKETS (1 << 20)
+#define TCP_HASH_SIZE 1024          /* Initial established hash size */
+#define TCP_EHASH_MAX_SIZE (1 << 21)
+#define TCP_EHASH_LOCKS 1024        /* Bucket lock stripes, <= TCP_HASH_SIZE */
+#define TCP_LHASH_SIZE 32
+#define TCP_REUSEPORT_MAX 256
+#define TCP_TIMEWAIT_LEN 60         /* Seconds */
+
+/* TCP states (TCP_ESTABLISHED ... TCP_CLOSING) come from <netinet/tcp.h> */
 
 /* TCP Flags */
 #define TCP_FLAG_FIN 0x01
@@ -77,7 +77,17 @@ struct tcp_sock {
     uint16_t window;
     uint32_t ts_recent;
     uint32_t ts_recent_stamp;
-    struct tcp_sock *next;
+    
+    /* Established hash linkage, walked by lockless readers */
+    _Atomic(struct tcp_sock *) next;
+    uint32_t hash;
+    atomic_int refcnt;
+    struct tcp_sock *free_next;     /* Sock cache freelist */
+    
+    /* Listening sockets */
+    bool reuseport;
+    struct tcp_sock *parent;        /* Listener that accepted this child (not held) */
+    
     pthread_mutex_t lock;
     
     /* Send/Receive Buffers */
@@ -113,27 +123,83 @@ struct tcp_sock {
     char md5_key[16];
 };
 
-/* Hash Table for Socket Lookup */
-struct tcp_hashbucket {
-    struct tcp_sock *chain;
-    pthread_rwlock_t lock;
+/*
+ * Established hash. Chains are hlist_nulls style: the end of each chain is
+ * a marker encoding the bucket index rather than NULL, so a lockless reader
+ * that was moved onto another chain (socket freed and re-hashed, or table
+ * resized under it) notices and restarts the lookup.
+ */
+struct tcp_ehash_bucket {
+    _Atomic(struct tcp_sock *) chain;
+};
+
+struct tcp_ehash_table {
+    uint32_t mask;
+    struct tcp_ehash_table *retired;    /* Previous tables, see tcp_ehash_grow */
+    struct tcp_ehash_bucket buckets[];
+};
+
+/* Listening hash: one group per bound (addr, port), SO_REUSEPORT members */
+struct sock_reuseport {
+    struct sock_reuseport *next;        /* Immutable once published */
+    uint32_t addr;
+    uint16_t port;
+    bool reuseport;
+    atomic_int num_socks;
+    struct tcp_sock *socks[TCP_REUSEPORT_MAX];
 };
 
+struct tcp_listen_bucket {
+    _Atomic(struct sock_reuseport *) groups;
+    pthread_mutex_t lock;
+};
+
+#define TCP_NULLS_MARKER(v) ((struct tcp_sock *)(((uintptr_t)(v) << 1) | 1UL))
+
+static inline bool is_a_nulls(const struct tcp_sock *sk) {
+    return (uintptr_t)sk & 1UL;
+}
+
+static inline uint32_t get_nulls_value(const struct tcp_sock *sk) {
+    return (uint32_t)((uintptr_t)sk >> 1);
+}
+
 /* Global Variables */
-static struct tcp_hashbucket tcp_hashtable[TCP_HASH_SIZE];
+static _Atomic(struct tcp_ehash_table *) tcp_ehash;
+static pthread_mutex_t tcp_ehash_locks[TCP_EHASH_LOCKS];
+static pthread_mutex_t tcp_ehash_resize_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_uint tcp_ehash_seq;       /* Odd while a resize is running */
+static atomic_int tcp_ehash_count;
+static uint32_t tcp_ehash_secret;
+static struct tcp_listen_bucket tcp_listen_hash[TCP_LHASH_SIZE];
 static pthread_mutex_t tcp_create_lock = PTHREAD_MUTEX_INITIALIZER;
 static int tcp_port_counter = 1024;
 
+/*
+ * Sock cache: memory of freed sockets is recycled but never returned, so a
+ * lockless reader may still dereference a socket it found in the hash
+ * (SLAB_TYPESAFE_BY_RCU semantics). Readers validate with refcnt + keys.
+ */
+static struct tcp_sock *tcp_sock_cache;
+static pthread_mutex_t tcp_sock_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_int tcp_sockets_allocated;
+
 /* Function Declarations */
 static uint32_t tcp_init_sequence(void);
 static void tcp_init_sock(struct tcp_sock *sk);
 static void tcp_destroy_sock(struct tcp_sock *sk);
 static uint16_t tcp_checksum(const void *buff, size_t len);
-static int tcp_hash_function(uint32_t saddr, uint32_t daddr, uint16_t sport, uint16_t dport);
+static uint32_t tcp_hash_function(uint32_t saddr, uint32_t daddr, uint16_t sport, uint16_t dport);
 static struct tcp_sock *tcp_lookup(uint32_t saddr, uint32_t daddr, uint16_t sport, uint16_t dport);
-static void tcp_hash_insert(struct tcp_sock *sk);
-static void tcp_hash_remove(struct tcp_sock *sk);
-static int tcp_process_syn(struct tcp_sock *sk, const struct tcphdr *th);
+static int tcp_hash_insert(struct tcp_sock *sk);
+static bool tcp_hash_remove(struct tcp_sock *sk);
+static void tcp_sock_put(struct tcp_sock *sk);
+static void tcp_listen_stop(struct tcp_sock *sk);
+static struct tcp_sock *tcp_lookup_listener(uint32_t daddr, uint16_t dport, uint32_t hash);
+static struct tcp_sock *tcp_v4_syn_recv_sock(struct tcp_sock *listener, uint32_t saddr,
+                                             uint32_t daddr, uint16_t sport,
+                                             uint16_t dport, uint32_t isn);
+static int tcp_process_syn(struct tcp_sock *sk, const struct iphdr *iph, const struct tcphdr *th);
 static int tcp_process_ack(struct tcp_sock *sk, const struct tcphdr *th);
 static int tcp_send_syn(struct tcp_sock *sk);
 static int tcp_send_ack(struct tcp_sock *sk);
@@ -143,17 +209,33 @@ static void tcp_md5_hash_header(char *hash, const struct tcp_sock *sk, const str
 
 /* Initialize TCP Socket */
 static void tcp_init_sock(struct tcp_sock *sk) {
+    /* Lockless readers may still be walking through a recycled socket */
+    struct tcp_sock *next = atomic_load_explicit(&sk->next, memory_order_relaxed);
+    
     memset(sk, 0, sizeof(*sk));
-    sk->state = TCP_CLOSED;
+    atomic_store_explicit(&sk->next, next, memory_order_relaxed);
+    sk->state = TCP_CLOSE;
     sk->window = TCP_INIT_WINDOW;
     sk->seq = tcp_init_sequence();
     pthread_mutex_init(&sk->lock, NULL);
+}
+
+/* Allocate send/receive buffers on first use (1M idle sockets must fit) */
+static int tcp_sock_alloc_buffers(struct tcp_sock *sk) {
+    if (sk->send_buf)
+        return 0;
     
-    /* Allocate buffers */
     sk->send_buf = malloc(TCP_INIT_WINDOW);
     sk->recv_buf = malloc(TCP_INIT_WINDOW);
+    if (!sk->send_buf || !sk->recv_buf) {
+        free(sk->send_buf);
+        free(sk->recv_buf);
+        sk->send_buf = sk->recv_buf = NULL;
+        return -ENOMEM;
+    }
     sk->send_size = TCP_INIT_WINDOW;
     sk->recv_size = TCP_INIT_WINDOW;
+    return 0;
 }
 
 /* Generate Initial Sequence Number */
@@ -165,78 +247,370 @@ static uint32_t tcp_init_sequence(void) {
 
 /* Calculate TCP Checksum */
 static uint16_t tcp_checksum(const void *buff, size_t len) {
-    const uint16_t *ptr = buff;
-    uint32_t sum = 0;
-    size_t i;
+    return csum_sim_compute(buff, len);
+}
+
+/* Hash Function for Socket Lookup (keyed, so chains cannot be targeted) */
+static uint32_t tcp_hash_function(uint32_t saddr, uint32_t daddr, uint16_t sport, uint16_t dport) {
+    uint32_t h = tcp_ehash_secret;
     
-    for (i = 0; i < len/2; i++)
-        sum += ptr[i];
+    h ^= saddr;
+    h *= 0x9e3779b1;
+    h ^= daddr;
+    h = ((h << 13) | (h >> 19)) * 0x85ebca6b;
+    h ^= ((uint32_t)sport << 16) | dport;
     
-    if (len & 1)
-        sum += ((uint8_t *)buff)[len-1];
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+#define TCP_MATCH(sk, sa, da, sp, dp) \
+    ((sk)->saddr == (sa) && (sk)->daddr == (da) && \
+     (sk)->sport == (sp) && (sk)->dport == (dp))
+
+/* Take a reference unless the socket is already being freed */
+static bool tcp_sock_hold_not_zero(struct tcp_sock *sk) {
+    int ref = atomic_load_explicit(&sk->refcnt, memory_order_relaxed);
     
-    sum = (sum >> 16) + (sum & 0xFFFF);
-    sum += (sum >> 16);
+    do {
+        if (ref == 0)
+            return false;
+    } while (!atomic_compare_exchange_weak_explicit(&sk->refcnt, &ref, ref + 1,
+                                                    memory_order_acquire,
+                                                    memory_order_relaxed));
+    return true;
+}
+
+static struct tcp_ehash_table *tcp_ehash_alloc(uint32_t size) {
+    struct tcp_ehash_table *tbl;
+    uint32_t i;
+    
+    tbl = malloc(sizeof(*tbl) + size * sizeof(tbl->buckets[0]));
+    if (!tbl)
+        return NULL;
+    
+    tbl->mask = size - 1;
+    tbl->retired = NULL;
+    for (i = 0; i < size; i++)
+        atomic_init(&tbl->buckets[i].chain, TCP_NULLS_MARKER(i));
+    return tbl;
+}
+
+static unsigned int tcp_ehash_read_begin(void) {
+    unsigned int seq;
     
-    return ~sum;
+    while ((seq = atomic_load_explicit(&tcp_ehash_seq, memory_order_acquire)) & 1)
+        sched_yield();
+    return seq;
 }
 
-/* Hash Function for Socket Lookup */
-static int tcp_hash_function(uint32_t saddr, uint32_t daddr, uint16_t sport, uint16_t dport) {
-    return (saddr ^ daddr ^ ((uint32_t)sport << 16) ^ dport) & (TCP_HASH_SIZE - 1);
+static bool tcp_ehash_read_retry(unsigned int seq) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&tcp_ehash_seq, memory_order_relaxed) != seq;
 }
 
-/* Socket Lookup */
+/*
+ * Double the established hash. Writers are excluded by taking every bucket
+ * lock; lockless readers are redirected by the resize seqcount. There is no
+ * RCU grace period in userspace, so the old bucket array is parked on the
+ * new table's retired list; sizes double, so this costs at most one extra
+ * table's worth of memory.
+ */
+static void tcp_ehash_grow(struct tcp_ehash_table *old) {
+    struct tcp_ehash_table *tbl;
+    struct tcp_sock *sk, *next;
+    uint32_t i, slot;
+    
+    if (pthread_mutex_trylock(&tcp_ehash_resize_lock))
+        return;     /* Someone else is already growing it */
+    
+    if (atomic_load(&tcp_ehash) != old || old->mask + 1 >= TCP_EHASH_MAX_SIZE)
+        goto out;
+    
+    tbl = tcp_ehash_alloc((old->mask + 1) * 2);
+    if (!tbl)
+        goto out;
+    
+    for (i = 0; i < TCP_EHASH_LOCKS; i++)
+        pthread_mutex_lock(&tcp_ehash_locks[i]);
+    
+    atomic_fetch_add_explicit(&tcp_ehash_seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    
+    for (i = 0; i <= old->mask; i++) {
+        sk = atomic_load_explicit(&old->buckets[i].chain, memory_order_relaxed);
+        while (!is_a_nulls(sk)) {
+            next = atomic_load_explicit(&sk->next, memory_order_relaxed);
+            slot = sk->hash & tbl->mask;
+            atomic_store_explicit(&sk->next,
+                                  atomic_load_explicit(&tbl->buckets[slot].chain,
+                                                       memory_order_relaxed),
+                                  memory_order_relaxed);
+            atomic_store_explicit(&tbl->buckets[slot].chain, sk,
+                                  memory_order_relaxed);
+            sk = next;
+        }
+    }
+    
+    tbl->retired = old;
+    atomic_store_explicit(&tcp_ehash, tbl, memory_order_release);
+    atomic_fetch_add_explicit(&tcp_ehash_seq, 1, memory_order_release);
+    
+    for (i = 0; i < TCP_EHASH_LOCKS; i++)
+        pthread_mutex_unlock(&tcp_ehash_locks[i]);
+out:
+    pthread_mutex_unlock(&tcp_ehash_resize_lock);
+}
+
+/* Socket Lookup: lockless, returns a referenced socket or NULL */
 static struct tcp_sock *tcp_lookup(uint32_t saddr, uint32_t daddr, uint16_t sport, uint16_t dport) {
-    int hash = tcp_hash_function(saddr, daddr, sport, dport);
+    uint32_t hash = tcp_hash_function(saddr, daddr, sport, dport);
+    struct tcp_ehash_table *tbl;
     struct tcp_sock *sk;
+    unsigned int seq;
+    uint32_t slot;
+    
+begin:
+    seq = tcp_ehash_read_begin();
+    tbl = atomic_load_explicit(&tcp_ehash, memory_order_acquire);
+    slot = hash & tbl->mask;
+    
+    for (sk = atomic_load_explicit(&tbl->buckets[slot].chain, memory_order_acquire);
+         !is_a_nulls(sk);
+         sk = atomic_load_explicit(&sk->next, memory_order_acquire)) {
+        if (sk->hash != hash || !TCP_MATCH(sk, saddr, daddr, sport, dport))
+            continue;
+        if (!tcp_sock_hold_not_zero(sk))
+            goto begin;
+        /* The socket may have been freed and reused for another flow */
+        if (!TCP_MATCH(sk, saddr, daddr, sport, dport)) {
+            tcp_sock_put(sk);
+            goto begin;
+        }
+        return sk;
+    }
+    
+    /* Ended on another bucket's chain, or raced with a resize */
+    if (get_nulls_value(sk) != slot || tcp_ehash_read_retry(seq))
+        goto begin;
+    
+    return NULL;
+}
+
+/*
+ * Insert Socket into Hash Table unless its 4-tuple is already there, in
+ * which case -EEXIST. The caller holds a reference; on success the table
+ * takes one more.
+ */
+static int tcp_hash_insert(struct tcp_sock *sk) {
+    struct tcp_ehash_table *tbl;
+    struct tcp_sock *cur;
+    pthread_mutex_t *lock;
+    uint32_t slot;
+    
+    sk->hash = tcp_hash_function(sk->saddr, sk->daddr, sk->sport, sk->dport);
+    
+    lock = &tcp_ehash_locks[sk->hash & (TCP_EHASH_LOCKS - 1)];
+    pthread_mutex_lock(lock);
+    tbl = atomic_load_explicit(&tcp_ehash, memory_order_relaxed);
+    slot = sk->hash & tbl->mask;
+    
+    /* Writers of this slot are excluded, so the recheck is exact */
+    for (cur = atomic_load_explicit(&tbl->buckets[slot].chain, memory_order_relaxed);
+         !is_a_nulls(cur);
+         cur = atomic_load_explicit(&cur->next, memory_order_relaxed)) {
+        if (cur->hash == sk->hash &&
+            TCP_MATCH(cur, sk->saddr, sk->daddr, sk->sport, sk->dport)) {
+            pthread_mutex_unlock(lock);
+            return -EEXIST;
+        }
+    }
+    
+    atomic_fetch_add_explicit(&sk->refcnt, 1, memory_order_release);
+    atomic_store_explicit(&sk->next,
+                          atomic_load_explicit(&tbl->buckets[slot].chain,
+                                               memory_order_relaxed),
+                          memory_order_relaxed);
+    atomic_store_explicit(&tbl->buckets[slot].chain, sk, memory_order_release);
+    pthread_mutex_unlock(lock);
+    
+    /* Keep the load factor at or below one */
+    if (atomic_fetch_add(&tcp_ehash_count, 1) + 1 > (int)tbl->mask + 1)
+        tcp_ehash_grow(tbl);
+    return 0;
+}
+
+/* Remove Socket from Hash Table; returns false if it was not hashed */
+static bool tcp_hash_remove(struct tcp_sock *sk) {
+    _Atomic(struct tcp_sock *) *pprev;
+    struct tcp_ehash_table *tbl;
+    struct tcp_sock *cur;
+    pthread_mutex_t *lock;
+    bool found = false;
     
-    pthread_rwlock_rdlock(&tcp_hashtable[hash].lock);
-    for (sk = tcp_hashtable[hash].chain; sk; sk = sk->next) {
-        if (sk->saddr == saddr && sk->daddr == daddr &&
-            sk->sport == sport && sk->dport == dport)
+    lock = &tcp_ehash_locks[sk->hash & (TCP_EHASH_LOCKS - 1)];
+    pthread_mutex_lock(lock);
+    tbl = atomic_load_explicit(&tcp_ehash, memory_order_relaxed);
+    pprev = &tbl->buckets[sk->hash & tbl->mask].chain;
+    for (cur = atomic_load_explicit(pprev, memory_order_relaxed); !is_a_nulls(cur);
+         pprev = &cur->next, cur = atomic_load_explicit(pprev, memory_order_relaxed)) {
+        if (cur == sk) {
+            /* sk->next is left intact for readers currently on sk */
+            atomic_store_explicit(pprev,
+                                  atomic_load_explicit(&sk->next, memory_order_relaxed),
+                                  memory_order_release);
+            found = true;
             break;
+        }
     }
-    pthread_rwlock_unlock(&tcp_hashtable[hash].lock);
+    pthread_mutex_unlock(lock);
     
-    return sk;
+    if (found)
+        atomic_fetch_sub(&tcp_ehash_count, 1);
+    return found;
 }
 
-/* Insert Socket into Hash Table */
-static void tcp_hash_insert(struct tcp_sock *sk) {
-    int hash = tcp_hash_function(sk->saddr, sk->daddr, sk->sport, sk->dport);
+/*
+ * Bind a listener; members of an SO_REUSEPORT group share one entry. The
+ * listening hash holds the socket's first reference, dropped on destroy.
+ */
+static int tcp_listen_start(struct tcp_sock *sk) {
+    struct tcp_listen_bucket *lb = &tcp_listen_hash[sk->sport & (TCP_LHASH_SIZE - 1)];
+    struct sock_reuseport *grp, *spare = NULL;
+    int n, ret = 0;
+    
+    pthread_mutex_lock(&lb->lock);
+    for (grp = atomic_load(&lb->groups); grp; grp = grp->next) {
+        n = atomic_load(&grp->num_socks);
+        if (!n && !spare)
+            spare = grp;
+        if (n && grp->addr == sk->saddr && grp->port == sk->sport)
+            break;
+    }
     
-    pthread_rwlock_wrlock(&tcp_hashtable[hash].lock);
-    sk->next = tcp_hashtable[hash].chain;
-    tcp_hashtable[hash].chain = sk;
-    pthread_rwlock_unlock(&tcp_hashtable[hash].lock);
+    if (grp) {
+        n = atomic_load(&grp->num_socks);
+        if (!grp->reuseport || !sk->reuseport || n >= TCP_REUSEPORT_MAX) {
+            ret = -EADDRINUSE;
+            goto out;
+        }
+        atomic_store_explicit(&sk->refcnt, 1, memory_order_relaxed);
+        grp->socks[n] = sk;
+        atomic_store_explicit(&grp->num_socks, n + 1, memory_order_release);
+        goto listening;
+    }
+    
+    /* Emptied groups stay published (readers may hold them) and are reused */
+    grp = spare;
+    if (!grp) {
+        grp = calloc(1, sizeof(*grp));
+        if (!grp) {
+            ret = -ENOMEM;
+            goto out;
+        }
+    }
+    grp->addr = sk->saddr;
+    grp->port = sk->sport;
+    grp->reuseport = sk->reuseport;
+    atomic_store_explicit(&sk->refcnt, 1, memory_order_relaxed);
+    grp->socks[0] = sk;
+    if (grp == spare) {
+        atomic_store_explicit(&grp->num_socks, 1, memory_order_release);
+    } else {
+        atomic_init(&grp->num_socks, 1);
+        grp->next = atomic_load_explicit(&lb->groups, memory_order_relaxed);
+        atomic_store_explicit(&lb->groups, grp, memory_order_release);
+    }
+    
+listening:
+    sk->state = TCP_LISTEN;
+out:
+    pthread_mutex_unlock(&lb->lock);
+    return ret;
 }
 
-/* Remove Socket from Hash Table */
-static void tcp_hash_remove(struct tcp_sock *sk) {
-    int hash = tcp_hash_function(sk->saddr, sk->daddr, sk->sport, sk->dport);
-    struct tcp_sock **psk;
+/* Unbind a listener */
+static void tcp_listen_stop(struct tcp_sock *sk) {
+    struct tcp_listen_bucket *lb = &tcp_listen_hash[sk->sport & (TCP_LHASH_SIZE - 1)];
+    struct sock_reuseport *grp;
+    int i, n;
     
-    pthread_rwlock_wrlock(&tcp_hashtable[hash].lock);
-    for (psk = &tcp_hashtable[hash].chain; *psk; psk = &(*psk)->next) {
-        if (*psk == sk) {
-            *psk = sk->next;
+    pthread_mutex_lock(&lb->lock);
+    for (grp = atomic_load(&lb->groups); grp; grp = grp->next) {
+        n = atomic_load(&grp->num_socks);
+        for (i = 0; i < n; i++) {
+            if (grp->socks[i] != sk)
+                continue;
+            grp->socks[i] = grp->socks[n - 1];
+            atomic_store_explicit(&grp->num_socks, n - 1, memory_order_release);
+            goto out;
+        }
+    }
+out:
+    pthread_mutex_unlock(&lb->lock);
+    sk->state = TCP_CLOSE;
+}
+
+/*
+ * Listener lookup: an exact address match beats INADDR_ANY, and within a
+ * reuseport group the flow hash picks the member in O(1), spreading SYNs
+ * across listeners. Returns a referenced listener or NULL, like tcp_lookup.
+ */
+static struct tcp_sock *tcp_lookup_listener(uint32_t daddr, uint16_t dport, uint32_t hash) {
+    struct tcp_listen_bucket *lb = &tcp_listen_hash[dport & (TCP_LHASH_SIZE - 1)];
+    struct sock_reuseport *grp, *best;
+    struct tcp_sock *sk;
+    int n, cnt;
+    
+begin:
+    best = NULL;
+    n = 0;
+    for (grp = atomic_load_explicit(&lb->groups, memory_order_acquire); grp; grp = grp->next) {
+        cnt = atomic_load_explicit(&grp->num_socks, memory_order_acquire);
+        if (!cnt || grp->port != dport)
+            continue;
+        if (grp->addr == daddr) {
+            best = grp;
+            n = cnt;
             break;
         }
+        if (grp->addr == htonl(INADDR_ANY) && !best) {
+            best = grp;
+            n = cnt;
+        }
+    }
+    
+    if (!best)
+        return NULL;
+    
+    sk = best->socks[((uint64_t)hash * n) >> 32];
+    if (!tcp_sock_hold_not_zero(sk))
+        goto begin;
+    /* Closed, or freed and reused, since we read the group */
+    if (sk->state != TCP_LISTEN || sk->sport != dport || sk->saddr != best->addr) {
+        tcp_sock_put(sk);
+        goto begin;
     }
-    pthread_rwlock_unlock(&tcp_hashtable[hash].lock);
+    return sk;
 }
 
-/* Process Incoming SYN Packet */
-static int tcp_process_syn(struct tcp_sock *sk, const struct tcphdr *th) {
+/* Process Incoming SYN Packet: the listener opens a SYN_RECV child */
+static int tcp_process_syn(struct tcp_sock *sk, const struct iphdr *iph, const struct tcphdr *th) {
+    struct tcp_sock *child;
+    
     if (sk->state != TCP_LISTEN)
         return -1;
     
-    sk->daddr = ntohl(th->source);
-    sk->ack_seq = ntohl(th->seq) + 1;
-    sk->state = TCP_SYN_RECV;
-    
-    return tcp_send_syn(sk);
+    child = tcp_v4_syn_recv_sock(sk, iph->saddr, iph->daddr, ntohs(th->source),
+                                 ntohs(th->dest), ntohl(th->seq));
+    if (!child)
+        return -1;
+    tcp_sock_put(child);
+    return 0;
 }
 
 /* Process Incoming ACK Packet */
@@ -271,7 +645,7 @@ static int tcp_process_ack(struct tcp_sock *sk, const struct tcphdr *th) {
             break;
             
         case TCP_LAST_ACK:
-            sk->state = TCP_CLOSED;
+            sk->state = TCP_CLOSE;
             tcp_destroy_sock(sk);
             break;
     }
@@ -392,32 +766,85 @@ static void tcp_md5_hash_header(char *hash, const struct tcp_sock *sk, const str
     MD5_Final((unsigned char *)hash, &ctx);
 }
 
-/* Socket Destruction */
-static void tcp_destroy_sock(struct tcp_sock *sk) {
-    tcp_hash_remove(sk);
-    
+/* Return a socket to the sock cache */
+static void tcp_sock_free(struct tcp_sock *sk) {
     pthread_mutex_destroy(&sk->lock);
     free(sk->send_buf);
     free(sk->recv_buf);
-    free(sk);
+    sk->send_buf = sk->recv_buf = NULL;
+    
+    pthread_mutex_lock(&tcp_sock_cache_lock);
+    sk->free_next = tcp_sock_cache;
+    tcp_sock_cache = sk;
+    pthread_mutex_unlock(&tcp_sock_cache_lock);
+    atomic_fetch_sub(&tcp_sockets_allocated, 1);
 }
 
-/* Main TCP Processing Function */
+/* Drop a reference taken by a lookup or owned by a hash */
+static void tcp_sock_put(struct tcp_sock *sk) {
+    if (atomic_fetch_sub_explicit(&sk->refcnt, 1, memory_order_acq_rel) == 1)
+        tcp_sock_free(sk);
+}
+
+/*
+ * Socket Destruction: unhash and drop the hash's reference. Callers may
+ * still hold their own (and the socket lock); the last tcp_sock_put frees
+ * it. A socket someone else already unhashed is left alone.
+ */
+static void tcp_destroy_sock(struct tcp_sock *sk) {
+    if (sk->state == TCP_LISTEN) {
+        /* In-flight SYNs may still hold the listener */
+        tcp_listen_stop(sk);
+        tcp_sock_put(sk);
+    } else if (tcp_hash_remove(sk)) {
+        tcp_sock_put(sk);
+    }
+}
+
+/*
+ * Rewrite a segment's destination (DNAT-style), patching the IP and TCP
+ * checksums incrementally rather than re-summing the payload. daddr is in
+ * network order and dport in host order, like the socket keys.
+ */
+static void tcp_v4_rewrite_dst(struct iphdr *iph, struct tcphdr *th,
+                               uint32_t daddr, uint16_t dport) {
+    csum_sim_replace4(&iph->check, iph->daddr, daddr);
+    csum_sim_replace4(&th->check, iph->daddr, daddr);  /* Pseudo-header */
+    csum_sim_replace2(&th->check, th->dest, htons(dport));
+    iph->daddr = daddr;
+    th->dest = htons(dport);
+}
+
+/*
+ * Main TCP Processing Function: each segment is demultiplexed to its
+ * established socket, or for a SYN to a listener, and the socket is put
+ * once the segment has been handled.
+ */
 static void *tcp_process_packet(void *arg) {
-    struct tcp_sock *sk = arg;
+    struct tcp_sock *sk;
+    uint16_t sport, dport;
     char packet[MAX_PACKET_SIZE];
     struct iphdr *iph;
     struct tcphdr *th;
     ssize_t len;
-    int ret;
+    int ret, fd;
+    
+    (void)arg;
+    
+    /* Raw TCP socket: every segment arrives with its IP header */
+    fd = socket(AF_INET, SOCK_RAW, IPPROTO_TCP);
+    if (fd < 0) {
+        perror("raw socket");
+        return NULL;
+    }
     
     while (1) {
-        /* Receive packet (simulated) */
-        len = /* receive packet */;
+        /* Receive packet */
+        len = recv(fd, packet, sizeof(packet), 0);
         if (len < 0)
             continue;
             
-        if (len < sizeof(*iph) + sizeof(*th))
+        if ((size_t)len < sizeof(*iph) + sizeof(*th))
             continue;
             
         iph = (struct iphdr *)packet;
@@ -426,6 +853,17 @@ static void *tcp_process_packet(void *arg) {
         /* Verify checksum */
         if (tcp_checksum(th, len - sizeof(*iph)) != 0)
             continue;
+        
+        /* Demultiplex: the established hash first, then listeners for a SYN */
+        sport = ntohs(th->source);
+        dport = ntohs(th->dest);
+        sk = tcp_lookup(iph->daddr, iph->saddr, dport, sport);
+        if (!sk && th->syn && !th->ack)
+            sk = tcp_lookup_listener(iph->daddr, dport,
+                                     tcp_hash_function(iph->daddr, iph->saddr,
+                                                       dport, sport));
+        if (!sk)
+            continue;
             
         pthread_mutex_lock(&sk->lock);
         
@@ -433,7 +871,7 @@ static void *tcp_process_packet(void *arg) {
         switch (sk->state) {
             case TCP_LISTEN:
                 if (th->syn)
-                    ret = tcp_process_syn(sk, th);
+                    ret = tcp_process_syn(sk, iph, th);
                 break;
                 
             case TCP_SYN_SENT:
@@ -441,7 +879,14 @@ static void *tcp_process_packet(void *arg) {
                     ret = tcp_process_ack(sk, th);
                 break;
                 
+            case TCP_SYN_RECV:
+                if (th->ack)
+                    ret = tcp_process_ack(sk, th);
+                break;
+                
             case TCP_ESTABLISHED:
+                if (tcp_sock_alloc_buffers(sk) < 0)
+                    break;
                 if (th->fin) {
                     sk->state = TCP_CLOSE_WAIT;
                     sk->ack_seq++;
@@ -482,6 +927,7 @@ static void *tcp_process_packet(void *arg) {
         /* Update statistics */
         sk->stats.packets_in++;
         sk->stats.bytes_in += len;
+        tcp_sock_put(sk);
     }
     
     return NULL;
@@ -489,12 +935,24 @@ static void *tcp_process_packet(void *arg) {
 
 /* Initialize TCP Subsystem */
 int tcp_init(void) {
+    struct tcp_ehash_table *tbl;
     int i;
     
-    /* Initialize hash table */
-    for (i = 0; i < TCP_HASH_SIZE; i++) {
-        tcp_hashtable[i].chain = NULL;
-        pthread_rwlock_init(&tcp_hashtable[i].lock, NULL);
+    tcp_ehash_secret = tcp_init_sequence() ^ ((uint32_t)getpid() << 16);
+    
+    /* Initialize hash tables */
+    tbl = tcp_ehash_alloc(TCP_HASH_SIZE);
+    if (!tbl)
+        return -ENOMEM;
+    atomic_store(&tcp_ehash, tbl);
+    atomic_store(&tcp_ehash_count, 0);
+    
+    for (i = 0; i < TCP_EHASH_LOCKS; i++)
+        pthread_mutex_init(&tcp_ehash_locks[i], NULL);
+    
+    for (i = 0; i < TCP_LHASH_SIZE; i++) {
+        atomic_init(&tcp_listen_hash[i].groups, NULL);
+        pthread_mutex_init(&tcp_listen_hash[i].lock, NULL);
     }
     
     return 0;
@@ -502,19 +960,445 @@ int tcp_init(void) {
 
 /* Create TCP Socket */
 struct tcp_sock *tcp_create_sock(void) {
-    struct tcp_sock *sk = malloc(sizeof(*struct tcp_sock));
-    if (!sk)
+    struct tcp_sock *sk;
+    
+    if (atomic_fetch_add(&tcp_sockets_allocated, 1) >= TCP_MAX_SOCKETS) {
+        atomic_fetch_sub(&tcp_sockets_allocated, 1);
         return NULL;
-        
+    }
+    
+    pthread_mutex_lock(&tcp_sock_cache_lock);
+    sk = tcp_sock_cache;
+    if (sk)
+        tcp_sock_cache = sk->free_next;
+    pthread_mutex_unlock(&tcp_sock_cache_lock);
+    
+    if (!sk) {
+        sk = calloc(1, sizeof(*sk));
+        if (!sk) {
+            atomic_fetch_sub(&tcp_sockets_allocated, 1);
+            return NULL;
+        }
+    }
+    
     tcp_init_sock(sk);
     return sk;
 }
 
+/*
+ * Open the SYN_RECV child for a SYN that reached listener, and put it in
+ * the established hash so the final ACK finds it with a single lookup.
+ * The caller holds a reference on listener. Returns the child referenced
+ * for the caller; drop it with tcp_sock_put.
+ */
+static struct tcp_sock *tcp_v4_syn_recv_sock(struct tcp_sock *listener, uint32_t saddr,
+                                             uint32_t daddr, uint16_t sport,
+                                             uint16_t dport, uint32_t isn) {
+    struct tcp_sock *child;
+    
+    child = tcp_create_sock();
+    if (!child)
+        return NULL;
+    
+    child->saddr = daddr;
+    child->daddr = saddr;
+    child->sport = dport;
+    child->dport = sport;
+    child->ack_seq = isn + 1;
+    child->state = TCP_SYN_RECV;
+    child->parent = listener;
+    tcp_send_syn(child);
+    
+    /* The caller's reference; the hash takes its own on insert */
+    atomic_store_explicit(&child->refcnt, 1, memory_order_relaxed);
+    if (tcp_hash_insert(child) < 0) {
+        /* A concurrent SYN for the same 4-tuple got there first */
+        tcp_sock_put(child);
+        return NULL;
+    }
+    return child;
+}
+
+/* Passive open: pick a listener for the SYN and open the child off it */
+static struct tcp_sock *tcp_v4_conn_request(uint32_t saddr, uint32_t daddr,
+                                            uint16_t sport, uint16_t dport,
+                                            uint32_t isn) {
+    struct tcp_sock *listener, *child;
+    uint32_t hash;
+    
+    /* Retransmitted SYN for a connection we already know */
+    child = tcp_lookup(daddr, saddr, dport, sport);
+    if (child) {
+        tcp_sock_put(child);
+        return NULL;
+    }
+    
+    hash = tcp_hash_function(daddr, saddr, dport, sport);
+    listener = tcp_lookup_listener(daddr, dport, hash);
+    if (!listener)
+        return NULL;
+    
+    child = tcp_v4_syn_recv_sock(listener, saddr, daddr, sport, dport, isn);
+    tcp_sock_put(listener);
+    return child;
+}
+
+/* Final ACK of the handshake */
+static int tcp_v4_rcv_ack(uint32_t saddr, uint32_t daddr, uint16_t sport,
+                          uint16_t dport, uint32_t ack) {
+    struct tcp_sock *sk;
+    struct tcphdr th;
+    int established;
+    
+    sk = tcp_lookup(daddr, saddr, dport, sport);
+    if (!sk)
+        return -ENOENT;
+    
+    memset(&th, 0, sizeof(th));
+    th.ack = 1;
+    th.ack_seq = htonl(ack);
+    
+    pthread_mutex_lock(&sk->lock);
+    tcp_process_ack(sk, &th);
+    established = sk->state == TCP_ESTABLISHED;
+    pthread_mutex_unlock(&sk->lock);
+    
+    tcp_sock_put(sk);
+    return established ? 0 : -EINVAL;
+}
+
+/* Free every established socket and shrink the hash back to its initial size */
+static void tcp_ehash_reset(void) {
+    struct tcp_ehash_table *tbl = atomic_load(&tcp_ehash), *old;
+    struct tcp_sock *sk, *next;
+    uint32_t i;
+    
+    for (i = 0; i <= tbl->mask; i++) {
+        sk = atomic_load(&tbl->buckets[i].chain);
+        while (!is_a_nulls(sk)) {
+            next = atomic_load(&sk->next);
+            tcp_sock_put(sk);
+            sk = next;
+        }
+    }
+    
+    while (tbl) {
+        old = tbl->retired;
+        free(tbl);
+        tbl = old;
+    }
+    atomic_store(&tcp_ehash, tcp_ehash_alloc(TCP_HASH_SIZE));
+    atomic_store(&tcp_ehash_count, 0);
+}
+
+/* Connection-rate benchmark */
+#define TCP_BENCH_CONNS 1000000
+#define TCP_BENCH_LISTENERS 8
+#define TCP_BENCH_PORT 80
+
+struct tcp_bench_worker {
+    pthread_t thread;
+    uint32_t first;
+    uint32_t count;
+    uint32_t established;
+};
+
+static struct tcp_sock *tcp_bench_listeners[TCP_BENCH_LISTENERS];
+
+static void *tcp_bench_thread(void *arg) {
+    struct tcp_bench_worker *w = arg;
+    uint32_t laddr = inet_addr("192.168.1.1");
+    uint32_t i, n, raddr;
+    uint16_t rport;
+    struct tcp_sock *child;
+    
+    for (i = 0; i < w->count; i++) {
+        n = w->first + i;
+        raddr = htonl(0x0a000000 | (n >> 14));
+        rport = 1024 + (n & 0x3fff);
+        
+        child = tcp_v4_conn_request(raddr, laddr, rport, TCP_BENCH_PORT, n);
+        if (!child)
+            continue;
+        if (tcp_v4_rcv_ack(raddr, laddr, rport, TCP_BENCH_PORT, child->seq + 1) == 0)
+            w->established++;
+        tcp_sock_put(child);
+    }
+    return NULL;
+}
+
+static int tcp_run_conn_benchmark(void) {
+    static const int thread_counts[] = { 1, 2, 4, 8 };
+    struct tcp_bench_worker workers[8];
+    struct timespec t0, t1;
+    uint32_t per_listener[TCP_BENCH_LISTENERS];
+    uint32_t total, lo, hi;
+    struct tcp_ehash_table *tbl;
+    struct tcp_sock *sk;
+    size_t t;
+    int i, nthreads;
+    double secs;
+    
+    if (tcp_init() < 0)
+        return 1;
+    
+    for (i = 0; i < TCP_BENCH_LISTENERS; i++) {
+        sk = tcp_create_sock();
+        sk->saddr = htonl(INADDR_ANY);
+        sk->sport = TCP_BENCH_PORT;
+        sk->reuseport = true;
+        if (tcp_listen_start(sk) < 0) {
+            fprintf(stderr, "listen failed\n");
+            return 1;
+        }
+        tcp_bench_listeners[i] = sk;
+    }
+    
+    printf("SYN->ESTABLISHED, %d connections, %d reuseport listeners\n",
+           TCP_BENCH_CONNS, TCP_BENCH_LISTENERS);
+    
+    for (t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        nthreads = thread_counts[t];
+        
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (i = 0; i < nthreads; i++) {
+            workers[i].count = TCP_BENCH_CONNS / nthreads;
+            workers[i].first = i * workers[i].count;
+            workers[i].established = 0;
+            pthread_create(&workers[i].thread, NULL, tcp_bench_thread, &workers[i]);
+        }
+        total = 0;
+        for (i = 0; i < nthreads; i++) {
+            pthread_join(workers[i].thread, NULL);
+            total += workers[i].established;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        
+        /* Verify lookups still hit after all the resizes */
+        memset(per_listener, 0, sizeof(per_listener));
+        tbl = atomic_load(&tcp_ehash);
+        for (i = 0; i <= (int)tbl->mask; i++) {
+            for (sk = atomic_load(&tbl->buckets[i].chain); !is_a_nulls(sk);
+                 sk = atomic_load(&sk->next)) {
+                int l;
+                for (l = 0; l < TCP_BENCH_LISTENERS; l++)
+                    if (sk->parent == tcp_bench_listeners[l])
+                        per_listener[l]++;
+            }
+        }
+        lo = hi = per_listener[0];
+        for (i = 1; i < TCP_BENCH_LISTENERS; i++) {
+            if (per_listener[i] < lo)
+                lo = per_listener[i];
+            if (per_listener[i] > hi)
+                hi = per_listener[i];
+        }
+        
+        printf("  threads=%d established=%u %.0f conn/s buckets=%u "
+               "per-listener min=%u max=%u\n",
+               nthreads, total, total / secs, tbl->mask + 1, lo, hi);
+        
+        tcp_ehash_reset();
+    }
+    
+    for (i = 0; i < TCP_BENCH_LISTENERS; i++)
+        tcp_destroy_sock(tcp_bench_listeners[i]);
+    return 0;
+}
+
+/* Checksum benchmark */
+#define CSUM_BENCH_BYTES (256UL << 20)  /* Bytes checksummed per measurement */
+
+/* The scalar 16-bit loop tcp_checksum used before csum_sim.h */
+static csum_sim_t csum_bench_ref16(const void *buff, size_t len, csum_sim_t sum) {
+    const uint16_t *ptr = buff;
+    uint64_t acc = sum;
+    size_t i;
+    
+    for (i = 0; i < len/2; i++)
+        acc += ptr[i];
+    if (len & 1)
+        acc += ((const uint8_t *)buff)[len-1];
+    return csum_sim_fold64(acc);
+}
+
+static double csum_bench_gbps(csum_sim_fn fn, csum_sim_copy_fn copy_fn,
+                              unsigned char *dst, const unsigned char *src,
+                              size_t len) {
+    struct timespec t0, t1;
+    size_t iters = CSUM_BENCH_BYTES / len, i;
+    volatile csum_sim_t sink = 0;
+    double secs;
+    
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < iters; i++) {
+        if (copy_fn)
+            sink += copy_fn(dst, src, len, 0);
+        else
+            sink += fn(src, len, 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    (void)sink;
+    return (double)iters * len / secs / 1e9;
+}
+
+/* Full TCP checksum over pseudo-header and segment, check field taken as 0 */
+static uint16_t csum_bench_tcp_full(const struct iphdr *iph, struct tcphdr *th,
+                                    size_t len) {
+    uint16_t check = th->check, full;
+    
+    th->check = 0;
+    full = csum_sim_fold(csum_sim_partial(th, len,
+                                          csum_sim_tcpudp_nofold(iph->saddr, iph->daddr,
+                                                                 len, IPPROTO_TCP, 0)));
+    th->check = check;
+    return full;
+}
+
+/*
+ * Destination rewrites on a 1500-byte segment: every incremental update
+ * must match a full recompute, then time both.
+ */
+static int csum_bench_rewrite(const unsigned char *src) {
+    enum { PKT_LEN = 1500, ROUNDS = 1000000 };
+    unsigned char pkt[PKT_LEN];
+    struct iphdr *iph = (struct iphdr *)pkt;
+    struct tcphdr *th = (struct tcphdr *)(pkt + sizeof(*iph));
+    size_t len = PKT_LEN - sizeof(*iph);
+    struct timespec t0, t1;
+    volatile uint16_t sink = 0;
+    double inc_ns, full_ns;
+    int i;
+    
+    memcpy(pkt, src, PKT_LEN);
+    memset(iph, 0, sizeof(*iph));
+    iph->version = 4;
+    iph->ihl = 5;
+    iph->tot_len = htons(PKT_LEN);
+    iph->protocol = IPPROTO_TCP;
+    iph->saddr = inet_addr("10.0.0.1");
+    iph->daddr = inet_addr("192.168.1.1");
+    iph->check = csum_sim_compute(iph, sizeof(*iph));
+    th->check = csum_bench_tcp_full(iph, th, len);
+    
+    for (i = 0; i < ROUNDS / 10; i++) {
+        uint16_t ip_check;
+        
+        tcp_v4_rewrite_dst(iph, th, (uint32_t)rand(), (uint16_t)rand());
+        ip_check = iph->check;
+        iph->check = 0;
+        if (csum_sim_compute(iph, sizeof(*iph)) != ip_check ||
+            csum_bench_tcp_full(iph, th, len) != th->check) {
+            fprintf(stderr, "rewrite: incremental checksum differs from recompute\n");
+            return 1;
+        }
+        iph->check = ip_check;
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < ROUNDS; i++)
+        tcp_v4_rewrite_dst(iph, th, iph->daddr + 1, i);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    inc_ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / ROUNDS;
+    
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < ROUNDS; i++) {
+        iph->daddr++;
+        th->dest = htons(i);
+        iph->check = 0;
+        iph->check = csum_sim_compute(iph, sizeof(*iph));
+        th->check = csum_bench_tcp_full(iph, th, len);
+        sink += th->check;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    full_ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / ROUNDS;
+    (void)sink;
+    
+    printf("dst rewrite, %d bytes: incremental %.1f ns, recompute %.1f ns\n",
+           PKT_LEN, inc_ns, full_ns);
+    return 0;
+}
+
+static int tcp_run_csum_benchmark(void) {
+    static const size_t sizes[] = { 64, 256, 1500, 4096, 16384, 65536 };
+    unsigned char *src, *dst;
+    size_t s, k, i;
+    uint16_t want;
+    int ret;
+    
+    src = malloc(65536);
+    dst = malloc(65536);
+    if (!src || !dst)
+        return 1;
+    for (i = 0; i < 65536; i++)
+        src[i] = rand();
+    
+    printf("checksum GB/s (dispatch picks %s)\n", csum_sim_resolve()->name);
+    printf("%8s %8s", "bytes", "ref16");
+    for (k = 0; k < CSUM_SIM_NR_KERNELS; k++)
+        if (csum_sim_kernels[k].supported())
+            printf(" %8s %8s", csum_sim_kernels[k].name, "+copy");
+    printf(" %8s\n", "cpy+sum");
+    
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        want = csum_sim_fold(csum_bench_ref16(src, sizes[s], 0));
+        printf("%8zu %8.2f", sizes[s],
+               csum_bench_gbps(csum_bench_ref16, NULL, dst, src, sizes[s]));
+        
+        for (k = 0; k < CSUM_SIM_NR_KERNELS; k++) {
+            const struct csum_sim_kernel *kern = &csum_sim_kernels[k];
+            
+            if (!kern->supported())
+                continue;
+            if (csum_sim_fold(kern->partial(src, sizes[s], 0)) != want ||
+                csum_sim_fold(kern->partial_copy(dst, src, sizes[s], 0)) != want ||
+                memcmp(dst, src, sizes[s])) {
+                fprintf(stderr, "%s: wrong checksum at %zu bytes\n",
+                        kern->name, sizes[s]);
+                return 1;
+            }
+            printf(" %8.2f %8.2f",
+                   csum_bench_gbps(kern->partial, NULL, dst, src, sizes[s]),
+                   csum_bench_gbps(NULL, kern->partial_copy, dst, src, sizes[s]));
+        }
+        
+        /* Two passes, as a send path without copy-and-checksum does */
+        {
+            struct timespec t0, t1;
+            size_t iters = CSUM_BENCH_BYTES / sizes[s];
+            volatile csum_sim_t sink = 0;
+            double secs;
+            
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            for (i = 0; i < iters; i++) {
+                memcpy(dst, src, sizes[s]);
+                sink += csum_sim_partial(dst, sizes[s], 0);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+            (void)sink;
+            printf(" %8.2f\n", (double)iters * sizes[s] / secs / 1e9);
+        }
+    }
+    
+    ret = csum_bench_rewrite(src);
+    free(src);
+    free(dst);
+    return ret;
+}
+
 /* Main Function - Example Usage */
 int main(int argc, char *argv[]) {
     struct tcp_sock *sk;
     pthread_t thread;
     
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        return tcp_run_conn_benchmark();
+    if (argc > 1 && strcmp(argv[1], "--csum-bench") == 0)
+        return tcp_run_csum_benchmark();
+    
     /* Initialize TCP subsystem */
     if (tcp_init() < 0) {
         fprintf(stderr, "Failed to initialize TCP\n");
@@ -531,13 +1415,15 @@ int main(int argc, char *argv[]) {
     /* Set up socket */
     sk->saddr = inet_addr("192.168.1.1");
     sk->sport = 12345;
-    sk->state = TCP_LISTEN;
     
-    /* Insert into hash table */
-    tcp_hash_insert(sk);
+    /* Insert into listening hash */
+    if (tcp_listen_start(sk) < 0) {
+        fprintf(stderr, "Failed to listen\n");
+        return 1;
+    }
     
-    /* Create processing thread */
-    pthread_create(&thread, NULL, tcp_process_packet, sk);
+    /* Create processing thread; it demultiplexes every segment itself */
+    pthread_create(&thread, NULL, tcp_process_packet, NULL);
     
     /* Wait for thread */
     pthread_join(thread, NULL);
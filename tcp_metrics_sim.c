@@ -7,6 +7,11 @@
  * - Congestion window tracking
  * - TCP Fast Open support
  * - Metrics persistence and aging
+ * - Lockless lookups: readers walk nulls-terminated chains and read each
+ *   block under its seqcount; only writers take locks
+ * - Keyed SipHash bucket selection, so peers cannot target one chain
+ * - Reclaim of the oldest block once a chain is deeper than
+ *   TCP_METRICS_RECLAIM_DEPTH
  */
 
 #include <stdio.h>
@@ -16,6 +21,7 @@
 #include <pthread.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <unistd.h>
 #include <sys/time.h>
 #include <arpa/inet.h>
@@ -23,8 +29,9 @@
 /* Constants */
 #define TCP_METRICS_TIMEOUT (60 * 60)  // 1 hour in seconds
 #define TCP_METRICS_RECLAIM_DEPTH 5
-#define TCP_METRICS_MAX_ENTRIES 1024
+#define TCP_METRICS_MAX_ENTRIES 8192   // Hash slots, power of two
 #define TCP_FASTOPEN_KEY_LENGTH 16
+#define TCP_FASTOPEN_SYN_LOSS_MAX 1023 // Width of the syn_loss bit-field
 #define USEC_PER_MSEC 1000
 
 /* TCP Metric Types */
@@ -66,29 +73,43 @@ struct tcp_fastopen_metrics {
 
 /* TCP Metrics Block */
 struct tcp_metrics_block {
-    struct tcp_metrics_block *next;
+    _Atomic(struct tcp_metrics_block *) next;  // Chain, nulls-terminated
     struct inetpeer_addr saddr;  // Source address
     struct inetpeer_addr daddr;  // Destination address
     time_t timestamp;  // Last update timestamp
     uint32_t locks;  // Metric locks
     uint32_t values[TCP_METRIC_MAX];  // Metric values
     struct tcp_fastopen_metrics fastopen;
-    pthread_mutex_t lock;
+    atomic_uint seq;  // Odd while a writer is changing the fields above
+    pthread_mutex_t lock;  // Serialises writers
+    struct tcp_metrics_block *free_next;  // Free list link, leaves next alone
 };
 
 /* Hash Table Bucket */
 struct metrics_bucket {
-    struct tcp_metrics_block *chain;
-    pthread_mutex_t lock;
+    _Atomic(struct tcp_metrics_block *) chain;
+    pthread_mutex_t lock;  // Insert, reclaim and remove
 };
 
+/*
+ * Chains end in a marker carrying the slot number. Removed blocks are
+ * recycled rather than freed (SLAB_TYPESAFE_BY_RCU semantics), so a reader
+ * can be carried onto another chain; ending on a foreign marker means retry.
+ */
+#define METRICS_NULLS_MARKER(i) ((struct tcp_metrics_block *)(((uintptr_t)(i) << 1) | 1))
+#define metrics_is_nulls(p) ((uintptr_t)(p) & 1)
+#define metrics_nulls_value(p) ((uint32_t)((uintptr_t)(p) >> 1))
+
 /* Global Variables */
 static struct metrics_bucket *metrics_hash = NULL;
 static size_t metrics_hash_size = TCP_METRICS_MAX_ENTRIES;
-static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t metrics_hash_key[2];
+static struct tcp_metrics_block *metrics_free_list;
+static pthread_mutex_t metrics_free_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /* Function Declarations */
-static uint32_t hash_addr(const struct inetpeer_addr *addr);
+static uint32_t hash_addr(const struct inetpeer_addr *saddr,
+                          const struct inetpeer_addr *daddr);
 static bool addr_equal(const struct inetpeer_addr *a, const struct inetpeer_addr *b);
 static struct tcp_metrics_block *metrics_alloc(void);
 static void metrics_free(struct tcp_metrics_block *tm);
@@ -108,18 +129,77 @@ static void fastopen_update(struct tcp_metrics_block *tm,
                           const struct tcp_fastopen_cookie *cookie);
 static void metrics_age(struct tcp_metrics_block *tm);
 
-/* Address Hash Function */
-static uint32_t hash_addr(const struct inetpeer_addr *addr) {
-    uint32_t hash = 0;
-    size_t len = (addr->family == AF_INET) ? 4 : 16;
-    const uint32_t *ptr = (addr->family == AF_INET) ? &addr->addr.v4 : addr->addr.v6;
+/* Per-Block Seqcount */
+static unsigned int metrics_read_begin(struct tcp_metrics_block *tm) {
+    unsigned int seq;
     
-    while (len >= 4) {
-        hash = (hash << 5) - hash + *ptr++;
-        len -= 4;
+    while ((seq = atomic_load_explicit(&tm->seq, memory_order_acquire)) & 1)
+        ;
+    return seq;
+}
+
+static bool metrics_read_retry(struct tcp_metrics_block *tm, unsigned int seq) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&tm->seq, memory_order_relaxed) != seq;
+}
+
+/* Writers hold tm->lock (or the bucket lock for reclaim) */
+static void metrics_write_begin(struct tcp_metrics_block *tm) {
+    atomic_fetch_add_explicit(&tm->seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void metrics_write_end(struct tcp_metrics_block *tm) {
+    atomic_fetch_add_explicit(&tm->seq, 1, memory_order_release);
+}
+
+/* SipHash-1-3 */
+#define SIPROUND(v0, v1, v2, v3) do { \
+    v0 += v1; v1 = (v1 << 13) | (v1 >> 51); v1 ^= v0; v0 = (v0 << 32) | (v0 >> 32); \
+    v2 += v3; v3 = (v3 << 16) | (v3 >> 48); v3 ^= v2; \
+    v0 += v3; v3 = (v3 << 21) | (v3 >> 43); v3 ^= v0; \
+    v2 += v1; v1 = (v1 << 17) | (v1 >> 47); v1 ^= v2; v2 = (v2 << 32) | (v2 >> 32); \
+} while (0)
+
+static uint64_t siphash_1_3(const uint64_t *words, size_t nwords,
+                            const uint64_t key[2]) {
+    uint64_t v0 = 0x736f6d6570736575ULL ^ key[0];
+    uint64_t v1 = 0x646f72616e646f6dULL ^ key[1];
+    uint64_t v2 = 0x6c7967656e657261ULL ^ key[0];
+    uint64_t v3 = 0x7465646279746573ULL ^ key[1];
+    uint64_t last = (uint64_t)(nwords * 8) << 56;
+    size_t i;
+
+    for (i = 0; i < nwords; i++) {
+        v3 ^= words[i];
+        SIPROUND(v0, v1, v2, v3);
+        v0 ^= words[i];
     }
-    
-    return hash % metrics_hash_size;
+    v3 ^= last;
+    SIPROUND(v0, v1, v2, v3);
+    v0 ^= last;
+    v2 ^= 0xff;
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/* Keyed Address-Pair Hash */
+static uint32_t hash_addr(const struct inetpeer_addr *saddr,
+                          const struct inetpeer_addr *daddr) {
+    uint64_t words[5];
+
+    if (saddr->family == AF_INET) {
+        words[0] = ((uint64_t)saddr->addr.v4 << 32) | daddr->addr.v4;
+        words[1] = AF_INET;
+        return siphash_1_3(words, 2, metrics_hash_key) & (metrics_hash_size - 1);
+    }
+
+    memcpy(&words[0], saddr->addr.v6, 16);
+    memcpy(&words[2], daddr->addr.v6, 16);
+    words[4] = saddr->family;
+    return siphash_1_3(words, 5, metrics_hash_key) & (metrics_hash_size - 1);
 }
 
 /* Address Comparison */
@@ -133,61 +213,104 @@ static bool addr_equal(const struct inetpeer_addr *a, const struct inetpeer_addr
     return memcmp(a->addr.v6, b->addr.v6, sizeof(a->addr.v6)) == 0;
 }
 
-/* Allocate New Metrics Block */
+/* Allocate New Metrics Block, recycling a removed one if possible */
 static struct tcp_metrics_block *metrics_alloc(void) {
-    struct tcp_metrics_block *tm = calloc(1, sizeof(*tm));
-    if (!tm)
-        return NULL;
-        
-    pthread_mutex_init(&tm->lock, NULL);
+    struct tcp_metrics_block *tm;
+    
+    pthread_mutex_lock(&metrics_free_lock);
+    tm = metrics_free_list;
+    if (tm)
+        metrics_free_list = tm->free_next;
+    pthread_mutex_unlock(&metrics_free_lock);
+    
+    if (!tm) {
+        tm = calloc(1, sizeof(*tm));
+        if (!tm)
+            return NULL;
+        atomic_init(&tm->seq, 0);
+        pthread_mutex_init(&tm->lock, NULL);
+    }
+    
+    // Readers may still be looking at a recycled block
+    metrics_write_begin(tm);
+    memset(&tm->saddr, 0, sizeof(tm->saddr));
+    memset(&tm->daddr, 0, sizeof(tm->daddr));
+    tm->locks = 0;
+    memset(tm->values, 0, sizeof(tm->values));
+    memset(&tm->fastopen, 0, sizeof(tm->fastopen));
     tm->timestamp = time(NULL);
+    metrics_write_end(tm);
     
     return tm;
 }
 
-/* Free Metrics Block */
+/* Free Metrics Block: back to the free list, memory stays type-stable */
 static void metrics_free(struct tcp_metrics_block *tm) {
     if (!tm)
         return;
         
-    pthread_mutex_destroy(&tm->lock);
-    free(tm);
+    pthread_mutex_lock(&metrics_free_lock);
+    // tm->next keeps pointing into its old chain, so a reader still on tm
+    // walks on to a nulls marker instead of into the free list
+    tm->free_next = metrics_free_list;
+    metrics_free_list = tm;
+    pthread_mutex_unlock(&metrics_free_lock);
+}
+
+/* Does tm currently hold the saddr/daddr pair? */
+static bool metrics_match(struct tcp_metrics_block *tm,
+                          const struct inetpeer_addr *saddr,
+                          const struct inetpeer_addr *daddr) {
+    unsigned int seq;
+    bool match;
+
+    do {
+        seq = metrics_read_begin(tm);
+        match = addr_equal(&tm->saddr, saddr) && addr_equal(&tm->daddr, daddr);
+    } while (metrics_read_retry(tm, seq));
+
+    return match;
 }
 
-/* Lookup Metrics */
+/* Lookup Metrics: lockless */
 static struct tcp_metrics_block *metrics_lookup(const struct inetpeer_addr *saddr,
                                               const struct inetpeer_addr *daddr) {
-    uint32_t hash = hash_addr(saddr) ^ hash_addr(daddr);
+    uint32_t hash = hash_addr(saddr, daddr);
     struct metrics_bucket *bucket = &metrics_hash[hash];
     struct tcp_metrics_block *tm;
-    
-    pthread_mutex_lock(&bucket->lock);
-    
-    for (tm = bucket->chain; tm; tm = tm->next) {
-        if (addr_equal(&tm->saddr, saddr) && addr_equal(&tm->daddr, daddr)) {
+
+begin:
+    for (tm = atomic_load_explicit(&bucket->chain, memory_order_acquire);
+         !metrics_is_nulls(tm);
+         tm = atomic_load_explicit(&tm->next, memory_order_acquire)) {
+        if (metrics_match(tm, saddr, daddr)) {
             metrics_age(tm);
-            break;
+            return tm;
         }
     }
-    
-    pthread_mutex_unlock(&bucket->lock);
-    return tm;
+
+    if (metrics_nulls_value(tm) != hash)
+        goto begin;
+
+    return NULL;
 }
 
 /* Update Metric Value */
-static void metrics_update(struct tcp_metrics_block *tm,
+static void metrics_update(struct tcp_metrics_block *tm, 
                          enum tcp_metric_index idx,
                          uint32_t value) {
     if (!tm || idx >= TCP_METRIC_MAX)
         return;
-        
+
     pthread_mutex_lock(&tm->lock);
-    
+
     if (!metrics_locked(tm, idx)) {
+        metrics_write_begin(tm);
         tm->values[idx] = value;
         tm->timestamp = time(NULL);
+        metrics_write_end(tm);
     }
-    
+
     pthread_mutex_unlock(&tm->lock);
 }
 
@@ -195,25 +318,54 @@ static void metrics_update(struct tcp_metrics_block *tm,
 static uint32_t metrics_read(struct tcp_metrics_block *tm,
                            enum tcp_metric_index idx) {
     uint32_t value = 0;
-    
+    unsigned int seq;
+
     if (!tm || idx >= TCP_METRIC_MAX)
         return 0;
-        
-    pthread_mutex_lock(&tm->lock);
-    value = tm->values[idx];
-    pthread_mutex_unlock(&tm->lock);
-    
+
+    do {
+        seq = metrics_read_begin(tm);
+        value = tm->values[idx];
+    } while (metrics_read_retry(tm, seq));
+
     return value;
 }
 
+/* Read every metric of a peer at once, as a new connection does */
+bool metrics_read_all(const struct inetpeer_addr *saddr,
+                      const struct inetpeer_addr *daddr,
+                      uint32_t values[TCP_METRIC_MAX]) {
+    struct tcp_metrics_block *tm;
+    unsigned int seq;
+    bool match;
+
+again:
+    tm = metrics_lookup(saddr, daddr);
+    if (!tm)
+        return false;
+
+    do {
+        seq = metrics_read_begin(tm);
+        match = addr_equal(&tm->saddr, saddr) && addr_equal(&tm->daddr, daddr);
+        memcpy(values, tm->values, sizeof(tm->values));
+    } while (metrics_read_retry(tm, seq));
+
+    // Reclaimed for another peer since the lookup
+    if (!match)
+        goto again;
+    return true;
+}
+
 /* Lock Metric */
 static void metrics_lock(struct tcp_metrics_block *tm,
                         enum tcp_metric_index idx) {
     if (!tm || idx >= TCP_METRIC_MAX)
         return;
-        
+
     pthread_mutex_lock(&tm->lock);
+    metrics_write_begin(tm);
     tm->locks |= (1 << idx);
+    metrics_write_end(tm);
     pthread_mutex_unlock(&tm->lock);
 }
 
@@ -222,7 +374,7 @@ static bool metrics_locked(struct tcp_metrics_block *tm,
                          enum tcp_metric_index idx) {
     if (!tm || idx >= TCP_METRIC_MAX)
         return false;
-        
+
     return (tm->locks & (1 << idx)) != 0;
 }
 
@@ -232,13 +384,89 @@ static void fastopen_update(struct tcp_metrics_block *tm,
                           const struct tcp_fastopen_cookie *cookie) {
     if (!tm || !cookie)
         return;
-        
+
     pthread_mutex_lock(&tm->lock);
-    
+
+    metrics_write_begin(tm);
     tm->fastopen.mss = mss;
     memcpy(&tm->fastopen.cookie, cookie, sizeof(*cookie));
     tm->timestamp = time(NULL);
-    
+    metrics_write_end(tm);
+
+    pthread_mutex_unlock(&tm->lock);
+}
+
+/*
+ * TFO fast path for an active open: copy the cached MSS, cookie and SYN
+ * loss history without taking any lock. Returns false if nothing is cached.
+ */
+bool tcp_fastopen_cache_get(const struct inetpeer_addr *saddr,
+                            const struct inetpeer_addr *daddr,
+                            uint16_t *mss,
+                            struct tcp_fastopen_cookie *cookie,
+                            int *syn_loss,
+                            time_t *last_syn_loss) {
+    struct tcp_fastopen_metrics tfom;
+    struct tcp_metrics_block *tm;
+    unsigned int seq;
+    bool match;
+
+again:
+    tm = metrics_lookup(saddr, daddr);
+    if (!tm)
+        return false;
+
+    do {
+        seq = metrics_read_begin(tm);
+        match = addr_equal(&tm->saddr, saddr) && addr_equal(&tm->daddr, daddr);
+        tfom = tm->fastopen;
+    } while (metrics_read_retry(tm, seq));
+
+    if (!match)
+        goto again;
+
+    if (tfom.mss)
+        *mss = tfom.mss;
+    *cookie = tfom.cookie;
+    if (cookie->len <= 0 && tfom.try_exp == 1)
+        cookie->exp = true;
+    *syn_loss = tfom.syn_loss;
+    *last_syn_loss = tfom.syn_loss ? tfom.last_syn_loss : 0;
+    return true;
+}
+
+struct tcp_metrics_block *metrics_add(const struct inetpeer_addr *saddr,
+                                    const struct inetpeer_addr *daddr);
+
+/* Record the outcome of a TFO handshake */
+void tcp_fastopen_cache_set(const struct inetpeer_addr *saddr,
+                            const struct inetpeer_addr *daddr,
+                            uint16_t mss,
+                            const struct tcp_fastopen_cookie *cookie,
+                            bool syn_lost,
+                            uint16_t try_exp) {
+    struct tcp_metrics_block *tm = metrics_add(saddr, daddr);
+
+    if (!tm)
+        return;
+
+    pthread_mutex_lock(&tm->lock);
+    metrics_write_begin(tm);
+    if (mss)
+        tm->fastopen.mss = mss;
+    if (cookie && cookie->len > 0)
+        tm->fastopen.cookie = *cookie;
+    else if (try_exp > tm->fastopen.try_exp && tm->fastopen.cookie.len <= 0)
+        tm->fastopen.try_exp = try_exp;
+    if (syn_lost) {
+        if (tm->fastopen.syn_loss < TCP_FASTOPEN_SYN_LOSS_MAX)
+            tm->fastopen.syn_loss++;
+        tm->fastopen.last_syn_loss = time(NULL);
+    } else {
+        tm->fastopen.syn_loss = 0;
+    }
+    tm->timestamp = time(NULL);
+    metrics_write_end(tm);
     pthread_mutex_unlock(&tm->lock);
 }
 
@@ -253,8 +481,12 @@ static void metrics_age(struct tcp_metrics_block *tm) {
     
     if (now - tm->timestamp > TCP_METRICS_TIMEOUT) {
         pthread_mutex_lock(&tm->lock);
-        memset(tm->values, 0, sizeof(tm->values));
-        tm->timestamp = now;
+        if (now - tm->timestamp > TCP_METRICS_TIMEOUT) {
+            metrics_write_begin(tm);
+            memset(tm->values, 0, sizeof(tm->values));
+            tm->timestamp = now;
+            metrics_write_end(tm);
+        }
         pthread_mutex_unlock(&tm->lock);
     }
 }
@@ -267,9 +499,16 @@ bool metrics_init(void) {
     if (!metrics_hash)
         return false;
         
-    for (i = 0; i < metrics_hash_size; i++)
+    for (i = 0; i < metrics_hash_size; i++) {
+        atomic_init(&metrics_hash[i].chain, METRICS_NULLS_MARKER(i));
         pthread_mutex_init(&metrics_hash[i].lock, NULL);
-        
+    }
+    
+    metrics_hash_key[0] = ((uint64_t)rand() << 32) ^ (uint64_t)rand() ^
+                          (uint64_t)time(NULL);
+    metrics_hash_key[1] = ((uint64_t)rand() << 32) ^ (uint64_t)rand() ^
+                          (uint64_t)getpid();
+                          
     return true;
 }
 
@@ -284,10 +523,11 @@ void metrics_cleanup(void) {
     for (i = 0; i < metrics_hash_size; i++) {
         pthread_mutex_lock(&metrics_hash[i].lock);
         
-        tm = metrics_hash[i].chain;
-        while (tm) {
-            next = tm->next;
-            metrics_free(tm);
+        tm = atomic_load(&metrics_hash[i].chain);
+        while (!metrics_is_nulls(tm)) {
+            next = atomic_load(&tm->next);
+            pthread_mutex_destroy(&tm->lock);
+            free(tm);
             tm = next;
         }
         
@@ -295,55 +535,106 @@ void metrics_cleanup(void) {
         pthread_mutex_destroy(&metrics_hash[i].lock);
     }
     
+    while ((tm = metrics_free_list) != NULL) {
+        metrics_free_list = tm->free_next;
+        pthread_mutex_destroy(&tm->lock);
+        free(tm);
+    }
+    
     free(metrics_hash);
     metrics_hash = NULL;
 }
 
-/* Add New Metrics Entry */
+/* Add New Metrics Entry, reclaiming the chain's oldest block when deep */
 struct tcp_metrics_block *metrics_add(const struct inetpeer_addr *saddr,
                                     const struct inetpeer_addr *daddr) {
-    uint32_t hash = hash_addr(saddr) ^ hash_addr(daddr);
+    uint32_t hash = hash_addr(saddr, daddr);
     struct metrics_bucket *bucket = &metrics_hash[hash];
-    struct tcp_metrics_block *tm;
-    
+    struct tcp_metrics_block *tm, *oldest = NULL;
+    int depth = 0;
+
     tm = metrics_lookup(saddr, daddr);
     if (tm)
         return tm;
-        
+
+    pthread_mutex_lock(&bucket->lock);
+
+    // Recheck under the lock, noting the stalest block as we go
+    for (tm = atomic_load_explicit(&bucket->chain, memory_order_relaxed);
+         !metrics_is_nulls(tm);
+         tm = atomic_load_explicit(&tm->next, memory_order_relaxed)) {
+        if (addr_equal(&tm->saddr, saddr) && addr_equal(&tm->daddr, daddr)) {
+            pthread_mutex_unlock(&bucket->lock);
+            return tm;
+        }
+        if (!oldest || tm->timestamp < oldest->timestamp)
+            oldest = tm;
+        depth++;
+    }
+
+    if (depth > TCP_METRICS_RECLAIM_DEPTH) {
+        // Reuse in place: the block stays on this chain, only its key and
+        // contents change, which readers see through its seqcount
+        tm = oldest;
+        pthread_mutex_lock(&tm->lock);
+        metrics_write_begin(tm);
+        memcpy(&tm->saddr, saddr, sizeof(*saddr));
+        memcpy(&tm->daddr, daddr, sizeof(*daddr));
+        tm->locks = 0;
+        memset(tm->values, 0, sizeof(tm->values));
+        memset(&tm->fastopen, 0, sizeof(tm->fastopen));
+        tm->timestamp = time(NULL);
+        metrics_write_end(tm);
+        pthread_mutex_unlock(&tm->lock);
+        pthread_mutex_unlock(&bucket->lock);
+        return tm;
+    }
+
     tm = metrics_alloc();
-    if (!tm)
+    if (!tm) {
+        pthread_mutex_unlock(&bucket->lock);
         return NULL;
-        
+    }
+
+    metrics_write_begin(tm);
     memcpy(&tm->saddr, saddr, sizeof(*saddr));
     memcpy(&tm->daddr, daddr, sizeof(*daddr));
-    
-    pthread_mutex_lock(&bucket->lock);
-    tm->next = bucket->chain;
-    bucket->chain = tm;
+    metrics_write_end(tm);
+
+    atomic_store_explicit(&tm->next,
+                          atomic_load_explicit(&bucket->chain, memory_order_relaxed),
+                          memory_order_relaxed);
+    atomic_store_explicit(&bucket->chain, tm, memory_order_release);
     pthread_mutex_unlock(&bucket->lock);
-    
+
     return tm;
 }
 
 /* Remove Metrics Entry */
 void metrics_remove(const struct inetpeer_addr *saddr,
                    const struct inetpeer_addr *daddr) {
-    uint32_t hash = hash_addr(saddr) ^ hash_addr(daddr);
+    uint32_t hash = hash_addr(saddr, daddr);
     struct metrics_bucket *bucket = &metrics_hash[hash];
-    struct tcp_metrics_block *tm, **pprev;
-    
+    struct tcp_metrics_block *tm;
+    _Atomic(struct tcp_metrics_block *) *pprev;
+
     pthread_mutex_lock(&bucket->lock);
-    
+
     pprev = &bucket->chain;
-    while ((tm = *pprev) != NULL) {
+    while (!metrics_is_nulls(tm = atomic_load_explicit(pprev, memory_order_relaxed))) {
         if (addr_equal(&tm->saddr, saddr) && addr_equal(&tm->daddr, daddr)) {
-            *pprev = tm->next;
+            // tm->next stays intact for readers still on it; metrics_free()
+            // chains the free list through free_next
+            atomic_store_explicit(pprev,
+                                  atomic_load_explicit(&tm->next, memory_order_relaxed),
+                                  memory_order_release);
+            pthread_mutex_unlock(&bucket->lock);
             metrics_free(tm);
-            break;
+            return;
         }
         pprev = &tm->next;
     }
-    
+
     pthread_mutex_unlock(&bucket->lock);
 }
 
@@ -352,13 +643,13 @@ void metrics_print(const struct inetpeer_addr *saddr,
                   const struct inetpeer_addr *daddr) {
     struct tcp_metrics_block *tm;
     char src[INET6_ADDRSTRLEN], dst[INET6_ADDRSTRLEN];
-    
+
     tm = metrics_lookup(saddr, daddr);
     if (!tm) {
         printf("No metrics found\n");
         return;
     }
-    
+
     if (saddr->family == AF_INET) {
         inet_ntop(AF_INET, &saddr->addr.v4, src, sizeof(src));
         inet_ntop(AF_INET, &daddr->addr.v4, dst, sizeof(dst));
@@ -366,7 +657,7 @@ void metrics_print(const struct inetpeer_addr *saddr,
         inet_ntop(AF_INET6, saddr->addr.v6, src, sizeof(src));
         inet_ntop(AF_INET6, daddr->addr.v6, dst, sizeof(dst));
     }
-    
+
     printf("TCP Metrics for %s -> %s:\n", src, dst);
     printf("  RTT: %u usec\n", metrics_read(tm, TCP_METRIC_RTT));
     printf("  RTTVAR: %u usec\n", metrics_read(tm, TCP_METRIC_RTTVAR));
@@ -377,8 +668,136 @@ void metrics_print(const struct inetpeer_addr *saddr,
     printf("  Fast Open SYN Loss: %u\n", tm->fastopen.syn_loss);
 }
 
+/* Benchmark */
+#define BENCH_PEERS 40000
+#define BENCH_OPS (1 << 22)
+#define BENCH_READERS 3
+
+static atomic_bool bench_stop;
+static atomic_ulong bench_torn;
+
+static double bench_elapsed_ns(const struct timespec *start) {
+    struct timespec end;
+    
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
+
+static void bench_peer(uint32_t i, struct inetpeer_addr *saddr,
+                       struct inetpeer_addr *daddr) {
+    saddr->family = AF_INET;
+    saddr->addr.v4 = htonl(0x0a000001);
+    daddr->family = AF_INET;
+    daddr->addr.v4 = htonl(0xc0a80000 + i);
+}
+
+/* Readers check that every metric of a block comes from the same update */
+static void *bench_reader(void *arg) {
+    struct inetpeer_addr saddr, daddr;
+    uint32_t values[TCP_METRIC_MAX];
+    uint32_t i = (uint32_t)(uintptr_t)arg;
+    
+    while (!atomic_load(&bench_stop)) {
+        bench_peer(i++ % 64, &saddr, &daddr);
+        if (!metrics_read_all(&saddr, &daddr, values))
+            continue;
+        for (int m = 1; m < TCP_METRIC_MAX; m++)
+            if (values[m] != values[0])
+                atomic_fetch_add(&bench_torn, 1);
+    }
+    return NULL;
+}
+
+/* Connection-rate workload: every new connection consults the cache */
+static int run_benchmark(void) {
+    struct inetpeer_addr saddr, daddr;
+    struct tcp_fastopen_cookie cookie = { .len = 8 };
+    uint32_t values[TCP_METRIC_MAX];
+    struct tcp_metrics_block *tm;
+    pthread_t readers[BENCH_READERS];
+    struct timespec start;
+    uint16_t mss = 0;
+    int syn_loss;
+    time_t last_loss;
+    double ns;
+    size_t chains = 0, blocks = 0, longest = 0;
+    
+    if (!metrics_init())
+        return 1;
+        
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < BENCH_PEERS; i++) {
+        bench_peer(i, &saddr, &daddr);
+        tm = metrics_add(&saddr, &daddr);
+        metrics_update(tm, TCP_METRIC_RTT, 1000 + i);
+        tcp_fastopen_cache_set(&saddr, &daddr, 1460, &cookie, false, 0);
+    }
+    ns = bench_elapsed_ns(&start);
+    printf("tcp_metrics: %d peers, %zu slots\n", BENCH_PEERS, metrics_hash_size);
+    printf("  insert + update:     %7.1f ns/peer\n", ns / BENCH_PEERS);
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < BENCH_OPS; i++) {
+        bench_peer((i * 2654435761u) % BENCH_PEERS, &saddr, &daddr);
+        metrics_read_all(&saddr, &daddr, values);
+    }
+    ns = bench_elapsed_ns(&start);
+    printf("  new connection read: %7.1f ns (%.1f M conn/s)\n",
+           ns / BENCH_OPS, BENCH_OPS / ns * 1e3);
+           
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < BENCH_OPS; i++) {
+        bench_peer((i * 2654435761u) % BENCH_PEERS, &saddr, &daddr);
+        tcp_fastopen_cache_get(&saddr, &daddr, &mss, &cookie, &syn_loss, &last_loss);
+    }
+    ns = bench_elapsed_ns(&start);
+    printf("  TFO cookie get:      %7.1f ns\n", ns / BENCH_OPS);
+    
+    // Chains stay bounded however many peers arrive
+    for (size_t i = 0; i < metrics_hash_size; i++) {
+        size_t depth = 0;
+        for (tm = atomic_load(&metrics_hash[i].chain); !metrics_is_nulls(tm);
+             tm = atomic_load(&tm->next))
+            depth++;
+        chains += depth > 0;
+        blocks += depth;
+        if (depth > longest)
+            longest = depth;
+    }
+    printf("  blocks %zu in %zu chains, longest %zu (reclaim depth %d)\n",
+           blocks, chains, longest, TCP_METRICS_RECLAIM_DEPTH);
+           
+    // Consistency under concurrent writers: every block the readers can
+    // see holds one value in all metrics, so any mismatch is a torn read
+    for (uint32_t i = 0; i < 64; i++) {
+        bench_peer(i, &saddr, &daddr);
+        metrics_remove(&saddr, &daddr);
+    }
+    for (int r = 0; r < BENCH_READERS; r++)
+        pthread_create(&readers[r], NULL, bench_reader, (void *)(uintptr_t)r);
+    for (uint32_t i = 0; i < BENCH_OPS / 16; i++) {
+        bench_peer(i % 64, &saddr, &daddr);
+        tm = metrics_add(&saddr, &daddr);
+        pthread_mutex_lock(&tm->lock);
+        metrics_write_begin(tm);
+        for (int m = 0; m < TCP_METRIC_MAX; m++)
+            tm->values[m] = i;
+        metrics_write_end(tm);
+        pthread_mutex_unlock(&tm->lock);
+        if (i % 4096 == 0)
+            metrics_remove(&saddr, &daddr);
+    }
+    atomic_store(&bench_stop, true);
+    for (int r = 0; r < BENCH_READERS; r++)
+        pthread_join(readers[r], NULL);
+    printf("  torn reads under concurrent update: %lu\n", atomic_load(&bench_torn));
+    
+    metrics_cleanup();
+    return atomic_load(&bench_torn) ? 1 : 0;
+}
+
 /* Example Usage */
-int main(void) {
+int main(int argc, char **argv) {
     struct inetpeer_addr saddr = {
         .family = AF_INET,
         .addr.v4 = 0x0100007f  // 127.0.0.1
@@ -394,6 +813,11 @@ int main(void) {
         .key = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08}
     };
     
+    srand(time(NULL));
+    
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        return run_benchmark();
+        
     if (!metrics_init()) {
         fprintf(stderr, "Failed to initialize metrics system\n");
         return 1;
@@ -413,6 +837,10 @@ int main(void) {
     metrics_update(tm, TCP_METRIC_CWND, 10);
     metrics_update(tm, TCP_METRIC_REORDERING, 3);
     
+    /* A locked metric (route "lock") ignores what connections learn */
+    metrics_lock(tm, TCP_METRIC_SSTHRESH);
+    metrics_update(tm, TCP_METRIC_SSTHRESH, 1000);
+    
     fastopen_update(tm, 1460, &cookie);
     
     /* Print metrics */
@@ -4,7 +4,10 @@
  * 
  * This simulation implements:
  * - TIME_WAIT state management
- * - Request socket handling
+ * - Resizable TIME_WAIT hash with timer-wheel batched expiry
+ * - Request socket handling with SYN-ACK retransmit timers
+ * - Lockless accept queue
+ * - SYN cookies
  * - Connection establishment
  * - TCP options processing
  */
@@ -20,6 +23,9 @@
 #include <sys/time.h>
 #include <arpa/inet.h>
 #include <netinet/tcp.h>
+#include <stdatomic.h>
+
+#include "timer_wheel_sim.h"
 
 /* Constants */
 #define TCP_TIMEWAIT_LEN (60 * 2)  // 2 minutes in seconds
@@ -30,20 +36,35 @@
 #define TCP_MAX_REORDERING 3
 #define MAX_TCP_FASTOPEN_COOKIE 16
 
-/* TCP States */
-enum {
-    TCP_ESTABLISHED = 1,
-    TCP_SYN_SENT,
-    TCP_SYN_RECV,
-    TCP_FIN_WAIT1,
-    TCP_FIN_WAIT2,
-    TCP_TIME_WAIT,
-    TCP_CLOSE,
-    TCP_CLOSE_WAIT,
-    TCP_LAST_ACK,
-    TCP_LISTEN,
-    TCP_CLOSING
-};
+/* SYN cookies */
+#define TCP_SYNCOOKIES_OFF 0
+#define TCP_SYNCOOKIES_ON_OVERFLOW 1
+#define TCP_SYNCOOKIES_ALWAYS 2
+#define COOKIEBITS 24                   /* Upper 8 bits carry the minute counter */
+#define COOKIEMASK (((uint32_t)1 << COOKIEBITS) - 1)
+#define COOKIE_DATA_BITS 8              /* MSS index, wscale, SACK, timestamps */
+#define MAX_SYNCOOKIE_AGE 2             /* Minutes */
+#define COOKIE_WSCALE_NONE 0xf
+
+/* Request sock queue */
+#define REQSK_LOCKS 64
+#define TCP_MAX_SYN_BACKLOG 4096
+#define TCP_TIMEOUT_INIT 1              /* Seconds to the first SYN-ACK retransmit */
+#define TCP_SYNACK_RETRIES 5
+
+/* PAWS: timestamps older than this are no longer compared */
+#define TCP_PAWS_24DAYS (60 * 60 * 24 * 24)
+
+/* <netinet/tcp.h> calls it TCPOPT_MAXSEG */
+#define TCPOPT_MSS TCPOPT_MAXSEG
+
+/* TCP states (TCP_ESTABLISHED ... TCP_CLOSING) come from <netinet/tcp.h> */
+
+/* Sequence number comparisons, modulo 2^32 */
+static inline bool before(uint32_t seq1, uint32_t seq2) {
+    return (int32_t)(seq1 - seq2) < 0;
+}
+#define after(seq2, seq1) before(seq1, seq2)
 
 /* TCP Substate for TIME_WAIT */
 enum {
@@ -73,6 +94,7 @@ struct tcp_fastopen_cookie {
 /* Request Socket */
 struct request_sock {
     struct request_sock *next;
+    _Atomic(struct request_sock *) accept_next;
     uint32_t rcv_nxt;
     uint32_t snt_isn;
     uint16_t mss;
@@ -91,7 +113,13 @@ struct request_sock {
     /* Timestamps */
     uint32_t ts_recent;
     uint32_t ts_recent_stamp;
-    uint32_t expires;
+    uint32_t expires;               /* SYN-ACK timeout, seconds */
+    
+    /* SYN-ACK timer and syn_table membership */
+    struct wheel_timer rsk_timer;   /* syn_wheel_lock */
+    struct request_sock *expire_next;  /* reqsk_queue_expire() batch */
+    bool rsk_hashed;                /* In syn_table; syn lock */
+    atomic_int rsk_refcnt;          /* One for syn_table/accept, one for the timer */
     
     /* Window */
     uint16_t window_clamp;
@@ -99,6 +127,36 @@ struct request_sock {
     bool sack_ok;
     bool tstamp_ok;
     bool wscale_ok;
+    bool cookie;    /* Rebuilt from a SYN cookie, nothing was queued */
+};
+
+/*
+ * Per-listener request queue. Half-open requests live in a striped-lock
+ * hash; completed ones go to a lockless MPSC accept queue (any number of
+ * receive paths push, accept() pops).
+ */
+struct request_sock_queue {
+    struct request_sock **syn_table;
+    uint32_t nr_table_entries;
+    pthread_mutex_t syn_locks[REQSK_LOCKS];
+    atomic_int qlen;
+    int max_qlen;
+    
+    _Atomic(struct request_sock *) accept_tail;
+    struct request_sock *accept_head;   /* Consumer only */
+    struct request_sock accept_stub;
+    
+    /* SYN-ACK timeouts, in seconds; nests inside a syn lock */
+    struct timer_wheel syn_wheel;
+    pthread_mutex_t syn_wheel_lock;
+    
+    atomic_ulong reqs_allocated;
+    atomic_ulong reqs_expired;
+    atomic_ulong synack_retrans;
+    atomic_ulong cookies_sent;
+    atomic_ulong cookies_ok;
+    atomic_ulong cookies_failed;
+    atomic_ulong drops;
 };
 
 /* TIME_WAIT Socket */
@@ -121,6 +179,14 @@ struct tcp_timewait_sock {
     uint8_t tw_substate;
     time_t tw_timeout;
     
+    /* Hash and death-row linkage */
+    struct tcp_timewait_sock *next;
+    struct tcp_timewait_sock *tw_wnext;
+    struct tcp_timewait_sock **tw_wpprev;
+    struct tcp_timewait_sock *tw_expire_next;  /* tcp_tw_expire() batch */
+    bool tw_expiring;       /* Off the wheel, being killed; wheel lock */
+    atomic_int tw_refcnt;   /* One for the hash, one while on the wheel */
+    
     /* Rate limiting */
     time_t tw_last_oow_ack_time;
     
@@ -129,15 +195,42 @@ struct tcp_timewait_sock {
 };
 
 /* Hash Table for TIME_WAIT Sockets */
-#define TIMEWAIT_HASHBITS 8
+#define TIMEWAIT_HASHBITS 8             /* Initial size, grows on demand */
 #define TIMEWAIT_HASHSIZE (1 << TIMEWAIT_HASHBITS)
+#define TIMEWAIT_HASH_MAX_BITS 22
 
 struct tw_hash_bucket {
     struct tcp_timewait_sock *chain;
     pthread_mutex_t lock;
 };
 
-static struct tw_hash_bucket tw_hash[TIMEWAIT_HASHSIZE];
+struct tw_hashinfo {
+    struct tw_hash_bucket *buckets;
+    uint32_t mask;
+    atomic_int count;
+    pthread_rwlock_t resize_lock;   /* Read: bucket operations, write: resize */
+};
+
+static struct tw_hashinfo tw_hashinfo;
+
+/*
+ * TIME_WAIT death row: a one-second-granularity wheel. Every timeout is at
+ * most TCP_TIMEWAIT_LEN ahead, so a wheel longer than that never wraps and
+ * a whole slot expires as one batch.
+ */
+#define TW_WHEEL_SLOTS 256
+
+struct tw_wheel {
+    struct tcp_timewait_sock *slots[TW_WHEEL_SLOTS];
+    time_t clk;                     /* Next second to expire */
+    pthread_mutex_t lock;
+};
+
+static struct tw_wheel tw_death_row;
+
+static int sysctl_tcp_syncookies = TCP_SYNCOOKIES_ON_OVERFLOW;
+static uint32_t syncookie_secret[2];
+static const uint16_t msstab[] = { 536, 1300, 1440, 1460 };
 
 /* Function Declarations */
 static uint32_t tcp_tw_hash_func(uint32_t saddr, uint32_t daddr,
@@ -158,10 +251,18 @@ static void tcp_openreq_init(struct request_sock *req,
                             struct tcp_options_received *opt,
                             const struct tcphdr *th);
 
-/* Hash Function for TIME_WAIT Sockets */
+/* Hash Function for TIME_WAIT Sockets (callers mask with the table size) */
 static uint32_t tcp_tw_hash_func(uint32_t saddr, uint32_t daddr,
                                 uint16_t sport, uint16_t dport) {
-    return (saddr ^ daddr ^ ((uint32_t)sport << 16) ^ dport) & (TIMEWAIT_HASHSIZE - 1);
+    uint32_t h = saddr * 0x9e3779b1;
+    
+    h ^= daddr;
+    h = ((h << 13) | (h >> 19)) * 0x85ebca6b;
+    h ^= ((uint32_t)sport << 16) | dport;
+    h ^= h >> 16;
+    h *= 0xc2b2ae35;
+    h ^= h >> 15;
+    return h;
 }
 
 /* Check if Sequence Number is in Window */
@@ -241,62 +342,233 @@ static bool tcp_paws_check(const struct tcp_timewait_sock *tw,
     return true;
 }
 
+/* Drop a TIME_WAIT socket reference */
+static void tcp_tw_put(struct tcp_timewait_sock *tw) {
+    if (atomic_fetch_sub(&tw->tw_refcnt, 1) == 1) {
+        pthread_mutex_destroy(&tw->lock);
+        free(tw);
+    }
+}
+
+/* Arm (or re-arm) the TIME_WAIT timer; a newly armed timer holds a reference */
+static void tcp_tw_schedule(struct tcp_timewait_sock *tw, time_t timeout) {
+    struct tw_wheel *wheel = &tw_death_row;
+    struct tcp_timewait_sock **slot;
+    
+    pthread_mutex_lock(&wheel->lock);
+    if (tw->tw_expiring) {
+        /* The timer already fired; tcp_tw_expire() owns tw's linkage */
+        pthread_mutex_unlock(&wheel->lock);
+        return;
+    }
+    if (tw->tw_wpprev) {
+        *tw->tw_wpprev = tw->tw_wnext;
+        if (tw->tw_wnext)
+            tw->tw_wnext->tw_wpprev = tw->tw_wpprev;
+    } else {
+        atomic_fetch_add(&tw->tw_refcnt, 1);
+    }
+    
+    if (timeout < wheel->clk)
+        timeout = wheel->clk;
+    tw->tw_timeout = timeout;
+    
+    slot = &wheel->slots[timeout % TW_WHEEL_SLOTS];
+    tw->tw_wnext = *slot;
+    if (*slot)
+        (*slot)->tw_wpprev = &tw->tw_wnext;
+    *slot = tw;
+    tw->tw_wpprev = slot;
+    pthread_mutex_unlock(&wheel->lock);
+}
+
+/* Disarm the TIME_WAIT timer; returns true if it was armed */
+static bool tcp_tw_deschedule(struct tcp_timewait_sock *tw) {
+    struct tw_wheel *wheel = &tw_death_row;
+    bool armed = false;
+    
+    pthread_mutex_lock(&wheel->lock);
+    if (tw->tw_wpprev) {
+        *tw->tw_wpprev = tw->tw_wnext;
+        if (tw->tw_wnext)
+            tw->tw_wnext->tw_wpprev = tw->tw_wpprev;
+        tw->tw_wpprev = NULL;
+        tw->tw_wnext = NULL;
+        armed = true;
+    }
+    pthread_mutex_unlock(&wheel->lock);
+    
+    if (armed)
+        tcp_tw_put(tw);
+    return armed;
+}
+
+/* Double the TIME_WAIT hash once the load factor exceeds one */
+static void tcp_tw_hash_grow(uint32_t old_mask) {
+    struct tw_hashinfo *hi = &tw_hashinfo;
+    struct tw_hash_bucket *nb;
+    struct tcp_timewait_sock *tw, *next;
+    uint32_t i, size, mask;
+    
+    pthread_rwlock_wrlock(&hi->resize_lock);
+    if (hi->mask != old_mask || old_mask + 1 >= (1U << TIMEWAIT_HASH_MAX_BITS))
+        goto out;
+    
+    size = (old_mask + 1) * 2;
+    mask = size - 1;
+    nb = calloc(size, sizeof(*nb));
+    if (!nb)
+        goto out;
+    for (i = 0; i < size; i++)
+        pthread_mutex_init(&nb[i].lock, NULL);
+    
+    for (i = 0; i <= old_mask; i++) {
+        for (tw = hi->buckets[i].chain; tw; tw = next) {
+            uint32_t h = tcp_tw_hash_func(tw->tw_saddr, tw->tw_daddr,
+                                          tw->tw_sport, tw->tw_dport) & mask;
+            next = tw->next;
+            tw->next = nb[h].chain;
+            nb[h].chain = tw;
+        }
+        pthread_mutex_destroy(&hi->buckets[i].lock);
+    }
+    
+    free(hi->buckets);
+    hi->buckets = nb;
+    hi->mask = mask;
+out:
+    pthread_rwlock_unlock(&hi->resize_lock);
+}
+
+/* Unhash a TIME_WAIT socket; returns true if this caller removed it */
+static bool tcp_tw_unhash(struct tcp_timewait_sock *tw) {
+    struct tw_hashinfo *hi = &tw_hashinfo;
+    struct tw_hash_bucket *bucket;
+    struct tcp_timewait_sock **pprev;
+    bool found = false;
+    
+    pthread_rwlock_rdlock(&hi->resize_lock);
+    bucket = &hi->buckets[tcp_tw_hash_func(tw->tw_saddr, tw->tw_daddr,
+                                           tw->tw_sport, tw->tw_dport) & hi->mask];
+    pthread_mutex_lock(&bucket->lock);
+    for (pprev = &bucket->chain; *pprev; pprev = &(*pprev)->next) {
+        if (*pprev == tw) {
+            *pprev = tw->next;
+            found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&bucket->lock);
+    pthread_rwlock_unlock(&hi->resize_lock);
+    
+    if (found) {
+        atomic_fetch_sub(&hi->count, 1);
+        tcp_tw_put(tw);
+    }
+    return found;
+}
+
 /* Enter TIME_WAIT State */
 static void tcp_timewait_enter(struct tcp_timewait_sock *tw) {
+    struct tw_hashinfo *hi = &tw_hashinfo;
+    struct tw_hash_bucket *bucket;
     uint32_t hash = tcp_tw_hash_func(tw->tw_saddr, tw->tw_daddr,
                                     tw->tw_sport, tw->tw_dport);
-    struct tw_hash_bucket *bucket = &tw_hash[hash];
+    uint32_t mask;
     
-    tw->tw_timeout = time(NULL) + TCP_TIMEWAIT_LEN;
+    atomic_store(&tw->tw_refcnt, 1);    /* Hash reference */
+    tcp_tw_schedule(tw, time(NULL) + TCP_TIMEWAIT_LEN);
     
+    pthread_rwlock_rdlock(&hi->resize_lock);
+    mask = hi->mask;
+    bucket = &hi->buckets[hash & mask];
     pthread_mutex_lock(&bucket->lock);
     tw->next = bucket->chain;
     bucket->chain = tw;
     pthread_mutex_unlock(&bucket->lock);
+    pthread_rwlock_unlock(&hi->resize_lock);
+    
+    if (atomic_fetch_add(&hi->count, 1) + 1 > (int)mask + 1)
+        tcp_tw_hash_grow(mask);
 }
 
 /* Kill TIME_WAIT Socket */
 static void tcp_timewait_kill(struct tcp_timewait_sock *tw) {
-    uint32_t hash = tcp_tw_hash_func(tw->tw_saddr, tw->tw_daddr,
-                                    tw->tw_sport, tw->tw_dport);
-    struct tw_hash_bucket *bucket = &tw_hash[hash];
-    struct tcp_timewait_sock **pprev;
-    
-    pthread_mutex_lock(&bucket->lock);
+    tcp_tw_deschedule(tw);
+    tcp_tw_unhash(tw);
+}
+
+/*
+ * Expire every TIME_WAIT socket whose timeout is <= now. Due entries are
+ * unlinked from the wheel slots under the wheel lock and then unhashed as
+ * one batch, so the cost is proportional to the sockets expiring, not the
+ * sockets alive; entries a wheel span or more ahead stay in their slot.
+ */
+static unsigned long tcp_tw_expire(time_t now) {
+    struct tw_wheel *wheel = &tw_death_row;
+    struct tcp_timewait_sock *batch = NULL, *tw, *next;
+    unsigned long killed = 0;
+    time_t t;
+    int n;
     
-    pprev = &bucket->chain;
-    while (*pprev) {
-        if (*pprev == tw) {
-            *pprev = tw->next;
-            break;
+    pthread_mutex_lock(&wheel->lock);
+    for (t = wheel->clk, n = 0; t <= now && n < TW_WHEEL_SLOTS; t++, n++) {
+        struct tcp_timewait_sock **slot = &wheel->slots[t % TW_WHEEL_SLOTS];
+        
+        for (tw = *slot; tw; tw = next) {
+            next = tw->tw_wnext;
+            /* A slot also holds timers a whole wheel span ahead */
+            if (tw->tw_timeout > now)
+                continue;
+            *tw->tw_wpprev = next;
+            if (next)
+                next->tw_wpprev = tw->tw_wpprev;
+            tw->tw_wpprev = NULL;
+            tw->tw_wnext = NULL;
+            tw->tw_expiring = true;
+            tw->tw_expire_next = batch;
+            batch = tw;
         }
-        pprev = &(*pprev)->next;
     }
+    if (now >= wheel->clk)
+        wheel->clk = now + 1;
+    pthread_mutex_unlock(&wheel->lock);
     
-    pthread_mutex_unlock(&bucket->lock);
-    
-    pthread_mutex_destroy(&tw->lock);
-    free(tw);
+    /* Walked unlocked: the batch has its own link, and tw_expiring keeps
+     * tcp_tw_schedule() from putting these back on the wheel */
+    for (tw = batch; tw; tw = next) {
+        next = tw->tw_expire_next;
+        tcp_tw_unhash(tw);
+        tcp_tw_put(tw);     /* Timer reference */
+        killed++;
+    }
+    return killed;
 }
 
-/* Lookup TIME_WAIT Socket */
+/* Lookup TIME_WAIT Socket; returns a referenced socket, drop with tcp_tw_put */
 static struct tcp_timewait_sock *tcp_timewait_lookup(uint32_t saddr,
                                                     uint32_t daddr,
                                                     uint16_t sport,
                                                     uint16_t dport) {
+    struct tw_hashinfo *hi = &tw_hashinfo;
     uint32_t hash = tcp_tw_hash_func(saddr, daddr, sport, dport);
-    struct tw_hash_bucket *bucket = &tw_hash[hash];
+    struct tw_hash_bucket *bucket;
     struct tcp_timewait_sock *tw;
     
+    pthread_rwlock_rdlock(&hi->resize_lock);
+    bucket = &hi->buckets[hash & hi->mask];
     pthread_mutex_lock(&bucket->lock);
     
     for (tw = bucket->chain; tw; tw = tw->next) {
         if (tw->tw_saddr == saddr && tw->tw_daddr == daddr &&
-            tw->tw_sport == sport && tw->tw_dport == dport)
+            tw->tw_sport == sport && tw->tw_dport == dport) {
+            atomic_fetch_add(&tw->tw_refcnt, 1);
             break;
+        }
     }
     
     pthread_mutex_unlock(&bucket->lock);
+    pthread_rwlock_unlock(&hi->resize_lock);
     return tw;
 }
 
@@ -308,7 +580,7 @@ static void tcp_openreq_init(struct request_sock *req,
     req->snt_isn = rand();  // Should use better ISN generation
     req->mss = opt->mss ? : 536;
     req->num_retrans = 0;
-    req->syn_ack_retries = 0;
+    req->syn_ack_retries = TCP_SYNACK_RETRIES;
     
     /* Copy TCP options */
     memcpy(&req->opt, opt, sizeof(*opt));
@@ -330,7 +602,7 @@ static void tcp_openreq_init(struct request_sock *req,
 static int tcp_timewait_state_process(struct tcp_timewait_sock *tw,
                                      struct tcphdr *th,
                                      uint32_t seq, uint32_t end_seq) {
-    struct tcp_options_received tmp_opt;
+    struct tcp_options_received tmp_opt = { 0 };
     bool paws_reject = false;
     
     /* Parse options */
@@ -351,8 +623,10 @@ static int tcp_timewait_state_process(struct tcp_timewait_sock *tw,
                                          tw->tw_rcv_nxt + tw->tw_rcv_wnd))
             return 1;  // Send ACK
             
-        if (th->rst)
-            return 0;  // Kill socket
+        if (th->rst) {
+            tcp_timewait_kill(tw);
+            return 0;  // Socket killed
+        }
             
         if (th->syn && !before(seq, tw->tw_rcv_nxt))
             return 2;  // Send RST
@@ -371,7 +645,7 @@ static int tcp_timewait_state_process(struct tcp_timewait_sock *tw,
                 tw->tw_ts_recent_stamp = time(NULL);
             }
             
-            tw->tw_timeout = time(NULL) + TCP_TIMEWAIT_LEN;
+            tcp_tw_schedule(tw, time(NULL) + TCP_TIMEWAIT_LEN);
             return 1;  // Send ACK
         }
         
@@ -381,8 +655,10 @@ static int tcp_timewait_state_process(struct tcp_timewait_sock *tw,
         if (!paws_reject &&
             seq == tw->tw_rcv_nxt &&
             (seq == end_seq || th->rst)) {
-            if (th->rst)
-                return 0;  // Kill socket
+            if (th->rst) {
+                tcp_timewait_kill(tw);
+                return 0;  // Socket killed
+            }
                 
             /* Update timestamp if present */
             if (tmp_opt.saw_tstamp) {
@@ -391,7 +667,7 @@ static int tcp_timewait_state_process(struct tcp_timewait_sock *tw,
             }
             
             /* Restart TIME-WAIT */
-            tw->tw_timeout = time(NULL) + TCP_TIMEWAIT_LEN;
+            tcp_tw_schedule(tw, time(NULL) + TCP_TIMEWAIT_LEN);
             return 1;  // Send ACK
         }
         
@@ -406,23 +682,33 @@ static int tcp_timewait_state_process(struct tcp_timewait_sock *tw,
 
 /* Initialize TIME_WAIT Hash Table */
 static void tcp_timewait_init(void) {
+    struct tw_hashinfo *hi = &tw_hashinfo;
     int i;
     
+    hi->buckets = calloc(TIMEWAIT_HASHSIZE, sizeof(*hi->buckets));
+    hi->mask = TIMEWAIT_HASHSIZE - 1;
+    atomic_init(&hi->count, 0);
+    pthread_rwlock_init(&hi->resize_lock, NULL);
     for (i = 0; i < TIMEWAIT_HASHSIZE; i++) {
-        tw_hash[i].chain = NULL;
-        pthread_mutex_init(&tw_hash[i].lock, NULL);
+        hi->buckets[i].chain = NULL;
+        pthread_mutex_init(&hi->buckets[i].lock, NULL);
     }
+    
+    memset(tw_death_row.slots, 0, sizeof(tw_death_row.slots));
+    tw_death_row.clk = time(NULL);
+    pthread_mutex_init(&tw_death_row.lock, NULL);
 }
 
 /* Cleanup TIME_WAIT Hash Table */
 static void tcp_timewait_cleanup(void) {
-    int i;
+    struct tw_hashinfo *hi = &tw_hashinfo;
+    uint32_t i;
     struct tcp_timewait_sock *tw, *next;
     
-    for (i = 0; i < TIMEWAIT_HASHSIZE; i++) {
-        pthread_mutex_lock(&tw_hash[i].lock);
+    for (i = 0; i <= hi->mask; i++) {
+        pthread_mutex_lock(&hi->buckets[i].lock);
         
-        tw = tw_hash[i].chain;
+        tw = hi->buckets[i].chain;
         while (tw) {
             next = tw->next;
             pthread_mutex_destroy(&tw->lock);
@@ -430,19 +716,589 @@ static void tcp_timewait_cleanup(void) {
             tw = next;
         }
         
-        pthread_mutex_unlock(&tw_hash[i].lock);
-        pthread_mutex_destroy(&tw_hash[i].lock);
+        pthread_mutex_unlock(&hi->buckets[i].lock);
+        pthread_mutex_destroy(&hi->buckets[i].lock);
+    }
+    
+    free(hi->buckets);
+    hi->buckets = NULL;
+    pthread_rwlock_destroy(&hi->resize_lock);
+    pthread_mutex_destroy(&tw_death_row.lock);
+}
+
+/* Keyed hash used by SYN cookies */
+static uint32_t cookie_hash(uint32_t saddr, uint32_t daddr, uint16_t sport,
+                            uint16_t dport, uint32_t count, int c) {
+    uint32_t h = syncookie_secret[c] ^ count;
+    
+    h ^= saddr;
+    h *= 0xcc9e2d51;
+    h = (h << 15) | (h >> 17);
+    h ^= daddr;
+    h *= 0x1b873593;
+    h ^= ((uint32_t)sport << 16) | dport;
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+/* Minute counter embedded in the upper bits of a cookie */
+static uint32_t tcp_cookie_time(void) {
+    return (uint32_t)(time(NULL) / 60);
+}
+
+/*
+ * Cookie layout (Linux secure_tcp_syn_cookie):
+ *   ISN = H1(tuple) + peer_isn + (count << 24) + ((H2(tuple, count) + data) & 0xffffff)
+ * Unlike Linux, which only stores the MSS index here and hides wscale/SACK
+ * in TSval, all negotiated options go into 8 data bits of the ISN so they
+ * survive even without timestamps. That leaves 16 bits for validation.
+ */
+static uint32_t secure_tcp_syn_cookie(uint32_t saddr, uint32_t daddr,
+                                      uint16_t sport, uint16_t dport,
+                                      uint32_t sseq, uint32_t data) {
+    uint32_t count = tcp_cookie_time();
+    
+    return cookie_hash(saddr, daddr, sport, dport, 0, 0) + sseq +
+           (count << COOKIEBITS) +
+           ((cookie_hash(saddr, daddr, sport, dport, count, 1) + data) & COOKIEMASK);
+}
+
+/* Returns the encoded data bits, or -1 if the cookie is forged or too old */
+static int check_tcp_syn_cookie(uint32_t cookie, uint32_t saddr, uint32_t daddr,
+                                uint16_t sport, uint16_t dport, uint32_t sseq) {
+    uint32_t diff, count = tcp_cookie_time();
+    uint32_t data;
+    
+    cookie -= cookie_hash(saddr, daddr, sport, dport, 0, 0) + sseq;
+    
+    diff = (count - (cookie >> COOKIEBITS)) & ((uint32_t)-1 >> COOKIEBITS);
+    if (diff >= MAX_SYNCOOKIE_AGE)
+        return -1;
+    
+    data = (cookie - cookie_hash(saddr, daddr, sport, dport, count - diff, 1)) & COOKIEMASK;
+    if (data >= (1U << COOKIE_DATA_BITS))
+        return -1;
+    return (int)data;
+}
+
+static uint32_t cookie_encode_options(const struct tcp_options_received *opt) {
+    uint32_t mssind = sizeof(msstab) / sizeof(msstab[0]) - 1;
+    uint32_t wscale = opt->wscale_ok ? (opt->wscale & 0xf) : COOKIE_WSCALE_NONE;
+    uint16_t mss = opt->mss ? opt->mss : 536;
+    
+    while (mssind > 0 && mss < msstab[mssind])
+        mssind--;
+    
+    return mssind | (wscale << 2) | ((uint32_t)opt->sack_ok << 6) |
+           ((uint32_t)opt->saw_tstamp << 7);
+}
+
+/* ISN for a SYN answered with a cookie: nothing is allocated */
+static uint32_t cookie_v4_init_sequence(uint32_t saddr, uint32_t daddr,
+                                        uint16_t sport, uint16_t dport,
+                                        uint32_t seq,
+                                        const struct tcp_options_received *opt) {
+    return secure_tcp_syn_cookie(saddr, daddr, sport, dport, seq,
+                                 cookie_encode_options(opt));
+}
+
+/* Rebuild a request from the ACK of a cookie SYN-ACK */
+static struct request_sock *cookie_v4_check(uint32_t saddr, uint32_t daddr,
+                                            uint16_t sport, uint16_t dport,
+                                            uint32_t seq, uint32_t ack_seq) {
+    struct request_sock *req;
+    int data;
+    
+    data = check_tcp_syn_cookie(ack_seq - 1, saddr, daddr, sport, dport, seq - 1);
+    if (data < 0)
+        return NULL;
+    
+    req = calloc(1, sizeof(*req));
+    if (!req)
+        return NULL;
+    
+    req->saddr = saddr;
+    req->daddr = daddr;
+    req->sport = sport;
+    req->dport = dport;
+    req->rcv_nxt = seq;
+    req->snt_isn = ack_seq - 1;
+    req->mss = msstab[data & 3];
+    req->wscale_ok = ((data >> 2) & 0xf) != COOKIE_WSCALE_NONE;
+    req->rcv_wscale = req->wscale_ok ? (data >> 2) & 0xf : 0;
+    req->sack_ok = (data >> 6) & 1;
+    req->tstamp_ok = (data >> 7) & 1;
+    req->window_clamp = TCP_WINDOW_DEFAULT;
+    req->cookie = true;
+    atomic_init(&req->rsk_refcnt, 1);
+    return req;
+}
+
+static void syncookie_init(void) {
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_REALTIME, &ts);
+    srand((unsigned int)(ts.tv_nsec ^ getpid()));
+    syncookie_secret[0] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+    syncookie_secret[1] = ((uint32_t)rand() << 16) ^ (uint32_t)rand() ^ (uint32_t)ts.tv_nsec;
+}
+
+/* Lockless MPSC push (Vyukov): any receive path may complete a request */
+static void reqsk_accept_push(struct request_sock_queue *q, struct request_sock *req) {
+    struct request_sock *prev;
+    
+    atomic_store_explicit(&req->accept_next, NULL, memory_order_relaxed);
+    prev = atomic_exchange_explicit(&q->accept_tail, req, memory_order_acq_rel);
+    atomic_store_explicit(&prev->accept_next, req, memory_order_release);
+}
+
+/* Single consumer (accept) pop; NULL if empty or a push is mid-flight */
+static struct request_sock *reqsk_queue_accept(struct request_sock_queue *q) {
+    struct request_sock *head = q->accept_head;
+    struct request_sock *next = atomic_load_explicit(&head->accept_next,
+                                                     memory_order_acquire);
+    
+    if (head == &q->accept_stub) {
+        if (!next)
+            return NULL;
+        q->accept_head = next;
+        head = next;
+        next = atomic_load_explicit(&next->accept_next, memory_order_acquire);
+    }
+    if (next) {
+        q->accept_head = next;
+        return head;
+    }
+    if (head != atomic_load_explicit(&q->accept_tail, memory_order_acquire))
+        return NULL;
+    
+    reqsk_accept_push(q, &q->accept_stub);
+    next = atomic_load_explicit(&head->accept_next, memory_order_acquire);
+    if (next) {
+        q->accept_head = next;
+        return head;
+    }
+    return NULL;
+}
+
+static int reqsk_queue_init(struct request_sock_queue *q, int max_qlen) {
+    int i;
+    
+    memset(q, 0, sizeof(*q));
+    q->max_qlen = max_qlen;
+    q->nr_table_entries = 1;
+    while (q->nr_table_entries < (uint32_t)max_qlen)
+        q->nr_table_entries <<= 1;
+    q->syn_table = calloc(q->nr_table_entries, sizeof(*q->syn_table));
+    if (!q->syn_table)
+        return -1;
+    for (i = 0; i < REQSK_LOCKS; i++)
+        pthread_mutex_init(&q->syn_locks[i], NULL);
+    timer_wheel_init(&q->syn_wheel, (uint64_t)time(NULL));
+    pthread_mutex_init(&q->syn_wheel_lock, NULL);
+    
+    atomic_init(&q->accept_stub.accept_next, NULL);
+    atomic_init(&q->accept_tail, &q->accept_stub);
+    q->accept_head = &q->accept_stub;
+    return 0;
+}
+
+static void reqsk_queue_destroy(struct request_sock_queue *q) {
+    struct request_sock *req, *next;
+    uint32_t i;
+    
+    for (i = 0; i < q->nr_table_entries; i++) {
+        for (req = q->syn_table[i]; req; req = next) {
+            next = req->next;
+            free(req);
+        }
+    }
+    while ((req = reqsk_queue_accept(q)) != NULL)
+        free(req);
+    for (i = 0; i < REQSK_LOCKS; i++)
+        pthread_mutex_destroy(&q->syn_locks[i]);
+    pthread_mutex_destroy(&q->syn_wheel_lock);
+    free(q->syn_table);
+}
+
+/* Drop a request reference; accept() owns the one a completed request keeps */
+static void reqsk_put(struct request_sock *req) {
+    if (atomic_fetch_sub(&req->rsk_refcnt, 1) == 1)
+        free(req);
+}
+
+/* Queued request for a 4-tuple; caller holds its syn lock */
+static struct request_sock *reqsk_lookup(struct request_sock_queue *q, uint32_t h,
+                                         uint32_t saddr, uint32_t daddr,
+                                         uint16_t sport, uint16_t dport) {
+    struct request_sock *req;
+    
+    for (req = q->syn_table[h & (q->nr_table_entries - 1)]; req; req = req->next) {
+        if (req->saddr == saddr && req->daddr == daddr &&
+            req->sport == sport && req->dport == dport)
+            return req;
+    }
+    return NULL;
+}
+
+/* Caller holds the request's syn lock */
+static void reqsk_unlink(struct request_sock_queue *q, uint32_t h,
+                         struct request_sock *req) {
+    struct request_sock **pprev;
+    
+    for (pprev = &q->syn_table[h & (q->nr_table_entries - 1)]; *pprev;
+         pprev = &(*pprev)->next) {
+        if (*pprev == req) {
+            *pprev = req->next;
+            break;
+        }
+    }
+    req->rsk_hashed = false;
+}
+
+/* (Re)arm the SYN-ACK timer; caller holds the request's syn lock */
+static void reqsk_timer_add(struct request_sock_queue *q, struct request_sock *req,
+                            time_t now) {
+    pthread_mutex_lock(&q->syn_wheel_lock);
+    timer_wheel_add(&q->syn_wheel, &req->rsk_timer, req->expires, (uint64_t)now);
+    pthread_mutex_unlock(&q->syn_wheel_lock);
+}
+
+/* Wheel callback, under syn_wheel_lock: the timer reference moves to the batch */
+static void reqsk_timer_fn(struct wheel_timer *timer, void *arg) {
+    struct request_sock *req = container_of(timer, struct request_sock, rsk_timer);
+    struct request_sock **batch = arg;
+    
+    req->expire_next = *batch;
+    *batch = req;
+}
+
+/*
+ * Run the SYN-ACK timers due by now. A request still half-open gets its
+ * SYN-ACK again with the timeout doubled, up to syn_ack_retries times;
+ * after that it is unlinked and gives its qlen slot back. Requests that
+ * completed meanwhile only drop the timer reference. Returns the number
+ * of requests dropped.
+ */
+static unsigned long reqsk_queue_expire(struct request_sock_queue *q, time_t now) {
+    struct request_sock *batch = NULL, *req, *next;
+    unsigned long dropped = 0;
+    
+    pthread_mutex_lock(&q->syn_wheel_lock);
+    timer_wheel_run(&q->syn_wheel, (uint64_t)now, &batch);
+    pthread_mutex_unlock(&q->syn_wheel_lock);
+    
+    for (req = batch; req; req = next) {
+        uint32_t h = tcp_tw_hash_func(req->saddr, req->daddr, req->sport, req->dport);
+        pthread_mutex_t *lock = &q->syn_locks[h & (REQSK_LOCKS - 1)];
+        bool armed = false, drop = false;
+        
+        next = req->expire_next;
+        pthread_mutex_lock(lock);
+        if (req->rsk_hashed) {
+            if ((uint32_t)now < req->expires) {
+                /* The wheel rounds; never act before the timeout */
+                reqsk_timer_add(q, req, now);
+                armed = true;
+            } else if (req->num_retrans < req->syn_ack_retries) {
+                req->num_retrans++;
+                req->expires = (uint32_t)now + (TCP_TIMEOUT_INIT << req->num_retrans);
+                reqsk_timer_add(q, req, now);
+                atomic_fetch_add(&q->synack_retrans, 1);
+                armed = true;
+            } else {
+                reqsk_unlink(q, h, req);
+                drop = true;
+            }
+        }
+        pthread_mutex_unlock(lock);
+        
+        if (drop) {
+            atomic_fetch_sub(&q->qlen, 1);
+            atomic_fetch_add(&q->reqs_expired, 1);
+            reqsk_put(req);     /* syn_table reference */
+            dropped++;
+        }
+        if (!armed)
+            reqsk_put(req);     /* Timer reference */
+    }
+    return dropped;
+}
+
+/*
+ * Handle a SYN for a listener. Returns 0 with the SYN-ACK ISN in *isn, or
+ * -1 if the SYN is dropped. Once the half-open queue is full (or always,
+ * with TCP_SYNCOOKIES_ALWAYS) the reply carries a cookie and no state is
+ * kept, so a SYN flood allocates nothing.
+ */
+static int tcp_conn_request(struct request_sock_queue *q,
+                            uint32_t saddr, uint32_t daddr,
+                            uint16_t sport, uint16_t dport, uint32_t seq,
+                            struct tcp_options_received *opt, uint32_t *isn) {
+    uint32_t h = tcp_tw_hash_func(saddr, daddr, sport, dport);
+    pthread_mutex_t *lock = &q->syn_locks[h & (REQSK_LOCKS - 1)];
+    struct request_sock *req, *dup;
+    struct tcphdr th;
+    time_t now;
+    bool want_cookie;
+    
+    /* A retransmitted SYN gets the queued request's SYN-ACK again */
+    pthread_mutex_lock(lock);
+    dup = reqsk_lookup(q, h, saddr, daddr, sport, dport);
+    if (dup)
+        *isn = dup->snt_isn;
+    pthread_mutex_unlock(lock);
+    if (dup) {
+        atomic_fetch_add(&q->synack_retrans, 1);
+        return 0;
+    }
+    
+    want_cookie = sysctl_tcp_syncookies == TCP_SYNCOOKIES_ALWAYS ||
+                  (sysctl_tcp_syncookies == TCP_SYNCOOKIES_ON_OVERFLOW &&
+                   atomic_load(&q->qlen) >= q->max_qlen);
+    
+    if (want_cookie) {
+        *isn = cookie_v4_init_sequence(saddr, daddr, sport, dport, seq, opt);
+        atomic_fetch_add(&q->cookies_sent, 1);
+        return 0;
+    }
+    
+    if (atomic_fetch_add(&q->qlen, 1) >= q->max_qlen) {
+        atomic_fetch_sub(&q->qlen, 1);
+        atomic_fetch_add(&q->drops, 1);
+        return -1;
+    }
+    
+    req = calloc(1, sizeof(*req));
+    if (!req) {
+        atomic_fetch_sub(&q->qlen, 1);
+        return -1;
+    }
+    
+    memset(&th, 0, sizeof(th));
+    th.seq = htonl(seq);
+    tcp_openreq_init(req, opt, &th);
+    req->saddr = saddr;
+    req->daddr = daddr;
+    req->sport = sport;
+    req->dport = dport;
+    wheel_timer_init(&req->rsk_timer, reqsk_timer_fn);
+    atomic_init(&req->rsk_refcnt, 2);   /* syn_table and timer */
+    
+    now = time(NULL);
+    pthread_mutex_lock(lock);
+    /* The same SYN on another receive path got there first */
+    dup = reqsk_lookup(q, h, saddr, daddr, sport, dport);
+    if (dup) {
+        *isn = dup->snt_isn;
+        pthread_mutex_unlock(lock);
+        atomic_fetch_sub(&q->qlen, 1);
+        free(req);
+        return 0;
+    }
+    req->next = q->syn_table[h & (q->nr_table_entries - 1)];
+    q->syn_table[h & (q->nr_table_entries - 1)] = req;
+    req->rsk_hashed = true;
+    req->expires = (uint32_t)now + TCP_TIMEOUT_INIT;
+    reqsk_timer_add(q, req, now);
+    *isn = req->snt_isn;
+    pthread_mutex_unlock(lock);
+    
+    atomic_fetch_add(&q->reqs_allocated, 1);
+    return 0;
+}
+
+/*
+ * Handle the ACK completing a handshake: match a queued request, or
+ * validate a cookie. The completed request goes to the accept queue,
+ * which owns a reference; drop it with reqsk_put().
+ */
+static struct request_sock *tcp_check_req(struct request_sock_queue *q,
+                                          uint32_t saddr, uint32_t daddr,
+                                          uint16_t sport, uint16_t dport,
+                                          uint32_t seq, uint32_t ack_seq) {
+    uint32_t h = tcp_tw_hash_func(saddr, daddr, sport, dport);
+    struct request_sock **pprev, *req = NULL;
+    
+    pthread_mutex_lock(&q->syn_locks[h & (REQSK_LOCKS - 1)]);
+    for (pprev = &q->syn_table[h & (q->nr_table_entries - 1)]; *pprev;
+         pprev = &(*pprev)->next) {
+        struct request_sock *r = *pprev;
+        
+        if (r->saddr == saddr && r->daddr == daddr &&
+            r->sport == sport && r->dport == dport &&
+            r->snt_isn + 1 == ack_seq && r->rcv_nxt == seq) {
+            *pprev = r->next;
+            r->rsk_hashed = false;
+            req = r;
+            /* A timer already firing drops its own reference */
+            pthread_mutex_lock(&q->syn_wheel_lock);
+            if (timer_wheel_del(&q->syn_wheel, &req->rsk_timer))
+                atomic_fetch_sub(&req->rsk_refcnt, 1);
+            pthread_mutex_unlock(&q->syn_wheel_lock);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&q->syn_locks[h & (REQSK_LOCKS - 1)]);
+    
+    if (req) {
+        atomic_fetch_sub(&q->qlen, 1);
+    } else if (sysctl_tcp_syncookies != TCP_SYNCOOKIES_OFF) {
+        req = cookie_v4_check(saddr, daddr, sport, dport, seq, ack_seq);
+        atomic_fetch_add(req ? &q->cookies_ok : &q->cookies_failed, 1);
+    }
+    
+    if (req)
+        reqsk_accept_push(q, req);
+    return req;
+}
+
+static double tcp_bench_elapsed(const struct timespec *t0) {
+    struct timespec t1;
+    
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) + (t1.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+/*
+ * Benchmark: a SYN flood of TCP_BENCH_SYNS half-open connections against
+ * a TCP_MAX_SYN_BACKLOG queue, then TCP_BENCH_TW TIME_WAIT sockets entered,
+ * looked up and expired through the wheel.
+ */
+#define TCP_BENCH_SYNS 4000000
+#define TCP_BENCH_TW 2000000
+
+static int tcp_run_minisocks_benchmark(void) {
+    struct request_sock_queue q;
+    struct tcp_options_received opt;
+    struct tcp_timewait_sock *tw;
+    struct request_sock *req;
+    struct timespec t0;
+    uint32_t daddr = inet_addr("192.168.1.1");
+    uint32_t i, saddr, isn, rtx_isn, hits = 0, accepted = 0;
+    uint16_t sport;
+    unsigned long expired = 0, batches = 0, reqs_dropped = 0, n;
+    time_t now;
+    double secs;
+    
+    syncookie_init();
+    tcp_timewait_init();
+    if (reqsk_queue_init(&q, TCP_MAX_SYN_BACKLOG) < 0)
+        return 1;
+    
+    memset(&opt, 0, sizeof(opt));
+    opt.mss = 1460;
+    opt.wscale = 7;
+    opt.wscale_ok = true;
+    opt.sack_ok = true;
+    opt.saw_tstamp = true;
+    
+    /* SYN flood: every SYN answered, only the first max_qlen allocate */
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < TCP_BENCH_SYNS; i++) {
+        saddr = htonl(0x0a000000 | (i >> 14));
+        sport = htons(1024 + (i & 0x3fff));
+        tcp_conn_request(&q, saddr, daddr, sport, htons(80), i, &opt, &isn);
+    }
+    secs = tcp_bench_elapsed(&t0);
+    printf("SYN flood: %u SYNs %.0f SYN/s, requests allocated=%lu cookies=%lu\n",
+           TCP_BENCH_SYNS, TCP_BENCH_SYNS / secs,
+           atomic_load(&q.reqs_allocated), atomic_load(&q.cookies_sent));
+    
+    /* Legitimate clients complete the handshake with the cookie ISN */
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < TCP_BENCH_SYNS; i++) {
+        saddr = htonl(0x0a000000 | (i >> 14));
+        sport = htons(1024 + (i & 0x3fff));
+        isn = cookie_v4_init_sequence(saddr, daddr, sport, htons(80), i, &opt);
+        tcp_check_req(&q, saddr, daddr, sport, htons(80), i + 1, isn + 1);
+        while ((req = reqsk_queue_accept(&q)) != NULL) {
+            if (req->cookie && req->mss == 1460 && req->rcv_wscale == 7 &&
+                req->sack_ok && req->tstamp_ok)
+                accepted++;
+            reqsk_put(req);
+        }
     }
+    secs = tcp_bench_elapsed(&t0);
+    printf("Cookie ACKs: %.0f ACK/s, valid=%lu invalid=%lu options-intact=%u\n",
+           TCP_BENCH_SYNS / secs, atomic_load(&q.cookies_ok),
+           atomic_load(&q.cookies_failed), accepted);
+    
+    /* The flood never answers its SYN-ACKs: retransmit, then free the slots */
+    for (now = time(NULL);
+         now <= time(NULL) + (TCP_TIMEOUT_INIT << (TCP_SYNACK_RETRIES + 1)) + 1; now++)
+        reqs_dropped += reqsk_queue_expire(&q, now);
+    saddr = htonl(0x0b000001);
+    tcp_conn_request(&q, saddr, daddr, htons(1024), htons(80), 0, &opt, &isn);
+    tcp_conn_request(&q, saddr, daddr, htons(1024), htons(80), 0, &opt, &rtx_isn);
+    printf("SYN-ACK timeouts: retransmits=%lu expired=%lu, then a new SYN %s "
+           "(qlen=%d, retransmitted SYN %s)\n",
+           atomic_load(&q.synack_retrans), reqs_dropped,
+           atomic_load(&q.reqs_allocated) == TCP_MAX_SYN_BACKLOG + 1 ? "queued" : "NOT queued",
+           atomic_load(&q.qlen), rtx_isn == isn ? "matched" : "NOT matched");
+    
+    /* TIME_WAIT: enter, look up, expire */
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < TCP_BENCH_TW; i++) {
+        tw = calloc(1, sizeof(*tw));
+        if (!tw)
+            break;
+        pthread_mutex_init(&tw->lock, NULL);
+        tw->tw_saddr = daddr;
+        tw->tw_daddr = htonl(0x0a000000 | (i >> 14));
+        tw->tw_sport = htons(80);
+        tw->tw_dport = htons(1024 + (i & 0x3fff));
+        tw->tw_rcv_wnd = TCP_WINDOW_DEFAULT;
+        tw->tw_substate = TCP_TIME_WAIT_SUBSTATE;
+        tcp_timewait_enter(tw);
+    }
+    secs = tcp_bench_elapsed(&t0);
+    printf("TIME_WAIT enter: %u socks %.0f/s, hash buckets=%u\n",
+           TCP_BENCH_TW, TCP_BENCH_TW / secs, tw_hashinfo.mask + 1);
+    
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < TCP_BENCH_TW; i++) {
+        tw = tcp_timewait_lookup(daddr, htonl(0x0a000000 | (i >> 14)),
+                                 htons(80), htons(1024 + (i & 0x3fff)));
+        if (tw) {
+            hits++;
+            tcp_tw_put(tw);
+        }
+    }
+    secs = tcp_bench_elapsed(&t0);
+    printf("TIME_WAIT lookup: %.0f lookups/s, hits=%u\n", TCP_BENCH_TW / secs, hits);
+    
+    /* Run the wheel over simulated time, one tick per second */
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (now = time(NULL); now <= time(NULL) + TCP_TIMEWAIT_LEN + 2; now++) {
+        n = tcp_tw_expire(now);
+        if (n)
+            batches++;
+        expired += n;
+    }
+    secs = tcp_bench_elapsed(&t0);
+    printf("TIME_WAIT expiry: %lu socks in %lu batches, %.0f expirations/s, left=%d\n",
+           expired, batches, expired / secs, atomic_load(&tw_hashinfo.count));
+    
+    reqsk_queue_destroy(&q);
+    tcp_timewait_cleanup();
+    return 0;
 }
 
 /* Example Usage */
-int main(void) {
+int main(int argc, char *argv[]) {
     struct tcp_timewait_sock *tw;
     struct tcphdr th;
-    struct tcp_options_received opt;
     uint32_t seq, end_seq;
     int ret;
     
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        return tcp_run_minisocks_benchmark();
+    
     /* Initialize TIME_WAIT system */
     tcp_timewait_init();
     
@@ -484,6 +1340,14 @@ int main(void) {
     ret = tcp_timewait_state_process(tw, &th, seq, end_seq);
     printf("Process result: %d\n", ret);
     
+    /* An in-window RST kills the TIME_WAIT socket */
+    th.fin = 0;
+    th.ack = 0;
+    th.rst = 1;
+    seq = tw->tw_rcv_nxt;
+    ret = tcp_timewait_state_process(tw, &th, seq, seq);
+    printf("RST result: %d\n", ret);
+    
     /* Cleanup */
     tcp_timewait_cleanup();
     
@@ -6,6 +6,8 @@
  * - TCP packet transmission
  * - Window management
  * - MSS/TSO handling
+ * - GSO super-segments split at the device boundary
+ * - TSO autosizing and EDT-based pacing
  * - Nagle algorithm
  * - Congestion control
  * - Retransmission
@@ -37,6 +39,25 @@
 #define TCP_RTO_MAX 120000  /* 120 seconds */
 #define TCP_INIT_RTO 3000  /* 3 seconds */
 
+/* GSO/TSO and pacing */
+#define TCP_GSO_MAX_SIZE 65536     /* Largest super-segment handed to the device */
+#define TCP_MAX_HEADER 320         /* Headroom reserved for headers (MAX_TCP_HEADER) */
+#define TCP_MIN_TSO_SEGS 2         /* Minimum TSO burst when pacing is slow */
+#define TCP_PACING_SHIFT 10        /* Autosize to ~1ms worth of pacing rate */
+#define TCP_PACING_UNLIMITED (~0ULL)
+#define NSEC_PER_SEC 1000000000ULL
+
+#define SEQ_LT(a, b) ((int32_t)((a) - (b)) < 0)
+#define SEQ_GT(a, b) ((int32_t)((a) - (b)) > 0)
+
+#ifndef min
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#endif
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+
 /* TCP Options */
 #define TCPOPT_NOP 1
 #define TCPOPT_EOL 0
@@ -45,20 +66,7 @@
 #define TCPOPT_SACK_PERMITTED 4
 #define TCPOPT_TIMESTAMP 8
 
-/* TCP States */
-enum tcp_state {
-    TCP_ESTABLISHED = 1,
-    TCP_SYN_SENT,
-    TCP_SYN_RECV,
-    TCP_FIN_WAIT1,
-    TCP_FIN_WAIT2,
-    TCP_TIME_WAIT,
-    TCP_CLOSE,
-    TCP_CLOSE_WAIT,
-    TCP_LAST_ACK,
-    TCP_LISTEN,
-    TCP_CLOSING
-};
+/* TCP states (TCP_ESTABLISHED ... TCP_CLOSING) come from <netinet/tcp.h> */
 
 /* TCP Segment */
 struct tcp_segment {
@@ -66,7 +74,11 @@ struct tcp_segment {
     uint32_t seq;
     uint32_t end_seq;
     uint32_t when;  /* Timestamp when sent */
-    uint16_t len;
+    uint64_t tstamp_ns;  /* EDT: earliest departure time */
+    uint32_t len;
+    uint32_t truesize;   /* Allocated payload capacity */
+    uint16_t gso_size;   /* Wire MSS used when the device splits it */
+    uint16_t gso_segs;   /* Wire packets this segment accounts for */
     uint8_t flags;
     uint8_t retries;
     bool acked;
@@ -123,10 +135,25 @@ struct tcp_sock {
     bool cork;           /* TCP_CORK set? */
     uint32_t mss_cache;  /* Current MSS including TCP options */
     
+    /* GSO/TSO */
+    uint32_t write_seq;  /* Tail of data queued by the user */
+    struct tcp_segment *xmit_head; /* First not-yet-sent segment */
+    uint32_t gso_max_size; /* Device GSO limit (bytes) */
+    uint64_t xmit_units; /* Segments passed down the stack */
+    uint64_t dev_frames; /* Wire frames produced by the device */
+    
+    /* Pacing (EDT model) */
+    uint64_t pacing_rate;   /* Bytes per second, ~0 = unpaced */
+    uint64_t tcp_wstamp_ns; /* Departure time of the next segment */
+    uint64_t pacing_timer;  /* Armed pacing timer expiry (ns), 0 = idle */
+    
     /* Timers */
     uint32_t rto_timer;  /* Retransmission timer */
     uint32_t probe_timer;/* Zero window probe timer */
     
+    /* Raw socket segments are sent on, -1 if none */
+    int sock_fd;
+    
     /* Locks */
     pthread_mutex_t lock;
 };
@@ -138,6 +165,13 @@ static uint32_t tcp_time_now(void) {
     return (ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
 }
 
+/* Get current time in nanoseconds (EDT clock) */
+static uint64_t tcp_clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
 /* Initialize TCP socket */
 static void tcp_init_sock(struct tcp_sock *tp) {
     memset(tp, 0, sizeof(*tp));
@@ -148,6 +182,9 @@ static void tcp_init_sock(struct tcp_sock *tp) {
     tp->ssthresh = TCP_MAX_WINDOW;
     tp->rto = TCP_INIT_RTO;
     tp->mss_cache = TCP_DEFAULT_MSS;
+    tp->gso_max_size = TCP_GSO_MAX_SIZE;
+    tp->pacing_rate = TCP_PACING_UNLIMITED;
+    tp->sock_fd = -1;
     pthread_mutex_init(&tp->lock, NULL);
 }
 
@@ -179,6 +216,7 @@ static struct tcp_segment *tcp_alloc_segment(uint32_t size) {
     if (seg) {
         memset(seg, 0, sizeof(*seg));
         seg->len = size;
+        seg->truesize = size;
     }
     return seg;
 }
@@ -234,9 +272,14 @@ static bool tcp_nagle_check(struct tcp_sock *tp, struct tcp_segment *seg) {
     return false;
 }
 
+/* Number of wire packets a (possibly GSO) segment accounts for */
+static inline uint32_t tcp_skb_pcount(const struct tcp_segment *seg) {
+    return seg->gso_segs ? seg->gso_segs : 1;
+}
+
 /* Congestion control - slow start */
-static void tcp_slow_start(struct tcp_sock *tp) {
-    tp->cwnd += 1;
+static void tcp_slow_start(struct tcp_sock *tp, uint32_t acked) {
+    tp->cwnd += acked;
     if (tp->cwnd >= tp->ssthresh)
         tp->cwnd = tp->ssthresh;
 }
@@ -269,19 +312,21 @@ static void tcp_handle_rto(struct tcp_sock *tp) {
 /* Process incoming ACK */
 static void tcp_handle_ack(struct tcp_sock *tp, uint32_t ack_seq, uint32_t win) {
     struct tcp_segment *seg = tp->send_head;
-    bool new_data = false;
+    uint32_t acked_pkts = 0;
     
     /* Update send window */
     tp->snd_wnd = win;
+    if (SEQ_GT(ack_seq, tp->snd_una))
+        tp->snd_una = ack_seq;
     
     /* Process acknowledged segments */
     while (seg) {
-        if (SEQ_LT(seg->seq, ack_seq)) {
+        if (!SEQ_GT(seg->end_seq, ack_seq)) {
             /* Segment fully acknowledged */
             if (!seg->acked) {
                 seg->acked = true;
-                tp->packets_out--;
-                new_data = true;
+                tp->packets_out -= tcp_skb_pcount(seg);
+                acked_pkts += tcp_skb_pcount(seg);
                 
                 /* Update RTT if we were measuring it */
                 if (seg->seq == tp->rtt_seq) {
@@ -304,9 +349,9 @@ static void tcp_handle_ack(struct tcp_sock *tp, uint32_t ack_seq, uint32_t win)
     }
     
     /* Update congestion control */
-    if (new_data) {
+    if (acked_pkts) {
         if (tp->cwnd < tp->ssthresh)
-            tcp_slow_start(tp);
+            tcp_slow_start(tp, acked_pkts);
         else
             tcp_cong_avoid(tp);
     }
@@ -317,8 +362,9 @@ static int tcp_transmit_segment(struct tcp_sock *tp, struct tcp_segment *seg) {
     struct sockaddr_in dest;
     struct tcphdr th;
     struct msghdr msg;
-    struct iovec iov[2];
-    char control[TCP_MAX_MSS];
+    struct iovec iov[3];
+    char control[40];   /* TCP options, at most 40 bytes */
+    size_t optlen = 0;
     int ret;
     
     /* Build TCP header */
@@ -329,7 +375,7 @@ static int tcp_transmit_segment(struct tcp_sock *tp, struct tcp_segment *seg) {
     th.ack_seq = htonl(tp->rcv_nxt);
     th.window = htons(tp->rcv_wnd);
     th.doff = 5;  /* 5 * 4 = 20 bytes */
-    th.flags = seg->flags;
+    th.th_flags = seg->flags;
     
     /* Add TCP options */
     if (seg->seq == tp->snd_nxt) {  /* First transmission */
@@ -366,8 +412,11 @@ static int tcp_transmit_segment(struct tcp_sock *tp, struct tcp_segment *seg) {
             ptr += 4;
         }
         
-        /* Update header length */
-        th.doff = (ptr - control + 3) / 4;
+        /* Pad the options to a 32-bit boundary; update header length */
+        optlen = ptr - control;
+        while (optlen % 4)
+            control[optlen++] = TCPOPT_EOL;
+        th.doff = 5 + optlen / 4;
     }
     
     /* Prepare socket address */
@@ -378,16 +427,18 @@ static int tcp_transmit_segment(struct tcp_sock *tp, struct tcp_segment *seg) {
     
     /* Set up IO vector */
     iov[0].iov_base = &th;
-    iov[0].iov_len = th.doff * 4;
-    iov[1].iov_base = seg->data;
-    iov[1].iov_len = seg->len;
+    iov[0].iov_len = sizeof(th);
+    iov[1].iov_base = control;
+    iov[1].iov_len = optlen;
+    iov[2].iov_base = seg->data;
+    iov[2].iov_len = seg->len;
     
     /* Set up message header */
     memset(&msg, 0, sizeof(msg));
     msg.msg_name = &dest;
     msg.msg_namelen = sizeof(dest);
     msg.msg_iov = iov;
-    msg.msg_iovlen = 2;
+    msg.msg_iovlen = 3;
     
     /* Send segment */
     ret = sendmsg(tp->sock_fd, &msg, 0);
@@ -460,13 +511,299 @@ static void tcp_write_xmit(struct tcp_sock *tp) {
     }
 }
 
+/*
+ * TSO autosizing: size bursts to roughly 1ms worth of the pacing rate so a
+ * slow flow does not dump a 64KB burst into the network at once, while a
+ * fast flow always fills the device GSO limit.
+ */
+static uint32_t tcp_tso_autosize(struct tcp_sock *tp, uint32_t mss_now) {
+    uint64_t bytes, limit;
+
+    if (tp->pacing_rate == TCP_PACING_UNLIMITED)
+        bytes = tp->gso_max_size;
+    else
+        bytes = tp->pacing_rate >> TCP_PACING_SHIFT;
+
+    /* A device limit below the header reserve leaves no payload room */
+    limit = tp->gso_max_size > TCP_MAX_HEADER ?
+            tp->gso_max_size - TCP_MAX_HEADER : 0;
+    bytes = min(bytes, limit);
+    return max((uint32_t)(bytes / mss_now), (uint32_t)TCP_MIN_TSO_SEGS);
+}
+
+/* Payload size the send path should aim for when building a super-segment */
+static uint32_t tcp_gso_size_goal(struct tcp_sock *tp) {
+    uint32_t mss_now = tp->mss_cache;
+
+    if (tp->gso_max_size <= mss_now)
+        return mss_now;
+    return tcp_tso_autosize(tp, mss_now) * mss_now;
+}
+
+/*
+ * Queue user data. Instead of one segment per MSS, data is appended to the
+ * unsent tail until it reaches the size goal, so a bulk write becomes a few
+ * 64KB super-segments.
+ */
+static int tcp_sendmsg_gso(struct tcp_sock *tp, const char *buf, uint32_t len) {
+    uint32_t size_goal = tcp_gso_size_goal(tp);
+    uint32_t copied = 0;
+
+    while (copied < len) {
+        struct tcp_segment *seg = tp->send_tail;
+        uint32_t copy;
+
+        /* Only an unsent tail segment with spare room may grow */
+        if (!tp->xmit_head || seg->len >= seg->truesize) {
+            /* Send buffer limit: TCP_MAX_QUEUE full-sized packets */
+            if (tp->write_seq - tp->snd_una >= TCP_MAX_QUEUE * tp->mss_cache)
+                break;
+
+            seg = tcp_alloc_segment(size_goal);
+            if (!seg)
+                break;
+            seg->len = 0;
+            seg->seq = tp->write_seq;
+            seg->end_seq = tp->write_seq;
+            tcp_queue_segment(tp, seg);
+            if (!tp->xmit_head)
+                tp->xmit_head = seg;
+        }
+
+        copy = min(len - copied, seg->truesize - seg->len);
+        memcpy(seg->data + seg->len, buf + copied, copy);
+        seg->len += copy;
+        seg->end_seq += copy;
+        tp->write_seq += copy;
+        copied += copy;
+    }
+
+    return copied ? (int)copied : -EAGAIN;
+}
+
+/*
+ * Split a queued super-segment so that the first part carries len bytes.
+ * Used when cwnd, the receive window or the autosize limit allow only part
+ * of it to go out now.
+ */
+static int tcp_tso_fragment(struct tcp_sock *tp, struct tcp_segment *seg,
+                            uint32_t len) {
+    uint32_t nlen = seg->len - len;
+    struct tcp_segment *buff = tcp_alloc_segment(nlen);
+
+    if (!buff)
+        return -ENOMEM;
+
+    memcpy(buff->data, seg->data + len, nlen);
+    buff->seq = seg->seq + len;
+    buff->end_seq = seg->end_seq;
+    seg->len = len;
+    seg->end_seq = buff->seq;
+
+    buff->next = seg->next;
+    seg->next = buff;
+    if (tp->send_tail == seg)
+        tp->send_tail = buff;
+    return 0;
+}
+
+/*
+ * Device boundary: software GSO splits the super-segment into gso_segs wire
+ * frames. The simulated device has no frame buffers to build headers into,
+ * so only the frame count is recorded.
+ */
+static void tcp_gso_segment(struct tcp_sock *tp, struct tcp_segment *seg) {
+    tp->dev_frames += seg->gso_segs;
+}
+
+/* Hand one (super-)segment to the device */
+static int tcp_transmit_gso(struct tcp_sock *tp, struct tcp_segment *seg) {
+    uint32_t mss_now = tp->mss_cache;
+
+    seg->gso_size = mss_now;
+    seg->gso_segs = DIV_ROUND_UP(seg->len, mss_now);
+    seg->when = tcp_time_now();
+    if (!tp->rtt_seq)
+        tp->rtt_seq = seg->seq;
+
+    tcp_gso_segment(tp, seg);
+    tp->packets_out += seg->gso_segs;
+    tp->xmit_units++;
+    return seg->len;
+}
+
+/* Pacing: returns true (and arms the pacing timer) if we must wait */
+static bool tcp_pacing_check(struct tcp_sock *tp, uint64_t now) {
+    if (tp->pacing_rate == TCP_PACING_UNLIMITED)
+        return false;
+    if (tp->tcp_wstamp_ns <= now)
+        return false;
+
+    tp->pacing_timer = tp->tcp_wstamp_ns;
+    return true;
+}
+
+/* EDT: stamp the departure time and advance the next one by len/rate */
+static void tcp_update_skb_after_send(struct tcp_sock *tp,
+                                      struct tcp_segment *seg, uint64_t now) {
+    uint64_t len_ns;
+
+    tp->tcp_wstamp_ns = max(tp->tcp_wstamp_ns, now);
+    seg->tstamp_ns = tp->tcp_wstamp_ns;
+    if (tp->pacing_rate == TCP_PACING_UNLIMITED)
+        return;
+
+    len_ns = (uint64_t)seg->len * NSEC_PER_SEC / tp->pacing_rate;
+    tp->tcp_wstamp_ns += len_ns;
+}
+
+/* Sleep until the armed pacing timer fires */
+static void tcp_pacing_timer_wait(struct tcp_sock *tp) {
+    struct timespec ts;
+
+    if (!tp->pacing_timer)
+        return;
+    ts.tv_sec = tp->pacing_timer / NSEC_PER_SEC;
+    ts.tv_nsec = tp->pacing_timer % NSEC_PER_SEC;
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    tp->pacing_timer = 0;
+}
+
+/*
+ * GSO transmission path: one cwnd/window/Nagle/pacing decision per
+ * super-segment rather than per MSS.
+ */
+static int tcp_write_xmit_gso(struct tcp_sock *tp) {
+    struct tcp_segment *seg;
+    uint32_t mss_now = tp->mss_cache;
+    uint64_t now = tcp_clock_ns();
+    int sent = 0;
+
+    while ((seg = tp->xmit_head) != NULL) {
+        uint32_t cwnd_quota, limit;
+
+        if (tcp_pacing_check(tp, now))
+            break;
+
+        cwnd_quota = tp->cwnd > tp->packets_out ? tp->cwnd - tp->packets_out : 0;
+        if (!cwnd_quota)
+            break;
+
+        /* Receive window */
+        if (!SEQ_LT(seg->seq, tp->snd_una + tp->snd_wnd))
+            break;
+        limit = min(cwnd_quota * mss_now, tp->snd_una + tp->snd_wnd - seg->seq);
+        limit = min(limit, tcp_tso_autosize(tp, mss_now) * mss_now);
+
+        if (seg->len > limit) {
+            limit -= limit % mss_now;
+            if (!limit || tcp_tso_fragment(tp, seg, limit) < 0)
+                break;
+        }
+
+        if (!tcp_nagle_check(tp, seg))
+            break;
+
+        if (tcp_transmit_gso(tp, seg) <= 0)
+            break;
+
+        tp->xmit_head = seg->next;
+        tp->snd_nxt = seg->end_seq;
+        tcp_update_skb_after_send(tp, seg, now);
+        sent++;
+    }
+
+    return sent;
+}
+
+/*
+ * Bulk transfer benchmark: push total bytes through the GSO path against a
+ * loopback peer that ACKs everything in flight. gso_max_size == MSS models
+ * the legacy one-segment-per-MSS behaviour.
+ */
+static void tcp_bulk_benchmark(const char *name, uint32_t gso_max_size,
+                               uint64_t pacing_rate, uint64_t total) {
+    static char chunk[TCP_GSO_MAX_SIZE];
+    struct tcp_sock tp;
+    struct tcp_segment *seg;
+    uint64_t start, elapsed;
+    clock_t cpu_start;
+    double cpu;
+
+    tcp_init_sock(&tp);
+    tp.state = TCP_ESTABLISHED;
+    tp.mss_cache = 1460;
+    tp.snd_wnd = TCP_MAX_WINDOW;
+    tp.gso_max_size = gso_max_size;
+    tp.pacing_rate = pacing_rate;
+
+    start = tcp_clock_ns();
+    cpu_start = clock();
+
+    while ((uint64_t)tp.snd_una < total && tp.state == TCP_ESTABLISHED) {
+        /* Keep the send buffer full, like a bulk writer would */
+        while ((uint64_t)tp.write_seq < total &&
+               tcp_sendmsg_gso(&tp, chunk, min((uint64_t)sizeof(chunk),
+                                               total - tp.write_seq)) > 0)
+            ;
+
+        tcp_write_xmit_gso(&tp);
+        tcp_handle_ack(&tp, tp.snd_nxt, TCP_MAX_WINDOW);
+        tcp_pacing_timer_wait(&tp);
+    }
+
+    elapsed = tcp_clock_ns() - start;
+    cpu = (double)(clock() - cpu_start) / CLOCKS_PER_SEC;
+
+    printf("%-10s units=%-8llu frames=%-8llu avg_unit=%-6llu "
+           "wall=%.3fs cpu=%.3fs\n",
+           name, (unsigned long long)tp.xmit_units,
+           (unsigned long long)tp.dev_frames,
+           (unsigned long long)(tp.xmit_units ? total / tp.xmit_units : 0),
+           elapsed / 1e9, cpu);
+
+    while (tp.send_head) {
+        seg = tp.send_head;
+        tp.send_head = seg->next;
+        tcp_free_segment(seg);
+    }
+    pthread_mutex_destroy(&tp.lock);
+}
+
+static int tcp_run_gso_benchmark(void) {
+    const uint64_t total = 256ULL << 20;   /* 256MB */
+    const uint64_t rates[] = { 12500000ULL, 125000000ULL, 1250000000ULL };
+    struct tcp_sock tp;
+    size_t i;
+
+    tcp_init_sock(&tp);
+    tp.mss_cache = 1460;
+    printf("TSO autosize (mss 1460):\n");
+    for (i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+        tp.pacing_rate = rates[i];
+        printf("  pacing %5llu Mbit/s -> %u segs/burst\n",
+               (unsigned long long)(rates[i] * 8 / 1000000),
+               tcp_tso_autosize(&tp, tp.mss_cache));
+    }
+    pthread_mutex_destroy(&tp.lock);
+
+    printf("Bulk transfer of %llu MB:\n", (unsigned long long)(total >> 20));
+    tcp_bulk_benchmark("per-MSS", 1460, TCP_PACING_UNLIMITED, total);
+    tcp_bulk_benchmark("GSO", TCP_GSO_MAX_SIZE, TCP_PACING_UNLIMITED, total);
+    tcp_bulk_benchmark("GSO+pace", TCP_GSO_MAX_SIZE, 5000000000ULL, total);
+    return 0;
+}
+
 /* Example usage */
-int main(void) {
+int main(int argc, char *argv[]) {
     struct tcp_sock tp;
     struct tcp_segment *seg;
     char data[] = "Hello, TCP!";
     int i;
     
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        return tcp_run_gso_benchmark();
+    
     /* Initialize socket */
     tcp_init_sock(&tp);
     tp.state = TCP_ESTABLISHED;
@@ -0,0 +1,340 @@
+/*
+ * Hierarchical Timer Wheel Simulation
+ * Shared by alarmtimer_sim.c, clockevents_sim.c and tcp_minisocks_sim.c
+ *
+ * Timeouts are measured in ticks and hashed into WHEEL_DEPTH levels of
+ * WHEEL_LVL_SIZE buckets.  Level n has a granularity of 8^n ticks, so
+ * with 8 levels of 64 buckets one wheel covers about 2^27 ticks:
+ *
+ *   level  granularity   range (ticks)
+ *     0          1              0 -         63
+ *     1          8             64 -        511
+ *     2         64            512 -       4095
+ *     ...
+ *     7    2097152      117440512 -  134217727
+ *
+ * A timer is placed once, at the level where its timeout fits, and
+ * never cascades down: it fires when its bucket comes due, up to one
+ * granule (about 12%) late.  That is the trade for O(1) add and cancel,
+ * which is what timeouts need: they are mostly cancelled or re-armed
+ * long before they would expire.
+ *
+ * Each level keeps a 64-bit map of non-empty buckets.  Expiry collects
+ * a whole bucket per level in one step, and the next expiry (how long a
+ * NOHZ CPU may sleep) is found from the maps with a rotate and a count
+ * of trailing zeros per level, without touching any timer.
+ */
+
+#ifndef _TIMER_WHEEL_SIM_H
+#define _TIMER_WHEEL_SIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifndef container_of
+#define container_of(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+#endif
+
+#define WHEEL_LVL_CLK_SHIFT  3
+#define WHEEL_LVL_CLK_DIV    (1U << WHEEL_LVL_CLK_SHIFT)
+#define WHEEL_LVL_CLK_MASK   (WHEEL_LVL_CLK_DIV - 1)
+#define WHEEL_LVL_BITS       6
+#define WHEEL_LVL_SIZE       (1U << WHEEL_LVL_BITS)
+#define WHEEL_LVL_MASK       (WHEEL_LVL_SIZE - 1)
+#define WHEEL_DEPTH          8
+#define WHEEL_SIZE           (WHEEL_LVL_SIZE * WHEEL_DEPTH)
+
+#define WHEEL_LVL_SHIFT(n)   ((n) * WHEEL_LVL_CLK_SHIFT)
+#define WHEEL_LVL_GRAN(n)    (1ULL << WHEEL_LVL_SHIFT(n))
+#define WHEEL_LVL_OFFS(n)    ((n) * WHEEL_LVL_SIZE)
+/* First timeout that no longer fits level n - 1 */
+#define WHEEL_LVL_START(n)   ((uint64_t)(WHEEL_LVL_SIZE - 1) << (((n) - 1) * WHEEL_LVL_CLK_SHIFT))
+
+/* Longer timeouts are clamped to the last bucket of the last level */
+#define WHEEL_TIMEOUT_CUTOFF WHEEL_LVL_START(WHEEL_DEPTH)
+#define WHEEL_TIMEOUT_MAX    (WHEEL_TIMEOUT_CUTOFF - WHEEL_LVL_GRAN(WHEEL_DEPTH - 1))
+
+#define WHEEL_NO_EXPIRY      UINT64_MAX
+
+struct wheel_timer;
+
+typedef void (*wheel_timer_fn)(struct wheel_timer *timer, void *arg);
+
+struct wheel_timer {
+    struct wheel_timer *next;
+    struct wheel_timer **pprev;     /* NULL when not pending */
+    uint64_t expires;               /* ticks */
+    unsigned int idx;               /* bucket while pending */
+    wheel_timer_fn function;
+};
+
+struct timer_wheel {
+    uint64_t clk;                   /* next tick to process */
+    uint64_t next_expiry;           /* earliest bucket expiry, a lower bound */
+    bool next_expiry_recalc;        /* a bucket emptied since it was computed */
+    size_t nr_timers;
+    uint64_t pending_map[WHEEL_DEPTH];
+    struct wheel_timer *vectors[WHEEL_SIZE];
+};
+
+static inline void timer_wheel_init(struct timer_wheel *wheel, uint64_t now)
+{
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->clk = now;
+    wheel->next_expiry = WHEEL_NO_EXPIRY;
+}
+
+static inline void wheel_timer_init(struct wheel_timer *timer, wheel_timer_fn function)
+{
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->expires = 0;
+    timer->idx = 0;
+    timer->function = function;
+}
+
+static inline bool wheel_timer_pending(const struct wheel_timer *timer)
+{
+    return timer->pprev != NULL;
+}
+
+/* Bucket of a timeout at level lvl, rounded up to the level's granule */
+static inline unsigned int wheel_calc_index(uint64_t expires, unsigned int lvl,
+                                            uint64_t *bucket_expiry)
+{
+    expires = (expires + WHEEL_LVL_GRAN(lvl) - 1) >> WHEEL_LVL_SHIFT(lvl);
+    *bucket_expiry = expires << WHEEL_LVL_SHIFT(lvl);
+    return WHEEL_LVL_OFFS(lvl) + (unsigned int)(expires & WHEEL_LVL_MASK);
+}
+
+static inline unsigned int wheel_calc_wheel_index(uint64_t expires, uint64_t clk,
+                                                  uint64_t *bucket_expiry)
+{
+    /* Already due: the bucket processed next */
+    if (expires < clk) {
+        *bucket_expiry = clk;
+        return (unsigned int)(clk & WHEEL_LVL_MASK);
+    }
+
+    uint64_t delta = expires - clk;
+    unsigned int lvl = 0;
+
+    if (delta >= WHEEL_TIMEOUT_CUTOFF) {
+        expires = clk + WHEEL_TIMEOUT_MAX;
+        lvl = WHEEL_DEPTH - 1;
+    } else {
+        while (lvl < WHEEL_DEPTH - 1 && delta >= WHEEL_LVL_START(lvl + 1))
+            lvl++;
+    }
+    return wheel_calc_index(expires, lvl, bucket_expiry);
+}
+
+/* Distance from bucket clk to the next pending bucket of a level, -1 if none */
+static inline int wheel_next_pending_bucket(const struct timer_wheel *wheel, unsigned int lvl,
+                                            unsigned int clk)
+{
+    uint64_t map = wheel->pending_map[lvl];
+
+    if (!map)
+        return -1;
+    map = clk ? (map >> clk) | (map << (WHEEL_LVL_SIZE - clk)) : map;
+    return __builtin_ctzll(map);
+}
+
+/*
+ * Earliest bucket expiry, from the pending maps alone.  A level is only
+ * looked at if its buckets could come due before the lower level wraps
+ * around to its next level-up boundary.
+ */
+static inline uint64_t wheel_next_timer_interrupt(struct timer_wheel *wheel)
+{
+    uint64_t next = WHEEL_NO_EXPIRY;
+    uint64_t clk = wheel->clk;
+
+    for (unsigned int lvl = 0; lvl < WHEEL_DEPTH; lvl++) {
+        int pos = wheel_next_pending_bucket(wheel, lvl, (unsigned int)(clk & WHEEL_LVL_MASK));
+        unsigned int lvl_clk = (unsigned int)(clk & WHEEL_LVL_CLK_MASK);
+
+        if (pos >= 0) {
+            uint64_t tmp = (clk + (uint64_t)pos) << WHEEL_LVL_SHIFT(lvl);
+            if (tmp < next)
+                next = tmp;
+
+            /* Due before this level's clock ticks over into the next level */
+            if ((unsigned int)pos <= ((WHEEL_LVL_CLK_DIV - lvl_clk) & WHEEL_LVL_CLK_MASK))
+                break;
+        }
+
+        clk >>= WHEEL_LVL_CLK_SHIFT;
+        clk += lvl_clk ? 1 : 0;
+    }
+
+    wheel->next_expiry_recalc = false;
+    return next;
+}
+
+/* NOHZ: the tick at which the next timer is due, WHEEL_NO_EXPIRY if none */
+static inline uint64_t timer_wheel_next_expiry(struct timer_wheel *wheel)
+{
+    if (wheel->next_expiry_recalc)
+        wheel->next_expiry = wheel_next_timer_interrupt(wheel);
+    return wheel->next_expiry;
+}
+
+/*
+ * An idle wheel is not run, so clk falls behind.  Bring it up to now
+ * before placing a timer so the timeout picks its level from the real
+ * distance; clk never passes a bucket that is still due.
+ */
+static inline void timer_wheel_forward(struct timer_wheel *wheel, uint64_t now)
+{
+    if (now <= wheel->clk)
+        return;
+
+    uint64_t next = timer_wheel_next_expiry(wheel);
+    if (next > now)
+        wheel->clk = now;
+    else if (next > wheel->clk)
+        wheel->clk = next;
+}
+
+static inline void wheel_detach(struct timer_wheel *wheel, struct wheel_timer *timer)
+{
+    unsigned int idx = timer->idx;
+
+    *timer->pprev = timer->next;
+    if (timer->next)
+        timer->next->pprev = timer->pprev;
+    timer->next = NULL;
+    timer->pprev = NULL;
+
+    if (!wheel->vectors[idx]) {
+        wheel->pending_map[idx / WHEEL_LVL_SIZE] &= ~(1ULL << (idx % WHEEL_LVL_SIZE));
+        wheel->next_expiry_recalc = true;
+    }
+}
+
+/* Cancel: O(1); true if the timer was pending */
+static inline bool timer_wheel_del(struct timer_wheel *wheel, struct wheel_timer *timer)
+{
+    if (!wheel_timer_pending(timer))
+        return false;
+
+    /* A timer collected for expiry sits on a private list, not in a bucket */
+    if (timer->idx < WHEEL_SIZE) {
+        wheel_detach(wheel, timer);
+    } else {
+        *timer->pprev = timer->next;
+        if (timer->next)
+            timer->next->pprev = timer->pprev;
+        timer->next = NULL;
+        timer->pprev = NULL;
+    }
+    wheel->nr_timers--;
+    return true;
+}
+
+/* Add or re-arm: O(1) */
+static inline void timer_wheel_add(struct timer_wheel *wheel, struct wheel_timer *timer,
+                                   uint64_t expires, uint64_t now)
+{
+    uint64_t bucket_expiry;
+
+    timer_wheel_del(wheel, timer);
+    timer_wheel_forward(wheel, now);
+
+    unsigned int idx = wheel_calc_wheel_index(expires, wheel->clk, &bucket_expiry);
+    struct wheel_timer **head = &wheel->vectors[idx];
+
+    timer->expires = expires;
+    timer->idx = idx;
+    timer->next = *head;
+    if (*head)
+        (*head)->pprev = &timer->next;
+    *head = timer;
+    timer->pprev = head;
+    wheel->pending_map[idx / WHEEL_LVL_SIZE] |= 1ULL << (idx % WHEEL_LVL_SIZE);
+    wheel->nr_timers++;
+
+    if (bucket_expiry < wheel->next_expiry)
+        wheel->next_expiry = bucket_expiry;
+}
+
+/*
+ * Append the bucket due at clk on every level that turns over at clk
+ * to the list ending at tail.  Returns the new tail.
+ */
+static inline struct wheel_timer **wheel_collect_expired(struct timer_wheel *wheel,
+                                                         struct wheel_timer **tail)
+{
+    uint64_t clk = wheel->clk;
+
+    for (unsigned int lvl = 0; lvl < WHEEL_DEPTH; lvl++) {
+        unsigned int idx = (unsigned int)(clk & WHEEL_LVL_MASK) + WHEEL_LVL_OFFS(lvl);
+        uint64_t bit = 1ULL << (idx % WHEEL_LVL_SIZE);
+
+        if (wheel->pending_map[lvl] & bit) {
+            struct wheel_timer *timer = wheel->vectors[idx];
+
+            wheel->pending_map[lvl] &= ~bit;
+            wheel->vectors[idx] = NULL;
+            *tail = timer;
+            timer->pprev = tail;
+            for (; timer; timer = timer->next) {
+                timer->idx = WHEEL_SIZE;    /* off the wheel */
+                tail = &timer->next;
+            }
+        }
+        if (clk & WHEEL_LVL_CLK_MASK)
+            break;
+        clk >>= WHEEL_LVL_CLK_SHIFT;
+    }
+    return tail;
+}
+
+/*
+ * Run every timer due at or before now.  Ticks with nothing due are
+ * skipped in one step, so a wheel left idle for a long time costs no
+ * more to catch up than one that ran every tick.  All due buckets are
+ * collected before any callback runs, so a callback re-adding its timer
+ * is placed relative to now; callbacks may also cancel timers still
+ * waiting on the expired list.  Returns the number of timers run.
+ */
+static inline size_t timer_wheel_run(struct timer_wheel *wheel, uint64_t now, void *arg)
+{
+    struct wheel_timer *expired = NULL, **tail = &expired;
+    size_t fired = 0;
+
+    while (now >= wheel->clk && now >= timer_wheel_next_expiry(wheel)) {
+        /* Nothing is due before next_expiry */
+        if (wheel->clk < wheel->next_expiry)
+            wheel->clk = wheel->next_expiry;
+
+        tail = wheel_collect_expired(wheel, tail);
+        wheel->clk++;
+        wheel->next_expiry = wheel_next_timer_interrupt(wheel);
+    }
+
+    /* Every tick up to now is done */
+    if (wheel->clk <= now)
+        wheel->clk = now + 1;
+
+    struct wheel_timer *timer;
+    while ((timer = expired)) {
+        expired = timer->next;
+        if (expired)
+            expired->pprev = &expired;
+        timer->next = NULL;
+        timer->pprev = NULL;
+        wheel->nr_timers--;
+        fired++;
+        if (timer->function)
+            timer->function(timer, arg);
+    }
+    return fired;
+}
+
+#endif /* _TIMER_WHEEL_SIM_H */
@@ -0,0 +1,333 @@
+/*
+ * Timerqueue Simulation
+ * Shared by hrtimer_sim.c and alarmtimer_sim.c
+ *
+ * A timerqueue holds timers ordered by expiry in a red-black tree and
+ * caches the leftmost node, so the next timer to fire is found in O(1)
+ * and adding or removing one costs O(log n) however many are armed.
+ * Equal expiries insert to the right: timers due at the same time stay
+ * in the order they were queued.
+ *
+ * Nodes are embedded in the structure that owns them; container_of()
+ * gets back to it.  A node that is not queued has an empty (self)
+ * parent link, so timerqueue_node_queued() is O(1) as well.
+ */
+
+#ifndef _TIMERQUEUE_SIM_H
+#define _TIMERQUEUE_SIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef container_of
+#define container_of(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+#endif
+
+enum rb_color {
+    RB_RED,
+    RB_BLACK
+};
+
+struct rb_node {
+    struct rb_node *parent;
+    struct rb_node *left;
+    struct rb_node *right;
+    enum rb_color color;
+};
+
+/* Tree root with cached leftmost (smallest) node */
+struct rb_root_cached {
+    struct rb_node *rb_node;
+    struct rb_node *rb_leftmost;
+};
+
+struct timerqueue_node {
+    struct rb_node node;
+    uint64_t expires;
+};
+
+struct timerqueue_head {
+    struct rb_root_cached rb_root;
+};
+
+static inline void rb_rotate_left(struct rb_root_cached *root, struct rb_node *x)
+{
+    struct rb_node *y = x->right;
+
+    x->right = y->left;
+    if (y->left)
+        y->left->parent = x;
+    y->parent = x->parent;
+    if (!x->parent)
+        root->rb_node = y;
+    else if (x == x->parent->left)
+        x->parent->left = y;
+    else
+        x->parent->right = y;
+    y->left = x;
+    x->parent = y;
+}
+
+static inline void rb_rotate_right(struct rb_root_cached *root, struct rb_node *x)
+{
+    struct rb_node *y = x->left;
+
+    x->left = y->right;
+    if (y->right)
+        y->right->parent = x;
+    y->parent = x->parent;
+    if (!x->parent)
+        root->rb_node = y;
+    else if (x == x->parent->right)
+        x->parent->right = y;
+    else
+        x->parent->left = y;
+    y->right = x;
+    x->parent = y;
+}
+
+static inline struct rb_node *rb_next(struct rb_node *node)
+{
+    if (node->right) {
+        node = node->right;
+        while (node->left)
+            node = node->left;
+        return node;
+    }
+    while (node->parent && node == node->parent->right)
+        node = node->parent;
+    return node->parent;
+}
+
+/* Link node below parent (NULL for the root), then rebalance */
+static inline void rb_insert_color(struct rb_root_cached *root, struct rb_node *node,
+                                   struct rb_node *parent, struct rb_node **link)
+{
+    node->parent = parent;
+    node->left = NULL;
+    node->right = NULL;
+    node->color = RB_RED;
+    *link = node;
+
+    while (node != root->rb_node && node->parent->color == RB_RED) {
+        struct rb_node *gparent = node->parent->parent;
+
+        if (node->parent == gparent->left) {
+            struct rb_node *uncle = gparent->right;
+            if (uncle && uncle->color == RB_RED) {
+                node->parent->color = RB_BLACK;
+                uncle->color = RB_BLACK;
+                gparent->color = RB_RED;
+                node = gparent;
+            } else {
+                if (node == node->parent->right) {
+                    node = node->parent;
+                    rb_rotate_left(root, node);
+                }
+                node->parent->color = RB_BLACK;
+                gparent->color = RB_RED;
+                rb_rotate_right(root, gparent);
+            }
+        } else {
+            struct rb_node *uncle = gparent->left;
+            if (uncle && uncle->color == RB_RED) {
+                node->parent->color = RB_BLACK;
+                uncle->color = RB_BLACK;
+                gparent->color = RB_RED;
+                node = gparent;
+            } else {
+                if (node == node->parent->left) {
+                    node = node->parent;
+                    rb_rotate_right(root, node);
+                }
+                node->parent->color = RB_BLACK;
+                gparent->color = RB_RED;
+                rb_rotate_left(root, gparent);
+            }
+        }
+    }
+    root->rb_node->color = RB_BLACK;
+}
+
+static inline void rb_transplant(struct rb_root_cached *root, struct rb_node *u,
+                                 struct rb_node *v)
+{
+    if (!u->parent)
+        root->rb_node = v;
+    else if (u == u->parent->left)
+        u->parent->left = v;
+    else
+        u->parent->right = v;
+    if (v)
+        v->parent = u->parent;
+}
+
+static inline void rb_erase_fixup(struct rb_root_cached *root, struct rb_node *node,
+                                  struct rb_node *parent)
+{
+    while (node != root->rb_node && (!node || node->color == RB_BLACK)) {
+        if (node == parent->left) {
+            struct rb_node *sibling = parent->right;
+            if (sibling->color == RB_RED) {
+                sibling->color = RB_BLACK;
+                parent->color = RB_RED;
+                rb_rotate_left(root, parent);
+                sibling = parent->right;
+            }
+            if ((!sibling->left || sibling->left->color == RB_BLACK) &&
+                (!sibling->right || sibling->right->color == RB_BLACK)) {
+                sibling->color = RB_RED;
+                node = parent;
+                parent = node->parent;
+            } else {
+                if (!sibling->right || sibling->right->color == RB_BLACK) {
+                    sibling->left->color = RB_BLACK;
+                    sibling->color = RB_RED;
+                    rb_rotate_right(root, sibling);
+                    sibling = parent->right;
+                }
+                sibling->color = parent->color;
+                parent->color = RB_BLACK;
+                if (sibling->right)
+                    sibling->right->color = RB_BLACK;
+                rb_rotate_left(root, parent);
+                node = root->rb_node;
+            }
+        } else {
+            struct rb_node *sibling = parent->left;
+            if (sibling->color == RB_RED) {
+                sibling->color = RB_BLACK;
+                parent->color = RB_RED;
+                rb_rotate_right(root, parent);
+                sibling = parent->left;
+            }
+            if ((!sibling->left || sibling->left->color == RB_BLACK) &&
+                (!sibling->right || sibling->right->color == RB_BLACK)) {
+                sibling->color = RB_RED;
+                node = parent;
+                parent = node->parent;
+            } else {
+                if (!sibling->left || sibling->left->color == RB_BLACK) {
+                    sibling->right->color = RB_BLACK;
+                    sibling->color = RB_RED;
+                    rb_rotate_left(root, sibling);
+                    sibling = parent->left;
+                }
+                sibling->color = parent->color;
+                parent->color = RB_BLACK;
+                if (sibling->left)
+                    sibling->left->color = RB_BLACK;
+                rb_rotate_right(root, parent);
+                node = root->rb_node;
+            }
+        }
+    }
+    if (node)
+        node->color = RB_BLACK;
+}
+
+static inline void rb_erase_cached(struct rb_root_cached *root, struct rb_node *z)
+{
+    struct rb_node *child, *parent;
+    enum rb_color color = z->color;
+
+    if (root->rb_leftmost == z)
+        root->rb_leftmost = rb_next(z);
+
+    if (!z->left) {
+        child = z->right;
+        parent = z->parent;
+        rb_transplant(root, z, child);
+    } else if (!z->right) {
+        child = z->left;
+        parent = z->parent;
+        rb_transplant(root, z, child);
+    } else {
+        struct rb_node *successor = z->right;
+        while (successor->left)
+            successor = successor->left;
+        color = successor->color;
+        child = successor->right;
+        if (successor->parent == z) {
+            parent = successor;
+        } else {
+            parent = successor->parent;
+            rb_transplant(root, successor, child);
+            successor->right = z->right;
+            successor->right->parent = successor;
+        }
+        rb_transplant(root, z, successor);
+        successor->left = z->left;
+        successor->left->parent = successor;
+        successor->color = z->color;
+    }
+
+    if (color == RB_BLACK && root->rb_node)
+        rb_erase_fixup(root, child, parent);
+}
+
+static inline void timerqueue_init_head(struct timerqueue_head *head)
+{
+    head->rb_root.rb_node = NULL;
+    head->rb_root.rb_leftmost = NULL;
+}
+
+static inline void timerqueue_init(struct timerqueue_node *node)
+{
+    node->node.parent = &node->node;
+}
+
+static inline bool timerqueue_node_queued(const struct timerqueue_node *node)
+{
+    return node->node.parent != &node->node;
+}
+
+/* Earliest timer, NULL when empty */
+static inline struct timerqueue_node *timerqueue_getnext(struct timerqueue_head *head)
+{
+    struct rb_node *leftmost = head->rb_root.rb_leftmost;
+
+    return leftmost ? container_of(leftmost, struct timerqueue_node, node) : NULL;
+}
+
+static inline struct timerqueue_node *timerqueue_iterate_next(struct timerqueue_node *node)
+{
+    struct rb_node *next = rb_next(&node->node);
+
+    return next ? container_of(next, struct timerqueue_node, node) : NULL;
+}
+
+/* Queue node by its expires; true when it became the earliest */
+static inline bool timerqueue_add(struct timerqueue_head *head, struct timerqueue_node *node)
+{
+    struct rb_node **link = &head->rb_root.rb_node;
+    struct rb_node *parent = NULL;
+    bool leftmost = true;
+
+    while (*link) {
+        parent = *link;
+        if (node->expires < container_of(parent, struct timerqueue_node, node)->expires) {
+            link = &parent->left;
+        } else {
+            link = &parent->right;
+            leftmost = false;
+        }
+    }
+
+    rb_insert_color(&head->rb_root, &node->node, parent, link);
+    if (leftmost)
+        head->rb_root.rb_leftmost = &node->node;
+    return leftmost;
+}
+
+/* Unqueue node; true while timers remain */
+static inline bool timerqueue_del(struct timerqueue_head *head, struct timerqueue_node *node)
+{
+    rb_erase_cached(&head->rb_root, &node->node);
+    timerqueue_init(node);
+    return head->rb_root.rb_node != NULL;
+}
+
+#endif /* _TIMERQUEUE_SIM_H */
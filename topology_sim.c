@@ -7,6 +7,9 @@
 #include <time.h>
 #include <errno.h>
 #include <unistd.h>
+#include <limits.h>
+
+#include "sched_topology_sim.h"
 
 // Logging Macros
 #define LOG_LEVEL_DEBUG 0
@@ -31,6 +34,17 @@ static int current_log_level = LOG_LEVEL_INFO;
 #define MAX_CORES        16
 #define MAX_THREADS      4
 #define CACHE_LINE_SIZE  64
+#define PAGE_SIZE        4096
+
+// SLIT distances: relative latency, local = 10
+#define LOCAL_DISTANCE   10
+#define HOP_DISTANCE     6      // per hop of the default hypercube
+#define MAX_DISTANCE     254    // 255 means unreachable
+
+// Automatic NUMA Balancing
+#define NUMA_SCAN_PERIOD 4096   // task accesses between scans
+#define NUMA_SCAN_SIZE   256    // pages made to fault per scan
+#define NUMA_NO_NODE     0xff
 
 // Cache Levels
 typedef enum {
@@ -94,6 +108,10 @@ typedef struct {
     size_t num_sockets;
     size_t memory_size;
     unsigned int memory_latency;
+    size_t nr_pages;            // memory pool, in pages
+    size_t free_pages;
+    size_t nr_cpus;             // online cores
+    size_t nr_tasks;            // NUMA tasks running here
     struct {
         unsigned long local_accesses;
         unsigned long remote_accesses;
@@ -101,12 +119,54 @@ typedef struct {
     } stats;
 } numa_node_t;
 
+// Memory Policy Modes
+typedef enum {
+    MPOL_DEFAULT,               // local node, nearest fallback
+    MPOL_PREFERRED,             // one node, nearest fallback
+    MPOL_BIND,                  // nodes in the mask only
+    MPOL_INTERLEAVE             // round robin over the mask
+} mpol_mode_t;
+
+// Memory Policy
+typedef struct {
+    mpol_mode_t mode;
+    unsigned int preferred_node;
+    uint64_t nodes;
+    unsigned int il_next;
+} mempolicy_t;
+
+// NUMA Task: a thread and its private memory region
+typedef struct numa_task {
+    struct numa_task *next;     // manager's task list
+    unsigned int id;
+    unsigned int node;          // node of the CPU it runs on
+    bool pinned;                // CPU affinity forbids moving it
+    mempolicy_t policy;
+    size_t nr_pages;
+    uint8_t *page_node;         // node backing each page
+    uint8_t *page_last_nid;     // node of the page's last hinting fault
+    uint8_t *page_prot_none;    // armed: next access is a hinting fault
+    size_t scan_offset;
+    unsigned long accesses_since_scan;
+    unsigned long numa_faults[MAX_NUMA_NODES];  // by memory node, decayed
+    unsigned int preferred_node;
+    struct {
+        unsigned long accesses;
+        unsigned long remote_accesses;
+        unsigned long total_latency;
+        unsigned long hint_faults;
+    } stats;
+} numa_task_t;
+
 // Topology Statistics
 typedef struct {
     unsigned long cache_hits;
     unsigned long cache_misses;
     unsigned long memory_accesses;
     unsigned long cpu_migrations;
+    unsigned long page_migrations;
+    unsigned long hint_faults;
+    unsigned long alloc_failures;
     double avg_memory_latency;
 } topo_stats_t;
 
@@ -115,13 +175,18 @@ typedef struct {
     size_t num_nodes;
     size_t num_sockets_per_node;
     size_t num_cores_per_socket;
+    size_t node_memory;         // bytes per node, 0 = 16GB
     bool track_stats;
+    bool numa_balancing;
 } topo_config_t;
 
 // Topology Manager
 typedef struct {
     numa_node_t *nodes;
     size_t num_nodes;
+    unsigned int distance[MAX_NUMA_NODES][MAX_NUMA_NODES];
+    unsigned int node_order[MAX_NUMA_NODES][MAX_NUMA_NODES];  // nearest first
+    numa_task_t *numa_tasks;
     topo_config_t config;
     topo_stats_t stats;
     pthread_mutex_t manager_lock;
@@ -153,9 +218,28 @@ bool access_memory(
     mem_access_t type
 );
 
+bool topo_build_cpu_topology(
+    topo_manager_t *manager,
+    unsigned int threads_per_core,
+    struct cpu_topology *topo
+);
+
+bool topo_set_distance(topo_manager_t *manager, unsigned int a, unsigned int b,
+                       unsigned int distance);
+bool topo_load_node_distances(topo_manager_t *manager, const char *sysfs_root);
+int alloc_page_node(topo_manager_t *manager, mempolicy_t *policy, unsigned int local_node);
+
+numa_task_t* create_numa_task(topo_manager_t *manager, unsigned int id, unsigned int node,
+                              bool pinned, mempolicy_t policy, size_t nr_pages,
+                              unsigned int touch_node);
+void destroy_numa_task(topo_manager_t *manager, numa_task_t *task);
+unsigned int numa_task_access(topo_manager_t *manager, numa_task_t *task, size_t page);
+
+void print_numa_distances(topo_manager_t *manager);
 void print_topology(topo_manager_t *manager);
 void print_topo_stats(topo_manager_t *manager);
 void demonstrate_topology(void);
+void demonstrate_numa_policies(void);
 
 // Utility Function: Get Log Level String
 const char* get_log_level_string(int level) {
@@ -199,8 +283,33 @@ const char* get_mem_access_string(mem_access_t type) {
     }
 }
 
+// Fallback order of every node: itself, then by distance (ties by id)
+static void topo_build_node_order(topo_manager_t *manager) {
+    for (unsigned int n = 0; n < manager->num_nodes; n++) {
+        unsigned int *order = manager->node_order[n];
+
+        for (unsigned int i = 0; i < manager->num_nodes; i++)
+            order[i] = i;
+        for (unsigned int i = 1; i < manager->num_nodes; i++) {
+            unsigned int node = order[i], j = i;
+            while (j > 0 && (manager->distance[n][order[j - 1]] > manager->distance[n][node] ||
+                             (manager->distance[n][order[j - 1]] == manager->distance[n][node] &&
+                              order[j - 1] > node))) {
+                order[j] = order[j - 1];
+                j--;
+            }
+            order[j] = node;
+        }
+    }
+}
+
 // Create Topology Manager
 topo_manager_t* create_topo_manager(topo_config_t config) {
+    if (config.num_nodes == 0 || config.num_nodes > MAX_NUMA_NODES) {
+        LOG(LOG_LEVEL_ERROR, "Number of NUMA nodes must be 1-%d", MAX_NUMA_NODES);
+        return NULL;
+    }
+
     topo_manager_t *manager = malloc(sizeof(topo_manager_t));
     if (!manager) {
         LOG(LOG_LEVEL_ERROR, "Failed to allocate topology manager");
@@ -226,10 +335,28 @@ topo_manager_t* create_topo_manager(topo_config_t config) {
     }
 
     manager->num_nodes = config.num_nodes;
+    manager->numa_tasks = NULL;
     manager->config = config;
     memset(&manager->stats, 0, sizeof(topo_stats_t));
     pthread_mutex_init(&manager->manager_lock, NULL);
 
+    // Default SLIT: nodes on a hypercube, HOP_DISTANCE per link crossed
+    for (unsigned int a = 0; a < config.num_nodes; a++) {
+        for (unsigned int b = 0; b < config.num_nodes; b++) {
+            manager->distance[a][b] = LOCAL_DISTANCE +
+                HOP_DISTANCE * (unsigned int)__builtin_popcount(a ^ b);
+        }
+    }
+    topo_build_node_order(manager);
+
+    if (config.node_memory) {
+        for (size_t i = 0; i < config.num_nodes; i++) {
+            numa_node_t *node = &manager->nodes[i];
+            node->memory_size = config.node_memory;
+            node->nr_pages = node->free_pages = config.node_memory / PAGE_SIZE;
+        }
+    }
+
     LOG(LOG_LEVEL_DEBUG, "Created topology manager with %zu NUMA nodes", 
         config.num_nodes);
     return manager;
@@ -244,6 +371,10 @@ bool init_numa_node(numa_node_t *node, unsigned int id, size_t num_sockets) {
     node->num_sockets = num_sockets;
     node->memory_size = 16UL * 1024 * 1024 * 1024;  // 16GB per node
     node->memory_latency = 100;  // Base memory latency in ns
+    node->nr_pages = node->memory_size / PAGE_SIZE;
+    node->free_pages = node->nr_pages;
+    node->nr_cpus = num_sockets * MAX_CORES;
+    node->nr_tasks = 0;
     memset(&node->stats, 0, sizeof(node->stats));
 
     // Initialize sockets
@@ -322,15 +453,9 @@ unsigned int calculate_memory_latency(
         target_node >= manager->num_nodes)
         return UINT_MAX;
 
-    // Base latency of target node
-    unsigned int latency = manager->nodes[target_node].memory_latency;
-
-    // Add inter-node communication overhead
-    if (source_node != target_node) {
-        latency += 50 * abs((int)source_node - (int)target_node);
-    }
-
-    return latency;
+    // SLIT distances are relative latencies: base latency scales with them
+    return manager->nodes[target_node].memory_latency *
+           manager->distance[source_node][target_node] / LOCAL_DISTANCE;
 }
 
 // Access Memory
@@ -376,6 +501,432 @@ bool access_memory(
     return success;
 }
 
+// Build CPU Topology
+//
+// Flatten the node/socket/core tree into the per-CPU description the
+// scheduler builds its sched domains from.  A socket shares one L3, so
+// it is the LLC; every online core contributes threads_per_core logical
+// CPUs, numbered thread-first.
+bool topo_build_cpu_topology(
+    topo_manager_t *manager,
+    unsigned int threads_per_core,
+    struct cpu_topology *topo
+) {
+    if (!manager || !topo) return false;
+    if (threads_per_core == 0 || threads_per_core > MAX_THREADS) return false;
+
+    unsigned int cpu = 0, core_id = 0, llc_id = 0;
+    bool fits = true;
+
+    pthread_mutex_lock(&manager->manager_lock);
+
+    for (size_t n = 0; n < manager->num_nodes && fits; n++) {
+        numa_node_t *node = &manager->nodes[n];
+
+        for (size_t s = 0; s < node->num_sockets && fits; s++, llc_id++) {
+            socket_t *socket = &node->sockets[s];
+
+            for (size_t c = 0; c < socket->num_cores; c++) {
+                if (socket->cores[c].state != CPU_ONLINE)
+                    continue;
+                if (cpu + threads_per_core > NR_CPUS) {
+                    fits = false;
+                    break;
+                }
+                for (unsigned int t = 0; t < threads_per_core; t++, cpu++) {
+                    topo->cpu[cpu].core = core_id;
+                    topo->cpu[cpu].llc = llc_id;
+                    topo->cpu[cpu].node = node->id;
+                }
+                core_id++;
+            }
+        }
+    }
+    topo->nr_cpus = cpu;
+
+    pthread_mutex_unlock(&manager->manager_lock);
+
+    if (!fits)
+        LOG(LOG_LEVEL_ERROR, "Topology exceeds %d logical CPUs", NR_CPUS);
+    return fits && cpu > 0;
+}
+
+// Set NUMA Distance
+//
+// Distances follow the ACPI SLIT: LOCAL_DISTANCE on the diagonal, larger
+// values further away.  The matrix is kept symmetric.
+bool topo_set_distance(topo_manager_t *manager, unsigned int a, unsigned int b,
+                       unsigned int distance) {
+    if (!manager || a >= manager->num_nodes || b >= manager->num_nodes)
+        return false;
+    if (a == b ? distance != LOCAL_DISTANCE
+               : distance <= LOCAL_DISTANCE || distance > MAX_DISTANCE) {
+        LOG(LOG_LEVEL_ERROR, "Invalid distance %u between nodes %u and %u", distance, a, b);
+        return false;
+    }
+
+    pthread_mutex_lock(&manager->manager_lock);
+    manager->distance[a][b] = manager->distance[b][a] = distance;
+    topo_build_node_order(manager);
+    pthread_mutex_unlock(&manager->manager_lock);
+    return true;
+}
+
+// Load NUMA Distances
+//
+// Read <sysfs_root>/node<N>/distance, one row of the SLIT per node, as
+// found under /sys/devices/system/node.  Either every row is valid and
+// the matrix is replaced, or it is left untouched.
+bool topo_load_node_distances(topo_manager_t *manager, const char *sysfs_root) {
+    if (!manager || !sysfs_root) return false;
+
+    unsigned int distance[MAX_NUMA_NODES][MAX_NUMA_NODES];
+    char path[PATH_MAX];
+
+    for (unsigned int a = 0; a < manager->num_nodes; a++) {
+        snprintf(path, sizeof(path), "%s/node%u/distance", sysfs_root, a);
+        FILE *file = fopen(path, "r");
+        if (!file) {
+            LOG(LOG_LEVEL_ERROR, "Cannot open %s: %s", path, strerror(errno));
+            return false;
+        }
+
+        unsigned int b = 0;
+        while (b < manager->num_nodes && fscanf(file, "%u", &distance[a][b]) == 1)
+            b++;
+        fclose(file);
+
+        if (b < manager->num_nodes) {
+            LOG(LOG_LEVEL_ERROR, "%s: expected %zu distances, got %u",
+                path, manager->num_nodes, b);
+            return false;
+        }
+    }
+
+    for (unsigned int a = 0; a < manager->num_nodes; a++) {
+        for (unsigned int b = 0; b < manager->num_nodes; b++) {
+            unsigned int d = distance[a][b];
+            if (a == b ? d != LOCAL_DISTANCE : d <= LOCAL_DISTANCE || d > MAX_DISTANCE) {
+                LOG(LOG_LEVEL_ERROR, "Invalid distance %u between nodes %u and %u", d, a, b);
+                return false;
+            }
+        }
+    }
+
+    pthread_mutex_lock(&manager->manager_lock);
+    memcpy(manager->distance, distance, sizeof(distance));
+    topo_build_node_order(manager);
+    pthread_mutex_unlock(&manager->manager_lock);
+    return true;
+}
+
+static bool take_node_page(topo_manager_t *manager, unsigned int nid) {
+    numa_node_t *node = &manager->nodes[nid];
+
+    if (!node->free_pages)
+        return false;
+    node->free_pages--;
+    node->stats.memory_used += PAGE_SIZE;
+    return true;
+}
+
+static void put_node_page(topo_manager_t *manager, unsigned int nid) {
+    numa_node_t *node = &manager->nodes[nid];
+
+    node->free_pages++;
+    node->stats.memory_used -= PAGE_SIZE;
+}
+
+static bool policy_allows(const mempolicy_t *policy, unsigned int nid) {
+    if (policy->mode != MPOL_BIND && policy->mode != MPOL_INTERLEAVE)
+        return true;
+    return (policy->nodes >> nid) & 1;
+}
+
+// Caller holds manager_lock
+static int __alloc_page_node(topo_manager_t *manager, mempolicy_t *policy,
+                             unsigned int local_node) {
+    unsigned int start = local_node;
+
+    switch (policy->mode) {
+        case MPOL_INTERLEAVE:
+            // Next allowed node after the last one used; full nodes are skipped
+            for (unsigned int i = 0; i < manager->num_nodes; i++) {
+                unsigned int nid = (policy->il_next + i) % manager->num_nodes;
+                if (policy_allows(policy, nid) && take_node_page(manager, nid)) {
+                    policy->il_next = (nid + 1) % manager->num_nodes;
+                    return (int)nid;
+                }
+            }
+            break;
+        case MPOL_PREFERRED:
+            start = policy->preferred_node;
+            // fall through
+        case MPOL_DEFAULT:
+        case MPOL_BIND:
+            for (unsigned int i = 0; i < manager->num_nodes; i++) {
+                unsigned int nid = manager->node_order[start][i];
+                if (policy_allows(policy, nid) && take_node_page(manager, nid))
+                    return (int)nid;
+            }
+            break;
+    }
+
+    manager->stats.alloc_failures++;
+    return -1;
+}
+
+// Allocate Page
+//
+// Pick the node backing a page allocated by a thread on local_node.
+// Returns the node, or -1 when no node the policy allows has memory.
+int alloc_page_node(topo_manager_t *manager, mempolicy_t *policy, unsigned int local_node) {
+    if (!manager || !policy || local_node >= manager->num_nodes) return -1;
+    if (policy->mode == MPOL_PREFERRED && policy->preferred_node >= manager->num_nodes)
+        return -1;
+
+    pthread_mutex_lock(&manager->manager_lock);
+    int nid = __alloc_page_node(manager, policy, local_node);
+    pthread_mutex_unlock(&manager->manager_lock);
+    return nid;
+}
+
+// Create NUMA Task
+//
+// The task runs on node; its memory is first touched by a thread on
+// touch_node, which is where MPOL_DEFAULT places it.
+numa_task_t* create_numa_task(topo_manager_t *manager, unsigned int id, unsigned int node,
+                              bool pinned, mempolicy_t policy, size_t nr_pages,
+                              unsigned int touch_node) {
+    if (!manager || node >= manager->num_nodes || touch_node >= manager->num_nodes ||
+        nr_pages == 0)
+        return NULL;
+    if (policy.mode == MPOL_PREFERRED && policy.preferred_node >= manager->num_nodes)
+        return NULL;
+
+    numa_task_t *task = calloc(1, sizeof(numa_task_t));
+    if (!task) return NULL;
+
+    task->page_node = malloc(nr_pages);
+    task->page_last_nid = malloc(nr_pages);
+    task->page_prot_none = calloc(nr_pages, 1);
+    if (!task->page_node || !task->page_last_nid || !task->page_prot_none) {
+        free(task->page_node);
+        free(task->page_last_nid);
+        free(task->page_prot_none);
+        free(task);
+        return NULL;
+    }
+
+    task->id = id;
+    task->node = node;
+    task->pinned = pinned;
+    task->policy = policy;
+    task->nr_pages = nr_pages;
+    task->preferred_node = NUMA_NO_NODE;
+    memset(task->page_last_nid, NUMA_NO_NODE, nr_pages);
+
+    pthread_mutex_lock(&manager->manager_lock);
+
+    for (size_t page = 0; page < nr_pages; page++) {
+        int nid = __alloc_page_node(manager, &task->policy, touch_node);
+        if (nid < 0) {
+            while (page--)
+                put_node_page(manager, task->page_node[page]);
+            pthread_mutex_unlock(&manager->manager_lock);
+            LOG(LOG_LEVEL_WARN, "Task %u: out of memory under its policy", id);
+            free(task->page_node);
+            free(task->page_last_nid);
+            free(task->page_prot_none);
+            free(task);
+            return NULL;
+        }
+        task->page_node[page] = (uint8_t)nid;
+    }
+
+    manager->nodes[node].nr_tasks++;
+    task->next = manager->numa_tasks;
+    manager->numa_tasks = task;
+
+    pthread_mutex_unlock(&manager->manager_lock);
+    return task;
+}
+
+// Destroy NUMA Task
+void destroy_numa_task(topo_manager_t *manager, numa_task_t *task) {
+    if (!manager || !task) return;
+
+    pthread_mutex_lock(&manager->manager_lock);
+
+    for (numa_task_t **link = &manager->numa_tasks; *link; link = &(*link)->next) {
+        if (*link == task) {
+            *link = task->next;
+            break;
+        }
+    }
+    for (size_t page = 0; page < task->nr_pages; page++)
+        put_node_page(manager, task->page_node[page]);
+    manager->nodes[task->node].nr_tasks--;
+
+    pthread_mutex_unlock(&manager->manager_lock);
+
+    free(task->page_node);
+    free(task->page_last_nid);
+    free(task->page_prot_none);
+    free(task);
+}
+
+static bool migrate_numa_page(topo_manager_t *manager, numa_task_t *task, size_t page,
+                              unsigned int dst) {
+    if (!policy_allows(&task->policy, dst) || !take_node_page(manager, dst))
+        return false;
+
+    put_node_page(manager, task->page_node[page]);
+    task->page_node[page] = (uint8_t)dst;
+    manager->stats.page_migrations++;
+    return true;
+}
+
+static void move_numa_task(topo_manager_t *manager, numa_task_t *task, unsigned int dst) {
+    manager->nodes[task->node].nr_tasks--;
+    manager->nodes[dst].nr_tasks++;
+    task->node = dst;
+    manager->stats.cpu_migrations++;
+}
+
+// NUMA Hinting Fault
+//
+// The page was armed by the scanner, so this access tells us which node
+// uses it.  A page is only migrated once two faults in a row come from
+// the same node (the two-stage filter): a single fault from a node that
+// touches the page in passing is not worth the copy.
+static void numa_hint_fault(topo_manager_t *manager, numa_task_t *task, size_t page) {
+    unsigned int mem_nid = task->page_node[page];
+    unsigned int last_nid = task->page_last_nid[page];
+
+    task->page_prot_none[page] = 0;
+    task->page_last_nid[page] = (uint8_t)task->node;
+    task->numa_faults[mem_nid]++;
+    task->stats.hint_faults++;
+    manager->stats.hint_faults++;
+
+    if (mem_nid != task->node && last_nid == task->node)
+        migrate_numa_page(manager, task, page, task->node);
+}
+
+// NUMA Task Placement
+//
+// The preferred node is the one most of the recent faults hit.  Moving
+// the task there brings all of that memory local at once, so it is
+// tried before pages are migrated one by one: into a free CPU, or by
+// swapping with a task on that node which would rather be here.
+static void task_numa_placement(topo_manager_t *manager, numa_task_t *task) {
+    unsigned long max_faults = 0;
+    unsigned int preferred = NUMA_NO_NODE;
+
+    for (unsigned int nid = 0; nid < manager->num_nodes; nid++) {
+        if (task->numa_faults[nid] > max_faults) {
+            max_faults = task->numa_faults[nid];
+            preferred = nid;
+        }
+        task->numa_faults[nid] /= 2;
+    }
+    if (preferred == NUMA_NO_NODE)
+        return;
+
+    task->preferred_node = preferred;
+    if (task->pinned || preferred == task->node)
+        return;
+
+    unsigned int src = task->node;
+    if (manager->nodes[preferred].nr_tasks < manager->nodes[preferred].nr_cpus) {
+        move_numa_task(manager, task, preferred);
+        return;
+    }
+
+    for (numa_task_t *other = manager->numa_tasks; other; other = other->next) {
+        if (other->node == preferred && !other->pinned && other->preferred_node == src) {
+            move_numa_task(manager, task, preferred);
+            move_numa_task(manager, other, src);
+            return;
+        }
+    }
+}
+
+// NUMA Scan
+//
+// Once per scan period: settle placement on the faults gathered, then
+// arm the next window of pages so their next access faults.
+static void task_numa_work(topo_manager_t *manager, numa_task_t *task) {
+    task->accesses_since_scan = 0;
+    task_numa_placement(manager, task);
+
+    for (size_t i = 0; i < NUMA_SCAN_SIZE && i < task->nr_pages; i++) {
+        task->page_prot_none[task->scan_offset] = 1;
+        task->scan_offset = (task->scan_offset + 1) % task->nr_pages;
+    }
+}
+
+// NUMA Task Memory Access
+//
+// One access by task to one of its pages.  Returns the latency in ns
+// given where the task runs and where the page lives, UINT_MAX if the
+// page does not exist.
+unsigned int numa_task_access(topo_manager_t *manager, numa_task_t *task, size_t page) {
+    if (!manager || !task || page >= task->nr_pages) return UINT_MAX;
+
+    pthread_mutex_lock(&manager->manager_lock);
+
+    bool balancing = manager->config.numa_balancing;
+    if (balancing && task->page_prot_none[page])
+        numa_hint_fault(manager, task, page);
+
+    unsigned int nid = task->page_node[page];
+    unsigned int latency = calculate_memory_latency(manager, task->node, nid);
+
+    task->stats.accesses++;
+    task->stats.total_latency += latency;
+    if (nid == task->node) {
+        manager->nodes[nid].stats.local_accesses++;
+    } else {
+        manager->nodes[nid].stats.remote_accesses++;
+        task->stats.remote_accesses++;
+    }
+
+    if (manager->config.track_stats) {
+        manager->stats.memory_accesses++;
+        manager->stats.avg_memory_latency +=
+            (latency - manager->stats.avg_memory_latency) / manager->stats.memory_accesses;
+    }
+
+    if (balancing && ++task->accesses_since_scan >= NUMA_SCAN_PERIOD)
+        task_numa_work(manager, task);
+
+    pthread_mutex_unlock(&manager->manager_lock);
+    return latency;
+}
+
+// Print NUMA Distances
+void print_numa_distances(topo_manager_t *manager) {
+    if (!manager) return;
+
+    pthread_mutex_lock(&manager->manager_lock);
+
+    printf("\nNUMA Distances:\nnode");
+    for (size_t b = 0; b < manager->num_nodes; b++)
+        printf(" %4zu", b);
+    printf("\n");
+    for (size_t a = 0; a < manager->num_nodes; a++) {
+        printf("%4zu", a);
+        for (size_t b = 0; b < manager->num_nodes; b++)
+            printf(" %4u", manager->distance[a][b]);
+        printf("   free %zu/%zu pages, %zu tasks\n", manager->nodes[a].free_pages,
+               manager->nodes[a].nr_pages, manager->nodes[a].nr_tasks);
+    }
+
+    pthread_mutex_unlock(&manager->manager_lock);
+}
+
 // Print Topology
 void print_topology(topo_manager_t *manager) {
     if (!manager) return;
@@ -427,6 +978,9 @@ void print_topo_stats(topo_manager_t *manager) {
     printf("Cache Misses:      %lu\n", manager->stats.cache_misses);
     printf("Memory Accesses:   %lu\n", manager->stats.memory_accesses);
     printf("CPU Migrations:    %lu\n", manager->stats.cpu_migrations);
+    printf("Page Migrations:   %lu\n", manager->stats.page_migrations);
+    printf("Hinting Faults:    %lu\n", manager->stats.hint_faults);
+    printf("Alloc Failures:    %lu\n", manager->stats.alloc_failures);
     printf("Avg Memory Latency: %.2f ns\n", manager->stats.avg_memory_latency);
 
     // Print per-node statistics
@@ -437,6 +991,7 @@ void print_topo_stats(topo_manager_t *manager) {
         printf("  Remote Accesses: %lu\n", node->stats.remote_accesses);
         printf("  Memory Used:     %lu MB\n", 
             node->stats.memory_used / (1024*1024));
+        printf("  Free Pages:      %zu/%zu\n", node->free_pages, node->nr_pages);
     }
 
     pthread_mutex_unlock(&manager->manager_lock);
@@ -448,6 +1003,16 @@ void destroy_topo_manager(topo_manager_t *manager) {
 
     pthread_mutex_lock(&manager->manager_lock);
 
+    // Free tasks the caller left behind
+    while (manager->numa_tasks) {
+        numa_task_t *task = manager->numa_tasks;
+        manager->numa_tasks = task->next;
+        free(task->page_node);
+        free(task->page_last_nid);
+        free(task->page_prot_none);
+        free(task);
+    }
+
     // Free all nodes
     for (size_t i = 0; i < manager->num_nodes; i++) {
         numa_node_t *node = &manager->nodes[i];
@@ -486,6 +1051,17 @@ void demonstrate_topology(void) {
     // Print initial topology
     print_topology(manager);
 
+    // Derive the scheduler's view: SMT -> MC (socket) -> NODE -> NUMA
+    static struct cpu_topology cpu_topo;
+    static struct sched_domain *sd[NR_CPUS];
+    if (topo_build_cpu_topology(manager, 2, &cpu_topo) &&
+        build_sched_domains(&cpu_topo, sd)) {
+        printf("\n%u logical CPUs\n", cpu_topo.nr_cpus);
+        print_sched_domains(sd[0], 0);
+        print_sched_domains(sd[cpu_topo.nr_cpus - 1], cpu_topo.nr_cpus - 1);
+        free_sched_domains(sd, cpu_topo.nr_cpus);
+    }
+
     // Simulate memory accesses
     for (unsigned int i = 0; i < manager->num_nodes; i++) {
         // Local access
@@ -505,12 +1081,251 @@ void demonstrate_topology(void) {
     destroy_topo_manager(manager);
 }
 
-int main(void) {
+// Demonstrate NUMA Policies
+void demonstrate_numa_policies(void) {
+    static const char *const mode_names[] = { "default", "preferred", "bind", "interleave" };
+    topo_config_t config = {
+        .num_nodes = 4,
+        .num_sockets_per_node = 1,
+        .num_cores_per_socket = 8,
+        .node_memory = 64 * PAGE_SIZE,
+        .track_stats = true,
+        .numa_balancing = true
+    };
+
+    topo_manager_t *manager = create_topo_manager(config);
+    if (!manager) return;
+
+    // Two boards of two nodes: the far board is two hops away
+    topo_set_distance(manager, 0, 1, 12);
+    topo_set_distance(manager, 2, 3, 12);
+    for (unsigned int a = 0; a < 2; a++) {
+        for (unsigned int b = 2; b < 4; b++)
+            topo_set_distance(manager, a, b, 32);
+    }
+    print_numa_distances(manager);
+
+    // Eight pages allocated by a thread on node 1 under each policy
+    mempolicy_t policies[] = {
+        { .mode = MPOL_DEFAULT },
+        { .mode = MPOL_PREFERRED, .preferred_node = 3 },
+        { .mode = MPOL_BIND, .nodes = 0x5 },
+        { .mode = MPOL_INTERLEAVE, .nodes = 0xf },
+    };
+    printf("\nPages allocated from node 1:\n");
+    for (size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); p++) {
+        numa_task_t *task = create_numa_task(manager, (unsigned int)p, 1, true,
+                                             policies[p], 8, 1);
+        if (!task) continue;
+        printf("  %-10s", mode_names[policies[p].mode]);
+        for (size_t page = 0; page < task->nr_pages; page++)
+            printf(" %u", task->page_node[page]);
+        printf("\n");
+        destroy_numa_task(manager, task);
+    }
+
+    // Bound to node 2 but asking for more than it holds
+    mempolicy_t bind = { .mode = MPOL_BIND, .nodes = 1u << 2 };
+    numa_task_t *big = create_numa_task(manager, 10, 2, true, bind, 65, 2);
+    printf("  bind to node 2, 65 pages: %s\n", big ? "allocated" : "failed");
+    destroy_numa_task(manager, big);
+
+    // A task on node 2 whose memory was first touched on node 0
+    mempolicy_t local = { .mode = MPOL_DEFAULT };
+    numa_task_t *task = create_numa_task(manager, 20, 2, true, local, 48, 0);
+    if (task) {
+        uint64_t seed = 1;
+        unsigned long before_remote = 0;
+
+        for (unsigned long i = 0; i < 200000; i++) {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            numa_task_access(manager, task, seed % task->nr_pages);
+            if (i == NUMA_SCAN_PERIOD - 1)
+                before_remote = task->stats.remote_accesses;
+        }
+        printf("\nPinned task on node 2, memory on node 0, balancing on:\n");
+        printf("  first scan period: %.0f%% remote\n",
+               100.0 * before_remote / NUMA_SCAN_PERIOD);
+        printf("  whole run:         %.0f%% remote, avg %.1f ns, %lu hinting faults\n",
+               100.0 * task->stats.remote_accesses / task->stats.accesses,
+               (double)task->stats.total_latency / task->stats.accesses,
+               task->stats.hint_faults);
+        destroy_numa_task(manager, task);
+    }
+
+    print_topo_stats(manager);
+    destroy_topo_manager(manager);
+}
+
+/*
+ * Benchmark: 8 NUMA nodes, 32 tasks of 2048 pages each.  Every task
+ * spends 80% of its accesses on a hot fifth of its pages.  The
+ * simulator counts latency only, so a memory-bound task's throughput is
+ * taken as all-local latency over the latency it saw; the steady column
+ * covers the last quarter of the run, after balancing has settled.
+ */
+#define BENCH_NODES            8
+#define BENCH_TASKS            32
+#define BENCH_PAGES            2048
+#define BENCH_ACCESSES         (1UL << 18)     // per task
+#define BENCH_BURST            64              // accesses per task turn
+
+static inline uint64_t bench_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct bench_scenario {
+    const char *name;
+    mpol_mode_t mode;
+    bool first_touch_node0;     // memory set up by a thread on node 0
+    bool pinned;
+    bool numa_balancing;
+};
+
+static double bench_run(const struct bench_scenario *sc, const char *distances,
+                        double local_latency) {
+    topo_config_t config = {
+        .num_nodes = BENCH_NODES,
+        .num_sockets_per_node = 1,
+        .num_cores_per_socket = 16,
+        .track_stats = false,
+        .numa_balancing = sc->numa_balancing
+    };
+    topo_manager_t *manager = create_topo_manager(config);
+    if (!manager) return 0;
+    if (distances && !topo_load_node_distances(manager, distances)) {
+        destroy_topo_manager(manager);
+        return 0;
+    }
+
+    numa_task_t *tasks[BENCH_TASKS];
+    mempolicy_t policy = { .mode = sc->mode, .nodes = (1u << BENCH_NODES) - 1 };
+    for (unsigned int t = 0; t < BENCH_TASKS; t++) {
+        unsigned int node = t % BENCH_NODES;
+        tasks[t] = create_numa_task(manager, t, node, sc->pinned, policy, BENCH_PAGES,
+                                    sc->first_touch_node0 ? 0 : node);
+        if (!tasks[t]) {
+            destroy_topo_manager(manager);
+            return 0;
+        }
+    }
+
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    unsigned long total = 0, steady = 0, steady_accesses = 0, remote = 0;
+    const size_t hot = BENCH_PAGES / 5;
+    double start = bench_now();
+
+    for (unsigned long done = 0; done < BENCH_ACCESSES; done += BENCH_BURST) {
+        bool measure_steady = done >= BENCH_ACCESSES * 3 / 4;
+        for (unsigned int t = 0; t < BENCH_TASKS; t++) {
+            for (unsigned int i = 0; i < BENCH_BURST; i++) {
+                uint64_t r = bench_rand(&seed);
+                size_t page = r % 10 < 8 ? (r >> 8) % hot : hot + (r >> 8) % (BENCH_PAGES - hot);
+                unsigned int latency = numa_task_access(manager, tasks[t], page);
+                total += latency;
+                if (measure_steady) {
+                    steady += latency;
+                    steady_accesses++;
+                }
+            }
+        }
+    }
+    double elapsed = bench_now() - start;
+
+    unsigned long accesses = 0;
+    for (unsigned int t = 0; t < BENCH_TASKS; t++) {
+        accesses += tasks[t]->stats.accesses;
+        remote += tasks[t]->stats.remote_accesses;
+    }
+
+    double avg = (double)total / accesses;
+    double steady_avg = (double)steady / steady_accesses;
+    if (local_latency == 0)
+        local_latency = avg;
+    printf("  %-26s %6.1f ns %6.1f ns %5.1f%% %6.1f%% %6.1f%% %7lu %5lu %5.0f ns\n",
+           sc->name, avg, steady_avg, 100.0 * remote / accesses,
+           100.0 * local_latency / avg, 100.0 * local_latency / steady_avg,
+           manager->stats.page_migrations, manager->stats.cpu_migrations,
+           elapsed * 1e9 / accesses);
+
+    for (unsigned int t = 0; t < BENCH_TASKS; t++)
+        destroy_numa_task(manager, tasks[t]);
+    destroy_topo_manager(manager);
+    return avg;
+}
+
+static int run_benchmark(const char *distances) {
+    static const struct bench_scenario scenarios[] = {
+        { "local",                     MPOL_DEFAULT,    false, false, false },
+        { "interleave",                MPOL_INTERLEAVE, false, false, false },
+        { "node 0 first touch",        MPOL_DEFAULT,    true,  false, false },
+        { "node 0 + balancing",        MPOL_DEFAULT,    true,  false, true  },
+        { "node 0 pinned + balancing", MPOL_DEFAULT,    true,  true,  true  },
+    };
+
+    if (distances) {
+        topo_config_t config = { .num_nodes = BENCH_NODES, .num_sockets_per_node = 1 };
+        topo_manager_t *manager = create_topo_manager(config);
+        bool loaded = manager && topo_load_node_distances(manager, distances);
+        destroy_topo_manager(manager);
+        if (!loaded)
+            return 1;
+    }
+
+    printf("%d nodes, %d tasks x %d pages, %lu accesses each, 80%% on 20%% of pages\n",
+           BENCH_NODES, BENCH_TASKS, BENCH_PAGES, BENCH_ACCESSES);
+    printf("Distances: %s\n", distances ? distances : "hypercube (10/16/22/28)");
+    printf("  %-26s %9s %9s %6s %7s %7s %7s %5s %8s\n", "scenario", "avg", "steady",
+           "remote", "thru", "steady", "pg-mig", "t-mig", "cost");
+
+    double local_latency = 0;
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        double avg = bench_run(&scenarios[i], distances, local_latency);
+        if (avg == 0)
+            return 1;
+        if (i == 0)
+            local_latency = avg;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *distances = NULL;
+    bool bench = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench") == 0) {
+            bench = true;
+        } else if (strcmp(argv[i], "--distances") == 0 && i + 1 < argc) {
+            distances = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--bench] [--distances SYSFS_NODE_DIR]\n", argv[0]);
+            return 1;
+        }
+    }
+
     // Set log level
     current_log_level = LOG_LEVEL_INFO;
 
+    if (bench)
+        return run_benchmark(distances);
+
     // Run demonstration
     demonstrate_topology();
+    demonstrate_numa_policies();
 
     return 0;
 }
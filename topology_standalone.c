@@ -1,11 +1,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
 #include "topology.h"
 
 /* Global variables */
 static struct cpu_topology cpu_topology[MAX_CPUS];
 static unsigned long cpu_capacity[MAX_CPUS];
+static unsigned long raw_capacity[MAX_CPUS];
+static const char *cpu_type_of[MAX_CPUS];
 static unsigned long max_capacity = 0;
 
 /* CPU efficiency table */
@@ -17,6 +22,57 @@ static const struct cpu_efficiency table_efficiency[] = {
     {NULL, 0},
 };
 
+/*
+ * Energy model: operating points of each core type, as power at every
+ * frequency.  A cluster shares one clock, so it is one performance
+ * domain and runs at the OPP its busiest CPU needs.
+ */
+#define EM_MAX_PERF_STATES 8
+
+struct em_perf_state {
+    unsigned long frequency;    /* kHz */
+    unsigned long power;        /* mW while busy */
+    unsigned long cost;         /* power * max_freq / frequency */
+};
+
+struct em_opp_table {
+    const char *compatible;
+    unsigned int nr_perf_states;
+    struct {
+        unsigned long frequency;
+        unsigned long power;
+    } opp[EM_MAX_PERF_STATES];
+};
+
+static const struct em_opp_table table_energy[] = {
+    {"arm,cortex-a15", 5, {{ 800000, 320}, {1200000, 560}, {1600000, 900},
+                           {2000000, 1400}, {2500000, 2150}}},
+    {"arm,cortex-a7",  5, {{ 350000,  20}, { 600000,  40}, { 800000,  62},
+                           {1000000,  95}, {1200000,  140}}},
+    {"arm,cortex-a53", 5, {{ 500000,  40}, { 800000,  75}, {1000000, 110},
+                           {1200000,  160}, {1400000,  230}}},
+    {"arm,cortex-a72", 5, {{ 600000, 250}, {1000000, 480}, {1400000, 800},
+                           {1800000, 1250}, {2000000, 1550}}},
+    {NULL, 0, {{0, 0}}},
+};
+
+struct em_perf_domain {
+    unsigned int cluster_id;
+    unsigned int cpus[MAX_CPUS];
+    unsigned int nr_cpus;
+    unsigned int nr_perf_states;
+    struct em_perf_state table[EM_MAX_PERF_STATES];
+};
+
+static struct em_perf_domain perf_domains[MAX_CPUS];
+static unsigned int nr_perf_domains = 0;
+
+/* Utilization currently placed on each CPU, in capacity units */
+static unsigned long cpu_util[MAX_CPUS];
+
+/* Headroom schedutil keeps: util must stay below 80% of capacity */
+#define fits_capacity(util, cap) ((util) * 1280 < (cap) * 1024)
+
 void init_cpu_topology(void) {
     memset(cpu_topology, 0, sizeof(cpu_topology));
     memset(cpu_capacity, 0, sizeof(cpu_capacity));
@@ -49,13 +105,15 @@ int add_cpu(unsigned int cpuid, const char *cpu_type,
     cpu_topology[cpuid].core_id = core_id;
     cpu_topology[cpuid].cluster_id = cluster_id;
     cpu_topology[cpuid].present = true;
+    cpu_type_of[cpuid] = cpu_type;
     
     /* Calculate CPU capacity based on efficiency */
     unsigned long efficiency = get_cpu_efficiency(cpu_type);
-    cpu_capacity[cpuid] = (efficiency * SCHED_CAPACITY_SCALE) / 3891;
+    raw_capacity[cpuid] = (efficiency * SCHED_CAPACITY_SCALE) / 3891;
+    cpu_capacity[cpuid] = raw_capacity[cpuid];
     
-    if (cpu_capacity[cpuid] > max_capacity)
-        max_capacity = cpu_capacity[cpuid];
+    if (raw_capacity[cpuid] > max_capacity)
+        max_capacity = raw_capacity[cpuid];
         
     return 0;
 }
@@ -66,12 +124,14 @@ int remove_cpu(unsigned int cpuid) {
         
     cpu_topology[cpuid].present = false;
     cpu_capacity[cpuid] = 0;
+    raw_capacity[cpuid] = 0;
+    cpu_type_of[cpuid] = NULL;
     
     /* Recalculate max capacity */
     max_capacity = 0;
     for (int i = 0; i < MAX_CPUS; i++) {
-        if (cpu_topology[i].present && cpu_capacity[i] > max_capacity)
-            max_capacity = cpu_capacity[i];
+        if (cpu_topology[i].present && raw_capacity[i] > max_capacity)
+            max_capacity = raw_capacity[i];
     }
     
     return 0;
@@ -81,9 +141,10 @@ void update_cpu_capacity(unsigned int cpu) {
     if (cpu >= MAX_CPUS || !cpu_topology[cpu].present)
         return;
         
-    /* Normalize capacity to max capacity */
+    /* Normalize capacity to max capacity; from the raw value, so
+     * repeated updates do not compound */
     if (max_capacity > 0) {
-        cpu_capacity[cpu] = (cpu_capacity[cpu] * SCHED_CAPACITY_SCALE) / max_capacity;
+        cpu_capacity[cpu] = (raw_capacity[cpu] * SCHED_CAPACITY_SCALE) / max_capacity;
     }
 }
 
@@ -110,8 +171,369 @@ void print_cpu_topology(void) {
     }
 }
 
+static const struct em_opp_table *get_cpu_opp_table(const char *cpu_type) {
+    const struct em_opp_table *table = table_energy;
+    
+    while (cpu_type && table->compatible) {
+        if (strcmp(table->compatible, cpu_type) == 0)
+            return table;
+        table++;
+    }
+    
+    return NULL;
+}
+
+/*
+ * Build one performance domain per cluster from the OPP table of its
+ * CPUs.  Run after the capacities are updated.  Returns the number of
+ * domains; 0 when a present CPU has no energy model.
+ */
+int build_perf_domains(void) {
+    nr_perf_domains = 0;
+    
+    for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (!cpu_topology[cpu].present)
+            continue;
+            
+        struct em_perf_domain *pd = NULL;
+        for (unsigned int i = 0; i < nr_perf_domains; i++) {
+            if (perf_domains[i].cluster_id == cpu_topology[cpu].cluster_id)
+                pd = &perf_domains[i];
+        }
+        
+        if (!pd) {
+            const struct em_opp_table *opp = get_cpu_opp_table(cpu_type_of[cpu]);
+            if (!opp) {
+                nr_perf_domains = 0;
+                return 0;
+            }
+            
+            pd = &perf_domains[nr_perf_domains++];
+            pd->cluster_id = cpu_topology[cpu].cluster_id;
+            pd->nr_cpus = 0;
+            pd->nr_perf_states = opp->nr_perf_states;
+            
+            /* Cost: energy per unit of work, busy time scaling with
+             * max_freq / freq */
+            unsigned long max_freq = opp->opp[opp->nr_perf_states - 1].frequency;
+            for (unsigned int i = 0; i < opp->nr_perf_states; i++) {
+                pd->table[i].frequency = opp->opp[i].frequency;
+                pd->table[i].power = opp->opp[i].power;
+                pd->table[i].cost = opp->opp[i].power * max_freq / opp->opp[i].frequency;
+            }
+        }
+        pd->cpus[pd->nr_cpus++] = cpu;
+    }
+    
+    return (int)nr_perf_domains;
+}
+
+/*
+ * Estimated power of a domain, in mW, if dst_cpu takes on task_util
+ * more (dst_cpu -1: as it stands).  The domain runs at the lowest OPP
+ * that leaves the busiest CPU schedutil's 25% headroom; each CPU then
+ * spends util / capacity of the time busy at that OPP's cost.
+ */
+static unsigned long em_pd_energy(const struct em_perf_domain *pd, int dst_cpu,
+                                  unsigned long task_util) {
+    unsigned long max_util = 0, sum_util = 0;
+    unsigned long scale_cpu = cpu_capacity[pd->cpus[0]];
+    
+    if (!scale_cpu)
+        return 0;
+        
+    for (unsigned int i = 0; i < pd->nr_cpus; i++) {
+        unsigned int cpu = pd->cpus[i];
+        unsigned long util = cpu_util[cpu];
+        
+        if ((int)cpu == dst_cpu)
+            util += task_util;
+        if (util > scale_cpu)
+            util = scale_cpu;
+        sum_util += util;
+        if (util > max_util)
+            max_util = util;
+    }
+    
+    /* Frequency that serves max_util with headroom */
+    unsigned long max_freq = pd->table[pd->nr_perf_states - 1].frequency;
+    unsigned long freq = (max_util + (max_util >> 2)) * max_freq / scale_cpu;
+    const struct em_perf_state *ps = &pd->table[pd->nr_perf_states - 1];
+    
+    for (unsigned int i = 0; i < pd->nr_perf_states; i++) {
+        if (pd->table[i].frequency >= freq) {
+            ps = &pd->table[i];
+            break;
+        }
+    }
+    
+    return ps->cost * sum_util / scale_cpu;
+}
+
+/* Any CPU past its headroom: placement should spread, not save */
+static bool system_overutilized(void) {
+    for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (cpu_topology[cpu].present && !fits_capacity(cpu_util[cpu], cpu_capacity[cpu]))
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Wakeup placement by energy.  Each domain's energy as it stands is
+ * computed once; a candidate only re-evaluates its own domain, so the
+ * cost is one pass per domain plus one per candidate.  Candidates are
+ * the previous CPU and, per domain, the CPU with the most spare
+ * capacity that still fits the task: the one that keeps the domain's
+ * OPP lowest.  Returns -1 when overutilized or nothing fits, leaving
+ * the choice to the capacity-aware fallback.
+ */
+int find_energy_efficient_cpu(unsigned long task_util, int prev_cpu) {
+    unsigned long best_delta = ULONG_MAX, prev_delta = ULONG_MAX;
+    int best_cpu = -1;
+    
+    if (!nr_perf_domains || system_overutilized())
+        return -1;
+        
+    for (unsigned int d = 0; d < nr_perf_domains; d++) {
+        const struct em_perf_domain *pd = &perf_domains[d];
+        unsigned long base_energy = em_pd_energy(pd, -1, 0);
+        long max_spare = -1;
+        int max_spare_cpu = -1;
+        
+        for (unsigned int i = 0; i < pd->nr_cpus; i++) {
+            unsigned int cpu = pd->cpus[i];
+            unsigned long util = cpu_util[cpu] + task_util;
+            
+            if (!fits_capacity(util, cpu_capacity[cpu]))
+                continue;
+                
+            if ((int)cpu == prev_cpu) {
+                prev_delta = em_pd_energy(pd, prev_cpu, task_util) - base_energy;
+                continue;
+            }
+            
+            long spare = (long)cpu_capacity[cpu] - (long)util;
+            if (spare > max_spare) {
+                max_spare = spare;
+                max_spare_cpu = (int)cpu;
+            }
+        }
+        
+        if (max_spare_cpu < 0)
+            continue;
+            
+        unsigned long delta = em_pd_energy(pd, max_spare_cpu, task_util) - base_energy;
+        if (delta < best_delta) {
+            best_delta = delta;
+            best_cpu = max_spare_cpu;
+        }
+    }
+    
+    /* Stay put unless moving saves energy */
+    if (prev_delta <= best_delta)
+        return prev_delta == ULONG_MAX ? -1 : prev_cpu;
+    return best_cpu;
+}
+
+/* Capacity-aware fallback: the CPU with the most spare capacity */
+int find_max_spare_cpu(unsigned long task_util) {
+    long max_spare = LONG_MIN;
+    int best_cpu = -1;
+    
+    for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (!cpu_topology[cpu].present)
+            continue;
+        long spare = (long)cpu_capacity[cpu] - (long)(cpu_util[cpu] + task_util);
+        if (spare > max_spare) {
+            max_spare = spare;
+            best_cpu = (int)cpu;
+        }
+    }
+    
+    return best_cpu;
+}
+
+/* Energy-aware placement, falling back to spare capacity */
+int select_task_cpu(unsigned long task_util, int prev_cpu) {
+    int cpu = find_energy_efficient_cpu(task_util, prev_cpu);
+    
+    return cpu >= 0 ? cpu : find_max_spare_cpu(task_util);
+}
+
+void place_task(unsigned int cpu, unsigned long task_util) {
+    if (cpu < MAX_CPUS)
+        cpu_util[cpu] += task_util;
+}
+
+void clear_cpu_util(void) {
+    memset(cpu_util, 0, sizeof(cpu_util));
+}
+
+/* Estimated power of the whole system in mW */
+unsigned long compute_energy(void) {
+    unsigned long energy = 0;
+    
+    for (unsigned int d = 0; d < nr_perf_domains; d++)
+        energy += em_pd_energy(&perf_domains[d], -1, 0);
+    return energy;
+}
+
+void print_energy_model(void) {
+    printf("\nEnergy Model:\n");
+    for (unsigned int d = 0; d < nr_perf_domains; d++) {
+        const struct em_perf_domain *pd = &perf_domains[d];
+        
+        printf("Cluster %u (CPUs", pd->cluster_id);
+        for (unsigned int i = 0; i < pd->nr_cpus; i++)
+            printf(" %u", pd->cpus[i]);
+        printf(", capacity %lu):\n", cpu_capacity[pd->cpus[0]]);
+        
+        for (unsigned int i = 0; i < pd->nr_perf_states; i++) {
+            printf("  %4lu MHz  %5lu mW  cost %5lu\n",
+                   pd->table[i].frequency / 1000, pd->table[i].power, pd->table[i].cost);
+        }
+    }
+}
+
+/*
+ * Benchmark: periodic tasks re-placed every round on 4 big + 4 LITTLE
+ * CPUs.  A CPU given more than its capacity delivers only its capacity,
+ * so throughput is delivered over demanded utilization.
+ */
+#define BENCH_ROUNDS       2000
+#define BENCH_MAX_TASKS    64
+
+static inline uint64_t bench_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+enum bench_policy {
+    BENCH_UNAWARE,      /* least utilized CPU, capacity ignored */
+    BENCH_SPARE,        /* most spare capacity */
+    BENCH_EAS,          /* energy aware, spare capacity fallback */
+};
+
+static const char *const bench_policy_names[] = { "unaware", "spare-cap", "energy" };
+
+static int bench_select(enum bench_policy policy, unsigned long task_util, int prev_cpu) {
+    if (policy == BENCH_EAS)
+        return select_task_cpu(task_util, prev_cpu);
+    if (policy == BENCH_SPARE)
+        return find_max_spare_cpu(task_util);
+
+    int best_cpu = -1;
+    unsigned long min_util = ULONG_MAX;
+    for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (cpu_topology[cpu].present && cpu_util[cpu] < min_util) {
+            min_util = cpu_util[cpu];
+            best_cpu = (int)cpu;
+        }
+    }
+    return best_cpu;
+}
+
+static void bench_run(unsigned int load_pct, enum bench_policy policy) {
+    unsigned long task_util[BENCH_MAX_TASKS];
+    int prev_cpu[BENCH_MAX_TASKS];
+    unsigned long total_capacity = 0, demand = 0;
+    unsigned int nr_tasks = 0;
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    double energy = 0, delivered = 0, requested = 0;
+    uint64_t placements = 0;
+    
+    for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (cpu_topology[cpu].present)
+            total_capacity += cpu_capacity[cpu];
+    }
+    
+    /* Mostly light tasks, one in eight heavy, up to the target load */
+    while (nr_tasks < BENCH_MAX_TASKS && demand < total_capacity * load_pct / 100) {
+        unsigned long util = bench_rand(&seed) % 8 == 0
+            ? 150 + bench_rand(&seed) % 250
+            : 20 + bench_rand(&seed) % 80;
+        task_util[nr_tasks] = util;
+        prev_cpu[nr_tasks] = -1;
+        demand += util;
+        nr_tasks++;
+    }
+    
+    double start = bench_now();
+    for (unsigned int round = 0; round < BENCH_ROUNDS; round++) {
+        clear_cpu_util();
+        
+        /* Wake in a different order each round, each task's util
+         * jittering by up to +-25% */
+        unsigned int first = (unsigned int)(bench_rand(&seed) % nr_tasks);
+        for (unsigned int i = 0; i < nr_tasks; i++) {
+            unsigned int t = (first + i) % nr_tasks;
+            unsigned long util = task_util[t] * (75 + bench_rand(&seed) % 51) / 100;
+            int cpu = bench_select(policy, util, prev_cpu[t]);
+            
+            place_task((unsigned int)cpu, util);
+            prev_cpu[t] = cpu;
+            requested += util;
+            placements++;
+        }
+        
+        for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+            if (cpu_topology[cpu].present)
+                delivered += cpu_util[cpu] < cpu_capacity[cpu] ? cpu_util[cpu] : cpu_capacity[cpu];
+        }
+        energy += compute_energy();
+    }
+    double elapsed = bench_now() - start;
+    
+    printf("  %3u%% load %2u tasks  %-9s  power %6.0f mW  throughput %5.1f%%  "
+           "work/mW %5.2f  %4.0f ns/placement\n",
+           load_pct, nr_tasks, bench_policy_names[policy], energy / BENCH_ROUNDS,
+           100.0 * delivered / requested, energy > 0 ? delivered / energy : 0.0,
+           elapsed * 1e9 / (placements ? placements : 1));
+}
+
+static int run_benchmark(void) {
+    static const unsigned int loads[] = { 15, 30, 50, 70 };
+    
+    init_cpu_topology();
+    for (unsigned int cpu = 0; cpu < 8; cpu++) {
+        if (add_cpu(cpu, cpu < 4 ? "arm,cortex-a72" : "arm,cortex-a53",
+                    0, cpu, cpu < 4 ? 0 : 1) < 0) {
+            printf("benchmark needs MAX_CPUS >= 8\n");
+            return 1;
+        }
+    }
+    for (int i = 0; i < MAX_CPUS; i++)
+        update_cpu_capacity(i);
+    if (!build_perf_domains())
+        return 1;
+        
+    printf("Task placement on 4x Cortex-A72 + 4x Cortex-A53, %d rounds\n"
+           "(load as share of total capacity; work/mW = delivered capacity per mW)\n",
+           BENCH_ROUNDS);
+    for (unsigned int i = 0; i < sizeof(loads) / sizeof(loads[0]); i++) {
+        bench_run(loads[i], BENCH_UNAWARE);
+        bench_run(loads[i], BENCH_SPARE);
+        bench_run(loads[i], BENCH_EAS);
+    }
+    return 0;
+}
+
 /* Example usage */
-int main() {
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        return run_benchmark();
+        
     /* Initialize topology subsystem */
     init_cpu_topology();
     
@@ -129,6 +551,21 @@ int main() {
     /* Print topology */
     print_cpu_topology();
     
+    /* Energy-aware placement of a few tasks */
+    if (build_perf_domains()) {
+        static const unsigned long utils[] = { 60, 120, 90, 400, 250, 40 };
+        
+        print_energy_model();
+        printf("\nEnergy-aware placement:\n");
+        clear_cpu_util();
+        for (unsigned int i = 0; i < sizeof(utils) / sizeof(utils[0]); i++) {
+            int cpu = select_task_cpu(utils[i], -1);
+            place_task((unsigned int)cpu, utils[i]);
+            printf("  task util %3lu -> CPU %d (system %lu mW)\n",
+                   utils[i], cpu, compute_energy());
+        }
+    }
+    
     /* Remove a CPU */
     printf("\nRemoving CPU 1...\n");
     remove_cpu(1);
@@ -2,6 +2,14 @@
 /*
  * UDP Protocol Implementation Simulation
  * Based on Linux kernel UDP implementation
+ *
+ * Receive is batched: a vector of skbs is demultiplexed in one pass,
+ * consecutive datagrams of one flow are coalesced (UDP GRO) and handed to
+ * the socket's lockless MPSC queue in a single operation.
+ *
+ * Sockets are hashed twice, by local port and by (local address, port),
+ * in an RCU-resizable table; SO_REUSEPORT sockets on one address form a
+ * group from which lookup picks a member by flow hash in O(1).
  */
 
 #include <linux/types.h>
@@ -14,6 +22,13 @@
 #include <linux/inet.h>
 #include <linux/netdevice.h>
 #include <linux/skbuff.h>
+#include <linux/llist.h>
+#include <linux/wait.h>
+#include <linux/spinlock.h>
+#include <linux/seqlock.h>
+#include <linux/rculist.h>
+#include <linux/random.h>
+#include <linux/jhash.h>
 #include <net/sock.h>
 #include <net/checksum.h>
 #include <net/udp.h>
@@ -22,6 +37,17 @@
 #include <net/route.h>
 #include <net/inet_common.h>
 
+#include "csum_sim.h"
+
+/* UDP Receive Batching */
+#define UDP_GRO_CNT_MAX 64       /* Max datagrams per GRO super-skb */
+#define UDP_GRO_MAX_LEN 65535    /* Max bytes per GRO super-skb */
+#define UDP_RCV_BATCH_MAX 64     /* Max skbs per udp_v4_rcv_batch() call */
+
+#ifndef UDP_GRO
+#define UDP_GRO 104              /* setsockopt: receive coalesced datagrams */
+#endif
+
 /* UDP Socket Structure */
 struct udp_sock {
     struct sock sk;
@@ -36,8 +62,33 @@ struct udp_sock {
     __u8  no_check6_tx:1;   /* Disable checksum on outgoing packets */
     __u8  no_check6_rx:1;   /* Disable checksum on incoming packets */
     __u8  encap_enabled:1;  /* UDP encapsulation enabled */
+    __u8  gro_enabled:1;    /* Deliver GRO super-datagrams */
     int (*encap_rcv)(struct sock *sk, struct sk_buff *skb);
     void (*encap_destroy)(struct sock *sk);
+
+    /* Secondary hash on (saddr, port); primary uses sk->sk_node */
+    struct hlist_node udp_portaddr_node;
+    unsigned int udp_portaddr_hash;
+    struct udp_reuseport __rcu *reuse;
+
+    /*
+     * Receive queue. Softirq producers push with llist_add_batch() and
+     * never take a lock; readers splice the llist into reader_queue under
+     * reader_lock, so one splice serves many recvmsg calls.
+     */
+    struct llist_head rx_llist;
+    struct sk_buff_head reader_queue;
+    spinlock_t reader_lock;
+    atomic_t rx_mem;              /* truesize queued, against sk_rcvbuf */
+    wait_queue_head_t rx_wait;
+};
+
+/* vector entry for udp_v4_recvmmsg() */
+struct udp_mmsghdr {
+    struct msghdr msg_hdr;
+    size_t msg_cap;              /* Buffer size for this entry */
+    int addr_len;
+    unsigned int msg_len;        /* Bytes received */
 };
 
 /* UDP Statistics */
@@ -48,14 +99,51 @@ struct udp_mib {
     unsigned long udp_noports;
     unsigned long udp_rx_csum_errors;
     unsigned long udp_ignored_errors;
+    unsigned long udp_rcv_batches;
+    unsigned long udp_gro_merged;
+    unsigned long udp_rcvbuf_errors;
 };
 
 static struct udp_mib udp_statistics;
 
 /* UDP Socket Hash Table */
-#define UDP_HTABLE_SIZE 128
-static struct hlist_head udp_hash[UDP_HTABLE_SIZE];
+#define UDP_HTABLE_SIZE 128          /* Initial slots per hash */
+#define UDP_HTABLE_SIZE_MAX 65536
+#define UDP_HTABLE_LOAD 2            /* Grow past 2 sockets per slot */
+#define UDP_REUSEPORT_INIT 8
+
+struct udp_hslot {
+    struct hlist_head head;
+    unsigned int count;
+};
+
+struct udp_table {
+    unsigned int mask;
+    struct udp_hslot *hash;          /* By local port */
+    struct udp_hslot *hash2;         /* By (local address, local port) */
+    struct rcu_head rcu;
+};
+
+/* SO_REUSEPORT group: sockets bound to the same (address, port) */
+struct udp_reuseport {
+    __u16 num_socks;
+    __u16 max_socks;
+    struct rcu_head rcu;
+    struct sock *socks[];
+};
+
+/*
+ * Readers walk the table under RCU and retry if a resize moved sockets
+ * underneath them; writers serialize on udp_hash_lock. Lookups run from
+ * the receive softirq, so writers keep BH off: a softirq spinning in
+ * read_seqcount_begin() on the writer's CPU would never see it finish.
+ */
+static struct udp_table __rcu *udp_table;
 static DEFINE_SPINLOCK(udp_hash_lock);
+static seqcount_spinlock_t udp_table_seq =
+    SEQCNT_SPINLOCK_ZERO(udp_table_seq, &udp_hash_lock);
+static unsigned int udp_sock_count;
+static u32 udp_hash_secret __read_mostly;
 
 /* UDP Socket Functions */
 
@@ -64,120 +152,794 @@ static inline struct udp_sock *udp_sk(const struct sock *sk)
     return (struct udp_sock *)sk;
 }
 
-static unsigned int udp_hash_function(struct net *net, __be16 port)
+/* Unmasked; callers apply the current table's mask */
+static unsigned int udp_hash_function(struct net *net, unsigned short port)
 {
-    return jhash_1word((__u32)port, 0) & (UDP_HTABLE_SIZE - 1);
+    return jhash_1word((__u32)port, udp_hash_secret);
 }
 
-static int udp_v4_get_port(struct sock *sk, unsigned short snum)
+static unsigned int udp_portaddr_hash(__be32 addr, unsigned short port)
+{
+    return jhash_1word((__force __u32)addr, udp_hash_secret) ^ port;
+}
+
+static inline u32 udp_flow_hash(__be32 saddr, __be16 sport,
+                                __be32 daddr, __be16 dport)
+{
+    return jhash_3words((__force __u32)daddr, (__force __u32)saddr,
+                        ((__u32)ntohs(sport) << 16) | ntohs(dport),
+                        udp_hash_secret);
+}
+
+static struct udp_table *udp_table_alloc(unsigned int size, gfp_t gfp)
+{
+    struct udp_table *t;
+    unsigned int i;
+
+    t = kzalloc(sizeof(*t), gfp);
+    if (!t)
+        return NULL;
+    t->hash = kvcalloc(size, sizeof(*t->hash), gfp);
+    t->hash2 = kvcalloc(size, sizeof(*t->hash2), gfp);
+    if (!t->hash || !t->hash2) {
+        kvfree(t->hash);
+        kvfree(t->hash2);
+        kfree(t);
+        return NULL;
+    }
+    for (i = 0; i < size; i++) {
+        INIT_HLIST_HEAD(&t->hash[i].head);
+        INIT_HLIST_HEAD(&t->hash2[i].head);
+    }
+    t->mask = size - 1;
+    return t;
+}
+
+static void udp_table_free(struct udp_table *t)
+{
+    kvfree(t->hash);
+    kvfree(t->hash2);
+    kfree(t);
+}
+
+static inline struct udp_table *udp_table_locked(void)
+{
+    return rcu_dereference_protected(udp_table,
+                                     lockdep_is_held(&udp_hash_lock));
+}
+
+/* Caller holds udp_hash_lock */
+static void udp_hash_sk(struct udp_table *t, struct sock *sk)
+{
+    struct udp_sock *up = udp_sk(sk);
+    struct udp_hslot *hslot, *hslot2;
+
+    hslot = &t->hash[udp_hash_function(sock_net(sk), sk->sk_port) & t->mask];
+    hslot2 = &t->hash2[up->udp_portaddr_hash & t->mask];
+
+    hlist_add_head_rcu(&sk->sk_node, &hslot->head);
+    hslot->count++;
+    hlist_add_head_rcu(&up->udp_portaddr_node, &hslot2->head);
+    hslot2->count++;
+}
+
+/* Caller holds udp_hash_lock */
+static void udp_unhash_sk(struct udp_table *t, struct sock *sk)
 {
-    unsigned int hash = udp_hash_function(sock_net(sk), snum);
     struct udp_sock *up = udp_sk(sk);
-    struct hlist_node *node;
+
+    hlist_del_rcu(&sk->sk_node);
+    t->hash[udp_hash_function(sock_net(sk), sk->sk_port) & t->mask].count--;
+    hlist_del_rcu(&up->udp_portaddr_node);
+    t->hash2[up->udp_portaddr_hash & t->mask].count--;
+}
+
+/*
+ * Double both hashes. Sockets are moved under the write side of
+ * udp_table_seq so a lookup that raced with the move retries.
+ */
+static void udp_table_grow(void)
+{
+    struct udp_table *old, *new;
+    struct sock *sk;
+    struct hlist_node *tmp;
+    unsigned int size, i;
+
+    rcu_read_lock();
+    size = (rcu_dereference(udp_table)->mask + 1) * 2;
+    rcu_read_unlock();
+    if (size > UDP_HTABLE_SIZE_MAX)
+        return;
+
+    new = udp_table_alloc(size, GFP_KERNEL);
+    if (!new)
+        return;
+
+    spin_lock_bh(&udp_hash_lock);
+    old = udp_table_locked();
+    if (old->mask + 1 != size / 2 ||
+        udp_sock_count <= UDP_HTABLE_LOAD * (old->mask + 1)) {
+        /* Someone else grew it, or sockets went away */
+        spin_unlock_bh(&udp_hash_lock);
+        udp_table_free(new);
+        return;
+    }
+
+    write_seqcount_begin(&udp_table_seq);
+    for (i = 0; i <= old->mask; i++) {
+        hlist_for_each_entry_safe(sk, tmp, &old->hash[i].head, sk_node) {
+            udp_unhash_sk(old, sk);
+            udp_hash_sk(new, sk);
+        }
+    }
+    rcu_assign_pointer(udp_table, new);
+    write_seqcount_end(&udp_table_seq);
+    spin_unlock_bh(&udp_hash_lock);
+
+    synchronize_rcu();
+    udp_table_free(old);
+}
+
+/* SO_REUSEPORT groups; callers hold udp_hash_lock */
+
+static struct udp_reuseport *udp_reuseport_alloc(unsigned int max)
+{
+    struct udp_reuseport *reuse;
+
+    reuse = kzalloc(struct_size(reuse, socks, max), GFP_ATOMIC);
+    if (reuse)
+        reuse->max_socks = max;
+    return reuse;
+}
+
+static int udp_reuseport_add(struct sock *sk, struct sock *peer)
+{
+    struct udp_reuseport *reuse, *more;
+    unsigned int i;
+
+    reuse = rcu_dereference_protected(udp_sk(peer)->reuse,
+                                      lockdep_is_held(&udp_hash_lock));
+    if (!reuse) {
+        reuse = udp_reuseport_alloc(UDP_REUSEPORT_INIT);
+        if (!reuse)
+            return -ENOMEM;
+        reuse->socks[0] = peer;
+        reuse->num_socks = 1;
+        rcu_assign_pointer(udp_sk(peer)->reuse, reuse);
+    }
+
+    if (reuse->num_socks == reuse->max_socks) {
+        if (reuse->max_socks > U16_MAX / 2)
+            return -EBUSY;
+        more = udp_reuseport_alloc(reuse->max_socks * 2);
+        if (!more)
+            return -ENOMEM;
+        memcpy(more->socks, reuse->socks,
+               reuse->num_socks * sizeof(struct sock *));
+        more->num_socks = reuse->num_socks;
+        for (i = 0; i < more->num_socks; i++)
+            rcu_assign_pointer(udp_sk(more->socks[i])->reuse, more);
+        kfree_rcu(reuse, rcu);
+        reuse = more;
+    }
+
+    reuse->socks[reuse->num_socks] = sk;
+    /* Publish the slot before the count that makes it selectable */
+    smp_wmb();
+    WRITE_ONCE(reuse->num_socks, reuse->num_socks + 1);
+    rcu_assign_pointer(udp_sk(sk)->reuse, reuse);
+    return 0;
+}
+
+static void udp_reuseport_detach(struct sock *sk)
+{
+    struct udp_reuseport *reuse;
+    unsigned int i;
+
+    reuse = rcu_dereference_protected(udp_sk(sk)->reuse,
+                                      lockdep_is_held(&udp_hash_lock));
+    if (!reuse)
+        return;
+
+    for (i = 0; i < reuse->num_socks; i++) {
+        if (reuse->socks[i] == sk) {
+            reuse->socks[i] = reuse->socks[reuse->num_socks - 1];
+            smp_wmb();
+            WRITE_ONCE(reuse->num_socks, reuse->num_socks - 1);
+            break;
+        }
+    }
+    RCU_INIT_POINTER(udp_sk(sk)->reuse, NULL);
+    if (!reuse->num_socks)
+        kfree_rcu(reuse, rcu);
+}
+
+/* O(1) member selection; caller holds rcu_read_lock */
+static struct sock *udp_reuseport_select(struct udp_reuseport *reuse, u32 hash)
+{
+    unsigned int num = READ_ONCE(reuse->num_socks);
+
+    if (!num)
+        return NULL;
+    smp_rmb();
+    return READ_ONCE(reuse->socks[reciprocal_scale(hash, num)]);
+}
+
+/*
+ * May sk bind (up->saddr, snum)? On success *peer is set to a socket whose
+ * reuseport group sk should join, if any. Binding a specific address only
+ * needs the two hash2 slots; a wildcard bind overlaps every address and
+ * walks the port's primary slot.
+ */
+static int udp_lib_lport_inuse(struct udp_table *t, struct sock *sk,
+                               unsigned short snum, struct sock **peer)
+{
+    struct udp_sock *up = udp_sk(sk), *up2;
     struct sock *sk2;
+    unsigned int slot;
+    int pass;
+
+    *peer = NULL;
+
+    if (up->saddr != htonl(INADDR_ANY)) {
+        for (pass = 0; pass < 2; pass++) {
+            __be32 addr = pass ? htonl(INADDR_ANY) : up->saddr;
+
+            slot = udp_portaddr_hash(addr, snum) & t->mask;
+            hlist_for_each_entry(up2, &t->hash2[slot].head, udp_portaddr_node) {
+                sk2 = &up2->sk;
+                if (sk2->sk_port != snum || up2->saddr != addr ||
+                    (sk->sk_bound_dev_if && sk2->sk_bound_dev_if &&
+                     sk->sk_bound_dev_if != sk2->sk_bound_dev_if))
+                    continue;
+                if (!sk->sk_reuseport || !sk2->sk_reuseport)
+                    return 1;
+                /* Only an exact device match may share a group */
+                if (!pass && !*peer && !up2->daddr &&
+                    sk->sk_bound_dev_if == sk2->sk_bound_dev_if)
+                    *peer = sk2;
+            }
+        }
+        return 0;
+    }
+
+    slot = udp_hash_function(sock_net(sk), snum) & t->mask;
+    hlist_for_each_entry(sk2, &t->hash[slot].head, sk_node) {
+        if (sk2->sk_port != snum ||
+            (sk->sk_bound_dev_if && sk2->sk_bound_dev_if &&
+             sk->sk_bound_dev_if != sk2->sk_bound_dev_if))
+            continue;
+        if (!sk->sk_reuseport || !sk2->sk_reuseport)
+            return 1;
+        if (udp_sk(sk2)->saddr == htonl(INADDR_ANY) &&
+            !udp_sk(sk2)->daddr && !*peer &&
+            sk->sk_bound_dev_if == sk2->sk_bound_dev_if)
+            *peer = sk2;
+    }
+    return 0;
+}
+
+static int udp_v4_get_port(struct sock *sk, unsigned short snum)
+{
+    struct udp_sock *up = udp_sk(sk);
+    struct udp_table *t;
+    struct sock *peer;
+    unsigned int i, start;
     int ret = 0;
+    bool grow;
 
-    spin_lock(&udp_hash_lock);
+    spin_lock_bh(&udp_hash_lock);
+    t = udp_table_locked();
     
     if (!snum) {
-        /* Find an available port */
-        for (snum = 1024; snum < 65535; snum++) {
-            hash = udp_hash_function(sock_net(sk), snum);
-            hlist_for_each_entry(sk2, &udp_hash[hash], sk_node) {
-                if (sk2->sk_port == snum)
-                    goto next_port;
-            }
-            break;
-next_port:
-            continue;
+        /* Find an available port, starting at a random offset */
+        start = get_random_u32_below(65535 - 1024);
+        for (i = 0; i < 65535 - 1024; i++) {
+            snum = 1024 + (start + i) % (65535 - 1024);
+            if (!udp_lib_lport_inuse(t, sk, snum, &peer) && !peer)
+                break;
         }
-        if (snum >= 65535) {
+        if (i == 65535 - 1024) {
             ret = -EADDRINUSE;
             goto out;
         }
     } else {
         /* Check if requested port is available */
-        hlist_for_each_entry(sk2, &udp_hash[hash], sk_node) {
-            if (sk2->sk_port == snum) {
-                ret = -EADDRINUSE;
+        if (udp_lib_lport_inuse(t, sk, snum, &peer)) {
+            ret = -EADDRINUSE;
+            goto out;
+        }
+        if (peer) {
+            ret = udp_reuseport_add(sk, peer);
+            if (ret)
                 goto out;
-            }
         }
     }
 
     /* Assign port and add to hash table */
     sk->sk_port = snum;
-    hlist_add_head(&sk->sk_node, &udp_hash[hash]);
+    up->udp_portaddr_hash = udp_portaddr_hash(up->saddr, snum);
+    udp_hash_sk(t, sk);
+    udp_sock_count++;
 
 out:
-    spin_unlock(&udp_hash_lock);
+    grow = !ret && udp_sock_count > UDP_HTABLE_LOAD * (t->mask + 1);
+    spin_unlock_bh(&udp_hash_lock);
+    if (grow)
+        udp_table_grow();
     return ret;
 }
 
+static void udp_v4_unhash(struct sock *sk)
+{
+    spin_lock_bh(&udp_hash_lock);
+    if (!hlist_unhashed(&sk->sk_node)) {
+        udp_reuseport_detach(sk);
+        udp_unhash_sk(udp_table_locked(), sk);
+        sk_node_init(&sk->sk_node);
+        udp_sock_count--;
+    }
+    spin_unlock_bh(&udp_hash_lock);
+}
+
+/* Socket Lookup */
+
+static int udp_compute_score(struct sock *sk, __be32 saddr, __be16 sport,
+                             __be32 laddr, unsigned short hnum, int dif)
+{
+    struct udp_sock *up = udp_sk(sk);
+    int score = 1;
+
+    if (sk->sk_port != hnum || up->saddr != laddr)
+        return -1;
+    if (laddr)
+        score += 4;
+    if (up->daddr) {
+        if (up->daddr != saddr)
+            return -1;
+        score += 4;
+    }
+    if (up->dest) {
+        if (up->dest != sport)
+            return -1;
+        score += 4;
+    }
+    if (sk->sk_bound_dev_if) {
+        if (sk->sk_bound_dev_if != dif)
+            return -1;
+        score += 4;
+    }
+    return score;
+}
+
+static struct sock *udp_lookup2(const struct udp_hslot *hslot2, __be32 saddr,
+                                __be16 sport, __be32 laddr,
+                                unsigned short hnum, int dif, u32 hash)
+{
+    struct udp_reuseport *reuse;
+    struct udp_sock *up;
+    struct sock *sk, *result = NULL;
+    int score, badness = 0;
+
+    hlist_for_each_entry_rcu(up, &hslot2->head, udp_portaddr_node) {
+        sk = &up->sk;
+        score = udp_compute_score(sk, saddr, sport, laddr, hnum, dif);
+        if (score > badness) {
+            badness = score;
+            result = sk;
+        }
+    }
+
+    /*
+     * A connected socket wins outright. An unconnected winner stands for
+     * its whole group; connect() detaches members, so every socket the
+     * selector can return is unconnected too.
+     */
+    if (result && !udp_sk(result)->daddr) {
+        reuse = rcu_dereference(udp_sk(result)->reuse);
+        if (reuse) {
+            sk = udp_reuseport_select(reuse, hash);
+            if (sk)
+                return sk;
+        }
+    }
+    return result;
+}
+
+/*
+ * Look up the receiving socket: the exact (daddr, dport) slot first, then
+ * the wildcard one. Caller holds rcu_read_lock; sockets are SOCK_RCU_FREE.
+ */
+static struct sock *udp_v4_lookup(struct net *net, __be32 saddr, __be16 sport,
+                                  __be32 daddr, __be16 dport, int dif)
+{
+    unsigned short hnum = ntohs(dport);
+    u32 hash = udp_flow_hash(saddr, sport, daddr, dport);
+    const struct udp_table *t;
+    struct sock *result;
+    unsigned int seq, slot;
+
+    do {
+        seq = read_seqcount_begin(&udp_table_seq);
+        t = rcu_dereference(udp_table);
+
+        slot = udp_portaddr_hash(daddr, hnum) & t->mask;
+        result = udp_lookup2(&t->hash2[slot], saddr, sport, daddr,
+                             hnum, dif, hash);
+        if (!result) {
+            slot = udp_portaddr_hash(htonl(INADDR_ANY), hnum) & t->mask;
+            result = udp_lookup2(&t->hash2[slot], saddr, sport,
+                                 htonl(INADDR_ANY), hnum, dif, hash);
+        }
+    } while (read_seqcount_retry(&udp_table_seq, seq));
+
+    return result;
+}
+
 /* UDP Packet Handling */
 
 static int udp_v4_checksum(struct sk_buff *skb)
 {
     struct udphdr *uh = udp_hdr(skb);
-    __wsum csum;
+    const struct iphdr *iph = ip_hdr(skb);
+    __wsum psum;
 
-    if (uh->check == 0)
+    if (uh->check == 0 || skb->ip_summed == CHECKSUM_UNNECESSARY)
         return 0;
 
-    csum = skb_checksum(skb, 0, skb->len, 0);
-    if (csum == 0)
+    /* Use the device's full checksum rather than touching the payload */
+    psum = csum_tcpudp_nofold(iph->saddr, iph->daddr, skb->len,
+                              IPPROTO_UDP, 0);
+    if (skb->ip_summed == CHECKSUM_COMPLETE &&
+        !csum_fold(csum_add(skb->csum, psum))) {
+        skb->ip_summed = CHECKSUM_UNNECESSARY;
         return 0;
-    
-    return -1;
+    }
+
+    /* Linear skbs take the shared word-at-a-time kernel */
+    if (!skb_is_nonlinear(skb)) {
+        if (csum_sim_fold(csum_sim_partial(skb->data, skb->len,
+                                           (__force csum_sim_t)psum)))
+            return -1;
+    } else if (csum_fold(skb_checksum(skb, 0, skb->len, psum))) {
+        return -1;
+    }
+
+    skb->ip_summed = CHECKSUM_UNNECESSARY;
+    return 0;
 }
 
-static int udp_v4_rcv(struct sk_buff *skb)
+/* Per-socket receive queue */
+
+static void udp_rx_queue_init(struct udp_sock *up)
 {
-    struct udphdr *uh;
+    init_llist_head(&up->rx_llist);
+    skb_queue_head_init(&up->reader_queue);
+    spin_lock_init(&up->reader_lock);
+    atomic_set(&up->rx_mem, 0);
+    init_waitqueue_head(&up->rx_wait);
+}
+
+/* Producer side: publish a chain of skbs linked through ll_node */
+static void udp_rx_enqueue_batch(struct sock *sk, struct sk_buff *first,
+                                 struct sk_buff *last, int truesize)
+{
+    struct udp_sock *up = udp_sk(sk);
+
+    atomic_add(truesize, &up->rx_mem);
+    llist_add_batch(&first->ll_node, &last->ll_node, &up->rx_llist);
+    wake_up_interruptible(&up->rx_wait);
+    sk->sk_data_ready(sk);
+}
+
+/* Consumer side: caller holds reader_lock */
+static struct sk_buff *__udp_rx_dequeue(struct udp_sock *up)
+{
+    struct llist_node *node;
+    struct sk_buff *skb, *tmp;
+
+    skb = __skb_dequeue(&up->reader_queue);
+    if (skb)
+        return skb;
+
+    /* llist is LIFO; restore arrival order before splicing */
+    node = llist_reverse_order(llist_del_all(&up->rx_llist));
+    llist_for_each_entry_safe(skb, tmp, node, ll_node)
+        __skb_queue_tail(&up->reader_queue, skb);
+
+    return __skb_dequeue(&up->reader_queue);
+}
+
+static struct sk_buff *udp_rx_dequeue(struct sock *sk, int noblock, int *err)
+{
+    struct udp_sock *up = udp_sk(sk);
+    struct sk_buff *skb;
+    long timeo = sock_rcvtimeo(sk, noblock);
+
+    for (;;) {
+        spin_lock_bh(&up->reader_lock);
+        skb = __udp_rx_dequeue(up);
+        spin_unlock_bh(&up->reader_lock);
+        if (skb) {
+            atomic_sub(skb->truesize, &up->rx_mem);
+            return skb;
+        }
+
+        if (!timeo) {
+            *err = -EAGAIN;
+            return NULL;
+        }
+        timeo = wait_event_interruptible_timeout(up->rx_wait,
+                    !llist_empty(&up->rx_llist) ||
+                    !skb_queue_empty_lockless(&up->reader_queue), timeo);
+        if (timeo < 0) {
+            *err = sock_intr_errno(timeo);
+            return NULL;
+        }
+    }
+}
+
+static void udp_rx_purge(struct sock *sk)
+{
+    struct udp_sock *up = udp_sk(sk);
+    struct sk_buff *skb;
+
+    spin_lock_bh(&up->reader_lock);
+    while ((skb = __udp_rx_dequeue(up)) != NULL) {
+        atomic_sub(skb->truesize, &up->rx_mem);
+        kfree_skb(skb);
+    }
+    spin_unlock_bh(&up->reader_lock);
+}
+
+/* UDP GRO */
+
+/* Flow identity used for lookup reuse and GRO; never points at an skb */
+struct udp_flow_key {
+    __be32 saddr;
+    __be32 daddr;
+    __u32 ports;
+    const struct net_device *dev;
+};
+
+static inline void udp_flow_key_init(struct udp_flow_key *key,
+                                     const struct sk_buff *skb)
+{
+    key->saddr = ip_hdr(skb)->saddr;
+    key->daddr = ip_hdr(skb)->daddr;
+    key->ports = *(const __u32 *)udp_hdr(skb);
+    key->dev = skb->dev;
+}
+
+static inline bool udp_flow_key_eq(const struct udp_flow_key *a,
+                                   const struct udp_flow_key *b)
+{
+    return a->saddr == b->saddr && a->daddr == b->daddr &&
+           a->ports == b->ports && a->dev == b->dev;
+}
+
+/* Datagrams bound for one socket, collected during a batch */
+struct udp_rcv_chain {
     struct sock *sk;
-    int ret;
+    struct sk_buff *newest;      /* llist order: newest -> oldest */
+    struct sk_buff *oldest;
+    int truesize;
 
-    /* Validate UDP header */
-    if (!pskb_may_pull(skb, sizeof(struct udphdr)))
-        goto drop;
+    /* Open GRO super-skb; always == newest when set */
+    struct sk_buff *gro_head;
+    struct sk_buff *gro_tail;    /* Last skb on gro_head's frag_list */
+    struct udp_flow_key gro_flow;
+    bool gro_closed;             /* A short segment ended it */
+};
 
-    uh = udp_hdr(skb);
+/*
+ * Append skb to the open super-skb. Every segment but the last must carry
+ * exactly gso_size bytes of payload, as for UDP_SEGMENT.
+ */
+static bool udp_gro_merge(struct udp_rcv_chain *c, struct sk_buff *skb)
+{
+    struct sk_buff *head = c->gro_head;
+    struct skb_shared_info *shinfo = skb_shinfo(head);
+    unsigned int plen = skb->len - sizeof(struct udphdr);
 
-    /* Verify checksum */
-    if (udp_v4_checksum(skb) < 0)
-        goto csum_error;
+    /* A zero-length datagram has no gso_size boundary to survive in */
+    if (c->gro_closed || !plen)
+        return false;
 
-    /* Find matching socket */
-    sk = __udp4_lib_lookup(sock_net(skb->sk), ip_hdr(skb)->saddr,
-                          uh->source, ip_hdr(skb)->daddr,
-                          uh->dest, skb->dev->ifindex);
-    if (!sk)
-        goto no_sock;
+    if (!shinfo->gso_size) {
+        if (head->len - sizeof(struct udphdr) < plen)
+            return false;
+        shinfo->gso_size = head->len - sizeof(struct udphdr);
+        shinfo->gso_segs = 1;
+        shinfo->gso_type = SKB_GSO_UDP_L4;
+    }
 
-    /* Queue packet to socket */
-    ret = udp_queue_rcv_skb(sk, skb);
-    if (ret < 0)
-        goto drop;
+    if (plen > shinfo->gso_size || shinfo->gso_segs >= UDP_GRO_CNT_MAX ||
+        head->len + plen > UDP_GRO_MAX_LEN)
+        return false;
 
-    return 0;
+    skb_pull(skb, sizeof(struct udphdr));
+    skb->next = NULL;
+    if (c->gro_tail)
+        c->gro_tail->next = skb;
+    else
+        shinfo->frag_list = skb;
+    c->gro_tail = skb;
+
+    head->len += plen;
+    head->data_len += plen;
+    head->truesize += skb->truesize;
+    shinfo->gso_segs++;
+
+    if (plen < shinfo->gso_size)
+        c->gro_closed = true;
+
+    udp_statistics.udp_gro_merged++;
+    return true;
+}
+
+/* Fix up the UDP header of a finished super-skb */
+static void udp_gro_complete(struct udp_rcv_chain *c)
+{
+    struct sk_buff *head = c->gro_head;
+
+    c->gro_head = NULL;
+    if (!head || !skb_shinfo(head)->gso_size)
+        return;
+    udp_hdr(head)->len = htons(head->len);
+    udp_hdr(head)->check = 0;
+    head->ip_summed = CHECKSUM_UNNECESSARY;
+}
+
+static void udp_rcv_chain_flush(struct udp_rcv_chain *c)
+{
+    udp_gro_complete(c);
+    if (c->newest)
+        udp_rx_enqueue_batch(c->sk, c->newest, c->oldest, c->truesize);
+    memset(c, 0, sizeof(*c));
+}
+
+static void udp_rcv_chain_add(struct udp_rcv_chain *c, struct sock *sk,
+                              struct sk_buff *skb,
+                              const struct udp_flow_key *flow)
+{
+    if (c->sk != sk)
+        udp_rcv_chain_flush(c);
+    c->sk = sk;
+    c->truesize += skb->truesize;
+
+    /* Coalesce into the open super-skb if the flow continues */
+    if (c->gro_head && udp_flow_key_eq(&c->gro_flow, flow) &&
+        udp_gro_merge(c, skb))
+        return;
+    udp_gro_complete(c);
+
+    /* Link newest-first so the reader's llist_reverse_order() restores
+     * arrival order across and within batches */
+    skb->ll_node.next = c->newest ? &c->newest->ll_node : NULL;
+    c->newest = skb;
+    if (!c->oldest)
+        c->oldest = skb;
+
+    if (udp_sk(sk)->gro_enabled) {
+        c->gro_head = skb;
+        c->gro_tail = NULL;
+        c->gro_flow = *flow;
+        c->gro_closed = false;
+    }
+}
+
+/*
+ * Receive a vector of skbs. Header validation and checksum run per skb;
+ * the socket lookup is skipped for consecutive datagrams of one flow, and
+ * each run of datagrams for one socket is enqueued with a single atomic
+ * operation and a single wakeup.
+ */
+static int udp_v4_rcv_batch(struct sk_buff **skbs, unsigned int n)
+{
+    struct udp_rcv_chain chain = { 0 };
+    struct udp_flow_key flow, last_flow;
+    struct sock *sk = NULL;
+    struct udphdr *uh;
+    unsigned int i;
+    int queued = 0, pending;
+
+    udp_statistics.udp_rcv_batches++;
+
+    /* Keeps looked-up sockets alive until the chain is flushed */
+    rcu_read_lock();
+    for (i = 0; i < n; i++) {
+        struct sk_buff *skb = skbs[i];
+
+        if (i + 1 < n)
+            prefetch(skbs[i + 1]->data);
+
+        /* Validate UDP header */
+        if (!pskb_may_pull(skb, sizeof(struct udphdr)))
+            goto drop;
+
+        uh = udp_hdr(skb);
+        if (ntohs(uh->len) < sizeof(struct udphdr) ||
+            ntohs(uh->len) > skb->len)
+            goto drop;
+        if (ntohs(uh->len) < skb->len && pskb_trim_rcsum(skb, ntohs(uh->len)))
+            goto drop;
+
+        /* Verify checksum */
+        if (udp_v4_checksum(skb) < 0)
+            goto csum_error;
+
+        /* Find matching socket; reuse it while the flow is unchanged */
+        udp_flow_key_init(&flow, skb);
+        if (!sk || !udp_flow_key_eq(&flow, &last_flow)) {
+            sk = udp_v4_lookup(dev_net(skb->dev), ip_hdr(skb)->saddr,
+                               uh->source, ip_hdr(skb)->daddr,
+                               uh->dest, skb->dev->ifindex);
+            last_flow = flow;
+            if (!sk)
+                goto no_sock;
+        }
+
+        pending = chain.sk == sk ? chain.truesize : 0;
+        if (atomic_read(&udp_sk(sk)->rx_mem) + pending > sk->sk_rcvbuf) {
+            udp_statistics.udp_rcvbuf_errors++;
+            atomic_inc(&sk->sk_drops);
+            goto drop;
+        }
+
+        udp_rcv_chain_add(&chain, sk, skb, &flow);
+        udp_statistics.udp_packets++;
+        queued++;
+        continue;
 
 csum_error:
-    udp_statistics.udp_rx_csum_errors++;
-    goto drop;
+        udp_statistics.udp_rx_csum_errors++;
+        goto drop;
 
 no_sock:
-    udp_statistics.udp_noports++;
-    icmp_send(skb, ICMP_DEST_UNREACH, ICMP_PORT_UNREACH, 0);
-    goto drop;
+        udp_statistics.udp_noports++;
+        icmp_send(skb, ICMP_DEST_UNREACH, ICMP_PORT_UNREACH, 0);
+        goto drop;
 
 drop:
-    udp_statistics.udp_dropped++;
-    kfree_skb(skb);
-    return -1;
+        udp_statistics.udp_dropped++;
+        kfree_skb(skb);
+    }
+
+    udp_rcv_chain_flush(&chain);
+    rcu_read_unlock();
+    return queued;
+}
+
+static int udp_v4_rcv(struct sk_buff *skb)
+{
+    return udp_v4_rcv_batch(&skb, 1) == 1 ? 0 : -1;
 }
 
 /* UDP Socket Operations */
 
+static int udp_v4_setsockopt(struct socket *sock, int level, int optname,
+                             sockptr_t optval, unsigned int optlen)
+{
+    struct udp_sock *up = udp_sk(sock->sk);
+    int val;
+
+    if (level != SOL_UDP)
+        return -ENOPROTOOPT;
+    if (optlen < sizeof(int))
+        return -EINVAL;
+    if (copy_from_sockptr(&val, optval, sizeof(val)))
+        return -EFAULT;
+
+    switch (optname) {
+    case UDP_GRO:
+        up->gro_enabled = !!val;
+        return 0;
+    default:
+        return -ENOPROTOOPT;
+    }
+}
+
 static int udp_v4_connect(struct sock *sk, struct sockaddr *uaddr, int addr_len)
 {
     struct sockaddr_in *addr = (struct sockaddr_in *)uaddr;
@@ -190,9 +952,14 @@ static int udp_v4_connect(struct sock *sk, struct sockaddr *uaddr, int addr_len)
     if (addr->sin_family != AF_INET)
         return -EAFNOSUPPORT;
 
+    /* A connected socket only takes its own peer's traffic, so it may
+     * no longer be picked for the group's flows */
+    spin_lock_bh(&udp_hash_lock);
+    udp_reuseport_detach(sk);
     sk->sk_state = TCP_ESTABLISHED;
     up->daddr = addr->sin_addr.s_addr;
     up->dest = addr->sin_port;
+    spin_unlock_bh(&udp_hash_lock);
 
     return 0;
 }
@@ -202,6 +969,7 @@ static int udp_v4_sendmsg(struct sock *sk, struct msghdr *msg, size_t len)
     struct udp_sock *up = udp_sk(sk);
     struct sk_buff *skb;
     struct udphdr *uh;
+    __wsum csum = 0;
     int err;
 
     /* Create new skb */
@@ -213,8 +981,13 @@ static int udp_v4_sendmsg(struct sock *sk, struct msghdr *msg, size_t len)
     /* Reserve space for headers */
     skb_reserve(skb, sizeof(struct udphdr));
 
-    /* Copy data */
-    err = memcpy_from_msg(skb_put(skb, len), msg, len);
+    /* Copy data, checksumming it in the same pass */
+    if (up->checksum_zero) {
+        err = memcpy_from_msg(skb_put(skb, len), msg, len);
+    } else {
+        err = csum_and_copy_from_iter_full(skb_put(skb, len), len, &csum,
+                                           &msg->msg_iter) ? 0 : -EFAULT;
+    }
     if (err < 0) {
         kfree_skb(skb);
         return err;
@@ -229,7 +1002,8 @@ static int udp_v4_sendmsg(struct sock *sk, struct msghdr *msg, size_t len)
 
     /* Calculate checksum */
     if (!up->checksum_zero) {
-        skb->csum = csum_partial(skb->data, len + sizeof(struct udphdr), 0);
+        skb->csum = (__force __wsum)csum_sim_partial(uh, sizeof(struct udphdr),
+                                                     (__force csum_sim_t)csum);
         uh->check = csum_tcpudp_magic(up->saddr, up->daddr,
                                      len + sizeof(struct udphdr),
                                      IPPROTO_UDP, skb->csum);
@@ -248,18 +1022,13 @@ static int udp_v4_sendmsg(struct sock *sk, struct msghdr *msg, size_t len)
     return len;
 }
 
-static int udp_v4_recvmsg(struct sock *sk, struct msghdr *msg, size_t len,
-                         int flags, int *addr_len)
+/* Copy one datagram (or GRO super-datagram) out and free it */
+static int udp_v4_recv_skb(struct sock *sk, struct sk_buff *skb,
+                           struct msghdr *msg, size_t len, int *addr_len)
 {
-    struct sk_buff *skb;
     struct udphdr *uh;
     int copied, err;
 
-    /* Get next packet from receive queue */
-    skb = skb_recv_datagram(sk, flags, flags & MSG_DONTWAIT, &err);
-    if (!skb)
-        return err;
-
     uh = udp_hdr(skb);
     copied = skb->len - sizeof(struct udphdr);
     if (copied > len) {
@@ -281,16 +1050,120 @@ static int udp_v4_recvmsg(struct sock *sk, struct msghdr *msg, size_t len,
         *addr_len = sizeof(*sin);
     }
 
+    /* Tell the application how to split a coalesced datagram */
+    if (skb_shinfo(skb)->gso_size) {
+        int gso_size = skb_shinfo(skb)->gso_size;
+
+        put_cmsg(msg, SOL_UDP, UDP_GRO, sizeof(gso_size), &gso_size);
+    }
+
     err = copied;
 
 out_free:
-    skb_free_datagram(sk, skb);
+    kfree_skb(skb);
     return err;
 }
 
+static int udp_v4_recvmsg(struct sock *sk, struct msghdr *msg, size_t len,
+                         int flags, int *addr_len)
+{
+    struct sk_buff *skb;
+    int err;
+
+    /* Get next packet from receive queue */
+    skb = udp_rx_dequeue(sk, flags & MSG_DONTWAIT, &err);
+    if (!skb)
+        return err;
+
+    return udp_v4_recv_skb(sk, skb, msg, len, addr_len);
+}
+
+/* Put back datagrams a batch dequeued but did not deliver, oldest first */
+static void udp_rx_requeue(struct udp_sock *up, struct sk_buff **skbs,
+                           unsigned int n)
+{
+    spin_lock_bh(&up->reader_lock);
+    while (n--) {
+        atomic_add(skbs[n]->truesize, &up->rx_mem);
+        __skb_queue_head(&up->reader_queue, skbs[n]);
+    }
+    spin_unlock_bh(&up->reader_lock);
+}
+
+/*
+ * Receive up to vlen datagrams. Only the first may block; the rest are
+ * taken from the queue under one reader_lock hold. Stops at the first
+ * entry that fails to copy and leaves the datagrams after it queued.
+ * Returns the number of entries filled, or an error if none were.
+ */
+static int udp_v4_recvmmsg(struct sock *sk, struct udp_mmsghdr *vec,
+                           unsigned int vlen, int flags)
+{
+    struct udp_sock *up = udp_sk(sk);
+    struct sk_buff *skbs[UDP_RCV_BATCH_MAX];
+    unsigned int i, n = 0, done = 0;
+    int err, ret;
+
+    if (!vlen)
+        return 0;
+
+    skbs[n] = udp_rx_dequeue(sk, flags & MSG_DONTWAIT, &err);
+    if (!skbs[n])
+        return err;
+    n++;
+
+    vlen = min_t(unsigned int, vlen, UDP_RCV_BATCH_MAX);
+    spin_lock_bh(&up->reader_lock);
+    while (n < vlen && (skbs[n] = __udp_rx_dequeue(up)) != NULL) {
+        atomic_sub(skbs[n]->truesize, &up->rx_mem);
+        n++;
+    }
+    spin_unlock_bh(&up->reader_lock);
+
+    for (i = 0; i < n; i++) {
+        ret = udp_v4_recv_skb(sk, skbs[i], &vec[i].msg_hdr, vec[i].msg_cap,
+                              &vec[i].addr_len);
+        if (ret < 0) {
+            err = ret;
+            /* Not ours to drop; the next call picks them up */
+            udp_rx_requeue(up, &skbs[i + 1], n - i - 1);
+            break;
+        }
+        vec[i].msg_len = ret;
+        done++;
+    }
+
+    return done ? done : err;
+}
+
+/* Socket setup and teardown, run from udp_v4_prot's init/destroy hooks */
+static int udp_v4_init_sock(struct sock *sk)
+{
+    udp_rx_queue_init(udp_sk(sk));
+    return 0;
+}
+
+static void udp_v4_destroy_sock(struct sock *sk)
+{
+    udp_v4_unhash(sk);
+    udp_rx_purge(sk);
+}
+
+/* UDP Protocol */
+static struct proto udp_v4_prot = {
+    .name = "UDP_SIM",
+    .owner = THIS_MODULE,
+    .init = udp_v4_init_sock,
+    .destroy = udp_v4_destroy_sock,
+    .get_port = udp_v4_get_port,
+    .unhash = udp_v4_unhash,
+    .obj_size = sizeof(struct udp_sock),
+};
+
 /* UDP Protocol Operations */
 static const struct proto_ops udp_v4_ops = {
     .family = PF_INET,
+    .setsockopt = udp_v4_setsockopt,
     .connect = udp_v4_connect,
     .sendmsg = udp_v4_sendmsg,
     .recvmsg = udp_v4_recvmsg,
@@ -300,27 +1173,232 @@ static const struct proto_ops udp_v4_ops = {
 static struct inet_protosw udp4_protosw = {
     .type = SOCK_DGRAM,
     .protocol = IPPROTO_UDP,
-    .prot = &udp_prot,
+    .prot = &udp_v4_prot,
     .ops = &udp_v4_ops,
     .flags = INET_PROTOSW_PERMANENT,
 };
 
+/* Receive selftest: loopback datagrams through the batch path */
+
+static struct sk_buff *__init udp_selftest_skb(__be32 saddr, __be16 sport,
+                                               __be32 daddr, __be16 dport,
+                                               const void *data,
+                                               unsigned int plen)
+{
+    struct sk_buff *skb;
+    struct iphdr *iph;
+    struct udphdr *uh;
+
+    skb = alloc_skb(sizeof(*iph) + sizeof(*uh) + plen, GFP_KERNEL);
+    if (!skb)
+        return NULL;
+
+    skb_reset_network_header(skb);
+    iph = skb_put_zero(skb, sizeof(*iph));
+    iph->version = 4;
+    iph->ihl = 5;
+    iph->protocol = IPPROTO_UDP;
+    iph->saddr = saddr;
+    iph->daddr = daddr;
+    skb_pull(skb, sizeof(*iph));
+
+    skb_reset_transport_header(skb);
+    uh = skb_put_zero(skb, sizeof(*uh));
+    uh->source = sport;
+    uh->dest = dport;
+    uh->len = htons(sizeof(*uh) + plen);
+    skb_put_data(skb, data, plen);
+
+    skb->dev = init_net.loopback_dev;
+    skb->ip_summed = CHECKSUM_UNNECESSARY;
+    return skb;
+}
+
+/*
+ * Queue n copies of a plen-byte datagram in one batch and read them back
+ * with udp_v4_recvmmsg(); expect want entries of want_len bytes each.
+ */
+static int __init udp_selftest_rcv(struct sock *sk, unsigned short port,
+                                   unsigned int n, unsigned int plen,
+                                   unsigned int want, unsigned int want_len)
+{
+    static const char payload[16] = "0123456789abcdef";
+    static char bufs[4][64] __initdata;
+    struct sk_buff *skbs[4];
+    struct udp_mmsghdr vec[4];
+    struct kvec iov[4];
+    unsigned int i;
+    int ret;
+
+    for (i = 0; i < n; i++) {
+        skbs[i] = udp_selftest_skb(htonl(INADDR_LOOPBACK + 1), htons(5000),
+                                   htonl(INADDR_LOOPBACK), htons(port),
+                                   payload, plen);
+        if (!skbs[i]) {
+            while (i--)
+                kfree_skb(skbs[i]);
+            return -ENOMEM;
+        }
+    }
+    if (udp_v4_rcv_batch(skbs, n) != n)
+        return -EIO;
+
+    memset(vec, 0, sizeof(vec));
+    for (i = 0; i < ARRAY_SIZE(vec); i++) {
+        iov[i].iov_base = bufs[i];
+        iov[i].iov_len = sizeof(bufs[i]);
+        iov_iter_kvec(&vec[i].msg_hdr.msg_iter, ITER_DEST, &iov[i], 1,
+                      sizeof(bufs[i]));
+        vec[i].msg_cap = sizeof(bufs[i]);
+    }
+
+    ret = udp_v4_recvmmsg(sk, vec, ARRAY_SIZE(vec), MSG_DONTWAIT);
+    if (ret != (int)want)
+        return ret < 0 ? ret : -EIO;
+    for (i = 0; i < want; i++) {
+        if (vec[i].msg_len != want_len ||
+            memcmp(bufs[i], payload, min(want_len, plen)))
+            return -EIO;
+    }
+
+    /* Queue drained */
+    ret = udp_v4_recvmmsg(sk, vec, ARRAY_SIZE(vec), MSG_DONTWAIT);
+    return ret == -EAGAIN ? 0 : -EIO;
+}
+
+/*
+ * Queue four distinct datagrams and make the second entry's copy fault:
+ * recvmmsg returns the first, drops the faulting one, and the last two
+ * come back in order on the next call.
+ */
+static int __init udp_selftest_rcv_fault(struct sock *sk, unsigned short port)
+{
+    static const char payload[16] = "0123456789abcdef";
+    static char bufs[4][64] __initdata;
+    struct sk_buff *skbs[4];
+    struct udp_mmsghdr vec[4];
+    struct kvec iov[4];
+    unsigned int i;
+    int ret;
+
+    for (i = 0; i < ARRAY_SIZE(skbs); i++) {
+        skbs[i] = udp_selftest_skb(htonl(INADDR_LOOPBACK + 1), htons(5000),
+                                   htonl(INADDR_LOOPBACK), htons(port),
+                                   payload + i, 8);
+        if (!skbs[i]) {
+            while (i--)
+                kfree_skb(skbs[i]);
+            return -ENOMEM;
+        }
+    }
+    if (udp_v4_rcv_batch(skbs, ARRAY_SIZE(skbs)) != ARRAY_SIZE(skbs))
+        return -EIO;
+
+    memset(vec, 0, sizeof(vec));
+    for (i = 0; i < ARRAY_SIZE(vec); i++) {
+        iov[i].iov_base = bufs[i];
+        iov[i].iov_len = sizeof(bufs[i]);
+        /* Entry 1 claims room it does not have: the copy runs short */
+        iov_iter_kvec(&vec[i].msg_hdr.msg_iter, ITER_DEST, &iov[i], 1,
+                      i == 1 ? 0 : sizeof(bufs[i]));
+        vec[i].msg_cap = sizeof(bufs[i]);
+    }
+
+    ret = udp_v4_recvmmsg(sk, vec, ARRAY_SIZE(vec), MSG_DONTWAIT);
+    if (ret != 1)
+        return ret < 0 ? ret : -EIO;
+    if (vec[0].msg_len != 8 || memcmp(bufs[0], payload, 8))
+        return -EIO;
+
+    memset(vec, 0, sizeof(vec));
+    for (i = 0; i < ARRAY_SIZE(vec); i++) {
+        iov_iter_kvec(&vec[i].msg_hdr.msg_iter, ITER_DEST, &iov[i], 1,
+                      sizeof(bufs[i]));
+        vec[i].msg_cap = sizeof(bufs[i]);
+    }
+
+    ret = udp_v4_recvmmsg(sk, vec, ARRAY_SIZE(vec), MSG_DONTWAIT);
+    if (ret != 2)
+        return ret < 0 ? ret : -EIO;
+    for (i = 0; i < 2; i++) {
+        if (vec[i].msg_len != 8 || memcmp(bufs[i], payload + 2 + i, 8))
+            return -EIO;
+    }
+
+    ret = udp_v4_recvmmsg(sk, vec, ARRAY_SIZE(vec), MSG_DONTWAIT);
+    return ret == -EAGAIN ? 0 : -EIO;
+}
+
+static int __init udp_v4_selftest(void)
+{
+    const unsigned short port = 9999;
+    struct sock *sk;
+    int err;
+
+    sk = sk_alloc(&init_net, PF_INET, GFP_KERNEL, &udp_v4_prot, 1);
+    if (!sk)
+        return -ENOMEM;
+    sock_init_data(NULL, sk);
+
+    err = sk->sk_prot->init(sk);
+    if (err)
+        goto out_free;
+
+    udp_sk(sk)->saddr = htonl(INADDR_LOOPBACK);
+    err = sk->sk_prot->get_port(sk, port);
+    if (err)
+        goto out_destroy;
+
+    /* Plain datagrams come back one per entry, in order */
+    err = udp_selftest_rcv(sk, port, 3, 16, 3, 16);
+    if (err)
+        goto out_destroy;
+
+    /* A faulting entry ends the batch without losing what follows */
+    err = udp_selftest_rcv_fault(sk, port);
+    if (err)
+        goto out_destroy;
+
+    /* With GRO, same-sized datagrams coalesce into one super-datagram... */
+    udp_sk(sk)->gro_enabled = 1;
+    err = udp_selftest_rcv(sk, port, 4, 16, 1, 64);
+    if (err)
+        goto out_destroy;
+
+    /* ...but empty ones keep their boundaries */
+    err = udp_selftest_rcv(sk, port, 3, 0, 3, 0);
+
+out_destroy:
+    sk->sk_prot->destroy(sk);
+out_free:
+    sk_free(sk);
+    return err;
+}
+
 /* UDP Protocol Initialization */
 static int __init udp_v4_init(void)
 {
-    int i;
+    struct udp_table *t;
+    int err;
 
     /* Initialize hash table */
-    for (i = 0; i < UDP_HTABLE_SIZE; i++)
-        INIT_HLIST_HEAD(&udp_hash[i]);
+    get_random_bytes(&udp_hash_secret, sizeof(udp_hash_secret));
+    t = udp_table_alloc(UDP_HTABLE_SIZE, GFP_KERNEL);
+    if (!t)
+        return -ENOMEM;
+    RCU_INIT_POINTER(udp_table, t);
 
     /* Clear statistics */
     memset(&udp_statistics, 0, sizeof(udp_statistics));
 
     /* Register protocol */
-    proto_register(&udp_prot, 1);
+    proto_register(&udp_v4_prot, 1);
     inet_register_protosw(&udp4_protosw);
 
+    err = udp_v4_selftest();
+    if (err)
+        pr_warn("udp_sim: receive selftest failed: %d\n", err);
+
     return 0;
 }
 
@@ -328,7 +1406,10 @@ static int __init udp_v4_init(void)
 static void __exit udp_v4_exit(void)
 {
     inet_unregister_protosw(&udp4_protosw);
-    proto_unregister(&udp_prot);
+    proto_unregister(&udp_v4_prot);
+
+    synchronize_rcu();
+    udp_table_free(rcu_dereference_protected(udp_table, 1));
 }
 
 module_init(udp_v4_init);